@@ -357,10 +357,7 @@ void C1Wire::ReportHumidity(const std::string& deviceId,float humidity)
 
 void C1Wire::ReportPressure(const std::string& deviceId,float pressure)
 {
-   _tGeneralDevice gdevice;
-   gdevice.subtype=sTypePressure;
-   gdevice.floatval1=pressure;
-   sDecodeRXMessage(this, (const unsigned char *)&gdevice);
+   SendGeneralSensor(sTypePressure,0,pressure);
 }
 
 void C1Wire::ReportTemperatureHumidity(const std::string& deviceId,float temperature,float humidity)
@@ -449,8 +446,5 @@ void C1Wire::ReportVoltage(int unit,int voltage)
 
 void C1Wire::ReportIlluminescence(float illuminescence)
 {
-   _tGeneralDevice gdevice;
-   gdevice.subtype=sTypeSolarRadiation;
-   gdevice.floatval1=illuminescence;
-   sDecodeRXMessage(this, (const unsigned char *)&gdevice);
+   SendGeneralSensor(sTypeSolarRadiation,0,illuminescence);
 }
\ No newline at end of file
@@ -662,10 +662,7 @@ bool CDavisLoggerSerial::HandleLoopData(const unsigned char *data, size_t len)
 	if ((pData[44]!=0xFF)&&(pData[45]!=0x7F))
 	{
 		unsigned int solarRadiation=((unsigned int)((pData[45] << 8) | pData[44]));//Watt/M2
-		_tGeneralDevice gdevice;
-		gdevice.subtype=sTypeSolarRadiation;
-		gdevice.floatval1=float(solarRadiation);
-		sDecodeRXMessage(this, (const unsigned char *)&gdevice);
+		SendGeneralSensor(sTypeSolarRadiation,0,float(solarRadiation));
 
 	}
 
@@ -676,11 +673,7 @@ bool CDavisLoggerSerial::HandleLoopData(const unsigned char *data, size_t len)
 		{
 			int moister=pData[62+iMoister];
 
-			_tGeneralDevice gdevice;
-			gdevice.subtype=sTypeSoilMoisture;
-			gdevice.intval1=moister;
-			gdevice.id=1+iMoister;
-			sDecodeRXMessage(this, (const unsigned char *)&gdevice);
+			SendGeneralSensor(sTypeSoilMoisture,1+iMoister,0,moister);
 		}
 	}
 
@@ -691,11 +684,7 @@ bool CDavisLoggerSerial::HandleLoopData(const unsigned char *data, size_t len)
 		{
 			int leaf_wetness=pData[66+iLeaf];
 
-			_tGeneralDevice gdevice;
-			gdevice.subtype=sTypeLeafWetness;
-			gdevice.intval1=leaf_wetness;
-			gdevice.id=1+iLeaf;
-			sDecodeRXMessage(this, (const unsigned char *)&gdevice);
+			SendGeneralSensor(sTypeLeafWetness,1+iLeaf,0,leaf_wetness);
 		}
 	}
 
@@ -4,6 +4,8 @@
 #include "../main/Logger.h"
 #include "../main/localtime_r.h"
 #include "../main/Helper.h"
+#include "../main/RFXtrx.h"
+#include "hardwaretypes.h"
 
 CDomoticzHardwareBase::CDomoticzHardwareBase()
 {
@@ -110,3 +112,93 @@ void CDomoticzHardwareBase::SetHeartbeatReceived()
 {
 	mytime(&m_LastHeartbeatReceive);
 }
+
+void CDomoticzHardwareBase::SendGeneralSensor(const unsigned char subType, const unsigned long ID, const float floatValue, const int intValue)
+{
+	_tDeviceUpdate update;
+	update.devType=pTypeGeneral;
+	update.subType=subType;
+	update.ID=ID;
+	update.Unit=1;
+	update.floatval=floatValue;
+	update.intval=intValue;
+	sUpdateDevice(this, update);
+}
+
+void CDomoticzHardwareBase::SendUsageSensor(const unsigned long ID, const unsigned char Unit, const float usage)
+{
+	_tDeviceUpdate update;
+	update.devType=pTypeUsage;
+	update.subType=sTypeElectric;
+	update.ID=ID;
+	update.Unit=Unit;
+	update.floatval=usage;
+	update.intval=0;
+	sUpdateDevice(this, update);
+}
+
+void CDomoticzHardwareBase::SendTempSensor(const unsigned char subType, const unsigned long ID, const unsigned char Unit, const unsigned char BatteryLevel, const float temp)
+{
+	_tDeviceUpdate update;
+	update.devType=pTypeTEMP;
+	update.subType=subType;
+	update.ID=ID;
+	update.Unit=Unit;
+	update.BatteryLevel=BatteryLevel;
+	update.floatval=temp;
+	sUpdateDevice(this, update);
+}
+
+void CDomoticzHardwareBase::SendHumiditySensor(const unsigned char subType, const unsigned long ID, const unsigned char BatteryLevel, const int humidity)
+{
+	_tDeviceUpdate update;
+	update.devType=pTypeHUM;
+	update.subType=subType;
+	update.ID=ID;
+	update.Unit=1;
+	update.BatteryLevel=BatteryLevel;
+	update.intval=humidity;
+	update.intval2=Get_Humidity_Level((unsigned char)humidity);
+	sUpdateDevice(this, update);
+}
+
+void CDomoticzHardwareBase::SendTempHumSensor(const unsigned char subType, const unsigned long ID, const unsigned char Unit, const unsigned char BatteryLevel, const float temp, const int humidity)
+{
+	_tDeviceUpdate update;
+	update.devType=pTypeTEMP_HUM;
+	update.subType=subType;
+	update.ID=ID;
+	update.Unit=Unit;
+	update.BatteryLevel=BatteryLevel;
+	update.floatval=temp;
+	update.intval=humidity;
+	update.intval2=Get_Humidity_Level((unsigned char)humidity);
+	sUpdateDevice(this, update);
+}
+
+void CDomoticzHardwareBase::SendP1PowerSensor(const unsigned long powerusage1, const unsigned long powerusage2, const unsigned long powerdeliv1, const unsigned long powerdeliv2, const unsigned long usagecurrent, const unsigned long delivcurrent)
+{
+	_tDeviceUpdate update;
+	update.devType=pTypeP1Power;
+	update.subType=sTypeP1Power;
+	update.ID=1;
+	update.Unit=sTypeP1Power;
+	update.P1.powerusage1=powerusage1;
+	update.P1.powerusage2=powerusage2;
+	update.P1.powerdeliv1=powerdeliv1;
+	update.P1.powerdeliv2=powerdeliv2;
+	update.P1.usagecurrent=usagecurrent;
+	update.P1.delivcurrent=delivcurrent;
+	sUpdateDevice(this, update);
+}
+
+void CDomoticzHardwareBase::SendP1GasSensor(const unsigned long gasusage)
+{
+	_tDeviceUpdate update;
+	update.devType=pTypeP1Gas;
+	update.subType=sTypeP1Gas;
+	update.ID=1;
+	update.Unit=sTypeP1Gas;
+	update.P1.gasusage=gasusage;
+	sUpdateDevice(this, update);
+}
@@ -6,6 +6,55 @@
 //Base class with functions all notification systems should have
 #define RX_BUFFER_SIZE 40
 
+//Typed device update, handled by the main worker without building and decoding a RFXtrx packet
+struct _tDeviceUpdate
+{
+	//device key
+	unsigned char devType;
+	unsigned char subType;
+	unsigned long ID;
+	unsigned char Unit;
+	unsigned char SignalLevel;	//12 if not reported
+	unsigned char BatteryLevel;	//percentage, 255 if not reported
+	//values
+	float floatval;	//general and usage value, temperature
+	int intval;	//general value, humidity
+	int intval2;	//humidity status
+	//P1 smart meter, readings in Wh and dm3, current usage and delivery in W
+	struct
+	{
+		unsigned long powerusage1;
+		unsigned long powerusage2;
+		unsigned long powerdeliv1;
+		unsigned long powerdeliv2;
+		unsigned long usagecurrent;
+		unsigned long delivcurrent;
+		unsigned long gasusage;
+	} P1;
+	//evohome controller (Unit 0), zones and hot water, same fields as the EVOHOME1/EVOHOME2 packets
+	struct
+	{
+		unsigned char updatetype;
+		short temperature;	//1/100 degrees, on/off for the hot water state
+		unsigned char status;	//controller mode
+		unsigned char mode;
+		unsigned char controllermode;
+		unsigned short year;
+		unsigned char month;
+		unsigned char day;
+		unsigned char hrs;
+		unsigned char mins;
+		unsigned char action;
+	} EVOHOME;
+
+	_tDeviceUpdate()
+	{
+		memset(this,0,sizeof(_tDeviceUpdate));
+		SignalLevel=12;
+		BatteryLevel=255;
+	}
+};
+
 class CDomoticzHardwareBase
 {
 	friend class C1Wire;
@@ -55,6 +104,15 @@ public:
 
 	void SetHeartbeatReceived();
 
+	//Typed device updates for hardware that does not receive RFXtrx packets itself
+	void SendGeneralSensor(const unsigned char subType, const unsigned long ID, const float floatValue, const int intValue=0);
+	void SendUsageSensor(const unsigned long ID, const unsigned char Unit, const float usage);
+	void SendTempSensor(const unsigned char subType, const unsigned long ID, const unsigned char Unit, const unsigned char BatteryLevel, const float temp);
+	void SendHumiditySensor(const unsigned char subType, const unsigned long ID, const unsigned char BatteryLevel, const int humidity);
+	void SendTempHumSensor(const unsigned char subType, const unsigned long ID, const unsigned char Unit, const unsigned char BatteryLevel, const float temp, const int humidity);
+	void SendP1PowerSensor(const unsigned long powerusage1, const unsigned long powerusage2, const unsigned long powerdeliv1, const unsigned long powerdeliv2, const unsigned long usagecurrent, const unsigned long delivcurrent);
+	void SendP1GasSensor(const unsigned long gasusage);
+
 	bool IsStarted() { return m_bIsStarted; }
 	time_t m_LastHeartbeat;
 	time_t m_LastHeartbeatReceive;
@@ -67,6 +125,7 @@ public:
 	unsigned char m_rxbufferpos;
 	bool m_bEnableReceive;
 	boost::signals2::signal<void(CDomoticzHardwareBase *pHardware, const unsigned char *pRXCommand)> sDecodeRXMessage;
+	boost::signals2::signal<void(CDomoticzHardwareBase *pHardware, const _tDeviceUpdate &update)> sUpdateDevice;
 	boost::signals2::signal<void(CDomoticzHardwareBase *pDevice)> sOnConnected;
 	void *m_pUserData;
 private:
@@ -153,7 +153,7 @@ void CEcoDevices::GetMeterDetails()
 		{
 			m_lastSharedSendElectra = atime;
 			m_lastelectrausage = m_p1power.usagecurrent;
-			sDecodeRXMessage(this, (const unsigned char *)&m_p1power);
+			SendP1PowerSensor(m_p1power.powerusage1,m_p1power.powerusage2,m_p1power.powerdeliv1,m_p1power.powerdeliv2,m_p1power.usagecurrent,m_p1power.delivcurrent);
 		}
 	}
 }
@@ -1443,14 +1443,7 @@ bool CEnOceanESP2::ParseData()
 				{
 					//0xA5, 0x12, 0x01, "Electricity"
 					int cvalue=(pFrame->DATA_BYTE3<<16)|(pFrame->DATA_BYTE2<<8)|(pFrame->DATA_BYTE1);
-					_tUsageMeter umeter;
-					umeter.id1=(BYTE)pFrame->ID_BYTE3;
-					umeter.id2=(BYTE)pFrame->ID_BYTE2;
-					umeter.id3=(BYTE)pFrame->ID_BYTE1;
-					umeter.id4=(BYTE)pFrame->ID_BYTE0;
-					umeter.dunit=1;
-					umeter.fusage=(float)cvalue;
-					sDecodeRXMessage(this, (const unsigned char *)&umeter);
+					SendUsageSensor((pFrame->ID_BYTE3<<24)|(pFrame->ID_BYTE2<<16)|(pFrame->ID_BYTE1<<8)|pFrame->ID_BYTE0,1,(float)cvalue);
 				}
 				else if (szST=="AMR.Gas")
 				{
@@ -1108,14 +1108,7 @@ void CEnOceanESP3::ParseRadioDatagram()
 					{
 						//0xA5, 0x12, 0x01, "Electricity"
 						int cvalue=(DATA_BYTE3<<16)|(DATA_BYTE2<<8)|(DATA_BYTE1);
-						_tUsageMeter umeter;
-						umeter.id1=(BYTE)ID_BYTE3;
-						umeter.id2=(BYTE)ID_BYTE2;
-						umeter.id3=(BYTE)ID_BYTE1;
-						umeter.id4=(BYTE)ID_BYTE0;
-						umeter.dunit=1;
-						umeter.fusage=(float)cvalue;
-						sDecodeRXMessage(this, (const unsigned char *)&umeter);
+						SendUsageSensor((ID_BYTE3<<24)|(ID_BYTE2<<16)|(ID_BYTE1<<8)|ID_BYTE0,1,(float)cvalue);
 					}
 					else if (szST=="AMR.Gas")
 					{
@@ -447,10 +447,7 @@ void CForecastIO::GetMeterDetails()
 			float visibility=(float)atof(root["currently"]["visibility"].asString().c_str())*1.60934f; //miles to km
 			if (visibility>=0)
 			{
-				_tGeneralDevice gdevice;
-				gdevice.subtype=sTypeVisibility;
-				gdevice.floatval1=visibility;
-				sDecodeRXMessage(this, (const unsigned char *)&gdevice);
+				SendGeneralSensor(sTypeVisibility,0,visibility);
 			}
 		}
 	}
@@ -462,10 +459,7 @@ void CForecastIO::GetMeterDetails()
 			float radiation=(float)atof(root["currently"]["ozone"].asString().c_str());	//this is in dobson units, need to convert to Watt/m2? (2.69(10^20) ?
 			if (radiation>=0.0f)
 			{
-				_tGeneralDevice gdevice;
-				gdevice.subtype=sTypeSolarRadiation;
-				gdevice.floatval1=radiation;
-				sDecodeRXMessage(this, (const unsigned char *)&gdevice);
+				SendGeneralSensor(sTypeSolarRadiation,0,radiation);
 			}
 		}
 	}
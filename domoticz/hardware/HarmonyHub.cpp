@@ -395,16 +395,15 @@ void CHarmonyHub::UpdateSwitch(unsigned char idx,const char * realID, const bool
 	//sprintf(szIdx, "%X%02X%02X%02X", 0, 0, 0, idx);
 	std::stringstream szQuery;
 	std::vector<std::vector<std::string> > result;
-	szQuery << "SELECT Name,nValue,sValue FROM DeviceStatus WHERE (HardwareID==" << m_HwdID << ") AND (DeviceID=='" << hexId.str() << "')";
-	result = m_sql.query(szQuery.str()); //-V519
-	if (result.size() < 1)
+	int nvalue;
+	std::string svalue;
+	if (!m_sql.GetDeviceValue(m_HwdID, hexId.str(), 1, pTypeLighting2, sTypeAC, nvalue, svalue))
 	{
 		bDeviceExits = false;
 	}
 	else
 	{
 		//check if we have a change, if not do not update it
-		int nvalue = atoi(result[0][1].c_str());
 		if ((!bOn) && (nvalue == 0))
 			return;
 		if ((bOn && (nvalue != 0)))
@@ -448,12 +448,7 @@ void Meteostick::SendPercentage(const unsigned long Idx, const float Percentage,
 		bDeviceExits = false;
 	}
 
-	_tGeneralDevice gDevice;
-	gDevice.subtype = sTypePercentage;
-	gDevice.id = 1;
-	gDevice.floatval1 = Percentage;
-	gDevice.intval1 = (int)Idx;
-	sDecodeRXMessage(this, (const unsigned char *)&gDevice);
+	SendGeneralSensor(sTypePercentage, Idx, Percentage);
 
 	if (!bDeviceExits)
 	{
@@ -469,14 +464,14 @@ float Meteostick::GetRainSensorCounter(const unsigned char Idx)
 {
 	float counter = 0;
 
-	std::stringstream szQuery;
-	std::vector<std::vector<std::string> > result;
-	szQuery << "SELECT sValue FROM DeviceStatus WHERE (HardwareID==" << m_HwdID << ") AND (DeviceID==" << int(Idx) << ") AND (Type==" << int(pTypeRAIN) << ") AND (Subtype==" << int(sTypeRAIN3) << ")";
-	result = m_sql.query(szQuery.str());
-	if (result.size() >0)
+	char szIdx[10];
+	sprintf(szIdx, "%d", int(Idx));
+	int nValue;
+	std::string sValue;
+	if (m_sql.GetDeviceValue(m_HwdID, szIdx, 0, pTypeRAIN, sTypeRAIN3, nValue, sValue))
 	{
 		std::vector<std::string> strarray;
-		StringSplit(result[0][0], ";", strarray);
+		StringSplit(sValue, ";", strarray);
 		if (strarray.size() == 2)
 		{
 			counter = (float)atof(strarray[1].c_str());
@@ -543,11 +538,7 @@ void Meteostick::SendLeafWetnessRainSensor(const unsigned char Idx, const unsign
 		bDeviceExits = false;
 	}
 
-	_tGeneralDevice gdevice;
-	gdevice.subtype = sTypeLeafWetness;
-	gdevice.intval1 = Wetness;
-	gdevice.id = finalID;
-	sDecodeRXMessage(this, (const unsigned char *)&gdevice);
+	SendGeneralSensor(sTypeLeafWetness, finalID, 0, Wetness);
 
 	if (!bDeviceExits)
 	{
@@ -572,11 +563,7 @@ void Meteostick::SendSoilMoistureSensor(const unsigned char Idx, const unsigned
 		bDeviceExits = false;
 	}
 
-	_tGeneralDevice gdevice;
-	gdevice.subtype = sTypeSoilMoisture;
-	gdevice.intval1 = Moisture;
-	gdevice.id = finalID;
-	sDecodeRXMessage(this, (const unsigned char *)&gdevice);
+	SendGeneralSensor(sTypeSoilMoisture, finalID, 0, Moisture);
 
 	if (!bDeviceExits)
 	{
@@ -600,11 +587,7 @@ void Meteostick::SendSolarRadiationSensor(const unsigned char Idx, const float R
 		bDeviceExits = false;
 	}
 
-	_tGeneralDevice gdevice;
-	gdevice.subtype = sTypeSolarRadiation;
-	gdevice.id = (int)Idx;
-	gdevice.floatval1 = Radiation;
-	sDecodeRXMessage(this, (const unsigned char *)&gdevice);
+	SendGeneralSensor(sTypeSolarRadiation, Idx, Radiation);
 
 	if (!bDeviceExits)
 	{
@@ -68,16 +68,15 @@ void OTGWBase::UpdateSwitch(const unsigned char Idx, const bool bOn, const std::
 	sprintf(szIdx,"%X%02X%02X%02X",0,0,0,Idx);
 	std::stringstream szQuery;
 	std::vector<std::vector<std::string> > result;
-	szQuery << "SELECT Name,nValue,sValue FROM DeviceStatus WHERE (HardwareID==" << m_HwdID << ") AND (DeviceID=='" << szIdx << "')";
-	result=m_sql.query(szQuery.str()); //-V519
-	if (result.size()<1)
+	int nvalue;
+	std::string svalue;
+	if (!m_sql.GetDeviceValue(m_HwdID, szIdx, 1, pTypeLighting2, sTypeAC, nvalue, svalue))
 	{
 		bDeviceExits=false;
 	}
 	else
 	{
 		//check if we have a change, if not do not update it
-		int nvalue=atoi(result[0][1].c_str());
 		if ((!bOn)&&(nvalue==0))
 			return;
 		if ((bOn&&(nvalue!=0)))
@@ -217,12 +216,7 @@ void OTGWBase::UpdatePressureSensor(const unsigned long Idx, const float Pressur
 		bDeviceExits=false;
 	}
 
-	_tGeneralDevice gDevice;
-	gDevice.subtype=sTypePressure;
-	gDevice.id=1;
-	gDevice.floatval1=Pressure;
-	gDevice.intval1=(int)Idx;
-	sDecodeRXMessage(this, (const unsigned char *)&gDevice);
+	SendGeneralSensor(sTypePressure,Idx,Pressure);
 
 	if (!bDeviceExits)
 	{
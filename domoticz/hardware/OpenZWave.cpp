@@ -446,30 +446,15 @@ COpenZWave::~COpenZWave(void)
 //-----------------------------------------------------------------------------
 COpenZWave::NodeInfo* COpenZWave::GetNodeInfo( OpenZWave::Notification const* _notification )
 {
-	unsigned int const homeId = _notification->GetHomeId();
-	unsigned char const nodeId = _notification->GetNodeId();
-	for( std::list<NodeInfo>::iterator it = m_nodes.begin(); it != m_nodes.end(); ++it )
-	{
-		if( ( it->m_homeId == homeId ) && ( it->m_nodeId == nodeId ) )
-		{
-			return &(*it);
-		}
-	}
-
-	return NULL;
+	return GetNodeInfo(_notification->GetHomeId(), _notification->GetNodeId());
 }
 
 COpenZWave::NodeInfo* COpenZWave::GetNodeInfo( const unsigned int homeID, const int nodeID)
 {
-	for( std::list<NodeInfo>::iterator it = m_nodes.begin(); it != m_nodes.end(); ++it )
-	{
-		if( ( it->m_homeId == homeID ) && ( it->m_nodeId == nodeID ) )
-		{
-			return &(*it);
-		}
-	}
-
-	return NULL;
+	NodeMap::iterator it = m_nodes.find(GetNodeKey(homeID, nodeID));
+	if (it == m_nodes.end())
+		return NULL;
+	return &it->second;
 }
 
 void COpenZWave::WriteControllerConfig()
@@ -654,7 +639,7 @@ void COpenZWave::OnZWaveNotification( OpenZWave::Notification const* _notificati
 			nodeInfo.IsDead=false;//m_pManager->IsNodeFailed(_homeID,_nodeID);
 
 			nodeInfo.m_LastSeen = m_updateTime;
-			m_nodes.push_back( nodeInfo );
+			m_nodes[GetNodeKey(_homeID, _nodeID)] = nodeInfo;
 			AddNode(_homeID, _nodeID, &nodeInfo);
 		}
 		break;
@@ -662,15 +647,10 @@ void COpenZWave::OnZWaveNotification( OpenZWave::Notification const* _notificati
 		{
 			_log.Log(LOG_STATUS,"OpenZWave: Node Removed. HomeID: %u, NodeID: %d",_homeID,_nodeID);
 			// Remove the node from our list
-			for( std::list<NodeInfo>::iterator it = m_nodes.begin(); it != m_nodes.end(); ++it )
+			if (m_nodes.erase(GetNodeKey(_homeID, _nodeID)) > 0)
 			{
-				if( ( it->m_homeId == _homeID ) && ( it->m_nodeId == _nodeID ) )
-				{
-					m_nodes.erase( it );
-					DeleteNode(_homeID, _nodeID);
-					WriteControllerConfig();
-					break;
-				}
+				DeleteNode(_homeID, _nodeID);
+				WriteControllerConfig();
 			}
 		}
 		break;
@@ -1136,21 +1116,7 @@ void COpenZWave::SwitchLight(const int nodeID, const int instanceID, const int c
 			instance=vID.GetInstance();//(See note on top of this file) GetInstance();
 		}
 
-		std::stringstream sstr;
-		sstr << int(NodeID) << ".instances." << int(instance) << ".commandClasses." << int(commandclass) << ".data";
-		std::string path=sstr.str();
-
-		_tZWaveDevice *pDevice=NULL;
-		std::map<std::string,_tZWaveDevice>::iterator itt;
-		for (itt=m_devices.begin(); itt!=m_devices.end(); ++itt)
-		{
-			std::string::size_type loc = path.find(itt->second.string_id,0);
-			if (loc!=std::string::npos)
-			{
-				pDevice=&itt->second;
-				break;
-			}
-		}
+		_tZWaveDevice *pDevice=FindValueDevice(NodeID,instance,commandclass,-1);
 		if (pDevice!=NULL)
 		{
 			pDevice->intvalue=value;
@@ -1884,9 +1850,7 @@ void COpenZWave::UpdateValue(const OpenZWave::ValueID vID)
 	}
 
 	time_t atime=mytime(NULL);
-	std::stringstream sstr;
-	sstr << int(NodeID) << ".instances." << int(instance) << ".commandClasses." << int(commandclass) << ".data";
-
+	int scaleID=-1;
 	if (
 		(vLabel=="Energy")||
 		(vLabel=="Power")||
@@ -1895,7 +1859,6 @@ void COpenZWave::UpdateValue(const OpenZWave::ValueID vID)
 		(vLabel=="Power Factor")
 		)
 	{
-		int scaleID=0;
 		if (vLabel=="Energy")
 			scaleID=SCALEID_ENERGY;
 		else if (vLabel=="Power")
@@ -1906,10 +1869,7 @@ void COpenZWave::UpdateValue(const OpenZWave::ValueID vID)
 			scaleID=SCALEID_CURRENT;
 		else if (vLabel=="Power Factor")
 			scaleID=SCALEID_POWERFACTOR;
-
-		sstr << "." << scaleID;
 	}
-	std::string path=sstr.str();
 
 #ifdef DEBUG_ZWAVE_INT
 	_log.Log(LOG_NORM, "OpenZWave: Value_Changed: Node: %d, CommandClass: %s, Label: %s, Instance: %d, Index: %d",NodeID, cclassStr(commandclass),vLabel.c_str(),vID.GetInstance(),vID.GetIndex());
@@ -1987,17 +1947,7 @@ void COpenZWave::UpdateValue(const OpenZWave::ValueID vID)
 		return;
 	}
 
-	_tZWaveDevice *pDevice=NULL;
-	std::map<std::string,_tZWaveDevice>::iterator itt;
-	for (itt=m_devices.begin(); itt!=m_devices.end(); ++itt)
-	{
-		std::string::size_type loc = path.find(itt->second.string_id,0);
-		if (loc!=std::string::npos)
-		{
-			pDevice=&itt->second;
-			break;
-		}
-	}
+	_tZWaveDevice *pDevice=FindValueDevice(NodeID,instance,commandclass,scaleID);
 	if (pDevice==NULL)
 		return;
 
@@ -120,7 +120,9 @@ private:
 
 	OpenZWave::Manager *m_pManager;
 
-	std::list<NodeInfo> m_nodes;
+	typedef boost::unordered_map<unsigned long long,NodeInfo> NodeMap;
+	NodeMap m_nodes;
+	static unsigned long long GetNodeKey(const unsigned int homeID, const int nodeID) { return ((unsigned long long)homeID<<8)|(nodeID&0xFF); }
 	boost::mutex m_NotificationMutex;
 
 	std::string m_szSerialPort;
@@ -156,7 +156,7 @@ void P1MeterBase::MatchLine()
 		if (m_exclmarkfound) {
 			bool bSend2Shared=false;
 			time_t atime=mytime(NULL);
-			sDecodeRXMessage(this, (const unsigned char *)&m_p1power);//decode message
+			SendP1PowerSensor(m_p1power.powerusage1,m_p1power.powerusage2,m_p1power.powerdeliv1,m_p1power.powerdeliv2,m_p1power.usagecurrent,m_p1power.delivcurrent);
 			bSend2Shared=(atime-m_lastSharedSendElectra>59);
 			if (abs(double(m_lastelectrausage)-double(m_p1power.usagecurrent))>40)
 				bSend2Shared=true;
@@ -173,7 +173,7 @@ void P1MeterBase::MatchLine()
 				//only update gas when there is a new value, or 5 minutes are passed
 				m_lastSharedSendGas=atime;
 				m_lastgasusage=m_p1gas.gasusage;
-				sDecodeRXMessage(this, (const unsigned char *)&m_p1gas);//decode message
+				SendP1GasSensor(m_p1gas.gasusage);
 			}
 			m_exclmarkfound=0;
 		}
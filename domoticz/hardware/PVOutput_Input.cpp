@@ -200,12 +200,7 @@ void CPVOutputInput::SendVoltage(const unsigned long Idx, const float Volt, cons
 		bDeviceExits=false;
 	}
 
-	_tGeneralDevice gDevice;
-	gDevice.subtype=sTypeVoltage;
-	gDevice.id=1;
-	gDevice.floatval1=Volt;
-	gDevice.intval1=(int)Idx;
-	sDecodeRXMessage(this, (const unsigned char *)&gDevice);
+	SendGeneralSensor(sTypeVoltage,Idx,Volt);
 
 	if (!bDeviceExits)
 	{
@@ -234,12 +229,7 @@ void CPVOutputInput::SendPercentage(const unsigned long Idx, const float Percent
 		bDeviceExits=false;
 	}
 
-	_tGeneralDevice gDevice;
-	gDevice.subtype=sTypePercentage;
-	gDevice.id=1;
-	gDevice.floatval1=Percentage;
-	gDevice.intval1=(int)Idx;
-	sDecodeRXMessage(this, (const unsigned char *)&gDevice);
+	SendGeneralSensor(sTypePercentage,Idx,Percentage);
 
 	if (!bDeviceExits)
 	{
@@ -255,17 +245,16 @@ void CPVOutputInput::SendPercentage(const unsigned long Idx, const float Percent
 bool CPVOutputInput::GetMeter(const unsigned char ID1,const unsigned char ID2, double &musage, double &mtotal)
 {
 	int Idx=(ID1 * 256) + ID2;
-	bool bDeviceExits=true;
-	std::stringstream szQuery;
-	std::vector<std::vector<std::string> > result;
-	szQuery << "SELECT Name, sValue FROM DeviceStatus WHERE (HardwareID==" << m_HwdID << ") AND (DeviceID==" << int(Idx) << ") AND (Type==" << int(pTypeENERGY) << ") AND (Subtype==" << int(sTypeELEC2) << ")";
-	result=m_sql.query(szQuery.str());
-	if (result.size()<1)
+	char szIdx[10];
+	sprintf(szIdx,"%d",Idx);
+	int nValue;
+	std::string sValue;
+	if (!m_sql.GetDeviceValue(m_HwdID, szIdx, 0, pTypeENERGY, sTypeELEC2, nValue, sValue))
 	{
 		return false;
 	}
 	std::vector<std::string> splitresult;
-	StringSplit(result[0][1],";",splitresult);
+	StringSplit(sValue,";",splitresult);
 	if (splitresult.size()!=2)
 		return false;
 	musage=atof(splitresult[0].c_str());
@@ -22,6 +22,12 @@
 	#define DEBUG_ZWAVE_INT
 #endif
 
+//Poll intervals, fast after a command was sent, backing off to the idle interval when nothing changes
+#define RAZBERRY_POLL_FAST_MS 100
+#define RAZBERRY_POLL_ACTIVE_MS 500
+#define RAZBERRY_POLL_IDLE_MS 2000
+#define RAZBERRY_FAST_POLLS 30
+
 static std::string readInputTestFile( const char *path )
 {
 	FILE *file = fopen( path, "rb" );
@@ -40,6 +46,98 @@ static std::string readInputTestFile( const char *path )
 	return text;
 }
 
+static const char *JsonSkipSpace(const char *p, const char *pEnd)
+{
+	while ((p<pEnd)&&((*p==' ')||(*p=='\t')||(*p=='\r')||(*p=='\n')))
+		p++;
+	return p;
+}
+
+//Reads the string at p (including the quotes), returns the position after it or NULL when invalid
+static const char *JsonReadString(const char *p, const char *pEnd, std::string *pStr)
+{
+	if ((p>=pEnd)||(*p!='"'))
+		return NULL;
+	p++;
+	if (pStr)
+		pStr->clear();
+	while (p<pEnd)
+	{
+		char c=*p++;
+		if (c=='"')
+			return p;
+		if (c=='\\')
+		{
+			if (p>=pEnd)
+				return NULL;
+			c=*p++;
+			if (c=='u')
+			{
+				//not used in the keys we look at, kept as is
+				if (pEnd-p<4)
+					return NULL;
+				if (pStr)
+				{
+					pStr->append("\\u");
+					pStr->append(p,4);
+				}
+				p+=4;
+				continue;
+			}
+			switch (c)
+			{
+			case 'b': c='\b'; break;
+			case 'f': c='\f'; break;
+			case 'n': c='\n'; break;
+			case 'r': c='\r'; break;
+			case 't': c='\t'; break;
+			}
+		}
+		if (pStr)
+			pStr->push_back(c);
+	}
+	return NULL;
+}
+
+//Skips the value at p without materialising it, returns the position after it or NULL when invalid
+static const char *JsonSkipValue(const char *p, const char *pEnd)
+{
+	p=JsonSkipSpace(p,pEnd);
+	if (p>=pEnd)
+		return NULL;
+	if (*p=='"')
+		return JsonReadString(p,pEnd,NULL);
+	if ((*p=='{')||(*p=='['))
+	{
+		int depth=0;
+		while (p<pEnd)
+		{
+			char c=*p;
+			if (c=='"')
+			{
+				p=JsonReadString(p,pEnd,NULL);
+				if (p==NULL)
+					return NULL;
+				continue;
+			}
+			p++;
+			if ((c=='{')||(c=='['))
+				depth++;
+			else if ((c=='}')||(c==']'))
+			{
+				if (--depth==0)
+					return p;
+			}
+		}
+		return NULL;
+	}
+	//number, true, false or null
+	const char *pStart=p;
+	while ((p<pEnd)&&(*p!=',')&&(*p!='}')&&(*p!=']')&&(*p!=' ')&&(*p!='\t')&&(*p!='\r')&&(*p!='\n'))
+		p++;
+	return (p>pStart)?p:NULL;
+}
+
 CRazberry::CRazberry(const int ID, const std::string &ipaddress, const int port, const std::string &username, const std::string &password)
 {
 	m_HwdID=ID;
@@ -48,11 +146,16 @@ CRazberry::CRazberry(const int ID, const std::string &ipaddress, const int port,
 	m_username=username;
 	m_password=password;
 	m_controllerID=0;
+	m_pUpdateSession=NULL;
+	m_pCommandSession=NULL;
+	m_nFastPolls=0;
 }
 
 
 CRazberry::~CRazberry(void)
 {
+	HTTPClient::DestroySession(m_pUpdateSession);
+	HTTPClient::DestroySession(m_pCommandSession);
 }
 
 void CRazberry::StopHardwareIntern()
@@ -80,27 +183,46 @@ const std::string CRazberry::GetRunURL(const std::string &cmd)
 	return sUrl.str();
 }
 
+bool CRazberry::GetControllerData()
+{
+	if (m_pUpdateSession==NULL)
+	{
+		m_pUpdateSession=HTTPClient::CreateSession();
+		if (m_pUpdateSession==NULL)
+			return false;
+	}
+	//clear keeps the capacity, so the buffer is not reallocated for every poll
+	m_updateBuffer.clear();
+	if (!HTTPClient::GETSession(m_pUpdateSession,GetControllerURL(),m_updateBuffer))
+	{
+		//reconnect on the next poll
+		HTTPClient::DestroySession(m_pUpdateSession);
+		m_pUpdateSession=NULL;
+		return false;
+	}
+	m_updateBuffer.push_back(0);
+	return true;
+}
+
 bool CRazberry::GetInitialDevices()
 {
 	m_updateTime=0;
-	std::string sResult;
 #ifndef DEBUG_ZWAVE_INT	
-	std::string szURL=GetControllerURL();
-
-	bool bret;
-	bret=HTTPClient::GET(szURL,sResult);
-	if (!bret)
+	if (!GetControllerData())
 	{
 		_log.Log(LOG_ERROR,"Razberry: Error getting data!");
 		return 0;
 	}
 #else
-	sResult=readInputTestFile("test.json");
+	std::string sResult=readInputTestFile("test.json");
+	m_updateBuffer.assign(sResult.begin(),sResult.end());
+	m_updateBuffer.push_back(0);
 #endif
 	Json::Value root;
 
 	Json::Reader jReader;
-	bool ret=jReader.parse(sResult,root);
+	const char *pData=(const char*)&m_updateBuffer[0];
+	bool ret=jReader.parse(pData,pData+m_updateBuffer.size()-1,root,false);
 	if (!ret)
 	{
 		_log.Log(LOG_ERROR,"Razberry: Invalid data received!");
@@ -132,57 +254,153 @@ bool CRazberry::GetInitialDevices()
 
 bool CRazberry::GetUpdates()
 {
-	std::string sResult;
 #ifndef	DEBUG_ZWAVE_INT
-	std::string szURL=GetControllerURL();
-	bool bret;
-	bret=HTTPClient::GET(szURL,sResult);
-	if (!bret)
+	if (!GetControllerData())
 	{
 		_log.Log(LOG_ERROR,"Razberry: Error getting update data!");
+		SetNextPollInterval(false,false);
 		return 0;
 	}
 #else
-	sResult=readInputTestFile("update.json");
+	std::string sResult=readInputTestFile("update.json");
+	m_updateBuffer.assign(sResult.begin(),sResult.end());
+	m_updateBuffer.push_back(0);
 #endif
-	Json::Value root;
-
-	Json::Reader jReader;
-	bool ret=jReader.parse(sResult,root);
-	if (!ret)
+	int nUpdates=ParseUpdates((const char*)&m_updateBuffer[0],m_updateBuffer.size()-1);
+	if (nUpdates<0)
 	{
 		_log.Log(LOG_ERROR,"Razberry: Invalid data received!");
+		SetNextPollInterval(false,false);
 		return 0;
 	}
+	SetNextPollInterval(true,nUpdates>0);
+	return true;
+}
 
-	for (Json::Value::iterator itt=root.begin(); itt!=root.end(); ++itt)
+int CRazberry::ParseUpdates(const char *pData, const size_t nLength)
+{
+	//The response is one object with "updateTime", an optional "devices" tree
+	//and the changed values keyed on their path (devices.<node>.instances.<instance>...)
+	//Only values of paths we can use are parsed into a Json::Value
+	const char *pEnd=pData+nLength;
+	const char *p=JsonSkipSpace(pData,pEnd);
+	if ((p>=pEnd)||(*p!='{'))
+		return -1;
+	p=JsonSkipSpace(p+1,pEnd);
+	if ((p<pEnd)&&(*p=='}'))
+		return 0;
+
+	int nUpdates=0;
+	std::string kName;
+	Json::Reader jReader;
+	while (p<pEnd)
 	{
-		std::string kName=itt.key().asString();
-		const Json::Value obj=(*itt);
+		p=JsonReadString(p,pEnd,&kName);
+		if (p==NULL)
+			return -1;
+		p=JsonSkipSpace(p,pEnd);
+		if ((p>=pEnd)||(*p!=':'))
+			return -1;
+		const char *pValue=JsonSkipSpace(p+1,pEnd);
+		p=JsonSkipValue(pValue,pEnd);
+		if (p==NULL)
+			return -1;
 
 		if (kName=="updateTime")
 		{
-			std::string supdateTime=obj.asString();
-			m_updateTime=(time_t)atol(supdateTime.c_str());
+			//the buffer is zero terminated, atol stops at the end of the value
+			if (*pValue=='"')
+				pValue++;
+			m_updateTime=(time_t)atol(pValue);
 		}
 		else if (kName=="devices")
 		{
-			parseDevices(obj);
+			//new or changed device structure
+			Json::Value devroot;
+			if (jReader.parse(pValue,p,devroot,false))
+			{
+				parseDevices(devroot);
+				nUpdates++;
+			}
 		}
-		else
+		else if (IsWantedPath(kName))
 		{
-			std::vector<std::string> results;
-			StringSplit(kName,".",results);
-
-			if (results.size()>1)
+			Json::Value obj;
+			if (jReader.parse(pValue,p,obj,false))
 			{
-				if (kName.find("lastReceived")==std::string::npos)
-					UpdateDevice(kName,obj);
+				UpdateDevice(kName,obj);
+				nUpdates++;
 			}
 		}
+
+		p=JsonSkipSpace(p,pEnd);
+		if (p>=pEnd)
+			return -1;
+		if (*p=='}')
+			return nUpdates;
+		if (*p!=',')
+			return -1;
+		p=JsonSkipSpace(p+1,pEnd);
 	}
+	return -1;
+}
 
-	return true;
+bool CRazberry::IsWantedPath(const std::string &path)
+{
+	if (path.compare(0,8,"devices.")!=0)
+		return false;
+	if (path.find(".instances.")==std::string::npos)
+		return false;
+	if (
+		(path.find("lastReceived")!=std::string::npos)||
+		(path.find("srcId")!=std::string::npos)||
+		(path.find("sensorTime")!=std::string::npos)
+		)
+		return false;
+	//these can create a new device
+	if (
+		(path.find(".data.level")!=std::string::npos)||
+		(path.find("commandClasses.43.data.currentScene")!=std::string::npos)
+		)
+		return true;
+	int nodeID=atoi(path.c_str()+8);
+	return (m_node_devices.find(nodeID)!=m_node_devices.end());
+}
+
+void CRazberry::SetNextPollInterval(const bool bSuccess, const bool bActive)
+{
+	if (!bSuccess)
+	{
+		//controller unreachable or bad reply, stop fast polling and back off
+		m_nFastPolls=0;
+		int nInterval=m_PollIntervalMS;
+		if (nInterval<RAZBERRY_POLL_ACTIVE_MS)
+			nInterval=RAZBERRY_POLL_ACTIVE_MS;
+		nInterval*=2;
+		if (nInterval>RAZBERRY_POLL_IDLE_MS)
+			nInterval=RAZBERRY_POLL_IDLE_MS;
+		m_PollIntervalMS=nInterval;
+		return;
+	}
+	int nFastPolls=m_nFastPolls;
+	if (nFastPolls>0)
+	{
+		//if this fails a new command just restarted the fast polls, keep its count
+		m_nFastPolls.compare_exchange_strong(nFastPolls,nFastPolls-1);
+		m_PollIntervalMS=RAZBERRY_POLL_FAST_MS;
+	}
+	else if (bActive)
+	{
+		m_PollIntervalMS=RAZBERRY_POLL_ACTIVE_MS;
+	}
+	else
+	{
+		int nInterval=m_PollIntervalMS;
+		nInterval+=nInterval/2;
+		if (nInterval>RAZBERRY_POLL_IDLE_MS)
+			nInterval=RAZBERRY_POLL_IDLE_MS;
+		m_PollIntervalMS=nInterval;
+	}
 }
 
 void CRazberry::parseDevices(const Json::Value &devroot)
@@ -608,15 +826,15 @@ void CRazberry::UpdateDevice(const std::string &path, const Json::Value &obj)
 	}
 	if (pDevice==NULL)
 	{
-		std::map<std::string,_tZWaveDevice>::iterator itt;
-		for (itt=m_devices.begin(); itt!=m_devices.end(); ++itt)
+		//devices.<node>.instances.<instance>.commandClasses.<class>.data[.<scale>].<field>
+		std::vector<std::string> results;
+		StringSplit(path,".",results);
+		if ((results.size()>=7)&&(results[0]=="devices")&&(results[2]=="instances")&&(results[4]=="commandClasses")&&(results[6]=="data"))
 		{
-			std::string::size_type loc = path.find(itt->second.string_id,0);
-			if (loc!=std::string::npos)
-			{
-				pDevice=&itt->second;
-				break;
-			}
+			int scaleID=-1;
+			if ((results.size()>7)&&(!results[7].empty())&&(isdigit((unsigned char)results[7][0])))
+				scaleID=atoi(results[7].c_str());
+			pDevice=FindValueDevice(atoi(results[1].c_str()),atoi(results[3].c_str()),atoi(results[5].c_str()),scaleID);
 		}
 	}
 
@@ -691,9 +909,7 @@ void CRazberry::UpdateDevice(const std::string &path, const Json::Value &obj)
 		for (int iInst=0; iInst<7; iInst++)
 		{
 			_device.instanceID=iInst;
-			std:: string devicestring_id=GenerateDeviceStringID(&_device);
-			std::map<std::string,_tZWaveDevice>::iterator iDevice=m_devices.find(devicestring_id);
-			if (iDevice!=m_devices.end())
+			if (FindDeviceByKey(_device.nodeID,_device.instanceID,_device.commandClassID,_device.scaleID)!=NULL)
 			{
 				bFoundInstance=true;
 				break;
@@ -705,11 +921,9 @@ void CRazberry::UpdateDevice(const std::string &path, const Json::Value &obj)
 		InsertDevice(_device);
 
 		//find device again
-		std:: string devicestring_id=GenerateDeviceStringID(&_device);
-		std::map<std::string,_tZWaveDevice>::iterator iDevice=m_devices.find(devicestring_id);
-		if (iDevice==m_devices.end())
+		pDevice=FindDeviceByKey(_device.nodeID,_device.instanceID,_device.commandClassID,_device.scaleID);
+		if (pDevice==NULL)
 			return; //uhuh?
-		pDevice=&iDevice->second;
 	}
 
 	time_t atime=mytime(NULL);
@@ -821,28 +1035,28 @@ void CRazberry::UpdateDevice(const std::string &path, const Json::Value &obj)
 
 ZWaveBase::_tZWaveDevice* CRazberry::FindDeviceByScale(const int nodeID, const int scaleID)
 {
-	std::map<std::string,_tZWaveDevice>::iterator itt;
-	for (itt=m_devices.begin(); itt!=m_devices.end(); ++itt)
+	std::map<int,std::vector<_tZWaveDevice*> >::iterator inode=m_node_devices.find(nodeID);
+	if (inode==m_node_devices.end())
+		return NULL;
+	std::vector<_tZWaveDevice*>::iterator itt;
+	for (itt=inode->second.begin(); itt!=inode->second.end(); ++itt)
 	{
-		if (
-			(itt->second.nodeID==nodeID)&&
-			(itt->second.scaleID==scaleID)
-			)
-			return &itt->second;
+		if ((*itt)->scaleID==scaleID)
+			return *itt;
 	}
 	return NULL;
 }
 
 ZWaveBase::_tZWaveDevice* CRazberry::FindDeviceInstance(const int nodeID, const int instanceID)
 {
-	std::map<std::string,_tZWaveDevice>::iterator itt;
-	for (itt=m_devices.begin(); itt!=m_devices.end(); ++itt)
+	std::map<int,std::vector<_tZWaveDevice*> >::iterator inode=m_node_devices.find(nodeID);
+	if (inode==m_node_devices.end())
+		return NULL;
+	std::vector<_tZWaveDevice*>::iterator itt;
+	for (itt=inode->second.begin(); itt!=inode->second.end(); ++itt)
 	{
-		if (
-			(itt->second.nodeID==nodeID)&&
-			(itt->second.instanceID==instanceID)
-			)
-			return &itt->second;
+		if ((*itt)->instanceID==instanceID)
+			return *itt;
 	}
 	return NULL;
 }
@@ -867,14 +1081,20 @@ void CRazberry::SetThermostatSetPoint(const int nodeID, const int instanceID, co
 
 void CRazberry::RunCMD(const std::string &cmd)
 {
-	std::string szURL=GetRunURL(cmd);
-	bool bret;
-	std::string sResult;
-	bret=HTTPClient::GET(szURL,sResult);
-	if (!bret)
+	boost::mutex::scoped_lock l(m_command_mutex);
+	if (m_pCommandSession==NULL)
+		m_pCommandSession=HTTPClient::CreateSession();
+	std::vector<unsigned char> vResult;
+	if ((m_pCommandSession==NULL)||(!HTTPClient::GETSession(m_pCommandSession,GetRunURL(cmd),vResult)))
 	{
 		_log.Log(LOG_ERROR,"Razberry: Error sending command to controller!");
+		HTTPClient::DestroySession(m_pCommandSession);
+		m_pCommandSession=NULL;
+		return;
 	}
+	//poll fast for a while, so the new state is reported quickly
+	m_nFastPolls=RAZBERRY_FAST_POLLS;
+	m_PollIntervalMS=RAZBERRY_POLL_FAST_MS;
 }
 
 bool CRazberry::IncludeDevice()
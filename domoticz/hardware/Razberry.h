@@ -1,7 +1,10 @@
 #pragma once
 
 #include <map>
+#include <vector>
 #include <time.h>
+#include <boost/thread/mutex.hpp>
+#include <boost/atomic.hpp>
 #include "ZWaveBase.h"
 
 namespace Json
@@ -20,6 +23,11 @@ public:
 private:
 	const std::string GetControllerURL();
 	const std::string GetRunURL(const std::string &cmd);
+	bool GetControllerData();
+	//Walks the update response without building the document, returns the number of values handled or -1 when invalid
+	int ParseUpdates(const char *pData, const size_t nLength);
+	bool IsWantedPath(const std::string &path);
+	void SetNextPollInterval(const bool bSuccess, const bool bActive);
 	void parseDevices(const Json::Value &devroot);
 	void UpdateDevice(const std::string &path, const Json::Value &obj);
 
@@ -39,6 +47,14 @@ private:
 	std::string m_username;
 	std::string m_password;
 	int m_controllerID;
+
+	//keep-alive connections, one for the update thread and one for commands
+	void *m_pUpdateSession;
+	void *m_pCommandSession;
+	boost::mutex m_command_mutex;
+	std::vector<unsigned char> m_updateBuffer;
+	//polls left at the fast interval after a command was sent, set by the command thread
+	boost::atomic<int> m_nFastPolls;
 };
 
 
@@ -37,14 +37,14 @@ void S0MeterBase::ReloadLastTotals()
 		m_meters[ii].m_last_values[3]=0;
 
 		char szTmp[300];
-		std::vector<std::vector<std::string> > result;
+		int nValue;
+		std::string sValue;
 		std::vector<std::string> results;
 
-		sprintf(szTmp,"SELECT sValue FROM DeviceStatus WHERE (HardwareID=%d AND DeviceID='%d' AND Unit=0 AND Type=%d AND SubType=%d)",m_HwdID, ii+1, pTypeENERGY, sTypeELEC2);
-		result=m_sql.query(szTmp);
-		if (result.size()==1)
+		sprintf(szTmp,"%d",ii+1);
+		if (m_sql.GetDeviceValue(m_HwdID, szTmp, 0, pTypeENERGY, sTypeELEC2, nValue, sValue))
 		{
-			StringSplit(result[0][0],";",results);
+			StringSplit(sValue,";",results);
 			if (results.size()==2)
 			{
 				m_meters[ii].m_volume_total=atof(results[1].c_str())/1000.0;
@@ -129,12 +129,7 @@ void S0MeterBase::SendMeter(unsigned char ID, double musage, double mtotal)
 	else if (meterype==MTYPE_GAS)
 	{
 		//can only be one gas meter...
-		P1Gas	m_p1gas;
-		m_p1gas.len=sizeof(P1Gas)-1;
-		m_p1gas.type=pTypeP1Gas;
-		m_p1gas.subtype=sTypeP1Gas;
-		m_p1gas.gasusage=(unsigned long)(mtotal*1000.0);
-		sDecodeRXMessage(this, (const unsigned char *)&m_p1gas);//decode message
+		SendP1GasSensor((unsigned long)(mtotal*1000.0));
 	}
 	else
 	{
@@ -258,7 +258,7 @@ void Teleinfo::MatchLine()
 					//_log.Log(LOG_NORM,"powerusage2 = %lu", m_p1power.powerusage2);
 					//_log.Log(LOG_NORM,"usagecurrent = %lu", m_p1power.usagecurrent);
 					 m_p1power.usagecurrent /= m_counter;
-					sDecodeRXMessage(this, (const unsigned char *)&m_p1power);
+					SendP1PowerSensor(m_p1power.powerusage1,m_p1power.powerusage2,m_p1power.powerdeliv1,m_p1power.powerdeliv2,m_p1power.usagecurrent,m_p1power.delivcurrent);
 					m_counter = 0;
 					m_p1power.usagecurrent = 0;
 				}
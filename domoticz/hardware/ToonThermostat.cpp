@@ -258,16 +258,15 @@ void CToonThermostat::UpdateSwitch(const unsigned char Idx, const bool bOn, cons
 	sprintf(szIdx, "%X%02X%02X%02X", 0, 0, 0, Idx);
 	std::stringstream szQuery;
 	std::vector<std::vector<std::string> > result;
-	szQuery << "SELECT Name,nValue,sValue FROM DeviceStatus WHERE (HardwareID==" << m_HwdID << ") AND (DeviceID=='" << szIdx << "')";
-	result = m_sql.query(szQuery.str()); //-V519
-	if (result.size() < 1)
+	int nvalue;
+	std::string svalue;
+	if (!m_sql.GetDeviceValue(m_HwdID, szIdx, 1, pTypeLighting2, sTypeAC, nvalue, svalue))
 	{
 		bDeviceExits = false;
 	}
 	else
 	{
 		//check if we have a change, if not do not update it
-		int nvalue = atoi(result[0][1].c_str());
 		if ((!bOn) && (nvalue == 0))
 			return;
 		if ((bOn && (nvalue != 0)))
@@ -566,7 +565,7 @@ void CToonThermostat::GetMeterDetails()
 		{
 			m_lastSharedSendElectra = atime;
 			m_lastelectrausage = m_p1power.usagecurrent;
-			sDecodeRXMessage(this, (const unsigned char *)&m_p1power);
+			SendP1PowerSensor(m_p1power.powerusage1,m_p1power.powerusage2,m_p1power.powerdeliv1,m_p1power.powerdeliv2,m_p1power.usagecurrent,m_p1power.delivcurrent);
 		}
 	}
 	
@@ -580,7 +579,7 @@ void CToonThermostat::GetMeterDetails()
 		{
 			m_lastSharedSendGas = atime;
 			m_lastgasusage = m_p1gas.gasusage;
-			sDecodeRXMessage(this, (const unsigned char *)&m_p1gas);
+			SendP1GasSensor(m_p1gas.gasusage);
 		}
 	}
 }
@@ -450,10 +450,7 @@ void CWunderground::GetMeterDetails()
 			float visibility=(float)atof(root["current_observation"]["visibility_km"].asString().c_str());
 			if (visibility>=0)
 			{
-				_tGeneralDevice gdevice;
-				gdevice.subtype=sTypeVisibility;
-				gdevice.floatval1=visibility;
-				sDecodeRXMessage(this, (const unsigned char *)&gdevice);
+				SendGeneralSensor(sTypeVisibility,0,visibility);
 			}
 		}
 	}
@@ -465,10 +462,7 @@ void CWunderground::GetMeterDetails()
 			float radiation=(float)atof(root["current_observation"]["solarradiation"].asString().c_str());
 			if (radiation>=0.0f)
 			{
-				_tGeneralDevice gdevice;
-				gdevice.subtype=sTypeSolarRadiation;
-				gdevice.floatval1=radiation;
-				sDecodeRXMessage(this, (const unsigned char *)&gdevice);
+				SendGeneralSensor(sTypeSolarRadiation,0,radiation);
 			}
 		}
 	}
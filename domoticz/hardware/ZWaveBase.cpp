@@ -16,6 +16,9 @@
 #include "../main/mainworker.h"
 
 #define CONTROLLER_COMMAND_TIMEOUT 20
+//Granularity of the poll interval, the heartbeat is checked every tick
+#define ZWAVE_POLL_TICK_MS 100
+#define ZWAVE_POLL_INTERVAL_MS 500
 
 #pragma warning(disable: 4996)
 
@@ -26,6 +29,7 @@ ZWaveBase::ZWaveBase()
 	m_LastIncludedNode=0;
 	m_bControllerCommandInProgress=false;
 	m_updateTime=0;
+	m_PollIntervalMS=ZWAVE_POLL_INTERVAL_MS;
 }
 
 
@@ -66,9 +70,11 @@ void ZWaveBase::Do_Work()
 	//prevent OpenZWave locale from taking over
 	_configthreadlocale(_ENABLE_PER_THREAD_LOCALE);
 #endif
+	int nPollWait=0;
 	while (!m_stoprequested)
 	{
-		sleep_milliseconds(500);
+		sleep_milliseconds(ZWAVE_POLL_TICK_MS);
+		nPollWait+=ZWAVE_POLL_TICK_MS;
 
 		time_t atime = mytime(NULL);
 		struct tm ltime;
@@ -81,6 +87,9 @@ void ZWaveBase::Do_Work()
 
 		if (m_stoprequested)
 			return;
+		if (nPollWait<m_PollIntervalMS)
+			continue;
+		nPollWait=0;
 		if (m_bInitState)
 		{
 			if (GetInitialDevices())
@@ -118,11 +127,45 @@ std::string ZWaveBase::GenerateDeviceStringID(const _tZWaveDevice *pDevice)
 	return sstr.str();
 }
 
+unsigned long long ZWaveBase::GetDeviceKey(const int nodeID, const int instanceID, const int CommandClassID, const int scaleID)
+{
+	//16 bits each, scene devices of the Razberry use (scene<<8)+node as node id
+	return
+		((unsigned long long)(nodeID&0xFFFF)<<48)|
+		((unsigned long long)(instanceID&0xFFFF)<<32)|
+		((unsigned long long)(CommandClassID&0xFFFF)<<16)|
+		(unsigned long long)(scaleID&0xFFFF);
+}
+
+unsigned long long ZWaveBase::GetDeviceKey(const _tZWaveDevice *pDevice)
+{
+	return GetDeviceKey(pDevice->nodeID,pDevice->instanceID,pDevice->commandClassID,pDevice->scaleID);
+}
+
+ZWaveBase::_tZWaveDevice* ZWaveBase::StoreDevice(const _tZWaveDevice &device)
+{
+	unsigned long long key=GetDeviceKey(&device);
+	ZWaveDeviceMap::iterator itt=m_devices.find(key);
+	if (itt!=m_devices.end())
+	{
+		itt->second=device;
+		return &itt->second;
+	}
+	_tZWaveDevice *pDevice=&m_devices[key];
+	*pDevice=device;
+	std::vector<_tZWaveDevice*> &nodedevices=m_node_devices[device.nodeID];
+	std::vector<_tZWaveDevice*>::iterator itt2=nodedevices.begin();
+	while ((itt2!=nodedevices.end())&&(GetDeviceKey(*itt2)<key))
+		++itt2;
+	nodedevices.insert(itt2,pDevice);
+	return pDevice;
+}
+
 void ZWaveBase::InsertDevice(_tZWaveDevice device)
 {
 	device.string_id=GenerateDeviceStringID(&device);
 
-	bool bNewDevice=(m_devices.find(device.string_id)==m_devices.end());
+	bool bNewDevice=(m_devices.find(GetDeviceKey(&device))==m_devices.end());
 	
 	device.lastreceived=mytime(NULL);
 #ifdef _DEBUG
@@ -137,21 +180,21 @@ void ZWaveBase::InsertDevice(_tZWaveDevice device)
 #endif
 	//insert or update device in internal record
 	device.sequence_number=1;
-	m_devices[device.string_id]=device;
+	StoreDevice(device);
 
 	SendSwitchIfNotExists(&device);
 }
 
 void ZWaveBase::UpdateDeviceBatteryStatus(const int nodeID, const int value)
 {
-	std::map<std::string,_tZWaveDevice>::iterator itt;
-	for (itt=m_devices.begin(); itt!=m_devices.end(); ++itt)
+	std::map<int,std::vector<_tZWaveDevice*> >::iterator inode=m_node_devices.find(nodeID);
+	if (inode==m_node_devices.end())
+		return;
+	std::vector<_tZWaveDevice*>::iterator itt;
+	for (itt=inode->second.begin(); itt!=inode->second.end(); ++itt)
 	{
-		if (itt->second.nodeID==nodeID)
-		{
-			itt->second.batValue=value;
-			itt->second.hasBattery=true;//we got an update, so it should have a battery then...
-		}
+		(*itt)->batValue=value;
+		(*itt)->hasBattery=true;//we got an update, so it should have a battery then...
 	}
 }
 
@@ -391,32 +434,15 @@ void ZWaveBase::SendDevice2Domoticz(const _tZWaveDevice *pDevice)
 	}
 	else if (pDevice->devType==ZDTYPE_SENSOR_POWER)
 	{
-		_tUsageMeter umeter;
-		umeter.id1=ID1;
-		umeter.id2=ID2;
-		umeter.id3=ID3;
-		umeter.id4=ID4;
-		umeter.dunit=pDevice->scaleID;
-		umeter.fusage=pDevice->floatValue;
-		sDecodeRXMessage(this, (const unsigned char *)&umeter);//decode message
+		SendUsageSensor((ID1<<24)|(ID2<<16)|(ID3<<8)|ID4,(unsigned char)pDevice->scaleID,pDevice->floatValue);
 	}
 	else if (pDevice->devType==ZDTYPE_SENSOR_VOLTAGE)
 	{
-		_tGeneralDevice gDevice;
-		gDevice.subtype=sTypeVoltage;
-		gDevice.id=ID4;
-		gDevice.floatval1=pDevice->floatValue;
-		gDevice.intval1=(int)(ID1<<24)|(ID2<<16)|(ID3<<8)|ID4;
-		sDecodeRXMessage(this, (const unsigned char *)&gDevice);
+		SendGeneralSensor(sTypeVoltage,(ID1<<24)|(ID2<<16)|(ID3<<8)|ID4,pDevice->floatValue);
 	}
 	else if (pDevice->devType==ZDTYPE_SENSOR_PERCENTAGE)
 	{
-		_tGeneralDevice gDevice;
-		gDevice.subtype=sTypePercentage;
-		gDevice.id=ID4;
-		gDevice.floatval1=pDevice->floatValue;
-		gDevice.intval1=(int)(ID1<<24)|(ID2<<16)|(ID3<<8)|ID4;
-		sDecodeRXMessage(this, (const unsigned char *)&gDevice);
+		SendGeneralSensor(sTypePercentage,(ID1<<24)|(ID2<<16)|(ID3<<8)|ID4,pDevice->floatValue);
 	}
 	else if (pDevice->devType==ZDTYPE_SENSOR_AMPERE)
 	{
@@ -533,64 +559,33 @@ void ZWaveBase::SendDevice2Domoticz(const _tZWaveDevice *pDevice)
 	{
 		if (!pDevice->bValidValue)
 			return;
-		RBUF tsen;
-		memset(&tsen,0,sizeof(RBUF));
+		unsigned char battery_level=9;
+		if (pDevice->hasBattery)
+		{
+			battery_level=Convert_Battery_To_PercInt(pDevice->batValue);
+		}
 
 		const _tZWaveDevice *pHumDevice=FindDevice(pDevice->nodeID,-1,-1,ZDTYPE_SENSOR_HUMIDITY);
 		if (pHumDevice)
 		{
 			if (!pHumDevice->bValidValue)
 				return;
-			tsen.TEMP_HUM.packetlength=sizeof(tsen.TEMP_HUM)-1;
-			tsen.TEMP_HUM.packettype=pTypeTEMP_HUM;
-			tsen.TEMP_HUM.subtype=sTypeTH5;
-			tsen.TEMP_HUM.rssi=12;
-			tsen.TEMP_HUM.id1=ID3;
-			tsen.TEMP_HUM.id2=ID4;
-
-			tsen.TEMP_HUM.battery_level=9;
-			if (pDevice->hasBattery)
-			{
-				tsen.TEMP_HUM.battery_level=Convert_Battery_To_PercInt(pDevice->batValue);
-			}
-
-			tsen.TEMP_HUM.tempsign=(pDevice->floatValue>=0)?0:1;
-			int at10=round(abs(pDevice->floatValue*10.0f));
-			tsen.TEMP_HUM.temperatureh=(BYTE)(at10/256);
-			at10-=(tsen.TEMP_HUM.temperatureh*256);
-			tsen.TEMP_HUM.temperaturel=(BYTE)(at10);
-			tsen.TEMP_HUM.humidity=(BYTE)pHumDevice->intvalue;
-			tsen.TEMP_HUM.humidity_status=Get_Humidity_Level(tsen.TEMP_HUM.humidity);
+			SendTempHumSensor(sTypeTH5,(ID3<<8)|ID4,0,(battery_level+1)*10,pDevice->floatValue,pHumDevice->intvalue);
 		}
 		else
 		{
-			tsen.TEMP.packetlength=sizeof(tsen.TEMP)-1;
-			tsen.TEMP.packettype=pTypeTEMP;
-			tsen.TEMP.subtype=sTypeTEMP10;
-			tsen.TEMP.rssi=12;
-			tsen.TEMP.id1=ID3;
-			tsen.TEMP.id2=ID4;
-
-			tsen.TEMP.battery_level=9;
-			if (pDevice->hasBattery)
-			{
-				tsen.TEMP.battery_level=Convert_Battery_To_PercInt(pDevice->batValue);
-			}
-
-			tsen.TEMP.tempsign=(pDevice->floatValue>=0)?0:1;
-			int at10=round(abs(pDevice->floatValue*10.0f));
-			tsen.TEMP.temperatureh=(BYTE)(at10/256);
-			at10-=(tsen.TEMP.temperatureh*256);
-			tsen.TEMP.temperaturel=(BYTE)(at10);
+			SendTempSensor(sTypeTEMP10,(ID3<<8)|ID4,ID4,battery_level*10,pDevice->floatValue);
 		}
-		sDecodeRXMessage(this, (const unsigned char *)&tsen.TEMP);//decode message
 	}
 	else if (pDevice->devType==ZDTYPE_SENSOR_HUMIDITY)
 	{
 		if (!pDevice->bValidValue)
 			return;
-		RBUF tsen;
-		memset(&tsen,0,sizeof(RBUF));
+		unsigned char battery_level=9;
+		if (pDevice->hasBattery)
+		{
+			battery_level=Convert_Battery_To_PercInt(pDevice->batValue);
+		}
 
 		const _tZWaveDevice *pTempDevice=FindDevice(pDevice->nodeID,-1,-1,ZDTYPE_SENSOR_TEMPERATURE);
 		if (pTempDevice)
@@ -599,51 +594,14 @@ void ZWaveBase::SendDevice2Domoticz(const _tZWaveDevice *pDevice)
 				return;
 
 			//report it with the ID of the temperature sensor, else we get two sensors with the same value
-			ID1 = 0;
-			ID2 = (unsigned char)((pTempDevice->nodeID & 0xFF00) >> 8);
 			ID3 = (unsigned char)pTempDevice->nodeID & 0xFF;
 			ID4 = pTempDevice->instanceID;
-
-			tsen.TEMP_HUM.packetlength=sizeof(tsen.TEMP_HUM)-1;
-			tsen.TEMP_HUM.packettype=pTypeTEMP_HUM;
-			tsen.TEMP_HUM.subtype=sTypeTH5;
-			tsen.TEMP_HUM.rssi=12;
-			tsen.TEMP_HUM.id1=ID3;
-			tsen.TEMP_HUM.id2=ID4;
-			ID4=pTempDevice->instanceID;
-
-			tsen.TEMP_HUM.battery_level=9;
-			if (pDevice->hasBattery)
-			{
-				tsen.TEMP_HUM.battery_level=Convert_Battery_To_PercInt(pDevice->batValue);
-			}
-
-			tsen.TEMP_HUM.tempsign=(pTempDevice->floatValue>=0)?0:1;
-			int at10=round(abs(pTempDevice->floatValue*10.0f));
-			tsen.TEMP_HUM.temperatureh=(BYTE)(at10/256);
-			at10-=(tsen.TEMP_HUM.temperatureh*256);
-			tsen.TEMP_HUM.temperaturel=(BYTE)(at10);
-			tsen.TEMP_HUM.humidity=(BYTE)pDevice->intvalue;
-			tsen.TEMP_HUM.humidity_status=Get_Humidity_Level(tsen.TEMP_HUM.humidity);
+			SendTempHumSensor(sTypeTH5,(ID3<<8)|ID4,0,(battery_level+1)*10,pTempDevice->floatValue,pDevice->intvalue);
 		}
 		else
 		{
-			memset(&tsen,0,sizeof(RBUF));
-			tsen.HUM.packetlength=sizeof(tsen.HUM)-1;
-			tsen.HUM.packettype=pTypeHUM;
-			tsen.HUM.subtype=sTypeHUM2;
-			tsen.HUM.rssi=12;
-			tsen.HUM.id1=ID3;
-			tsen.HUM.id2=ID4;
-			tsen.HUM.battery_level=9;
-			if (pDevice->hasBattery)
-			{
-				tsen.HUM.battery_level=Convert_Battery_To_PercInt(pDevice->batValue);
-			}
-			tsen.HUM.humidity=(BYTE)pDevice->intvalue;
-			tsen.HUM.humidity_status=Get_Humidity_Level(tsen.HUM.humidity);
+			SendHumiditySensor(sTypeHUM2,(ID3<<8)|ID4,(battery_level+1)*10,pDevice->intvalue);
 		}
-		sDecodeRXMessage(this, (const unsigned char *)&tsen.TEMP);//decode message
 	}
 	else if (pDevice->devType==ZDTYPE_SENSOR_LIGHT)
 	{
@@ -678,35 +636,184 @@ void ZWaveBase::SendDevice2Domoticz(const _tZWaveDevice *pDevice)
 
 ZWaveBase::_tZWaveDevice* ZWaveBase::FindDevice(const int nodeID, const int instanceID, const int indexID, const _eZWaveDeviceType devType)
 {
-	std::map<std::string,_tZWaveDevice>::iterator itt;
-	for (itt=m_devices.begin(); itt!=m_devices.end(); ++itt)
+	std::map<int,std::vector<_tZWaveDevice*> >::iterator inode=m_node_devices.find(nodeID);
+	if (inode==m_node_devices.end())
+		return NULL;
+	std::vector<_tZWaveDevice*>::iterator itt;
+	for (itt=inode->second.begin(); itt!=inode->second.end(); ++itt)
 	{
 		if (
-			(itt->second.nodeID==nodeID)&&
-			((itt->second.instanceID==instanceID)||(instanceID==-1))&&
-			(itt->second.devType==devType)
+			(((*itt)->instanceID==instanceID)||(instanceID==-1))&&
+			((*itt)->devType==devType)
 			)
-			return &itt->second;
+			return *itt;
 	}
 	return NULL;
 }
 
 ZWaveBase::_tZWaveDevice* ZWaveBase::FindDevice(const int nodeID, const int instanceID, const int indexID, const int CommandClassID,  const _eZWaveDeviceType devType)
 {
-	std::map<std::string,_tZWaveDevice>::iterator itt;
-	for (itt=m_devices.begin(); itt!=m_devices.end(); ++itt)
+	std::map<int,std::vector<_tZWaveDevice*> >::iterator inode=m_node_devices.find(nodeID);
+	if (inode==m_node_devices.end())
+		return NULL;
+	std::vector<_tZWaveDevice*>::iterator itt;
+	for (itt=inode->second.begin(); itt!=inode->second.end(); ++itt)
 	{
 		if (
-			(itt->second.nodeID==nodeID)&&
-			((itt->second.instanceID==instanceID)||(instanceID==-1))&&
-			(itt->second.commandClassID==CommandClassID)&&
-			(itt->second.devType==devType)
+			(((*itt)->instanceID==instanceID)||(instanceID==-1))&&
+			((*itt)->commandClassID==CommandClassID)&&
+			((*itt)->devType==devType)
 			)
-			return &itt->second;
+			return *itt;
 	}
 	return NULL;
 }
 
+ZWaveBase::_tZWaveDevice* ZWaveBase::FindDeviceByKey(const int nodeID, const int instanceID, const int CommandClassID, const int scaleID)
+{
+	ZWaveDeviceMap::iterator itt=m_devices.find(GetDeviceKey(nodeID,instanceID,CommandClassID,scaleID));
+	if (itt==m_devices.end())
+		return NULL;
+	return &itt->second;
+}
+
+ZWaveBase::_tZWaveDevice* ZWaveBase::FindValueDevice(const int nodeID, const int instanceID, const int CommandClassID, const int scaleID)
+{
+	_tZWaveDevice *pDevice=FindDeviceByKey(nodeID,instanceID,CommandClassID,-1);
+	if ((pDevice==NULL)&&(scaleID!=-1))
+		pDevice=FindDeviceByKey(nodeID,instanceID,CommandClassID,scaleID);
+	return pDevice;
+}
+
+//Driver without hardware, only used to fill a device index for BenchmarkDeviceIndex
+class CZWaveBenchmark : public ZWaveBase
+{
+public:
+	bool GetInitialDevices() { return true; }
+	bool GetUpdates() { return true; }
+private:
+	void SwitchLight(const int nodeID, const int instanceID, const int commandClass, const int value) {}
+	void SetThermostatSetPoint(const int nodeID, const int instanceID, const int commandClass, const float value) {}
+	void StopHardwareIntern() {}
+	bool IncludeDevice() { return false; }
+	bool ExcludeDevice(const int nodeID) { return false; }
+	bool RemoveFailedDevice(const int nodeID) { return false; }
+	bool CancelControllerCommand() { return false; }
+};
+
+void ZWaveBase::BenchmarkDeviceIndex()
+{
+	//120 nodes with a switch, a temperature sensor and an energy meter (energy and power), as a large installation
+	const int nNodes=120;
+	const int nNotifications=200000;
+	CZWaveBenchmark zbench;
+	std::map<std::string,_tZWaveDevice> oldindex;
+	std::vector<_tZWaveDevice> values;
+	for (int nodeID=2; nodeID<nNodes+2; nodeID++)
+	{
+		_tZWaveDevice device;
+		device.nodeID=nodeID;
+		device.instanceID=1;
+		device.indexID=0;
+		device.commandClassID=37;
+		device.scaleID=-1;
+		device.devType=ZDTYPE_SWITCH_NORMAL;
+		values.push_back(device);
+		device.commandClassID=49;
+		device.devType=ZDTYPE_SENSOR_TEMPERATURE;
+		values.push_back(device);
+		device.commandClassID=50;
+		device.scaleID=0;
+		device.devType=ZDTYPE_SENSOR_POWERENERGYMETER;
+		values.push_back(device);
+		device.scaleID=2;
+		device.devType=ZDTYPE_SENSOR_POWER;
+		values.push_back(device);
+	}
+	std::vector<_tZWaveDevice>::iterator itt;
+	for (itt=values.begin(); itt!=values.end(); ++itt)
+	{
+		itt->string_id=zbench.GenerateDeviceStringID(&(*itt));
+		zbench.StoreDevice(*itt);
+		oldindex[itt->string_id]=*itt;
+	}
+
+	//A value notification looks up the device of the value, meters also look up the power device of the node,
+	//and every 50th notification is a battery report
+	long usec[2];
+	int nFound[2];
+	int nPowerFound[2];
+	for (int jj=0; jj<2; jj++)
+	{
+		nFound[jj]=0;
+		nPowerFound[jj]=0;
+		srand(1);
+		boost::posix_time::ptime tstart=boost::posix_time::microsec_clock::universal_time();
+		for (int ii=0; ii<nNotifications; ii++)
+		{
+			const _tZWaveDevice &value=values[rand()%values.size()];
+			_tZWaveDevice *pDevice=NULL;
+			_tZWaveDevice *pPowerDevice=NULL;
+			if (jj==0)
+			{
+				pDevice=zbench.FindValueDevice(value.nodeID,value.instanceID,value.commandClassID,value.scaleID);
+				if ((pDevice!=NULL)&&(pDevice->devType==ZDTYPE_SENSOR_POWERENERGYMETER))
+					pPowerDevice=zbench.FindDevice(value.nodeID,-1,-1,ZDTYPE_SENSOR_POWER);
+				if (ii%50==0)
+					zbench.UpdateDeviceBatteryStatus(value.nodeID,100);
+			}
+			else
+			{
+				//string keyed map as used before
+				std::stringstream sstr;
+				sstr << value.nodeID << ".instances." << value.instanceID << ".commandClasses." << value.commandClassID << ".data";
+				if (value.scaleID!=-1)
+					sstr << "." << value.scaleID;
+				std::string path=sstr.str();
+				std::map<std::string,_tZWaveDevice>::iterator itt2;
+				for (itt2=oldindex.begin(); itt2!=oldindex.end(); ++itt2)
+				{
+					if (path.find(itt2->second.string_id,0)!=std::string::npos)
+					{
+						pDevice=&itt2->second;
+						break;
+					}
+				}
+				if ((pDevice!=NULL)&&(pDevice->devType==ZDTYPE_SENSOR_POWERENERGYMETER))
+				{
+					for (itt2=oldindex.begin(); itt2!=oldindex.end(); ++itt2)
+					{
+						if ((itt2->second.nodeID==value.nodeID)&&(itt2->second.devType==ZDTYPE_SENSOR_POWER))
+						{
+							pPowerDevice=&itt2->second;
+							break;
+						}
+					}
+				}
+				if (ii%50==0)
+				{
+					for (itt2=oldindex.begin(); itt2!=oldindex.end(); ++itt2)
+					{
+						if (itt2->second.nodeID==value.nodeID)
+						{
+							itt2->second.batValue=100;
+							itt2->second.hasBattery=true;
+						}
+					}
+				}
+			}
+			if ((pDevice!=NULL)&&(GetDeviceKey(pDevice)==GetDeviceKey(&value)))
+				nFound[jj]++;
+			if (pPowerDevice!=NULL)
+				nPowerFound[jj]++;
+		}
+		usec[jj]=(long)(boost::posix_time::microsec_clock::universal_time()-tstart).total_microseconds();
+	}
+	_log.Log(LOG_STATUS,"ZWave benchmark: %d devices, %d notifications",(int)values.size(),nNotifications);
+	_log.Log(LOG_STATUS,"ZWave benchmark: device index %.3f us/notification (%d devices, %d power devices found), string keyed map %.3f us/notification (%d devices, %d power devices found)",
+		(double)usec[0]/nNotifications,nFound[0],nPowerFound[0],(double)usec[1]/nNotifications,nFound[1],nPowerFound[1]);
+}
+
 void hue2rgb(const float hue, int &outR, int &outG, int &outB)
 {
 	double      hh, p, q, t, ff;
@@ -1,7 +1,10 @@
 #pragma once
 
 #include <map>
+#include <vector>
 #include <time.h>
+#include <boost/unordered_map.hpp>
+#include <boost/atomic.hpp>
 #include "DomoticzHardware.h"
 
 class ZWaveBase : public CDomoticzHardwareBase
@@ -78,10 +81,14 @@ class ZWaveBase : public CDomoticzHardwareBase
 			label = "Unknown";
 		}
 	};
+	typedef boost::unordered_map<unsigned long long,_tZWaveDevice> ZWaveDeviceMap;
 public:
 	ZWaveBase();
 	~ZWaveBase(void);
 
+	//Compares the cost of finding the device for a value notification with the previous string keyed map (-zwavebenchmark)
+	static void BenchmarkDeviceIndex();
+
 	virtual bool GetInitialDevices()=0;
 	virtual bool GetUpdates()=0;
 	bool StartHardware();
@@ -94,9 +101,15 @@ private:
 	
 	_tZWaveDevice* FindDevice(const int nodeID, const int instanceID, const int indexID, const _eZWaveDeviceType devType);
 	_tZWaveDevice* FindDevice(const int nodeID, const int instanceID, const int indexID, const int CommandClassID, const _eZWaveDeviceType devType);
+	_tZWaveDevice* FindDeviceByKey(const int nodeID, const int instanceID, const int CommandClassID, const int scaleID);
+	//Device that receives a value of node/instance/command class/scale, a device without scale takes all values of its command class
+	_tZWaveDevice* FindValueDevice(const int nodeID, const int instanceID, const int CommandClassID, const int scaleID);
+	static unsigned long long GetDeviceKey(const int nodeID, const int instanceID, const int CommandClassID, const int scaleID);
+	static unsigned long long GetDeviceKey(const _tZWaveDevice *pDevice);
 
 	std::string GenerateDeviceStringID(const _tZWaveDevice *pDevice);
 	void InsertDevice(_tZWaveDevice device);
+	_tZWaveDevice* StoreDevice(const _tZWaveDevice &device);
 	void UpdateDeviceBatteryStatus(const int nodeID, const int value);
 	unsigned char Convert_Battery_To_PercInt(const unsigned char level);
 	virtual void SwitchLight(const int nodeID, const int instanceID, const int commandClass, const int value)=0;
@@ -111,8 +124,12 @@ private:
 	time_t m_ControllerCommandStartTime;
 	int m_LastIncludedNode;
 	time_t m_updateTime;
+	//Time between two GetUpdates calls, can be changed by the hardware while running (poll and command threads)
+	boost::atomic<int> m_PollIntervalMS;
 	bool m_bInitState;
-	std::map<std::string,_tZWaveDevice> m_devices;
+	ZWaveDeviceMap m_devices;
+	//Devices of each node, ordered by device key
+	std::map<int,std::vector<_tZWaveDevice*> > m_node_devices;
 	boost::shared_ptr<boost::thread> m_thread;
 	bool m_stoprequested;
 };
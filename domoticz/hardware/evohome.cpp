@@ -36,12 +36,25 @@
 
 #define RETRY_DELAY 30
 
+//Transmit scheduling
+#define EVOHOME_SEND_TICK_MS 50		//worker loop interval
+#define EVOHOME_SEND_INTERVAL_MS 250	//minimum gap between two transmissions
+#define EVOHOME_ACK_TIMEOUT_MS 1000	//wait this long for the echo of the gateway before a retry
+#define EVOHOME_BACKOFF_BASE_MS 250	//retry back-off window, doubled on every retry
+#define EVOHOME_BACKOFF_MAX_MS 16000
+#define EVOHOME_MAX_RETRIES 10
+//The 868MHz band allows a 1% duty cycle, a packet takes roughly 1ms per byte on air
+#define EVOHOME_DUTY_CYCLE 0.01
+#define EVOHOME_AIRTIME_BURST_MS 2000	//airtime that may be used in a burst (RequestCurrentState)
+#define EVOHOME_PACKET_OVERHEAD 12	//header bytes of a packet
+
 std::ofstream *CEvohome::m_pEvoLog=NULL;
 #ifdef _DEBUG
 bool CEvohome::m_bDebug=true;
 #else
 bool CEvohome::m_bDebug=false;
 #endif
+bool CEvohome::m_bReplay=false;
 
 const char CEvohome::m_szControllerMode[7][20]={"Normal","Economy","Away","Day Off","Custom","Heating Off","Unknown"};
 const char CEvohome::m_szWebAPIMode[7][20]={"Auto","AutoWithEco","Away","DayOff","Custom","HeatingOff","Unknown"};
@@ -79,7 +92,13 @@ CEvohome::CEvohome(const int ID, const char* szSerialPort) :
 
 	m_stoprequested=false;
 	m_nBufPtr=0;
-	m_nSendFail=0;
+	m_bSendInFlight=false;
+	m_nSendInFlightPriority=spPoll;
+	m_tNextSendSlot=boost::posix_time::microsec_clock::universal_time();
+	m_tAirtimeUpdate=m_tNextSendSlot;
+	m_fAirtimeBudget=EVOHOME_AIRTIME_BURST_MS;
+	memset(&m_SendStats,0,sizeof(m_SendStats));
+	m_nAckTimeTotal=0;
 	m_nZoneCount=0;
 	m_nControllerMode=0;
 	
@@ -228,9 +247,18 @@ bool CEvohome::OpenSerialDevice()
 void CEvohome::Do_Work()
 {
 	int nStartup=0;
+	int nTick=0;
 	while (!m_stoprequested)
 	{
-		sleep_seconds(1);
+		sleep_milliseconds(EVOHOME_SEND_TICK_MS);
+		if (m_stoprequested)
+			break;
+		if (isOpen())
+			Do_Send();
+		if (++nTick < 1000/EVOHOME_SEND_TICK_MS)
+			continue;
+		nTick=0;
+
 		time_t atime = mytime(NULL);
 		struct tm ltime;
 		localtime_r(&atime, &ltime);
@@ -260,7 +288,6 @@ void CEvohome::Do_Work()
 		}
 		else
 		{
-			Do_Send();//FIXME afaik if there is a collision then we should increase the back off period exponentially if it happens again
 			if(nStartup<300)//if we haven't got zone names in 300s we auto init them (zone creation blocked until we have something)...
 			{
 				nStartup++;
@@ -506,15 +533,14 @@ int CEvohome::ProcessBuf(char * buf, int size)
 			start=i+1;
 		else if(buf[i]==0x0A)//this is the end of packet marker...not sure if there is a CR before this?
 		{
-			char msg[2048];
 			if (i - start >= 2048) {
 				Log(false,LOG_ERROR,"evohome: Message length exceeds max message size");
 				start = i + 1;
 				continue;
 			}
-			//convert into a null terminated string
-			snprintf(msg, i - start, "%.*s", i - start, buf + start);
-			ProcessMsg(msg);
+			//terminate the message in place, without the CR before the LF
+			buf[((i>start)&&(buf[i-1]==0x0D))?i-1:i]=0;
+			ProcessMsg(buf + start);
 			start = i + 1;
 		}
 	}
@@ -523,22 +549,92 @@ int CEvohome::ProcessBuf(char * buf, int size)
 	return size - start;
 }
 
+//Value of a hex digit, 0xFF for all other characters
+static const unsigned char g_EvoHexTable[256]={
+	0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,
+	0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,
+	0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,
+	0x00,0x01,0x02,0x03,0x04,0x05,0x06,0x07,0x08,0x09,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,
+	0xFF,0x0A,0x0B,0x0C,0x0D,0x0E,0x0F,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,
+	0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,
+	0xFF,0x0A,0x0B,0x0C,0x0D,0x0E,0x0F,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,
+	0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,
+	0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,
+	0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,
+	0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,
+	0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,
+	0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,
+	0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,
+	0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,
+	0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,
+};
+
+//Leading hex digits of a token (as sscanf %x)
+static unsigned int EvoParseHex(const char *szTkn, const size_t nLen)
+{
+	unsigned int nRet=0;
+	for (size_t i=0; (i<nLen)&&(g_EvoHexTable[(unsigned char)szTkn[i]]!=0xFF); i++)
+		nRet=(nRet<<4)|g_EvoHexTable[(unsigned char)szTkn[i]];
+	return nRet;
+}
+
+//Leading decimal digits of a token (as atoi)
+static unsigned int EvoParseDec(const char *szTkn, const size_t nLen, size_t *pnPos=NULL)
+{
+	unsigned int nRet=0;
+	size_t i;
+	for (i=0; (i<nLen)&&(szTkn[i]>='0')&&(szTkn[i]<='9'); i++)
+		nRet=nRet*10+(szTkn[i]-'0');
+	if (pnPos)
+		*pnPos=i;
+	return nRet;
+}
+
+//Device id in the form type:address (as CEvohomeID::GetID)
+static unsigned int EvoParseID(const char *szTkn, const size_t nLen)
+{
+	size_t nPos=0;
+	unsigned char idType=(unsigned char)EvoParseDec(szTkn,nLen,&nPos);
+	unsigned int idAddr=0;
+	if ((nPos<nLen)&&(szTkn[nPos]==':'))
+		idAddr=EvoParseDec(szTkn+nPos+1,nLen-nPos-1);
+	return CEvohomeID::GetID(idType,idAddr);
+}
+
+CEvohomeMsg::packettype CEvohomeMsg::SetPacketType(const char *szPkt, const size_t nLen)
+{
+	type=pktunk;
+	for(int i=pktinf;i<=pktwrt;i++)
+		if((strlen(szPacketType[i])==nLen)&&(!strncmp(szPkt,szPacketType[i],nLen)))
+			return (type=static_cast<packettype>(i));
+	return type;
+}
+
 bool CEvohomeMsg::DecodePacket(const char * rawmsg)
 {
+	//Single pass over the line, tokens point into rawmsg so nothing is copied
 	int cmdidx=0;
 	int nid=0;
-	std::string line(rawmsg);
-	std::vector<std::string> tkns;
-	boost::split(tkns,line,boost::is_any_of(" "),boost::token_compress_on);//There are sometimes 2 spaces between token 1 and 2 so we use token_compress_on to avoid an additional empty token
-	for (size_t i = 0; i < tkns.size(); i++)
+	int i=-1;
+	const char *pos=rawmsg;
+	while (*pos)
 	{
-		std::string tkn(tkns[i]);
+		if (*pos==' ')//There are sometimes 2 spaces between token 1 and 2
+		{
+			pos++;
+			continue;
+		}
+		const char *tkn=pos;
+		while ((*pos)&&(*pos!=' '))
+			pos++;
+		size_t nLen=pos-tkn;
+		i++;
 		if(i==0)//this is some sort of status or flags but not sure what exactly
 		{
 		}
 		else if(i==1)
 		{
-			if(SetPacketType(tkn.c_str())!=pktunk)
+			if(SetPacketType(tkn,nLen)!=pktunk)
 				SetFlag(flgpkt);
 		}
 		else if(cmdidx && i==cmdidx+2) //payload starts 2 after command idx
@@ -548,19 +644,28 @@ bool CEvohomeMsg::DecodePacket(const char * rawmsg)
 				CEvohome::Log(false,LOG_ERROR,"evohome: no payload size - possible corrupt message");
 				return false;
 			}
-			if(tkn.length()%2)
+			if(nLen%2)
 			{
 				CEvohome::Log(false,LOG_ERROR,"evohome: uneven payload - possible corrupt message");
 				return false;
 			}
-			if(tkn.length()/2>m_nBufSize)
+			if(nLen/2>m_nBufSize)
 			{
 				CEvohome::Log(false,LOG_ERROR,"evohome: payload exceeds max buffer size");
 				return false;
 			}
 			int ps=0;
-			for(int j=0;j<tkn.length();j+=2)
-				sscanf(tkn.substr(j,2).c_str(),"%02hhx",&payload[ps++]);//requires C99
+			for(size_t j=0;j<nLen;j+=2)
+			{
+				unsigned char hi=g_EvoHexTable[(unsigned char)tkn[j]];
+				unsigned char lo=g_EvoHexTable[(unsigned char)tkn[j+1]];
+				if((hi|lo)&0xF0)
+				{
+					CEvohome::Log(false,LOG_ERROR,"evohome: invalid payload character - possible corrupt message");
+					return false;
+				}
+				payload[ps++]=(hi<<4)|lo;
+			}
 			if(ps==payloadsize)
 			{
 				SetFlag(flgpay);
@@ -572,48 +677,47 @@ bool CEvohomeMsg::DecodePacket(const char * rawmsg)
 			}
 			
 		}
-		else if(tkn.length()==4)
+		else if(nLen==4)
 		{
-			sscanf(tkn.c_str(),"%04x",&command);
+			command=EvoParseHex(tkn,nLen);
 			SetFlag(flgcmd);
 			if(!cmdidx)
 				cmdidx=i;
 		}
-		else if(tkn.length()==3)
+		else if(nLen==3)
 		{
-			if(tkn.find('-')==std::string::npos)
+			if(!memchr(tkn,'-',nLen))
 			{
 				if(i==2)
 				{
-					timestamp=atoi(tkn.c_str());
+					timestamp=EvoParseDec(tkn,nLen);
 					SetFlag(flgts);
 				}
 				else if(cmdidx && i==cmdidx+1)
 				{
-					payloadsize=atoi(tkn.c_str());
+					payloadsize=EvoParseDec(tkn,nLen);
 					SetFlag(flgps);
 				}
 			}
 		}
 		else
 		{
-			int nPos=tkn.find(':');
-			if(nPos!=std::string::npos)
+			if(memchr(tkn,':',nLen))
 			{
 				if(nid>=3)
 				{
 					CEvohome::Log(false,LOG_ERROR,"evohome: too many message ids - possible corrupt message");
 					continue;
 				}
-				if(tkn.find('-')==std::string::npos)
+				if(!memchr(tkn,'-',nLen))
 				{
-					id[nid]=tkn;
+					id[nid].SetID(EvoParseID(tkn,nLen));
 					SetFlag(flgid1<<nid);
 				}
 				nid++;
 			}
 			else
-				CEvohome::Log(false,LOG_STATUS,"evohome: WARNING unrecognised message structure - possible corrupt message '%s' (%d)",tkn.c_str(),i);
+				CEvohome::Log(false,LOG_STATUS,"evohome: WARNING unrecognised message structure - possible corrupt message '%.*s' (%d)",(int)nLen,tkn,i);
 		}
 	}
 	return IsValid();
@@ -693,25 +797,23 @@ bool CEvohome::DecodeSetpoint(CEvohomeMsg &msg)//0x2309
 		Log(false,LOG_ERROR,"evohome: %s: Error decoding zone setpoint payload, size incorrect: %d", tag, msg.payloadsize);
 		return false;
 	}
-	REVOBUF tsen;
-	memset(&tsen,0,sizeof(REVOBUF));
-	tsen.EVOHOME2.len=sizeof(tsen.EVOHOME2)-1;
-	tsen.EVOHOME2.type=pTypeEvohomeZone;
-	tsen.EVOHOME2.subtype=sTypeEvohomeZone;
-	RFX_SETID3(msg.GetID(0),tsen.EVOHOME2.id1,tsen.EVOHOME2.id2,tsen.EVOHOME2.id3) //this message can be received from other than the controller...is zone always valid though? (when a local override is in action we get different values one from the controller the other from the zone valve but the zone number is still ok)
-	tsen.EVOHOME2.mode=zmNotSp;
-	tsen.EVOHOME2.updatetype=updSetPoint;//setpoint
+	_tDeviceUpdate update;
+	update.devType=pTypeEvohomeZone;
+	update.subType=sTypeEvohomeZone;
+	update.ID=msg.GetID(0); //this message can be received from other than the controller...is zone always valid though? (when a local override is in action we get different values one from the controller the other from the zone valve but the zone number is still ok)
+	update.EVOHOME.mode=zmNotSp;
+	update.EVOHOME.updatetype=updSetPoint;//setpoint
 	
 	for (int i = 0 ; i < msg.payloadsize ; i += 3) {
-		tsen.EVOHOME2.zone = msg.payload[i]+1;
-		tsen.EVOHOME2.temperature =  msg.payload[i + 1] << 8 | msg.payload[i + 2];
-		if(tsen.EVOHOME2.temperature==0x7FFF)
+		update.Unit = msg.payload[i]+1;
+		update.EVOHOME.temperature =  msg.payload[i + 1] << 8 | msg.payload[i + 2];
+		if(update.EVOHOME.temperature==0x7FFF)
 		{
 			Log(true,LOG_STATUS,"evohome: %s: Warning setpoint not set for zone %d",tag, msg.payload[0]);
 			continue;
 		}
-		SetMaxZoneCount(tsen.EVOHOME2.zone);//this should increase on startup as we poll all zones so we don't respond to changes here
-		Log(true,LOG_STATUS,"evohome: %s: Setting: %d: %d", tag, tsen.EVOHOME2.zone, tsen.EVOHOME2.temperature);
+		SetMaxZoneCount(update.Unit);//this should increase on startup as we poll all zones so we don't respond to changes here
+		Log(true,LOG_STATUS,"evohome: %s: Setting: %d: %d", tag, update.Unit, update.EVOHOME.temperature);
 		//It appears that the controller transmits the current setpoint for all zones periodically this is presumably so 
 		//the zone controller can update to any changes as required
 		//The zone controllers also individually transmit their own setpoint as it is currently set
@@ -719,7 +821,7 @@ bool CEvohome::DecodeSetpoint(CEvohomeMsg &msg)//0x2309
 		//The exception appears to be for local overrides which may be possible to track by seeing if a change
 		//occurs that does not correspond to the controller setpoint for a given zone
 		if (msg.GetID(0) == GetControllerID())
-			sDecodeRXMessage(this, (const unsigned char *)&tsen.EVOHOME2);//Decode message
+			sUpdateDevice(this, update);
 	}
 	
 	return true;
@@ -738,50 +840,48 @@ bool CEvohome::DecodeSetpointOverride(CEvohomeMsg &msg)//0x2349
 		Log(false,LOG_ERROR,"evohome: %s: Error decoding payload unknown size: %d", tag, msg.payloadsize);
 		return false;
 	}
-	REVOBUF tsen;
-	memset(&tsen,0,sizeof(REVOBUF));
-	tsen.EVOHOME2.len=sizeof(tsen.EVOHOME2)-1;
-	tsen.EVOHOME2.type=pTypeEvohomeZone;
-	tsen.EVOHOME2.subtype=sTypeEvohomeZone;
-	RFX_SETID3(msg.GetID(0),tsen.EVOHOME2.id1,tsen.EVOHOME2.id2,tsen.EVOHOME2.id3) //will be id of controller so must use zone number
+	_tDeviceUpdate update;
+	update.devType=pTypeEvohomeZone;
+	update.subType=sTypeEvohomeZone;
+	update.ID=msg.GetID(0); //will be id of controller so must use zone number
 	
-	tsen.EVOHOME2.zone = msg.payload[0]+1;//controller is 0 so let our zones start from 1...
-	if(tsen.EVOHOME2.zone>m_nMaxZones)
+	update.Unit = msg.payload[0]+1;//controller is 0 so let our zones start from 1...
+	if(update.Unit>m_nMaxZones)
 	{
-		Log(false,LOG_ERROR,"evohome: %s: Error zone number out of bounds: %d", tag, tsen.EVOHOME2.zone);
+		Log(false,LOG_ERROR,"evohome: %s: Error zone number out of bounds: %d", tag, update.Unit);
 		return false;
 	}
-	tsen.EVOHOME2.updatetype = updSetPoint;//setpoint
-	tsen.EVOHOME2.temperature = msg.payload[1] << 8 | msg.payload[2];
-	if(tsen.EVOHOME2.temperature==0x7FFF)
+	update.EVOHOME.updatetype = updSetPoint;//setpoint
+	update.EVOHOME.temperature = msg.payload[1] << 8 | msg.payload[2];
+	if(update.EVOHOME.temperature==0x7FFF)
 	{
-		Log(true,LOG_STATUS,"evohome: %s: Warning setpoint not set for zone %d",tag, tsen.EVOHOME2.zone);
+		Log(true,LOG_STATUS,"evohome: %s: Warning setpoint not set for zone %d",tag, update.Unit);
 		return true;
 	}
-	SetMaxZoneCount(tsen.EVOHOME2.zone);//this should increase on startup as we poll all zones so we don't respond to changes here
-	if(m_ZoneOverrideLocal[tsen.EVOHOME2.zone-1]==zmWind || m_ZoneOverrideLocal[tsen.EVOHOME2.zone-1]==zmLocal)
+	SetMaxZoneCount(update.Unit);//this should increase on startup as we poll all zones so we don't respond to changes here
+	if(m_ZoneOverrideLocal[update.Unit-1]==zmWind || m_ZoneOverrideLocal[update.Unit-1]==zmLocal)
 	{
-		Log(true,LOG_STATUS,"evohome: %s: A local override is in effect for zone %d",tag,tsen.EVOHOME2.zone);
+		Log(true,LOG_STATUS,"evohome: %s: A local override is in effect for zone %d",tag,update.Unit);
 		return true;
 	}
-	tsen.EVOHOME2.mode=ConvertMode(m_evoToDczOverrideMode,msg.payload[3]);
-	if(tsen.EVOHOME2.mode==-1)
+	update.EVOHOME.mode=ConvertMode(m_evoToDczOverrideMode,msg.payload[3]);
+	if(update.EVOHOME.mode==-1)
 	{
 		Log(false,LOG_STATUS,"evohome: %s: WARNING unexpected mode %d",tag,msg.payload[3]);
 		return false;
 	}
-	tsen.EVOHOME2.controllermode=ConvertMode(m_evoToDczControllerMode,GetControllerMode());
+	update.EVOHOME.controllermode=ConvertMode(m_evoToDczControllerMode,GetControllerMode());
 	if(msg.payloadsize == 13)
 	{	
-		CEvohomeDateTime::DecodeDateTime(tsen.EVOHOME2,msg.payload,7);
-		Log(true,LOG_STATUS,"evohome: %s: Setting: %d: %d (%d=%s) %s", tag, tsen.EVOHOME2.zone, tsen.EVOHOME2.temperature, tsen.EVOHOME2.mode, GetZoneModeName(tsen.EVOHOME2.mode),CEvohomeDateTime::GetStrDate(tsen.EVOHOME2).c_str());
+		CEvohomeDateTime::DecodeDateTime(update.EVOHOME,msg.payload,7);
+		Log(true,LOG_STATUS,"evohome: %s: Setting: %d: %d (%d=%s) %s", tag, update.Unit, update.EVOHOME.temperature, update.EVOHOME.mode, GetZoneModeName(update.EVOHOME.mode),CEvohomeDateTime::GetStrDate(update.EVOHOME).c_str());
 	}
 	else
 	{
-		Log(true,LOG_STATUS,"evohome: %s: Setting: %d: %d (%d=%s)", tag, tsen.EVOHOME2.zone, tsen.EVOHOME2.temperature, tsen.EVOHOME2.mode, GetZoneModeName(tsen.EVOHOME2.mode));
+		Log(true,LOG_STATUS,"evohome: %s: Setting: %d: %d (%d=%s)", tag, update.Unit, update.EVOHOME.temperature, update.EVOHOME.mode, GetZoneModeName(update.EVOHOME.mode));
 	}
 	
-	sDecodeRXMessage(this, (const unsigned char *)&tsen.EVOHOME2);//Decode message
+	sUpdateDevice(this, update);
 	return true;
 }
 
@@ -804,27 +904,25 @@ bool CEvohome::DecodeZoneTemp(CEvohomeMsg &msg)//0x30C9
 	}
 	
 	bool bRefresh=false;
-	REVOBUF tsen;
-	memset(&tsen,0,sizeof(REVOBUF));
-	tsen.EVOHOME2.len=sizeof(tsen.EVOHOME2)-1;
-	tsen.EVOHOME2.type=pTypeEvohomeZone;
-	tsen.EVOHOME2.subtype=sTypeEvohomeZone;
-	RFX_SETID3(msg.GetID(0),tsen.EVOHOME2.id1,tsen.EVOHOME2.id2,tsen.EVOHOME2.id3);
+	_tDeviceUpdate update;
+	update.devType=pTypeEvohomeZone;
+	update.subType=sTypeEvohomeZone;
+	update.ID=msg.GetID(0);
 	for (int i = 0 ; i < msg.payloadsize ; i += 3) {
 		//if this is broadcast direct from the sensor then the zoneID is always 0 and we need to match on the device id if possible (use zone 0 to indicate this)
 		//otherwise use the zone number...controller is 0 so let our zones start from 1...
 		if (msg.GetID(0) == GetControllerID())
-			tsen.EVOHOME2.zone = msg.payload[i]+1;
+			update.Unit = msg.payload[i]+1;
 		else
-			tsen.EVOHOME2.zone = 0;
-		tsen.EVOHOME2.temperature = msg.payload[i + 1] << 8 | msg.payload[i + 2];
+			update.Unit = 0;
+		update.EVOHOME.temperature = msg.payload[i + 1] << 8 | msg.payload[i + 2];
 		//this is sent for zones that use a zone temperature instead of the internal sensor.
-		Log(true,LOG_STATUS,"evohome: %s: Zone sensor msg: 0x%x: %d: %d", tag, msg.GetID(0), tsen.EVOHOME2.zone, tsen.EVOHOME2.temperature);
-		if(tsen.EVOHOME2.temperature!=0x7FFF)//afaik this is the error value just ignore it right now as we have no way to report errors...also perhaps could be returned if DHW is not installed?
+		Log(true,LOG_STATUS,"evohome: %s: Zone sensor msg: 0x%x: %d: %d", tag, msg.GetID(0), update.Unit, update.EVOHOME.temperature);
+		if(update.EVOHOME.temperature!=0x7FFF)//afaik this is the error value just ignore it right now as we have no way to report errors...also perhaps could be returned if DHW is not installed?
 		{
-			sDecodeRXMessage(this, (const unsigned char *)&tsen.EVOHOME2);//Decode message
+			sUpdateDevice(this, update);
 			if (msg.GetID(0) == GetControllerID())
-				bRefresh=SetMaxZoneCount(tsen.EVOHOME2.zone);//this should increase on startup as we poll all zones so we don't respond to changes here
+				bRefresh=SetMaxZoneCount(update.Unit);//this should increase on startup as we poll all zones so we don't respond to changes here
 		}
 	}
 
@@ -865,36 +963,34 @@ bool CEvohome::DecodeDHWState(CEvohomeMsg &msg)//1F41
 		return false;
 	}
 	
-	REVOBUF tsen;
-	memset(&tsen,0,sizeof(REVOBUF));
-	tsen.EVOHOME2.len=sizeof(tsen.EVOHOME2)-1;
-	tsen.EVOHOME2.type=pTypeEvohomeWater;
-	tsen.EVOHOME2.subtype=sTypeEvohomeWater;
-	RFX_SETID3(msg.GetID(0),tsen.EVOHOME2.id1,tsen.EVOHOME2.id2,tsen.EVOHOME2.id3) //will be id of controller so must use zone number
+	_tDeviceUpdate update;
+	update.devType=pTypeEvohomeWater;
+	update.subType=sTypeEvohomeWater;
+	update.ID=msg.GetID(0); //will be id of controller so must use zone number
 	
-	tsen.EVOHOME2.zone = msg.payload[0]+1;////NA to DHW...controller is 0 so let our zones start from 1...
-	tsen.EVOHOME2.updatetype = updSetPoint;//state
-	tsen.EVOHOME2.temperature = msg.payload[1];//just on or off for DHW
-	if(tsen.EVOHOME2.temperature == 0x7F)//FIXME this is just a guess?
+	update.Unit = msg.payload[0]+1;////NA to DHW...controller is 0 so let our zones start from 1...
+	update.EVOHOME.updatetype = updSetPoint;//state
+	update.EVOHOME.temperature = msg.payload[1];//just on or off for DHW
+	if(update.EVOHOME.temperature == 0x7F)//FIXME this is just a guess?
 		return false;
-	tsen.EVOHOME2.mode=ConvertMode(m_evoToDczOverrideMode,msg.payload[2]);
-	if(tsen.EVOHOME2.mode==-1)
+	update.EVOHOME.mode=ConvertMode(m_evoToDczOverrideMode,msg.payload[2]);
+	if(update.EVOHOME.mode==-1)
 	{
 		Log(false,LOG_STATUS,"evohome: %s: WARNING unexpected mode %d",tag, msg.payload[2]);
 		return false;
 	}
-	tsen.EVOHOME2.controllermode=ConvertMode(m_evoToDczControllerMode,GetControllerMode());
+	update.EVOHOME.controllermode=ConvertMode(m_evoToDczControllerMode,GetControllerMode());
 	if(msg.payloadsize == 12)
 	{	
-		CEvohomeDateTime::DecodeDateTime(tsen.EVOHOME2,msg.payload,6);
-		Log(true,LOG_STATUS,"evohome: %s: Setting: %d: %d (%d=%s) %s", tag, tsen.EVOHOME2.zone, tsen.EVOHOME2.temperature, tsen.EVOHOME2.mode, GetZoneModeName(tsen.EVOHOME2.mode),CEvohomeDateTime::GetStrDate(tsen.EVOHOME2).c_str());
+		CEvohomeDateTime::DecodeDateTime(update.EVOHOME,msg.payload,6);
+		Log(true,LOG_STATUS,"evohome: %s: Setting: %d: %d (%d=%s) %s", tag, update.Unit, update.EVOHOME.temperature, update.EVOHOME.mode, GetZoneModeName(update.EVOHOME.mode),CEvohomeDateTime::GetStrDate(update.EVOHOME).c_str());
 	}
 	else
 	{
-		Log(true,LOG_STATUS,"evohome: %s: Setting: %d: %d (%d=%s)", tag, tsen.EVOHOME2.zone, tsen.EVOHOME2.temperature, tsen.EVOHOME2.mode, GetZoneModeName(tsen.EVOHOME2.mode));
+		Log(true,LOG_STATUS,"evohome: %s: Setting: %d: %d (%d=%s)", tag, update.Unit, update.EVOHOME.temperature, update.EVOHOME.mode, GetZoneModeName(update.EVOHOME.mode));
 	}
 	
-	sDecodeRXMessage(this, (const unsigned char *)&tsen.EVOHOME2);//Decode message
+	sUpdateDevice(this, update);
 	return true;
 }
 
@@ -922,19 +1018,17 @@ bool CEvohome::DecodeDHWTemp(CEvohomeMsg &msg)//1260
 		Log(true,LOG_STATUS,"evohome: %s: WARNING: sensor reading with zone != 0: 0x%x - %d", tag, msg.GetID(0), msg.payload[0]);
 	}
 		
-	REVOBUF tsen;
-	memset(&tsen,0,sizeof(REVOBUF));
-	tsen.EVOHOME2.len=sizeof(tsen.EVOHOME2)-1;
-	tsen.EVOHOME2.type=pTypeEvohomeWater;
-	tsen.EVOHOME2.subtype=sTypeEvohomeWater;
-	RFX_SETID3(msg.GetID(0),tsen.EVOHOME2.id1,tsen.EVOHOME2.id2,tsen.EVOHOME2.id3);
+	_tDeviceUpdate update;
+	update.devType=pTypeEvohomeWater;
+	update.subType=sTypeEvohomeWater;
+	update.ID=msg.GetID(0);
 	
 	for (int i = 0 ; i < msg.payloadsize ; i += 3) {
-		tsen.EVOHOME2.zone = msg.payload[i]+1;//we're using zone 0 to trigger a lookup on ID rather than zone number (not relevant for DHW)
-		tsen.EVOHOME2.temperature = msg.payload[i + 1] << 8 | msg.payload[i + 2];
-		Log(true,LOG_STATUS,"evohome: %s: DHW sensor msg: 0x%x: %d: %d", tag, msg.GetID(0), tsen.EVOHOME2.zone, tsen.EVOHOME2.temperature);
-		if(tsen.EVOHOME2.temperature!=0x7FFF)//afaik this is the error value just ignore it right now as we have no way to report errors...also perhaps could be returned if DHW is not installed?
-			sDecodeRXMessage(this, (const unsigned char *)&tsen.EVOHOME2);//Decode message
+		update.Unit = msg.payload[i]+1;//we're using zone 0 to trigger a lookup on ID rather than zone number (not relevant for DHW)
+		update.EVOHOME.temperature = msg.payload[i + 1] << 8 | msg.payload[i + 2];
+		Log(true,LOG_STATUS,"evohome: %s: DHW sensor msg: 0x%x: %d: %d", tag, msg.GetID(0), update.Unit, update.EVOHOME.temperature);
+		if(update.EVOHOME.temperature!=0x7FFF)//afaik this is the error value just ignore it right now as we have no way to report errors...also perhaps could be returned if DHW is not installed?
+			sUpdateDevice(this, update);
 	}
 
 	return true;
@@ -952,24 +1046,22 @@ bool CEvohome::DecodeControllerMode(CEvohomeMsg &msg)//2E04
 		return false;
 	}
 	
-	REVOBUF tsen;
-	memset(&tsen,0,sizeof(REVOBUF));
-	tsen.EVOHOME1.len=sizeof(tsen.EVOHOME1)-1;
-	tsen.EVOHOME1.type=pTypeEvohome;
-	tsen.EVOHOME1.subtype=sTypeEvohome;
-	RFX_SETID3(msg.GetID(0),tsen.EVOHOME1.id1,tsen.EVOHOME1.id2,tsen.EVOHOME1.id3);
+	_tDeviceUpdate update;
+	update.devType=pTypeEvohome;
+	update.subType=sTypeEvohome;
+	update.ID=msg.GetID(0);
 	
 	int nControllerMode=msg.payload[0];
-	tsen.EVOHOME1.status=ConvertMode(m_evoToDczControllerMode,nControllerMode);//this converts to the modes originally setup with the web client ver
-	if(tsen.EVOHOME1.status==-1)
+	update.EVOHOME.status=ConvertMode(m_evoToDczControllerMode,nControllerMode);//this converts to the modes originally setup with the web client ver
+	if(update.EVOHOME.status==-1)
 	{
 		Log(false,LOG_STATUS,"evohome: %s: WARNING unexpected mode %d",tag, nControllerMode);
 		return false;
 	}
-	CEvohomeDateTime::DecodeDateTime(tsen.EVOHOME1,msg.payload,1);
-	tsen.EVOHOME1.mode=msg.payload[7];//1 is tmp 0 is perm
-	Log(true,LOG_STATUS,"evohome: %s: Setting: (%d=%s) (%d=%s) %s", tag, tsen.EVOHOME1.status, GetControllerModeName(tsen.EVOHOME1.status),tsen.EVOHOME1.mode,tsen.EVOHOME1.mode?"Temporary":"Permanent",CEvohomeDateTime::GetStrDate(tsen.EVOHOME1).c_str());
-	sDecodeRXMessage(this, (const unsigned char *)&tsen.EVOHOME1);//Decode message
+	CEvohomeDateTime::DecodeDateTime(update.EVOHOME,msg.payload,1);
+	update.EVOHOME.mode=msg.payload[7];//1 is tmp 0 is perm
+	Log(true,LOG_STATUS,"evohome: %s: Setting: (%d=%s) (%d=%s) %s", tag, update.EVOHOME.status, GetControllerModeName(update.EVOHOME.status),update.EVOHOME.mode,update.EVOHOME.mode?"Temporary":"Permanent",CEvohomeDateTime::GetStrDate(update.EVOHOME).c_str());
+	sUpdateDevice(this, update);
 	
 	if(SetControllerMode(nControllerMode))//if only the until time changed we should be ok as the unit will broadcast a new controller mode when the current mode ends
 		RequestZoneState();//This can conflict with our startup polling but will still succeed ok
@@ -1064,35 +1156,33 @@ bool CEvohome::DecodeZoneWindow(CEvohomeMsg &msg)
 		Log(false,LOG_ERROR,"evohome: %s: Error decoding command, packet size too small: %d", tag, msg.payloadsize);
 		return false;
 	}
-	REVOBUF tsen;
-	memset(&tsen,0,sizeof(REVOBUF));
-	tsen.EVOHOME2.len=sizeof(tsen.EVOHOME2)-1;
-	tsen.EVOHOME2.type=pTypeEvohomeZone;
-	tsen.EVOHOME2.subtype=sTypeEvohomeZone;
-	RFX_SETID3(msg.GetID(0),tsen.EVOHOME2.id1,tsen.EVOHOME2.id2,tsen.EVOHOME2.id3)
+	_tDeviceUpdate update;
+	update.devType=pTypeEvohomeZone;
+	update.subType=sTypeEvohomeZone;
+	update.ID=msg.GetID(0);
 	
 	uint8_t nWindow,nMisc;
-	msg.Get(tsen.EVOHOME2.zone).Get(nWindow).Get(nMisc);//not sure what the last byte is seems to always be 0
-	if(tsen.EVOHOME2.zone>=m_nMaxZones)
+	msg.Get(update.Unit).Get(nWindow).Get(nMisc);//not sure what the last byte is seems to always be 0
+	if(update.Unit>=m_nMaxZones)
 	{
-		Log(false,LOG_ERROR,"evohome: %s: Error zone number out of bounds: %d", tag, tsen.EVOHOME2.zone+1);
+		Log(false,LOG_ERROR,"evohome: %s: Error zone number out of bounds: %d", tag, update.Unit+1);
 		return false;
 	}
-	tsen.EVOHOME2.mode=(nWindow?zmWind:zmAuto);
-	tsen.EVOHOME2.updatetype = updOverride;//zone modde override (window / local)
-	m_ZoneOverrideLocal[tsen.EVOHOME2.zone]=static_cast<zoneModeType>(tsen.EVOHOME2.mode);
+	update.EVOHOME.mode=(nWindow?zmWind:zmAuto);
+	update.EVOHOME.updatetype = updOverride;//zone modde override (window / local)
+	m_ZoneOverrideLocal[update.Unit]=static_cast<zoneModeType>(update.EVOHOME.mode);
 	
-	tsen.EVOHOME2.zone++;
-	SetMaxZoneCount(tsen.EVOHOME2.zone);//this should increase on startup as we poll all zones so we don't respond to changes here
+	update.Unit++;
+	SetMaxZoneCount(update.Unit);//this should increase on startup as we poll all zones so we don't respond to changes here
 	
 	if(nWindow!=0 && nWindow!=0xC8)
 		Log(true,LOG_STATUS,"evohome: %s: Unexpected zone state Window=%d",tag,nWindow);
 	if(nMisc!=0)
 		Log(true,LOG_STATUS,"evohome: %s: Unexpected zone state nMisc=%d",tag,nMisc);
-	Log(true,LOG_STATUS,"evohome: %s: %d: Window %d",tag,tsen.EVOHOME2.zone,nWindow);
+	Log(true,LOG_STATUS,"evohome: %s: %d: Window %d",tag,update.Unit,nWindow);
 	
 	if (msg.GetID(0) == GetControllerID())
-		sDecodeRXMessage(this, (const unsigned char *)&tsen.EVOHOME2);//Decode message
+		sUpdateDevice(this, update);
 	
 	return true;
 }
@@ -1189,24 +1279,97 @@ bool CEvohome::DecodeActuatorState(CEvohomeMsg &msg)
 	return true;
 }
 
+//True if both writes set the same thing (command, destination and zone) so the later one supersedes the earlier one
+static bool IsSameWriteTarget(const CEvohomeMsg &a, const CEvohomeMsg &b)
+{
+	if(a.type!=CEvohomeMsg::pktwrt || b.type!=CEvohomeMsg::pktwrt)
+		return false;
+	if(a.command!=b.command || a.GetID(1)!=b.GetID(1))
+		return false;
+	if(a.command==CEvohome::cmdSetpointOverride || a.command==CEvohome::cmdDHWState)
+		return (a.payloadsize>0 && b.payloadsize>0 && a.payload[0]==b.payload[0]);//zone
+	return true;
+}
+
 void CEvohome::AddSendQueue(const CEvohomeMsg &msg)
 {
 	boost::lock_guard<boost::mutex> l(m_mtxSend);
-	m_SendQueue.push_back(msg);//may throw bad_alloc
+	//writes come from the user (or a script), requests are polling
+	int nPriority=(msg.type==CEvohomeMsg::pktwrt)?spUser:spPoll;
+	if(msg.type==CEvohomeMsg::pktreq)
+	{
+		//the same request is already waiting, the answer will serve both
+		for(SendQueue::const_iterator itt=m_SendQueue[nPriority].begin();itt!=m_SendQueue[nPriority].end();++itt)
+		{
+			if(itt->msg==msg)
+			{
+				m_SendStats.Deduplicated++;
+				return;
+			}
+		}
+	}
+	else if(msg.type==CEvohomeMsg::pktwrt)
+	{
+		//a write for the same zone still waiting (or backing off) is replaced in place so the last user setting always wins,
+		//the one on air cannot be recalled, the new write is queued behind it
+		for(SendQueue::iterator itt=m_SendQueue[nPriority].begin();itt!=m_SendQueue[nPriority].end();++itt)
+		{
+			if(m_bSendInFlight && m_itSendInFlight==itt)
+				continue;
+			if(IsSameWriteTarget(itt->msg,msg))
+			{
+				itt->msg=msg;
+				itt->tQueued=boost::posix_time::microsec_clock::universal_time();
+				itt->tNextSend=itt->tQueued;
+				itt->nRetries=0;
+				m_SendStats.Deduplicated++;
+				return;
+			}
+		}
+	}
+	_tSendItem sitem;
+	sitem.msg=msg;
+	sitem.tQueued=boost::posix_time::microsec_clock::universal_time();
+	sitem.tNextSend=sitem.tQueued;
+	sitem.nRetries=0;
+	m_SendQueue[nPriority].push_back(sitem);//may throw bad_alloc
+	int nQueueSize=m_SendQueue[spUser].size()+m_SendQueue[spPoll].size();
+	if(nQueueSize>m_SendStats.MaxQueueSize)
+		m_SendStats.MaxQueueSize=nQueueSize;
+}
+
+void CEvohome::AckSendItem(const int nPriority, SendQueue::iterator itt, const boost::posix_time::ptime &tNow)
+{
+	long nAckTime=(long)(tNow-itt->tQueued).total_milliseconds();
+	m_SendStats.Acked++;
+	m_nAckTimeTotal+=nAckTime;
+	if(nAckTime>m_SendStats.MaxAckTime)
+		m_SendStats.MaxAckTime=nAckTime;
+	if(m_bSendInFlight && m_itSendInFlight==itt)
+		m_bSendInFlight=false;
+	m_SendQueue[nPriority].erase(itt);
 }
 
 void CEvohome::PopSendQueue(const CEvohomeMsg &msg)
 {
 	boost::lock_guard<boost::mutex> l(m_mtxSend);
-	if(!m_SendQueue.empty())
+	boost::posix_time::ptime tNow=boost::posix_time::microsec_clock::universal_time();
+	if(m_bSendInFlight && m_itSendInFlight->msg==msg)
+	{
+		AckSendItem(m_nSendInFlightPriority,m_itSendInFlight,tNow);
+		return;
+	}
+	//late echo of a message that timed out and waits for a retry
+	for(int nPriority=0;nPriority<spCount;nPriority++)
 	{
-		if(m_SendQueue.front()==msg || m_nSendFail>=10)
+		for(SendQueue::iterator itt=m_SendQueue[nPriority].begin();itt!=m_SendQueue[nPriority].end();++itt)
 		{
-			m_SendQueue.pop_front();
-			m_nSendFail=0;
+			if((itt->nRetries>0)&&(itt->msg==msg))
+			{
+				AckSendItem(nPriority,itt,tNow);
+				return;
+			}
 		}
-		else
-			m_nSendFail++;
 	}
 }
 
@@ -1216,11 +1379,83 @@ void CEvohome::Do_Send()
 	if(m_nBufPtr>0)
 		return;
 	boost::lock_guard<boost::mutex> sl(m_mtxSend);
-	if(!m_SendQueue.empty())
+	boost::posix_time::ptime tNow=boost::posix_time::microsec_clock::universal_time();
+
+	m_fAirtimeBudget+=(tNow-m_tAirtimeUpdate).total_milliseconds()*EVOHOME_DUTY_CYCLE;
+	if(m_fAirtimeBudget>EVOHOME_AIRTIME_BURST_MS)
+		m_fAirtimeBudget=EVOHOME_AIRTIME_BURST_MS;
+	m_tAirtimeUpdate=tNow;
+
+	if(m_bSendInFlight)
 	{
-		std::string out(m_SendQueue.front().Encode()+"\r\n");
-		write(out.c_str(),out.length());
+		if(tNow<m_tAckDeadline)
+			return;
+		//no echo, most likely a collision with another transmitter, retry after a random exponential back-off
+		m_bSendInFlight=false;
+		_tSendItem &sitem=*m_itSendInFlight;
+		sitem.nRetries++;
+		//a later write for the same zone was queued while this one was on air, retrying would undo it
+		bool bSuperseded=false;
+		SendQueue::iterator itNext=m_itSendInFlight;
+		for(++itNext;itNext!=m_SendQueue[m_nSendInFlightPriority].end();++itNext)
+		{
+			if(IsSameWriteTarget(sitem.msg,itNext->msg))
+			{
+				bSuperseded=true;
+				break;
+			}
+		}
+		if(bSuperseded)
+		{
+			m_SendStats.Deduplicated++;
+			m_SendQueue[m_nSendInFlightPriority].erase(m_itSendInFlight);
+		}
+		else if(sitem.nRetries>EVOHOME_MAX_RETRIES)
+		{
+			Log(false,LOG_ERROR,"evohome: no response for command %04x after %d retries, dropped",sitem.msg.command,EVOHOME_MAX_RETRIES);
+			m_SendStats.Dropped++;
+			m_SendQueue[m_nSendInFlightPriority].erase(m_itSendInFlight);
+		}
+		else
+		{
+			int nWindow=std::min(EVOHOME_BACKOFF_BASE_MS<<std::min(sitem.nRetries-1,16),EVOHOME_BACKOFF_MAX_MS);
+			sitem.tNextSend=tNow+boost::posix_time::milliseconds(nWindow/2+rand()%(nWindow/2+1));
+			m_SendStats.Retries++;
+		}
 	}
+	if(tNow<m_tNextSendSlot)
+		return;
+
+	for(int nPriority=0;nPriority<spCount;nPriority++)
+	{
+		for(SendQueue::iterator itt=m_SendQueue[nPriority].begin();itt!=m_SendQueue[nPriority].end();++itt)
+		{
+			if(itt->tNextSend>tNow)
+				continue;
+			double fAirtime=EVOHOME_PACKET_OVERHEAD+itt->msg.payloadsize;
+			if(m_fAirtimeBudget<fAirtime)
+				return;
+			std::string out(itt->msg.Encode()+"\r\n");
+			write(out.c_str(),out.length());
+			m_fAirtimeBudget-=fAirtime;
+			m_SendStats.Sent++;
+			m_bSendInFlight=true;
+			m_nSendInFlightPriority=nPriority;
+			m_itSendInFlight=itt;
+			m_tAckDeadline=tNow+boost::posix_time::milliseconds(EVOHOME_ACK_TIMEOUT_MS);
+			m_tNextSendSlot=tNow+boost::posix_time::milliseconds(EVOHOME_SEND_INTERVAL_MS);
+			return;
+		}
+	}
+}
+
+void CEvohome::GetSendStats(_tEvohomeSendStats &stats)
+{
+	boost::lock_guard<boost::mutex> l(m_mtxSend);
+	stats=m_SendStats;
+	stats.QueueSizeUser=m_SendQueue[spUser].size();
+	stats.QueueSize=stats.QueueSizeUser+m_SendQueue[spPoll].size();
+	stats.AvgAckTime=(m_SendStats.Acked>0)?(long)(m_nAckTimeTotal/m_SendStats.Acked):0;
 }
 
 bool CEvohome::SetZoneCount(uint8_t nZoneCount)
@@ -1348,6 +1583,8 @@ void CEvohome::Log(const char *szMsg, CEvohomeMsg &msg)
 
 void CEvohome::Log(bool bDebug, int nLogLevel, const char* format, ... )
 {
+        if(m_bReplay)
+                return;
         va_list argList;
         char cbuffer[1024];
         va_start(argList, format);
@@ -1363,3 +1600,203 @@ void CEvohome::Log(bool bDebug, int nLogLevel, const char* format, ... )
 		*m_pEvoLog << std::endl;
 	}
 }
+
+//The previous split/sscanf decoder, kept as reference for ReplayLog
+static bool DecodePacketReference(CEvohomeMsg &msg, const char * rawmsg)
+{
+	int cmdidx=0;
+	int nid=0;
+	std::string line(rawmsg);
+	std::vector<std::string> tkns;
+	boost::split(tkns,line,boost::is_any_of(" "),boost::token_compress_on);
+	for (size_t i = 0; i < tkns.size(); i++)
+	{
+		std::string tkn(tkns[i]);
+		if(i==0)
+		{
+		}
+		else if(i==1)
+		{
+			if(msg.SetPacketType(tkn)!=CEvohomeMsg::pktunk)
+				msg.SetFlag(CEvohomeMsg::flgpkt);
+		}
+		else if(cmdidx && i==cmdidx+2)
+		{
+			if((!msg.GetFlag(CEvohomeMsg::flgps))||(tkn.length()%2)||(tkn.length()/2>CEvohomeMsg::m_nBufSize))
+				return false;
+			int ps=0;
+			for(size_t j=0;j<tkn.length();j+=2)
+				sscanf(tkn.substr(j,2).c_str(),"%02hhx",&msg.payload[ps++]);
+			if(ps!=msg.payloadsize)
+				return false;
+			msg.SetFlag(CEvohomeMsg::flgpay);
+		}
+		else if(tkn.length()==4)
+		{
+			sscanf(tkn.c_str(),"%04x",&msg.command);
+			msg.SetFlag(CEvohomeMsg::flgcmd);
+			if(!cmdidx)
+				cmdidx=i;
+		}
+		else if(tkn.length()==3)
+		{
+			if(tkn.find('-')==std::string::npos)
+			{
+				if(i==2)
+				{
+					msg.timestamp=atoi(tkn.c_str());
+					msg.SetFlag(CEvohomeMsg::flgts);
+				}
+				else if(cmdidx && i==cmdidx+1)
+				{
+					msg.payloadsize=atoi(tkn.c_str());
+					msg.SetFlag(CEvohomeMsg::flgps);
+				}
+			}
+		}
+		else if(tkn.find(':')!=std::string::npos)
+		{
+			if(nid>=3)
+				continue;
+			if(tkn.find('-')==std::string::npos)
+			{
+				msg.id[nid]=tkn;
+				msg.SetFlag(CEvohomeMsg::flgid1<<nid);
+			}
+			nid++;
+		}
+	}
+	return msg.IsValid();
+}
+
+static bool IsSameDecode(const CEvohomeMsg &a, const CEvohomeMsg &b)
+{
+	if((a.IsValid()!=b.IsValid())||(a.flags!=b.flags)||(a.type!=b.type))
+		return false;
+	if(!a.IsValid())
+		return true;//rejected by both, the decode stops at different points
+	for(int i=0;i<3;i++)
+		if(a.id[i].GetID()!=b.id[i].GetID())
+			return false;
+	if((a.timestamp!=b.timestamp)||(a.command!=b.command)||(a.payloadsize!=b.payloadsize))
+		return false;
+	return (memcmp(a.payload,b.payload,a.payloadsize)==0);
+}
+
+bool CEvohome::ReplayLog(const std::string &szLogFile)
+{
+	std::ifstream infile(szLogFile.c_str());
+	if(!infile.is_open())
+	{
+		_log.Log(LOG_ERROR,"evohome: cannot open replay file %s",szLogFile.c_str());
+		return false;
+	}
+	//Lines are written by Log(rawmsg,msg) as "YYYY-MM-DD HH:MM:SS <raw message> (<payload>)", plain captures without date are accepted too
+	std::vector<std::string> msgs;
+	std::string sLine;
+	while(std::getline(infile,sLine))
+	{
+		if((sLine.size()>20)&&(sLine[4]=='-')&&(sLine[13]==':')&&(sLine[19]==' '))
+			sLine=sLine.substr(20);
+		size_t nPos=sLine.find(" (");
+		if(nPos!=std::string::npos)
+			sLine=sLine.substr(0,nPos);
+		nPos=sLine.find_last_not_of("\r\n");
+		if(nPos==std::string::npos)
+			continue;
+		sLine.erase(nPos+1);
+		msgs.push_back(sLine);
+	}
+	infile.close();
+	if(msgs.empty())
+	{
+		_log.Log(LOG_ERROR,"evohome: no messages in replay file %s",szLogFile.c_str());
+		return false;
+	}
+
+	m_bReplay=true;
+	//Parity with the reference decoder
+	size_t nValid=0,nDiff=0;
+	std::vector<std::string>::const_iterator itt;
+	for(itt=msgs.begin();itt!=msgs.end();++itt)
+	{
+		CEvohomeMsg msg(itt->c_str());
+		CEvohomeMsg msgref;
+		DecodePacketReference(msgref,itt->c_str());
+		if(msg.IsValid())
+			nValid++;
+		if(!IsSameDecode(msg,msgref))
+		{
+			if(nDiff<10)
+				_log.Log(LOG_ERROR,"evohome: decode differs from reference: '%s'",itt->c_str());
+			nDiff++;
+		}
+	}
+
+	//Corrupted copies of each message, the decoder may reject them but must not read past the line
+	const char szFuzzChars[]="0123456789ABCDEFabcdef:- -.xG";
+	size_t nFuzz=0,nFuzzValid=0,nFuzzDiff=0;
+	srand(1);
+	for(itt=msgs.begin();itt!=msgs.end();++itt)
+	{
+		for(int ii=0;ii<8;ii++)
+		{
+			std::string sFuzz(*itt);
+			int nMutations=1+rand()%3;
+			for(int jj=0;(jj<nMutations)&&(!sFuzz.empty());jj++)
+			{
+				size_t nPos=rand()%sFuzz.size();
+				switch(rand()%4)
+				{
+				case 0:
+					sFuzz[nPos]=szFuzzChars[rand()%(sizeof(szFuzzChars)-1)];
+					break;
+				case 1:
+					sFuzz.erase(nPos);
+					break;
+				case 2:
+					sFuzz.insert(nPos," ");
+					break;
+				default:
+					sFuzz.erase(nPos,1);
+					break;
+				}
+			}
+			CEvohomeMsg msg(sFuzz.c_str());
+			CEvohomeMsg msgref;
+			DecodePacketReference(msgref,sFuzz.c_str());
+			nFuzz++;
+			if(msg.IsValid())
+				nFuzzValid++;
+			if(!IsSameDecode(msg,msgref))
+				nFuzzDiff++;
+		}
+	}
+
+	//Decode rate of both decoders, over at least 100000 messages
+	size_t nPasses=100000/msgs.size()+1;
+	double msgsec[2];
+	for(int jj=0;jj<2;jj++)
+	{
+		boost::posix_time::ptime tstart=boost::posix_time::microsec_clock::universal_time();
+		for(size_t nPass=0;nPass<nPasses;nPass++)
+		{
+			for(itt=msgs.begin();itt!=msgs.end();++itt)
+			{
+				CEvohomeMsg msg;
+				if(jj==0)
+					msg.DecodePacket(itt->c_str());
+				else
+					DecodePacketReference(msg,itt->c_str());
+			}
+		}
+		long long us=(boost::posix_time::microsec_clock::universal_time()-tstart).total_microseconds();
+		msgsec[jj]=(us>0)?(double)(msgs.size()*nPasses)*1000000.0/us:0.0;
+	}
+	m_bReplay=false;
+
+	_log.Log(LOG_STATUS,"evohome: replayed %d messages, %d valid, %d differ from the reference decoder",(int)msgs.size(),(int)nValid,(int)nDiff);
+	_log.Log(LOG_STATUS,"evohome: %d corrupted messages, %d accepted, %d decoded differently (the reference decoder accepts invalid hex)",(int)nFuzz,(int)nFuzzValid,(int)nFuzzDiff);
+	_log.Log(LOG_STATUS,"evohome: %.0f messages/sec (reference decoder %.0f messages/sec)",msgsec[0],msgsec[1]);
+	return (nDiff==0);
+}
@@ -17,6 +17,7 @@
 
 #include "ASyncSerial.h"
 #include "DomoticzHardware.h"
+#include <boost/date_time/posix_time/posix_time.hpp>
 
 #define RFX_SETID3(ID,id1,id2,id3) {id1=ID>>16&0xFF;id2=ID>>8&0xFF;id3=ID&0xFF;}
 #define RFX_GETID3(id1,id2,id3) ((id1<<16)|(id2<<8)|id3)
@@ -322,13 +323,8 @@ public:
 	void SetFlag(int nFlag){flags|=nFlag;}
 	bool GetFlag(int nFlag){return (flags&nFlag);}
 	
-	packettype SetPacketType(const std::string &szPkt)
-	{
-		type=pktunk;
-		for(int i=pktinf;i<=pktwrt;i++)
-			if(szPkt==szPacketType[i])
-				return (type=static_cast<packettype>(i));
-	}
+	packettype SetPacketType(const std::string &szPkt){return SetPacketType(szPkt.c_str(),szPkt.length());}
+	packettype SetPacketType(const char *szPkt, const size_t nLen);
 	
 	std::string GetStrID(int idx) const
 	{
@@ -363,6 +359,20 @@ public:
 	unsigned char payload[m_nBufSize];
 };
 
+struct _tEvohomeSendStats
+{
+	int QueueSize;
+	int QueueSizeUser;	//user commands waiting
+	int MaxQueueSize;
+	unsigned long long Sent;	//transmissions including retries
+	unsigned long long Acked;
+	unsigned long long Retries;
+	unsigned long long Dropped;
+	unsigned long long Deduplicated;	//requests merged with a waiting one, writes superseded by a later one
+	long AvgAckTime;	//ms from queueing to the echo of the gateway
+	long MaxAckTime;
+};
+
 class CEvohome : public AsyncSerial, public CDomoticzHardwareBase
 {
 public:
@@ -445,7 +455,27 @@ public:
 	static void LogDate();
 	static void Log(bool bDebug, int nLogLevel, const char* format, ... );
 	static void Log(const char *szMsg, CEvohomeMsg &msg);
+	//Decodes the messages of a captured evoraw.log, checks the result against the reference decoder
+	//and a set of corrupted copies, and logs the decode rate (-evoreplay)
+	static bool ReplayLog(const std::string &szLogFile);
+
+	void GetSendStats(_tEvohomeSendStats &stats);
 private:
+	//Transmit priority, user commands are sent before the polling requests
+	enum sendPriority{
+		spUser,
+		spPoll,
+		spCount
+	};
+	struct _tSendItem
+	{
+		CEvohomeMsg msg;
+		boost::posix_time::ptime tQueued;
+		boost::posix_time::ptime tNextSend;
+		int nRetries;
+	};
+	typedef std::list<_tSendItem> SendQueue;
+
 	void Init();
 	bool StartHardware();
 	bool StopHardware();
@@ -528,9 +558,18 @@ private:
 	int m_nBufPtr;
 	
 	std::map < unsigned int, fnc_evohome_decode > m_Decoders;
-	std::list < CEvohomeMsg > m_SendQueue;
+	SendQueue m_SendQueue[spCount];
 	boost::mutex m_mtxSend;
-	int m_nSendFail;
+	bool m_bSendInFlight;	//waiting for the echo of m_itSendInFlight
+	int m_nSendInFlightPriority;
+	SendQueue::iterator m_itSendInFlight;
+	boost::posix_time::ptime m_tAckDeadline;
+	boost::posix_time::ptime m_tNextSendSlot;
+	double m_fAirtimeBudget;	//ms of airtime that can be used now
+	boost::posix_time::ptime m_tAirtimeUpdate;
+	_tEvohomeSendStats m_SendStats;
+	unsigned long long m_nAckTimeTotal;
+	void AckSendItem(const int nPriority, SendQueue::iterator itt, const boost::posix_time::ptime &tNow);
 	
 	uint8_t m_nZoneCount;
 	boost::mutex m_mtxZoneCount;
@@ -550,6 +589,7 @@ private:
 	unsigned int m_nMyID;//gateway ID
 	
 	static bool m_bDebug;//Debug mode for extra logging
+	static bool m_bReplay;//no logging while replaying a log file
 	static std::ofstream *m_pEvoLog;
 };
 
@@ -0,0 +1,385 @@
+#include "stdafx.h"
+#include "AsyncHTTPClient.h"
+#include <set>
+#include "HTTPClient.h"
+#include "../main/Logger.h"
+#include "../main/Helper.h"
+#if defined WIN32
+	#include "../curl/curl.h"
+#else
+	#include <curl/curl.h>
+#endif
+
+//maximum number of queued requests
+#define HTTP_MAX_QUEUE 256
+//maximum number of requests in progress
+#define HTTP_MAX_ACTIVE 8
+//maximum number of requests in progress to one host
+#define HTTP_MAX_HOST_ACTIVE 2
+//requests per second to one host, and the allowed burst
+#define HTTP_HOST_RATE 5
+#define HTTP_HOST_BURST 10
+//maximum seconds between retries
+#define HTTP_MAX_BACKOFF 60
+//seconds to finish pending requests when stopping
+#define HTTP_STOP_TIMEOUT 5
+
+CAsyncHTTPClient::CAsyncHTTPClient(void)
+{
+	m_multi=NULL;
+	m_stoprequested=false;
+}
+
+CAsyncHTTPClient::~CAsyncHTTPClient(void)
+{
+	StopThread();
+}
+
+bool CAsyncHTTPClient::StartThread()
+{
+	if (m_thread!=NULL)
+		return true;
+	if (!HTTPClient::CheckIfGlobalInitDone())
+		return false;
+	m_multi=curl_multi_init();
+	if (m_multi==NULL)
+		return false;
+#if LIBCURL_VERSION_NUM >= 0x071e00
+	curl_multi_setopt((CURLM*)m_multi, CURLMOPT_MAX_HOST_CONNECTIONS, (long)HTTP_MAX_HOST_ACTIVE);
+#endif
+	m_stoprequested=false;
+	m_thread = boost::shared_ptr<boost::thread>(new boost::thread(boost::bind(&CAsyncHTTPClient::Do_Work, this)));
+	return (m_thread!=NULL);
+}
+
+void CAsyncHTTPClient::StopThread()
+{
+	if (m_thread==NULL)
+		return;
+	{
+		boost::lock_guard<boost::mutex> l(m_mutex);
+		m_stoprequested=true;
+	}
+	m_cond.notify_all();
+	m_thread->join();
+	m_thread.reset();
+}
+
+bool CAsyncHTTPClient::GET(const std::string &url, const std::vector<std::string> &ExtraHeaders, const ResultCallback &callback, const int MaxRetries)
+{
+	return AddRequest(HTTP_METHOD_GET, url, "", ExtraHeaders, callback, MaxRetries);
+}
+
+bool CAsyncHTTPClient::POST(const std::string &url, const std::string &postdata, const std::vector<std::string> &ExtraHeaders, const ResultCallback &callback, const int MaxRetries)
+{
+	return AddRequest(HTTP_METHOD_POST, url, postdata, ExtraHeaders, callback, MaxRetries);
+}
+
+bool CAsyncHTTPClient::PUT(const std::string &url, const std::string &postdata, const std::vector<std::string> &ExtraHeaders, const ResultCallback &callback, const int MaxRetries)
+{
+	return AddRequest(HTTP_METHOD_PUT, url, postdata, ExtraHeaders, callback, MaxRetries);
+}
+
+//host:port of an url, without credentials
+std::string CAsyncHTTPClient::GetHost(const std::string &url)
+{
+	std::string host=url;
+	size_t pos=host.find("://");
+	if (pos!=std::string::npos)
+		host=host.substr(pos+3);
+	pos=host.find_first_of("/?");
+	if (pos!=std::string::npos)
+		host=host.substr(0,pos);
+	pos=host.rfind('@');
+	if (pos!=std::string::npos)
+		host=host.substr(pos+1);
+	return host;
+}
+
+bool CAsyncHTTPClient::AddRequest(const _eHTTPMethod Method, const std::string &url, const std::string &postdata, const std::vector<std::string> &ExtraHeaders, const ResultCallback &callback, const int MaxRetries)
+{
+	_tHTTPRequest request;
+	request.Method=Method;
+	request.URL=url;
+	request.PostData=postdata;
+	request.ExtraHeaders=ExtraHeaders;
+	request.Callback=callback;
+	request.Host=GetHost(url);
+	request.MaxRetries=MaxRetries;
+	request.Attempt=0;
+	request.NextAttempt=boost::posix_time::microsec_clock::universal_time();
+	request.pHeaders=NULL;
+	{
+		boost::lock_guard<boost::mutex> l(m_mutex);
+		if ((m_thread==NULL)||(m_stoprequested))
+			return false;
+		if (m_queue.size()>=HTTP_MAX_QUEUE)
+		{
+			_log.Log(LOG_ERROR,"HTTP: request queue full, dropping request to %s",request.Host.c_str());
+			return false;
+		}
+		m_queue.push_back(request);
+	}
+	m_cond.notify_all();
+	return true;
+}
+
+//Token bucket per host, called with m_mutex locked
+bool CAsyncHTTPClient::AllowRequest(const std::string &Host, const boost::posix_time::ptime &now)
+{
+	std::map<std::string,_tHostRate>::iterator itt=m_hosts.find(Host);
+	if (itt==m_hosts.end())
+	{
+		_tHostRate rate;
+		rate.Tokens=HTTP_HOST_BURST;
+		rate.LastRefill=now;
+		rate.Active=0;
+		itt=m_hosts.insert(std::pair<std::string,_tHostRate>(Host,rate)).first;
+	}
+	_tHostRate &rate=itt->second;
+	rate.Tokens+=(now-rate.LastRefill).total_milliseconds()*HTTP_HOST_RATE/1000.0;
+	if (rate.Tokens>HTTP_HOST_BURST)
+		rate.Tokens=HTTP_HOST_BURST;
+	rate.LastRefill=now;
+	if ((rate.Active>=HTTP_MAX_HOST_ACTIVE)||(rate.Tokens<1.0))
+		return false;
+	rate.Tokens-=1.0;
+	rate.Active++;
+	return true;
+}
+
+void CAsyncHTTPClient::StartRequests()
+{
+	boost::posix_time::ptime now=boost::posix_time::microsec_clock::universal_time();
+	std::vector<_tHTTPRequest> tostart;
+	{
+		boost::lock_guard<boost::mutex> l(m_mutex);
+		//requests to one host are started in order, a delayed request holds back the ones behind it
+		std::set<std::string> blockedhosts;
+		std::deque<_tHTTPRequest>::iterator itt=m_queue.begin();
+		while ((itt!=m_queue.end())&&(m_active.size()+tostart.size()<HTTP_MAX_ACTIVE))
+		{
+			if (
+				(blockedhosts.find(itt->Host)!=blockedhosts.end())||
+				(itt->NextAttempt>now)||
+				(!AllowRequest(itt->Host,now))
+				)
+			{
+				blockedhosts.insert(itt->Host);
+				++itt;
+				continue;
+			}
+			tostart.push_back(*itt);
+			itt=m_queue.erase(itt);
+		}
+	}
+	std::vector<_tHTTPRequest>::iterator itt;
+	for (itt=tostart.begin(); itt!=tostart.end(); ++itt)
+		StartRequest(*itt);
+}
+
+void CAsyncHTTPClient::StartRequest(_tHTTPRequest &request)
+{
+	CURL *curl=NULL;
+	if (!m_idle_handles.empty())
+	{
+		//connections are kept by the multi handle, so reused handles keep using them
+		curl=(CURL*)m_idle_handles.back();
+		m_idle_handles.pop_back();
+		curl_easy_reset(curl);
+	}
+	else
+		curl=curl_easy_init();
+	if (curl==NULL)
+	{
+		m_hosts[request.Host].Active--;
+		if (request.Callback)
+			request.Callback(false,"");
+		return;
+	}
+
+	_tHTTPRequest &active=m_active[curl];
+	active=request;
+	active.Response.clear();
+
+	HTTPClient::SetGlobalOptions(curl);
+	struct curl_slist *headers=NULL;
+	std::vector<std::string>::const_iterator itt;
+	for (itt=active.ExtraHeaders.begin(); itt!=active.ExtraHeaders.end(); ++itt)
+	{
+		headers = curl_slist_append(headers, (*itt).c_str());
+	}
+	if (headers!=NULL) {
+		curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+	}
+	active.pHeaders=headers;
+
+	curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)&active.Response);
+	curl_easy_setopt(curl, CURLOPT_URL, active.URL.c_str());
+	if (active.Method==HTTP_METHOD_POST)
+	{
+		curl_easy_setopt(curl, CURLOPT_POST, 1);
+		curl_easy_setopt(curl, CURLOPT_POSTFIELDS, active.PostData.c_str());
+	}
+	else if (active.Method==HTTP_METHOD_PUT)
+	{
+		curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "PUT");
+		curl_easy_setopt(curl, CURLOPT_POSTFIELDS, active.PostData.c_str());
+	}
+	curl_multi_add_handle((CURLM*)m_multi, curl);
+}
+
+void CAsyncHTTPClient::HandleFinished()
+{
+	CURLMsg *msg;
+	int msgs_left=0;
+	while ((msg=curl_multi_info_read((CURLM*)m_multi,&msgs_left))!=NULL)
+	{
+		if (msg->msg!=CURLMSG_DONE)
+			continue;
+		CURL *curl=msg->easy_handle;
+		CURLcode res=msg->data.result;
+		long http_code=0;
+		curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
+		curl_multi_remove_handle((CURLM*)m_multi, curl);
+
+		std::map<void*,_tHTTPRequest>::iterator itt=m_active.find(curl);
+		if (itt==m_active.end())
+		{
+			curl_easy_cleanup(curl);
+			continue;
+		}
+		_tHTTPRequest request=itt->second;
+		m_active.erase(itt);
+		if (request.pHeaders!=NULL)
+			curl_slist_free_all((struct curl_slist*)request.pHeaders);
+		request.pHeaders=NULL;
+		if (m_idle_handles.size()<HTTP_MAX_ACTIVE)
+			m_idle_handles.push_back(curl);
+		else
+			curl_easy_cleanup(curl);
+
+		bool bSuccess=((res==CURLE_OK)&&(http_code<500));
+		//only retry when the request did not reach (or was not handled by) the server,
+		//a gateway timeout may have been handled upstream so it is only retried for a GET
+		bool bRetry=(
+			(res==CURLE_COULDNT_RESOLVE_HOST)||
+			(res==CURLE_COULDNT_CONNECT)||
+			(http_code==502)||
+			(http_code==503)||
+			((http_code==504)&&(request.Method==HTTP_METHOD_GET))
+			);
+		{
+			boost::lock_guard<boost::mutex> l(m_mutex);
+			m_hosts[request.Host].Active--;
+			if ((bRetry)&&(request.Attempt<request.MaxRetries)&&(!m_stoprequested))
+			{
+				//retry with backoff, in front of the newer requests to this host
+				int delay=1<<request.Attempt;
+				if (delay>HTTP_MAX_BACKOFF)
+					delay=HTTP_MAX_BACKOFF;
+				request.Attempt++;
+				request.NextAttempt=boost::posix_time::microsec_clock::universal_time()+boost::posix_time::seconds(delay);
+				request.Response.clear();
+				m_queue.push_front(request);
+				continue;
+			}
+		}
+		if (!bSuccess)
+		{
+			if (res!=CURLE_OK)
+				_log.Log(LOG_ERROR,"HTTP: request to %s failed: %s",request.Host.c_str(),curl_easy_strerror(res));
+			else
+				_log.Log(LOG_ERROR,"HTTP: request to %s failed: HTTP %ld",request.Host.c_str(),http_code);
+		}
+		if (request.Callback)
+		{
+			std::string response(request.Response.begin(),request.Response.end());
+			request.Callback(bSuccess,response);
+		}
+	}
+}
+
+void CAsyncHTTPClient::Do_Work()
+{
+	boost::posix_time::ptime stoptime(boost::posix_time::not_a_date_time);
+	while (true)
+	{
+		boost::posix_time::ptime now=boost::posix_time::microsec_clock::universal_time();
+		{
+			boost::unique_lock<boost::mutex> l(m_mutex);
+			if (m_stoprequested)
+			{
+				//give pending requests (notifications) a moment to finish
+				if (stoptime.is_not_a_date_time())
+					stoptime=now;
+				if ((m_queue.empty()&&m_active.empty())||(now-stoptime>boost::posix_time::seconds(HTTP_STOP_TIMEOUT)))
+					break;
+			}
+			else if (m_queue.empty()&&m_active.empty())
+			{
+				m_cond.timed_wait(l, boost::posix_time::milliseconds(1000));
+				continue;
+			}
+		}
+
+		StartRequests();
+		if (m_active.empty())
+		{
+			//only rate limited or delayed retries
+			sleep_milliseconds(100);
+			continue;
+		}
+
+		int running=0;
+		curl_multi_perform((CURLM*)m_multi, &running);
+		HandleFinished();
+		if (m_active.empty())
+			continue;
+
+		//Wait for socket activity, at most 100ms so new requests are picked up
+		fd_set fdread;
+		fd_set fdwrite;
+		fd_set fdexcep;
+		FD_ZERO(&fdread);
+		FD_ZERO(&fdwrite);
+		FD_ZERO(&fdexcep);
+		int maxfd=-1;
+		long curl_timeo=-1;
+		curl_multi_timeout((CURLM*)m_multi, &curl_timeo);
+		if ((curl_timeo<0)||(curl_timeo>100))
+			curl_timeo=100;
+		curl_multi_fdset((CURLM*)m_multi, &fdread, &fdwrite, &fdexcep, &maxfd);
+		if (maxfd==-1)
+		{
+			sleep_milliseconds(curl_timeo);
+		}
+		else
+		{
+			struct timeval timeout;
+			timeout.tv_sec=0;
+			timeout.tv_usec=curl_timeo*1000;
+			select(maxfd+1, &fdread, &fdwrite, &fdexcep, &timeout);
+		}
+	}
+
+	//Abort what is left
+	std::map<void*,_tHTTPRequest>::iterator itt;
+	for (itt=m_active.begin(); itt!=m_active.end(); ++itt)
+	{
+		curl_multi_remove_handle((CURLM*)m_multi, (CURL*)itt->first);
+		curl_easy_cleanup((CURL*)itt->first);
+		if (itt->second.pHeaders!=NULL)
+			curl_slist_free_all((struct curl_slist*)itt->second.pHeaders);
+	}
+	if (m_active.size()+m_queue.size()>0)
+		_log.Log(LOG_ERROR,"HTTP: %d pending request(s) dropped", (int)(m_active.size()+m_queue.size()));
+	m_active.clear();
+	m_queue.clear();
+	std::vector<void*>::iterator itt2;
+	for (itt2=m_idle_handles.begin(); itt2!=m_idle_handles.end(); ++itt2)
+		curl_easy_cleanup((CURL*)*itt2);
+	m_idle_handles.clear();
+	curl_multi_cleanup((CURLM*)m_multi);
+	m_multi=NULL;
+}
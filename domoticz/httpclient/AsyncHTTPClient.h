@@ -0,0 +1,75 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <boost/function.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+//Non-blocking HTTP client, requests are queued and handled by one worker thread (curl_multi).
+//Connections are kept alive and reused per host, each host is rate limited,
+//requests that could not reach the server are retried with an exponential backoff.
+class CAsyncHTTPClient
+{
+public:
+	//Called from the worker thread when a request is finished (after all retries)
+	typedef boost::function<void(const bool bSuccess, const std::string &response)> ResultCallback;
+
+	CAsyncHTTPClient(void);
+	~CAsyncHTTPClient(void);
+
+	bool StartThread();
+	void StopThread();
+
+	//Returns false when the request queue is full
+	bool GET(const std::string &url, const std::vector<std::string> &ExtraHeaders, const ResultCallback &callback=ResultCallback(), const int MaxRetries=2);
+	bool POST(const std::string &url, const std::string &postdata, const std::vector<std::string> &ExtraHeaders, const ResultCallback &callback=ResultCallback(), const int MaxRetries=2);
+	bool PUT(const std::string &url, const std::string &postdata, const std::vector<std::string> &ExtraHeaders, const ResultCallback &callback=ResultCallback(), const int MaxRetries=2);
+private:
+	enum _eHTTPMethod
+	{
+		HTTP_METHOD_GET=0,
+		HTTP_METHOD_POST,
+		HTTP_METHOD_PUT,
+	};
+	struct _tHTTPRequest
+	{
+		_eHTTPMethod Method;
+		std::string URL;
+		std::string PostData;
+		std::vector<std::string> ExtraHeaders;
+		ResultCallback Callback;
+		std::string Host;
+		int MaxRetries;
+		int Attempt;
+		boost::posix_time::ptime NextAttempt;
+		//while active
+		std::vector<unsigned char> Response;
+		void *pHeaders;
+	};
+	struct _tHostRate
+	{
+		double Tokens;
+		boost::posix_time::ptime LastRefill;
+		int Active;
+	};
+
+	bool AddRequest(const _eHTTPMethod Method, const std::string &url, const std::string &postdata, const std::vector<std::string> &ExtraHeaders, const ResultCallback &callback, const int MaxRetries);
+	static std::string GetHost(const std::string &url);
+	bool AllowRequest(const std::string &Host, const boost::posix_time::ptime &now);
+	void StartRequests();
+	void StartRequest(_tHTTPRequest &request);
+	void HandleFinished();
+
+	void Do_Work();
+
+	boost::mutex m_mutex;
+	boost::condition_variable m_cond;
+	std::deque<_tHTTPRequest> m_queue;
+	std::map<void*,_tHTTPRequest> m_active;
+	std::vector<void*> m_idle_handles;
+	std::map<std::string,_tHostRate> m_hosts;
+	void *m_multi;
+	volatile bool m_stoprequested;
+	boost::shared_ptr<boost::thread> m_thread;
+};
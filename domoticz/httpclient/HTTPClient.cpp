@@ -163,6 +163,43 @@ bool HTTPClient::GETBinaryToFile(const std::string url, const std::string output
 	}
 }
 
+void* HTTPClient::CreateSession()
+{
+	if (!CheckIfGlobalInitDone())
+		return NULL;
+	CURL *curl=curl_easy_init();
+	if (!curl)
+		return NULL;
+	SetGlobalOptions(curl);
+	return curl;
+}
+
+void HTTPClient::DestroySession(void *session)
+{
+	if (session!=NULL)
+		curl_easy_cleanup((CURL *)session);
+}
+
+bool HTTPClient::GETSession(void *session, const std::string url, std::vector<unsigned char> &response)
+{
+	try
+	{
+		CURL *curl=(CURL *)session;
+		if (!curl)
+			return false;
+
+		curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L);
+		curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)&response);
+		curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+		CURLcode res = curl_easy_perform(curl);
+		return (res==CURLE_OK);
+	}
+	catch (...)
+	{
+		return false;
+	}
+}
+
 bool HTTPClient::POSTBinary(const std::string url, const std::string postdata, const std::vector<std::string> ExtraHeaders, std::vector<unsigned char> &response)
 {
 	try
@@ -12,6 +12,12 @@ public:
 
 	static bool GETBinaryToFile(const std::string url, const std::string outputfile);
 
+	//Persistent connection, requests done with the same session reuse the connection (keep-alive)
+	//A session may only be used by one thread at a time
+	static void* CreateSession();
+	static void DestroySession(void *session);
+	static bool GETSession(void *session, const std::string url, std::vector<unsigned char> &response);
+
 	//POST functions, postdata looks like: "name=john&age=123&country=this"
 	static bool POST(const std::string url, const std::string postdata, const std::vector<std::string> ExtraHeaders, std::string &response);
 	static bool POSTBinary(const std::string url, const std::string postdata, const std::vector<std::string> ExtraHeaders, std::vector<unsigned char> &response);
@@ -28,6 +34,7 @@ public:
 	static void SetTimeout(const long timeout);
 	static void SetUserAgent(const std::string useragent);
 private:
+	friend class CAsyncHTTPClient;
 	static void SetGlobalOptions(void *curlobj);
 	static bool CheckIfGlobalInitDone();
 	//our static variables
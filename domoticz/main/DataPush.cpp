@@ -6,6 +6,7 @@
 #include "../hardware/hardwaretypes.h"
 #include "RFXtrx.h"
 #include "SQLHelper.h"
+#include "mainworker.h"
 
 typedef struct _STR_TABLE_ID1_ID2 {
 	unsigned long    id1;
@@ -23,8 +24,15 @@ const char *findVarTableID1ID2 (_STR_TABLE_ID1_ID2 *t, unsigned long id1, unsign
 	return "Not supported";
 }
 
+static void FibaroPushResult(const bool bSuccess, const std::string &response)
+{
+	if (!bSuccess)
+		_log.Log(LOG_ERROR,"Error sending data to Fibaro!");
+}
+
 void CDataPush::DoWork(const unsigned long long DeviceRowIdxIn)
 {
+	boost::lock_guard<boost::mutex> l(m_mutex);
 	DeviceRowIdx = DeviceRowIdxIn;
 	int fActive;
 	m_sql.GetPreferencesVar("FibaroActive", fActive);
@@ -111,7 +119,6 @@ void CDataPush::DoFibaroPush()
 					sendValue = lstatus;
 				}
 				if (sendValue !="") {
-					std::string sResult;
 					std::stringstream sPostData;
 					std::stringstream Url;
 					std::vector<std::string> ExtraHeaders;
@@ -124,7 +131,7 @@ void CDataPush::DoFibaroPush()
 						if (fibaroDebugActive) {
 							_log.Log(LOG_NORM,"FibaroLink: sending global variable %s with value: %s",targetVariable.c_str(),sendValue.c_str());
 						}
-						if (!HTTPClient::PUT(Url.str(),sPostData.str(),ExtraHeaders,sResult))
+						if (!m_mainworker.m_httpclient.PUT(Url.str(),sPostData.str(),ExtraHeaders,FibaroPushResult))
 						{
 							_log.Log(LOG_ERROR,"Error sending data to Fibaro!");
 						
@@ -135,7 +142,7 @@ void CDataPush::DoFibaroPush()
 						if (fibaroDebugActive) {
 							_log.Log(LOG_NORM,"FibaroLink: sending value %s to property %s of virtual device id %d",sendValue.c_str(),targetProperty.c_str(),targetDeviceID);
 						}
-						if (!HTTPClient::GET(Url.str(),sResult))
+						if (!m_mainworker.m_httpclient.GET(Url.str(),ExtraHeaders,FibaroPushResult))
 						{
 							_log.Log(LOG_ERROR,"Error sending data to Fibaro!");
 						}
@@ -146,7 +153,7 @@ void CDataPush::DoFibaroPush()
 							if (fibaroDebugActive) {
 								_log.Log(LOG_NORM,"FibaroLink: activating scene %d",targetDeviceID);
 							}
-							if (!HTTPClient::GET(Url.str(),sResult))
+							if (!m_mainworker.m_httpclient.GET(Url.str(),ExtraHeaders,FibaroPushResult))
 							{
 								_log.Log(LOG_ERROR,"Error sending data to Fibaro!");
 							}
@@ -158,7 +165,7 @@ void CDataPush::DoFibaroPush()
 							if (fibaroDebugActive) {
 								_log.Log(LOG_NORM,"FibaroLink: reboot");
 							}
-							if (!HTTPClient::POST(Url.str(),sPostData.str(),ExtraHeaders,sResult))
+							if (!m_mainworker.m_httpclient.POST(Url.str(),sPostData.str(),ExtraHeaders,FibaroPushResult))
 							{
 								_log.Log(LOG_ERROR,"Error sending data to Fibaro!");
 							}
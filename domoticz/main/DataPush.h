@@ -8,6 +8,7 @@ public:
 	std::string DropdownOptionsValue(const unsigned long long DeviceRowIdxIn,int pos);
 
 private:
+	boost::mutex m_mutex;
 	unsigned long long DeviceRowIdx;
 	void DoFibaroPush();
 	const char *RFX_Type_SubType_DropdownOptions(const unsigned char dType, const unsigned char sType);
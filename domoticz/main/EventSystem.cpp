@@ -18,6 +18,8 @@
 #else
 #include <dirent.h>
 #endif
+#include <sys/stat.h>
+#include <fstream>
 
 extern "C" {
 #include "../lua/src/lua.h"    
@@ -27,16 +29,152 @@ extern "C" {
 
 extern std::string szStartupFolder;
 
+//above this size pending events of the same device/variable are merged
+#define EVENT_QUEUE_COALESCE_SIZE 100
+#define MAX_EVENT_QUEUE_SIZE 1000
+//lua worker threads, and lua states (a state is only in use while its script runs)
+#define LUA_MAX_STATES 4
+//a lua run that takes longer is reported, and keeps its worker until it returns
+#define LUA_RUN_TIMEOUT_SEC 10
+
+//Adds the rule to the index for every "device[ID]" (or "variable[ID]") in its conditions
+static void IndexBlocklyRule(const std::string &Conditions, const std::string &szPrefix, const size_t ruleIdx, std::map<unsigned long long, std::vector<size_t> > &index)
+{
+	size_t pos = 0;
+	while ((pos = Conditions.find(szPrefix, pos)) != std::string::npos)
+	{
+		pos += szPrefix.size();
+		size_t epos = Conditions.find(']', pos);
+		if (epos == std::string::npos)
+			break;
+		std::string szID = Conditions.substr(pos, epos - pos);
+		if (szID.empty() || (szID.find_first_not_of("0123456789") != std::string::npos))
+			continue;
+		unsigned long long ID;
+		std::stringstream s_str(szID);
+		s_str >> ID;
+		std::vector<size_t> &rules = index[ID];
+		if (rules.empty() || (rules.back() != ruleIdx))
+			rules.push_back(ruleIdx);
+	}
+}
+
+static bool IsLuaNameChar(const char c)
+{
+	return ((isalnum((unsigned char)c)) || (c == '_'));
+}
+
+//Collects the names a script looks up in the given table (like devicechanged['Lamp']),
+//returns false when the script uses the table in any other way
+static bool GetLuaScriptTriggers(const std::string &source, const std::string &tablename, std::set<std::string> &triggers)
+{
+	//devicechanged also holds the measurements of the device as 'name_Temperature' and so on
+	static const char *szSuffixes[] = { "_Temperature", "_Dewpoint", "_Humidity", "_Barometer", "_Utility", "_Rain", "_RainLastHour", "_UV", NULL };
+
+	size_t pos = 0;
+	while ((pos = source.find(tablename, pos)) != std::string::npos)
+	{
+		size_t p = pos + tablename.size();
+		if (((pos > 0) && (IsLuaNameChar(source[pos - 1]))) || ((p < source.size()) && (IsLuaNameChar(source[p]))))
+		{
+			//part of another name
+			pos = p;
+			continue;
+		}
+		while ((p < source.size()) && (isspace((unsigned char)source[p])))
+			p++;
+		if (p >= source.size())
+			return false;
+
+		std::string name;
+		if (source[p] == '.')
+		{
+			size_t npos = ++p;
+			while ((p < source.size()) && (IsLuaNameChar(source[p])))
+				p++;
+			name = source.substr(npos, p - npos);
+		}
+		else if (source[p] == '[')
+		{
+			p++;
+			while ((p < source.size()) && (isspace((unsigned char)source[p])))
+				p++;
+			if ((p >= source.size()) || ((source[p] != '\'') && (source[p] != '"')))
+				return false;
+			size_t epos = source.find(source[p], p + 1);
+			if (epos == std::string::npos)
+				return false;
+			name = source.substr(p + 1, epos - p - 1);
+			if (name.find('\\') != std::string::npos)
+				return false;
+			p = epos + 1;
+		}
+		if (name.empty())
+			return false;
+
+		triggers.insert(name);
+		for (int ii = 0; szSuffixes[ii] != NULL; ii++)
+		{
+			size_t slen = strlen(szSuffixes[ii]);
+			if ((name.size() > slen) && (name.compare(name.size() - slen, slen, szSuffixes[ii]) == 0))
+				triggers.insert(name.substr(0, name.size() - slen));
+		}
+		pos = p;
+	}
+	//a script that never looks at the table runs for every change
+	return !triggers.empty();
+}
+
 CEventSystem::CEventSystem(void)
 {
 	m_stoprequested = false;
 	m_bEnabled = true;
+	m_bLuaDirError = false;
+	m_pBlocklyState = NULL;
+	m_luaworkers_generation = 0;
+	m_devicestates_version = 1;
+	m_devicestates_resetversion = 1;
+	m_uservariables_version = 1;
+	m_uservariables_resetversion = 1;
+	m_measurements_version = 0;
+	m_eventqueue_stoprequested = false;
+	m_bEventQueueOverloaded = false;
+	m_eventqueue_stats.QueueSize = 0;
+	m_eventqueue_stats.MaxQueueSize = 0;
+	m_eventqueue_stats.TotalQueued = 0;
+	m_eventqueue_stats.TotalCoalesced = 0;
+	m_eventqueue_stats.TotalDropped = 0;
+	m_eventqueue_stats.OldestAge = 0;
+	m_eventqueue_stats.AvgQueueAge = 0;
+	m_eventqueue_stats.MaxQueueAge = 0;
+	m_eventqueue_processed = 0;
+	m_eventqueue_age_total = 0;
 }
 
 
 CEventSystem::~CEventSystem(void)
 {
 	StopEventSystem();
+	{
+		//states still in use belong to a script that did not finish
+		boost::lock_guard<boost::mutex> l(m_luastates_mutex);
+		std::vector<_tLuaStateItem*>::iterator itt;
+		for (itt = m_luastates.begin(); itt != m_luastates.end(); ++itt)
+		{
+			if (!(*itt)->bInUse)
+			{
+				lua_close((*itt)->lua_state);
+				delete (*itt);
+			}
+		}
+		m_luastates.clear();
+	}
+	if (m_pBlocklyState != NULL)
+	{
+		lua_close(m_pBlocklyState->lua_state);
+		delete m_pBlocklyState;
+		m_pBlocklyState = NULL;
+	}
 	/*
 	if (m_pLUA!=NULL)
 	{
@@ -56,9 +194,16 @@ void CEventSystem::StartEventSystem()
 
 	LoadEvents();
 	GetCurrentStates();
+	ScanLuaScripts();
 
 	m_secondcounter = (58 * 2);
 
+	StartLuaWorkers();
+	{
+		boost::lock_guard<boost::mutex> l(m_eventqueue_mutex);
+		m_eventqueue_stoprequested = false;
+		m_eventqueue_thread = boost::shared_ptr<boost::thread>(new boost::thread(boost::bind(&CEventSystem::Do_EventQueue_Work, this)));
+	}
 	m_thread = boost::shared_ptr<boost::thread>(new boost::thread(boost::bind(&CEventSystem::Do_Work, this)));
 }
 
@@ -69,6 +214,72 @@ void CEventSystem::StopEventSystem()
 		m_stoprequested = true;
 		m_thread->join();
 	}
+	if (m_eventqueue_thread)
+	{
+		{
+			boost::lock_guard<boost::mutex> l(m_eventqueue_mutex);
+			m_eventqueue_stoprequested = true;
+			m_eventqueue.clear();
+			m_eventqueue_pending.clear();
+		}
+		m_eventqueue_cond.notify_all();
+		m_eventqueue_thread->join();
+		boost::lock_guard<boost::mutex> l(m_eventqueue_mutex);
+		m_eventqueue_thread.reset();
+	}
+	StopLuaWorkers();
+}
+
+void CEventSystem::StartLuaWorkers()
+{
+	boost::lock_guard<boost::mutex> l(m_luajobs_mutex);
+	m_luaworkers_generation++;
+	for (int ii = 0; ii < LUA_MAX_STATES; ii++)
+		m_luaworkers.push_back(boost::shared_ptr<boost::thread>(new boost::thread(boost::bind(&CEventSystem::Do_LuaWorker, this, m_luaworkers_generation))));
+}
+
+void CEventSystem::StopLuaWorkers()
+{
+	std::vector<boost::shared_ptr<boost::thread> > workers;
+	{
+		boost::lock_guard<boost::mutex> l(m_luajobs_mutex);
+		if (m_luaworkers.empty())
+			return;
+		m_luaworkers_generation++;
+		workers.swap(m_luaworkers);
+	}
+	m_luajobs_cond.notify_all();
+	std::vector<boost::shared_ptr<boost::thread> >::iterator itt;
+	for (itt = workers.begin(); itt != workers.end(); ++itt)
+	{
+		//a worker that is stuck in a script is detached, it exits when the script returns
+		if (!(*itt)->timed_join(boost::posix_time::seconds(2)))
+			_log.Log(LOG_ERROR, "EventSystem: a lua script is still running, its worker is left behind");
+	}
+}
+
+void CEventSystem::Do_LuaWorker(const int generation)
+{
+	for (;;)
+	{
+		boost::shared_ptr<_tLuaJob> job;
+		{
+			boost::unique_lock<boost::mutex> l(m_luajobs_mutex);
+			while ((m_luajobs.empty()) && (generation == m_luaworkers_generation))
+				m_luajobs_cond.wait(l);
+			//queued jobs hold a lua state, they are run before a stopping worker exits
+			if (m_luajobs.empty())
+				return;
+			job = m_luajobs.front();
+			m_luajobs.pop_front();
+		}
+		luaThread(job->item, job->filename);
+		{
+			boost::lock_guard<boost::mutex> l(m_luajobs_mutex);
+			job->bDone = true;
+		}
+		m_luajobs_done_cond.notify_all();
+	}
 }
 
 void CEventSystem::LoadEvents()
@@ -76,6 +287,10 @@ void CEventSystem::LoadEvents()
 	boost::lock_guard<boost::mutex> l(eventMutex);
 
 	m_events.clear();
+	m_blocklydevicerules.clear();
+	m_blocklyvariablerules.clear();
+	m_blocklysecurityrules.clear();
+	m_blocklytimerules.clear();
 
 	std::stringstream szQuery;
 	std::vector<std::vector<std::string> > result;
@@ -99,11 +314,29 @@ void CEventSystem::LoadEvents()
 			eitem.SequenceNo = atoi(sd[5].c_str());
 			m_events.push_back(eitem);
 
+			if (eitem.EventStatus != 1)
+				continue;
+			size_t ruleIdx = m_events.size() - 1;
+			IndexBlocklyRule(eitem.Conditions, "device[", ruleIdx, m_blocklydevicerules);
+			IndexBlocklyRule(eitem.Conditions, "variable[", ruleIdx, m_blocklyvariablerules);
+			if (eitem.Conditions.find("securitystatus") != std::string::npos)
+				m_blocklysecurityrules.push_back(ruleIdx);
+			// time rules will only run when time or date based critera are found
+			if ((eitem.Conditions.find("timeofday") != std::string::npos) || (eitem.Conditions.find("weekday") != std::string::npos))
+				m_blocklytimerules.push_back(ruleIdx);
 		}
 #ifdef _DEBUG
 		_log.Log(LOG_STATUS, "Events (re)loaded");
 #endif
 	}
+
+	//drop the compiled conditions of the previous rules
+	boost::lock_guard<boost::mutex> l2(luaMutex);
+	if (m_pBlocklyState != NULL)
+	{
+		lua_newtable(m_pBlocklyState->lua_state);
+		lua_setfield(m_pBlocklyState->lua_state, LUA_REGISTRYINDEX, "blocklyconditions");
+	}
 }
 
 void CEventSystem::Do_Work()
@@ -124,6 +357,11 @@ void CEventSystem::Do_Work()
 			m_secondcounter = 0;
 			ProcessMinute();
 		}
+		if (m_secondcounter % 4 == 0)
+		{
+			//pick up new or changed lua scripts
+			ScanLuaScripts();
+		}
 		if (ltime.tm_sec % 12 == 0) {
 			m_mainworker.HeartbeatUpdate("EventSystem");
 		}
@@ -147,6 +385,7 @@ return std::string(buf.data(), buf.size());
 void CEventSystem::GetCurrentStates()
 {
 	m_devicestates.clear();
+	m_devicestates_resetversion = ++m_devicestates_version;
 
 	std::stringstream szQuery;
 	std::vector<std::vector<std::string> > result;
@@ -173,6 +412,7 @@ void CEventSystem::GetCurrentStates()
 			sitem.nValueWording = nValueToWording(sitem.devType, sitem.subType, switchtype, (unsigned char)sitem.nValue, sitem.sValue);
 			sitem.lastUpdate = sd[7];
 			sitem.lastLevel = atoi(sd[8].c_str());
+			sitem.version = m_devicestates_version;
 			m_devicestates[sitem.ID] = sitem;
 		}
 	}
@@ -180,7 +420,8 @@ void CEventSystem::GetCurrentStates()
 
 void CEventSystem::GetCurrentUserVariables()
 {
-	m_uservariables.clear();
+	std::map<unsigned long long, _tUserVariable> oldvariables;
+	oldvariables.swap(m_uservariables);
 
 	std::stringstream szQuery;
 	std::vector<std::vector<std::string> > result;
@@ -199,14 +440,45 @@ void CEventSystem::GetCurrentUserVariables()
 			uvitem.variableValue = sd[2];
 			uvitem.variableType = atoi(sd[3].c_str());
 			uvitem.lastUpdate = sd[4];
+
+			//only changed variables get a new version, so the lua tables can be updated in place
+			std::map<unsigned long long, _tUserVariable>::iterator itt = oldvariables.find(uvitem.ID);
+			if (itt == oldvariables.end())
+			{
+				uvitem.version = ++m_uservariables_version;
+			}
+			else
+			{
+				if (itt->second.variableName != uvitem.variableName)
+					m_uservariables_resetversion = ++m_uservariables_version;
+				if (
+					(itt->second.variableName == uvitem.variableName) &&
+					(itt->second.variableValue == uvitem.variableValue) &&
+					(itt->second.variableType == uvitem.variableType) &&
+					(itt->second.lastUpdate == uvitem.lastUpdate)
+					)
+					uvitem.version = itt->second.version;
+				else
+					uvitem.version = ++m_uservariables_version;
+				oldvariables.erase(itt);
+			}
 			m_uservariables[uvitem.ID] = uvitem;
 		}
 	}
+	if (!oldvariables.empty())
+	{
+		//variables were deleted
+		m_uservariables_resetversion = ++m_uservariables_version;
+	}
 }
 
 
 void CEventSystem::GetCurrentMeasurementStates()
 {
+	if (m_measurements_version == m_devicestates_version)
+		return; //nothing changed since the last call
+	m_measurements_version = m_devicestates_version;
+
 	m_tempValuesByName.clear();
 	m_dewValuesByName.clear();
 	m_humValuesByName.clear();
@@ -672,6 +944,7 @@ void CEventSystem::RemoveSingleState(int ulDevID)
 
 	//_log.Log(LOG_STATUS,"deleted device %d",ulDevID);
 	m_devicestates.erase(ulDevID);
+	m_devicestates_resetversion = ++m_devicestates_version;
 
 }
 
@@ -687,6 +960,8 @@ void CEventSystem::WWWUpdateSingleState(const unsigned long long ulDevID, const
 		_tDeviceStatus replaceitem = itt->second;
 		replaceitem.deviceName = devname;
 		itt->second = replaceitem;
+		m_devicestates_resetversion = ++m_devicestates_version;
+		itt->second.version = m_devicestates_version;
 	}
 }
 
@@ -695,9 +970,11 @@ void CEventSystem::WWWUpdateSecurityState(int securityStatus)
 	if (!m_bEnabled)
 		return;
 
-	m_sql.GetPreferencesVar("SecStatus", m_SecStatus);
-	GetCurrentUserVariables();
-	EvaluateEvent("security");
+	_tEventQueueItem item;
+	item.reason = "security";
+	item.DeviceID = 0;
+	item.varId = 0;
+	QueueEvent(item);
 }
 
 std::string CEventSystem::UpdateSingleState(const unsigned long long ulDevID, const std::string &devname, const int nValue, const char* sValue, const unsigned char devType, const unsigned char subType, const _eSwitchType switchType, const std::string &lastUpdate, const unsigned char lastLevel)
@@ -709,7 +986,10 @@ std::string CEventSystem::UpdateSingleState(const unsigned long long ulDevID, co
 	if (itt != m_devicestates.end()) {
 		//Update
 		_tDeviceStatus replaceitem = itt->second;
+		if (replaceitem.deviceName != devname)
+			m_devicestates_resetversion = m_devicestates_version + 1;
 		replaceitem.deviceName = devname;
+		replaceitem.version = ++m_devicestates_version;
 		replaceitem.nValue = nValue;
 		replaceitem.sValue = sValue;
 		replaceitem.nValueWording = nValueWording;
@@ -727,50 +1007,160 @@ std::string CEventSystem::UpdateSingleState(const unsigned long long ulDevID, co
 		newitem.nValueWording = nValueWording;
 		newitem.lastUpdate = lastUpdate;
 		newitem.lastLevel = lastLevel;
+		newitem.version = ++m_devicestates_version;
 		m_devicestates[newitem.ID] = newitem;
 	}
 	return nValueWording;
 }
 
 
-void CEventSystem::ProcessDevice(const int HardwareID, const unsigned long long ulDevID, const unsigned char unit, const unsigned char devType, const unsigned char subType, const unsigned char signallevel, const unsigned char batterylevel, const int nValue, const char* sValue, const std::string &devname, const int varId)
+void CEventSystem::ProcessDevice(const int HardwareID, const unsigned long long ulDevID, const unsigned char unit, const unsigned char devType, const unsigned char subType, const unsigned char signallevel, const unsigned char batterylevel, const int nValue, const char* sValue, const std::string &devname, const _eSwitchType switchType, const std::string &lastUpdate, const unsigned char lastLevel, const int varId)
 {
 	if (!m_bEnabled)
 		return;
-	boost::lock_guard<boost::mutex> l(eventMutex);
 
-	// query to get switchtype & LastUpdate, can't seem to get it from SQLHelper?
-	std::vector<std::vector<std::string> > result;
-	std::stringstream szQuery;
-	szQuery << "SELECT ID, SwitchType, LastUpdate, LastLevel FROM DeviceStatus WHERE (Name == '" << devname << "')";
-	result = m_sql.query(szQuery.str());
-	if (result.size()>0) {
-		std::vector<std::string> sd = result[0];
-		_eSwitchType switchType = (_eSwitchType)atoi(sd[1].c_str());
-
-		std::string nValueWording = UpdateSingleState(ulDevID, devname, nValue, sValue, devType, subType, switchType, sd[2], atoi(sd[3].c_str()));
-		GetCurrentUserVariables();
-		EvaluateEvent("device", ulDevID, devname, nValue, sValue, nValueWording, 0);
-	}
-	else {
-		_log.Log(LOG_ERROR, "Could not determine switch type for event device %s", devname.c_str());
-	}
+	_tEventQueueItem item;
+	item.reason = "device";
+	item.DeviceID = ulDevID;
+	item.devname = devname;
+	item.nValue = nValue;
+	item.sValue = sValue;
+	item.devType = devType;
+	item.subType = subType;
+	item.switchType = switchType;
+	item.lastUpdate = lastUpdate;
+	item.lastLevel = lastLevel;
+	item.varId = 0;
+	QueueEvent(item);
 }
 
 void CEventSystem::ProcessMinute()
 {
-	boost::lock_guard<boost::mutex> l(eventMutex);
-	GetCurrentUserVariables();
-	EvaluateEvent("time");
+	_tEventQueueItem item;
+	item.reason = "time";
+	item.DeviceID = 0;
+	item.varId = 0;
+	QueueEvent(item);
 }
 
 void CEventSystem::ProcessUserVariable(const unsigned long long varId)
 {
 	if (!m_bEnabled)
 		return;
+
+	_tEventQueueItem item;
+	item.reason = "uservariable";
+	item.DeviceID = 0;
+	item.varId = varId;
+	QueueEvent(item);
+}
+
+void CEventSystem::QueueEvent(_tEventQueueItem &item)
+{
+	item.QueueTime = boost::posix_time::microsec_clock::universal_time();
+
+	boost::lock_guard<boost::mutex> l(m_eventqueue_mutex);
+	if (!m_eventqueue_thread)
+		return;
+
+	std::pair<std::string, unsigned long long> key(item.reason, (item.reason == "uservariable") ? item.varId : item.DeviceID);
+	if (m_eventqueue.size() >= EVENT_QUEUE_COALESCE_SIZE)
+	{
+		//overloaded, update the pending event of this device/variable instead of adding another one
+		std::map<std::pair<std::string, unsigned long long>, std::list<_tEventQueueItem>::iterator>::iterator itt = m_eventqueue_pending.find(key);
+		if (itt != m_eventqueue_pending.end())
+		{
+			boost::posix_time::ptime QueueTime = itt->second->QueueTime;
+			*itt->second = item;
+			itt->second->QueueTime = QueueTime;
+			m_eventqueue_stats.TotalCoalesced++;
+			return;
+		}
+		if (m_eventqueue.size() >= MAX_EVENT_QUEUE_SIZE)
+		{
+			if (!m_bEventQueueOverloaded)
+				_log.Log(LOG_ERROR, "EventSystem: event queue full (%d events), dropping events!", (int)m_eventqueue.size());
+			m_bEventQueueOverloaded = true;
+			m_eventqueue_stats.TotalDropped++;
+			return;
+		}
+	}
+	m_eventqueue.push_back(item);
+	m_eventqueue_pending[key] = --m_eventqueue.end();
+	m_eventqueue_stats.TotalQueued++;
+	if ((int)m_eventqueue.size() > m_eventqueue_stats.MaxQueueSize)
+		m_eventqueue_stats.MaxQueueSize = (int)m_eventqueue.size();
+	m_eventqueue_cond.notify_one();
+}
+
+void CEventSystem::Do_EventQueue_Work()
+{
+	while (true)
+	{
+		_tEventQueueItem item;
+		{
+			boost::unique_lock<boost::mutex> l(m_eventqueue_mutex);
+			while ((!m_eventqueue_stoprequested) && (m_eventqueue.empty()))
+				m_eventqueue_cond.wait(l);
+			if (m_eventqueue_stoprequested)
+				break;
+			item = m_eventqueue.front();
+			std::pair<std::string, unsigned long long> key(item.reason, (item.reason == "uservariable") ? item.varId : item.DeviceID);
+			std::map<std::pair<std::string, unsigned long long>, std::list<_tEventQueueItem>::iterator>::iterator itt = m_eventqueue_pending.find(key);
+			if ((itt != m_eventqueue_pending.end()) && (itt->second == m_eventqueue.begin()))
+				m_eventqueue_pending.erase(itt);
+			m_eventqueue.pop_front();
+			if (m_eventqueue.size() < EVENT_QUEUE_COALESCE_SIZE)
+				m_bEventQueueOverloaded = false;
+
+			long age = (long)(boost::posix_time::microsec_clock::universal_time() - item.QueueTime).total_milliseconds();
+			m_eventqueue_processed++;
+			m_eventqueue_age_total += age;
+			if (age > m_eventqueue_stats.MaxQueueAge)
+				m_eventqueue_stats.MaxQueueAge = age;
+		}
+		ProcessEventQueueItem(item);
+	}
+}
+
+void CEventSystem::ProcessEventQueueItem(const _tEventQueueItem &item)
+{
 	boost::lock_guard<boost::mutex> l(eventMutex);
-	GetCurrentUserVariables();
-	EvaluateEvent("uservariable", varId);
+
+	if (item.reason == "device")
+	{
+		//the state is updated here, so scripts see the devices as they were when this event was queued
+		std::string nValueWording = UpdateSingleState(item.DeviceID, item.devname, item.nValue, item.sValue.c_str(), item.devType, item.subType, item.switchType, item.lastUpdate, item.lastLevel);
+		GetCurrentUserVariables();
+		EvaluateEvent("device", item.DeviceID, item.devname, item.nValue, item.sValue.c_str(), nValueWording, 0);
+	}
+	else if (item.reason == "security")
+	{
+		m_sql.GetPreferencesVar("SecStatus", m_SecStatus);
+		GetCurrentUserVariables();
+		EvaluateEvent("security");
+	}
+	else if (item.reason == "uservariable")
+	{
+		GetCurrentUserVariables();
+		EvaluateEvent("uservariable", item.varId);
+	}
+	else
+	{
+		GetCurrentUserVariables();
+		EvaluateEvent(item.reason);
+	}
+}
+
+void CEventSystem::GetEventQueueStats(_tEventQueueStats &stats)
+{
+	boost::lock_guard<boost::mutex> l(m_eventqueue_mutex);
+	stats = m_eventqueue_stats;
+	stats.QueueSize = (int)m_eventqueue.size();
+	stats.OldestAge = 0;
+	if (!m_eventqueue.empty())
+		stats.OldestAge = (long)(boost::posix_time::microsec_clock::universal_time() - m_eventqueue.front().QueueTime).total_milliseconds();
+	stats.AvgQueueAge = (m_eventqueue_processed > 0) ? (long)(m_eventqueue_age_total / m_eventqueue_processed) : 0;
 }
 
 void CEventSystem::EvaluateEvent(const std::string &reason)
@@ -787,455 +1177,567 @@ void CEventSystem::EvaluateEvent(const std::string &reason, const unsigned long
 {
 	if (!m_bEnabled)
 		return;
-	std::stringstream lua_DirT;
 
-#ifdef WIN32
-	lua_DirT << szStartupFolder << "scripts\\lua\\";
-#else
-	lua_DirT << szStartupFolder << "scripts/lua/";
-#endif
-
-	std::string lua_Dir = lua_DirT.str();
-
-	DIR *lDir;
-	struct dirent *ent;
+	std::string varname;
+	if ((reason == "uservariable") && (varId > 0))
+	{
+		std::map<unsigned long long, _tUserVariable>::const_iterator itt = m_uservariables.find(varId);
+		if (itt != m_uservariables.end())
+			varname = itt->second.variableName;
+	}
 
-	if ((lDir = opendir(lua_Dir.c_str())) != NULL)
+	//the script list is kept up to date by ScanLuaScripts
+	std::vector<std::string> scripts;
 	{
-		while ((ent = readdir(lDir)) != NULL)
+		boost::lock_guard<boost::mutex> l(luaMutex);
+		std::map<std::string, _tLuaScript>::const_iterator itt;
+		for (itt = m_luascripts.begin(); itt != m_luascripts.end(); ++itt)
 		{
-			std::string filename = ent->d_name;
-			if (ent->d_type == DT_REG)
+			const _tLuaScript &script = itt->second;
+			const std::string &filename = script.name;
+			if ((reason == "device") && (filename.find("_device_") != std::string::npos))
 			{
-				if ((filename.length() < 4) || (filename.compare(filename.length() - 4, 4, ".lua") != 0))
+				if ((!script.bAllTriggers) && (script.triggers.find(devname) == script.triggers.end()))
 				{
-					//_log.Log(LOG_STATUS,"ignore file not .lua: %s",filename.c_str());
+					UpdateEventStatsSkipped(itt->first);
+					continue;
 				}
-				else if (filename.find("_demo.lua") == std::string::npos) //skip demo lua files
+			}
+			else if ((reason == "uservariable") && (filename.find("_variable_") != std::string::npos))
+			{
+				if ((!script.bAllTriggers) && (script.triggers.find(varname) == script.triggers.end()))
 				{
-					if ((reason == "device") && (filename.find("_device_") != std::string::npos))
-					{
-						EvaluateLua(reason, lua_Dir + filename, DeviceID, devname, nValue, sValue, nValueWording, 0);
-					}
-					else if ((reason == "time") && (filename.find("_time_") != std::string::npos))
-					{
-						EvaluateLua(reason, lua_Dir + filename);
-					}
-					else if ((reason == "security") && (filename.find("_security_") != std::string::npos))
-					{
-						EvaluateLua(reason, lua_Dir + filename);
-					}
-					else if ((reason == "uservariable") && (filename.find("_variable_") != std::string::npos))
-					{
-						EvaluateLua(reason, lua_Dir + filename, varId);
-					}
+					UpdateEventStatsSkipped(itt->first);
+					continue;
 				}
 			}
+			else if (
+				!((reason == "time") && (filename.find("_time_") != std::string::npos)) &&
+				!((reason == "security") && (filename.find("_security_") != std::string::npos))
+				)
+				continue;
+			scripts.push_back(itt->first);
 		}
-		closedir(lDir);
 	}
-	else {
-		_log.Log(LOG_ERROR, "Error accessing lua script directory %s", lua_Dir.c_str());
+
+	std::vector<std::string>::const_iterator itt;
+	for (itt = scripts.begin(); itt != scripts.end(); ++itt)
+	{
+		if (reason == "device")
+		{
+			EvaluateLua(reason, *itt, DeviceID, devname, nValue, sValue, nValueWording, 0);
+		}
+		else if (reason == "uservariable")
+		{
+			EvaluateLua(reason, *itt, varId);
+		}
+		else
+		{
+			EvaluateLua(reason, *itt);
+		}
 	}
 
 	EvaluateBlockly(reason, DeviceID, devname, nValue, sValue, nValueWording, varId);
-
-
 }
 
-void CEventSystem::EvaluateBlockly(const std::string &reason, const unsigned long long DeviceID, const std::string &devname, const int nValue, const char* sValue, std::string nValueWording, const unsigned long long varId)
+void CEventSystem::ScanLuaScripts()
 {
+	std::stringstream lua_DirT;
 
-	//#ifdef _DEBUG
-	//    _log.Log(LOG_STATUS,"EventSystem blockly %s trigger",reason.c_str());
-	//#endif
+#ifdef WIN32
+	lua_DirT << szStartupFolder << "scripts\\lua\\";
+#else
+	lua_DirT << szStartupFolder << "scripts/lua/";
+#endif
 
-	lua_State *lua_state;
-	lua_state = luaL_newstate();
+	std::string lua_Dir = lua_DirT.str();
 
-	// load Lua libraries
-	static const luaL_Reg lualibs[] =
-	{
-		{ "base", luaopen_base },
-		{ "io", luaopen_io },
-		{ "table", luaopen_table },
-		{ "string", luaopen_string },
-		{ "math", luaopen_math },
-		{ NULL, NULL }
-	};
+	boost::lock_guard<boost::mutex> l(luaMutex);
 
-	luaL_requiref(lua_state, "os", luaopen_os, 1);
+	DIR *lDir;
+	struct dirent *ent;
 
-	const luaL_Reg *lib = lualibs;
-	for (; lib->func != NULL; lib++)
+	if ((lDir = opendir(lua_Dir.c_str())) == NULL)
 	{
-		lib->func(lua_state);
-		lua_settop(lua_state, 0);
+		if (!m_bLuaDirError)
+			_log.Log(LOG_ERROR, "Error accessing lua script directory %s", lua_Dir.c_str());
+		m_bLuaDirError = true;
+		m_luascripts.clear();
+		return;
 	}
+	m_bLuaDirError = false;
 
-	// reroute print library to domoticz logger
-	luaL_openlibs(lua_state);
-	lua_pushcfunction(lua_state, l_domoticz_print);
-	lua_setglobal(lua_state, "print");
-
-	lua_createtable(lua_state, (int)m_devicestates.size(), 0);
+	std::map<std::string, _tLuaScript> oldscripts;
+	oldscripts.swap(m_luascripts);
 
-	typedef std::map<unsigned long long, _tDeviceStatus>::iterator it_type;
-	for (it_type iterator = m_devicestates.begin(); iterator != m_devicestates.end(); iterator++) {
-		_tDeviceStatus sitem = iterator->second;
-		lua_pushnumber(lua_state, (lua_Number)sitem.ID);
-		lua_pushstring(lua_state, sitem.nValueWording.c_str());
-		lua_rawset(lua_state, -3);
-	}
-	lua_setglobal(lua_state, "device");
+	while ((ent = readdir(lDir)) != NULL)
+	{
+		std::string filename = ent->d_name;
+		if (ent->d_type != DT_REG)
+			continue;
+		if ((filename.length() < 4) || (filename.compare(filename.length() - 4, 4, ".lua") != 0))
+			continue;
+		if (filename.find("_demo.lua") != std::string::npos) //skip demo lua files
+			continue;
 
-	lua_createtable(lua_state, (int)m_uservariables.size(), 0);
+		std::string fullname = lua_Dir + filename;
+		struct stat st;
+		if (stat(fullname.c_str(), &st) != 0)
+			continue;
 
-	typedef std::map<unsigned long long, _tUserVariable>::iterator it_var;
-	for (it_var iterator = m_uservariables.begin(); iterator != m_uservariables.end(); iterator++) {
-		_tUserVariable uvitem = iterator->second;
-		if (uvitem.variableType == 0)  {
-			lua_pushnumber(lua_state, (lua_Number)uvitem.ID);
-			lua_pushnumber(lua_state, atoi(uvitem.variableValue.c_str()));
-			lua_rawset(lua_state, -3);
-		}
-		else if (uvitem.variableType == 1)  {
-			lua_pushnumber(lua_state, (lua_Number)uvitem.ID);
-			lua_pushnumber(lua_state, atof(uvitem.variableValue.c_str()));
-			lua_rawset(lua_state, -3);
+		std::map<std::string, _tLuaScript>::iterator itt = oldscripts.find(fullname);
+		if ((itt != oldscripts.end()) && (itt->second.mtime == st.st_mtime) && (itt->second.size == st.st_size))
+		{
+			m_luascripts[fullname] = itt->second;
+			continue;
 		}
-		else {
-			lua_pushnumber(lua_state, (lua_Number)uvitem.ID);
-			lua_pushstring(lua_state, uvitem.variableValue.c_str());
-			lua_rawset(lua_state, -3);
+
+		//new or modified, compile it once, states load the bytecode
+		_tLuaScript script;
+		script.name = filename;
+		script.mtime = st.st_mtime;
+		script.size = st.st_size;
+		script.bAllTriggers = true;
+		if (CompileLuaScript(fullname, script.bytecode))
+		{
+			std::ifstream is(fullname.c_str(), std::ios::in | std::ios::binary);
+			std::string source((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+			if (filename.find("_device_") != std::string::npos)
+				script.bAllTriggers = !GetLuaScriptTriggers(source, "devicechanged", script.triggers);
+			else if (filename.find("_variable_") != std::string::npos)
+				script.bAllTriggers = !GetLuaScriptTriggers(source, "uservariablechanged", script.triggers);
 		}
+		else
+			script.bytecode.clear();
+		m_luascripts[fullname] = script;
 	}
-	lua_setglobal(lua_state, "variable");
+	closedir(lDir);
+}
 
-	GetCurrentMeasurementStates();
+static int LuaBytecodeWriter(lua_State *L, const void *p, size_t sz, void *ud)
+{
+	((std::string*)ud)->append((const char*)p, sz);
+	return 0;
+}
 
-	if (m_tempValuesByID.size()>0) {
-		lua_createtable(lua_state, (int)m_tempValuesByID.size(), 0);
-		std::map<unsigned long long, float>::iterator p;
-		for (p = m_tempValuesByID.begin(); p != m_tempValuesByID.end(); ++p)
-		{
-			lua_pushnumber(lua_state, (lua_Number)p->first);
-			lua_pushnumber(lua_state, (lua_Number)p->second);
-			lua_rawset(lua_state, -3);
-		}
-		lua_setglobal(lua_state, "temperaturedevice");
+bool CEventSystem::CompileLuaScript(const std::string &filename, std::string &bytecode)
+{
+	lua_State *lua_state = luaL_newstate();
+	int status = luaL_loadfile(lua_state, filename.c_str());
+	if (status == 0)
+	{
+		status = lua_dump(lua_state, LuaBytecodeWriter, &bytecode);
 	}
-	if (m_dewValuesByID.size()>0) {
-		lua_createtable(lua_state, (int)m_dewValuesByID.size(), 0);
-		std::map<unsigned long long, float>::iterator p;
-		for (p = m_dewValuesByID.begin(); p != m_dewValuesByID.end(); ++p)
-		{
-			lua_pushnumber(lua_state, (lua_Number)p->first);
-			lua_pushnumber(lua_state, (lua_Number)p->second);
-			lua_rawset(lua_state, -3);
-		}
-		lua_setglobal(lua_state, "dewpointdevice");
+	else
+	{
+		report_errors(lua_state, status);
 	}
-	if (m_humValuesByID.size()>0) {
-		lua_createtable(lua_state, (int)m_humValuesByID.size(), 0);
-		std::map<unsigned long long, unsigned char>::iterator p;
-		for (p = m_humValuesByID.begin(); p != m_humValuesByID.end(); ++p)
+	lua_close(lua_state);
+	return (status == 0);
+}
+
+lua_State *CEventSystem::CreateLuaState()
+{
+	lua_State *lua_state = luaL_newstate();
+
+	// load Lua libraries
+	luaL_openlibs(lua_state);
+
+	// reroute print library to Domoticz logger
+	lua_pushcfunction(lua_state, l_domoticz_print);
+	lua_setglobal(lua_state, "print");
+
+	//loaded scripts by filename, compiled blockly conditions by text
+	lua_newtable(lua_state);
+	lua_setfield(lua_state, LUA_REGISTRYINDEX, "domoticzscripts");
+	lua_newtable(lua_state);
+	lua_setfield(lua_state, LUA_REGISTRYINDEX, "blocklyconditions");
+
+	//each script run gets its own environment that falls back to the shared tables
+	lua_newtable(lua_state);
+	lua_pushglobaltable(lua_state);
+	lua_setfield(lua_state, -2, "__index");
+	lua_setfield(lua_state, LUA_REGISTRYINDEX, "domoticzenvmeta");
+
+	return lua_state;
+}
+
+CEventSystem::_tLuaStateItem *CEventSystem::GetLuaState()
+{
+	boost::lock_guard<boost::mutex> l(m_luastates_mutex);
+	std::vector<_tLuaStateItem*>::iterator itt;
+	for (itt = m_luastates.begin(); itt != m_luastates.end(); ++itt)
+	{
+		if (!(*itt)->bInUse)
 		{
-			lua_pushnumber(lua_state, (lua_Number)p->first);
-			lua_pushnumber(lua_state, (lua_Number)p->second);
-			lua_rawset(lua_state, -3);
-		}
-		lua_setglobal(lua_state, "humiditydevice");
+			(*itt)->bInUse = true;
+			return (*itt);
+		}
+	}
+	//all states are busy (or a script is still running after its timeout)
+	if (m_luastates.size() >= LUA_MAX_STATES)
+		return NULL;
+	_tLuaStateItem *item = new _tLuaStateItem;
+	item->lua_state = CreateLuaState();
+	item->bBlockly = false;
+	item->bInUse = true;
+	item->devicesversion = 0;
+	item->uservariablesversion = 0;
+	m_luastates.push_back(item);
+	return item;
+}
+
+void CEventSystem::ReleaseLuaState(_tLuaStateItem *item)
+{
+	boost::lock_guard<boost::mutex> l(m_luastates_mutex);
+	item->bInUse = false;
+}
+
+static void PushLuaKey(lua_State *lua_state, const std::string &key)
+{
+	lua_pushstring(lua_state, key.c_str());
+}
+
+static void PushLuaKey(lua_State *lua_state, const unsigned long long key)
+{
+	lua_pushnumber(lua_state, (lua_Number)key);
+}
+
+//Replaces a measurement table, tables without values are not defined
+template <typename K, typename V>
+static void SetLuaMeasurementTable(lua_State *lua_state, const char *szName, const std::map<K, V> &values)
+{
+	if (values.empty())
+	{
+		lua_pushnil(lua_state);
+		lua_setglobal(lua_state, szName);
+		return;
 	}
-	if (m_baroValuesByID.size()>0) {
-		lua_createtable(lua_state, (int)m_baroValuesByID.size(), 0);
-		std::map<unsigned long long, float>::iterator p;
-		for (p = m_baroValuesByID.begin(); p != m_baroValuesByID.end(); ++p)
-		{
-			lua_pushnumber(lua_state, (lua_Number)p->first);
-			lua_pushnumber(lua_state, (lua_Number)p->second);
-			lua_rawset(lua_state, -3);
-		}
-		lua_setglobal(lua_state, "barometerdevice");
+	lua_createtable(lua_state, (int)values.size(), 0);
+	typename std::map<K, V>::const_iterator p;
+	for (p = values.begin(); p != values.end(); ++p)
+	{
+		PushLuaKey(lua_state, p->first);
+		lua_pushnumber(lua_state, (lua_Number)p->second);
+		lua_rawset(lua_state, -3);
+	}
+	lua_setglobal(lua_state, szName);
+}
+
+//Updates the value of one device in a measurement table
+template <typename K, typename V>
+static void UpdateLuaMeasurementValue(lua_State *lua_state, const char *szName, const std::map<K, V> &values, const K &key)
+{
+	typename std::map<K, V>::const_iterator p = values.find(key);
+	if (p == values.end())
+		return;
+	lua_getglobal(lua_state, szName);
+	if (!lua_istable(lua_state, -1))
+	{
+		lua_pop(lua_state, 1);
+		lua_newtable(lua_state);
+		lua_pushvalue(lua_state, -1);
+		lua_setglobal(lua_state, szName);
 	}
-	if (m_utilityValuesByID.size()>0) {
-		lua_createtable(lua_state, (int)m_utilityValuesByID.size(), 0);
-		std::map<unsigned long long, float>::iterator p;
-		for (p = m_utilityValuesByID.begin(); p != m_utilityValuesByID.end(); ++p)
+	PushLuaKey(lua_state, key);
+	lua_pushnumber(lua_state, (lua_Number)p->second);
+	lua_rawset(lua_state, -3);
+	lua_pop(lua_state, 1);
+}
+
+static void PushLuaUserVariable(lua_State *lua_state, const CEventSystem::_tUserVariable &uvitem)
+{
+	if (uvitem.variableType == 0)
+		lua_pushnumber(lua_state, atoi(uvitem.variableValue.c_str()));
+	else if (uvitem.variableType == 1)
+		lua_pushnumber(lua_state, atof(uvitem.variableValue.c_str()));
+	else
+		lua_pushstring(lua_state, uvitem.variableValue.c_str());
+}
+
+//Brings the device and variable tables of a state up to date, only changed items are written
+void CEventSystem::SyncLuaTables(_tLuaStateItem *item)
+{
+	lua_State *lua_state = item->lua_state;
+	lua_settop(lua_state, 0);
+
+	GetCurrentMeasurementStates();
+
+	if (item->devicesversion != m_devicestates_version)
+	{
+		bool bFull = (item->devicesversion < m_devicestates_resetversion);
+		if (bFull)
 		{
-			lua_pushnumber(lua_state, (lua_Number)p->first);
-			lua_pushnumber(lua_state, (lua_Number)p->second);
-			lua_rawset(lua_state, -3);
+			//devices were removed or renamed, start with fresh tables
+			if (item->bBlockly)
+			{
+				lua_createtable(lua_state, (int)m_devicestates.size(), 0);
+				lua_setglobal(lua_state, "device");
+
+				SetLuaMeasurementTable(lua_state, "temperaturedevice", m_tempValuesByID);
+				SetLuaMeasurementTable(lua_state, "dewpointdevice", m_dewValuesByID);
+				SetLuaMeasurementTable(lua_state, "humiditydevice", m_humValuesByID);
+				SetLuaMeasurementTable(lua_state, "barometerdevice", m_baroValuesByID);
+				SetLuaMeasurementTable(lua_state, "utilitydevice", m_utilityValuesByID);
+				SetLuaMeasurementTable(lua_state, "raindevice", m_rainValuesByID);
+				SetLuaMeasurementTable(lua_state, "rainlasthourdevice", m_rainLastHourValuesByID);
+				SetLuaMeasurementTable(lua_state, "uvdevice", m_uvValuesByID);
+				SetLuaMeasurementTable(lua_state, "winddirdevice", m_winddirValuesByID);
+				SetLuaMeasurementTable(lua_state, "windspeeddevice", m_windspeedValuesByID);
+				SetLuaMeasurementTable(lua_state, "windgustdevice", m_windgustValuesByID);
+			}
+			else
+			{
+				lua_createtable(lua_state, (int)m_devicestates.size(), 0);
+				lua_setglobal(lua_state, "otherdevices");
+				lua_createtable(lua_state, (int)m_devicestates.size(), 0);
+				lua_setglobal(lua_state, "otherdevices_lastupdate");
+				lua_createtable(lua_state, (int)m_devicestates.size(), 0);
+				lua_setglobal(lua_state, "otherdevices_svalues");
+
+				SetLuaMeasurementTable(lua_state, "otherdevices_temperature", m_tempValuesByName);
+				SetLuaMeasurementTable(lua_state, "otherdevices_dewpoint", m_dewValuesByName);
+				SetLuaMeasurementTable(lua_state, "otherdevices_humidity", m_humValuesByName);
+				SetLuaMeasurementTable(lua_state, "otherdevices_barometer", m_baroValuesByName);
+				SetLuaMeasurementTable(lua_state, "otherdevices_utility", m_utilityValuesByName);
+				SetLuaMeasurementTable(lua_state, "otherdevices_rain", m_rainValuesByName);
+				SetLuaMeasurementTable(lua_state, "otherdevices_rain_lasthour", m_rainLastHourValuesByName);
+				SetLuaMeasurementTable(lua_state, "otherdevices_uv", m_uvValuesByName);
+				SetLuaMeasurementTable(lua_state, "otherdevices_winddir", m_winddirValuesByName);
+				SetLuaMeasurementTable(lua_state, "otherdevices_windspeed", m_windspeedValuesByName);
+				SetLuaMeasurementTable(lua_state, "otherdevices_windgust", m_windgustValuesByName);
+			}
 		}
-		lua_setglobal(lua_state, "utilitydevice");
-	}
-	if (m_rainValuesByID.size()>0) {
-		lua_createtable(lua_state, (int)m_rainValuesByID.size(), 0);
-		std::map<unsigned long long, float>::iterator p;
-		for (p = m_rainValuesByID.begin(); p != m_rainValuesByID.end(); ++p)
+
+		if (item->bBlockly)
 		{
-			lua_pushnumber(lua_state, (lua_Number)p->first);
-			lua_pushnumber(lua_state, (lua_Number)p->second);
-			lua_rawset(lua_state, -3);
+			lua_getglobal(lua_state, "device");
 		}
-		lua_setglobal(lua_state, "raindevice");
-	}
-	if (m_rainLastHourValuesByID.size()>0) {
-		lua_createtable(lua_state, (int)m_rainLastHourValuesByID.size(), 0);
-		std::map<unsigned long long, float>::iterator p;
-		for (p = m_rainLastHourValuesByID.begin(); p != m_rainLastHourValuesByID.end(); ++p)
+		else
 		{
-			lua_pushnumber(lua_state, (lua_Number)p->first);
-			lua_pushnumber(lua_state, (lua_Number)p->second);
-			lua_rawset(lua_state, -3);
+			lua_getglobal(lua_state, "otherdevices");
+			lua_getglobal(lua_state, "otherdevices_lastupdate");
+			lua_getglobal(lua_state, "otherdevices_svalues");
 		}
-		lua_setglobal(lua_state, "rainlasthourdevice");
-	}
-	if (m_uvValuesByID.size()>0) {
-		lua_createtable(lua_state, (int)m_uvValuesByID.size(), 0);
-		std::map<unsigned long long, float>::iterator p;
-		for (p = m_uvValuesByID.begin(); p != m_uvValuesByID.end(); ++p)
+
+		std::map<unsigned long long, _tDeviceStatus>::const_iterator itt;
+		for (itt = m_devicestates.begin(); itt != m_devicestates.end(); ++itt)
 		{
-			lua_pushnumber(lua_state, (lua_Number)p->first);
-			lua_pushnumber(lua_state, (lua_Number)p->second);
-			lua_rawset(lua_state, -3);
+			const _tDeviceStatus &sitem = itt->second;
+			if ((!bFull) && (sitem.version <= item->devicesversion))
+				continue;
+			if (item->bBlockly)
+			{
+				lua_pushnumber(lua_state, (lua_Number)sitem.ID);
+				lua_pushstring(lua_state, sitem.nValueWording.c_str());
+				lua_rawset(lua_state, 1);
+				if (bFull)
+					continue;
+				UpdateLuaMeasurementValue(lua_state, "temperaturedevice", m_tempValuesByID, sitem.ID);
+				UpdateLuaMeasurementValue(lua_state, "dewpointdevice", m_dewValuesByID, sitem.ID);
+				UpdateLuaMeasurementValue(lua_state, "humiditydevice", m_humValuesByID, sitem.ID);
+				UpdateLuaMeasurementValue(lua_state, "barometerdevice", m_baroValuesByID, sitem.ID);
+				UpdateLuaMeasurementValue(lua_state, "utilitydevice", m_utilityValuesByID, sitem.ID);
+				UpdateLuaMeasurementValue(lua_state, "raindevice", m_rainValuesByID, sitem.ID);
+				UpdateLuaMeasurementValue(lua_state, "rainlasthourdevice", m_rainLastHourValuesByID, sitem.ID);
+				UpdateLuaMeasurementValue(lua_state, "uvdevice", m_uvValuesByID, sitem.ID);
+				UpdateLuaMeasurementValue(lua_state, "winddirdevice", m_winddirValuesByID, sitem.ID);
+				UpdateLuaMeasurementValue(lua_state, "windspeeddevice", m_windspeedValuesByID, sitem.ID);
+				UpdateLuaMeasurementValue(lua_state, "windgustdevice", m_windgustValuesByID, sitem.ID);
+			}
+			else
+			{
+				lua_pushstring(lua_state, sitem.deviceName.c_str());
+				lua_pushstring(lua_state, sitem.nValueWording.c_str());
+				lua_rawset(lua_state, 1);
+				lua_pushstring(lua_state, sitem.deviceName.c_str());
+				lua_pushstring(lua_state, sitem.lastUpdate.c_str());
+				lua_rawset(lua_state, 2);
+				lua_pushstring(lua_state, sitem.deviceName.c_str());
+				lua_pushstring(lua_state, sitem.sValue.c_str());
+				lua_rawset(lua_state, 3);
+				if (bFull)
+					continue;
+				UpdateLuaMeasurementValue(lua_state, "otherdevices_temperature", m_tempValuesByName, sitem.deviceName);
+				UpdateLuaMeasurementValue(lua_state, "otherdevices_dewpoint", m_dewValuesByName, sitem.deviceName);
+				UpdateLuaMeasurementValue(lua_state, "otherdevices_humidity", m_humValuesByName, sitem.deviceName);
+				UpdateLuaMeasurementValue(lua_state, "otherdevices_barometer", m_baroValuesByName, sitem.deviceName);
+				UpdateLuaMeasurementValue(lua_state, "otherdevices_utility", m_utilityValuesByName, sitem.deviceName);
+				UpdateLuaMeasurementValue(lua_state, "otherdevices_rain", m_rainValuesByName, sitem.deviceName);
+				UpdateLuaMeasurementValue(lua_state, "otherdevices_rain_lasthour", m_rainLastHourValuesByName, sitem.deviceName);
+				UpdateLuaMeasurementValue(lua_state, "otherdevices_uv", m_uvValuesByName, sitem.deviceName);
+				UpdateLuaMeasurementValue(lua_state, "otherdevices_winddir", m_winddirValuesByName, sitem.deviceName);
+				UpdateLuaMeasurementValue(lua_state, "otherdevices_windspeed", m_windspeedValuesByName, sitem.deviceName);
+				UpdateLuaMeasurementValue(lua_state, "otherdevices_windgust", m_windgustValuesByName, sitem.deviceName);
+			}
 		}
-		lua_setglobal(lua_state, "uvdevice");
+		lua_settop(lua_state, 0);
+		item->devicesversion = m_devicestates_version;
 	}
-	if (m_winddirValuesByID.size()>0) {
-		lua_createtable(lua_state, (int)m_winddirValuesByID.size(), 0);
-		std::map<unsigned long long, float>::iterator p;
-		for (p = m_winddirValuesByID.begin(); p != m_winddirValuesByID.end(); ++p)
+
+	if (item->uservariablesversion != m_uservariables_version)
+	{
+		bool bFull = (item->uservariablesversion < m_uservariables_resetversion);
+		if (bFull)
 		{
-			lua_pushnumber(lua_state, (lua_Number)p->first);
-			lua_pushnumber(lua_state, (lua_Number)p->second);
-			lua_rawset(lua_state, -3);
+			if (item->bBlockly)
+			{
+				lua_createtable(lua_state, (int)m_uservariables.size(), 0);
+				lua_setglobal(lua_state, "variable");
+			}
+			else
+			{
+				lua_createtable(lua_state, (int)m_uservariables.size(), 0);
+				lua_setglobal(lua_state, "uservariables");
+				lua_createtable(lua_state, (int)m_uservariables.size(), 0);
+				lua_setglobal(lua_state, "uservariables_lastupdate");
+			}
 		}
-		lua_setglobal(lua_state, "winddirdevice");
-	}
-	if (m_windspeedValuesByID.size()>0) {
-		lua_createtable(lua_state, (int)m_windspeedValuesByID.size(), 0);
-		std::map<unsigned long long, float>::iterator p;
-		for (p = m_windspeedValuesByID.begin(); p != m_windspeedValuesByID.end(); ++p)
+
+		if (item->bBlockly)
 		{
-			lua_pushnumber(lua_state, (lua_Number)p->first);
-			lua_pushnumber(lua_state, (lua_Number)p->second);
-			lua_rawset(lua_state, -3);
+			lua_getglobal(lua_state, "variable");
 		}
-		lua_setglobal(lua_state, "windspeeddevice");
-	}
-	if (m_windgustValuesByID.size()>0) {
-		lua_createtable(lua_state, (int)m_windgustValuesByID.size(), 0);
-		std::map<unsigned long long, float>::iterator p;
-		for (p = m_windgustValuesByID.begin(); p != m_windgustValuesByID.end(); ++p)
+		else
 		{
-			lua_pushnumber(lua_state, (lua_Number)p->first);
-			lua_pushnumber(lua_state, (lua_Number)p->second);
-			lua_rawset(lua_state, -3);
+			lua_getglobal(lua_state, "uservariables");
+			lua_getglobal(lua_state, "uservariables_lastupdate");
 		}
-		lua_setglobal(lua_state, "windgustdevice");
-	}
-
-	lua_pushnumber(lua_state, (lua_Number)m_SecStatus);
-	lua_setglobal(lua_state, "securitystatus");
-
-	if ((reason == "device") && (DeviceID >0)) {
 
-		std::size_t found;
-		bool eventActive = false;
-
-		std::vector<_tEventItem>::iterator it;
-		for (it = m_events.begin(); it != m_events.end(); ++it) {
-			eventActive = false;
-			std::stringstream sstr;
-			sstr << "device[" << DeviceID << "]";
-			found = it->Conditions.find(sstr.str());
-			if (it->EventStatus == 1) { eventActive = true; };
-
-			if ((eventActive) && (found != std::string::npos)) {
-
-				// Replace Sunrise and sunset placeholder with actual time for query
-				if (it->Conditions.find("@Sunrise") != std::string::npos) {
-					int intRise = getSunRiseSunSetMinutes("Sunrise");
-					std::stringstream ssRise;
-					ssRise << intRise;
-					it->Conditions = stdreplace(it->Conditions, "@Sunrise", ssRise.str());
-				}
-				if (it->Conditions.find("@Sunset") != std::string::npos) {
-					int intSet = getSunRiseSunSetMinutes("Sunset");
-					std::stringstream ssSet;
-					ssSet << intSet;
-					it->Conditions = stdreplace(it->Conditions, "@Sunset", ssSet.str());
-				}
-
-				std::string ifCondition = "result = 0; weekday = os.date('*t')['wday']; timeofday = ((os.date('*t')['hour']*60)+os.date('*t')['min']); if " + it->Conditions + " then result = 1 end; return result";
-				//_log.Log(LOG_STATUS,"ifc: %s",ifCondition.c_str());
-				if (luaL_dostring(lua_state, ifCondition.c_str()))
-				{
-					_log.Log(LOG_ERROR, "Lua script error (Blockly), Name: %s => %s", it->Name.c_str(), lua_tostring(lua_state, -1));
-				}
-				else {
-					lua_Number ruleTrue = lua_tonumber(lua_state, -1);
-
-					if (ruleTrue != 0)
-					{
-						if (parseBlocklyActions(it->Actions, it->Name, it->ID))
-						{
-							_log.Log(LOG_NORM, "UI Event triggered: %s", it->Name.c_str());
-						}
-					}
-				}
+		std::map<unsigned long long, _tUserVariable>::const_iterator itt;
+		for (itt = m_uservariables.begin(); itt != m_uservariables.end(); ++itt)
+		{
+			const _tUserVariable &uvitem = itt->second;
+			if ((!bFull) && (uvitem.version <= item->uservariablesversion))
+				continue;
+			if (item->bBlockly)
+			{
+				lua_pushnumber(lua_state, (lua_Number)uvitem.ID);
+				PushLuaUserVariable(lua_state, uvitem);
+				lua_rawset(lua_state, 1);
 			}
-		}
-	}
-	else if (reason == "security") {
-		// security status change
-		std::size_t found;
-		bool eventActive = false;
-
-		std::vector<_tEventItem>::iterator it;
-		for (it = m_events.begin(); it != m_events.end(); ++it) {
-			eventActive = false;
-			std::stringstream sstr;
-			sstr << "securitystatus";
-			found = it->Conditions.find(sstr.str());
-			if (it->EventStatus == 1) { eventActive = true; };
-
-			if ((eventActive) && (found != std::string::npos)) {
-
-				// Replace Sunrise and sunset placeholder with actual time for query
-				if (it->Conditions.find("@Sunrise") != std::string::npos) {
-					int intRise = getSunRiseSunSetMinutes("Sunrise");
-					std::stringstream ssRise;
-					ssRise << intRise;
-					it->Conditions = stdreplace(it->Conditions, "@Sunrise", ssRise.str());
-				}
-				if (it->Conditions.find("@Sunset") != std::string::npos) {
-					int intSet = getSunRiseSunSetMinutes("Sunset");
-					std::stringstream ssSet;
-					ssSet << intSet;
-					it->Conditions = stdreplace(it->Conditions, "@Sunset", ssSet.str());
-				}
-
-				std::string ifCondition = "result = 0; weekday = os.date('*t')['wday']; timeofday = ((os.date('*t')['hour']*60)+os.date('*t')['min']); if " + it->Conditions + " then result = 1 end; return result";
-				//_log.Log(LOG_NORM,"ifc: %s",ifCondition.c_str());
-				if (luaL_dostring(lua_state, ifCondition.c_str()))
-				{
-					_log.Log(LOG_ERROR, "Lua script error (Blockly), Name: %s => %s", it->Name.c_str(), lua_tostring(lua_state, -1));
-				}
-				else {
-					lua_Number ruleTrue = lua_tonumber(lua_state, -1);
-
-					if (ruleTrue != 0)
-					{
-						if (parseBlocklyActions(it->Actions, it->Name, it->ID))
-						{
-							_log.Log(LOG_NORM, "UI Event triggered: %s", it->Name.c_str());
-						}
-					}
-				}
+			else
+			{
+				lua_pushstring(lua_state, uvitem.variableName.c_str());
+				PushLuaUserVariable(lua_state, uvitem);
+				lua_rawset(lua_state, 1);
+				lua_pushstring(lua_state, uvitem.variableName.c_str());
+				lua_pushstring(lua_state, uvitem.lastUpdate.c_str());
+				lua_rawset(lua_state, 2);
 			}
 		}
+		lua_settop(lua_state, 0);
+		item->uservariablesversion = m_uservariables_version;
 	}
+}
 
-	else if (reason == "time") {
+void CEventSystem::EvaluateBlockly(const std::string &reason, const unsigned long long DeviceID, const std::string &devname, const int nValue, const char* sValue, std::string nValueWording, const unsigned long long varId)
+{
 
-		bool eventActive = false;
+	//#ifdef _DEBUG
+	//    _log.Log(LOG_STATUS,"EventSystem blockly %s trigger",reason.c_str());
+	//#endif
 
-		std::vector<_tEventItem>::iterator it;
-		for (it = m_events.begin(); it != m_events.end(); ++it) {
-			eventActive = false;
-			if (it->EventStatus == 1) { eventActive = true; };
-			if (eventActive) {
-				// time rules will only run when time or date based critera are found
-				if ((it->Conditions.find("timeofday") != std::string::npos) || (it->Conditions.find("weekday") != std::string::npos)) {
+	//only the rules that reference this device/variable (see LoadEvents)
+	const std::vector<size_t> *pRules = NULL;
+	if ((reason == "device") && (DeviceID > 0))
+	{
+		std::map<unsigned long long, std::vector<size_t> >::const_iterator itt = m_blocklydevicerules.find(DeviceID);
+		if (itt != m_blocklydevicerules.end())
+			pRules = &itt->second;
+	}
+	else if (reason == "security")
+	{
+		pRules = &m_blocklysecurityrules;
+	}
+	else if (reason == "time")
+	{
+		pRules = &m_blocklytimerules;
+	}
+	else if ((reason == "uservariable") && (varId > 0))
+	{
+		std::map<unsigned long long, std::vector<size_t> >::const_iterator itt = m_blocklyvariablerules.find(varId);
+		if (itt != m_blocklyvariablerules.end())
+			pRules = &itt->second;
+	}
+	if ((pRules == NULL) || (pRules->empty()))
+		return;
 
-					// Replace Sunrise and sunset placeholder with actual time for query
-					if (it->Conditions.find("@Sunrise") != std::string::npos) {
-						int intRise = getSunRiseSunSetMinutes("Sunrise");
-						std::stringstream ssRise;
-						ssRise << intRise;
-						it->Conditions = stdreplace(it->Conditions, "@Sunrise", ssRise.str());
-					}
-					if (it->Conditions.find("@Sunset") != std::string::npos) {
-						int intSet = getSunRiseSunSetMinutes("Sunset");
-						std::stringstream ssSet;
-						ssSet << intSet;
-						it->Conditions = stdreplace(it->Conditions, "@Sunset", ssSet.str());
-					}
+	boost::lock_guard<boost::mutex> l(luaMutex);
 
-					std::string ifCondition = "result = 0; weekday = os.date('*t')['wday']; timeofday = ((os.date('*t')['hour']*60)+os.date('*t')['min']); if " + it->Conditions + " then result = 1 end; return result";
-					//_log.Log(LOG_NORM,"ifc: %s",ifCondition.c_str());
-					if (luaL_dostring(lua_state, ifCondition.c_str()))
-					{
-						_log.Log(LOG_ERROR, "Lua script error (Blockly), Name: %s => %s", it->Name.c_str(), lua_tostring(lua_state, -1));
-					}
-					else {
-						lua_Number ruleTrue = lua_tonumber(lua_state, -1);
-						if (ruleTrue != 0)
-						{
-							if (parseBlocklyActions(it->Actions, it->Name, it->ID))
-							{
-								_log.Log(LOG_NORM, "UI Event triggered: %s", it->Name.c_str());
-							}
-						}
-					}
-				}
-			}
-		}
+	if (m_pBlocklyState == NULL)
+	{
+		m_pBlocklyState = new _tLuaStateItem;
+		m_pBlocklyState->lua_state = CreateLuaState();
+		m_pBlocklyState->bBlockly = true;
+		m_pBlocklyState->bInUse = true;
+		m_pBlocklyState->devicesversion = 0;
+		m_pBlocklyState->uservariablesversion = 0;
 	}
+	lua_State *lua_state = m_pBlocklyState->lua_state;
+	SyncLuaTables(m_pBlocklyState);
 
-	if ((reason == "uservariable") && (varId >0)) {
-
-		std::size_t found;
-		bool eventActive = false;
+	lua_pushnumber(lua_state, (lua_Number)m_SecStatus);
+	lua_setglobal(lua_state, "securitystatus");
 
-		std::vector<_tEventItem>::iterator it;
-		for (it = m_events.begin(); it != m_events.end(); ++it) {
-			eventActive = false;
-			std::stringstream sstr;
-			sstr << "variable[" << varId << "]";
-			found = it->Conditions.find(sstr.str());
-			if (it->EventStatus == 1) { eventActive = true; };
+	std::vector<size_t>::const_iterator itRule;
+	for (itRule = pRules->begin(); itRule != pRules->end(); ++itRule)
+	{
+		std::vector<_tEventItem>::iterator it = m_events.begin() + *itRule;
+		boost::posix_time::ptime tstart = boost::posix_time::microsec_clock::universal_time();
 
-			if ((eventActive) && (found != std::string::npos)) {
+		// Replace Sunrise and sunset placeholder with actual time for query
+		if (it->Conditions.find("@Sunrise") != std::string::npos) {
+			int intRise = getSunRiseSunSetMinutes("Sunrise");
+			std::stringstream ssRise;
+			ssRise << intRise;
+			it->Conditions = stdreplace(it->Conditions, "@Sunrise", ssRise.str());
+		}
+		if (it->Conditions.find("@Sunset") != std::string::npos) {
+			int intSet = getSunRiseSunSetMinutes("Sunset");
+			std::stringstream ssSet;
+			ssSet << intSet;
+			it->Conditions = stdreplace(it->Conditions, "@Sunset", ssSet.str());
+		}
 
-				// Replace Sunrise and sunset placeholder with actual time for query
-				if (it->Conditions.find("@Sunrise") != std::string::npos) {
-					int intRise = getSunRiseSunSetMinutes("Sunrise");
-					std::stringstream ssRise;
-					ssRise << intRise;
-					it->Conditions = stdreplace(it->Conditions, "@Sunrise", ssRise.str());
-				}
-				if (it->Conditions.find("@Sunset") != std::string::npos) {
-					int intSet = getSunRiseSunSetMinutes("Sunset");
-					std::stringstream ssSet;
-					ssSet << intSet;
-					it->Conditions = stdreplace(it->Conditions, "@Sunset", ssSet.str());
-				}
+		std::string ifCondition = "result = 0; weekday = os.date('*t')['wday']; timeofday = ((os.date('*t')['hour']*60)+os.date('*t')['min']); if " + it->Conditions + " then result = 1 end; return result";
+		//_log.Log(LOG_STATUS,"ifc: %s",ifCondition.c_str());
+		if (RunBlocklyCondition(lua_state, ifCondition))
+		{
+			_log.Log(LOG_ERROR, "Lua script error (Blockly), Name: %s => %s", it->Name.c_str(), lua_tostring(lua_state, -1));
+		}
+		else {
+			lua_Number ruleTrue = lua_tonumber(lua_state, -1);
 
-				std::string ifCondition = "result = 0; weekday = os.date('*t')['wday']; timeofday = ((os.date('*t')['hour']*60)+os.date('*t')['min']); if " + it->Conditions + " then result = 1 end; return result";
-				//_log.Log(LOG_STATUS,"ifc: %s",ifCondition.c_str());
-				if (luaL_dostring(lua_state, ifCondition.c_str()))
+			if (ruleTrue != 0)
+			{
+				if (parseBlocklyActions(it->Actions, it->Name, it->ID))
 				{
-					_log.Log(LOG_ERROR, "Lua script error (Blockly), Name: %s => %s", it->Name.c_str(), lua_tostring(lua_state, -1));
-				}
-				else {
-					lua_Number ruleTrue = lua_tonumber(lua_state, -1);
-
-					if (ruleTrue != 0)
-					{
-						if (parseBlocklyActions(it->Actions, it->Name, it->ID))
-						{
-							_log.Log(LOG_NORM, "UI Event triggered: %s", it->Name.c_str());
-						}
-					}
+					_log.Log(LOG_NORM, "UI Event triggered: %s", it->Name.c_str());
 				}
 			}
 		}
+		UpdateEventStats(it->Name, "Blockly", tstart);
 	}
+	lua_settop(lua_state, 0);
+}
 
-	lua_close(lua_state);
+//Runs a blockly condition, compiled conditions are kept in the state
+int CEventSystem::RunBlocklyCondition(lua_State *lua_state, const std::string &ifCondition)
+{
+	lua_settop(lua_state, 0);
+	lua_getfield(lua_state, LUA_REGISTRYINDEX, "blocklyconditions");
+	lua_getfield(lua_state, 1, ifCondition.c_str());
+	if (!lua_isfunction(lua_state, -1))
+	{
+		lua_pop(lua_state, 1);
+		int status = luaL_loadstring(lua_state, ifCondition.c_str());
+		if (status != 0)
+			return status;
+		lua_pushvalue(lua_state, -1);
+		lua_setfield(lua_state, 1, ifCondition.c_str());
+	}
+	return lua_pcall(lua_state, 0, 1, 0);
 }
 
 
@@ -1386,36 +1888,33 @@ void CEventSystem::EvaluateLua(const std::string &reason, const std::string &fil
 		return;
 	}
 
-	lua_State *lua_state;
-	lua_state = luaL_newstate();
+	std::map<std::string, _tLuaScript>::const_iterator itScript = m_luascripts.find(filename);
+	if ((itScript == m_luascripts.end()) || (itScript->second.bytecode.empty()))
+		return; //removed, or it did not compile (already reported)
 
-	// load Lua libraries
-	static const luaL_Reg lualibs[] =
-	{
-		{ "base", luaopen_base },
-		{ "io", luaopen_io },
-		{ "table", luaopen_table },
-		{ "string", luaopen_string },
-		{ "math", luaopen_math },
-		{ NULL, NULL }
-	};
-
-	const luaL_Reg *lib = lualibs;
-	for (; lib->func != NULL; lib++)
+	_tLuaStateItem *item = GetLuaState();
+	if (item == NULL)
 	{
-		lib->func(lua_state);
-		lua_settop(lua_state, 0);
+		_log.Log(LOG_ERROR, "EventSystem: all %d lua states are used by scripts that did not return, skipping %s", LUA_MAX_STATES, filename.c_str());
+		UpdateEventStatsSkipped(filename);
+		return;
 	}
 
-	// reroute print library to Domoticz logger
-	luaL_openlibs(lua_state);
-	lua_pushcfunction(lua_state, l_domoticz_print);
-	lua_setglobal(lua_state, "print");
+	boost::posix_time::ptime tstart = boost::posix_time::microsec_clock::universal_time();
+	lua_State *lua_state = item->lua_state;
+	SyncLuaTables(item);
 
 #ifdef _DEBUG
 	_log.Log(LOG_STATUS, "EventSystem script %s trigger", reason.c_str());
 #endif
 
+	//per run globals go into a fresh environment table (stack index 1)
+	lua_newtable(lua_state);
+	lua_pushvalue(lua_state, 1);
+	lua_setfield(lua_state, 1, "_G");
+	lua_getfield(lua_state, LUA_REGISTRYINDEX, "domoticzenvmeta");
+	lua_setmetatable(lua_state, 1);
+
 	int intRise = getSunRiseSunSetMinutes("Sunrise");
 	int intSet = getSunRiseSunSetMinutes("Sunset");
 	time_t now = time(0);
@@ -1444,187 +1943,7 @@ void CEventSystem::EvaluateLua(const std::string &reason, const std::string &fil
 	lua_pushstring(lua_state, "SunsetInMinutes");
 	lua_pushnumber(lua_state, intSet);
 	lua_rawset(lua_state, -3);
-	lua_setglobal(lua_state, "timeofday");
-
-	GetCurrentMeasurementStates();
-
-	float thisDeviceTemp = 0;
-	float thisDeviceDew = 0;
-	float thisDeviceRain = 0;
-	float thisDeviceRainLastHour = 0;
-	float thisDeviceUV = 0;
-	unsigned char thisDeviceHum = 0;
-	float thisDeviceBaro = 0;
-	float thisDeviceUtility = 0;
-	float thisDeviceWindDir = 0;
-	float thisDeviceWindSpeed = 0;
-	float thisDeviceWindGust = 0;
-
-	if (m_tempValuesByName.size()>0)
-	{
-		lua_createtable(lua_state, (int)m_tempValuesByName.size(), 0);
-		std::map<std::string, float>::iterator p;
-		for (p = m_tempValuesByName.begin(); p != m_tempValuesByName.end(); ++p)
-		{
-			lua_pushstring(lua_state, p->first.c_str());
-			lua_pushnumber(lua_state, (lua_Number)p->second);
-			lua_rawset(lua_state, -3);
-			if (p->first == devname) {
-				thisDeviceTemp = p->second;
-			}
-		}
-		lua_setglobal(lua_state, "otherdevices_temperature");
-	}
-	if (m_dewValuesByName.size()>0)
-	{
-		lua_createtable(lua_state, (int)m_dewValuesByName.size(), 0);
-		std::map<std::string, float>::iterator p;
-		for (p = m_dewValuesByName.begin(); p != m_dewValuesByName.end(); ++p)
-		{
-			lua_pushstring(lua_state, p->first.c_str());
-			lua_pushnumber(lua_state, (lua_Number)p->second);
-			lua_rawset(lua_state, -3);
-			if (p->first == devname) {
-				thisDeviceDew = p->second;
-			}
-		}
-		lua_setglobal(lua_state, "otherdevices_dewpoint");
-	}
-	if (m_humValuesByName.size()>0)
-	{
-		lua_createtable(lua_state, (int)m_humValuesByName.size(), 0);
-		std::map<std::string, unsigned char>::iterator p;
-		for (p = m_humValuesByName.begin(); p != m_humValuesByName.end(); ++p)
-		{
-			lua_pushstring(lua_state, p->first.c_str());
-			lua_pushnumber(lua_state, (lua_Number)p->second);
-			lua_rawset(lua_state, -3);
-			if (p->first == devname) {
-				thisDeviceHum = p->second;
-			}
-		}
-		lua_setglobal(lua_state, "otherdevices_humidity");
-	}
-	if (m_baroValuesByName.size()>0)
-	{
-		lua_createtable(lua_state, (int)m_baroValuesByName.size(), 0);
-		std::map<std::string, float>::iterator p;
-		for (p = m_baroValuesByName.begin(); p != m_baroValuesByName.end(); ++p)
-		{
-			lua_pushstring(lua_state, p->first.c_str());
-			lua_pushnumber(lua_state, (lua_Number)p->second);
-			lua_rawset(lua_state, -3);
-			if (p->first == devname) {
-				thisDeviceBaro = (float)p->second;
-			}
-		}
-		lua_setglobal(lua_state, "otherdevices_barometer");
-	}
-	if (m_utilityValuesByName.size()>0)
-	{
-		lua_createtable(lua_state, (int)m_utilityValuesByName.size(), 0);
-		std::map<std::string, float>::iterator p;
-		for (p = m_utilityValuesByName.begin(); p != m_utilityValuesByName.end(); ++p)
-		{
-			lua_pushstring(lua_state, p->first.c_str());
-			lua_pushnumber(lua_state, (lua_Number)p->second);
-			lua_rawset(lua_state, -3);
-			if (p->first == devname) {
-				thisDeviceUtility = p->second;
-			}
-		}
-		lua_setglobal(lua_state, "otherdevices_utility");
-	}
-	if (m_rainValuesByName.size()>0)
-	{
-		lua_createtable(lua_state, (int)m_rainValuesByName.size(), 0);
-		std::map<std::string, float>::iterator p;
-		for (p = m_rainValuesByName.begin(); p != m_rainValuesByName.end(); ++p)
-		{
-			lua_pushstring(lua_state, p->first.c_str());
-			lua_pushnumber(lua_state, (lua_Number)p->second);
-			lua_rawset(lua_state, -3);
-			if (p->first == devname) {
-				thisDeviceRain = p->second;
-			}
-		}
-		lua_setglobal(lua_state, "otherdevices_rain");
-	}
-	if (m_rainLastHourValuesByName.size()>0)
-	{
-		lua_createtable(lua_state, (int)m_rainLastHourValuesByName.size(), 0);
-		std::map<std::string, float>::iterator p;
-		for (p = m_rainLastHourValuesByName.begin(); p != m_rainLastHourValuesByName.end(); ++p)
-		{
-			lua_pushstring(lua_state, p->first.c_str());
-			lua_pushnumber(lua_state, (lua_Number)p->second);
-			lua_rawset(lua_state, -3);
-			if (p->first == devname) {
-				thisDeviceRainLastHour = p->second;
-			}
-		}
-		lua_setglobal(lua_state, "otherdevices_rain_lasthour");
-	}
-	if (m_uvValuesByName.size()>0)
-	{
-		lua_createtable(lua_state, (int)m_uvValuesByName.size(), 0);
-		std::map<std::string, float>::iterator p;
-		for (p = m_uvValuesByName.begin(); p != m_uvValuesByName.end(); ++p)
-		{
-			lua_pushstring(lua_state, p->first.c_str());
-			lua_pushnumber(lua_state, (lua_Number)p->second);
-			lua_rawset(lua_state, -3);
-			if (p->first == devname) {
-				thisDeviceUV = p->second;
-			}
-		}
-		lua_setglobal(lua_state, "otherdevices_uv");
-	}
-	if (m_winddirValuesByName.size()>0)
-	{
-		lua_createtable(lua_state, (int)m_winddirValuesByName.size(), 0);
-		std::map<std::string, float>::iterator p;
-		for (p = m_winddirValuesByName.begin(); p != m_winddirValuesByName.end(); ++p)
-		{
-			lua_pushstring(lua_state, p->first.c_str());
-			lua_pushnumber(lua_state, (lua_Number)p->second);
-			lua_rawset(lua_state, -3);
-			if (p->first == devname) {
-				thisDeviceWindDir = p->second;
-			}
-		}
-		lua_setglobal(lua_state, "otherdevices_winddir");
-	}
-	if (m_windspeedValuesByName.size()>0)
-	{
-		lua_createtable(lua_state, (int)m_windspeedValuesByName.size(), 0);
-		std::map<std::string, float>::iterator p;
-		for (p = m_windspeedValuesByName.begin(); p != m_windspeedValuesByName.end(); ++p)
-		{
-			lua_pushstring(lua_state, p->first.c_str());
-			lua_pushnumber(lua_state, (lua_Number)p->second);
-			lua_rawset(lua_state, -3);
-			if (p->first == devname) {
-				thisDeviceWindSpeed = p->second;
-			}
-		}
-		lua_setglobal(lua_state, "otherdevices_windspeed");
-	}
-	if (m_windgustValuesByName.size()>0)
-	{
-		lua_createtable(lua_state, (int)m_windgustValuesByName.size(), 0);
-		std::map<std::string, float>::iterator p;
-		for (p = m_windgustValuesByName.begin(); p != m_windgustValuesByName.end(); ++p)
-		{
-			lua_pushstring(lua_state, p->first.c_str());
-			lua_pushnumber(lua_state, (lua_Number)p->second);
-			lua_rawset(lua_state, -3);
-			if (p->first == devname) {
-				thisDeviceWindGust = p->second;
-			}
-		}
-		lua_setglobal(lua_state, "otherdevices_windgust");
-	}
+	lua_setfield(lua_state, 1, "timeofday");
 
 	if (reason == "device")
 	{
@@ -1632,149 +1951,82 @@ void CEventSystem::EvaluateLua(const std::string &reason, const std::string &fil
 		lua_pushstring(lua_state, devname.c_str());
 		lua_pushstring(lua_state, nValueWording.c_str());
 		lua_rawset(lua_state, -3);
-		if (thisDeviceTemp != 0)
+
+		std::map<std::string, float>::const_iterator itt;
+		if ((itt = m_tempValuesByName.find(devname)) != m_tempValuesByName.end() && (itt->second != 0))
 		{
 			std::string tempName = devname;
 			tempName += "_Temperature";
 			lua_pushstring(lua_state, tempName.c_str());
-			lua_pushnumber(lua_state, (lua_Number)thisDeviceTemp);
+			lua_pushnumber(lua_state, (lua_Number)itt->second);
 			lua_rawset(lua_state, -3);
 		}
-		if (thisDeviceDew != 0)
+		if ((itt = m_dewValuesByName.find(devname)) != m_dewValuesByName.end() && (itt->second != 0))
 		{
 			std::string tempName = devname;
 			tempName += "_Dewpoint";
 			lua_pushstring(lua_state, tempName.c_str());
-			lua_pushnumber(lua_state, (lua_Number)thisDeviceDew);
+			lua_pushnumber(lua_state, (lua_Number)itt->second);
 			lua_rawset(lua_state, -3);
 		}
-		if (thisDeviceHum != 0) {
+		std::map<std::string, unsigned char>::const_iterator ittHum = m_humValuesByName.find(devname);
+		if ((ittHum != m_humValuesByName.end()) && (ittHum->second != 0)) {
 			std::string humName = devname;
 			humName += "_Humidity";
 			lua_pushstring(lua_state, humName.c_str());
-			lua_pushnumber(lua_state, (lua_Number)thisDeviceHum);
+			lua_pushnumber(lua_state, (lua_Number)ittHum->second);
 			lua_rawset(lua_state, -3);
 		}
-		if (thisDeviceBaro != 0) {
+		if ((itt = m_baroValuesByName.find(devname)) != m_baroValuesByName.end() && (itt->second != 0)) {
 			std::string baroName = devname;
 			baroName += "_Barometer";
 			lua_pushstring(lua_state, baroName.c_str());
-			lua_pushnumber(lua_state, (lua_Number)thisDeviceBaro);
+			lua_pushnumber(lua_state, (lua_Number)itt->second);
 			lua_rawset(lua_state, -3);
 		}
-		if (thisDeviceUtility != 0) {
+		if ((itt = m_utilityValuesByName.find(devname)) != m_utilityValuesByName.end() && (itt->second != 0)) {
 			std::string utilityName = devname;
 			utilityName += "_Utility";
 			lua_pushstring(lua_state, utilityName.c_str());
-			lua_pushnumber(lua_state, (lua_Number)thisDeviceUtility);
+			lua_pushnumber(lua_state, (lua_Number)itt->second);
 			lua_rawset(lua_state, -3);
 		}
-		if (thisDeviceRain != 0)
+		if ((itt = m_rainValuesByName.find(devname)) != m_rainValuesByName.end() && (itt->second != 0))
 		{
 			std::string tempName = devname;
 			tempName += "_Rain";
 			lua_pushstring(lua_state, tempName.c_str());
-			lua_pushnumber(lua_state, (lua_Number)thisDeviceRain);
+			lua_pushnumber(lua_state, (lua_Number)itt->second);
 			lua_rawset(lua_state, -3);
 		}
-		if (thisDeviceRainLastHour != 0)
+		if ((itt = m_rainLastHourValuesByName.find(devname)) != m_rainLastHourValuesByName.end() && (itt->second != 0))
 		{
 			std::string tempName = devname;
 			tempName += "_RainLastHour";
 			lua_pushstring(lua_state, tempName.c_str());
-			lua_pushnumber(lua_state, (lua_Number)thisDeviceRainLastHour);
+			lua_pushnumber(lua_state, (lua_Number)itt->second);
 			lua_rawset(lua_state, -3);
 		}
-		if (thisDeviceUV != 0)
+		if ((itt = m_uvValuesByName.find(devname)) != m_uvValuesByName.end() && (itt->second != 0))
 		{
 			std::string tempName = devname;
 			tempName += "_UV";
 			lua_pushstring(lua_state, tempName.c_str());
-			lua_pushnumber(lua_state, (lua_Number)thisDeviceUV);
-			lua_rawset(lua_state, -3);
-		}
-		lua_setglobal(lua_state, "devicechanged");
-	}
-
-	lua_createtable(lua_state, (int)m_devicestates.size(), 0);
-	typedef std::map<unsigned long long, _tDeviceStatus>::iterator it_type;
-	for (it_type iterator = m_devicestates.begin(); iterator != m_devicestates.end(); iterator++)
-	{
-		_tDeviceStatus sitem = iterator->second;
-		lua_pushstring(lua_state, sitem.deviceName.c_str());
-		lua_pushstring(lua_state, sitem.nValueWording.c_str());
-		lua_rawset(lua_state, -3);
-	}
-	lua_setglobal(lua_state, "otherdevices");
-
-	lua_createtable(lua_state, (int)m_devicestates.size(), 0);
-	typedef std::map<unsigned long long, _tDeviceStatus>::iterator it_type;
-	for (it_type iterator = m_devicestates.begin(); iterator != m_devicestates.end(); iterator++)
-	{
-		_tDeviceStatus sitem = iterator->second;
-		lua_pushstring(lua_state, sitem.deviceName.c_str());
-		lua_pushstring(lua_state, sitem.lastUpdate.c_str());
-		lua_rawset(lua_state, -3);
-	}
-	lua_setglobal(lua_state, "otherdevices_lastupdate");
-
-	lua_createtable(lua_state, (int)m_devicestates.size(), 0);
-	typedef std::map<unsigned long long, _tDeviceStatus>::iterator it_type;
-	for (it_type iterator = m_devicestates.begin(); iterator != m_devicestates.end(); iterator++)
-	{
-		_tDeviceStatus sitem = iterator->second;
-		lua_pushstring(lua_state, sitem.deviceName.c_str());
-		lua_pushstring(lua_state, sitem.sValue.c_str());
-		lua_rawset(lua_state, -3);
-	}
-	lua_setglobal(lua_state, "otherdevices_svalues");
-
-	lua_createtable(lua_state, (int)m_uservariables.size(), 0);
-
-	typedef std::map<unsigned long long, _tUserVariable>::iterator it_var;
-	for (it_var iterator = m_uservariables.begin(); iterator != m_uservariables.end(); iterator++) {
-		_tUserVariable uvitem = iterator->second;
-		if (uvitem.variableType == 0)  {
-			lua_pushstring(lua_state, uvitem.variableName.c_str());
-			lua_pushnumber(lua_state, atoi(uvitem.variableValue.c_str()));
-			lua_rawset(lua_state, -3);
-		}
-		else if (uvitem.variableType == 1)  {
-			lua_pushstring(lua_state, uvitem.variableName.c_str());
-			lua_pushnumber(lua_state, atof(uvitem.variableValue.c_str()));
-			lua_rawset(lua_state, -3);
-		}
-		else {
-			lua_pushstring(lua_state, uvitem.variableName.c_str());
-			lua_pushstring(lua_state, uvitem.variableValue.c_str());
+			lua_pushnumber(lua_state, (lua_Number)itt->second);
 			lua_rawset(lua_state, -3);
 		}
+		lua_setfield(lua_state, 1, "devicechanged");
 	}
-	lua_setglobal(lua_state, "uservariables");
-
-	lua_createtable(lua_state, (int)m_uservariables.size(), 0);
-
-	typedef std::map<unsigned long long, _tUserVariable>::iterator it_var;
-	for (it_var iterator = m_uservariables.begin(); iterator != m_uservariables.end(); iterator++) {
-		_tUserVariable uvitem = iterator->second;
-		lua_pushstring(lua_state, uvitem.variableName.c_str());
-		lua_pushstring(lua_state, uvitem.lastUpdate.c_str());
-		lua_rawset(lua_state, -3);
-	}
-	lua_setglobal(lua_state, "uservariables_lastupdate");
 
 	if (reason == "uservariable") {
 		if (varId > 0) {
-			typedef std::map<unsigned long long, _tUserVariable>::iterator it_cvar;
-			for (it_cvar iterator = m_uservariables.begin(); iterator != m_uservariables.end(); iterator++) {
-				_tUserVariable uvitem = iterator->second;
-				if (uvitem.ID == varId) {
-					lua_createtable(lua_state, 1, 0);
-					lua_pushstring(lua_state, uvitem.variableName.c_str());
-					lua_pushstring(lua_state, uvitem.variableValue.c_str());
-					lua_rawset(lua_state, -3);
-					lua_setglobal(lua_state, "uservariablechanged");
-				}
+			std::map<unsigned long long, _tUserVariable>::const_iterator itt = m_uservariables.find(varId);
+			if (itt != m_uservariables.end()) {
+				lua_createtable(lua_state, 1, 0);
+				lua_pushstring(lua_state, itt->second.variableName.c_str());
+				lua_pushstring(lua_state, itt->second.variableValue.c_str());
+				lua_rawset(lua_state, -3);
+				lua_setfield(lua_state, 1, "uservariablechanged");
 			}
 		}
 	}
@@ -1796,79 +2048,129 @@ void CEventSystem::EvaluateLua(const std::string &reason, const std::string &fil
 	lua_pushstring(lua_state, "Security");
 	lua_pushstring(lua_state, secstatusw.c_str());
 	lua_rawset(lua_state, -3);
-	lua_setglobal(lua_state, "globalvariables");
+	lua_setfield(lua_state, 1, "globalvariables");
 
-
-	int status = luaL_loadfile(lua_state, filename.c_str());
-
-	if (status == 0)
+	//load the script from its bytecode the first time this state runs it (or after it changed)
+	lua_getfield(lua_state, LUA_REGISTRYINDEX, "domoticzscripts");
+	std::pair<time_t, off_t> scriptversion(itScript->second.mtime, itScript->second.size);
+	std::map<std::string, std::pair<time_t, off_t> >::iterator itLoaded = item->loadedscripts.find(filename);
+	if ((itLoaded != item->loadedscripts.end()) && (itLoaded->second == scriptversion))
 	{
-		lua_sethook(lua_state, luaStop, LUA_MASKCOUNT, 10000000);
-		//luaThread = boost::thread(&CEventSystem::luaThread, lua_state, filename);
-		//boost::shared_ptr<boost::thread> luaThread = boost::shared_ptr<boost::thread>(new boost::thread(boost::bind(&CEventSystem::luaThread, this, lua_state, filename)));
-		boost::thread luaThread(boost::bind(&CEventSystem::luaThread, this, lua_state, filename));
-		//m_thread = boost::shared_ptr<boost::thread>(new boost::thread(boost::bind(&CEventSystem::Do_Work, this)));
-		if (!luaThread.timed_join(boost::posix_time::seconds(10)))
-		{
-			_log.Log(LOG_ERROR, "Warning: lua script %s has been running for more than 10 seconds", filename.c_str());
-		}
-		else
-		{
-			//_log.Log(LOG_ERROR, "lua script completed");
-		}
-		
-		
+		lua_getfield(lua_state, 2, filename.c_str());
 	}
 	else
 	{
-		report_errors(lua_state, status);
-		lua_close(lua_state);
+		const std::string &bytecode = itScript->second.bytecode;
+		int status = luaL_loadbuffer(lua_state, bytecode.data(), bytecode.size(), filename.c_str());
+		if (status != 0)
+		{
+			report_errors(lua_state, status);
+			lua_settop(lua_state, 0);
+			ReleaseLuaState(item);
+			return;
+		}
+		lua_pushvalue(lua_state, -1);
+		lua_setfield(lua_state, 2, filename.c_str());
+		item->loadedscripts[filename] = scriptversion;
+	}
+	lua_remove(lua_state, 2);
+
+	//the main chunk has _ENV as its only upvalue
+	lua_pushvalue(lua_state, 1);
+	lua_setupvalue(lua_state, 2, 1);
+
+	lua_sethook(lua_state, luaStop, LUA_MASKCOUNT, 10000000);
+	boost::shared_ptr<_tLuaJob> job(new _tLuaJob);
+	job->item = item;
+	job->filename = filename;
+	job->bDone = false;
+	boost::unique_lock<boost::mutex> lj(m_luajobs_mutex);
+	if (m_luaworkers.empty())
+	{
+		//event system is not started (or stopping)
+		lj.unlock();
+		luaThread(item, filename);
+		UpdateEventStats(filename, "Lua", tstart);
+		return;
 	}
-
-	/*
-	if (status == 0)
+	m_luajobs.push_back(job);
+	m_luajobs_cond.notify_one();
+	boost::system_time timeout = boost::get_system_time() + boost::posix_time::seconds(LUA_RUN_TIMEOUT_SEC);
+	while (!job->bDone)
 	{
-		lua_sethook(lua_state, luaStop, LUA_MASKCOUNT, 10000000);
-		status = lua_pcall(lua_state, 0, LUA_MULTRET, 0);
-	}
-
-
-	report_errors(lua_state, status);
-
-	bool scriptTrue = false;
-	lua_getglobal(lua_state, "commandArray");
-	if (lua_istable(lua_state, -1))
-	{
-		int tIndex = lua_gettop(lua_state);
-		scriptTrue = iterateLuaTable(lua_state, tIndex, filename);
+		if (!m_luajobs_done_cond.timed_wait(lj, timeout))
+			break;
 	}
-	else
+	bool bDone = job->bDone;
+	lj.unlock();
+	if (!bDone)
 	{
-		if (status == 0)
-		{
-			_log.Log(LOG_ERROR, "Lua script did not return a commandArray");
-		}
+		//the state and the worker are released when the script finally returns
+		_log.Log(LOG_ERROR, "Warning: lua script %s has been running for more than %d seconds", filename.c_str(), LUA_RUN_TIMEOUT_SEC);
 	}
+	UpdateEventStats(filename, "Lua", tstart);
+}
 
-	if (scriptTrue)
-	{
-		_log.Log(LOG_STATUS, "Script event triggered: %s", filename.c_str());
-	}
+void CEventSystem::UpdateEventStats(const std::string &Name, const std::string &Type, const boost::posix_time::ptime &tstart)
+{
+	long usec = (long)(boost::posix_time::microsec_clock::universal_time() - tstart).total_microseconds();
+
+	boost::lock_guard<boost::mutex> l(m_eventstats_mutex);
+	std::map<std::string, _tEventStats>::iterator itt = m_eventstats.find(Name);
+	if (itt == m_eventstats.end())
+	{
+		_tEventStats estats;
+		estats.Name = Name;
+		estats.Type = Type;
+		estats.Count = 0;
+		estats.Skipped = 0;
+		estats.TotalTime = 0;
+		estats.MaxTime = 0;
+		itt = m_eventstats.insert(std::make_pair(Name, estats)).first;
+	}
+	itt->second.Count++;
+	itt->second.TotalTime += usec;
+	if (usec > itt->second.MaxTime)
+		itt->second.MaxTime = usec;
+}
 
-	lua_close(lua_state);
-	*/
+void CEventSystem::UpdateEventStatsSkipped(const std::string &Name)
+{
+	boost::lock_guard<boost::mutex> l(m_eventstats_mutex);
+	std::map<std::string, _tEventStats>::iterator itt = m_eventstats.find(Name);
+	if (itt == m_eventstats.end())
+	{
+		_tEventStats estats;
+		estats.Name = Name;
+		estats.Type = "Lua";
+		estats.Count = 0;
+		estats.Skipped = 0;
+		estats.TotalTime = 0;
+		estats.MaxTime = 0;
+		itt = m_eventstats.insert(std::make_pair(Name, estats)).first;
+	}
+	itt->second.Skipped++;
+}
 
+void CEventSystem::GetEventStats(std::vector<_tEventStats> &stats)
+{
+	boost::lock_guard<boost::mutex> l(m_eventstats_mutex);
+	stats.clear();
+	std::map<std::string, _tEventStats>::const_iterator itt;
+	for (itt = m_eventstats.begin(); itt != m_eventstats.end(); ++itt)
+		stats.push_back(itt->second);
 }
 
-void CEventSystem::luaThread(lua_State *lua_state, const std::string &filename)
+void CEventSystem::luaThread(_tLuaStateItem *item, const std::string &filename)
 {
+	lua_State *lua_state = item->lua_state;
 	int status;
-	
-	status = lua_pcall(lua_state, 0, LUA_MULTRET, 0);
+
+	status = lua_pcall(lua_state, 0, 0, 0);
 	report_errors(lua_state, status);
 
 	bool scriptTrue = false;
-	lua_getglobal(lua_state, "commandArray");
+	lua_getfield(lua_state, 1, "commandArray");
 	if (lua_istable(lua_state, -1))
 	{
 		int tIndex = lua_gettop(lua_state);
@@ -1887,8 +2189,9 @@ void CEventSystem::luaThread(lua_State *lua_state, const std::string &filename)
 		_log.Log(LOG_STATUS, "Script event triggered: %s", filename.c_str());
 	}
 
-	lua_close(lua_state);
-
+	lua_sethook(lua_state, NULL, 0, 0);
+	lua_settop(lua_state, 0);
+	ReleaseLuaState(item);
 }
 
 
@@ -1899,7 +2202,6 @@ void CEventSystem::luaStop(lua_State *L, lua_Debug *ar)
 		(void)ar;  /* unused arg. */
 		lua_sethook(L, NULL, 0, 0);
 		luaL_error(L, "Lua script execution exceeds maximum number of lines");
-		lua_close(L);
 	}
 }
 
@@ -2044,6 +2346,7 @@ void CEventSystem::UpdateDevice(const std::string &DevParams)
 
 		szQuery.clear();
 		szQuery.str("");
+		m_sql.FlushWriteQueue(strtoull(idx.c_str(),NULL,10));
 		szQuery << "UPDATE DeviceStatus SET nValue=" << nvalue << ", sValue='" << svalue << "', LastUpdate='" << szLastUpdate << "' WHERE (ID = " << idx << ")";
 		result = m_sql.query(szQuery.str());
 	}
@@ -2,6 +2,9 @@
 
 #include <string>
 #include <vector>
+#include <set>
+#include <list>
+#include <deque>
 
 extern "C" {
 #include "../lua/src/lua.h"    
@@ -37,6 +40,7 @@ public:
 		std::string lastUpdate;
 		unsigned char lastLevel;
 		unsigned char switchtype;
+		unsigned long long version;
 	};
 	std::map<unsigned long long, _tDeviceStatus> m_devicestates;
 
@@ -47,9 +51,32 @@ public:
 		std::string variableValue;
 		int variableType;
 		std::string lastUpdate;
+		unsigned long long version;
 	};
 	std::map<unsigned long long, _tUserVariable> m_uservariables;
 
+	struct _tEventStats
+	{
+		std::string Name;	//script filename or blockly event name
+		std::string Type;
+		unsigned long long Count;
+		unsigned long long Skipped;	//not run because the changed device/variable is not referenced
+		long long TotalTime;	//us
+		long MaxTime;
+	};
+
+	struct _tEventQueueStats
+	{
+		int QueueSize;
+		int MaxQueueSize;
+		unsigned long long TotalQueued;
+		unsigned long long TotalCoalesced;	//pending events replaced by a newer one while overloaded
+		unsigned long long TotalDropped;
+		long OldestAge;		//ms the first pending event is waiting
+		long AvgQueueAge;	//ms from queueing until evaluation
+		long MaxQueueAge;
+	};
+
 	CEventSystem(void);
 	~CEventSystem(void);
 
@@ -58,11 +85,13 @@ public:
 
 	void LoadEvents();
 	void ProcessUserVariable(const unsigned long long varId);
-	void ProcessDevice(const int HardwareID, const unsigned long long ulDevID, const unsigned char unit, const unsigned char devType, const unsigned char subType, const unsigned char signallevel, const unsigned char batterylevel, const int nValue, const char* sValue, const std::string &devname, const int varId);
+	void ProcessDevice(const int HardwareID, const unsigned long long ulDevID, const unsigned char unit, const unsigned char devType, const unsigned char subType, const unsigned char signallevel, const unsigned char batterylevel, const int nValue, const char* sValue, const std::string &devname, const _eSwitchType switchType, const std::string &lastUpdate, const unsigned char lastLevel, const int varId);
 	void RemoveSingleState(int ulDevID);
 	void WWWUpdateSingleState(const unsigned long long ulDevID, const std::string &devname);
 	void WWWUpdateSecurityState(int securityStatus);
 	void WWWGetItemStates(std::vector<_tDeviceStatus> &iStates);
+	void GetEventStats(std::vector<_tEventStats> &stats);
+	void GetEventQueueStats(_tEventQueueStats &stats);
 	void SetEnabled(const bool bEnabled) { m_bEnabled = bEnabled; };
 private:
 	//lua_State	*m_pLUA;
@@ -74,10 +103,96 @@ private:
 	unsigned char m_secondcounter;
 	int m_SecStatus;
 
+	//compiled scripts/lua files, keyed by full path
+	struct _tLuaScript
+	{
+		std::string name;
+		time_t mtime;
+		off_t size;
+		std::string bytecode;
+		bool bAllTriggers;	//could not determine which devices/variables the script uses
+		std::set<std::string> triggers;
+	};
+	std::map<std::string, _tLuaScript> m_luascripts;
+	bool m_bLuaDirError;
+
+	//long-lived lua states, tables are updated in place using the versions below
+	struct _tLuaStateItem
+	{
+		lua_State *lua_state;
+		bool bBlockly;
+		bool bInUse;
+		unsigned long long devicesversion;
+		unsigned long long uservariablesversion;
+		std::map<std::string, std::pair<time_t, off_t> > loadedscripts;	//mtime/size of the compiled script that was loaded
+	};
+	boost::mutex m_luastates_mutex;
+	std::vector<_tLuaStateItem*> m_luastates;
+	_tLuaStateItem *m_pBlocklyState;
+
+	//scripts run on a fixed pool of worker threads. A script that is still running after its
+	//timeout keeps its state and worker, no more than LUA_MAX_STATES states are created
+	struct _tLuaJob
+	{
+		_tLuaStateItem *item;
+		std::string filename;
+		bool bDone;
+	};
+	boost::mutex m_luajobs_mutex;
+	boost::condition_variable m_luajobs_cond;
+	boost::condition_variable m_luajobs_done_cond;
+	std::deque<boost::shared_ptr<_tLuaJob> > m_luajobs;
+	std::vector<boost::shared_ptr<boost::thread> > m_luaworkers;
+	int m_luaworkers_generation;	//workers of an older generation (left behind by a stop) exit when they are done
+
+	unsigned long long m_devicestates_version;
+	unsigned long long m_devicestates_resetversion;
+	unsigned long long m_uservariables_version;
+	unsigned long long m_uservariables_resetversion;
+	unsigned long long m_measurements_version;
+
+	//indexes into m_events, built by LoadEvents
+	std::map<unsigned long long, std::vector<size_t> > m_blocklydevicerules;
+	std::map<unsigned long long, std::vector<size_t> > m_blocklyvariablerules;
+	std::vector<size_t> m_blocklysecurityrules;
+	std::vector<size_t> m_blocklytimerules;
+
+	boost::mutex m_eventstats_mutex;
+	std::map<std::string, _tEventStats> m_eventstats;
+
+	//events are evaluated on their own thread, in the order they were queued
+	struct _tEventQueueItem
+	{
+		std::string reason;
+		unsigned long long DeviceID;
+		std::string devname;
+		int nValue;
+		std::string sValue;
+		unsigned char devType;
+		unsigned char subType;
+		_eSwitchType switchType;
+		std::string lastUpdate;
+		unsigned char lastLevel;
+		unsigned long long varId;
+		boost::posix_time::ptime QueueTime;
+	};
+	boost::mutex m_eventqueue_mutex;
+	boost::condition_variable m_eventqueue_cond;
+	std::list<_tEventQueueItem> m_eventqueue;
+	std::map<std::pair<std::string, unsigned long long>, std::list<_tEventQueueItem>::iterator> m_eventqueue_pending;
+	boost::shared_ptr<boost::thread> m_eventqueue_thread;
+	volatile bool m_eventqueue_stoprequested;
+	bool m_bEventQueueOverloaded;
+	_tEventQueueStats m_eventqueue_stats;
+	unsigned long long m_eventqueue_processed;
+	long long m_eventqueue_age_total;
 
 	//our thread
 	void Do_Work();
 	void ProcessMinute();
+	void Do_EventQueue_Work();
+	void QueueEvent(_tEventQueueItem &item);
+	void ProcessEventQueueItem(const _tEventQueueItem &item);
 	void GetCurrentStates();
 	void GetCurrentMeasurementStates();
 	void GetCurrentUserVariables();
@@ -90,7 +205,19 @@ private:
 	void EvaluateLua(const std::string &reason, const std::string &filename, const unsigned long long varId);
 	void EvaluateLua(const std::string &reason, const std::string &filename);
 	void EvaluateLua(const std::string &reason, const std::string &filename, const unsigned long long DeviceID, const std::string &devname, const int nValue, const char* sValue, std::string nValueWording, const unsigned long long varId);
-	void luaThread(lua_State *lua_state, const std::string &filename);
+	void luaThread(_tLuaStateItem *item, const std::string &filename);
+	void StartLuaWorkers();
+	void StopLuaWorkers();
+	void Do_LuaWorker(const int generation);
+	void ScanLuaScripts();
+	bool CompileLuaScript(const std::string &filename, std::string &bytecode);
+	lua_State *CreateLuaState();
+	_tLuaStateItem *GetLuaState();
+	void ReleaseLuaState(_tLuaStateItem *item);
+	void SyncLuaTables(_tLuaStateItem *item);
+	int RunBlocklyCondition(lua_State *lua_state, const std::string &ifCondition);
+	void UpdateEventStats(const std::string &Name, const std::string &Type, const boost::posix_time::ptime &tstart);
+	void UpdateEventStatsSkipped(const std::string &Name);
 	static void luaStop(lua_State *L, lua_Debug *ar);
 	std::string nValueToWording(const unsigned char dType, const unsigned char dSubType, const _eSwitchType switchtype, const unsigned char nValue, const std::string &sValue);
 	static int l_domoticz_print(lua_State* lua_state);
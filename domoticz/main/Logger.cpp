@@ -25,7 +25,6 @@ CLogger::_tLogLineStruct::_tLogLineStruct(const _eLogLevel nlevel, const std::st
 
 CLogger::CLogger(void)
 {
-	m_bInSequenceMode=false;
 	m_verbose_level=VBL_ALL;
 }
 
@@ -201,27 +200,33 @@ void CLogger::LogNoLF(const _eLogLevel level, const char* logline, ...)
 
 void CLogger::LogSequenceStart()
 {
-	m_bInSequenceMode=true;
-	m_sequencestring.clear();
-	m_sequencestring.str("");
+	if (m_sequencestring.get()==NULL)
+		m_sequencestring.reset(new std::stringstream);
+	m_sequencestring->clear();
+	m_sequencestring->str("");
 }
 
 void CLogger::LogSequenceEnd(const _eLogLevel level)
 {
-	m_bInSequenceMode=false;
-	LogNoLF(level,m_sequencestring.str().c_str());
-	m_sequencestring.clear();
-	m_sequencestring.str("");
+	if (m_sequencestring.get()==NULL)
+		return;
+	LogNoLF(level,m_sequencestring->str().c_str());
+	m_sequencestring->clear();
+	m_sequencestring->str("");
 }
 
 void CLogger::LogSequenceAdd(const char* logline)
 {
-	m_sequencestring << logline << std::endl;
+	if (m_sequencestring.get()==NULL)
+		m_sequencestring.reset(new std::stringstream);
+	*m_sequencestring << logline << std::endl;
 }
 
 void CLogger::LogSequenceAddNoLF(const char* logline)
 {
-	m_sequencestring << logline;
+	if (m_sequencestring.get()==NULL)
+		m_sequencestring.reset(new std::stringstream);
+	*m_sequencestring << logline;
 }
 
 std::list<CLogger::_tLogLineStruct> CLogger::GetLog()
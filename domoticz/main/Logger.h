@@ -49,8 +49,8 @@ private:
 	boost::mutex m_mutex;
 	std::ofstream m_outputfile;
 	std::deque<_tLogLineStruct> m_lastlog;
-	bool m_bInSequenceMode;
-	std::stringstream m_sequencestring;
+	//one sequence per thread, hardware is decoded in parallel
+	boost::thread_specific_ptr<std::stringstream> m_sequencestring;
 	_eLogFileVerboseLevel m_verbose_level;
 };
 extern CLogger _log;
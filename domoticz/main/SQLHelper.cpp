@@ -1,5 +1,6 @@
 #include "stdafx.h"
 #include "SQLHelper.h"
+#include <boost/bind.hpp>
 #include <iostream>     /* standard I/O functions                         */
 #include "RFXtrx.h"
 #include "Helper.h"
@@ -14,7 +15,11 @@
 #include "../smtpclient/SMTPClient.h"
 #include "../webserver/Base64.h"
 #include "mainstructs.h"
+#include "TimeSeriesStore.h"
+#include "../zlib/zlib.h"
 #include <boost/lexical_cast.hpp>
+#include <algorithm>
+#include <limits.h>
 
 #ifndef WIN32
 	#include <sys/stat.h>
@@ -23,7 +28,55 @@
 	#include <pwd.h>
 #endif
 
-#define DB_VERSION 52 //Add support for evohome setpoint to logging
+#define DB_VERSION 54 //Make the Preferences key unique
+
+#define MAX_CACHED_STATEMENTS 128
+#define MAX_WRITE_QUEUE_SIZE 2000
+#define WRITE_QUEUE_LOW_WATER 1000	//a caller waiting on a full queue continues below this
+//threads executing scripts, emails and camera snapshots
+#define TASK_SLOW_WORKERS 2
+
+//Log retention, old rows are deleted in small batches so the database is never locked for long
+#define RETENTION_BATCH_SIZE 1000
+#define RETENTION_BATCH_PAUSE_MS 50
+#define RETENTION_TIME_BUDGET_MS 2000
+#define RETENTION_CONTINUE_DELAY 60
+
+//With the time series store enabled, the 5 minute log tables only keep the days needed
+//for the calendar jobs and the "today" values, the graphs read the history from the store
+#define TSDB_SQLITE_HISTORY_DAYS 2
+#define TSDB_SYNC_BATCH_SIZE 5000
+
+//Online backup, pages copied per step while holding the database, and the default pause between steps
+#define BACKUP_STEP_PAGES 128
+#define BACKUP_STEP_DELAY_MS 10
+#define BACKUP_GZIP_CHUNK_SIZE 65536
+
+//Takes m_sqlQueryMutex and counts per thread how often it is held, so code that
+//would wait for the writer thread (which needs the mutex) can tell it must not
+class CSQLQueryLock
+{
+public:
+	explicit CSQLQueryLock(boost::recursive_mutex &mutex) :
+		m_lock(mutex)
+	{
+		if (m_depth.get()==NULL)
+			m_depth.reset(new int(0));
+		(*m_depth)++;
+	}
+	~CSQLQueryLock()
+	{
+		(*m_depth)--;
+	}
+	static bool IsHeld()
+	{
+		return ((m_depth.get()!=NULL)&&(*m_depth>0));
+	}
+private:
+	boost::lock_guard<boost::recursive_mutex> m_lock;
+	static boost::thread_specific_ptr<int> m_depth;
+};
+boost::thread_specific_ptr<int> CSQLQueryLock::m_depth;
 
 const char *sqlCreateDeviceStatus =
 "CREATE TABLE IF NOT EXISTS [DeviceStatus] ("
@@ -53,6 +106,60 @@ const char *sqlCreateDeviceStatus =
 "[Protected] INTEGER DEFAULT 0, "
 "[CustomImage] INTEGER DEFAULT 0);";
 
+const char *sqlCreateDeviceStatusIndex =
+"CREATE INDEX IF NOT EXISTS [DeviceStatus_Key_Idx] ON [DeviceStatus] ([HardwareID], [DeviceID], [Unit], [Type], [SubType]);";
+
+//Preferences are written with INSERT OR REPLACE, older databases can hold a key more than once
+const char *sqlRemoveDuplicatePreferences =
+"DELETE FROM Preferences WHERE ROWID NOT IN (SELECT MAX(ROWID) FROM Preferences GROUP BY Key);";
+
+const char *sqlCreatePreferencesIndex =
+"CREATE UNIQUE INDEX IF NOT EXISTS [Preferences_Key_Idx] ON [Preferences] ([Key]);";
+
+//Tables holding the history of a device, these are all queried on DeviceRowID/Date
+const char *szLogTables[] =
+{
+	"LightingLog",
+	"Rain",
+	"Rain_Calendar",
+	"Temperature",
+	"Temperature_Calendar",
+	"UV",
+	"UV_Calendar",
+	"Wind",
+	"Wind_Calendar",
+	"Meter",
+	"Meter_Calendar",
+	"MultiMeter",
+	"MultiMeter_Calendar",
+	"Percentage",
+	"Percentage_Calendar",
+	"Fan",
+	"Fan_Calendar",
+	NULL
+};
+
+//5 minute log tables that are kept in the time series store, with their columns in store order (F=real, I=integer)
+struct _tTSDBTable
+{
+	const char *szTable;
+	const char *szColumns;
+	const char *szTypes;
+};
+
+const _tTSDBTable tsdbTables[] =
+{
+	{ "Temperature", "Temperature,Chill,Humidity,Barometer,DewPoint,SetPoint", "FFIIFF" },
+	{ "Rain", "Total,Rate", "FI" },
+	{ "Wind", "Direction,Speed,Gust", "FII" },
+	{ "UV", "Level", "F" },
+	{ "Meter", "Value,Usage", "II" },
+	{ "MultiMeter", "Value1,Value2,Value3,Value4,Value5,Value6", "IIIIII" },
+	{ "Percentage", "Percentage", "F" },
+	{ "Fan", "Speed", "I" },
+	{ NULL, NULL, NULL }
+};
+
 const char *sqlCreateDeviceStatusTrigger =
 "CREATE TRIGGER IF NOT EXISTS devicestatusupdate AFTER INSERT ON DeviceStatus\n"
 "BEGIN\n"
@@ -492,7 +599,17 @@ CSQLHelper::CSQLHelper(void)
 	m_LastSwitchID="";
 	m_LastSwitchRowID=0;
 	m_dbase=NULL;
+	m_bDeviceValueUpdate=false;
+	m_device_registry_generation=0;
+	m_logdata_version=0;
+	m_bTSDBEnabled=false;
+	m_bTSDBReady=false;
+	//Start the sequence at the startup time, so sequence numbers of a previous run are detected as stale
+	m_change_journal_base=(unsigned long long)mytime(NULL)*1000;
+	m_change_journal_seq=m_change_journal_base;
+	m_change_journal.resize(CHANGE_JOURNAL_SIZE);
 	m_stoprequested=false;
+	m_bIncrementalVacuum=false;
 	m_sensortimeoutcounter=0;
 	m_bAcceptNewHardware=true;
 	m_bAllowWidgetOrdering=true;
@@ -502,6 +619,28 @@ CSQLHelper::CSQLHelper(void)
 	SetUnitsAndScale();
 	m_bAcceptHardwareTimerActive=false;
 	m_iAcceptHardwareTimerCounter=0;
+	m_write_mode=DBWRITE_BATCHED;
+	m_write_interval=250;
+	memset(&m_write_stats,0,sizeof(m_write_stats));
+	m_write_latency_total=0;
+	m_write_full_logged=0;
+	m_bAbortBackup=false;
+	m_backup_users=0;
+	m_backup_status.bActive=false;
+	m_backup_status.PageCount=0;
+	m_backup_status.PagesRemaining=0;
+	m_backup_status.StartTime=0;
+	m_backup_status.EndTime=0;
+	m_backup_status.bLastResult=false;
+
+	SubscribePreferencesVar("WindUnit", boost::bind(&CSQLHelper::OnPreferencesVarChanged, this, _1, _2, _3));
+	SubscribePreferencesVar("TempUnit", boost::bind(&CSQLHelper::OnPreferencesVarChanged, this, _1, _2, _3));
+	SubscribePreferencesVar("AllowWidgetOrdering", boost::bind(&CSQLHelper::OnPreferencesVarChanged, this, _1, _2, _3));
+	SubscribePreferencesVar("ActiveTimerPlan", boost::bind(&CSQLHelper::OnPreferencesVarChanged, this, _1, _2, _3));
+	SubscribePreferencesVar("DisableEventScriptSystem", boost::bind(&CSQLHelper::OnPreferencesVarChanged, this, _1, _2, _3));
+	SubscribePreferencesVar("DBWriteMode", boost::bind(&CSQLHelper::OnPreferencesVarChanged, this, _1, _2, _3));
+	SubscribePreferencesVar("DBWriteInterval", boost::bind(&CSQLHelper::OnPreferencesVarChanged, this, _1, _2, _3));
+	SubscribePreferencesVar("EnableTimeSeriesStore", boost::bind(&CSQLHelper::OnPreferencesVarChanged, this, _1, _2, _3));
 
 	SetDatabaseName("domoticz.db");
 }
@@ -510,16 +649,104 @@ CSQLHelper::~CSQLHelper(void)
 {
 	if (m_background_task_thread)
 	{
-		m_stoprequested = true;
+		{
+			boost::lock_guard<boost::mutex> l(m_background_task_mutex);
+			m_stoprequested = true;
+		}
+		m_background_task_cond.notify_all();
 		m_background_task_thread->join();
 	}
+	if (!m_task_workers.empty())
+	{
+		{
+			boost::lock_guard<boost::mutex> l(m_task_worker_mutex);
+			m_stoprequested = true;
+		}
+		m_task_worker_cond.notify_all();
+		std::vector<boost::shared_ptr<boost::thread> >::iterator itt;
+		for (itt=m_task_workers.begin(); itt!=m_task_workers.end(); ++itt)
+			(*itt)->join();
+		m_task_workers.clear();
+	}
+	if (m_write_thread)
+	{
+		{
+			boost::lock_guard<boost::mutex> l(m_write_queue_mutex);
+			m_stoprequested = true;
+		}
+		m_write_queue_cond.notify_all();
+		m_write_queue_space_cond.notify_all();
+		m_write_thread->join();
+	}
 	if (m_dbase!=NULL)
 	{
+		ClearStatementCache();
 		sqlite3_close(m_dbase);
 		m_dbase=NULL;
 	}
 }
 
+//SVALUE(sValue,n), field n of a ';' separated sValue (split as StringSplit does), NULL when not present
+static void sqlite_svalue(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+	const char *szValue=(const char*)sqlite3_value_text(argv[0]);
+	int nField=sqlite3_value_int(argv[1]);
+	if ((szValue==NULL)||(nField<0))
+	{
+		sqlite3_result_null(context);
+		return;
+	}
+	const char *pStart=szValue;
+	for (;;)
+	{
+		const char *pEnd=strchr(pStart,';');
+		size_t len=(pEnd!=NULL)?(size_t)(pEnd-pStart):strlen(pStart);
+		if (len>0)
+		{
+			if (nField==0)
+			{
+				sqlite3_result_text(context, pStart, (int)len, SQLITE_TRANSIENT);
+				return;
+			}
+			nField--;
+		}
+		if (pEnd==NULL)
+			break;
+		pStart=pEnd+1;
+	}
+	sqlite3_result_null(context);
+}
+
+//SVALUE_COUNT(sValue), number of fields in a ';' separated sValue
+static void sqlite_svalue_count(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+	const char *szValue=(const char*)sqlite3_value_text(argv[0]);
+	int nFields=0;
+	if (szValue!=NULL)
+	{
+		const char *pStart=szValue;
+		for (;;)
+		{
+			const char *pEnd=strchr(pStart,';');
+			size_t len=(pEnd!=NULL)?(size_t)(pEnd-pStart):strlen(pStart);
+			if (len>0)
+				nFields++;
+			if (pEnd==NULL)
+				break;
+			pStart=pEnd+1;
+		}
+	}
+	sqlite3_result_int(context, nFields);
+}
+
+//DEWPOINT(temp,humidity)
+static void sqlite_dewpoint(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+	double temp=sqlite3_value_double(argv[0]);
+	unsigned char humidity=(unsigned char)sqlite3_value_int(argv[1]);
+	sqlite3_result_double(context, CalculateDewPoint(temp,humidity));
+}
+
 bool CSQLHelper::OpenDatabase()
 {
 	//Open Database
@@ -538,12 +765,21 @@ bool CSQLHelper::OpenDatabase()
 	rc=sqlite3_exec(m_dbase, "PRAGMA journal_mode=DELETE", NULL, NULL, NULL);
 #endif
     rc=sqlite3_exec(m_dbase, "PRAGMA foreign_keys = ON;", NULL, NULL, NULL);
+	sqlite3_update_hook(m_dbase, DeviceStatusHook, this);
+	//only when the database was created with auto_vacuum=INCREMENTAL the log cleanup can free pages
+	std::vector<std::vector<std::string> > resultvac=query("PRAGMA auto_vacuum;");
+	m_bIncrementalVacuum=((!resultvac.empty())&&(atoi(resultvac[0][0].c_str())==2));
+	//Helpers for the set based log/calendar jobs
+	sqlite3_create_function(m_dbase, "SVALUE", 2, SQLITE_UTF8, NULL, sqlite_svalue, NULL, NULL);
+	sqlite3_create_function(m_dbase, "SVALUE_COUNT", 1, SQLITE_UTF8, NULL, sqlite_svalue_count, NULL, NULL);
+	sqlite3_create_function(m_dbase, "DEWPOINT", 2, SQLITE_UTF8, NULL, sqlite_dewpoint, NULL, NULL);
 	bool bNewInstall=false;
 	std::vector<std::vector<std::string> > result=query("SELECT name FROM sqlite_master WHERE type='table' AND name='DeviceStatus'");
 	bNewInstall=(result.size()==0);
 	int dbversion=0;
 	if (!bNewInstall)
 	{
+		LoadPreferences();
 		GetPreferencesVar("DB_Version", dbversion);
 		//Pre-SQL Patches
 	}
@@ -1002,11 +1238,24 @@ bool CSQLHelper::OpenDatabase()
 			query("ALTER TABLE Temperature_Calendar ADD COLUMN [SetPoint_Max] FLOAT default 0");
 			query("ALTER TABLE Temperature_Calendar ADD COLUMN [SetPoint_Avg] FLOAT default 0");
 		}
+		if (dbversion < 53)
+		{
+			_log.Log(LOG_STATUS,"Creating database indexes, this could take a while on large databases...");
+			CreateIndexes();
+			//let the query planner know about them
+			query("ANALYZE");
+		}
+		if (dbversion < 54)
+		{
+			query(sqlRemoveDuplicatePreferences);
+			query(sqlCreatePreferencesIndex);
+		}
 	}
 	else if (bNewInstall)
 	{
 		//place here actions that needs to be performed on new databases
 		query("INSERT INTO Plans (Name) VALUES ('$Hidden Devices')");
+		CreateIndexes();
 	}
 	UpdatePreferencesVar("DB_Version",DB_VERSION);
 
@@ -1303,6 +1552,36 @@ bool CSQLHelper::OpenDatabase()
 	{
 		UpdatePreferencesVar("FloorplanInactiveOpacity", 5);
 	}
+	if (!GetPreferencesVar("DBWriteMode", nValue))
+	{
+		UpdatePreferencesVar("DBWriteMode", (int)DBWRITE_BATCHED);
+		nValue=(int)DBWRITE_BATCHED;
+	}
+	m_write_mode=(_eDBWriteMode)nValue;
+	if (!GetPreferencesVar("DBWriteInterval", nValue))
+	{
+		UpdatePreferencesVar("DBWriteInterval", 250); //ms
+		nValue=250;
+	}
+	m_write_interval=nValue;
+	if (!GetPreferencesVar("EnableTimeSeriesStore", nValue))
+	{
+		UpdatePreferencesVar("EnableTimeSeriesStore", 0);
+		nValue=0;
+	}
+	if ((nValue==1)&&(OpenTimeSeriesStore()))
+		SyncTimeSeriesStore();
+	if (!GetPreferencesVar("BackupStepDelay", nValue))
+	{
+		UpdatePreferencesVar("BackupStepDelay", BACKUP_STEP_DELAY_MS); //ms
+	}
+	if (!GetPreferencesVar("BackupCompress", nValue))
+	{
+		UpdatePreferencesVar("BackupCompress", 0);
+	}
+
+	LoadDeviceRegistry();
+	CheckQueryPlans();
 
 	//Start background thread
 	if (!StartThread())
@@ -1310,11 +1589,80 @@ bool CSQLHelper::OpenDatabase()
 	return true;
 }
 
+void CSQLHelper::CreateIndexes()
+{
+	query(sqlCreateDeviceStatusIndex);
+	query(sqlRemoveDuplicatePreferences);
+	query(sqlCreatePreferencesIndex);
+	char szTmp[200];
+	for (int ii=0; szLogTables[ii]!=NULL; ii++)
+	{
+		sprintf(szTmp,"CREATE INDEX IF NOT EXISTS [%s_Idx] ON [%s] ([DeviceRowID], [Date]);",szLogTables[ii],szLogTables[ii]);
+		query(szTmp);
+	}
+}
+
+//Runs the lookups done for every sensor update and graph request, and reports the ones
+//that can not use an index (for example because an index got dropped)
+void CSQLHelper::CheckQueryPlans()
+{
+	std::vector<std::string> queries;
+	queries.push_back("SELECT ID FROM DeviceStatus WHERE (HardwareID=-1 AND DeviceID='' AND Unit=0 AND Type=0 AND SubType=0)");
+	char szTmp[200];
+	for (int ii=0; szLogTables[ii]!=NULL; ii++)
+	{
+		sprintf(szTmp,"SELECT Date FROM %s WHERE (DeviceRowID==-1) ORDER BY Date ASC",szLogTables[ii]);
+		queries.push_back(szTmp);
+	}
+
+	int nRegressions=0;
+	boost::posix_time::ptime tstart=boost::posix_time::microsec_clock::universal_time();
+	std::vector<std::string>::const_iterator itt;
+	for (itt=queries.begin(); itt!=queries.end(); ++itt)
+	{
+		std::vector<std::vector<std::string> > result=query("EXPLAIN QUERY PLAN " + *itt);
+		bool bRegression=false;
+		std::vector<std::vector<std::string> >::const_iterator itt2;
+		for (itt2=result.begin(); itt2!=result.end(); ++itt2)
+		{
+			//last column is the description of the step
+			std::string detail=(*itt2)[itt2->size()-1];
+			if (
+				((detail.find("SCAN")!=std::string::npos)&&(detail.find("INDEX")==std::string::npos))||
+				(detail.find("TEMP B-TREE")!=std::string::npos)
+				)
+			{
+				_log.Log(LOG_ERROR,"Query plan: %s (%s)",detail.c_str(),itt->c_str());
+				bRegression=true;
+			}
+		}
+		if (bRegression)
+			nRegressions++;
+
+		//time the lookup itself, without an index this is a full table scan
+		boost::posix_time::ptime qstart=boost::posix_time::microsec_clock::universal_time();
+		query(*itt);
+		long qms=(long)(boost::posix_time::microsec_clock::universal_time()-qstart).total_milliseconds();
+		if (qms>100)
+			_log.Log(LOG_ERROR,"Query plan: lookup took %ld ms (%s)",qms,itt->c_str());
+	}
+	long tms=(long)(boost::posix_time::microsec_clock::universal_time()-tstart).total_milliseconds();
+	_log.Log(LOG_STATUS,"Query plan check: %d queries, %d without index (%ld ms)",(int)queries.size(),nRegressions,tms);
+}
+
 bool CSQLHelper::StartThread()
 {
 	m_background_task_thread = boost::shared_ptr<boost::thread>(new boost::thread(boost::bind(&CSQLHelper::Do_Work, this)));
+	if (m_task_workers.empty())
+	{
+		m_task_workers.push_back(boost::shared_ptr<boost::thread>(new boost::thread(boost::bind(&CSQLHelper::Do_TaskWorker, this, &m_device_tasks))));
+		for (int ii=0; ii<TASK_SLOW_WORKERS; ii++)
+			m_task_workers.push_back(boost::shared_ptr<boost::thread>(new boost::thread(boost::bind(&CSQLHelper::Do_TaskWorker, this, &m_slow_tasks))));
+	}
+	if (!m_write_thread)
+		m_write_thread = boost::shared_ptr<boost::thread>(new boost::thread(boost::bind(&CSQLHelper::Do_Write_Work, this)));
 
-	return (m_background_task_thread!=NULL);
+	return ((m_background_task_thread!=NULL)&&(m_write_thread!=NULL));
 }
 
 bool CSQLHelper::SwitchLightFromTasker(const std::string &idx, const std::string &switchcmd, const std::string &level, const std::string &hue)
@@ -1340,185 +1688,244 @@ bool CSQLHelper::SwitchLightFromTasker(unsigned long long idx, const std::string
 	return m_mainworker.SwitchLightInt(sd, switchcmd, level, hue, false);
 }
 
+static void GetURLResult(const std::string &url, const bool bSuccess, const std::string &response)
+{
+	if (!bSuccess)
+		_log.Log(LOG_ERROR,"Error opening url: %s",url.c_str());
+}
+
 void CSQLHelper::Do_Work()
 {
+	boost::chrono::steady_clock::time_point nextsecond=boost::chrono::steady_clock::now()+boost::chrono::seconds(1);
 	std::vector<_tTaskItem> _items2do;
 
 	while (!m_stoprequested)
 	{
-		//sleep 1 second
-		sleep_seconds(1);
-
-		if (m_bAcceptHardwareTimerActive)
+		boost::chrono::steady_clock::time_point now=boost::chrono::steady_clock::now();
+		if (now>=nextsecond)
 		{
-			m_iAcceptHardwareTimerCounter--;
-			if (m_iAcceptHardwareTimerCounter <= 0)
+			nextsecond+=boost::chrono::seconds(1);
+			if (nextsecond<=now)
+				nextsecond=now+boost::chrono::seconds(1);
+			if (m_bAcceptHardwareTimerActive)
 			{
-				m_bAcceptHardwareTimerActive = false;
-				m_bAcceptNewHardware = false;
-				UpdatePreferencesVar("AcceptNewHardware", 0);
-				_log.Log(LOG_STATUS, "Receiving of new sensors disabled!...");
+				m_iAcceptHardwareTimerCounter--;
+				if (m_iAcceptHardwareTimerCounter <= 0)
+				{
+					m_bAcceptHardwareTimerActive = false;
+					m_bAcceptNewHardware = false;
+					UpdatePreferencesVar("AcceptNewHardware", 0);
+					_log.Log(LOG_STATUS, "Receiving of new sensors disabled!...");
+				}
 			}
 		}
 
-		if (m_background_task_queue.size()>0)
+		_items2do.clear();
 		{
-			_items2do.clear();
-			boost::lock_guard<boost::mutex> l(m_background_task_mutex);
-
-			std::vector<_tTaskItem>::iterator itt=m_background_task_queue.begin();
-			while (itt!=m_background_task_queue.end())
+			boost::unique_lock<boost::mutex> l(m_background_task_mutex);
+			//sleep until the first task is due (or a new task is added), at most until the next second
+			boost::chrono::steady_clock::time_point wakeup=nextsecond;
+			if ((!m_background_task_queue.empty())&&(m_background_task_queue.begin()->first<wakeup))
+				wakeup=m_background_task_queue.begin()->first;
+			if ((wakeup>now)&&(!m_stoprequested))
+				m_background_task_cond.wait_until(l,wakeup);
+
+			now=boost::chrono::steady_clock::now();
+			while ((!m_background_task_queue.empty())&&(m_background_task_queue.begin()->first<=now))
 			{
-				itt->_DelayTime--;
-				if (itt->_DelayTime<=0)
+				TaskQueue::iterator itt=m_background_task_queue.begin();
+				if (itt->second._ItemType==TITEM_SWITCHCMD)
 				{
-					_items2do.push_back(*itt);
-					itt=m_background_task_queue.erase(itt);
+					_tTaskItemKey key;
+					key.idx=itt->second._idx;
+					key.HardwareID=itt->second._HardwareID;
+					key.nValue=itt->second._nValue;
+					m_background_task_index.erase(key);
 				}
-				else
-					++itt;
+				_items2do.push_back(itt->second);
+				m_background_task_queue.erase(itt);
 			}
 		}
-		if (_items2do.size()<1)
+		if (_items2do.empty())
 			continue;
 
-		std::vector<_tTaskItem>::iterator itt=_items2do.begin();
-		while (itt!=_items2do.end())
+		//hand them to the workers, so a slow task never delays the timers
 		{
-			if (itt->_ItemType == TITEM_SWITCHCMD)
+			boost::lock_guard<boost::mutex> l(m_task_worker_mutex);
+			std::vector<_tTaskItem>::const_iterator itt;
+			for (itt=_items2do.begin(); itt!=_items2do.end(); ++itt)
 			{
-				if (itt->_switchtype==STYPE_Motion)
-				{
-					std::string devname="";
-					switch (itt->_devType)
-					{
-					case pTypeLighting1:
-					case pTypeLighting2:
-					case pTypeLighting3:
-					case pTypeLighting5:
-					case pTypeLighting6:
-					case pTypeLimitlessLights:
-						SwitchLightFromTasker(itt->_idx, "Off", 0, -1);
-						break;
-					case pTypeSecurity1:
-						switch (itt->_subType)
-						{
-						case sTypeSecX10M:
-							SwitchLightFromTasker(itt->_idx, "No Motion", 0, -1);
-							break;
-						default:
-							//just update internally
-							UpdateValueInt(itt->_HardwareID, itt->_ID.c_str(), itt->_unit, itt->_devType, itt->_subType, itt->_signallevel, itt->_batterylevel, itt->_nValue, itt->_sValue.c_str(),devname,true);
-							break;
-						}
-						break;
-					case pTypeLighting4:
-						//only update internally
-						UpdateValueInt(itt->_HardwareID, itt->_ID.c_str(), itt->_unit, itt->_devType, itt->_subType, itt->_signallevel, itt->_batterylevel, itt->_nValue, itt->_sValue.c_str(),devname,true);
-						break;
-					default:
-						//unknown hardware type, sensor will only be updated internally
-						UpdateValueInt(itt->_HardwareID, itt->_ID.c_str(), itt->_unit, itt->_devType, itt->_subType, itt->_signallevel, itt->_batterylevel, itt->_nValue, itt->_sValue.c_str(),devname,true);
-						break;
-					}
-				}
-				else
+				switch (itt->_ItemType)
 				{
-					if (itt->_devType==pTypeLighting4)
-					{
-						//only update internally
-						std::string devname="";
-						UpdateValueInt(itt->_HardwareID, itt->_ID.c_str(), itt->_unit, itt->_devType, itt->_subType, itt->_signallevel, itt->_batterylevel, itt->_nValue, itt->_sValue.c_str(),devname,true);
-					}
-					else
-						SwitchLightFromTasker(itt->_idx, "Off", 0, -1);
+				case TITEM_EXECUTE_SCRIPT:
+				case TITEM_EMAIL_CAMERA_SNAPSHOT:
+				case TITEM_SEND_EMAIL:
+				case TITEM_SEND_EMAIL_TO:
+				case TITEM_CLEANUP_LOG:
+					m_slow_tasks.push_back(*itt);
+					break;
+				default:
+					m_device_tasks.push_back(*itt);
+					break;
 				}
 			}
-			else if (itt->_ItemType == TITEM_EXECUTE_SCRIPT)
+		}
+		m_task_worker_cond.notify_all();
+	}
+}
+
+void CSQLHelper::Do_TaskWorker(std::deque<_tTaskItem> *pQueue)
+{
+	while (true)
+	{
+		_tTaskItem tItem;
+		{
+			boost::unique_lock<boost::mutex> l(m_task_worker_mutex);
+			while ((pQueue->empty())&&(!m_stoprequested))
+				m_task_worker_cond.wait(l);
+			if (m_stoprequested)
+				return;
+			tItem=pQueue->front();
+			pQueue->pop_front();
+		}
+		ExecuteTaskItem(tItem);
+	}
+}
+
+void CSQLHelper::ExecuteTaskItem(const _tTaskItem &tItem)
+{
+	if (tItem._ItemType == TITEM_SWITCHCMD)
+	{
+		if (tItem._switchtype==STYPE_Motion)
+		{
+			std::string devname="";
+			switch (tItem._devType)
 			{
-				//start script
-				_log.Log(LOG_STATUS, "Executing script: %s", itt->_ID.c_str());
-#ifdef WIN32
-				ShellExecute(NULL,"open",itt->_ID.c_str(),itt->_sValue.c_str(),NULL,SW_SHOWNORMAL);
-#else
-				std::string lscript=itt->_ID + " " + itt->_sValue;
-				int ret=system(lscript.c_str());
-				if (ret != 0)
+			case pTypeLighting1:
+			case pTypeLighting2:
+			case pTypeLighting3:
+			case pTypeLighting5:
+			case pTypeLighting6:
+			case pTypeLimitlessLights:
+				SwitchLightFromTasker(tItem._idx, "Off", 0, -1);
+				break;
+			case pTypeSecurity1:
+				switch (tItem._subType)
 				{
-					_log.Log(LOG_ERROR, "Error executing script command (%s). returned: %d",itt->_ID.c_str(), ret);
+				case sTypeSecX10M:
+					SwitchLightFromTasker(tItem._idx, "No Motion", 0, -1);
+					break;
+				default:
+					//just update internally
+					UpdateValueInt(tItem._HardwareID, tItem._ID.c_str(), tItem._unit, tItem._devType, tItem._subType, tItem._signallevel, tItem._batterylevel, tItem._nValue, tItem._sValue.c_str(),devname,true);
+					break;
 				}
-#endif
+				break;
+			case pTypeLighting4:
+				//only update internally
+				UpdateValueInt(tItem._HardwareID, tItem._ID.c_str(), tItem._unit, tItem._devType, tItem._subType, tItem._signallevel, tItem._batterylevel, tItem._nValue, tItem._sValue.c_str(),devname,true);
+				break;
+			default:
+				//unknown hardware type, sensor will only be updated internally
+				UpdateValueInt(tItem._HardwareID, tItem._ID.c_str(), tItem._unit, tItem._devType, tItem._subType, tItem._signallevel, tItem._batterylevel, tItem._nValue, tItem._sValue.c_str(),devname,true);
+				break;
 			}
-			else if (itt->_ItemType == TITEM_EMAIL_CAMERA_SNAPSHOT)
+		}
+		else
+		{
+			if (tItem._devType==pTypeLighting4)
 			{
-				m_mainworker.m_cameras.EmailCameraSnapshot(itt->_ID,itt->_sValue);
+				//only update internally
+				std::string devname="";
+				UpdateValueInt(tItem._HardwareID, tItem._ID.c_str(), tItem._unit, tItem._devType, tItem._subType, tItem._signallevel, tItem._batterylevel, tItem._nValue, tItem._sValue.c_str(),devname,true);
 			}
-			else if (itt->_ItemType == TITEM_GETURL)
+			else
+				SwitchLightFromTasker(tItem._idx, "Off", 0, -1);
+		}
+	}
+	else if (tItem._ItemType == TITEM_EXECUTE_SCRIPT)
+	{
+		//start script
+		_log.Log(LOG_STATUS, "Executing script: %s", tItem._ID.c_str());
+#ifdef WIN32
+		ShellExecute(NULL,"open",tItem._ID.c_str(),tItem._sValue.c_str(),NULL,SW_SHOWNORMAL);
+#else
+		std::string lscript=tItem._ID + " " + tItem._sValue;
+		int ret=system(lscript.c_str());
+		if (ret != 0)
+		{
+			_log.Log(LOG_ERROR, "Error executing script command (%s). returned: %d",tItem._ID.c_str(), ret);
+		}
+#endif
+	}
+	else if (tItem._ItemType == TITEM_EMAIL_CAMERA_SNAPSHOT)
+	{
+		m_mainworker.m_cameras.EmailCameraSnapshot(tItem._ID,tItem._sValue);
+	}
+	else if (tItem._ItemType == TITEM_GETURL)
+	{
+		std::vector<std::string> ExtraHeaders;
+		bool ret=m_mainworker.m_httpclient.GET(tItem._sValue,ExtraHeaders,boost::bind(&GetURLResult,tItem._sValue,_1,_2));
+		if (!ret)
+		{
+			_log.Log(LOG_ERROR,"Error opening url: %s",tItem._sValue.c_str());
+		}
+	}
+	else if ((tItem._ItemType == TITEM_SEND_EMAIL)||(tItem._ItemType == TITEM_SEND_EMAIL_TO))
+	{
+		int nValue;
+		std::string sValue;
+		if (GetPreferencesVar("EmailServer",nValue,sValue))
+		{
+			if (sValue!="")
 			{
-				std::string sResult;
-				bool ret=HTTPClient::GET(itt->_sValue,sResult);
-				if (!ret)
+				std::string EmailFrom;
+				std::string EmailTo;
+				std::string EmailServer=sValue;
+				int EmailPort=25;
+				std::string EmailUsername;
+				std::string EmailPassword;
+				GetPreferencesVar("EmailFrom",nValue,EmailFrom);
+				if (tItem._ItemType != TITEM_SEND_EMAIL_TO)
 				{
-					_log.Log(LOG_ERROR,"Error opening url: %s",itt->_sValue.c_str());
+					GetPreferencesVar("EmailTo",nValue,EmailTo);
 				}
-			}
-			else if ((itt->_ItemType == TITEM_SEND_EMAIL)||(itt->_ItemType == TITEM_SEND_EMAIL_TO))
-			{
-				int nValue;
-				std::string sValue;
-				if (GetPreferencesVar("EmailServer",nValue,sValue))
+				else
 				{
-					if (sValue!="")
-					{
-						std::string EmailFrom;
-						std::string EmailTo;
-						std::string EmailServer=sValue;
-						int EmailPort=25;
-						std::string EmailUsername;
-						std::string EmailPassword;
-						GetPreferencesVar("EmailFrom",nValue,EmailFrom);
-						if (itt->_ItemType != TITEM_SEND_EMAIL_TO)
-						{
-							GetPreferencesVar("EmailTo",nValue,EmailTo);
-						}
-						else
-						{
-							EmailTo=itt->_command;
-						}
-						GetPreferencesVar("EmailUsername",nValue,EmailUsername);
-						GetPreferencesVar("EmailPassword",nValue,EmailPassword);
-						GetPreferencesVar("EmailPort", EmailPort);
-
-						SMTPClient sclient;
-						sclient.SetFrom(CURLEncode::URLDecode(EmailFrom.c_str()));
-						sclient.SetTo(CURLEncode::URLDecode(EmailTo.c_str()));
-						sclient.SetCredentials(base64_decode(EmailUsername),base64_decode(EmailPassword));
-						sclient.SetServer(CURLEncode::URLDecode(EmailServer.c_str()),EmailPort);
-						sclient.SetSubject(CURLEncode::URLDecode(itt->_ID));
-						sclient.SetHTMLBody(itt->_sValue);
-						bool bRet=sclient.SendEmail();
-
-						if (bRet)
-							_log.Log(LOG_STATUS,"Notification sent (Email)");
-						else
-							_log.Log(LOG_ERROR,"Notification failed (Email)");
-
-					}
+					EmailTo=tItem._command;
 				}
-			}
-            else if (itt->_ItemType == TITEM_SWITCHCMD_EVENT)
-            {
-				SwitchLightFromTasker(itt->_idx, itt->_command.c_str(), itt->_level, itt->_Hue);
-            }
+				GetPreferencesVar("EmailUsername",nValue,EmailUsername);
+				GetPreferencesVar("EmailPassword",nValue,EmailPassword);
+				GetPreferencesVar("EmailPort", EmailPort);
+
+				SMTPClient sclient;
+				sclient.SetFrom(CURLEncode::URLDecode(EmailFrom.c_str()));
+				sclient.SetTo(CURLEncode::URLDecode(EmailTo.c_str()));
+				sclient.SetCredentials(base64_decode(EmailUsername),base64_decode(EmailPassword));
+				sclient.SetServer(CURLEncode::URLDecode(EmailServer.c_str()),EmailPort);
+				sclient.SetSubject(CURLEncode::URLDecode(tItem._ID));
+				sclient.SetHTMLBody(tItem._sValue);
+				bool bRet=sclient.SendEmail();
+
+				if (bRet)
+					_log.Log(LOG_STATUS,"Notification sent (Email)");
+				else
+					_log.Log(LOG_ERROR,"Notification failed (Email)");
 
-            else if (itt->_ItemType == TITEM_SWITCHCMD_SCENE)
-            {
-				m_mainworker.SwitchScene(itt->_idx, itt->_command.c_str());
-            }
-            
-			++itt;
+			}
 		}
-		_items2do.clear();
+	}
+	else if (tItem._ItemType == TITEM_SWITCHCMD_EVENT)
+	{
+		SwitchLightFromTasker(tItem._idx, tItem._command.c_str(), tItem._level, tItem._Hue);
+	}
+	else if (tItem._ItemType == TITEM_SWITCHCMD_SCENE)
+	{
+		m_mainworker.SwitchScene(tItem._idx, tItem._command.c_str());
+	}
+	else if (tItem._ItemType == TITEM_CLEANUP_LOG)
+	{
+		CleanupLog(tItem._ID, tItem._sValue);
 	}
 }
 
@@ -1527,6 +1934,37 @@ void CSQLHelper::SetDatabaseName(const std::string &DBName)
 	m_dbase_name=DBName;
 }
 
+static void FetchStatementRows(sqlite3_stmt *statement, std::vector<std::vector<std::string> > &results)
+{
+	int cols = sqlite3_column_count(statement);
+	int result = 0;
+	while(true)
+	{
+		result = sqlite3_step(statement);
+
+		if(result == SQLITE_ROW)
+		{
+			std::vector<std::string> values;
+			for(int col = 0; col < cols; col++)
+			{
+				char* value = (char*)sqlite3_column_text(statement, col);
+				if ((value == 0)&&(col==0))
+					break;
+				else if (value == 0)
+					values.push_back(std::string("")); //insert empty string
+				else
+					values.push_back(value);
+			}
+			if (values.size()>0)
+				results.push_back(values);
+		}
+		else
+		{
+			break;  
+		}
+	}
+}
+
 std::vector<std::vector<std::string> > CSQLHelper::query(const std::string &szQuery)
 {
 	if (!m_dbase)
@@ -1535,40 +1973,14 @@ std::vector<std::vector<std::string> > CSQLHelper::query(const std::string &szQu
 		std::vector<std::vector<std::string> > results;
 		return results;
 	}
-	boost::lock_guard<boost::mutex> l(m_sqlQueryMutex);
+	CSQLQueryLock l(m_sqlQueryMutex);
 	
 	sqlite3_stmt *statement;
 	std::vector<std::vector<std::string> > results;
 
 	if(sqlite3_prepare_v2(m_dbase, szQuery.c_str(), -1, &statement, 0) == SQLITE_OK)
 	{
-		int cols = sqlite3_column_count(statement);
-		int result = 0;
-		while(true)
-		{
-			result = sqlite3_step(statement);
-
-			if(result == SQLITE_ROW)
-			{
-				std::vector<std::string> values;
-				for(int col = 0; col < cols; col++)
-				{
-					char* value = (char*)sqlite3_column_text(statement, col);
-					if ((value == 0)&&(col==0))
-						break;
-					else if (value == 0)
-						values.push_back(std::string("")); //insert empty string
-					else
-						values.push_back(value);
-				}
-				if (values.size()>0)
-					results.push_back(values);
-			}
-			else
-			{
-				break;  
-			}
-		}
+		FetchStatementRows(statement, results);
 		sqlite3_finalize(statement);
 	}
 
@@ -1578,24 +1990,594 @@ std::vector<std::vector<std::string> > CSQLHelper::query(const std::string &szQu
 	return results; 
 }
 
-unsigned long long CSQLHelper::UpdateValue(const int HardwareID, const char* ID, const unsigned char unit, const unsigned char devType, const unsigned char subType, const unsigned char signallevel, const unsigned char batterylevel, const int nValue, std::string &devname, const bool bUseOnOffAction)
+std::vector<std::vector<std::string> > CSQLHelper::query(const std::string &szQuery, const CSQLParams &params)
 {
-	return UpdateValue(HardwareID, ID, unit, devType, subType, signallevel, batterylevel, nValue, "", devname,bUseOnOffAction);
+	std::vector<std::vector<std::string> > results;
+	if (!m_dbase)
+	{
+		_log.Log(LOG_ERROR,"Database not open!!...Check your user rights!..");
+		return results;
+	}
+	CSQLQueryLock l(m_sqlQueryMutex);
+	ExecuteCachedQuery(szQuery, params, results);
+	return results;
 }
 
-unsigned long long CSQLHelper::UpdateValue(const int HardwareID, const char* ID, const unsigned char unit, const unsigned char devType, const unsigned char subType, const unsigned char signallevel, const unsigned char batterylevel, const char* sValue, std::string &devname, const bool bUseOnOffAction)
+//Needs to be called with m_sqlQueryMutex locked
+void CSQLHelper::ExecuteCachedQuery(const std::string &szQuery, const CSQLParams &params, std::vector<std::vector<std::string> > &results)
 {
-	return UpdateValue(HardwareID, ID, unit, devType, subType, signallevel, batterylevel, 0, sValue,devname,bUseOnOffAction);
+	sqlite3_stmt *statement=GetCachedStatement(szQuery);
+	if (statement==NULL)
+	{
+		_log.Log(LOG_ERROR,"SQL: %s (%s)",sqlite3_errmsg(m_dbase),szQuery.c_str());
+		return;
+	}
+
+	int iParam=1;
+	std::vector<_tSQLParam>::const_iterator itt;
+	for (itt=params.m_params.begin(); itt!=params.m_params.end(); ++itt)
+	{
+		switch (itt->_Type)
+		{
+		case SQLPARAM_INT:
+			sqlite3_bind_int64(statement, iParam, itt->_iValue);
+			break;
+		case SQLPARAM_FLOAT:
+			sqlite3_bind_double(statement, iParam, itt->_fValue);
+			break;
+		case SQLPARAM_TEXT:
+			sqlite3_bind_text(statement, iParam, itt->_sValue.c_str(), (int)itt->_sValue.size(), SQLITE_TRANSIENT);
+			break;
+		default:
+			sqlite3_bind_null(statement, iParam);
+			break;
+		}
+		iParam++;
+	}
+
+	FetchStatementRows(statement, results);
+
+	int rc=sqlite3_errcode(m_dbase);
+	if ((rc!=SQLITE_OK)&&(rc!=SQLITE_ROW)&&(rc!=SQLITE_DONE))
+		_log.Log(LOG_ERROR,"SQL: %s (%s)",sqlite3_errmsg(m_dbase),szQuery.c_str());
+
+	//keep the statement prepared for the next call
+	sqlite3_reset(statement);
+	sqlite3_clear_bindings(statement);
 }
 
-unsigned long long CSQLHelper::UpdateValue(const int HardwareID, const char* ID, const unsigned char unit, const unsigned char devType, const unsigned char subType, const unsigned char signallevel, const unsigned char batterylevel, const int nValue, const char* sValue, std::string &devname, const bool bUseOnOffAction)
+//For DeviceStatus updates that only change values (nValue/sValue/LastUpdate/...)
+//and log inserts. These do not touch anything we keep in the device registry.
+//When batching, a pending update with the same query for DeviceRowID is replaced (bCoalesce).
+//Direct writes to the same device have to call FlushWriteQueue(DeviceRowID) first
+void CSQLHelper::QueueWrite(const std::string &szQuery, const CSQLParams &params, const unsigned long long DeviceRowID, const bool bCoalesce)
 {
-	unsigned long long devRowID=UpdateValueInt(HardwareID, ID, unit, devType, subType, signallevel, batterylevel, nValue, sValue,devname,bUseOnOffAction);
-	if (devRowID == -1)
-		return -1;
-
-	bool bIsLightSwitch=false;
-	switch (devType)
+	if (!m_dbase)
+		return;
+	if ((m_write_mode==DBWRITE_IMMEDIATE)||(!m_write_thread))
+	{
+		std::vector<std::vector<std::string> > results;
+		CSQLQueryLock l(m_sqlQueryMutex);
+		if (DeviceRowID!=0)
+			ApplyWriteQueue(DeviceRowID); //left over from batched mode
+		m_bDeviceValueUpdate=true;
+		ExecuteCachedQuery(szQuery, params, results);
+		m_bDeviceValueUpdate=false;
+		return;
+	}
+
+	boost::unique_lock<boost::mutex> l(m_write_queue_mutex);
+	if ((m_write_queue.size()>=MAX_WRITE_QUEUE_SIZE)&&(CSQLQueryLock::IsHeld()))
+	{
+		//The writer needs m_sqlQueryMutex to make room, and this thread holds it (for example an
+		//aggregation job sending a notification). Waiting would deadlock, write here instead
+		m_write_stats.TotalInline++;
+		l.unlock();
+		std::vector<std::vector<std::string> > results;
+		CSQLQueryLock lq(m_sqlQueryMutex);
+		//the queued items go first, they are older
+		ApplyWriteQueue();
+		m_bDeviceValueUpdate=true;
+		ExecuteCachedQuery(szQuery, params, results);
+		m_bDeviceValueUpdate=false;
+		return;
+	}
+	if (m_write_queue.size()>=MAX_WRITE_QUEUE_SIZE)
+	{
+		//Writer can not keep up. Never drop a write (log rows can not be written again later),
+		//and do not write on the calling (hardware) thread either, wait until the writer made room
+		m_write_stats.TotalFullWaits++;
+		time_t atime=mytime(NULL);
+		if (atime-m_write_full_logged>=60)
+		{
+			m_write_full_logged=atime;
+			_log.Log(LOG_ERROR,"SQL: Write queue full, waiting for the writer (total: %llu)",m_write_stats.TotalFullWaits);
+		}
+		m_write_queue_cond.notify_one();
+		while ((m_write_queue.size()>=WRITE_QUEUE_LOW_WATER)&&(!m_stoprequested))
+			m_write_queue_space_cond.wait(l);
+	}
+	std::pair<unsigned long long,std::string> ikey(DeviceRowID,szQuery);
+	bool bIndex=((DeviceRowID!=0)&&(bCoalesce));
+	if (bIndex)
+	{
+		std::map<std::pair<unsigned long long,std::string>,size_t>::const_iterator itt=m_write_queue_index.find(ikey);
+		if (itt!=m_write_queue_index.end())
+		{
+			m_write_queue[itt->second].Params=params;
+			m_write_stats.TotalCoalesced++;
+			return;
+		}
+	}
+	_tSQLWriteItem witem;
+	witem.szQuery=szQuery;
+	witem.Params=params;
+	witem.DeviceRowID=DeviceRowID;
+	witem.bCoalesce=bCoalesce;
+	witem.QueueTime=boost::posix_time::microsec_clock::universal_time();
+	if (bIndex)
+		m_write_queue_index[ikey]=m_write_queue.size();
+	m_write_queue.push_back(witem);
+	m_write_stats.QueueSize=(int)m_write_queue.size();
+	if (m_write_stats.QueueSize>m_write_stats.MaxQueueSize)
+		m_write_stats.MaxQueueSize=m_write_stats.QueueSize;
+}
+
+//Needs to be called with m_sqlQueryMutex locked
+//Applies the whole queue, or only the items of DeviceRowID (!=0)
+void CSQLHelper::ApplyWriteQueue(const unsigned long long DeviceRowID)
+{
+	std::vector<_tSQLWriteItem> witems;
+	{
+		boost::lock_guard<boost::mutex> l(m_write_queue_mutex);
+		if (m_write_queue.empty())
+			return;
+		if (DeviceRowID==0)
+		{
+			witems.swap(m_write_queue);
+			m_write_queue_index.clear();
+		}
+		else
+		{
+			std::vector<_tSQLWriteItem> witems_left;
+			std::vector<_tSQLWriteItem>::const_iterator itt;
+			for (itt=m_write_queue.begin(); itt!=m_write_queue.end(); ++itt)
+			{
+				if (itt->DeviceRowID==DeviceRowID)
+					witems.push_back(*itt);
+				else
+					witems_left.push_back(*itt);
+			}
+			if (witems.empty())
+				return;
+			m_write_queue.swap(witems_left);
+			m_write_queue_index.clear();
+			for (size_t ii=0; ii<m_write_queue.size(); ii++)
+			{
+				if ((m_write_queue[ii].DeviceRowID!=0)&&(m_write_queue[ii].bCoalesce))
+					m_write_queue_index[std::make_pair(m_write_queue[ii].DeviceRowID,m_write_queue[ii].szQuery)]=ii;
+			}
+		}
+		m_write_stats.QueueSize=(int)m_write_queue.size();
+		if (m_write_queue.size()<WRITE_QUEUE_LOW_WATER)
+			m_write_queue_space_cond.notify_all();
+	}
+
+	//All items in one transaction, unless we are already inside one
+	bool bTransaction=(sqlite3_get_autocommit(m_dbase)!=0);
+	if (bTransaction)
+		sqlite3_exec(m_dbase, "BEGIN TRANSACTION;", NULL, NULL, NULL);
+	std::vector<std::vector<std::string> > results;
+	m_bDeviceValueUpdate=true;
+	std::vector<_tSQLWriteItem>::const_iterator itt;
+	for (itt=witems.begin(); itt!=witems.end(); ++itt)
+	{
+		ExecuteCachedQuery(itt->szQuery, itt->Params, results);
+		results.clear();
+	}
+	m_bDeviceValueUpdate=false;
+	if (bTransaction)
+	{
+		if (sqlite3_exec(m_dbase, "COMMIT;", NULL, NULL, NULL)!=SQLITE_OK)
+		{
+			_log.Log(LOG_ERROR,"SQL: Commit of %d queued updates failed (%s)",(int)witems.size(),sqlite3_errmsg(m_dbase));
+			sqlite3_exec(m_dbase, "ROLLBACK;", NULL, NULL, NULL);
+		}
+	}
+
+	boost::posix_time::ptime now=boost::posix_time::microsec_clock::universal_time();
+	boost::lock_guard<boost::mutex> l(m_write_queue_mutex);
+	for (itt=witems.begin(); itt!=witems.end(); ++itt)
+	{
+		long latency=(long)(now-itt->QueueTime).total_milliseconds();
+		m_write_latency_total+=latency;
+		if (latency>m_write_stats.MaxLatency)
+			m_write_stats.MaxLatency=latency;
+	}
+	m_write_stats.TotalItems+=witems.size();
+	m_write_stats.TotalBatches++;
+	m_write_stats.AvgLatency=(long)(m_write_latency_total/m_write_stats.TotalItems);
+}
+
+void CSQLHelper::FlushWriteQueue()
+{
+	if (!m_dbase)
+		return;
+	CSQLQueryLock l(m_sqlQueryMutex);
+	ApplyWriteQueue();
+}
+
+void CSQLHelper::FlushWriteQueue(const unsigned long long DeviceRowID)
+{
+	if ((!m_dbase)||(DeviceRowID==0))
+		return;
+	{
+		//nothing queued for it (the normal case), no need to wait for the database
+		boost::lock_guard<boost::mutex> l(m_write_queue_mutex);
+		bool bFound=false;
+		std::vector<_tSQLWriteItem>::const_iterator itt;
+		for (itt=m_write_queue.begin(); itt!=m_write_queue.end(); ++itt)
+		{
+			if (itt->DeviceRowID==DeviceRowID)
+			{
+				bFound=true;
+				break;
+			}
+		}
+		if (!bFound)
+			return;
+	}
+	CSQLQueryLock l(m_sqlQueryMutex);
+	ApplyWriteQueue(DeviceRowID);
+}
+
+void CSQLHelper::GetWriteQueueStats(_tSQLWriteStats &stats)
+{
+	boost::lock_guard<boost::mutex> l(m_write_queue_mutex);
+	stats=m_write_stats;
+}
+
+void CSQLHelper::Do_Write_Work()
+{
+	while (!m_stoprequested)
+	{
+		bool bHaveItems;
+		{
+			boost::unique_lock<boost::mutex> l(m_write_queue_mutex);
+			m_write_queue_cond.timed_wait(l, boost::posix_time::milliseconds(m_write_interval));
+			bHaveItems=!m_write_queue.empty();
+		}
+		if (bHaveItems)
+			FlushWriteQueue();
+	}
+	FlushWriteQueue();
+}
+
+//Called by sqlite (with m_sqlQueryMutex locked) for every row that is inserted, updated or deleted
+void CSQLHelper::DeviceStatusHook(void *pArg, int op, char const *dbname, char const *table, long long rowid)
+{
+	CSQLHelper *pHelper=(CSQLHelper*)pArg;
+	bool bDeviceStatus=(strcmp(table,"DeviceStatus")==0);
+	_eChangeJournalType jtype;
+	if (bDeviceStatus)
+		jtype=CJTYPE_DEVICE;
+	else if (strcmp(table,"Scenes")==0)
+		jtype=CJTYPE_SCENE;
+	else if (strcmp(table,"UserVariables")==0)
+		jtype=CJTYPE_USERVARIABLE;
+	else if (
+		(strcmp(table,"Hardware")==0)||
+		(strcmp(table,"SharedDevices")==0)||
+		(strcmp(table,"DeviceToPlansMap")==0)||
+		(strcmp(table,"Plans")==0)
+		)
+		jtype=CJTYPE_RESYNC;
+	else
+		return;
+
+	{
+		boost::lock_guard<boost::mutex> l(pHelper->m_change_journal_mutex);
+		pHelper->m_change_journal_seq++;
+		_tChangeJournalItem &jitem=pHelper->m_change_journal[pHelper->m_change_journal_seq%CHANGE_JOURNAL_SIZE];
+		jitem.seq=pHelper->m_change_journal_seq;
+		jitem.type=jtype;
+		jitem.op=op;
+		jitem.rowid=(unsigned long long)rowid;
+	}
+	pHelper->m_change_journal_cond.notify_all();
+
+	//value updates from the writer thread do not change the registry
+	if ((!bDeviceStatus)||(pHelper->m_bDeviceValueUpdate))
+		return;
+
+	boost::lock_guard<boost::mutex> l(pHelper->m_device_registry_mutex);
+	pHelper->m_device_registry_generation++;
+	std::map<unsigned long long,_tDeviceStatusInfo>::iterator itt=pHelper->m_device_registry.find((unsigned long long)rowid);
+	if (itt==pHelper->m_device_registry.end())
+		return;
+	if (op==SQLITE_DELETE)
+	{
+		pHelper->m_device_ids.erase(itt->second.Key);
+		pHelper->m_device_registry.erase(itt);
+	}
+	else
+	{
+		//Name/SwitchType/... could have been changed, reload it on the next lookup
+		itt->second.bStale=true;
+	}
+}
+
+void CSQLHelper::LoadDeviceRegistry()
+{
+	{
+		boost::lock_guard<boost::mutex> l(m_device_registry_mutex);
+		m_device_ids.clear();
+		m_device_registry.clear();
+	}
+	unsigned long generation=m_device_registry_generation;
+
+	std::vector<std::vector<std::string> > result;
+	result=query(
+		"SELECT ID,HardwareID,DeviceID,Unit,Type,SubType,Name,SwitchType,AddjValue,StrParam1,StrParam2,LastLevel,nValue,sValue FROM DeviceStatus",
+		CSQLParams());
+	std::vector<std::vector<std::string> >::const_iterator itt;
+	for (itt=result.begin(); itt!=result.end(); ++itt)
+	{
+		std::vector<std::string> sd=*itt;
+		_tDeviceStatusInfo info;
+		std::stringstream s_str( sd[0] );
+		s_str >> info.ID;
+		info.Key.HardwareID=atoi(sd[1].c_str());
+		info.Key.DeviceID=sd[2];
+		info.Key.Unit=(unsigned char)atoi(sd[3].c_str());
+		info.Key.Type=(unsigned char)atoi(sd[4].c_str());
+		info.Key.SubType=(unsigned char)atoi(sd[5].c_str());
+		info.Name=sd[6];
+		info.SwitchType=atoi(sd[7].c_str());
+		info.AddjValue=(float)atof(sd[8].c_str());
+		info.StrParam1=sd[9];
+		info.StrParam2=sd[10];
+		info.LastLevel=atoi(sd[11].c_str());
+		info.nValue=atoi(sd[12].c_str());
+		info.sValue=sd[13];
+		info.bStale=false;
+		AddDeviceToRegistry(info,generation);
+	}
+	_log.Log(LOG_STATUS,"Device registry loaded (%d devices)",(int)result.size());
+}
+
+bool CSQLHelper::LookupDevice(const _tDeviceStatusKey &key, _tDeviceStatusInfo &info)
+{
+	unsigned long generation;
+	{
+		boost::lock_guard<boost::mutex> l(m_device_registry_mutex);
+		std::map<_tDeviceStatusKey,unsigned long long>::const_iterator itt=m_device_ids.find(key);
+		if (itt!=m_device_ids.end())
+		{
+			info=m_device_registry[itt->second];
+			if (!info.bStale)
+				return true;
+		}
+		generation=m_device_registry_generation;
+	}
+	//Not known (yet) or changed, get it from the database
+	std::vector<std::vector<std::string> > result;
+	result=query(
+		"SELECT ID,Name,SwitchType,AddjValue,StrParam1,StrParam2,LastLevel,nValue,sValue FROM DeviceStatus WHERE (HardwareID=? AND DeviceID=? AND Unit=? AND Type=? AND SubType=?)",
+		CSQLParams().Add(key.HardwareID).Add(key.DeviceID).Add(key.Unit).Add(key.Type).Add(key.SubType));
+	if (result.size()==0)
+	{
+		RemoveDeviceFromRegistry(key);
+		return false;
+	}
+	std::vector<std::string> sd=result[0];
+	std::stringstream s_str( sd[0] );
+	s_str >> info.ID;
+	info.Key=key;
+	info.Name=sd[1];
+	info.SwitchType=atoi(sd[2].c_str());
+	info.AddjValue=(float)atof(sd[3].c_str());
+	info.StrParam1=sd[4];
+	info.StrParam2=sd[5];
+	info.LastLevel=atoi(sd[6].c_str());
+	info.nValue=atoi(sd[7].c_str());
+	info.sValue=sd[8];
+	info.bStale=false;
+	AddDeviceToRegistry(info,generation);
+	return true;
+}
+
+bool CSQLHelper::GetDeviceValue(const int HardwareID, const std::string &DeviceID, const unsigned char unit, const unsigned char devType, const unsigned char subType, int &nValue, std::string &sValue)
+{
+	_tDeviceStatusKey devkey;
+	devkey.HardwareID=HardwareID;
+	devkey.DeviceID=DeviceID;
+	devkey.Unit=unit;
+	devkey.Type=devType;
+	devkey.SubType=subType;
+	_tDeviceStatusInfo devinfo;
+	if (!LookupDevice(devkey,devinfo))
+		return false;
+	nValue=devinfo.nValue;
+	sValue=devinfo.sValue;
+	return true;
+}
+
+void CSQLHelper::AddDeviceToRegistry(const _tDeviceStatusInfo &info, const unsigned long generation)
+{
+	boost::lock_guard<boost::mutex> l(m_device_registry_mutex);
+	std::map<unsigned long long,_tDeviceStatusInfo>::iterator itt=m_device_registry.find(info.ID);
+	bool bKeepValue=false;
+	int nValue=0;
+	std::string sValue;
+	if (itt!=m_device_registry.end())
+	{
+		//the key of the device could have been changed
+		m_device_ids.erase(itt->second.Key);
+		//the database does not have the queued values yet
+		boost::lock_guard<boost::mutex> l2(m_write_queue_mutex);
+		std::vector<_tSQLWriteItem>::const_iterator itt2;
+		for (itt2=m_write_queue.begin(); itt2!=m_write_queue.end(); ++itt2)
+		{
+			if (itt2->DeviceRowID==info.ID)
+			{
+				bKeepValue=true;
+				nValue=itt->second.nValue;
+				sValue=itt->second.sValue;
+				break;
+			}
+		}
+	}
+	m_device_registry[info.ID]=info;
+	if (bKeepValue)
+	{
+		m_device_registry[info.ID].nValue=nValue;
+		m_device_registry[info.ID].sValue=sValue;
+	}
+	m_device_ids[info.Key]=info.ID;
+	if (generation!=m_device_registry_generation)
+	{
+		//the table was modified while we were reading it
+		m_device_registry[info.ID].bStale=true;
+	}
+}
+
+void CSQLHelper::ClearLastSwitch()
+{
+	boost::lock_guard<boost::mutex> l(m_last_switch_mutex);
+	m_LastSwitchID="";
+	m_LastSwitchRowID=0;
+}
+
+bool CSQLHelper::GetLastSwitch(std::string &ID, unsigned long long &RowID)
+{
+	boost::lock_guard<boost::mutex> l(m_last_switch_mutex);
+	if (m_LastSwitchID=="")
+		return false;
+	ID=m_LastSwitchID;
+	RowID=m_LastSwitchRowID;
+	return true;
+}
+
+void CSQLHelper::RemoveDeviceFromRegistry(const _tDeviceStatusKey &key)
+{
+	boost::lock_guard<boost::mutex> l(m_device_registry_mutex);
+	std::map<_tDeviceStatusKey,unsigned long long>::iterator itt=m_device_ids.find(key);
+	if (itt==m_device_ids.end())
+		return;
+	m_device_registry.erase(itt->second);
+	m_device_ids.erase(itt);
+}
+
+//Needs to be called with m_sqlQueryMutex locked
+sqlite3_stmt *CSQLHelper::GetCachedStatement(const std::string &szQuery)
+{
+	std::map<std::string,sqlite3_stmt*>::const_iterator itt=m_statement_cache.find(szQuery);
+	if (itt!=m_statement_cache.end())
+		return itt->second;
+
+	//Queries are expected to use parameters, if we still get a lot of different ones, start over
+	if (m_statement_cache.size()>=MAX_CACHED_STATEMENTS)
+		ClearStatementCache();
+
+	sqlite3_stmt *statement=NULL;
+	if (sqlite3_prepare_v2(m_dbase, szQuery.c_str(), -1, &statement, 0) != SQLITE_OK)
+	{
+		if (statement!=NULL)
+			sqlite3_finalize(statement);
+		return NULL;
+	}
+	m_statement_cache[szQuery]=statement;
+	return statement;
+}
+
+//Needs to be called with m_sqlQueryMutex locked
+void CSQLHelper::ClearStatementCache()
+{
+	std::map<std::string,sqlite3_stmt*>::iterator itt;
+	for (itt=m_statement_cache.begin(); itt!=m_statement_cache.end(); ++itt)
+	{
+		sqlite3_finalize(itt->second);
+	}
+	m_statement_cache.clear();
+}
+
+CSQLParams& CSQLParams::Add(const int value)
+{
+	return Add((long long)value);
+}
+
+CSQLParams& CSQLParams::Add(const long long value)
+{
+	_tSQLParam param;
+	param._Type=SQLPARAM_INT;
+	param._iValue=value;
+	param._fValue=0;
+	m_params.push_back(param);
+	return *this;
+}
+
+CSQLParams& CSQLParams::Add(const unsigned long long value)
+{
+	return Add((long long)value);
+}
+
+CSQLParams& CSQLParams::Add(const double value)
+{
+	_tSQLParam param;
+	param._Type=SQLPARAM_FLOAT;
+	param._iValue=0;
+	param._fValue=value;
+	m_params.push_back(param);
+	return *this;
+}
+
+CSQLParams& CSQLParams::Add(const char* value)
+{
+	if (value==NULL)
+		return AddNull();
+	return Add(std::string(value));
+}
+
+CSQLParams& CSQLParams::Add(const std::string &value)
+{
+	_tSQLParam param;
+	param._Type=SQLPARAM_TEXT;
+	param._iValue=0;
+	param._fValue=0;
+	param._sValue=value;
+	m_params.push_back(param);
+	return *this;
+}
+
+CSQLParams& CSQLParams::AddNull()
+{
+	_tSQLParam param;
+	param._Type=SQLPARAM_NULL;
+	param._iValue=0;
+	param._fValue=0;
+	m_params.push_back(param);
+	return *this;
+}
+
+unsigned long long CSQLHelper::UpdateValue(const int HardwareID, const char* ID, const unsigned char unit, const unsigned char devType, const unsigned char subType, const unsigned char signallevel, const unsigned char batterylevel, const int nValue, std::string &devname, const bool bUseOnOffAction)
+{
+	return UpdateValue(HardwareID, ID, unit, devType, subType, signallevel, batterylevel, nValue, "", devname,bUseOnOffAction);
+}
+
+unsigned long long CSQLHelper::UpdateValue(const int HardwareID, const char* ID, const unsigned char unit, const unsigned char devType, const unsigned char subType, const unsigned char signallevel, const unsigned char batterylevel, const char* sValue, std::string &devname, const bool bUseOnOffAction)
+{
+	return UpdateValue(HardwareID, ID, unit, devType, subType, signallevel, batterylevel, 0, sValue,devname,bUseOnOffAction);
+}
+
+unsigned long long CSQLHelper::UpdateValue(const int HardwareID, const char* ID, const unsigned char unit, const unsigned char devType, const unsigned char subType, const unsigned char signallevel, const unsigned char batterylevel, const int nValue, const char* sValue, std::string &devname, const bool bUseOnOffAction)
+{
+	unsigned long long devRowID=UpdateValueInt(HardwareID, ID, unit, devType, subType, signallevel, batterylevel, nValue, sValue,devname,bUseOnOffAction);
+	if (devRowID == -1)
+		return -1;
+
+	bool bIsLightSwitch=false;
+	switch (devType)
 	{
 	case pTypeLighting1:
 	case pTypeLighting2:
@@ -1621,12 +2603,8 @@ unsigned long long CSQLHelper::UpdateValue(const int HardwareID, const char* ID,
 	std::vector<std::vector<std::string> >::const_iterator itt,itt2;
 	char szTmp[300];
 
-	sprintf(szTmp,"SELECT ID FROM DeviceStatus WHERE (HardwareID=%d AND DeviceID='%s' AND Unit=%d AND Type=%d AND SubType=%d)",HardwareID, ID, unit, devType, subType);
-	result=query(szTmp);
-	if (result.size()==0)
-		return devRowID; //should never happen, because it was previously inserted if non-existent
-
-	std::string idx=result[0][0];
+	sprintf(szTmp,"%llu",devRowID);
+	std::string idx=szTmp;
 
 	time_t now = time(0);
 	struct tm ltime;
@@ -1651,6 +2629,7 @@ unsigned long long CSQLHelper::UpdateValue(const int HardwareID, const char* ID,
 				ltime.tm_year+1900,ltime.tm_mon+1, ltime.tm_mday, ltime.tm_hour, ltime.tm_min, ltime.tm_sec,
 				sd[0].c_str()
 				);
+			FlushWriteQueue(strtoull(sd[0].c_str(),NULL,10)); //a queued update of this device would overwrite it
 			query(szTmp);
 			//Set the status of all slave devices from this device (except the one we just received) to off
 			//Check if this switch was a Sub/Slave device for other devices, if so adjust the state of those other devices
@@ -1714,6 +2693,7 @@ unsigned long long CSQLHelper::UpdateValue(const int HardwareID, const char* ID,
 						ltime.tm_year+1900,ltime.tm_mon+1, ltime.tm_mday, ltime.tm_hour, ltime.tm_min, ltime.tm_sec,
 						sd[0].c_str()
 						);
+					FlushWriteQueue(strtoull(sd[0].c_str(),NULL,10));
 					query(szTmp);
 				}
 			}
@@ -1782,6 +2762,7 @@ unsigned long long CSQLHelper::UpdateValue(const int HardwareID, const char* ID,
 				ltime.tm_year+1900,ltime.tm_mon+1, ltime.tm_mday, ltime.tm_hour, ltime.tm_min, ltime.tm_sec,
 				sd[0].c_str()
 				);
+			FlushWriteQueue(strtoull(sd[0].c_str(),NULL,10));
 			query(szTmp);
 		}
 	}
@@ -1793,14 +2774,25 @@ unsigned long long CSQLHelper::UpdateValueInt(const int HardwareID, const char*
 	if (!m_dbase)
 		return -1;
 
-	char szTmp[400];
-
 	unsigned long long ulID=0;
 
 	std::vector<std::vector<std::string> > result;
-	sprintf(szTmp,"SELECT ID,Name FROM DeviceStatus WHERE (HardwareID=%d AND DeviceID='%s' AND Unit=%d AND Type=%d AND SubType=%d)",HardwareID, ID, unit, devType, subType);
-	result=query(szTmp);
-	if (result.size()==0)
+	_tDeviceStatusKey devkey;
+	devkey.HardwareID=HardwareID;
+	devkey.DeviceID=ID;
+	devkey.Unit=unit;
+	devkey.Type=devType;
+	devkey.SubType=subType;
+	_tDeviceStatusInfo devinfo;
+
+	time_t now = time(0);
+	struct tm ltime;
+	localtime_r(&now,&ltime);
+	char szLastUpdate[40];
+	sprintf(szLastUpdate,"%04d-%02d-%02d %02d:%02d:%02d",
+		ltime.tm_year+1900,ltime.tm_mon+1, ltime.tm_mday, ltime.tm_hour, ltime.tm_min, ltime.tm_sec);
+
+	if (!LookupDevice(devkey,devinfo))
 	{
 		//Insert
 
@@ -1811,46 +2803,38 @@ unsigned long long CSQLHelper::UpdateValueInt(const int HardwareID, const char*
 		}
 
 		devname="Unknown";
-		sprintf(szTmp,
+		query(
 			"INSERT INTO DeviceStatus (HardwareID, DeviceID, Unit, Type, SubType, SignalLevel, BatteryLevel, nValue, sValue) "
-			"VALUES ('%d','%s','%d','%d','%d','%d','%d','%d','%s')",
-			HardwareID,
-			ID,unit,devType,subType,
-			signallevel,batterylevel,
-			nValue,sValue);
-		result=query(szTmp);
+			"VALUES (?,?,?,?,?,?,?,?,?)",
+			CSQLParams().Add(HardwareID).Add(ID).Add(unit).Add(devType).Add(subType).Add(signallevel).Add(batterylevel).Add(nValue).Add(sValue));
 
 		//Get new ID
-		sprintf(szTmp,"SELECT ID FROM DeviceStatus WHERE (HardwareID=%d AND DeviceID='%s' AND Unit=%d AND Type=%d AND SubType=%d)",HardwareID, ID, unit, devType, subType);
-		result=query(szTmp);
-		if (result.size()==0)
+		if (!LookupDevice(devkey,devinfo))
 		{
 			_log.Log(LOG_ERROR,"Serious database error, problem getting ID from DeviceStatus!");
 			return -1;
 		}
-		std::stringstream s_str( result[0][0] );
-		s_str >> ulID;
+		ulID=devinfo.ID;
 	}
 	else
 	{
 		//Update
-		std::stringstream s_str( result[0][0] );
-		s_str >> ulID;
+		ulID=devinfo.ID;
+		devname=devinfo.Name;
 
-		devname=result[0][1];
-
-		time_t now = time(0);
-		struct tm ltime;
-		localtime_r(&now,&ltime);
-
-		sprintf(szTmp,
-			"UPDATE DeviceStatus SET SignalLevel=%d, BatteryLevel=%d, nValue=%d, sValue='%s', LastUpdate='%04d-%02d-%02d %02d:%02d:%02d' "
-			"WHERE (ID = %llu)",
-			signallevel,batterylevel,
-			nValue,sValue,
-			ltime.tm_year+1900,ltime.tm_mon+1, ltime.tm_mday, ltime.tm_hour, ltime.tm_min, ltime.tm_sec,
+		QueueWrite(
+			"UPDATE DeviceStatus SET SignalLevel=?, BatteryLevel=?, nValue=?, sValue=?, LastUpdate=? "
+			"WHERE (ID = ?)",
+			CSQLParams().Add(signallevel).Add(batterylevel).Add(nValue).Add(sValue).Add(szLastUpdate).Add(ulID),
 			ulID);
-		result = query(szTmp);
+		//readers on the decode path get the value from the registry, not from the (not yet written) database
+		boost::lock_guard<boost::mutex> l(m_device_registry_mutex);
+		std::map<unsigned long long,_tDeviceStatusInfo>::iterator itt=m_device_registry.find(ulID);
+		if (itt!=m_device_registry.end())
+		{
+			itt->second.nValue=nValue;
+			itt->second.sValue=sValue;
+		}
 	}
 
 	switch (devType)
@@ -1876,14 +2860,16 @@ unsigned long long CSQLHelper::UpdateValueInt(const int HardwareID, const char*
 	case pTypeThermostat3:
 	case pTypeRemote:
 		//Add Lighting log
-		m_LastSwitchID=ID;
-		m_LastSwitchRowID=ulID;
-		sprintf(szTmp,
-			"INSERT INTO LightingLog (DeviceRowID, nValue, sValue) "
-			"VALUES ('%llu', '%d', '%s')",
-			ulID,
-			nValue,sValue);
-		result=query(szTmp);
+		{
+			boost::lock_guard<boost::mutex> l(m_last_switch_mutex);
+			m_LastSwitchID=ID;
+			m_LastSwitchRowID=ulID;
+		}
+		QueueWrite(
+			"INSERT INTO LightingLog (DeviceRowID, nValue, sValue, Date) "
+			"VALUES (?, ?, ?, ?)",
+			CSQLParams().Add(ulID).Add(nValue).Add(sValue).Add(szLastUpdate),
+			ulID, false);
 
 		std::string lstatus="";
 		int llevel=0;
@@ -1891,16 +2877,10 @@ unsigned long long CSQLHelper::UpdateValueInt(const int HardwareID, const char*
 		bool bHaveGroupCmd=false;
 		int maxDimLevel=0;
 
-		sprintf(szTmp,
-			"SELECT Name,SwitchType,AddjValue,StrParam1,StrParam2 FROM DeviceStatus WHERE (ID = %llu)",
-			ulID);
-		result = query(szTmp);
-		if (result.size()>0)
 		{
-			std::vector<std::string> sd=result[0];
-			std::string Name=sd[0];
-			_eSwitchType switchtype=(_eSwitchType)atoi(sd[1].c_str());
-			int AddjValue=(int)atof(sd[2].c_str());
+			std::string Name=devinfo.Name;
+			_eSwitchType switchtype=(_eSwitchType)devinfo.SwitchType;
+			float AddjValue=devinfo.AddjValue;
 			GetLightStatus(devType, subType, switchtype,nValue, sValue, lstatus, llevel, bHaveDimmer, maxDimLevel, bHaveGroupCmd);
 
 			bool bIsLightSwitchOn=IsLightSwitchOn(lstatus);
@@ -1908,19 +2888,23 @@ unsigned long long CSQLHelper::UpdateValueInt(const int HardwareID, const char*
 			if ((bIsLightSwitchOn)&&(llevel!=0))
 			{
 				//update level for device
-				sprintf(szTmp,
-					"UPDATE DeviceStatus SET LastLevel='%d' WHERE (ID = %llu)",
-					llevel,
+				QueueWrite(
+					"UPDATE DeviceStatus SET LastLevel=? WHERE (ID = ?)",
+					CSQLParams().Add(llevel).Add(ulID),
 					ulID);
-				query(szTmp);
+				devinfo.LastLevel=llevel;
+				boost::lock_guard<boost::mutex> l(m_device_registry_mutex);
+				std::map<unsigned long long,_tDeviceStatusInfo>::iterator itt=m_device_registry.find(ulID);
+				if (itt!=m_device_registry.end())
+					itt->second.LastLevel=llevel;
 
 			}
 
 			if (bUseOnOffAction)
 			{
 				//Perform any On/Off actions
-				std::string OnAction=sd[3];
-				std::string OffAction=sd[4];
+				std::string OnAction=devinfo.StrParam1;
+				std::string OffAction=devinfo.StrParam2;
   
 				if(devType==pTypeEvohome)//would this be ok to extend as a general purpose feature?
 				{
@@ -1939,12 +2923,9 @@ unsigned long long CSQLHelper::UpdateValueInt(const int HardwareID, const char*
 			{
 				if (emailserver!="")
 				{
-					sprintf(szTmp,
-						"SELECT CameraRowID, DevSceneDelay FROM CamerasActiveDevices WHERE (DevSceneType==0) AND (DevSceneRowID==%llu) AND (DevSceneWhen==%d)",
-						ulID,
-						(bIsLightSwitchOn==true)?0:1
-						);
-					result=query(szTmp);
+					result=query(
+						"SELECT CameraRowID, DevSceneDelay FROM CamerasActiveDevices WHERE (DevSceneType==0) AND (DevSceneRowID==?) AND (DevSceneWhen==?)",
+						CSQLParams().Add(ulID).Add((bIsLightSwitchOn==true)?0:1));
 					if (result.size()>0)
 					{
 						std::vector<std::vector<std::string> >::const_iterator ittCam;
@@ -1977,9 +2958,8 @@ unsigned long long CSQLHelper::UpdateValueInt(const int HardwareID, const char*
 					if (nszStartupFolder == "")
 						nszStartupFolder = ".";
 					s_scriptparams << nszStartupFolder << " " << HardwareID << " " << ulID << " " << (bIsLightSwitchOn ? "On" : "Off") << " \"" << lstatus << "\"" << " \"" << devname << "\"";
-					//add script to background worker				
-					boost::lock_guard<boost::mutex> l(m_background_task_mutex);
-					m_background_task_queue.push_back(_tTaskItem::ExecuteScript(1, scriptname, s_scriptparams.str()));
+					//add script to background worker
+					AddTaskItem(_tTaskItem::ExecuteScript(1, scriptname, s_scriptparams.str()));
 				}
 			}
 
@@ -2052,27 +3032,8 @@ unsigned long long CSQLHelper::UpdateValueInt(const int HardwareID, const char*
 	*/
 					if (bAdd2DelayQueue==true)
 					{
-						boost::lock_guard<boost::mutex> l(m_background_task_mutex);
-						_tTaskItem tItem=_tTaskItem::SwitchLight(AddjValue,ulID,HardwareID,ID,unit,devType,subType,switchtype,signallevel,batterylevel,cmd,sValue);
-						//Remove all instances with this device from the queue first
-						//otherwise command will be send twice, and first one will be to soon as it is currently counting
-						std::vector<_tTaskItem>::iterator itt=m_background_task_queue.begin();
-						while (itt!=m_background_task_queue.end())
-						{
-							if (
-								(itt->_ItemType==TITEM_SWITCHCMD)&&
-								(itt->_idx==ulID)&&
-								(itt->_HardwareID == HardwareID)&&
-								(itt->_nValue == cmd)
-								)
-							{
-								itt=m_background_task_queue.erase(itt);
-							}
-							else
-								++itt;
-						}
-						//finally add it to the queue
-						m_background_task_queue.push_back(tItem);
+						//replaces a pending off-delay of this device
+						AddTaskItem(_tTaskItem::SwitchLight(AddjValue,ulID,HardwareID,ID,unit,devType,subType,switchtype,signallevel,batterylevel,cmd,sValue));
 					}
 				}
 			}
@@ -2082,7 +3043,7 @@ unsigned long long CSQLHelper::UpdateValueInt(const int HardwareID, const char*
 		CheckSceneStatusWithDevice(ulID);
 		break;
 	}
-	m_mainworker.m_eventsystem.ProcessDevice(HardwareID, ulID, unit, devType, subType, signallevel, batterylevel, nValue, sValue, devname, 0);
+	m_mainworker.m_eventsystem.ProcessDevice(HardwareID, ulID, unit, devType, subType, signallevel, batterylevel, nValue, sValue, devname, (_eSwitchType)devinfo.SwitchType, szLastUpdate, (unsigned char)devinfo.LastLevel, 0);
 	return ulID;
 }
 
@@ -2127,9 +3088,8 @@ void CSQLHelper::GetAddjustment(const int HardwareID, const char* ID, const unsi
 	AddjValue=0.0f;
 	AddjMulti=1.0f;
 	std::vector<std::vector<std::string> > result;
-	char szTmp[400];
-	sprintf(szTmp,"SELECT AddjValue,AddjMulti FROM DeviceStatus WHERE (HardwareID=%d AND DeviceID='%s' AND Unit=%d AND Type=%d AND SubType=%d)",HardwareID, ID, unit, devType, subType);
-	result=query(szTmp);
+	result=query("SELECT AddjValue,AddjMulti FROM DeviceStatus WHERE (HardwareID=? AND DeviceID=? AND Unit=? AND Type=? AND SubType=?)",
+		CSQLParams().Add(HardwareID).Add(ID).Add(unit).Add(devType).Add(subType));
 	if (result.size()!=0)
 	{
 		AddjValue=(float)atof(result[0][0].c_str());
@@ -2141,9 +3101,8 @@ void CSQLHelper::GetMeterType(const int HardwareID, const char* ID, const unsign
 {
 	meterType=0;
 	std::vector<std::vector<std::string> > result;
-	char szTmp[400];
-	sprintf(szTmp,"SELECT SwitchType FROM DeviceStatus WHERE (HardwareID=%d AND DeviceID='%s' AND Unit=%d AND Type=%d AND SubType=%d)",HardwareID, ID, unit, devType, subType);
-	result=query(szTmp);
+	result=query("SELECT SwitchType FROM DeviceStatus WHERE (HardwareID=? AND DeviceID=? AND Unit=? AND Type=? AND SubType=?)",
+		CSQLParams().Add(HardwareID).Add(ID).Add(unit).Add(devType).Add(subType));
 	if (result.size()!=0)
 	{
 		meterType=atoi(result[0][0].c_str());
@@ -2155,9 +3114,8 @@ void CSQLHelper::GetAddjustment2(const int HardwareID, const char* ID, const uns
 	AddjValue=0.0f;
 	AddjMulti=1.0f;
 	std::vector<std::vector<std::string> > result;
-	char szTmp[400];
-	sprintf(szTmp,"SELECT AddjValue2,AddjMulti2 FROM DeviceStatus WHERE (HardwareID=%d AND DeviceID='%s' AND Unit=%d AND Type=%d AND SubType=%d)",HardwareID, ID, unit, devType, subType);
-	result=query(szTmp);
+	result=query("SELECT AddjValue2,AddjMulti2 FROM DeviceStatus WHERE (HardwareID=? AND DeviceID=? AND Unit=? AND Type=? AND SubType=?)",
+		CSQLParams().Add(HardwareID).Add(ID).Add(unit).Add(devType).Add(subType));
 	if (result.size()!=0)
 	{
 		AddjValue=(float)atof(result[0][0].c_str());
@@ -2165,11 +3123,18 @@ void CSQLHelper::GetAddjustment2(const int HardwareID, const char* ID, const uns
 	}
 }
 
+static void NotificationResult(const std::string &Service, const bool bSuccess, const std::string &response)
+{
+	if (bSuccess)
+		_log.Log(LOG_STATUS,"Notification sent (%s)",Service.c_str());
+	else
+		_log.Log(LOG_ERROR,"Error sending %s Notification!",Service.c_str());
+}
+
 bool CSQLHelper::SendNotification(const std::string &EventID, const std::string &Message, const int Priority)
 {
 	int nValue;
 	std::string sValue;
-	std::string sResult;
 
 #if defined WIN32
 	//Make a system tray message
@@ -2187,14 +3152,10 @@ bool CSQLHelper::SendNotification(const std::string &EventID, const std::string
 			std::stringstream sPostData;
 			sPostData << "apikey=" << sValue << "&application=Domoticz&event=" << Message << "&description=" << Message << "&priority=" << Priority;
 			std::vector<std::string> ExtraHeaders;
-			if (!HTTPClient::POST("https://api.prowlapp.com/publicapi/add",sPostData.str(),ExtraHeaders,sResult))
+			if (!m_mainworker.m_httpclient.POST("https://api.prowlapp.com/publicapi/add",sPostData.str(),ExtraHeaders,boost::bind(&NotificationResult,"Prowl",_1,_2)))
 			{
 				_log.Log(LOG_ERROR,"Error sending Prowl Notification!");
 			}
-			else
-			{
-				_log.Log(LOG_STATUS,"Notification sent (Prowl)");
-			}
 		}
 	}
 	//check if NMA enabled
@@ -2207,14 +3168,10 @@ bool CSQLHelper::SendNotification(const std::string &EventID, const std::string
 			std::stringstream sPostData;
 			sPostData << "apikey=" << sValue << "&application=Domoticz&event=" << Message << "&description=" << Message << "&priority=" << Priority;
 			std::vector<std::string> ExtraHeaders;
-			if (!HTTPClient::POST("https://www.notifymyandroid.com/publicapi/notify",sPostData.str(),ExtraHeaders,sResult))
+			if (!m_mainworker.m_httpclient.POST("https://www.notifymyandroid.com/publicapi/notify",sPostData.str(),ExtraHeaders,boost::bind(&NotificationResult,"NMA",_1,_2)))
 			{
 				_log.Log(LOG_ERROR,"Error sending NMA Notification!");
 			}
-			else
-			{
-				_log.Log(LOG_STATUS,"Notification sent (NMA)");
-			}
 		}
 	}
 
@@ -2235,14 +3192,10 @@ bool CSQLHelper::SendNotification(const std::string &EventID, const std::string
 						sprintf(sPostData,"%s&retry=300&expire=3600",sPostData); // retry every 5 minutes, one hour long
 					}
 					std::vector<std::string> ExtraHeaders;
-					if (!HTTPClient::POST("https://api.pushover.net/1/messages.json",sPostData,ExtraHeaders,sResult))
+					if (!m_mainworker.m_httpclient.POST("https://api.pushover.net/1/messages.json",sPostData,ExtraHeaders,boost::bind(&NotificationResult,"Pushover",_1,_2)))
 					{
 						_log.Log(LOG_ERROR,"Error sending Pushover Notification!");
 					}
-					else
-					{
-						_log.Log(LOG_STATUS,"Notification sent (Pushover)");
-					}
 				}
 			}
 		}
@@ -2277,7 +3230,6 @@ bool CSQLHelper::SendNotificationEx(const std::string &Subject, const std::strin
 {
 	int nValue;
 	std::string sValue;
-	std::string sResult;
 
 #if defined WIN32
 	//Make a system tray message
@@ -2298,14 +3250,10 @@ bool CSQLHelper::SendNotificationEx(const std::string &Subject, const std::strin
 			std::stringstream sPostData;
 			sPostData << "apikey=" << sValue << "&application=Domoticz&event=" << uencode.URLEncode(Subject) << "&description=" << uencode.URLEncode(notimessage) << "&priority=" << Priority;
 			std::vector<std::string> ExtraHeaders;
-			if (!HTTPClient::POST("https://api.prowlapp.com/publicapi/add",sPostData.str(),ExtraHeaders,sResult))
+			if (!m_mainworker.m_httpclient.POST("https://api.prowlapp.com/publicapi/add",sPostData.str(),ExtraHeaders,boost::bind(&NotificationResult,"Prowl",_1,_2)))
 			{
 				_log.Log(LOG_ERROR,"Error sending Prowl Notification!");
 			}
-			else
-			{
-				_log.Log(LOG_STATUS,"Notification sent (Prowl)");
-			}
 		}
 	}
 	//check if NMA enabled
@@ -2318,14 +3266,10 @@ bool CSQLHelper::SendNotificationEx(const std::string &Subject, const std::strin
 			std::stringstream sPostData;
 			sPostData << "apikey=" << sValue << "&application=Domoticz&event=" << uencode.URLEncode(Subject) << "&description=" << uencode.URLEncode(notimessage) << "&priority=" << Priority;
 			std::vector<std::string> ExtraHeaders;
-			if (!HTTPClient::POST("https://www.notifymyandroid.com/publicapi/notify",sPostData.str(),ExtraHeaders,sResult))
+			if (!m_mainworker.m_httpclient.POST("https://www.notifymyandroid.com/publicapi/notify",sPostData.str(),ExtraHeaders,boost::bind(&NotificationResult,"NMA",_1,_2)))
 			{
 				_log.Log(LOG_ERROR,"Error sending NMA Notification!");
 			}
-			else
-			{
-				_log.Log(LOG_STATUS,"Notification sent (NMA)");
-			}
 		}
 	}
 	if (GetPreferencesVar("PushoverAPI",nValue,sValue))
@@ -2348,14 +3292,10 @@ bool CSQLHelper::SendNotificationEx(const std::string &Subject, const std::strin
 						sprintf(sPostData,"%s&retry=300&expire=3600",sPostData); // retry every 5 minutes, one hour long
 					}
 					std::vector<std::string> ExtraHeaders;
-					if (!HTTPClient::POST("https://api.pushover.net/1/messages.json",sPostData,ExtraHeaders,sResult))
+					if (!m_mainworker.m_httpclient.POST("https://api.pushover.net/1/messages.json",sPostData,ExtraHeaders,boost::bind(&NotificationResult,"Pushover",_1,_2)))
 					{
 						_log.Log(LOG_ERROR,"Error sending Pushover Notification!");
 					}
-					else
-					{
-						_log.Log(LOG_STATUS,"Notification sent (Pushover)");
-					}
 				}
 			}
 		}
@@ -2400,76 +3340,140 @@ void CSQLHelper::UpdatePreferencesVar(const char *Key, const int nValue, const c
 	if (!m_dbase)
 		return;
 
-	char szTmp[600];
-
-	unsigned long long ID=0;
-
-	std::vector<std::vector<std::string> > result;
-	sprintf(szTmp,"SELECT ROWID FROM Preferences WHERE (Key='%s')",Key);
-	result=query(szTmp);
-	if (result.size()==0)
+	//The database is written outside of m_preferences_mutex: the aggregation jobs read preferences
+	//while they hold the query mutex, taking both here would deadlock with them
+	std::vector<PreferencesVarCallback> callbacks;
 	{
-		//Insert
-		sprintf(szTmp,
-			"INSERT INTO Preferences (Key, nValue, sValue) "
-			"VALUES ('%s','%d','%s')",
-			Key,
-			nValue,sValue);
-		result=query(szTmp);
+		boost::lock_guard<boost::mutex> l(m_preferences_mutex);
+		std::map<std::string,_tPreferencesVar>::iterator itt=m_preferences.find(Key);
+		if (itt!=m_preferences.end())
+		{
+			if ((itt->second.nValue==nValue)&&(itt->second.sValue==sValue))
+				return; //nothing changed
+		}
+		_tPreferencesVar &pvar=m_preferences[Key];
+		pvar.nValue=nValue;
+		pvar.sValue=sValue;
+		std::map<std::string,std::vector<PreferencesVarCallback> >::const_iterator ittCB=m_preferences_callbacks.find(Key);
+		if (ittCB!=m_preferences_callbacks.end())
+			callbacks=ittCB->second;
+	}
+	{
+		//m_preferences_write_mutex is taken before m_sqlQueryMutex. The value written is the one
+		//cached at this point, so when updates race the last one also ends up in the database
+		boost::lock_guard<boost::mutex> l(m_preferences_write_mutex);
+		_tPreferencesVar pvar;
+		{
+			boost::lock_guard<boost::mutex> l2(m_preferences_mutex);
+			pvar=m_preferences[Key];
+		}
+		query(
+			"INSERT OR REPLACE INTO Preferences (Key, nValue, sValue) "
+			"VALUES (?,?,?)",
+			CSQLParams().Add(Key).Add(pvar.nValue).Add(pvar.sValue));
 	}
-	else
+	//Notify subscribers outside of the lock, they are allowed to read/write preferences
+	std::string szKey=Key;
+	std::string szValue=sValue;
+	std::vector<PreferencesVarCallback>::const_iterator itt;
+	for (itt=callbacks.begin(); itt!=callbacks.end(); ++itt)
 	{
-		//Update
-		std::stringstream s_str( result[0][0] );
-		s_str >> ID;
-
-		time_t now = time(0);
-		struct tm ltime;
-		localtime_r(&now,&ltime);
-
-		sprintf(szTmp,
-			"UPDATE Preferences SET Key='%s', nValue=%d, sValue='%s' "
-			"WHERE (ROWID = %llu)",
-			Key,
-			nValue,sValue,
-			ID);
-		result = query(szTmp);
+		(*itt)(szKey,nValue,szValue);
 	}
 }
 
 bool CSQLHelper::GetPreferencesVar(const char *Key, std::string &sValue)
+{
+	int nValue;
+	return GetPreferencesVar(Key, nValue, sValue);
+}
+
+bool CSQLHelper::GetPreferencesVar(const char *Key, int &nValue, std::string &sValue)
 {
 	if (!m_dbase)
 		return false;
 
-	char szTmp[200];
-
-	std::vector<std::vector<std::string> > result;
-	sprintf(szTmp,"SELECT sValue FROM Preferences WHERE (Key='%s')",Key);
-	result=query(szTmp);
-	if (result.size()<1)
+	boost::lock_guard<boost::mutex> l(m_preferences_mutex);
+	std::map<std::string,_tPreferencesVar>::const_iterator itt=m_preferences.find(Key);
+	if (itt==m_preferences.end())
 		return false;
-	std::vector<std::string> sd=result[0];
-	sValue=sd[0];
+	nValue=itt->second.nValue;
+	sValue=itt->second.sValue;
 	return true;
 }
 
-bool CSQLHelper::GetPreferencesVar(const char *Key, int &nValue, std::string &sValue)
+void CSQLHelper::SubscribePreferencesVar(const std::string &Key, const PreferencesVarCallback &callback)
 {
-	if (!m_dbase)
-		return false;
-
-	char szTmp[200];
+	boost::lock_guard<boost::mutex> l(m_preferences_mutex);
+	m_preferences_callbacks[Key].push_back(callback);
+}
 
+void CSQLHelper::LoadPreferences()
+{
 	std::vector<std::vector<std::string> > result;
-	sprintf(szTmp,"SELECT nValue, sValue FROM Preferences WHERE (Key='%s')",Key);
-	result=query(szTmp);
-	if (result.size()<1)
-		return false;
-	std::vector<std::string> sd=result[0];
-	nValue=atoi(sd[0].c_str());
-	sValue=sd[1];
-	return true;
+	result=query("SELECT Key, nValue, sValue FROM Preferences",CSQLParams());
+
+	boost::lock_guard<boost::mutex> l(m_preferences_mutex);
+	m_preferences.clear();
+	std::vector<std::vector<std::string> >::const_iterator itt;
+	for (itt=result.begin(); itt!=result.end(); ++itt)
+	{
+		const std::vector<std::string> &sd=*itt;
+		_tPreferencesVar pvar;
+		pvar.nValue=atoi(sd[1].c_str());
+		pvar.sValue=sd[2];
+		m_preferences[sd[0]]=pvar;
+	}
+}
+
+static std::string GetLocalTimeString(const time_t tm);
+
+void CSQLHelper::OnPreferencesVarChanged(const std::string &Key, const int nValue, const std::string &sValue)
+{
+	if (Key=="WindUnit")
+	{
+		m_windunit=(_eWindUnit)nValue;
+		SetUnitsAndScale();
+	}
+	else if (Key=="TempUnit")
+	{
+		m_tempunit=(_eTempUnit)nValue;
+		SetUnitsAndScale();
+	}
+	else if (Key=="AllowWidgetOrdering")
+		m_bAllowWidgetOrdering=(nValue==1);
+	else if (Key=="ActiveTimerPlan")
+		m_ActiveTimerPlan=nValue;
+	else if (Key=="DisableEventScriptSystem")
+		m_bDisableEventSystem=(nValue==1);
+	else if (Key=="DBWriteMode")
+	{
+		m_write_mode=(_eDBWriteMode)nValue;
+		if (m_write_mode==DBWRITE_IMMEDIATE)
+			FlushWriteQueue();
+	}
+	else if (Key=="DBWriteInterval")
+		m_write_interval=(nValue>0)?nValue:1;
+	else if (Key=="EnableTimeSeriesStore")
+	{
+		if (nValue==1)
+		{
+			if (!m_bTSDBEnabled)
+				OpenTimeSeriesStore(); //filled by the next 5 minute run
+		}
+		else if (m_bTSDBEnabled)
+		{
+			//the database only keeps TSDB_SQLITE_HISTORY_DAYS of 5 minute history, the rest is only in the store
+			if (HasStoreOnlyHistory())
+			{
+				_log.Log(LOG_ERROR,"Time series store: can not be disabled, it holds 5 minute history older than %d days that is not in the database. Set the short log history to %d days first and disable it after the next cleanup.",TSDB_SQLITE_HISTORY_DAYS,TSDB_SQLITE_HISTORY_DAYS);
+				UpdatePreferencesVar("EnableTimeSeriesStore", 1);
+				return;
+			}
+			m_bTSDBEnabled=false;
+			m_bTSDBReady=false;
+		}
+	}
 }
 
 int CSQLHelper::GetLastBackupNo(const char *Key, int &nValue)
@@ -3350,28 +4354,21 @@ void CSQLHelper::UpdateTempVar(const char *Key, const char* sValue)
 	if (!m_dbase)
 		return;
 
-	char szTmp[600];
-
 	unsigned long long ID=0;
 
 	std::vector<std::vector<std::string> > result;
-	sprintf(szTmp,"SELECT ROWID FROM TempVars WHERE (Key='%s')",Key);
-	result=query(szTmp);
+	result=query("SELECT ROWID FROM TempVars WHERE (Key=?)",CSQLParams().Add(Key));
 	if (result.size()==0)
 	{
 		//Insert
-		sprintf(szTmp,
-			"INSERT INTO TempVars (Key, sValue) VALUES ('%s','%s')",
-			Key,sValue);
-		result=query(szTmp);
+		query("INSERT INTO TempVars (Key, sValue) VALUES (?,?)",CSQLParams().Add(Key).Add(sValue));
 	}
 	else
 	{
 		//Update
 		std::stringstream s_str( result[0][0] );
 		s_str >> ID;
-		sprintf(szTmp,"UPDATE TempVars SET sValue='%s' WHERE (ROWID = %llu)",sValue,ID);
-		result = query(szTmp);
+		query("UPDATE TempVars SET sValue=? WHERE (ROWID = ?)",CSQLParams().Add(sValue).Add(ID));
 	}
 }
 
@@ -3380,11 +4377,8 @@ bool CSQLHelper::GetTempVar(const char *Key, int &nValue, std::string &sValue)
 	if (!m_dbase)
 		return false;
 
-	char szTmp[100];
-
 	std::vector<std::vector<std::string> > result;
-	sprintf(szTmp,"SELECT nValue,sValue FROM TempVars WHERE (Key='%s')",Key);
-	result=query(szTmp);
+	result=query("SELECT nValue,sValue FROM TempVars WHERE (Key=?)",CSQLParams().Add(Key));
 	if (result.size()<1)
 		return false;
 	std::vector<std::string> sd=result[0];
@@ -3401,17 +4395,22 @@ void CSQLHelper::Schedule5Minute()
 	//Force WAL flush
 	sqlite3_wal_checkpoint(m_dbase, NULL);
 
-	UpdateTemperatureLog();
-	UpdateRainLog();
-	UpdateWindLog();
-	UpdateUVLog();
-	UpdateMeter();
-	UpdateMultiMeter();
-	UpdatePercentageLog();
-	UpdateFanLog();
+	const _tAggregationJob jobs[] = {
+		{ "Temperature", &CSQLHelper::UpdateTemperatureLog },
+		{ "Rain", &CSQLHelper::UpdateRainLog },
+		{ "Wind", &CSQLHelper::UpdateWindLog },
+		{ "UV", &CSQLHelper::UpdateUVLog },
+		{ "Meter", &CSQLHelper::UpdateMeter },
+		{ "MultiMeter", &CSQLHelper::UpdateMultiMeter },
+		{ "Percentage", &CSQLHelper::UpdatePercentageLog },
+		{ "Fan", &CSQLHelper::UpdateFanLog },
+	};
+	RunAggregationJobs("5 minute log", jobs, sizeof(jobs)/sizeof(jobs[0]));
+	SyncTimeSeriesStore();
 	//Removing the line below could cause a very large database,
 	//and slow(large) data transfer (specially when working remote!!)
 	CleanupShortLog();
+	SetLogDataChanged();
 }
 
 void CSQLHelper::ScheduleDay()
@@ -3422,1138 +4421,505 @@ void CSQLHelper::ScheduleDay()
 	//Force WAL flush
 	sqlite3_wal_checkpoint(m_dbase, NULL);
 
-	AddCalendarTemperature();
-	AddCalendarUpdateRain();
-	AddCalendarUpdateUV();
-	AddCalendarUpdateWind();
-	AddCalendarUpdateMeter();
-	AddCalendarUpdateMultiMeter();
-	AddCalendarUpdatePercentage();
-	AddCalendarUpdateFan();
+	const _tAggregationJob jobs[] = {
+		{ "Temperature", &CSQLHelper::AddCalendarTemperature },
+		{ "Rain", &CSQLHelper::AddCalendarUpdateRain },
+		{ "UV", &CSQLHelper::AddCalendarUpdateUV },
+		{ "Wind", &CSQLHelper::AddCalendarUpdateWind },
+		{ "Meter", &CSQLHelper::AddCalendarUpdateMeter },
+		{ "MultiMeter", &CSQLHelper::AddCalendarUpdateMultiMeter },
+		{ "Percentage", &CSQLHelper::AddCalendarUpdatePercentage },
+		{ "Fan", &CSQLHelper::AddCalendarUpdateFan },
+	};
+	RunAggregationJobs("Calendar", jobs, sizeof(jobs)/sizeof(jobs[0]));
 	CleanupLightLog();
+	SetLogDataChanged();
 }
 
-void CSQLHelper::UpdateTemperatureLog()
+//Runs every job in its own transaction and keeps how long each of them took (getdbwriterstats).
+//The query mutex is held while a job runs so no other statement ends up in its transaction,
+//and released between the jobs so other queries do not wait for the whole run
+void CSQLHelper::RunAggregationJobs(const char *szSchedule, const _tAggregationJob *pJobs, const size_t nJobs)
 {
-	char szTmp[600];
-
-	time_t now = mytime(NULL);
-	if (now==0)
-		return;
-	struct tm tm1;
-	localtime_r(&now,&tm1);
-
-	int SensorTimeOut=60;
-	GetPreferencesVar("SensorTimeout", SensorTimeOut);
-
-	unsigned long long ID=0;
-
-	std::vector<std::vector<std::string> > result;
-	sprintf(szTmp,"SELECT ID,Type,SubType,nValue,sValue,LastUpdate FROM DeviceStatus WHERE (Type=%d OR Type=%d OR Type=%d OR Type=%d OR Type=%d OR Type=%d OR Type=%d OR Type=%d OR Type=%d OR Type=%d OR Type=%d OR Type=%d OR (Type=%d AND SubType=%d) OR (Type=%d AND SubType=%d))",
-		pTypeTEMP,
-		pTypeHUM,
-		pTypeTEMP_HUM,
-		pTypeTEMP_HUM_BARO,
-		pTypeTEMP_BARO,
-		pTypeUV,
-		pTypeWIND,
-		pTypeThermostat1,
-		pTypeRFXSensor,
-		pTypeRego6XXTemp,
-		pTypeEvohomeZone,
-		pTypeEvohomeWater,
-		pTypeGeneral,sTypeSystemTemp,
-		pTypeThermostat,sTypeThermSetpoint
-		);
-	result=query(szTmp);
-	if (result.size()>0)
+	_tAggregationStats astats;
+	astats.LastRun=mytime(NULL);
+	astats.bLastResult=true;
+	boost::posix_time::ptime tstart=boost::posix_time::microsec_clock::universal_time();
+	for (size_t ii=0; ii<nJobs; ii++)
 	{
-		std::vector<std::vector<std::string> >::const_iterator itt;
-		for (itt=result.begin(); itt!=result.end(); ++itt)
+		boost::posix_time::ptime tjob=boost::posix_time::microsec_clock::universal_time();
 		{
-			std::vector<std::string> sd=*itt;
-
-			unsigned long long ID;
-			std::stringstream s_str( sd[0] );
-			s_str >> ID;
-
-			unsigned char dType=atoi(sd[1].c_str());
-			unsigned char dSubType=atoi(sd[2].c_str());
-			int nValue=atoi(sd[3].c_str());
-			std::string sValue=sd[4];
-
-			//do not include sensors that have no reading within an hour
-			std::string sLastUpdate=sd[5];
-			struct tm ntime;
-			ntime.tm_isdst=tm1.tm_isdst;
-			ntime.tm_year=atoi(sLastUpdate.substr(0,4).c_str())-1900;
-			ntime.tm_mon=atoi(sLastUpdate.substr(5,2).c_str())-1;
-			ntime.tm_mday=atoi(sLastUpdate.substr(8,2).c_str());
-			ntime.tm_hour=atoi(sLastUpdate.substr(11,2).c_str());
-			ntime.tm_min=atoi(sLastUpdate.substr(14,2).c_str());
-			ntime.tm_sec=atoi(sLastUpdate.substr(17,2).c_str());
-			time_t checktime=mktime(&ntime);
-			if (now-checktime>=SensorTimeOut*60)
+			CSQLQueryLock l(m_sqlQueryMutex);
+			//queued sensor updates are not part of the job's transaction
+			ApplyWriteQueue();
+			if (sqlite3_exec(m_dbase, "BEGIN TRANSACTION;", NULL, NULL, NULL)!=SQLITE_OK)
+			{
+				_log.Log(LOG_ERROR,"SQL: %s, %s: could not start transaction (%s)",szSchedule,pJobs[ii].szName,sqlite3_errmsg(m_dbase));
+				astats.bLastResult=false;
 				continue;
-
-			std::vector<std::string> splitresults;
-			StringSplit(sValue, ";", splitresults);
-			if (splitresults.size()<1)
-				continue; //impossible
-
-			float temp=0;
-			float chill=0;
-			unsigned char humidity=0;
-			int barometer=0;
-			float dewpoint=0;
-			float setpoint=0;
-
-			switch (dType)
+			}
+			(this->*pJobs[ii].pJob)();
+			if (sqlite3_get_autocommit(m_dbase)!=0)
 			{
-			case pTypeRego6XXTemp:
-			case pTypeTEMP:
-			case pTypeThermostat:
-				temp=(float)atof(splitresults[0].c_str());
-				break;
-			case pTypeThermostat1:
-				temp=(float)atof(splitresults[0].c_str());
-				break;
-			case pTypeEvohomeWater:
-				if (splitresults.size()>=2)
-				{
-					temp=(float)atof(splitresults[0].c_str());
-					setpoint=(float)(splitresults[1]=="On")?60:0;
-					//FIXME hack setpoint just on or off...may throw graph out so maybe pick sensible on off values? 
-					//(if the actual hw set point was retrievable should use that otherwise some config option)
-					//actually if we plot the average it should give us an idea of how often hw has been switched on
-					//more meaningful if it was plotted against the zone valve & boiler relay i guess (actual time hw heated)
-				}
-				break;
-			case pTypeEvohomeZone:
-				if (splitresults.size()>=2)
-				{
-					temp=(float)atof(splitresults[0].c_str());
-					setpoint=(float)atof(splitresults[1].c_str());
-				}
-				break;
-			case pTypeHUM:
-				humidity=nValue;
-				break;
-			case pTypeTEMP_HUM:
-				if (splitresults.size()>=2)
-				{
-					temp=(float)atof(splitresults[0].c_str());
-					humidity=atoi(splitresults[1].c_str());
-					dewpoint=(float)CalculateDewPoint(temp,humidity);
-				}
-				break;
-			case pTypeTEMP_HUM_BARO:
-				if (splitresults.size()==5)
-				{
-					temp=(float)atof(splitresults[0].c_str());
-					humidity=atoi(splitresults[1].c_str());
-					if (dSubType==sTypeTHBFloat)
-						barometer=int(atof(splitresults[3].c_str())*10.0f);
-					else
-						barometer=atoi(splitresults[3].c_str());
-					dewpoint=(float)CalculateDewPoint(temp,humidity);
-				}
-				break;
-			case pTypeTEMP_BARO:
-				if (splitresults.size()>=2)
-				{
-					temp=(float)atof(splitresults[0].c_str());
-					barometer=int(atof(splitresults[1].c_str())*10.0f);
-				}
-				break;
-			case pTypeUV:
-				if (dSubType!=sTypeUV3)
-					continue;
-				if (splitresults.size()>=2)
-				{
-					temp=(float)atof(splitresults[1].c_str());
-				}
-				break;
-			case pTypeWIND:
-				if ((dSubType!=sTypeWIND4)&&(dSubType!=sTypeWINDNoTemp))
-					continue;
-				if (splitresults.size()>=6)
-				{
-					temp=(float)atof(splitresults[4].c_str());
-					chill=(float)atof(splitresults[5].c_str());
-				}
-				break;
-			case pTypeRFXSensor:
-				if (dSubType!=sTypeRFXSensorTemp)
-					continue;
-				temp=(float)atof(splitresults[0].c_str());
-				break;
-			case pTypeGeneral:
-				if (dSubType==sTypeSystemTemp)
-					temp=(float)atof(splitresults[0].c_str());
-				break;
+				//an error already rolled the transaction back
+				_log.Log(LOG_ERROR,"SQL: %s, %s: aggregation was rolled back",szSchedule,pJobs[ii].szName);
+				astats.bLastResult=false;
+			}
+			else if (sqlite3_exec(m_dbase, "COMMIT;", NULL, NULL, NULL)!=SQLITE_OK)
+			{
+				_log.Log(LOG_ERROR,"SQL: %s, %s: commit failed (%s)",szSchedule,pJobs[ii].szName,sqlite3_errmsg(m_dbase));
+				sqlite3_exec(m_dbase, "ROLLBACK;", NULL, NULL, NULL);
+				astats.bLastResult=false;
 			}
-			//insert record
-			sprintf(szTmp,
-				"INSERT INTO Temperature (DeviceRowID, Temperature, Chill, Humidity, Barometer, DewPoint, SetPoint) "
-				"VALUES ('%llu', '%.2f', '%.2f', '%d', '%d', '%.2f', '%.2f')",
-				ID,
-				temp,
-				chill,
-				humidity,
-				barometer,
-				dewpoint,
-				setpoint
-				);
-			std::vector<std::vector<std::string> > result2;
-			result2=query(szTmp);
 		}
+		astats.JobTimes.push_back(std::make_pair(std::string(pJobs[ii].szName),(long)(boost::posix_time::microsec_clock::universal_time()-tjob).total_milliseconds()));
 	}
+	astats.TotalTime=(long)(boost::posix_time::microsec_clock::universal_time()-tstart).total_milliseconds();
+
+	boost::lock_guard<boost::mutex> l(m_aggregation_stats_mutex);
+	m_aggregation_stats[szSchedule]=astats;
 }
 
-void CSQLHelper::UpdateRainLog()
+void CSQLHelper::GetAggregationStats(std::map<std::string, _tAggregationStats> &stats)
 {
-	char szTmp[600];
-	time_t now = mytime(NULL);
-	if (now==0)
-		return;
-	struct tm tm1;
-	localtime_r(&now,&tm1);
+	boost::lock_guard<boost::mutex> l(m_aggregation_stats_mutex);
+	stats=m_aggregation_stats;
+}
 
-	int SensorTimeOut=60;
-	GetPreferencesVar("SensorTimeout", SensorTimeOut);
+unsigned long CSQLHelper::GetLogDataVersion()
+{
+	boost::lock_guard<boost::mutex> l(m_logdata_mutex);
+	return m_logdata_version;
+}
 
-	unsigned long long ID=0;
+void CSQLHelper::SetLogDataChanged()
+{
+	boost::lock_guard<boost::mutex> l(m_logdata_mutex);
+	m_logdata_version++;
+}
 
-	std::vector<std::vector<std::string> > result;
-	sprintf(szTmp,"SELECT ID,Type,SubType,nValue,sValue,LastUpdate FROM DeviceStatus WHERE (Type=%d)",
-		pTypeRAIN
-		);
-	result=query(szTmp);
-	if (result.size()>0)
-	{
-		std::vector<std::vector<std::string> >::const_iterator itt;
-		for (itt=result.begin(); itt!=result.end(); ++itt)
-		{
-			std::vector<std::string> sd=*itt;
+unsigned long long CSQLHelper::GetChangeSequence()
+{
+	boost::lock_guard<boost::mutex> l(m_change_journal_mutex);
+	return m_change_journal_seq;
+}
 
-			unsigned long long ID;
-			std::stringstream s_str( sd[0] );
-			s_str >> ID;
-			unsigned char dType=atoi(sd[1].c_str());
-			unsigned char dSubType=atoi(sd[2].c_str());
-			int nValue=atoi(sd[3].c_str());
-			std::string sValue=sd[4];
+bool CSQLHelper::GetChangesSince(const unsigned long long since, unsigned long long &actseq, std::set<unsigned long long> &devices, std::set<unsigned long long> &scenes, std::set<unsigned long long> *pUserVariables)
+{
+	boost::lock_guard<boost::mutex> l(m_change_journal_mutex);
+	actseq=m_change_journal_seq;
+	if ((since<m_change_journal_base)||(since>m_change_journal_seq))
+		return false; //from a previous run, or invalid
+	if (m_change_journal_seq-since>CHANGE_JOURNAL_SIZE)
+		return false; //fell off the end of the journal
+	for (unsigned long long seq=since+1; seq<=m_change_journal_seq; seq++)
+	{
+		const _tChangeJournalItem &jitem=m_change_journal[seq%CHANGE_JOURNAL_SIZE];
+		if ((jitem.type==CJTYPE_USERVARIABLE)&&(pUserVariables==NULL))
+			continue;
+		if ((jitem.type==CJTYPE_RESYNC)||(jitem.op==SQLITE_DELETE))
+			return false;
+		if (jitem.type==CJTYPE_DEVICE)
+			devices.insert(jitem.rowid);
+		else if (jitem.type==CJTYPE_SCENE)
+			scenes.insert(jitem.rowid);
+		else
+			pUserVariables->insert(jitem.rowid);
+	}
+	return true;
+}
 
-			//do not include sensors that have no reading within an hour
-			std::string sLastUpdate=sd[5];
-			struct tm ntime;
-			ntime.tm_isdst=tm1.tm_isdst;
-			ntime.tm_year=atoi(sLastUpdate.substr(0,4).c_str())-1900;
-			ntime.tm_mon=atoi(sLastUpdate.substr(5,2).c_str())-1;
-			ntime.tm_mday=atoi(sLastUpdate.substr(8,2).c_str());
-			ntime.tm_hour=atoi(sLastUpdate.substr(11,2).c_str());
-			ntime.tm_min=atoi(sLastUpdate.substr(14,2).c_str());
-			ntime.tm_sec=atoi(sLastUpdate.substr(17,2).c_str());
-			time_t checktime=mktime(&ntime);
-			if (now-checktime>=SensorTimeOut*60)
-				continue;
+bool CSQLHelper::WaitForChanges(const unsigned long long since, const int timeoutms)
+{
+	boost::unique_lock<boost::mutex> l(m_change_journal_mutex);
+	if (m_change_journal_seq==since)
+		m_change_journal_cond.timed_wait(l, boost::posix_time::milliseconds(timeoutms));
+	return (m_change_journal_seq!=since);
+}
 
-			std::vector<std::string> splitresults;
-			StringSplit(sValue, ";", splitresults);
-			if (splitresults.size()<2)
-				continue; //impossible
+//Local time as stored in the LastUpdate/Date columns
+static std::string GetLocalTimeString(const time_t tm)
+{
+	struct tm ltime;
+	localtime_r(&tm,&ltime);
+	char szTmp[40];
+	sprintf(szTmp,"%04d-%02d-%02d %02d:%02d:%02d",ltime.tm_year+1900,ltime.tm_mon+1,ltime.tm_mday,ltime.tm_hour,ltime.tm_min,ltime.tm_sec);
+	return szTmp;
+}
+
+//Date range of yesterday, used by the calendar jobs
+static void GetYesterdayRange(std::string &szDateStart, std::string &szDateEnd)
+{
+	char szTmp[40];
+	time_t now = mytime(NULL);
+	struct tm tm1;
+	localtime_r(&now,&tm1);
 
-			float total=0;
-			int rate=0;
+	struct tm ltime;
+	ltime.tm_isdst=tm1.tm_isdst;
+	ltime.tm_hour=0;
+	ltime.tm_min=0;
+	ltime.tm_sec=0;
+	ltime.tm_year=tm1.tm_year;
+	ltime.tm_mon=tm1.tm_mon;
+	ltime.tm_mday=tm1.tm_mday;
 
-			rate=atoi(splitresults[0].c_str());
-			total=(float)atof(splitresults[1].c_str());
+	sprintf(szTmp,"%04d-%02d-%02d",ltime.tm_year+1900,ltime.tm_mon+1,ltime.tm_mday);
+	szDateEnd=szTmp;
 
-			//insert record
-			sprintf(szTmp,
-				"INSERT INTO Rain (DeviceRowID, Total, Rate) "
-				"VALUES ('%llu', '%.2f', '%d')",
-				ID,
-				total,
-				rate
-				);
-			std::vector<std::vector<std::string> > result2;
-			result2=query(szTmp);
-		}
-	}
+	//Subtract one day
+	ltime.tm_mday -= 1;
+	time_t later = mktime(&ltime);
+	struct tm tm2;
+	localtime_r(&later,&tm2);
+	sprintf(szTmp,"%04d-%02d-%02d",tm2.tm_year+1900,tm2.tm_mon+1,tm2.tm_mday);
+	szDateStart=szTmp;
 }
 
-void CSQLHelper::UpdateWindLog()
+void CSQLHelper::UpdateTemperatureLog()
 {
-	char szTmp[600];
 	time_t now = mytime(NULL);
 	if (now==0)
 		return;
-	struct tm tm1;
-	localtime_r(&now,&tm1);
 
 	int SensorTimeOut=60;
 	GetPreferencesVar("SensorTimeout", SensorTimeOut);
+	//do not include sensors that have no reading within the sensor timeout
+	std::string szCutoff=GetLocalTimeString(now-SensorTimeOut*60);
 
-	unsigned long long ID=0;
+	char szTmp[4000];
+	sprintf(szTmp,
+		"INSERT INTO Temperature (DeviceRowID, Temperature, Chill, Humidity, Barometer, DewPoint, SetPoint) "
+		"SELECT ID, round(Temp,2), round(Chill,2), Humidity, Barometer, "
+		"CASE WHEN (Type=%d AND Fields>=2) OR (Type=%d AND Fields=5) THEN round(DEWPOINT(Temp,Humidity),2) ELSE 0 END, " //TEMP_HUM, TEMP_HUM_BARO
+		"round(SetPoint,2) FROM ("
+			"SELECT ID, Type, Fields, "
+			"CASE "
+				"WHEN Type IN (%d,%d,%d,%d,%d,%d) THEN CAST(SVALUE(sValue,0) AS REAL) " //Rego6XXTemp, TEMP, Thermostat, Thermostat1, RFXSensor, General
+				"WHEN Type IN (%d,%d,%d,%d) AND Fields>=2 THEN CAST(SVALUE(sValue,0) AS REAL) " //EvohomeWater, EvohomeZone, TEMP_HUM, TEMP_BARO
+				"WHEN Type=%d AND Fields=5 THEN CAST(SVALUE(sValue,0) AS REAL) " //TEMP_HUM_BARO
+				"WHEN Type=%d AND Fields>=2 THEN CAST(SVALUE(sValue,1) AS REAL) " //UV
+				"WHEN Type=%d AND Fields>=6 THEN CAST(SVALUE(sValue,4) AS REAL) " //WIND
+				"ELSE 0 END AS Temp, "
+			"CASE WHEN Type=%d AND Fields>=6 THEN CAST(SVALUE(sValue,5) AS REAL) ELSE 0 END AS Chill, " //WIND
+			"CASE "
+				"WHEN Type=%d THEN nValue " //HUM
+				"WHEN (Type=%d AND Fields>=2) OR (Type=%d AND Fields=5) THEN CAST(SVALUE(sValue,1) AS INTEGER) " //TEMP_HUM, TEMP_HUM_BARO
+				"ELSE 0 END AS Humidity, "
+			"CASE "
+				"WHEN Type=%d AND Fields=5 AND SubType=%d THEN CAST(CAST(SVALUE(sValue,3) AS REAL)*10 AS INTEGER) " //TEMP_HUM_BARO, THBFloat
+				"WHEN Type=%d AND Fields=5 THEN CAST(SVALUE(sValue,3) AS INTEGER) " //TEMP_HUM_BARO
+				"WHEN Type=%d AND Fields>=2 THEN CAST(CAST(SVALUE(sValue,1) AS REAL)*10 AS INTEGER) " //TEMP_BARO
+				"ELSE 0 END AS Barometer, "
+			"CASE "
+				"WHEN Type=%d AND Fields>=2 THEN (CASE WHEN SVALUE(sValue,1)='On' THEN 60 ELSE 0 END) " //EvohomeWater, on/off only
+				"WHEN Type=%d AND Fields>=2 THEN CAST(SVALUE(sValue,1) AS REAL) " //EvohomeZone
+				"ELSE 0 END AS SetPoint "
+			"FROM (SELECT ID, Type, SubType, nValue, sValue, SVALUE_COUNT(sValue) AS Fields FROM DeviceStatus "
+				"WHERE (Type IN (%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d) OR (Type=%d AND SubType=%d) OR (Type=%d AND SubType=%d)) AND (LastUpdate>?)) "
+			"WHERE (Fields>=1) AND NOT (Type=%d AND SubType!=%d) AND NOT (Type=%d AND SubType NOT IN (%d,%d)) AND NOT (Type=%d AND SubType!=%d)"
+		")",
+		pTypeTEMP_HUM, pTypeTEMP_HUM_BARO,
+		pTypeRego6XXTemp, pTypeTEMP, pTypeThermostat, pTypeThermostat1, pTypeRFXSensor, pTypeGeneral,
+		pTypeEvohomeWater, pTypeEvohomeZone, pTypeTEMP_HUM, pTypeTEMP_BARO,
+		pTypeTEMP_HUM_BARO,
+		pTypeUV,
+		pTypeWIND,
+		pTypeWIND,
+		pTypeHUM,
+		pTypeTEMP_HUM, pTypeTEMP_HUM_BARO,
+		pTypeTEMP_HUM_BARO, sTypeTHBFloat,
+		pTypeTEMP_HUM_BARO,
+		pTypeTEMP_BARO,
+		pTypeEvohomeWater,
+		pTypeEvohomeZone,
+		pTypeTEMP, pTypeHUM, pTypeTEMP_HUM, pTypeTEMP_HUM_BARO, pTypeTEMP_BARO, pTypeUV, pTypeWIND, pTypeThermostat1, pTypeRFXSensor, pTypeRego6XXTemp, pTypeEvohomeZone, pTypeEvohomeWater,
+		pTypeGeneral, sTypeSystemTemp,
+		pTypeThermostat, sTypeThermSetpoint,
+		pTypeUV, sTypeUV3,
+		pTypeWIND, sTypeWIND4, sTypeWINDNoTemp,
+		pTypeRFXSensor, sTypeRFXSensorTemp
+		);
+	query(szTmp,CSQLParams().Add(szCutoff));
+}
 
-	std::vector<std::vector<std::string> > result;
-	sprintf(szTmp,"SELECT ID,Type,SubType,nValue,sValue,LastUpdate FROM DeviceStatus WHERE (Type=%d)", pTypeWIND);
-	result=query(szTmp);
-	if (result.size()>0)
-	{
-		std::vector<std::vector<std::string> >::const_iterator itt;
-		for (itt=result.begin(); itt!=result.end(); ++itt)
-		{
-			std::vector<std::string> sd=*itt;
+void CSQLHelper::UpdateRainLog()
+{
+	time_t now = mytime(NULL);
+	if (now==0)
+		return;
 
-			unsigned long long ID;
-			std::stringstream s_str( sd[0] );
-			s_str >> ID;
-			unsigned char dType=atoi(sd[1].c_str());
-			unsigned char dSubType=atoi(sd[2].c_str());
-			int nValue=atoi(sd[3].c_str());
-			std::string sValue=sd[4];
+	int SensorTimeOut=60;
+	GetPreferencesVar("SensorTimeout", SensorTimeOut);
+	std::string szCutoff=GetLocalTimeString(now-SensorTimeOut*60);
 
-			//do not include sensors that have no reading within an hour
-			std::string sLastUpdate=sd[5];
-			struct tm ntime;
-			ntime.tm_isdst=tm1.tm_isdst;
-			ntime.tm_year=atoi(sLastUpdate.substr(0,4).c_str())-1900;
-			ntime.tm_mon=atoi(sLastUpdate.substr(5,2).c_str())-1;
-			ntime.tm_mday=atoi(sLastUpdate.substr(8,2).c_str());
-			ntime.tm_hour=atoi(sLastUpdate.substr(11,2).c_str());
-			ntime.tm_min=atoi(sLastUpdate.substr(14,2).c_str());
-			ntime.tm_sec=atoi(sLastUpdate.substr(17,2).c_str());
-			time_t checktime=mktime(&ntime);
-			if (now-checktime>=SensorTimeOut*60)
-				continue;
+	char szTmp[600];
+	sprintf(szTmp,
+		"INSERT INTO Rain (DeviceRowID, Total, Rate) "
+		"SELECT ID, round(CAST(SVALUE(sValue,1) AS REAL),2), CAST(SVALUE(sValue,0) AS INTEGER) FROM DeviceStatus "
+		"WHERE (Type=%d) AND (LastUpdate>?) AND (SVALUE_COUNT(sValue)>=2)",
+		pTypeRAIN
+		);
+	query(szTmp,CSQLParams().Add(szCutoff));
+}
 
-			std::vector<std::string> splitresults;
-			StringSplit(sValue, ";", splitresults);
-			if (splitresults.size()<4)
-				continue; //impossible
+void CSQLHelper::UpdateWindLog()
+{
+	time_t now = mytime(NULL);
+	if (now==0)
+		return;
 
-			float direction=(float)atof(splitresults[0].c_str());
-			int speed=atoi(splitresults[2].c_str());
-			int gust=atoi(splitresults[3].c_str());
+	int SensorTimeOut=60;
+	GetPreferencesVar("SensorTimeout", SensorTimeOut);
+	std::string szCutoff=GetLocalTimeString(now-SensorTimeOut*60);
 
-			//insert record
-			sprintf(szTmp,
-				"INSERT INTO Wind (DeviceRowID, Direction, Speed, Gust) "
-				"VALUES ('%llu', '%.2f', '%d', '%d')",
-				ID,
-				direction,
-				speed,
-				gust
-				);
-			std::vector<std::vector<std::string> > result2;
-			result2=query(szTmp);
-		}
-	}
+	char szTmp[600];
+	sprintf(szTmp,
+		"INSERT INTO Wind (DeviceRowID, Direction, Speed, Gust) "
+		"SELECT ID, round(CAST(SVALUE(sValue,0) AS REAL),2), CAST(SVALUE(sValue,2) AS INTEGER), CAST(SVALUE(sValue,3) AS INTEGER) FROM DeviceStatus "
+		"WHERE (Type=%d) AND (LastUpdate>?) AND (SVALUE_COUNT(sValue)>=4)",
+		pTypeWIND
+		);
+	query(szTmp,CSQLParams().Add(szCutoff));
 }
 
 void CSQLHelper::UpdateUVLog()
 {
-	char szTmp[600];
 	time_t now = mytime(NULL);
 	if (now==0)
 		return;
-	struct tm tm1;
-	localtime_r(&now,&tm1);
 
 	int SensorTimeOut=60;
 	GetPreferencesVar("SensorTimeout", SensorTimeOut);
+	std::string szCutoff=GetLocalTimeString(now-SensorTimeOut*60);
 
-	unsigned long long ID=0;
-
-	std::vector<std::vector<std::string> > result;
-	sprintf(szTmp,"SELECT ID,Type,SubType,nValue,sValue,LastUpdate FROM DeviceStatus WHERE (Type=%d)", pTypeUV);
-	result=query(szTmp);
-	if (result.size()>0)
-	{
-		std::vector<std::vector<std::string> >::const_iterator itt;
-		for (itt=result.begin(); itt!=result.end(); ++itt)
-		{
-			std::vector<std::string> sd=*itt;
-
-			unsigned long long ID;
-			std::stringstream s_str( sd[0] );
-			s_str >> ID;
-			unsigned char dType=atoi(sd[1].c_str());
-			unsigned char dSubType=atoi(sd[2].c_str());
-			int nValue=atoi(sd[3].c_str());
-			std::string sValue=sd[4];
-
-			//do not include sensors that have no reading within an hour
-			std::string sLastUpdate=sd[5];
-			struct tm ntime;
-			ntime.tm_isdst=tm1.tm_isdst;
-			ntime.tm_year=atoi(sLastUpdate.substr(0,4).c_str())-1900;
-			ntime.tm_mon=atoi(sLastUpdate.substr(5,2).c_str())-1;
-			ntime.tm_mday=atoi(sLastUpdate.substr(8,2).c_str());
-			ntime.tm_hour=atoi(sLastUpdate.substr(11,2).c_str());
-			ntime.tm_min=atoi(sLastUpdate.substr(14,2).c_str());
-			ntime.tm_sec=atoi(sLastUpdate.substr(17,2).c_str());
-			time_t checktime=mktime(&ntime);
-			if (now-checktime>=SensorTimeOut*60)
-				continue;
-
-			std::vector<std::string> splitresults;
-			StringSplit(sValue, ";", splitresults);
-			if (splitresults.size()<1)
-				continue; //impossible
-
-			float level=(float)atof(splitresults[0].c_str());
-
-			//insert record
-			sprintf(szTmp,
-				"INSERT INTO UV (DeviceRowID, Level) "
-				"VALUES ('%llu', '%.1f')",
-				ID,
-				level
-				);
-			std::vector<std::vector<std::string> > result2;
-			result2=query(szTmp);
-		}
-	}
+	char szTmp[600];
+	sprintf(szTmp,
+		"INSERT INTO UV (DeviceRowID, Level) "
+		"SELECT ID, round(CAST(SVALUE(sValue,0) AS REAL),1) FROM DeviceStatus "
+		"WHERE (Type=%d) AND (LastUpdate>?) AND (SVALUE_COUNT(sValue)>=1)",
+		pTypeUV
+		);
+	query(szTmp,CSQLParams().Add(szCutoff));
 }
 
 void CSQLHelper::UpdateMeter()
 {
-	char szTmp[700];
 	time_t now = mytime(NULL);
 	if (now==0)
 		return;
 	struct tm tm1;
 	localtime_r(&now,&tm1);
 
-	struct tm ltime;
-	ltime.tm_isdst=tm1.tm_isdst;
-	ltime.tm_hour=0;
-	ltime.tm_min=0;
-	ltime.tm_sec=0;
-	ltime.tm_year=tm1.tm_year;
-	ltime.tm_mon=tm1.tm_mon;
-	ltime.tm_mday=tm1.tm_mday;
 	char szDateToday[100];
-	sprintf(szDateToday,"%04d-%02d-%02d",ltime.tm_year+1900,ltime.tm_mon+1,ltime.tm_mday);
+	sprintf(szDateToday,"%04d-%02d-%02d",tm1.tm_year+1900,tm1.tm_mon+1,tm1.tm_mday);
 
 	int SensorTimeOut=60;
 	GetPreferencesVar("SensorTimeout", SensorTimeOut);
+	std::string szCutoff=GetLocalTimeString(now-SensorTimeOut*60);
+	//P1 Gas meter transmits results every 1 a 2 hours
+	std::string szCutoffGas=GetLocalTimeString(now-3*3600);
 
-	unsigned long long ID=0;
-
-	std::vector<std::vector<std::string> > result;
-	std::vector<std::vector<std::string> > result2;
-
+	char szTmp[4000];
 	sprintf(szTmp,
-		"SELECT ID,HardwareID,DeviceID,Unit,Type,SubType,nValue,sValue,LastUpdate FROM DeviceStatus WHERE ("
-		"Type=%d OR " //pTypeRFXMeter
-		"Type=%d OR " //pTypeP1Gas
-		"Type=%d OR " //pTypeYouLess
-		"Type=%d OR " //pTypeENERGY
-		"Type=%d OR " //pTypePOWER
-		"Type=%d OR " //pTypeAirQuality
-		"Type=%d OR " //pTypeUsage
-		"Type=%d OR " //pTypeLux
-		"Type=%d OR " //pTypeWEIGHT
-		"(Type=%d AND SubType=%d) OR " //pTypeRego6XXValue,sTypeRego6XXCounter
-		"(Type=%d AND SubType=%d) OR " //pTypeGeneral,sTypeVisibility
-		"(Type=%d AND SubType=%d) OR " //pTypeGeneral,sTypeSolarRadiation
-		"(Type=%d AND SubType=%d) OR " //pTypeGeneral,sTypeSoilMoisture
-		"(Type=%d AND SubType=%d) OR " //pTypeGeneral,sTypeLeafWetness
-		"(Type=%d AND SubType=%d) OR " //pTypeRFXSensor,sTypeRFXSensorAD
-		"(Type=%d AND SubType=%d) OR" //pTypeRFXSensor,sTypeRFXSensorVolt
-		"(Type=%d AND SubType=%d) OR"  //pTypeGeneral,sTypeVoltage
-		"(Type=%d AND SubType=%d)"	  //pTypeGeneral,sTypePressure
-		")",
-		pTypeRFXMeter,
-		pTypeP1Gas,
+		"INSERT INTO Meter (DeviceRowID, Value, [Usage]) "
+		"SELECT ID, Value, Usage FROM ("
+			"SELECT ID, "
+			"CASE "
+				"WHEN Type=%d THEN CAST(SVALUE(sValue,0) AS INTEGER) " //YouLess
+				"WHEN Type IN (%d,%d) THEN CAST(round(CAST(SVALUE(sValue,1) AS REAL)*100) AS INTEGER) " //ENERGY, POWER
+				"WHEN Type=%d OR (Type=%d AND SubType IN (%d,%d)) THEN nValue " //AirQuality, SoilMoisture, LeafWetness
+				"WHEN Type=%d THEN CAST(round(CAST(sValue AS REAL)) AS INTEGER) " //Lux
+				"WHEN Type=%d THEN CAST(CAST(sValue AS REAL) AS INTEGER) " //RFXSensor
+				"WHEN Type=%d AND SubType=%d THEN CAST(CAST(sValue AS REAL)*1000 AS INTEGER) " //Voltage
+				"WHEN Type IN (%d,%d,%d) THEN CAST(CAST(sValue AS REAL)*10 AS INTEGER) " //Visibility, SolarRadiation, Pressure, WEIGHT, Usage
+				"ELSE CAST(sValue AS INTEGER) END AS Value, " //RFXMeter, P1Gas, Rego6XX counter
+			"CASE "
+				"WHEN Type=%d THEN CAST(SVALUE(sValue,1) AS INTEGER) " //YouLess
+				"WHEN Type IN (%d,%d) THEN CAST(SVALUE(sValue,0) AS INTEGER) " //ENERGY, POWER
+				"ELSE 0 END AS Usage, "
+			"CASE WHEN Type IN (%d,%d,%d,%d,%d) THEN 1 ELSE 0 END AS SkipSame " //RFXMeter, YouLess, POWER, Usage, Rego6XX counter
+			"FROM DeviceStatus WHERE ("
+				"Type IN (%d,%d,%d,%d,%d,%d,%d,%d,%d) OR "
+				"(Type=%d AND SubType=%d) OR "
+				"(Type=%d AND SubType IN (%d,%d,%d,%d,%d,%d)) OR "
+				"(Type=%d AND SubType IN (%d,%d))"
+			") "
+			"AND (((Type!=%d) AND (LastUpdate>?)) OR ((Type=%d) AND (LastUpdate>?))) "
+			"AND ((Type NOT IN (%d,%d,%d)) OR (SVALUE_COUNT(sValue)>=2))"
+		") AS m "
+		//if last value == actual value, then do not insert it
+		"WHERE (m.SkipSame=0) OR IFNULL((SELECT Value FROM Meter WHERE (DeviceRowID=m.ID) AND (Date>=?) ORDER BY ROWID DESC LIMIT 1)!=m.Value,1)",
 		pTypeYouLess,
-		pTypeENERGY,
-		pTypePOWER,
-		pTypeAirQuality,
-		pTypeUsage,
+		pTypeENERGY, pTypePOWER,
+		pTypeAirQuality, pTypeGeneral, sTypeSoilMoisture, sTypeLeafWetness,
 		pTypeLux,
-		pTypeWEIGHT,
-		pTypeRego6XXValue,sTypeRego6XXCounter,
-		pTypeGeneral,sTypeVisibility,
-		pTypeGeneral,sTypeSolarRadiation,
-		pTypeGeneral,sTypeSoilMoisture,
-		pTypeGeneral,sTypeLeafWetness,
-		pTypeRFXSensor,sTypeRFXSensorAD,
-		pTypeRFXSensor,sTypeRFXSensorVolt,
-		pTypeGeneral,sTypeVoltage,
-		pTypeGeneral,sTypePressure
+		pTypeRFXSensor,
+		pTypeGeneral, sTypeVoltage,
+		pTypeGeneral, pTypeWEIGHT, pTypeUsage,
+		pTypeYouLess,
+		pTypeENERGY, pTypePOWER,
+		pTypeRFXMeter, pTypeYouLess, pTypePOWER, pTypeUsage, pTypeRego6XXValue,
+		pTypeRFXMeter, pTypeP1Gas, pTypeYouLess, pTypeENERGY, pTypePOWER, pTypeAirQuality, pTypeUsage, pTypeLux, pTypeWEIGHT,
+		pTypeRego6XXValue, sTypeRego6XXCounter,
+		pTypeGeneral, sTypeVisibility, sTypeSolarRadiation, sTypeSoilMoisture, sTypeLeafWetness, sTypeVoltage, sTypePressure,
+		pTypeRFXSensor, sTypeRFXSensorAD, sTypeRFXSensorVolt,
+		pTypeP1Gas, pTypeP1Gas,
+		pTypeYouLess, pTypeENERGY, pTypePOWER
 		);
-	result=query(szTmp);
-	if (result.size()>0)
-	{
-		std::vector<std::vector<std::string> >::const_iterator itt;
-		for (itt=result.begin(); itt!=result.end(); ++itt)
-		{
-			std::vector<std::string> sd=*itt;
-
-			unsigned long long ID;
-			std::stringstream s_str( sd[0] );
-			s_str >> ID;
-			int hardwareID= atoi(sd[1].c_str());
-			std::string DeviceID=sd[2];
-			unsigned char Unit = atoi(sd[3].c_str());
-
-			unsigned char dType=atoi(sd[4].c_str());
-			unsigned char dSubType=atoi(sd[5].c_str());
-			int nValue=atoi(sd[6].c_str());
-			std::string sValue=sd[7];
-			std::string sLastUpdate=sd[8];
+	query(szTmp,CSQLParams().Add(szCutoff).Add(szCutoffGas).Add(szDateToday));
 
-			std::string susage="0";
-
-			//do not include sensors that have no reading within an hour
-			struct tm ntime;
-			ntime.tm_isdst=tm1.tm_isdst;
-			ntime.tm_year=atoi(sLastUpdate.substr(0,4).c_str())-1900;
-			ntime.tm_mon=atoi(sLastUpdate.substr(5,2).c_str())-1;
-			ntime.tm_mday=atoi(sLastUpdate.substr(8,2).c_str());
-			ntime.tm_hour=atoi(sLastUpdate.substr(11,2).c_str());
-			ntime.tm_min=atoi(sLastUpdate.substr(14,2).c_str());
-			ntime.tm_sec=atoi(sLastUpdate.substr(17,2).c_str());
-			time_t checktime=mktime(&ntime);
-
-			bool bSkipSameValue=true;
-
-			if (dType!=pTypeP1Gas)
-			{
-				if (now-checktime>=SensorTimeOut*60)
-					continue;
-			}
-			else
-			{
-				//P1 Gas meter transmits results every 1 a 2 hours
-				if (now-checktime>=3*3600)
-					continue;
-			}
-			if (dType==pTypeYouLess)
-			{
-				std::vector<std::string> splitresults;
-				StringSplit(sValue, ";", splitresults);
-				if (splitresults.size()<2)
-					continue;
-				sValue=splitresults[0];
-				susage = splitresults[1];
-			}
-			else if (dType==pTypeENERGY)
-			{
-				std::vector<std::string> splitresults;
-				StringSplit(sValue, ";", splitresults);
-				if (splitresults.size()<2)
-					continue;
-				susage=splitresults[0];
-				double fValue=atof(splitresults[1].c_str())*100;
-				sprintf(szTmp,"%.0f",fValue);
-				sValue=szTmp;
-				bSkipSameValue=false;
-			}
-			else if (dType==pTypePOWER)
-			{
-				std::vector<std::string> splitresults;
-				StringSplit(sValue, ";", splitresults);
-				if (splitresults.size()<2)
-					continue;
-				susage=splitresults[0];
-				double fValue=atof(splitresults[1].c_str())*100;
-				sprintf(szTmp,"%.0f",fValue);
-				sValue=szTmp;
-			}
-			else if (dType==pTypeAirQuality)
-			{
-				sprintf(szTmp,"%d",nValue);
-				sValue=szTmp;
-				CheckAndHandleNotification(hardwareID, DeviceID, Unit, dType, dSubType, NTYPE_USAGE, (float)nValue);
-				bSkipSameValue=false;
-			}
-			else if ((dType==pTypeGeneral)&&((dSubType==sTypeSoilMoisture)||(dSubType==sTypeLeafWetness)))
-			{
-				sprintf(szTmp,"%d",nValue);
-				sValue=szTmp;
-				bSkipSameValue=false;
-			}
-			else if ((dType==pTypeGeneral)&&(dSubType==sTypeVisibility))
-			{
-				double fValue=atof(sValue.c_str())*10.0f;
-				sprintf(szTmp,"%d",int(fValue));
-				sValue=szTmp;
-				bSkipSameValue=false;
-			}
-			else if ((dType==pTypeGeneral)&&(dSubType==sTypeSolarRadiation))
-			{
-				double fValue=atof(sValue.c_str())*10.0f;
-				sprintf(szTmp,"%d",int(fValue));
-				sValue=szTmp;
-				bSkipSameValue=false;
-			}
-			else if (dType==pTypeLux)
-			{
-				double fValue=atof(sValue.c_str());
-				sprintf(szTmp,"%.0f",fValue);
-				sValue=szTmp;
-				bSkipSameValue=false;
-			}
-			else if (dType==pTypeWEIGHT)
-			{
-				double fValue=atof(sValue.c_str())*10.0f;
-				sprintf(szTmp,"%d",int(fValue));
-				sValue=szTmp;
-				bSkipSameValue=false;
-			}
-			else if (dType==pTypeRFXSensor)
-			{
-				double fValue=atof(sValue.c_str());
-				sprintf(szTmp,"%d",int(fValue));
-				sValue=szTmp;
-				bSkipSameValue=false;
-			}
-			else if ((dType==pTypeGeneral)&&(dSubType==sTypeVoltage))
-			{
-				double fValue=atof(sValue.c_str())*1000.0f;
-				sprintf(szTmp,"%d",int(fValue));
-				sValue=szTmp;
-				bSkipSameValue=false;
-			}
-			else if ((dType==pTypeGeneral)&&(dSubType==sTypePressure))
-			{
-				double fValue=atof(sValue.c_str())*10.0f;
-				sprintf(szTmp,"%d",int(fValue));
-				sValue=szTmp;
-				bSkipSameValue=false;
-			}
-			else if (dType==pTypeUsage)
-			{
-				double fValue=atof(sValue.c_str())*10.0f;
-				sprintf(szTmp,"%d",int(fValue));
-				sValue=szTmp;
-			}
-			else if (dType == pTypeP1Gas)
-			{
-				bSkipSameValue = false;
-			}
-
-			unsigned long long MeterValue;
-			std::stringstream s_str2( sValue );
-			s_str2 >> MeterValue;
-
-			unsigned long long MeterUsage;
-			std::stringstream s_str3( susage );
-			s_str3 >> MeterUsage;
-
-			if (bSkipSameValue)
-			{
-				//if last value == actual value, then do not insert it
-				sprintf(szTmp,"SELECT Value FROM Meter WHERE (DeviceRowID=%llu) AND (Date>='%s') ORDER BY ROWID DESC LIMIT 1",ID,szDateToday);
-				result2=query(szTmp);
-				if (result2.size()>0)
-				{
-					std::vector<std::string> sd2=result2[0];
-					std::string sValueLast=sd2[0];
-					if (sValueLast==sValue)
-						continue; //skip same value
-				}
-			}
-
-			//insert record
-			sprintf(szTmp,
-				"INSERT INTO Meter (DeviceRowID, Value, [Usage]) "
-				"VALUES ('%llu', '%llu', '%llu')",
-				ID,
-				MeterValue,
-				MeterUsage
-				);
-			std::vector<std::vector<std::string> > result2;
-			result2=query(szTmp);
-		}
+	//Air quality notifications
+	std::vector<std::vector<std::string> > result;
+	result=query(
+		"SELECT HardwareID, DeviceID, Unit, Type, SubType, nValue FROM DeviceStatus WHERE (Type=?) AND (LastUpdate>?)",
+		CSQLParams().Add((int)pTypeAirQuality).Add(szCutoff));
+	std::vector<std::vector<std::string> >::const_iterator itt;
+	for (itt=result.begin(); itt!=result.end(); ++itt)
+	{
+		std::vector<std::string> sd=*itt;
+		int hardwareID= atoi(sd[0].c_str());
+		std::string DeviceID=sd[1];
+		unsigned char Unit = atoi(sd[2].c_str());
+		unsigned char dType=atoi(sd[3].c_str());
+		unsigned char dSubType=atoi(sd[4].c_str());
+		int nValue=atoi(sd[5].c_str());
+		CheckAndHandleNotification(hardwareID, DeviceID, Unit, dType, dSubType, NTYPE_USAGE, (float)nValue);
 	}
 }
 
 void CSQLHelper::UpdateMultiMeter()
 {
-	char szTmp[600];
 	time_t now = mytime(NULL);
 	if (now==0)
 		return;
-	struct tm tm1;
-	localtime_r(&now,&tm1);
 
 	int SensorTimeOut=60;
 	GetPreferencesVar("SensorTimeout", SensorTimeOut);
+	std::string szCutoff=GetLocalTimeString(now-SensorTimeOut*60);
 
-	unsigned long long ID=0;
-
-	std::vector<std::vector<std::string> > result;
-	sprintf(szTmp,"SELECT ID,Type,SubType,nValue,sValue,LastUpdate FROM DeviceStatus WHERE (Type=%d OR Type=%d OR Type=%d)",
+	char szTmp[2000];
+	sprintf(szTmp,
+		"INSERT INTO MultiMeter (DeviceRowID, Value1, Value2, Value3, Value4, Value5, Value6) "
+		"SELECT ID, "
+		//P1 Power: usage1, delivery1, usage current, delivery current, usage2, delivery2
+		"CASE WHEN Type=%d THEN CAST(SVALUE(sValue,0) AS INTEGER) ELSE CAST(CAST(SVALUE(sValue,0) AS REAL)*10 AS INTEGER) END, "
+		"CASE WHEN Type=%d THEN CAST(SVALUE(sValue,2) AS INTEGER) ELSE CAST(CAST(SVALUE(sValue,1) AS REAL)*10 AS INTEGER) END, "
+		"CASE WHEN Type=%d THEN CAST(SVALUE(sValue,4) AS INTEGER) ELSE CAST(CAST(SVALUE(sValue,2) AS REAL)*10 AS INTEGER) END, "
+		"CASE WHEN Type=%d THEN CAST(SVALUE(sValue,5) AS INTEGER) WHEN Type=%d THEN CAST(CAST(SVALUE(sValue,3) AS REAL)*1000 AS INTEGER) ELSE 0 END, "
+		"CASE WHEN Type=%d THEN CAST(SVALUE(sValue,1) AS INTEGER) ELSE 0 END, "
+		"CASE WHEN Type=%d THEN CAST(SVALUE(sValue,3) AS INTEGER) ELSE 0 END "
+		"FROM DeviceStatus WHERE (LastUpdate>?) AND ("
+			"(Type=%d AND SVALUE_COUNT(sValue)=6) OR "
+			"(Type=%d AND SubType=%d AND SVALUE_COUNT(sValue)=3) OR "
+			"(Type=%d AND SubType=%d AND SVALUE_COUNT(sValue)=4))",
+		pTypeP1Power,
+		pTypeP1Power,
+		pTypeP1Power,
+		pTypeP1Power, pTypeCURRENTENERGY,
+		pTypeP1Power,
+		pTypeP1Power,
 		pTypeP1Power,
-		pTypeCURRENT,
-		pTypeCURRENTENERGY
+		pTypeCURRENT, sTypeELEC1,
+		pTypeCURRENTENERGY, sTypeELEC4
 		);
-	result=query(szTmp);
-	if (result.size()>0)
-	{
-		std::vector<std::vector<std::string> >::const_iterator itt;
-		for (itt=result.begin(); itt!=result.end(); ++itt)
-		{
-			std::vector<std::string> sd=*itt;
-
-			unsigned long long ID;
-			std::stringstream s_str( sd[0] );
-			s_str >> ID;
-			unsigned char dType=atoi(sd[1].c_str());
-			unsigned char dSubType=atoi(sd[2].c_str());
-			int nValue=atoi(sd[3].c_str());
-			std::string sValue=sd[4];
-
-			//do not include sensors that have no reading within an hour
-			std::string sLastUpdate=sd[5];
-			struct tm ntime;
-			ntime.tm_isdst=tm1.tm_isdst;
-			ntime.tm_year=atoi(sLastUpdate.substr(0,4).c_str())-1900;
-			ntime.tm_mon=atoi(sLastUpdate.substr(5,2).c_str())-1;
-			ntime.tm_mday=atoi(sLastUpdate.substr(8,2).c_str());
-			ntime.tm_hour=atoi(sLastUpdate.substr(11,2).c_str());
-			ntime.tm_min=atoi(sLastUpdate.substr(14,2).c_str());
-			ntime.tm_sec=atoi(sLastUpdate.substr(17,2).c_str());
-			time_t checktime=mktime(&ntime);
-			if (now-checktime>=SensorTimeOut*60)
-				continue;
-			std::vector<std::string> splitresults;
-			StringSplit(sValue, ";", splitresults);
-
-			unsigned long long value1=0;
-			unsigned long long value2=0;
-			unsigned long long value3=0;
-			unsigned long long value4=0;
-			unsigned long long value5=0;
-			unsigned long long value6=0;
-
-			if (dType==pTypeP1Power)
-			{
-				if (splitresults.size()!=6)
-					continue; //impossible
-				unsigned long long powerusage1;
-				unsigned long long powerusage2;
-				unsigned long long powerdeliv1;
-				unsigned long long powerdeliv2;
-				unsigned long long usagecurrent;
-				unsigned long long delivcurrent;
-
-				std::stringstream s_powerusage1(splitresults[0]);
-				std::stringstream s_powerusage2(splitresults[1]);
-				std::stringstream s_powerdeliv1(splitresults[2]);
-				std::stringstream s_powerdeliv2(splitresults[3]);
-				std::stringstream s_usagecurrent(splitresults[4]);
-				std::stringstream s_delivcurrent(splitresults[5]);
-
-				s_powerusage1 >> powerusage1;
-				s_powerusage2 >> powerusage2;
-				s_powerdeliv1 >> powerdeliv1;
-				s_powerdeliv2 >> powerdeliv2;
-				s_usagecurrent >> usagecurrent;
-				s_delivcurrent >> delivcurrent;
-
-				value1=powerusage1;
-				value2=powerdeliv1;
-				value5=powerusage2;
-				value6=powerdeliv2;
-				value3=usagecurrent;
-				value4=delivcurrent;
-			}
-			else if ((dType==pTypeCURRENT)&&(dSubType==sTypeELEC1))
-			{
-				if (splitresults.size()!=3)
-					continue; //impossible
-
-				value1=(unsigned long)(atof(splitresults[0].c_str())*10.0f);
-				value2=(unsigned long)(atof(splitresults[1].c_str())*10.0f);
-				value3=(unsigned long)(atof(splitresults[2].c_str())*10.0f);
-			}
-			else if ((dType==pTypeCURRENTENERGY)&&(dSubType==sTypeELEC4))
-			{
-				if (splitresults.size()!=4)
-					continue; //impossible
-
-				value1=(unsigned long)(atof(splitresults[0].c_str())*10.0f);
-				value2=(unsigned long)(atof(splitresults[1].c_str())*10.0f);
-				value3=(unsigned long)(atof(splitresults[2].c_str())*10.0f);
-				value4=(unsigned long)(atof(splitresults[3].c_str())*1000.0f);
-			}
-			else
-				continue;//don't know you (yet)
-
-			//insert record
-			sprintf(szTmp,
-				"INSERT INTO MultiMeter (DeviceRowID, Value1, Value2, Value3, Value4, Value5, Value6) "
-				"VALUES ('%llu', '%llu', '%llu', '%llu', '%llu', '%llu', '%llu')",
-				ID,
-				value1,
-				value2,
-				value3,
-				value4,
-				value5,
-				value6
-				);
-			std::vector<std::vector<std::string> > result2;
-			result2=query(szTmp);
-		}
-	}
+	query(szTmp,CSQLParams().Add(szCutoff));
 }
 
 void CSQLHelper::UpdatePercentageLog()
 {
-	char szTmp[600];
-
 	time_t now = mytime(NULL);
 	if (now==0)
 		return;
-	struct tm tm1;
-	localtime_r(&now,&tm1);
 
 	int SensorTimeOut=60;
 	GetPreferencesVar("SensorTimeout", SensorTimeOut);
+	std::string szCutoff=GetLocalTimeString(now-SensorTimeOut*60);
 
-	unsigned long long ID=0;
-
-	std::vector<std::vector<std::string> > result;
-	sprintf(szTmp,"SELECT ID,Type,SubType,nValue,sValue,LastUpdate FROM DeviceStatus WHERE (Type=%d AND SubType=%d)",
+	char szTmp[600];
+	sprintf(szTmp,
+		"INSERT INTO Percentage (DeviceRowID, Percentage) "
+		"SELECT ID, round(CAST(sValue AS REAL),2) FROM DeviceStatus "
+		"WHERE (Type=%d AND SubType=%d) AND (LastUpdate>?) AND (SVALUE_COUNT(sValue)>=1)",
 		pTypeGeneral,sTypePercentage
 		);
-	result=query(szTmp);
-	if (result.size()>0)
-	{
-		std::vector<std::vector<std::string> >::const_iterator itt;
-		for (itt=result.begin(); itt!=result.end(); ++itt)
-		{
-			std::vector<std::string> sd=*itt;
-
-			unsigned long long ID;
-			std::stringstream s_str( sd[0] );
-			s_str >> ID;
-
-			unsigned char dType=atoi(sd[1].c_str());
-			unsigned char dSubType=atoi(sd[2].c_str());
-			int nValue=atoi(sd[3].c_str());
-			std::string sValue=sd[4];
-
-			//do not include sensors that have no reading within an hour
-			std::string sLastUpdate=sd[5];
-			struct tm ntime;
-			ntime.tm_isdst=tm1.tm_isdst;
-			ntime.tm_year=atoi(sLastUpdate.substr(0,4).c_str())-1900;
-			ntime.tm_mon=atoi(sLastUpdate.substr(5,2).c_str())-1;
-			ntime.tm_mday=atoi(sLastUpdate.substr(8,2).c_str());
-			ntime.tm_hour=atoi(sLastUpdate.substr(11,2).c_str());
-			ntime.tm_min=atoi(sLastUpdate.substr(14,2).c_str());
-			ntime.tm_sec=atoi(sLastUpdate.substr(17,2).c_str());
-			time_t checktime=mktime(&ntime);
-			if (now-checktime>=SensorTimeOut*60)
-				continue;
-
-			std::vector<std::string> splitresults;
-			StringSplit(sValue, ";", splitresults);
-			if (splitresults.size()<1)
-				continue; //impossible
-
-			float percentage= (float)atof(sValue.c_str());
-
-			//insert record
-			sprintf(szTmp,
-				"INSERT INTO Percentage (DeviceRowID, Percentage) "
-				"VALUES ('%llu', '%.2f')",
-				ID,
-				percentage
-				);
-			std::vector<std::vector<std::string> > result2;
-			result2=query(szTmp);
-		}
-	}
+	query(szTmp,CSQLParams().Add(szCutoff));
 }
 
 void CSQLHelper::UpdateFanLog()
 {
-	char szTmp[600];
-
 	time_t now = mytime(NULL);
 	if (now==0)
 		return;
-	struct tm tm1;
-	localtime_r(&now,&tm1);
 
 	int SensorTimeOut=60;
 	GetPreferencesVar("SensorTimeout", SensorTimeOut);
+	std::string szCutoff=GetLocalTimeString(now-SensorTimeOut*60);
 
-	unsigned long long ID=0;
-
-	std::vector<std::vector<std::string> > result;
-	sprintf(szTmp,"SELECT ID,Type,SubType,nValue,sValue,LastUpdate FROM DeviceStatus WHERE (Type=%d AND SubType=%d)",
+	char szTmp[600];
+	sprintf(szTmp,
+		"INSERT INTO Fan (DeviceRowID, Speed) "
+		"SELECT ID, CAST(sValue AS INTEGER) FROM DeviceStatus "
+		"WHERE (Type=%d AND SubType=%d) AND (LastUpdate>?) AND (SVALUE_COUNT(sValue)>=1)",
 		pTypeGeneral,sTypeSystemFan
 		);
-	result=query(szTmp);
-	if (result.size()>0)
-	{
-		std::vector<std::vector<std::string> >::const_iterator itt;
-		for (itt=result.begin(); itt!=result.end(); ++itt)
-		{
-			std::vector<std::string> sd=*itt;
-
-			unsigned long long ID;
-			std::stringstream s_str( sd[0] );
-			s_str >> ID;
-
-			unsigned char dType=atoi(sd[1].c_str());
-			unsigned char dSubType=atoi(sd[2].c_str());
-			int nValue=atoi(sd[3].c_str());
-			std::string sValue=sd[4];
-
-			//do not include sensors that have no reading within an hour
-			std::string sLastUpdate=sd[5];
-			struct tm ntime;
-			ntime.tm_isdst=tm1.tm_isdst;
-			ntime.tm_year=atoi(sLastUpdate.substr(0,4).c_str())-1900;
-			ntime.tm_mon=atoi(sLastUpdate.substr(5,2).c_str())-1;
-			ntime.tm_mday=atoi(sLastUpdate.substr(8,2).c_str());
-			ntime.tm_hour=atoi(sLastUpdate.substr(11,2).c_str());
-			ntime.tm_min=atoi(sLastUpdate.substr(14,2).c_str());
-			ntime.tm_sec=atoi(sLastUpdate.substr(17,2).c_str());
-			time_t checktime=mktime(&ntime);
-			if (now-checktime>=SensorTimeOut*60)
-				continue;
-
-			std::vector<std::string> splitresults;
-			StringSplit(sValue, ";", splitresults);
-			if (splitresults.size()<1)
-				continue; //impossible
-
-			int speed= (int)atoi(sValue.c_str());
-
-			//insert record
-			sprintf(szTmp,
-				"INSERT INTO Fan (DeviceRowID, Speed) "
-				"VALUES ('%llu', '%d')",
-				ID,
-				speed
-				);
-			std::vector<std::vector<std::string> > result2;
-			result2=query(szTmp);
-		}
-	}
+	query(szTmp,CSQLParams().Add(szCutoff));
 }
 
-
 void CSQLHelper::AddCalendarTemperature()
 {
-	char szTmp[600];
-
-	//Get All temperature devices in the Temperature Table
-	std::vector<std::vector<std::string> > resultdevices;
-	strcpy(szTmp,"SELECT DISTINCT(DeviceRowID) FROM Temperature ORDER BY DeviceRowID");
-	resultdevices=query(szTmp);
-	if (resultdevices.size()<1)
-		return; //nothing to do
-
-	char szDateStart[40];
-	char szDateEnd[40];
-
-	time_t now = mytime(NULL);
-	struct tm tm1;
-	localtime_r(&now,&tm1);
-
-	struct tm ltime;
-	ltime.tm_isdst=tm1.tm_isdst;
-	ltime.tm_hour=0;
-	ltime.tm_min=0;
-	ltime.tm_sec=0;
-	ltime.tm_year=tm1.tm_year;
-	ltime.tm_mon=tm1.tm_mon;
-	ltime.tm_mday=tm1.tm_mday;
-
-	sprintf(szDateEnd,"%04d-%02d-%02d",ltime.tm_year+1900,ltime.tm_mon+1,ltime.tm_mday);
-
-	//Subtract one day
-
-	ltime.tm_mday -= 1;
-	time_t later = mktime(&ltime);
-	struct tm tm2;
-	localtime_r(&later,&tm2);
-	sprintf(szDateStart,"%04d-%02d-%02d",tm2.tm_year+1900,tm2.tm_mon+1,tm2.tm_mday);
-
-	std::vector<std::vector<std::string> > result;
-
-	std::vector<std::vector<std::string> >::const_iterator itt;
-	for (itt=resultdevices.begin(); itt!=resultdevices.end(); ++itt)
-	{
-		std::vector<std::string> sddev=*itt;
-		unsigned long long ID;
-		std::stringstream s_str( sddev[0] );
-		s_str >> ID;
-
-		sprintf(szTmp,"SELECT MIN(Temperature), MAX(Temperature), AVG(Temperature), MIN(Chill), MAX(Chill), MAX(Humidity), MAX(Barometer), MIN(DewPoint), MIN(SetPoint), MAX(SetPoint), AVG(SetPoint) FROM Temperature WHERE (DeviceRowID='%llu' AND Date>='%s' AND Date<'%s')",
-			ID,
-			szDateStart,
-			szDateEnd
-			);
-		result=query(szTmp);
-		if (result.size()>0)
-		{
-			std::vector<std::string> sd=result[0];
-
-			float temp_min=(float)atof(sd[0].c_str());
-			float temp_max=(float)atof(sd[1].c_str());
-			float temp_avg=(float)atof(sd[2].c_str());
-			float chill_min=(float)atof(sd[3].c_str());
-			float chill_max=(float)atof(sd[4].c_str());
-			int humidity=atoi(sd[5].c_str());
-			int barometer=atoi(sd[6].c_str());
-			float dewpoint=(float)atof(sd[7].c_str());
-			float setpoint_min=(float)atof(sd[8].c_str());
-			float setpoint_max=(float)atof(sd[9].c_str());
-			float setpoint_avg=(float)atof(sd[10].c_str());
-			//insert into calendar table
-			sprintf(szTmp,
-				"INSERT INTO Temperature_Calendar (DeviceRowID, Temp_Min, Temp_Max, Temp_Avg, Chill_Min, Chill_Max, Humidity, Barometer, DewPoint, SetPoint_Min, SetPoint_Max, SetPoint_Avg, Date) "
-				"VALUES ('%llu', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%d', '%d', '%.2f', '%.2f', '%.2f', '%.2f', '%s')",
-				ID,
-				temp_min,
-				temp_max,
-				temp_avg,
-				chill_min,
-				chill_max,
-				humidity,
-				barometer,
-				dewpoint,
-				setpoint_min,
-				setpoint_max,
-				setpoint_avg,
-				szDateStart
-				);
-			result=query(szTmp);
-
-		}
-	}
+	std::string szDateStart,szDateEnd;
+	GetYesterdayRange(szDateStart,szDateEnd);
+
+	query(
+		"INSERT INTO Temperature_Calendar (DeviceRowID, Temp_Min, Temp_Max, Temp_Avg, Chill_Min, Chill_Max, Humidity, Barometer, DewPoint, SetPoint_Min, SetPoint_Max, SetPoint_Avg, Date) "
+		"SELECT DeviceRowID, round(MIN(Temperature),2), round(MAX(Temperature),2), round(AVG(Temperature),2), round(MIN(Chill),2), round(MAX(Chill),2), "
+		"CAST(MAX(Humidity) AS INTEGER), CAST(MAX(Barometer) AS INTEGER), round(MIN(DewPoint),2), round(MIN(SetPoint),2), round(MAX(SetPoint),2), round(AVG(SetPoint),2), ? "
+		"FROM Temperature WHERE (Date>=? AND Date<?) GROUP BY DeviceRowID",
+		CSQLParams().Add(szDateStart).Add(szDateStart).Add(szDateEnd));
 }
 
 void CSQLHelper::AddCalendarUpdateRain()
 {
-	char szTmp[600];
-
-	//Get All UV devices
-	std::vector<std::vector<std::string> > resultdevices;
-	strcpy(szTmp,"SELECT DISTINCT(DeviceRowID) FROM Rain ORDER BY DeviceRowID");
-	resultdevices=query(szTmp);
-	if (resultdevices.size()<1)
-		return; //nothing to do
-
-	char szDateStart[40];
-	char szDateEnd[40];
-
-	time_t now = mytime(NULL);
-	struct tm tm1;
-	localtime_r(&now,&tm1);
-
-	struct tm ltime;
-	ltime.tm_isdst=tm1.tm_isdst;
-	ltime.tm_hour=0;
-	ltime.tm_min=0;
-	ltime.tm_sec=0;
-	ltime.tm_year=tm1.tm_year;
-	ltime.tm_mon=tm1.tm_mon;
-	ltime.tm_mday=tm1.tm_mday;
-
-	sprintf(szDateEnd,"%04d-%02d-%02d",ltime.tm_year+1900,ltime.tm_mon+1,ltime.tm_mday);
-
-	//Subtract one day
-
-	ltime.tm_mday -= 1;
-	time_t later = mktime(&ltime);
-	struct tm tm2;
-	localtime_r(&later,&tm2);
-	sprintf(szDateStart,"%04d-%02d-%02d",tm2.tm_year+1900,tm2.tm_mon+1,tm2.tm_mday);
-
-	std::vector<std::vector<std::string> > result;
-
-	std::vector<std::vector<std::string> >::const_iterator itt;
-	for (itt=resultdevices.begin(); itt!=resultdevices.end(); ++itt)
-	{
-		std::vector<std::string> sddev=*itt;
-		unsigned long long ID;
-		std::stringstream s_str( sddev[0] );
-		s_str >> ID;
-
-		//Get Device Information
-		sprintf(szTmp,"SELECT SubType FROM DeviceStatus WHERE (ID='%llu')",ID);
-		result=query(szTmp);
-		if (result.size()<1)
-			continue;
-		std::vector<std::string> sd=result[0];
-
-		unsigned char subType=atoi(sd[0].c_str());
-
-		if (subType!=sTypeRAINWU)
-		{
-			sprintf(szTmp,"SELECT MIN(Total), MAX(Total), MAX(Rate) FROM Rain WHERE (DeviceRowID='%llu' AND Date>='%s' AND Date<'%s')",
-				ID,
-				szDateStart,
-				szDateEnd
-				);
-		}
-		else
-		{
-			sprintf(szTmp,"SELECT Total, Total, Rate FROM Rain WHERE (DeviceRowID='%llu' AND Date>='%s' AND Date<'%s') ORDER BY ROWID DESC LIMIT 1",
-				ID,
-				szDateStart,
-				szDateEnd
-				);
-		}
-
-		result=query(szTmp);
-		if (result.size()>0)
-		{
-			std::vector<std::string> sd=result[0];
-
-			float total_min=(float)atof(sd[0].c_str());
-			float total_max=(float)atof(sd[1].c_str());
-			int rate=atoi(sd[2].c_str());
-
-			float total_real=0;
-			if (subType!=sTypeRAINWU)
-			{
-				total_real=total_max-total_min;
-			}
-			else
-			{
-				total_real=total_max;
-			}
-			
+	std::string szDateStart,szDateEnd;
+	GetYesterdayRange(szDateStart,szDateEnd);
+
+	//Total is the difference of the counter over the day
+	query(
+		"INSERT INTO Rain_Calendar (DeviceRowID, Total, Rate, Date) "
+		"SELECT r.DeviceRowID, round(MAX(r.Total)-MIN(r.Total),2), CAST(MAX(r.Rate) AS INTEGER), ? "
+		"FROM Rain AS r INNER JOIN DeviceStatus AS d ON (d.ID=r.DeviceRowID) "
+		"WHERE (d.SubType!=?) AND (r.Date>=? AND r.Date<?) GROUP BY r.DeviceRowID HAVING (MAX(r.Total)-MIN(r.Total)<1000)",
+		CSQLParams().Add(szDateStart).Add((int)sTypeRAINWU).Add(szDateStart).Add(szDateEnd));
+	//Weather Underground reports the day total, take the last one
+	query(
+		"INSERT INTO Rain_Calendar (DeviceRowID, Total, Rate, Date) "
+		"SELECT r.DeviceRowID, round(r.Total,2), CAST(r.Rate AS INTEGER), ? "
+		"FROM Rain AS r INNER JOIN DeviceStatus AS d ON (d.ID=r.DeviceRowID) "
+		"WHERE (d.SubType=?) AND (r.Total<1000) AND r.ROWID IN (SELECT MAX(ROWID) FROM Rain WHERE (Date>=? AND Date<?) GROUP BY DeviceRowID)",
+		CSQLParams().Add(szDateStart).Add((int)sTypeRAINWU).Add(szDateStart).Add(szDateEnd));
+}
 
-			if (total_real<1000)
-			{
-				//insert into calendar table
-				sprintf(szTmp,
-					"INSERT INTO Rain_Calendar (DeviceRowID, Total, Rate, Date) "
-					"VALUES ('%llu', '%.2f', '%d', '%s')",
-					ID,
-					total_real,
-					rate,
-					szDateStart
-					);
-				result=query(szTmp);
-			}
-		}
-	}
+//Meter table devices whose day values go into MultiMeter_Calendar (min/max) instead of Meter_Calendar
+static bool IsMultiMeterCalendarType(const unsigned char devType, const unsigned char subType)
+{
+	return (
+		(devType==pTypeAirQuality)||
+		(devType==pTypeRFXSensor)||
+		((devType==pTypeGeneral)&&(subType==sTypeVisibility))||
+		((devType==pTypeGeneral)&&(subType==sTypeSolarRadiation))||
+		((devType==pTypeGeneral)&&(subType==sTypeSoilMoisture))||
+		((devType==pTypeGeneral)&&(subType==sTypeLeafWetness))||
+		((devType==pTypeGeneral)&&(subType==sTypeVoltage))||
+		((devType==pTypeGeneral)&&(subType==sTypePressure))||
+		(devType==pTypeLux)||
+		(devType==pTypeWEIGHT)||
+		(devType==pTypeUsage)
+		);
 }
 
 void CSQLHelper::AddCalendarUpdateMeter()
 {
-	char szTmp[600];
-
 	float EnergyDivider=1000.0f;
 	float GasDivider=100.0f;
 	float WaterDivider=100.0f;
@@ -4572,61 +4938,34 @@ void CSQLHelper::AddCalendarUpdateMeter()
 		WaterDivider=float(tValue);
 	}
 
-	//Get All Meter devices
-	std::vector<std::vector<std::string> > resultdevices;
-	strcpy(szTmp,"SELECT DISTINCT(DeviceRowID) FROM Meter ORDER BY DeviceRowID");
-	resultdevices=query(szTmp);
-	if (resultdevices.size()<1)
-		return; //nothing to do
-
-	char szDateStart[40];
-	char szDateEnd[40];
-
-	time_t now = mytime(NULL);
-	struct tm tm1;
-	localtime_r(&now,&tm1);
-
-	struct tm ltime;
-	ltime.tm_isdst=tm1.tm_isdst;
-	ltime.tm_hour=0;
-	ltime.tm_min=0;
-	ltime.tm_sec=0;
-	ltime.tm_year=tm1.tm_year;
-	ltime.tm_mon=tm1.tm_mon;
-	ltime.tm_mday=tm1.tm_mday;
-
-	sprintf(szDateEnd,"%04d-%02d-%02d %02d:%02d:%02d",ltime.tm_year+1900,ltime.tm_mon+1,ltime.tm_mday,ltime.tm_hour,ltime.tm_min,ltime.tm_sec);
-
-	//Subtract one day
-	ltime.tm_mday -= 1;
-	time_t later = mktime(&ltime);
-	struct tm tm2;
-	localtime_r(&later,&tm2);
-	sprintf(szDateStart,"%04d-%02d-%02d",tm2.tm_year+1900,tm2.tm_mon+1,tm2.tm_mday);
+	std::string szDateStart,szDateEnd;
+	GetYesterdayRange(szDateStart,szDateEnd);
+	szDateEnd+=" 00:00:00";
 
+	//one pass over yesterday's values of all meters
 	std::vector<std::vector<std::string> > result;
+	result=query(
+		"SELECT m.DeviceRowID, MIN(m.Value), MAX(m.Value), d.HardwareID, d.DeviceID, d.Unit, d.Type, d.SubType, d.SwitchType "
+		"FROM Meter AS m INNER JOIN DeviceStatus AS d ON (d.ID=m.DeviceRowID) "
+		"WHERE (m.Date>=? AND m.Date<?) GROUP BY m.DeviceRowID",
+		CSQLParams().Add(szDateStart).Add(szDateEnd));
 
 	std::vector<std::vector<std::string> >::const_iterator itt;
-	for (itt=resultdevices.begin(); itt!=resultdevices.end(); ++itt)
+	for (itt=result.begin(); itt!=result.end(); ++itt)
 	{
-		std::vector<std::string> sddev=*itt;
+		std::vector<std::string> sd=*itt;
 		unsigned long long ID;
-		std::stringstream s_str( sddev[0] );
+		std::stringstream s_str( sd[0] );
 		s_str >> ID;
 
-		//Get Device Information
-		sprintf(szTmp,"SELECT HardwareID, DeviceID, Unit, Type, SubType, SwitchType FROM DeviceStatus WHERE (ID='%llu')",ID);
-		result=query(szTmp);
-		if (result.size()<1)
-			continue;
-		std::vector<std::string> sd=result[0];
-
-		int hardwareID= atoi(sd[0].c_str());
-		std::string DeviceID=sd[1];
-		unsigned char Unit = atoi(sd[2].c_str());
-		unsigned char devType=atoi(sd[3].c_str());
-		unsigned char subType=atoi(sd[4].c_str());
-		_eSwitchType switchtype=(_eSwitchType) atoi(sd[5].c_str());
+		double total_min=(double)atof(sd[1].c_str());
+		double total_max=(double)atof(sd[2].c_str());
+		int hardwareID= atoi(sd[3].c_str());
+		std::string DeviceID=sd[4];
+		unsigned char Unit = atoi(sd[5].c_str());
+		unsigned char devType=atoi(sd[6].c_str());
+		unsigned char subType=atoi(sd[7].c_str());
+		_eSwitchType switchtype=(_eSwitchType) atoi(sd[8].c_str());
 		_eMeterType metertype=(_eMeterType)switchtype;
 
 		float tGasDivider=GasDivider;
@@ -4640,643 +4979,662 @@ void CSQLHelper::AddCalendarUpdateMeter()
 			metertype=MTYPE_GAS;
 			tGasDivider=1000.0f;
 		}
-        else if ((devType==pTypeRego6XXValue) && (subType==sTypeRego6XXCounter))
+		else if ((devType==pTypeRego6XXValue) && (subType==sTypeRego6XXCounter))
 		{
 			metertype=MTYPE_COUNTER;
 		}
 
-
-		sprintf(szTmp,"SELECT MIN(Value), MAX(Value) FROM Meter WHERE (DeviceRowID='%llu' AND Date>='%s' AND Date<'%s')",
-			ID,
-			szDateStart,
-			szDateEnd
-			);
-		result=query(szTmp);
-		if (result.size()>0)
+		if (!IsMultiMeterCalendarType(devType,subType))
 		{
-			std::vector<std::string> sd=result[0];
+			double total_real=total_max-total_min;
+			double counter = total_max;
 
-			double total_min=(double)atof(sd[0].c_str());
-			double total_max=(double)atof(sd[1].c_str());
+			//insert into calendar table
+			query(
+				"INSERT INTO Meter_Calendar (DeviceRowID, Value, Counter, Date) VALUES (?, round(?,2), round(?,2), ?)",
+				CSQLParams().Add(ID).Add(total_real).Add(counter).Add(szDateStart));
 
-			if (
-				(devType!=pTypeAirQuality)&&
-				(devType!=pTypeRFXSensor)&&
-				(!((devType==pTypeGeneral)&&(subType==sTypeVisibility)))&&
-				(!((devType==pTypeGeneral)&&(subType==sTypeSolarRadiation)))&&
-				(!((devType==pTypeGeneral)&&(subType==sTypeSoilMoisture)))&&
-				(!((devType==pTypeGeneral)&&(subType==sTypeLeafWetness)))&&
-				(!((devType==pTypeGeneral)&&(subType==sTypeVoltage)))&&
-				(!((devType==pTypeGeneral)&&(subType==sTypePressure)))&&
-				(devType!=pTypeLux)&&
-				(devType!=pTypeWEIGHT)&&
-				(devType!=pTypeUsage)
-				)
-			{
-				double total_real=total_max-total_min;
-				double counter = total_max;
-
-				//insert into calendar table
-				sprintf(szTmp,
-					"INSERT INTO Meter_Calendar (DeviceRowID, Value, Counter, Date) "
-					"VALUES ('%llu', '%.2f', '%.2f', '%s')",
-					ID,
-					total_real,
-					counter,
-					szDateStart
-					);
-				result=query(szTmp);
-
-				//Check for Notification
-				musage=0;
-				switch (metertype)
-				{
-				case MTYPE_ENERGY:
-					musage=float(total_real)/EnergyDivider;
-					if (musage!=0)
-						CheckAndHandleNotification(hardwareID, DeviceID, Unit, devType, subType, NTYPE_TODAYENERGY, musage);
-					break;
-				case MTYPE_GAS:
-					musage=float(total_real)/tGasDivider;
-					if (musage!=0)
-						CheckAndHandleNotification(hardwareID, DeviceID, Unit, devType, subType, NTYPE_TODAYGAS, musage);
-					break;
-				case MTYPE_WATER:
-					musage=float(total_real)/WaterDivider;
-					if (musage!=0)
-						CheckAndHandleNotification(hardwareID, DeviceID, Unit, devType, subType, NTYPE_TODAYGAS, musage);
-					break;
-				case MTYPE_COUNTER:
-					musage=float(total_real);
-					if (musage!=0)
-						CheckAndHandleNotification(hardwareID, DeviceID, Unit, devType, subType, NTYPE_TODAYCOUNTER, musage);
-					break;
-				}
-			}
-			else
-			{
-				//AirQuality/Usage Meter/Moisture/RFXSensor/Voltage insert into MultiMeter_Calendar table
-				sprintf(szTmp,
-					"INSERT INTO MultiMeter_Calendar (DeviceRowID, Value1,Value2,Value3,Value4,Value5,Value6, Date) "
-					"VALUES ('%llu', '%.2f','%.2f','%.2f','%.2f','%.2f','%.2f', '%s')",
-					ID,
-					total_min,total_max,0.0f,0.0f,0.0f,0.0f,
-					szDateStart
-					);
-				result=query(szTmp);
-			}
-			if (
-				(devType!=pTypeAirQuality)&&
-				(devType!=pTypeRFXSensor)&&
-				((devType!=pTypeGeneral)&&(subType!=sTypeVisibility))&&
-				((devType!=pTypeGeneral)&&(subType!=sTypeSolarRadiation))&&
-				((devType!=pTypeGeneral)&&(subType!=sTypeVoltage))&&
-				((devType!=pTypeGeneral)&&(subType!=sTypePressure))&&
-				((devType!=pTypeGeneral)&&(subType!=sTypeSoilMoisture))&&
-				((devType!=pTypeGeneral)&&(subType!=sTypeLeafWetness))&&
-				(devType!=pTypeLux)&&
-				(devType!=pTypeWEIGHT)
-				)
+			//Check for Notification
+			musage=0;
+			switch (metertype)
 			{
-				//Insert the last (max) counter value into the meter table to get the "today" value correct.
-				sprintf(szTmp,
-					"INSERT INTO Meter (DeviceRowID, Value, Date) "
-					"VALUES ('%llu', '%s', '%s')",
-					ID,
-					sd[1].c_str(),
-					szDateEnd
-					);
-				result=query(szTmp);
-
+			case MTYPE_ENERGY:
+				musage=float(total_real)/EnergyDivider;
+				if (musage!=0)
+					CheckAndHandleNotification(hardwareID, DeviceID, Unit, devType, subType, NTYPE_TODAYENERGY, musage);
+				break;
+			case MTYPE_GAS:
+				musage=float(total_real)/tGasDivider;
+				if (musage!=0)
+					CheckAndHandleNotification(hardwareID, DeviceID, Unit, devType, subType, NTYPE_TODAYGAS, musage);
+				break;
+			case MTYPE_WATER:
+				musage=float(total_real)/WaterDivider;
+				if (musage!=0)
+					CheckAndHandleNotification(hardwareID, DeviceID, Unit, devType, subType, NTYPE_TODAYGAS, musage);
+				break;
+			case MTYPE_COUNTER:
+				musage=float(total_real);
+				if (musage!=0)
+					CheckAndHandleNotification(hardwareID, DeviceID, Unit, devType, subType, NTYPE_TODAYCOUNTER, musage);
+				break;
 			}
 		}
 		else
 		{
-			//no new meter result received in last day
-			//insert into calendar table
-			sprintf(szTmp,
-				"INSERT INTO Meter_Calendar (DeviceRowID, Value, Date) "
-				"VALUES ('%llu', '%.2f', '%s')",
-				ID,
-				0.0f,
-				szDateStart
-				);
-			result=query(szTmp);
+			//AirQuality/Usage Meter/Moisture/RFXSensor/Voltage insert into MultiMeter_Calendar table
+			query(
+				"INSERT INTO MultiMeter_Calendar (DeviceRowID, Value1,Value2,Value3,Value4,Value5,Value6, Date) VALUES (?, round(?,2), round(?,2), 0, 0, 0, 0, ?)",
+				CSQLParams().Add(ID).Add(total_min).Add(total_max).Add(szDateStart));
+		}
+		if (
+			(devType!=pTypeAirQuality)&&
+			(devType!=pTypeRFXSensor)&&
+			((devType!=pTypeGeneral)&&(subType!=sTypeVisibility))&&
+			((devType!=pTypeGeneral)&&(subType!=sTypeSolarRadiation))&&
+			((devType!=pTypeGeneral)&&(subType!=sTypeVoltage))&&
+			((devType!=pTypeGeneral)&&(subType!=sTypePressure))&&
+			((devType!=pTypeGeneral)&&(subType!=sTypeSoilMoisture))&&
+			((devType!=pTypeGeneral)&&(subType!=sTypeLeafWetness))&&
+			(devType!=pTypeLux)&&
+			(devType!=pTypeWEIGHT)
+			)
+		{
+			//Insert the last (max) counter value into the meter table to get the "today" value correct.
+			query(
+				"INSERT INTO Meter (DeviceRowID, Value, Date) VALUES (?, ?, ?)",
+				CSQLParams().Add(ID).Add(sd[2]).Add(szDateEnd));
 		}
 	}
+
+	//no new meter result received in last day, only for the devices that have a Meter_Calendar
+	result=query(
+		"SELECT ID, Type, SubType FROM DeviceStatus "
+		"WHERE ID IN (SELECT DISTINCT(DeviceRowID) FROM Meter) AND ID NOT IN (SELECT DeviceRowID FROM Meter WHERE (Date>=? AND Date<?))",
+		CSQLParams().Add(szDateStart).Add(szDateEnd));
+	for (itt=result.begin(); itt!=result.end(); ++itt)
+	{
+		const std::vector<std::string> &sd=*itt;
+		if (IsMultiMeterCalendarType((unsigned char)atoi(sd[1].c_str()),(unsigned char)atoi(sd[2].c_str())))
+			continue;
+		query(
+			"INSERT INTO Meter_Calendar (DeviceRowID, Value, Date) VALUES (?, 0, ?)",
+			CSQLParams().Add(strtoull(sd[0].c_str(),NULL,10)).Add(szDateStart));
+	}
 }
 
 void CSQLHelper::AddCalendarUpdateMultiMeter()
 {
-	char szTmp[600];
-
 	float EnergyDivider=1000.0f;
-	float GasDivider=100.0f;
-	float WaterDivider=100.0f;
-	float musage=0;
 	int tValue;
 	if (GetPreferencesVar("MeterDividerEnergy", tValue))
 	{
 		EnergyDivider=float(tValue);
 	}
-	if (GetPreferencesVar("MeterDividerGas", tValue))
-	{
-		GasDivider=float(tValue);
-	}
-	if (GetPreferencesVar("MeterDividerWater", tValue))
-	{
-		WaterDivider=float(tValue);
-	}
-
-	//Get All meter devices
-	std::vector<std::vector<std::string> > resultdevices;
-	strcpy(szTmp,"SELECT DISTINCT(DeviceRowID) FROM MultiMeter ORDER BY DeviceRowID");
-	resultdevices=query(szTmp);
-	if (resultdevices.size()<1)
-		return; //nothing to do
 
-	char szDateStart[40];
-	char szDateEnd[40];
-
-	time_t now = mytime(NULL);
-	struct tm tm1;
-	localtime_r(&now,&tm1);
-
-	struct tm ltime;
-	ltime.tm_isdst=tm1.tm_isdst;
-	ltime.tm_hour=0;
-	ltime.tm_min=0;
-	ltime.tm_sec=0;
-	ltime.tm_year=tm1.tm_year;
-	ltime.tm_mon=tm1.tm_mon;
-	ltime.tm_mday=tm1.tm_mday;
-
-	sprintf(szDateEnd,"%04d-%02d-%02d %02d:%02d:%02d",ltime.tm_year+1900,ltime.tm_mon+1,ltime.tm_mday,ltime.tm_hour,ltime.tm_min,ltime.tm_sec);
-
-	//Subtract one day
-	ltime.tm_mday -= 1;
-	time_t later = mktime(&ltime);
-	struct tm tm2;
-	localtime_r(&later,&tm2);
-	sprintf(szDateStart,"%04d-%02d-%02d",tm2.tm_year+1900,tm2.tm_mon+1,tm2.tm_mday);
+	std::string szDateStart,szDateEnd;
+	GetYesterdayRange(szDateStart,szDateEnd);
+	szDateEnd+=" 00:00:00";
 
 	std::vector<std::vector<std::string> > result;
+	result=query(
+		"SELECT m.DeviceRowID, MIN(m.Value1), MAX(m.Value1), MIN(m.Value2), MAX(m.Value2), MIN(m.Value3), MAX(m.Value3), MIN(m.Value4), MAX(m.Value4), MIN(m.Value5), MAX(m.Value5), MIN(m.Value6), MAX(m.Value6), "
+		"d.HardwareID, d.DeviceID, d.Unit, d.Type, d.SubType "
+		"FROM MultiMeter AS m INNER JOIN DeviceStatus AS d ON (d.ID=m.DeviceRowID) "
+		"WHERE (m.Date>=? AND m.Date<?) GROUP BY m.DeviceRowID",
+		CSQLParams().Add(szDateStart).Add(szDateEnd));
 
 	std::vector<std::vector<std::string> >::const_iterator itt;
-	for (itt=resultdevices.begin(); itt!=resultdevices.end(); ++itt)
+	for (itt=result.begin(); itt!=result.end(); ++itt)
 	{
-		std::vector<std::string> sddev=*itt;
+		std::vector<std::string> sd=*itt;
 		unsigned long long ID;
-		std::stringstream s_str( sddev[0] );
+		std::stringstream s_str( sd[0] );
 		s_str >> ID;
 
-		//Get Device Information
-		sprintf(szTmp,"SELECT HardwareID, DeviceID, Unit, Type, SubType, SwitchType FROM DeviceStatus WHERE (ID='%llu')",ID);
-		result=query(szTmp);
-		if (result.size()<1)
-			continue;
-		std::vector<std::string> sd=result[0];
+		int hardwareID= atoi(sd[13].c_str());
+		std::string DeviceID=sd[14];
+		unsigned char Unit = atoi(sd[15].c_str());
+		unsigned char devType=atoi(sd[16].c_str());
+		unsigned char subType=atoi(sd[17].c_str());
 
-		int hardwareID= atoi(sd[0].c_str());
-		std::string DeviceID=sd[1];
-		unsigned char Unit = atoi(sd[2].c_str());
-		unsigned char devType=atoi(sd[3].c_str());
-		unsigned char subType=atoi(sd[4].c_str());
-		_eSwitchType switchtype=(_eSwitchType) atoi(sd[5].c_str());
-		_eMeterType metertype=(_eMeterType)switchtype;
+		double total_real[6];
+		double counter1 = 0;
+		double counter2 = 0;
+		double counter3 = 0;
+		double counter4 = 0;
 
-		sprintf(szTmp,"SELECT MIN(Value1), MAX(Value1), MIN(Value2), MAX(Value2), MIN(Value3), MAX(Value3), MIN(Value4), MAX(Value4), MIN(Value5), MAX(Value5), MIN(Value6), MAX(Value6) FROM MultiMeter WHERE (DeviceRowID='%llu' AND Date>='%s' AND Date<'%s')",
-			ID,
-			szDateStart,
-			szDateEnd
-			);
-		result=query(szTmp);
-		if (result.size()>0)
+		if (devType==pTypeP1Power)
 		{
-			std::vector<std::string> sd=result[0];
-
-			float total_real[6];
-			float counter1 = 0;
-			float counter2 = 0;
-			float counter3 = 0;
-			float counter4 = 0;
-
-			if (devType==pTypeP1Power)
+			for (int ii=0; ii<6; ii++)
 			{
-				for (int ii=0; ii<6; ii++)
-				{
-					float total_min=(float)atof(sd[(ii*2)+0].c_str());
-					float total_max=(float)atof(sd[(ii*2)+1].c_str());
-					total_real[ii]=total_max-total_min;
-				}
-				counter1 = (float)atof(sd[1].c_str());
-				counter2 = (float)atof(sd[3].c_str());
-				counter3 = (float)atof(sd[9].c_str());
-				counter4 = (float)atof(sd[11].c_str());
+				double total_min=atof(sd[1+(ii*2)+0].c_str());
+				double total_max=atof(sd[1+(ii*2)+1].c_str());
+				total_real[ii]=total_max-total_min;
 			}
-			else
+			counter1 = atof(sd[2].c_str());
+			counter2 = atof(sd[4].c_str());
+			counter3 = atof(sd[10].c_str());
+			counter4 = atof(sd[12].c_str());
+		}
+		else
+		{
+			for (int ii=0; ii<6; ii++)
 			{
-				for (int ii=0; ii<6; ii++)
-				{
-					float fvalue=(float)atof(sd[ii].c_str());
-					total_real[ii]=fvalue;
-				}
+				total_real[ii]=atof(sd[1+ii].c_str());
 			}
+		}
 
-			//insert into calendar table
-			sprintf(szTmp,
-				"INSERT INTO MultiMeter_Calendar (DeviceRowID, Value1, Value2, Value3, Value4, Value5, Value6, Counter1, Counter2, Counter3, Counter4, Date) "
-				"VALUES ('%llu', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%s')",
-				ID,
-				total_real[0],
-				total_real[1],
-				total_real[2],
-				total_real[3],
-				total_real[4],
-				total_real[5],
-				counter1,
-				counter2,
-				counter3,
-				counter4,
-				szDateStart
-				);
-			result=query(szTmp);
+		//insert into calendar table
+		query(
+			"INSERT INTO MultiMeter_Calendar (DeviceRowID, Value1, Value2, Value3, Value4, Value5, Value6, Counter1, Counter2, Counter3, Counter4, Date) "
+			"VALUES (?, round(?,2), round(?,2), round(?,2), round(?,2), round(?,2), round(?,2), round(?,2), round(?,2), round(?,2), round(?,2), ?)",
+			CSQLParams().Add(ID).
+				Add(total_real[0]).Add(total_real[1]).Add(total_real[2]).Add(total_real[3]).Add(total_real[4]).Add(total_real[5]).
+				Add(counter1).Add(counter2).Add(counter3).Add(counter4).
+				Add(szDateStart));
 
-			//Check for Notification
-			if (devType==pTypeP1Power)
-			{
-				float musage=(total_real[0]+total_real[1])/EnergyDivider;
-				CheckAndHandleNotification(hardwareID, DeviceID, Unit, devType, subType, NTYPE_TODAYENERGY, musage);
-			}
-/*
-			//Insert the last (max) counter values into the table to get the "today" value correct.
-			sprintf(szTmp,
-				"INSERT INTO MultiMeter (DeviceRowID, Value1, Value2, Value3, Value4, Value5, Value6, Date) "
-				"VALUES (%llu, %s, %s, %s, %s, %s, %s, '%s')",
-				ID,
-				sd[0].c_str(),
-				sd[1].c_str(),
-				sd[2].c_str(),
-				sd[3].c_str(),
-				sd[4].c_str(),
-				sd[5].c_str(),
-				szDateEnd
-				);
-				result=query(szTmp);
-*/
+		//Check for Notification
+		if (devType==pTypeP1Power)
+		{
+			float musage=float(total_real[0]+total_real[1])/EnergyDivider;
+			CheckAndHandleNotification(hardwareID, DeviceID, Unit, devType, subType, NTYPE_TODAYENERGY, musage);
 		}
 	}
 }
 
 void CSQLHelper::AddCalendarUpdateWind()
 {
-	char szTmp[600];
-
-	//Get All Wind devices
-	std::vector<std::vector<std::string> > resultdevices;
-	strcpy(szTmp,"SELECT DISTINCT(DeviceRowID) FROM Wind ORDER BY DeviceRowID");
-	resultdevices=query(szTmp);
-	if (resultdevices.size()<1)
-		return; //nothing to do
-
-	char szDateStart[40];
-	char szDateEnd[40];
-
-	time_t now = mytime(NULL);
-	struct tm tm1;
-	localtime_r(&now,&tm1);
-
-	struct tm ltime;
-	ltime.tm_isdst=tm1.tm_isdst;
-	ltime.tm_hour=0;
-	ltime.tm_min=0;
-	ltime.tm_sec=0;
-	ltime.tm_year=tm1.tm_year;
-	ltime.tm_mon=tm1.tm_mon;
-	ltime.tm_mday=tm1.tm_mday;
-
-	sprintf(szDateEnd,"%04d-%02d-%02d",ltime.tm_year+1900,ltime.tm_mon+1,ltime.tm_mday);
-
-	//Subtract one day
-
-	ltime.tm_mday -= 1;
-	time_t later = mktime(&ltime);
-	struct tm tm2;
-	localtime_r(&later,&tm2);
-	sprintf(szDateStart,"%04d-%02d-%02d",tm2.tm_year+1900,tm2.tm_mon+1,tm2.tm_mday);
-
-	std::vector<std::vector<std::string> > result;
-
-	std::vector<std::vector<std::string> >::const_iterator itt;
-	for (itt=resultdevices.begin(); itt!=resultdevices.end(); ++itt)
-	{
-		std::vector<std::string> sddev=*itt;
-		unsigned long long ID;
-		std::stringstream s_str( sddev[0] );
-		s_str >> ID;
-
-		sprintf(szTmp,"SELECT AVG(Direction), MIN(Speed), MAX(Speed), MIN(Gust), MAX(Gust) FROM Wind WHERE (DeviceRowID='%llu' AND Date>='%s' AND Date<'%s')",
-			ID,
-			szDateStart,
-			szDateEnd
-			);
-		result=query(szTmp);
-		if (result.size()>0)
-		{
-			std::vector<std::string> sd=result[0];
-
-			float Direction=(float)atof(sd[0].c_str());
-			int speed_min=atoi(sd[1].c_str());
-			int speed_max=atoi(sd[2].c_str());
-			int gust_min=atoi(sd[3].c_str());
-			int gust_max=atoi(sd[4].c_str());
-
-			//insert into calendar table
-			sprintf(szTmp,
-				"INSERT INTO Wind_Calendar (DeviceRowID, Direction, Speed_Min, Speed_Max, Gust_Min, Gust_Max, Date) "
-				"VALUES ('%llu', '%.2f', '%d', '%d', '%d', '%d', '%s')",
-				ID,
-				Direction,
-				speed_min,
-				speed_max,
-				gust_min,
-				gust_max,
-				szDateStart
-				);
-			result=query(szTmp);
-		}
-	}
+	std::string szDateStart,szDateEnd;
+	GetYesterdayRange(szDateStart,szDateEnd);
+
+	query(
+		"INSERT INTO Wind_Calendar (DeviceRowID, Direction, Speed_Min, Speed_Max, Gust_Min, Gust_Max, Date) "
+		"SELECT DeviceRowID, round(AVG(Direction),2), CAST(MIN(Speed) AS INTEGER), CAST(MAX(Speed) AS INTEGER), CAST(MIN(Gust) AS INTEGER), CAST(MAX(Gust) AS INTEGER), ? "
+		"FROM Wind WHERE (Date>=? AND Date<?) GROUP BY DeviceRowID",
+		CSQLParams().Add(szDateStart).Add(szDateStart).Add(szDateEnd));
 }
 
 void CSQLHelper::AddCalendarUpdateUV()
 {
-	char szTmp[600];
-
-	//Get All UV devices
-	std::vector<std::vector<std::string> > resultdevices;
-	strcpy(szTmp,"SELECT DISTINCT(DeviceRowID) FROM UV ORDER BY DeviceRowID");
-	resultdevices=query(szTmp);
-	if (resultdevices.size()<1)
-		return; //nothing to do
-
-	char szDateStart[40];
-	char szDateEnd[40];
-
-	time_t now = mytime(NULL);
-	struct tm tm1;
-	localtime_r(&now,&tm1);
-
-	struct tm ltime;
-	ltime.tm_isdst=tm1.tm_isdst;
-	ltime.tm_hour=0;
-	ltime.tm_min=0;
-	ltime.tm_sec=0;
-	ltime.tm_year=tm1.tm_year;
-	ltime.tm_mon=tm1.tm_mon;
-	ltime.tm_mday=tm1.tm_mday;
-
-	sprintf(szDateEnd,"%04d-%02d-%02d",ltime.tm_year+1900,ltime.tm_mon+1,ltime.tm_mday);
-
-	//Subtract one day
-
-	ltime.tm_mday -= 1;
-	time_t later = mktime(&ltime);
-	struct tm tm2;
-	localtime_r(&later,&tm2);
-	sprintf(szDateStart,"%04d-%02d-%02d",tm2.tm_year+1900,tm2.tm_mon+1,tm2.tm_mday);
-
-	std::vector<std::vector<std::string> > result;
-
-	std::vector<std::vector<std::string> >::const_iterator itt;
-	for (itt=resultdevices.begin(); itt!=resultdevices.end(); ++itt)
-	{
-		std::vector<std::string> sddev=*itt;
-		unsigned long long ID;
-		std::stringstream s_str( sddev[0] );
-		s_str >> ID;
-
-		sprintf(szTmp,"SELECT MAX(Level) FROM UV WHERE (DeviceRowID='%llu' AND Date>='%s' AND Date<'%s')",
-			ID,
-			szDateStart,
-			szDateEnd
-			);
-		result=query(szTmp);
-		if (result.size()>0)
-		{
-			std::vector<std::string> sd=result[0];
-
-			float level=(float)atof(sd[0].c_str());
-
-			//insert into calendar table
-			sprintf(szTmp,
-				"INSERT INTO UV_Calendar (DeviceRowID, Level, Date) "
-				"VALUES ('%llu', '%.2f', '%s')",
-				ID,
-				level,
-				szDateStart
-				);
-			result=query(szTmp);
-		}
-	}
+	std::string szDateStart,szDateEnd;
+	GetYesterdayRange(szDateStart,szDateEnd);
+
+	query(
+		"INSERT INTO UV_Calendar (DeviceRowID, Level, Date) "
+		"SELECT DeviceRowID, round(MAX(Level),2), ? "
+		"FROM UV WHERE (Date>=? AND Date<?) GROUP BY DeviceRowID",
+		CSQLParams().Add(szDateStart).Add(szDateStart).Add(szDateEnd));
 }
 
 void CSQLHelper::AddCalendarUpdatePercentage()
 {
-	char szTmp[600];
-
-	//Get All Percentage devices in the Percentage Table
-	std::vector<std::vector<std::string> > resultdevices;
-	strcpy(szTmp,"SELECT DISTINCT(DeviceRowID) FROM Percentage ORDER BY DeviceRowID");
-	resultdevices=query(szTmp);
-	if (resultdevices.size()<1)
-		return; //nothing to do
-
-	char szDateStart[40];
-	char szDateEnd[40];
-
-	time_t now = mytime(NULL);
-	struct tm tm1;
-	localtime_r(&now,&tm1);
-
-	struct tm ltime;
-	ltime.tm_isdst=tm1.tm_isdst;
-	ltime.tm_hour=0;
-	ltime.tm_min=0;
-	ltime.tm_sec=0;
-	ltime.tm_year=tm1.tm_year;
-	ltime.tm_mon=tm1.tm_mon;
-	ltime.tm_mday=tm1.tm_mday;
-
-	sprintf(szDateEnd,"%04d-%02d-%02d",ltime.tm_year+1900,ltime.tm_mon+1,ltime.tm_mday);
-
-	//Subtract one day
-
-	ltime.tm_mday -= 1;
-	time_t later = mktime(&ltime);
-	struct tm tm2;
-	localtime_r(&later,&tm2);
-	sprintf(szDateStart,"%04d-%02d-%02d",tm2.tm_year+1900,tm2.tm_mon+1,tm2.tm_mday);
+	std::string szDateStart,szDateEnd;
+	GetYesterdayRange(szDateStart,szDateEnd);
+
+	query(
+		"INSERT INTO Percentage_Calendar (DeviceRowID, Percentage_Min, Percentage_Max, Percentage_Avg, Date) "
+		"SELECT DeviceRowID, round(MIN(Percentage),2), round(MAX(Percentage),2), round(AVG(Percentage),2), ? "
+		"FROM Percentage WHERE (Date>=? AND Date<?) GROUP BY DeviceRowID",
+		CSQLParams().Add(szDateStart).Add(szDateStart).Add(szDateEnd));
+}
 
-	std::vector<std::vector<std::string> > result;
+void CSQLHelper::AddCalendarUpdateFan()
+{
+	std::string szDateStart,szDateEnd;
+	GetYesterdayRange(szDateStart,szDateEnd);
+
+	query(
+		"INSERT INTO Fan_Calendar (DeviceRowID, Speed_Min, Speed_Max, Speed_Avg, Date) "
+		"SELECT DeviceRowID, CAST(MIN(Speed) AS INTEGER), CAST(MAX(Speed) AS INTEGER), CAST(AVG(Speed) AS INTEGER), ? "
+		"FROM Fan WHERE (Date>=? AND Date<?) GROUP BY DeviceRowID",
+		CSQLParams().Add(szDateStart).Add(szDateStart).Add(szDateEnd));
+}
 
-	std::vector<std::vector<std::string> >::const_iterator itt;
-	for (itt=resultdevices.begin(); itt!=resultdevices.end(); ++itt)
-	{
-		std::vector<std::string> sddev=*itt;
-		unsigned long long ID;
-		std::stringstream s_str( sddev[0] );
-		s_str >> ID;
+void CSQLHelper::CleanupShortLog()
+{
+	int n5MinuteHistoryDays=1;
+	if(GetPreferencesVar("5MinuteHistoryDays", n5MinuteHistoryDays))
+    {
+        // If the history days is zero then all data in the short logs is deleted!
+        if(n5MinuteHistoryDays == 0)
+        {
+            _log.Log(LOG_ERROR,"CleanupShortLog(): MinuteHistoryDays is zero!");
+            return;
+        }
 
-		sprintf(szTmp,"SELECT MIN(Percentage), MAX(Percentage), AVG(Percentage) FROM Percentage WHERE (DeviceRowID='%llu' AND Date>='%s' AND Date<'%s')",
-			ID,
-			szDateStart,
-			szDateEnd
-			);
-		result=query(szTmp);
-		if (result.size()>0)
+		std::string szDateCutoff=GetLocalTimeString(mytime(NULL)-(n5MinuteHistoryDays*24*3600));
+		if (m_bTSDBReady)
 		{
-			std::vector<std::string> sd=result[0];
-
-			float percentage_min=(float)atof(sd[0].c_str());
-			float percentage_max=(float)atof(sd[1].c_str());
-			float percentage_avg=(float)atof(sd[2].c_str());
-			//insert into calendar table
-			sprintf(szTmp,
-				"INSERT INTO Percentage_Calendar (DeviceRowID, Percentage_Min, Percentage_Max, Percentage_Avg, Date) "
-				"VALUES ('%llu', '%.2f', '%.2f', '%.2f','%s')",
-				ID,
-				percentage_min,
-				percentage_max,
-				percentage_avg,
-				szDateStart
-				);
-			result=query(szTmp);
+			m_tsdb.Prune(CTimeSeriesStore::LocalTimeFromString(szDateCutoff));
+			if (n5MinuteHistoryDays>TSDB_SQLITE_HISTORY_DAYS)
+				szDateCutoff=GetLocalTimeString(mytime(NULL)-(TSDB_SQLITE_HISTORY_DAYS*24*3600));
+		}
 
+		//done in the background, in batches
+		const char *szTables[] = { "Temperature", "Rain", "Wind", "UV", "Meter", "MultiMeter", "Percentage", "Fan" };
+		for (size_t ii=0; ii<sizeof(szTables)/sizeof(szTables[0]); ii++)
+		{
+			QueueCleanupLog(szTables[ii], szDateCutoff);
 		}
 	}
 }
 
+//A table that is still being cleaned up is skipped, the next run uses a newer cutoff
+void CSQLHelper::QueueCleanupLog(const std::string &szTable, const std::string &szDateCutoff)
+{
+	{
+		boost::lock_guard<boost::mutex> l(m_cleanup_mutex);
+		if (!m_cleanup_pending.insert(szTable).second)
+			return;
+		_tCleanupStats &cstats=m_cleanup_stats[szTable];
+		cstats.LastRun=mytime(NULL);
+		cstats.bDone=false;
+		cstats.Passes=0;
+		cstats.Rows=0;
+		cstats.TotalTime=0;
+	}
+	AddTaskItem(_tTaskItem::CleanupLog(0, szTable, szDateCutoff));
+}
 
-void CSQLHelper::AddCalendarUpdateFan()
+void CSQLHelper::GetCleanupStats(std::map<std::string, _tCleanupStats> &stats)
 {
-	char szTmp[600];
+	boost::lock_guard<boost::mutex> l(m_cleanup_mutex);
+	stats=m_cleanup_stats;
+}
 
-	//Get All FAN devices in the Fan Table
-	std::vector<std::vector<std::string> > resultdevices;
-	strcpy(szTmp,"SELECT DISTINCT(DeviceRowID) FROM Fan ORDER BY DeviceRowID");
-	resultdevices=query(szTmp);
-	if (resultdevices.size()<1)
-		return; //nothing to do
+//Deletes the rows older than szDateCutoff, RETENTION_BATCH_SIZE rows at a time with a short pause in between
+//so other queries can get the database. When the time budget is used, the rest is done in a next run.
+void CSQLHelper::CleanupLog(const std::string &szTable, const std::string &szDateCutoff)
+{
+	if (!m_dbase)
+	{
+		boost::lock_guard<boost::mutex> l(m_cleanup_mutex);
+		m_cleanup_pending.erase(szTable);
+		return;
+	}
+	boost::posix_time::ptime tstart=boost::posix_time::microsec_clock::universal_time();
+	long ms=0;
+	int totRows=0;
+	bool bDone=false;
 
-	char szDateStart[40];
-	char szDateEnd[40];
+	char szTmp[300];
+	sprintf(szTmp,"SELECT MAX(ROWID), COUNT(*) FROM (SELECT ROWID FROM %s WHERE (Date<?) ORDER BY ROWID LIMIT %d)",szTable.c_str(),RETENTION_BATCH_SIZE);
+	std::string szSelect=szTmp;
+	sprintf(szTmp,"DELETE FROM %s WHERE (ROWID<=?) AND (Date<?)",szTable.c_str());
+	std::string szDelete=szTmp;
 
-	time_t now = mytime(NULL);
-	struct tm tm1;
-	localtime_r(&now,&tm1);
+	while (!m_stoprequested)
+	{
+		std::vector<std::vector<std::string> > result;
+		result=query(szSelect,CSQLParams().Add(szDateCutoff));
+		//the aggregate always returns a row, MAX(ROWID) is NULL when nothing is left
+		int nRows=(!result.empty())?atoi(result[0][1].c_str()):0;
+		if (nRows==0)
+		{
+			bDone=true;
+			break;
+		}
+		unsigned long long maxRowID=0;
+		std::stringstream s_str( result[0][0] );
+		s_str >> maxRowID;
 
-	struct tm ltime;
-	ltime.tm_isdst=tm1.tm_isdst;
-	ltime.tm_hour=0;
-	ltime.tm_min=0;
-	ltime.tm_sec=0;
-	ltime.tm_year=tm1.tm_year;
-	ltime.tm_mon=tm1.tm_mon;
-	ltime.tm_mday=tm1.tm_mday;
+		query(szDelete,CSQLParams().Add(maxRowID).Add(szDateCutoff));
+		totRows+=nRows;
 
-	sprintf(szDateEnd,"%04d-%02d-%02d",ltime.tm_year+1900,ltime.tm_mon+1,ltime.tm_mday);
+		ms=(long)(boost::posix_time::microsec_clock::universal_time()-tstart).total_milliseconds();
+		if (nRows<RETENTION_BATCH_SIZE)
+		{
+			bDone=true;
+			break;
+		}
+		if (ms>=RETENTION_TIME_BUDGET_MS)
+			break;
+		sleep_milliseconds(RETENTION_BATCH_PAUSE_MS);
+	}
+	if ((totRows!=0)&&(m_bIncrementalVacuum))
+	{
+		//give the freed pages back to the file system
+		query("PRAGMA incremental_vacuum(1000);");
+	}
+	ms=(long)(boost::posix_time::microsec_clock::universal_time()-tstart).total_milliseconds();
+	{
+		//every pass is counted, getdbwriterstats shows them per table
+		boost::lock_guard<boost::mutex> l(m_cleanup_mutex);
+		_tCleanupStats &cstats=m_cleanup_stats[szTable];
+		cstats.Passes++;
+		cstats.Rows+=totRows;
+		cstats.TotalTime+=ms;
+		cstats.bDone=bDone;
+		if ((bDone)||(m_stoprequested))
+		{
+			m_cleanup_pending.erase(szTable);
+			return;
+		}
+	}
+	_log.Log(LOG_NORM,"Cleanup %s: %d rows pruned in %ld ms, continuing in %d seconds",szTable.c_str(),totRows,ms,RETENTION_CONTINUE_DELAY);
+	//stays pending
+	AddTaskItem(_tTaskItem::CleanupLog(RETENTION_CONTINUE_DELAY, szTable, szDateCutoff));
+}
 
-	//Subtract one day
+static const _tTSDBTable *FindTSDBTable(const std::string &szTable)
+{
+	for (int ii=0; tsdbTables[ii].szTable!=NULL; ii++)
+	{
+		if (szTable==tsdbTables[ii].szTable)
+			return &tsdbTables[ii];
+	}
+	return NULL;
+}
 
-	ltime.tm_mday -= 1;
-	time_t later = mktime(&ltime);
-	struct tm tm2;
-	localtime_r(&later,&tm2);
-	sprintf(szDateStart,"%04d-%02d-%02d",tm2.tm_year+1900,tm2.tm_mon+1,tm2.tm_mday);
+//Same text as sqlite returns for a REAL column
+static std::string FormatSQLiteReal(const double value)
+{
+	char szTmp[40];
+	sprintf(szTmp,"%.15g",value);
+	if (strpbrk(szTmp,".eEnN")==NULL)
+		strcat(szTmp,".0");
+	return szTmp;
+}
 
-	std::vector<std::vector<std::string> > result;
+//The store is kept next to the database, domoticz.db -> domoticz_tsdb
+std::string CSQLHelper::GetTimeSeriesStorePath()
+{
+	std::string szPath=m_dbase_name;
+	size_t pos=szPath.rfind('.');
+	if ((pos!=std::string::npos)&&(szPath.find_first_of("/\\",pos)==std::string::npos))
+		szPath=szPath.substr(0,pos);
+	return szPath+"_tsdb";
+}
 
-	std::vector<std::vector<std::string> >::const_iterator itt;
-	for (itt=resultdevices.begin(); itt!=resultdevices.end(); ++itt)
+//True when the store holds 5 minute history that is no longer in the database (older than TSDB_SQLITE_HISTORY_DAYS)
+bool CSQLHelper::HasStoreOnlyHistory()
+{
+	if (!m_bTSDBReady)
+		return false;
+	long long oldest=m_tsdb.GetOldestTime();
+	long long cutoff=CTimeSeriesStore::LocalTimeFromString(GetLocalTimeString(mytime(NULL)-(TSDB_SQLITE_HISTORY_DAYS*24*3600)));
+	return ((oldest>=0)&&(oldest<cutoff));
+}
+
+bool CSQLHelper::OpenTimeSeriesStore()
+{
+	std::string szPath=GetTimeSeriesStorePath();
+	if (!m_tsdb.Open(szPath))
 	{
-		std::vector<std::string> sddev=*itt;
-		unsigned long long ID;
-		std::stringstream s_str( sddev[0] );
-		s_str >> ID;
+		_log.Log(LOG_ERROR,"Time series store: could not open %s",szPath.c_str());
+		return false;
+	}
+	m_bTSDBEnabled=true;
+	return true;
+}
 
-		sprintf(szTmp,"SELECT MIN(Speed), MAX(Speed), AVG(Speed) FROM Fan WHERE (DeviceRowID='%llu' AND Date>='%s' AND Date<'%s')",
-			ID,
-			szDateStart,
-			szDateEnd
-			);
+//Copies the rows that were added to the 5 minute log tables since the last run into the store
+void CSQLHelper::SyncTimeSeriesStore()
+{
+	if (!m_bTSDBEnabled)
+		return;
+	char szTmp[400];
+	for (int ii=0; tsdbTables[ii].szTable!=NULL; ii++)
+	{
+		const _tTSDBTable &ttable=tsdbTables[ii];
+		std::vector<std::string> columns;
+		StringSplit(ttable.szColumns, ",", columns);
+		int nColumns=(int)columns.size();
+		std::string szColumns;
+		for (int jj=0; jj<nColumns; jj++)
+			szColumns+="["+columns[jj]+"], ";
+
+		_tTSSyncPoint syncpoint;
+		m_tsdb.GetSyncPoint(ttable.szTable, syncpoint);
+		std::vector<std::vector<std::string> > result;
+		if (syncpoint.RowID!=0)
+		{
+			//sqlite hands out the ROWIDs of deleted newest rows again, the row we stopped at has to be the same one
+			sprintf(szTmp,"SELECT Date FROM %s WHERE (ROWID==?)",ttable.szTable);
+			result=query(szTmp,CSQLParams().Add(syncpoint.RowID));
+			if ((result.empty())||((syncpoint.Time!=0)&&(CTimeSeriesStore::LocalTimeFromString(result[0][0])!=syncpoint.Time)))
+			{
+				//continue after the last row that is older, rows that are already stored are skipped by Append
+				sprintf(szTmp,"SELECT MAX(ROWID) FROM %s WHERE (Date<?)",ttable.szTable);
+				result=query(szTmp,CSQLParams().Add(CTimeSeriesStore::LocalTimeToString(syncpoint.Time)));
+				syncpoint.RowID=0;
+				if ((!result.empty())&&(!result[0][0].empty()))
+				{
+					std::stringstream s_str( result[0][0] );
+					s_str >> syncpoint.RowID;
+				}
+				_log.Log(LOG_STATUS,"Time series store: %s rows were removed, copying again from row %llu",ttable.szTable,syncpoint.RowID);
+			}
+		}
+		sprintf(szTmp,"SELECT MAX(ROWID) FROM %s",ttable.szTable);
 		result=query(szTmp);
-		if (result.size()>0)
+		unsigned long long maxRowID=0;
+		if ((!result.empty())&&(!result[0][0].empty()))
 		{
-			std::vector<std::string> sd=result[0];
-
-			int speed_min=(int)atoi(sd[0].c_str());
-			int speed_max=(int)atoi(sd[1].c_str());
-			int speed_avg=(int)atoi(sd[2].c_str());
-			//insert into calendar table
-			sprintf(szTmp,
-				"INSERT INTO Fan_Calendar (DeviceRowID, Speed_Min, Speed_Max, Speed_Avg, Date) "
-				"VALUES ('%llu', '%d', '%d', '%d','%s')",
-				ID,
-				speed_min,
-				speed_max,
-				speed_avg,
-				szDateStart
-				);
-			result=query(szTmp);
+			std::stringstream s_str( result[0][0] );
+			s_str >> maxRowID;
+		}
+		if (maxRowID==syncpoint.RowID)
+			continue;
 
+		sprintf(szTmp,"SELECT ROWID, DeviceRowID, %sDate FROM %s WHERE (ROWID>?) ORDER BY ROWID LIMIT %d",szColumns.c_str(),ttable.szTable,TSDB_SYNC_BATCH_SIZE);
+		std::string szQuery=szTmp;
+		for (;;)
+		{
+			result=query(szQuery,CSQLParams().Add(syncpoint.RowID));
+			std::vector<std::vector<std::string> >::const_iterator itt;
+			for (itt=result.begin(); itt!=result.end(); ++itt)
+			{
+				const std::vector<std::string> &sd=*itt;
+				std::stringstream s_str( sd[0] );
+				s_str >> syncpoint.RowID;
+				unsigned long long DeviceRowID=0;
+				std::stringstream s_str2( sd[1] );
+				s_str2 >> DeviceRowID;
+				_tTSPoint point;
+				memset(&point,0,sizeof(point));
+				point.Time=CTimeSeriesStore::LocalTimeFromString(sd[2+nColumns]);
+				syncpoint.Time=point.Time;
+				if (point.Time<0)
+					continue;
+				for (int jj=0; jj<nColumns; jj++)
+					point.Values[jj]=atof(sd[2+jj].c_str());
+				m_tsdb.Append(ttable.szTable, DeviceRowID, nColumns, point);
+			}
+			if (result.size()<TSDB_SYNC_BATCH_SIZE)
+				break;
 		}
+		m_tsdb.SetSyncPoint(ttable.szTable, syncpoint);
 	}
+	m_bTSDBReady=true;
 }
 
-
-void CSQLHelper::CleanupShortLog()
+std::vector<std::vector<std::string> > CSQLHelper::GetShortLog(const std::string &Table, const unsigned long long DeviceRowID, const std::string &szColumns, const std::string &szDateStart, const std::string &szDateEnd)
 {
-	int n5MinuteHistoryDays=1;
-	if(GetPreferencesVar("5MinuteHistoryDays", n5MinuteHistoryDays))
-    {
-        // If the history days is zero then all data in the short logs is deleted!
-        if(n5MinuteHistoryDays == 0)
-        {
-            _log.Log(LOG_ERROR,"CleanupShortLog(): MinuteHistoryDays is zero!");
-            return;
-        }
-
-		char szDateStr[40];
-		char szTmp[200];
-
-	    sprintf(szDateStr,"datetime('now','-%d day', 'localtime')",n5MinuteHistoryDays);
+	std::string szEnd=szDateEnd;
+	if ((!szEnd.empty())&&(szEnd.find(':')==std::string::npos))
+		szEnd+=" 23:59:59";
+
+	//map the requested columns on the columns in the store, -1 is the date
+	const _tTSDBTable *pTable=(m_bTSDBReady)?FindTSDBTable(Table):NULL;
+	std::vector<int> colmap;
+	if (pTable!=NULL)
+	{
+		std::vector<std::string> storecolumns;
+		StringSplit(pTable->szColumns, ",", storecolumns);
+		std::vector<std::string> columns;
+		StringSplit(szColumns, ",", columns);
+		std::vector<std::string>::iterator itt;
+		for (itt=columns.begin(); itt!=columns.end(); ++itt)
+		{
+			std::string szColumn=*itt;
+			stdstring_trim(szColumn);
+			if ((szColumn.size()>2)&&(szColumn[0]=='[')&&(szColumn[szColumn.size()-1]==']'))
+				szColumn=szColumn.substr(1,szColumn.size()-2);
+			if (szColumn=="Date")
+			{
+				colmap.push_back(-1);
+				continue;
+			}
+			std::vector<std::string>::const_iterator ittCol=std::find(storecolumns.begin(),storecolumns.end(),szColumn);
+			if (ittCol==storecolumns.end())
+			{
+				pTable=NULL; //not in the store
+				break;
+			}
+			colmap.push_back((int)(ittCol-storecolumns.begin()));
+		}
+	}
 
-	    sprintf(szTmp,"DELETE FROM Temperature WHERE (Date<%s)",szDateStr);
-	    query(szTmp);
+	if (pTable==NULL)
+	{
+		std::string szQuery="SELECT "+szColumns+" FROM "+Table+" WHERE (DeviceRowID==?)";
+		CSQLParams params;
+		params.Add(DeviceRowID);
+		if (!szDateStart.empty())
+		{
+			szQuery+=" AND (Date>=?)";
+			params.Add(szDateStart);
+		}
+		if (!szEnd.empty())
+		{
+			szQuery+=" AND (Date<=?)";
+			params.Add(szEnd);
+		}
+		szQuery+=" ORDER BY Date ASC";
+		return query(szQuery,params);
+	}
 
-	    sprintf(szTmp,"DELETE FROM Rain WHERE (Date<%s)",szDateStr);
-	    query(szTmp);
+	//the store is pruned per day, so apply the history setting here
+	int n5MinuteHistoryDays=1;
+	GetPreferencesVar("5MinuteHistoryDays", n5MinuteHistoryDays);
+	long long tstart=CTimeSeriesStore::LocalTimeFromString(GetLocalTimeString(mytime(NULL)-(n5MinuteHistoryDays*24*3600)));
+	if (!szDateStart.empty())
+		tstart=std::max(tstart,CTimeSeriesStore::LocalTimeFromString(szDateStart));
+	long long tend=(szEnd.empty())?LLONG_MAX:CTimeSeriesStore::LocalTimeFromString(szEnd);
 
-	    sprintf(szTmp,"DELETE FROM Wind WHERE (Date<%s)",szDateStr);
-	    query(szTmp);
+	std::vector<_tTSPoint> points;
+	m_tsdb.Query(Table, DeviceRowID, tstart, tend, points);
 
-	    sprintf(szTmp,"DELETE FROM UV WHERE (Date<%s)",szDateStr);
-	    query(szTmp);
+	std::vector<std::vector<std::string> > results;
+	results.reserve(points.size());
+	char szTmp[40];
+	std::vector<_tTSPoint>::const_iterator itt;
+	for (itt=points.begin(); itt!=points.end(); ++itt)
+	{
+		std::vector<std::string> row;
+		std::vector<int>::const_iterator ittCol;
+		for (ittCol=colmap.begin(); ittCol!=colmap.end(); ++ittCol)
+		{
+			if (*ittCol==-1)
+				row.push_back(CTimeSeriesStore::LocalTimeToString(itt->Time));
+			else if (pTable->szTypes[*ittCol]=='I')
+			{
+				sprintf(szTmp,"%lld",(long long)itt->Values[*ittCol]);
+				row.push_back(szTmp);
+			}
+			else
+				row.push_back(FormatSQLiteReal(itt->Values[*ittCol]));
+		}
+		results.push_back(row);
+	}
+	return results;
+}
 
-	    sprintf(szTmp,"DELETE FROM Meter WHERE (Date<%s)",szDateStr);
-	    query(szTmp);
+bool CSQLHelper::MigrateTimeSeriesStore()
+{
+	m_bTSDBEnabled=false;
+	m_bTSDBReady=false;
+	if (!OpenTimeSeriesStore())
+		return false;
+	_log.Log(LOG_STATUS,"Time series store: copying the 5 minute log tables...");
+	boost::posix_time::ptime tstart=boost::posix_time::microsec_clock::universal_time();
+	m_tsdb.RemoveAll();
+	SyncTimeSeriesStore();
+	long ms=(long)(boost::posix_time::microsec_clock::universal_time()-tstart).total_milliseconds();
+	for (int ii=0; tsdbTables[ii].szTable!=NULL; ii++)
+	{
+		_tTSStoreStats stats;
+		m_tsdb.GetStats(tsdbTables[ii].szTable, stats);
+		_log.Log(LOG_STATUS,"Time series store: %s, %llu devices, %llu points, %llu bytes",tsdbTables[ii].szTable,stats.Series,stats.Points,stats.Bytes);
+	}
+	UpdatePreferencesVar("EnableTimeSeriesStore", 1);
+	_log.Log(LOG_STATUS,"Time series store: migration done in %ld ms, the store is enabled",ms);
+	return true;
+}
 
-	    sprintf(szTmp,"DELETE FROM MultiMeter WHERE (Date<%s)",szDateStr);
-	    query(szTmp);
+void CSQLHelper::BenchmarkTimeSeriesStore()
+{
+	if ((!m_bTSDBEnabled)&&(!OpenTimeSeriesStore()))
+		return;
+	bool bTSDBReady=m_bTSDBReady;
+	std::string szBenchDB=m_dbase_name+".bench";
+	char szTmp[400];
+	for (int ii=0; tsdbTables[ii].szTable!=NULL; ii++)
+	{
+		const _tTSDBTable &ttable=tsdbTables[ii];
+		std::vector<std::vector<std::string> > result;
+		sprintf(szTmp,"SELECT COUNT(*) FROM %s",ttable.szTable);
+		result=query(szTmp);
+		unsigned long long nRows=(result.empty())?0:(unsigned long long)atoll(result[0][0].c_str());
 
-		sprintf(szTmp,"DELETE FROM Percentage WHERE (Date<%s)",szDateStr);
+		//size in sqlite: copy the table and its index into an empty database
+		remove(szBenchDB.c_str());
+		query("ATTACH DATABASE '"+szBenchDB+"' AS bench");
+		sprintf(szTmp,"CREATE TABLE bench.[%s] AS SELECT * FROM main.[%s]",ttable.szTable,ttable.szTable);
 		query(szTmp);
-	
-		sprintf(szTmp,"DELETE FROM Fan WHERE (Date<%s)",szDateStr);
+		sprintf(szTmp,"CREATE INDEX bench.[%s_Idx] ON [%s] ([DeviceRowID], [Date])",ttable.szTable,ttable.szTable);
 		query(szTmp);
-	}
+		query("DETACH DATABASE bench");
+		long long sqlbytes=0;
+		FILE *fIn=fopen(szBenchDB.c_str(),"rb");
+		if (fIn!=NULL)
+		{
+			fseek(fIn,0,SEEK_END);
+			sqlbytes=ftell(fIn);
+			fclose(fIn);
+		}
+
+		_tTSStoreStats stats;
+		m_tsdb.GetStats(ttable.szTable, stats);
+
+		//scan all devices as the day graph does
+		std::string szColumns=ttable.szColumns;
+		szColumns=stdreplace(szColumns,"Usage","[Usage]")+",Date";
+		sprintf(szTmp,"SELECT DISTINCT DeviceRowID FROM %s",ttable.szTable);
+		result=query(szTmp);
+		std::vector<unsigned long long> devices;
+		std::vector<std::vector<std::string> >::const_iterator itt;
+		for (itt=result.begin(); itt!=result.end(); ++itt)
+			devices.push_back((unsigned long long)atoll((*itt)[0].c_str()));
+		long scanms[2];
+		size_t scanrows[2];
+		for (int jj=0; jj<2; jj++)
+		{
+			m_bTSDBReady=(jj==1);
+			scanrows[jj]=0;
+			boost::posix_time::ptime tstart=boost::posix_time::microsec_clock::universal_time();
+			std::vector<unsigned long long>::const_iterator itt2;
+			for (itt2=devices.begin(); itt2!=devices.end(); ++itt2)
+				scanrows[jj]+=GetShortLog(ttable.szTable, *itt2, szColumns).size();
+			scanms[jj]=(long)(boost::posix_time::microsec_clock::universal_time()-tstart).total_milliseconds();
+		}
+		m_bTSDBReady=bTSDBReady;
+
+		_log.Log(LOG_STATUS,"Benchmark %s: sqlite %llu rows, %lld bytes (%.1f bytes/row), store %llu points, %llu bytes (%.1f bytes/point)",
+			ttable.szTable,
+			nRows,sqlbytes,(nRows>0)?(double)sqlbytes/nRows:0.0,
+			stats.Points,stats.Bytes,(stats.Points>0)?(double)stats.Bytes/stats.Points:0.0);
+		_log.Log(LOG_STATUS,"Benchmark %s: scan of %d devices, sqlite %d rows in %ld ms, store %d rows in %ld ms",
+			ttable.szTable,(int)devices.size(),(int)scanrows[0],scanms[0],(int)scanrows[1],scanms[1]);
+	}
+	remove(szBenchDB.c_str());
+	if (!bTSDBReady)
+		_log.Log(LOG_STATUS,"Benchmark: the time series store is not in use, run with -tsdbmigrate first");
 }
 
+
 void CSQLHelper::DeleteHardware(const std::string &idx)
 {
 	std::vector<std::vector<std::string> > result;
@@ -5337,6 +5695,11 @@ void CSQLHelper::DeleteEvent(const std::string &idx)
 void CSQLHelper::DeleteDevice(const std::string &idx)
 {
 	char szTmp[200];
+	unsigned long long ulIdx=0;
+	std::stringstream s_str( idx );
+	s_str >> ulIdx;
+	FlushWriteQueue(ulIdx);
+	m_tsdb.RemoveSeries(ulIdx);
 	sprintf(szTmp,"DELETE FROM LightingLog WHERE (DeviceRowID == %s)",idx.c_str());
 	query(szTmp);
 	sprintf(szTmp,"DELETE FROM LightSubDevices WHERE (ParentID == %s)",idx.c_str());
@@ -5387,6 +5750,7 @@ void CSQLHelper::DeleteDevice(const std::string &idx)
 	m_mainworker.m_eventsystem.RemoveSingleState(atoi(idx.c_str()));
     
 	query(szTmp);
+	SetLogDataChanged();
 }
 
 void CSQLHelper::TransferDevice(const std::string &idx, const std::string &newidx)
@@ -5394,6 +5758,24 @@ void CSQLHelper::TransferDevice(const std::string &idx, const std::string &newid
 	char szTmp[400];
 	std::vector<std::vector<std::string> > result;
 
+	//queued switch log rows have to be moved too
+	FlushWriteQueue(strtoull(idx.c_str(),NULL,10));
+	FlushWriteQueue(strtoull(newidx.c_str(),NULL,10));
+
+	//5 minute history in the time series store is moved for the same date range as the rows of its table below,
+	//rows that are not in the store yet are copied with their new DeviceRowID
+	static const char *szTSDBTransferTables[] = { "Temperature", "Rain", "Wind", "UV", "Meter", "MultiMeter", NULL };
+	std::map<std::string,long long> tsdbTimeEnd;
+	if (m_bTSDBEnabled)
+	{
+		for (int ii=0; szTSDBTransferTables[ii]!=NULL; ii++)
+		{
+			sprintf(szTmp,"SELECT Date FROM %s WHERE (DeviceRowID == '%s') ORDER BY Date ASC LIMIT 1",szTSDBTransferTables[ii],newidx.c_str());
+			result=query(szTmp);
+			tsdbTimeEnd[szTSDBTransferTables[ii]]=(result.size()>0)?CTimeSeriesStore::LocalTimeFromString(result[0][0]):LLONG_MAX;
+		}
+	}
+
 	sprintf(szTmp,"UPDATE LightingLog SET DeviceRowID=%s WHERE (DeviceRowID == '%s')",newidx.c_str(),idx.c_str());
 	query(szTmp);
 	sprintf(szTmp,"UPDATE LightSubDevices SET DeviceRowID=%s WHERE (DeviceRowID == '%s')",newidx.c_str(),idx.c_str());
@@ -5502,6 +5884,14 @@ void CSQLHelper::TransferDevice(const std::string &idx, const std::string &newid
 	else
 		sprintf(szTmp,"UPDATE MultiMeter_Calendar SET DeviceRowID=%s WHERE (DeviceRowID == '%s')",newidx.c_str(),idx.c_str());
 	query(szTmp);
+
+	//before the caller deletes the old device, which removes its series
+	std::map<std::string,long long>::const_iterator ittEnd;
+	for (ittEnd=tsdbTimeEnd.begin(); ittEnd!=tsdbTimeEnd.end(); ++ittEnd)
+		m_tsdb.MoveSeries(ittEnd->first,strtoull(idx.c_str(),NULL,10),strtoull(newidx.c_str(),NULL,10),ittEnd->second);
+
+	//cached graphs of both devices are stale now
+	SetLogDataChanged();
 }
 
 void CSQLHelper::CheckAndUpdateDeviceOrder()
@@ -5580,11 +5970,7 @@ void CSQLHelper::CleanupLightLog()
 	localtime_r(&daybefore,&tm2);
 	sprintf(szDateEnd,"%04d-%02d-%02d %02d:%02d:00",tm2.tm_year+1900,tm2.tm_mon+1,tm2.tm_mday,tm2.tm_hour,tm2.tm_min);
 
-	char szTmp[100];
-	sprintf(szTmp,"DELETE FROM LightingLog WHERE (Date<'%s')",
-		szDateEnd
-		);
-	query(szTmp);
+	QueueCleanupLog("LightingLog", szDateEnd);
 }
 
 bool CSQLHelper::DoesSceneByNameExits(const std::string &SceneName)
@@ -5748,6 +6134,13 @@ void CSQLHelper::DeleteDataPoint(const char *ID, const std::string &Date)
 
 		sprintf(szTmp,"DELETE FROM Fan WHERE (DeviceRowID==%s) AND (Date>='%s') AND (Date<=%s)",ID,Date.c_str(),szDateEnd);
 		result=query(szTmp);
+
+		unsigned long long ulID=0;
+		std::stringstream s_str( ID );
+		s_str >> ulID;
+		long long tstart=CTimeSeriesStore::LocalTimeFromString(Date);
+		for (int ii=0; tsdbTables[ii].szTable!=NULL; ii++)
+			m_tsdb.RemovePoints(tsdbTables[ii].szTable, ulID, tstart, tstart+120);
 	}
 	else
 	{
@@ -5768,12 +6161,34 @@ void CSQLHelper::DeleteDataPoint(const char *ID, const std::string &Date)
 		sprintf(szTmp,"DELETE FROM Fan_Calendar WHERE (DeviceRowID==%s) AND (Date=='%s')",ID,Date.c_str());
 		result=query(szTmp);
 	}
+	SetLogDataChanged();
 }
 
 void CSQLHelper::AddTaskItem(const _tTaskItem &tItem)
 {
-	boost::lock_guard<boost::mutex> l(m_background_task_mutex);
-	m_background_task_queue.push_back(tItem);
+	boost::chrono::steady_clock::time_point due=boost::chrono::steady_clock::now()+boost::chrono::milliseconds((long)(tItem._DelayTime*1000.0f));
+	{
+		boost::lock_guard<boost::mutex> l(m_background_task_mutex);
+		TaskQueue::iterator itt=m_background_task_queue.insert(std::pair<boost::chrono::steady_clock::time_point,_tTaskItem>(due,tItem));
+		if (tItem._ItemType==TITEM_SWITCHCMD)
+		{
+			//Remove a pending instance of this device/command first,
+			//otherwise the command will be send twice, and the first one too soon
+			_tTaskItemKey key;
+			key.idx=tItem._idx;
+			key.HardwareID=tItem._HardwareID;
+			key.nValue=tItem._nValue;
+			std::map<_tTaskItemKey,TaskQueue::iterator>::iterator ittKey=m_background_task_index.find(key);
+			if (ittKey!=m_background_task_index.end())
+			{
+				m_background_task_queue.erase(ittKey->second);
+				ittKey->second=itt;
+			}
+			else
+				m_background_task_index[key]=itt;
+		}
+	}
+	m_background_task_cond.notify_one();
 }
 
 void CSQLHelper::EventsGetTaskItems(std::vector<_tTaskItem> &currentTasks)
@@ -5782,9 +6197,9 @@ void CSQLHelper::EventsGetTaskItems(std::vector<_tTaskItem> &currentTasks)
     
 	currentTasks.clear();
     
-    for(std::vector<_tTaskItem>::iterator it = m_background_task_queue.begin(); it != m_background_task_queue.end(); ++it)
+    for(TaskQueue::const_iterator it = m_background_task_queue.begin(); it != m_background_task_queue.end(); ++it)
     {
-		currentTasks.push_back(*it);
+		currentTasks.push_back(it->second);
 	}
 }
 
@@ -5830,9 +6245,48 @@ bool CSQLHelper::RestoreDatabase(const std::string &dbase)
 	sqlite3_close(dbase_restore);
 	//we have a valid database!
 	std::remove(outputfile.c_str());
+	//a running backup keeps the database in use
+	AbortBackup();
+	boost::lock_guard<boost::mutex> lb(m_backup_mutex);
 	//stop database
-	sqlite3_close(m_dbase);
-	m_dbase=NULL;
+	{
+		CSQLQueryLock l(m_sqlQueryMutex);
+		ApplyWriteQueue();
+		ClearStatementCache();
+		sqlite3_close(m_dbase);
+		m_dbase=NULL;
+	}
+	//cached graphs belong to the old database
+	SetLogDataChanged();
+	//so does the time series store, OpenDatabase opens and fills it again when the restored database has it enabled.
+	//History that is only in the store is not in the restored database, that store is moved aside instead of removed
+	bool bKeepStore=HasStoreOnlyHistory();
+	m_bTSDBEnabled=false;
+	m_bTSDBReady=false;
+	if (m_tsdb.IsOpen())
+	{
+		if (bKeepStore)
+		{
+			m_tsdb.Close();
+			std::string szPath=GetTimeSeriesStorePath();
+			std::string szKeepPath=szPath+"_"+boost::lexical_cast<std::string>(mytime(NULL));
+			if (std::rename(szPath.c_str(),szKeepPath.c_str())==0)
+				_log.Log(LOG_ERROR,"Restore: 5 minute history older than %d days is not in the restored database, the previous time series store is kept in %s",TSDB_SQLITE_HISTORY_DAYS,szKeepPath.c_str());
+			else
+			{
+				//never reuse it for the restored database, its rows belong to the old one
+				_log.Log(LOG_ERROR,"Restore: could not move the previous time series store aside, its 5 minute history older than %d days is lost",TSDB_SQLITE_HISTORY_DAYS);
+				m_tsdb.Open(szPath);
+				m_tsdb.RemoveAll();
+				m_tsdb.Close();
+			}
+		}
+		else
+		{
+			m_tsdb.RemoveAll();
+			m_tsdb.Close();
+		}
+	}
 	std::ofstream outfile2;
 	outfile2.open(m_dbase_name.c_str(),std::ios::out|std::ios::binary|std::ios::trunc);
 	if (!outfile2.is_open())
@@ -5856,49 +6310,186 @@ bool CSQLHelper::RestoreDatabase(const std::string &dbase)
 	return OpenDatabase();
 }
 
-bool CSQLHelper::BackupDatabase(const std::string &OutputFile)
+static bool GZipFile(const std::string &InputFile, const std::string &OutputFile)
+{
+	FILE *fIn=fopen(InputFile.c_str(),"rb");
+	if (!fIn)
+		return false;
+	gzFile fOut=gzopen(OutputFile.c_str(),"wb6");
+	if (!fOut)
+	{
+		fclose(fIn);
+		return false;
+	}
+	bool bResult=true;
+	std::vector<char> buffer(BACKUP_GZIP_CHUNK_SIZE);
+	size_t nRead;
+	while ((nRead=fread(&buffer[0],1,buffer.size(),fIn))>0)
+	{
+		if (gzwrite(fOut,&buffer[0],(unsigned)nRead)!=(int)nRead)
+		{
+			bResult=false;
+			break;
+		}
+	}
+	if (ferror(fIn))
+		bResult=false;
+	fclose(fIn);
+	if (gzclose(fOut)!=Z_OK)
+		bResult=false;
+	return bResult;
+}
+
+bool CSQLHelper::BackupDatabase(const std::string &OutputFile, const bool bCompress, int StepDelayMS)
 {
 	if (!m_dbase)
 		return false; //database not open!
 
-	boost::lock_guard<boost::mutex> l(m_sqlQueryMutex);
+	//the abort flag is only cleared when no backup is running or waiting,
+	//so an abort that comes in before this backup got the backup mutex is not lost
+	{
+		boost::lock_guard<boost::mutex> l(m_backup_status_mutex);
+		m_backup_users++;
+	}
+	bool bResult=DoBackupDatabase(OutputFile, bCompress, StepDelayMS);
+	boost::lock_guard<boost::mutex> l(m_backup_status_mutex);
+	if (--m_backup_users==0)
+		m_bAbortBackup=false;
+	return bResult;
+}
+
+bool CSQLHelper::DoBackupDatabase(const std::string &OutputFile, const bool bCompress, int StepDelayMS)
+{
+	boost::lock_guard<boost::mutex> lb(m_backup_mutex);
+	if (m_bAbortBackup)
+	{
+		_log.Log(LOG_ERROR,"Backup aborted: %s", OutputFile.c_str());
+		return false;
+	}
+	if (!m_dbase)
+		return false;
+	if (StepDelayMS<0)
+	{
+		StepDelayMS=BACKUP_STEP_DELAY_MS;
+		GetPreferencesVar("BackupStepDelay", StepDelayMS);
+	}
 
-	int rc;                     // Function return code
-	sqlite3 *pFile;             // Database connection opened on zFilename
-	sqlite3_backup *pBackup;    // Backup handle used to copy data
+	FlushWriteQueue();
 
-	// Open the database file identified by zFilename.
-	rc = sqlite3_open(OutputFile.c_str(), &pFile);
-	if( rc!=SQLITE_OK )
+	//the database only has TSDB_SQLITE_HISTORY_DAYS of 5 minute history while the store is enabled
+	if (HasStoreOnlyHistory())
+		_log.Log(LOG_ERROR,"Backup: 5 minute history older than %d days is only in the time series store (%s) and is not part of this backup",TSDB_SQLITE_HISTORY_DAYS,GetTimeSeriesStorePath().c_str());
+
+	//Copy into a temporary file, a previous backup with the same name stays intact until the new one is complete
+	std::string TempFile=OutputFile+".tmp";
+	std::remove(TempFile.c_str());
+
+	sqlite3 *pFile=NULL;
+	int rc = sqlite3_open(TempFile.c_str(), &pFile);
+	if (rc!=SQLITE_OK)
+	{
+		sqlite3_close(pFile);
 		return false;
+	}
 
-	// Open the sqlite3_backup object used to accomplish the transfer
-    pBackup = sqlite3_backup_init(pFile, "main", m_dbase, "main");
-    if( pBackup )
-	{
-      // Each iteration of this loop copies 5 database pages from database
-      // pDb to the backup database.
-      do {
-        rc = sqlite3_backup_step(pBackup, 5);
-        //xProgress(  sqlite3_backup_remaining(pBackup), sqlite3_backup_pagecount(pBackup) );
-        //if( rc==SQLITE_OK || rc==SQLITE_BUSY || rc==SQLITE_LOCKED ){
-          //sqlite3_sleep(250);
-        //}
-      } while( rc==SQLITE_OK || rc==SQLITE_BUSY || rc==SQLITE_LOCKED );
-
-      /* Release resources allocated by backup_init(). */
-      sqlite3_backup_finish(pBackup);
-    }
-    rc = sqlite3_errcode(pFile);
-	// Close the database connection opened on database file zFilename
-	// and return the result of this function.
+	{
+		boost::lock_guard<boost::mutex> l(m_backup_status_mutex);
+		m_backup_status.bActive=true;
+		m_backup_status.File=OutputFile;
+		m_backup_status.PageCount=0;
+		m_backup_status.PagesRemaining=0;
+		m_backup_status.StartTime=mytime(NULL);
+	}
+
+	sqlite3_backup *pBackup;
+	{
+		CSQLQueryLock l(m_sqlQueryMutex);
+		pBackup = sqlite3_backup_init(pFile, "main", m_dbase, "main");
+	}
+	if (pBackup)
+	{
+		//The database is only held while a small batch of pages is copied, so sensor updates continue during the backup.
+		//Pages that change meanwhile (through our connection) are updated in the backup by sqlite
+		do {
+			{
+				CSQLQueryLock l(m_sqlQueryMutex);
+				rc = sqlite3_backup_step(pBackup, BACKUP_STEP_PAGES);
+			}
+			{
+				boost::lock_guard<boost::mutex> l(m_backup_status_mutex);
+				m_backup_status.PageCount=sqlite3_backup_pagecount(pBackup);
+				m_backup_status.PagesRemaining=sqlite3_backup_remaining(pBackup);
+			}
+			if (m_bAbortBackup)
+				break;
+			if (rc==SQLITE_BUSY || rc==SQLITE_LOCKED)
+				sleep_milliseconds(100);
+			else if ((rc==SQLITE_OK)&&(StepDelayMS>0))
+				sleep_milliseconds(StepDelayMS);
+		} while( rc==SQLITE_OK || rc==SQLITE_BUSY || rc==SQLITE_LOCKED );
+
+		CSQLQueryLock l(m_sqlQueryMutex);
+		sqlite3_backup_finish(pBackup);
+	}
+	rc = sqlite3_errcode(pFile);
 	sqlite3_close(pFile);
-	return ( rc==SQLITE_OK );
+
+	bool bResult=((rc==SQLITE_OK)&&(!m_bAbortBackup));
+	if (bResult)
+	{
+		//sqlite needs a database file to copy the pages into, so a compressed backup
+		//briefly needs the space of the uncompressed copy plus the compressed file
+		std::string ResultFile=TempFile;
+		if (bCompress)
+		{
+			//compressed into a temporary file too, a failed gzip does not touch the previous backup
+			ResultFile=OutputFile+".tmp.gz";
+			bResult=GZipFile(TempFile,ResultFile);
+		}
+		if (bResult)
+		{
+#ifdef WIN32
+			//rename does not replace an existing file on Windows
+			std::remove(OutputFile.c_str());
+#endif
+			bResult=(std::rename(ResultFile.c_str(),OutputFile.c_str())==0);
+		}
+		if (bCompress)
+			std::remove(ResultFile.c_str());
+	}
+	std::remove(TempFile.c_str());
+	if (m_bAbortBackup)
+		_log.Log(LOG_ERROR,"Backup aborted: %s", OutputFile.c_str());
+
+	boost::lock_guard<boost::mutex> l(m_backup_status_mutex);
+	m_backup_status.bActive=false;
+	m_backup_status.EndTime=mytime(NULL);
+	m_backup_status.bLastResult=bResult;
+	return bResult;
+}
+
+void CSQLHelper::GetBackupStatus(_tBackupStatus &status)
+{
+	boost::lock_guard<boost::mutex> l(m_backup_status_mutex);
+	status=m_backup_status;
+}
+
+void CSQLHelper::AbortBackup()
+{
+	boost::lock_guard<boost::mutex> l(m_backup_status_mutex);
+	if (m_backup_users>0)
+		m_bAbortBackup=true;
 }
 
 void CSQLHelper::Lighting2GroupCmd(const std::string &ID, const unsigned char subType, const unsigned char GroupCmd)
 {
 	char szTmp[100];
+	std::vector<std::vector<std::string> > result;
+	sprintf(szTmp,"SELECT ID FROM DeviceStatus WHERE (DeviceID=='%s') And (Type==%d) And (SubType==%d)",ID.c_str(),pTypeLighting2,subType);
+	result=query(szTmp);
+	std::vector<std::vector<std::string> >::const_iterator itt;
+	for (itt=result.begin(); itt!=result.end(); ++itt)
+		FlushWriteQueue(strtoull((*itt)[0].c_str(),NULL,10));
 	sprintf(szTmp,"UPDATE DeviceStatus SET nValue = %d WHERE (DeviceID=='%s') And (Type==%d) And (SubType==%d)",GroupCmd,ID.c_str(),pTypeLighting2,subType);
 	query(szTmp);
 }
@@ -6376,7 +6967,7 @@ void CSQLHelper::FixDaylightSaving()
 			}
 		}
 	}
-
+	SetLogDataChanged();
 }
 
 std::string CSQLHelper::DeleteUserVariable(const std::string &idx)
@@ -4,9 +4,17 @@
 #include <string>
 #include "RFXNames.h"
 #include "../httpclient/UrlEncode.h"
+#include "TimeSeriesStore.h"
 #include <map>
+#include <set>
+#include <deque>
+#include <boost/function.hpp>
+#include <boost/atomic.hpp>
+#include <boost/chrono.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
 
 struct sqlite3;
+struct sqlite3_stmt;
 
 struct _tNotification
 {
@@ -41,12 +49,13 @@ enum _eTaskItemType
 	TITEM_SWITCHCMD_SCENE,
 	TITEM_GETURL,
 	TITEM_SEND_EMAIL_TO,
+	TITEM_CLEANUP_LOG,
 };
 
 struct _tTaskItem
 {
 	_eTaskItemType _ItemType;
-	int _DelayTime;
+	float _DelayTime; //seconds
 	int _HardwareID;
 	unsigned long long _idx;
 	std::string _ID;
@@ -68,7 +77,7 @@ struct _tTaskItem
 
 	}
 
-	static _tTaskItem SwitchLight(const int DelayTime, const unsigned long long idx, const int HardwareID, const char* ID, const unsigned char unit, const unsigned char devType, const unsigned char subType, const int switchtype, const unsigned char signallevel, const unsigned char batterylevel, const int nValue, const char* sValue)
+	static _tTaskItem SwitchLight(const float DelayTime, const unsigned long long idx, const int HardwareID, const char* ID, const unsigned char unit, const unsigned char devType, const unsigned char subType, const int switchtype, const unsigned char signallevel, const unsigned char batterylevel, const int nValue, const char* sValue)
 	{
 		_tTaskItem tItem;
 		tItem._ItemType=TITEM_SWITCHCMD;
@@ -86,7 +95,7 @@ struct _tTaskItem
 		tItem._sValue=sValue;
 		return tItem;
 	}
-	static _tTaskItem ExecuteScript(const int DelayTime, const std::string &ScriptPath, const std::string &ScriptParams)
+	static _tTaskItem ExecuteScript(const float DelayTime, const std::string &ScriptPath, const std::string &ScriptParams)
 	{
 		_tTaskItem tItem;
 		tItem._ItemType=TITEM_EXECUTE_SCRIPT;
@@ -95,7 +104,7 @@ struct _tTaskItem
 		tItem._sValue=ScriptParams;
 		return tItem;
 	}
-	static _tTaskItem EmailCameraSnapshot(const int DelayTime, const std::string &CamIdx, const std::string &Subject)
+	static _tTaskItem EmailCameraSnapshot(const float DelayTime, const std::string &CamIdx, const std::string &Subject)
 	{
 		_tTaskItem tItem;
 		tItem._ItemType=TITEM_EMAIL_CAMERA_SNAPSHOT;
@@ -104,7 +113,7 @@ struct _tTaskItem
 		tItem._sValue=Subject;
 		return tItem;
 	}
-	static _tTaskItem SendEmail(const int DelayTime, const std::string &Subject, const std::string &Body)
+	static _tTaskItem SendEmail(const float DelayTime, const std::string &Subject, const std::string &Body)
 	{
 		_tTaskItem tItem;
 		tItem._ItemType=TITEM_SEND_EMAIL;
@@ -113,7 +122,7 @@ struct _tTaskItem
 		tItem._sValue=Body;
 		return tItem;
 	}
-	static _tTaskItem SendEmailTo(const int DelayTime, const std::string &Subject, const std::string &Body, const std::string &To)
+	static _tTaskItem SendEmailTo(const float DelayTime, const std::string &Subject, const std::string &Body, const std::string &To)
 	{
 		_tTaskItem tItem;
 		tItem._ItemType=TITEM_SEND_EMAIL_TO;
@@ -123,7 +132,7 @@ struct _tTaskItem
 		tItem._command=To;
 		return tItem;
 	}
-    static _tTaskItem SwitchLightEvent(const int DelayTime, const unsigned long long idx, const std::string &Command, const unsigned char Level, const int Hue, const std::string &eventName)
+    static _tTaskItem SwitchLightEvent(const float DelayTime, const unsigned long long idx, const std::string &Command, const unsigned char Level, const int Hue, const std::string &eventName)
 	{
 		_tTaskItem tItem;
 		tItem._ItemType=TITEM_SWITCHCMD_EVENT;
@@ -136,7 +145,7 @@ struct _tTaskItem
 
 		return tItem;
 	}
-    static _tTaskItem SwitchSceneEvent(const int DelayTime, const unsigned long long idx, const std::string &Command, const std::string &eventName)
+    static _tTaskItem SwitchSceneEvent(const float DelayTime, const unsigned long long idx, const std::string &Command, const std::string &eventName)
 	{
 		_tTaskItem tItem;
 		tItem._ItemType=TITEM_SWITCHCMD_SCENE;
@@ -147,7 +156,7 @@ struct _tTaskItem
         
 		return tItem;
 	}
-	static _tTaskItem GetHTTPPage(const int DelayTime, const std::string &URL, const std::string &eventName)
+	static _tTaskItem GetHTTPPage(const float DelayTime, const std::string &URL, const std::string &eventName)
 	{
 		_tTaskItem tItem;
 		tItem._ItemType=TITEM_GETURL;
@@ -157,8 +166,190 @@ struct _tTaskItem
 
 		return tItem;
 	}
+	static _tTaskItem CleanupLog(const float DelayTime, const std::string &Table, const std::string &DateCutoff)
+	{
+		_tTaskItem tItem;
+		tItem._ItemType=TITEM_CLEANUP_LOG;
+		tItem._DelayTime=DelayTime;
+		tItem._ID=Table;
+		tItem._sValue=DateCutoff;
+		return tItem;
+	}
+};
+
+//Off-delay tasks are unique per device and command
+struct _tTaskItemKey
+{
+	unsigned long long idx;
+	int HardwareID;
+	int nValue;
+
+	bool operator<(const _tTaskItemKey &other) const
+	{
+		if (idx!=other.idx)
+			return (idx<other.idx);
+		if (HardwareID!=other.HardwareID)
+			return (HardwareID<other.HardwareID);
+		return (nValue<other.nValue);
+	}
+};
+
+enum _eSQLParamType
+{
+	SQLPARAM_NULL=0,
+	SQLPARAM_INT,
+	SQLPARAM_FLOAT,
+	SQLPARAM_TEXT,
+};
+
+struct _tSQLParam
+{
+	_eSQLParamType _Type;
+	long long _iValue;
+	double _fValue;
+	std::string _sValue;
 };
 
+//Typed parameters for a query with '?' placeholders,
+//values are bound by sqlite so they never need escaping
+class CSQLParams
+{
+public:
+	CSQLParams& Add(const int value);
+	CSQLParams& Add(const long long value);
+	CSQLParams& Add(const unsigned long long value);
+	CSQLParams& Add(const double value);
+	CSQLParams& Add(const char* value);
+	CSQLParams& Add(const std::string &value);
+	CSQLParams& AddNull();
+
+	std::vector<_tSQLParam> m_params;
+};
+
+//Lookup key of a device in the DeviceStatus table
+struct _tDeviceStatusKey
+{
+	int HardwareID;
+	std::string DeviceID;
+	unsigned char Unit;
+	unsigned char Type;
+	unsigned char SubType;
+
+	bool operator<(const _tDeviceStatusKey &other) const
+	{
+		if (HardwareID!=other.HardwareID)
+			return (HardwareID<other.HardwareID);
+		if (Unit!=other.Unit)
+			return (Unit<other.Unit);
+		if (Type!=other.Type)
+			return (Type<other.Type);
+		if (SubType!=other.SubType)
+			return (SubType<other.SubType);
+		return (DeviceID<other.DeviceID);
+	}
+};
+
+//In-memory copy of the DeviceStatus fields needed to process a received value
+struct _tDeviceStatusInfo
+{
+	unsigned long long ID;
+	_tDeviceStatusKey Key;
+	std::string Name;
+	int SwitchType;
+	float AddjValue;
+	std::string StrParam1;
+	std::string StrParam2;
+	int LastLevel;
+	int nValue;			//current values, also when the update is still in the write queue
+	std::string sValue;
+	bool bStale;
+};
+
+struct _tPreferencesVar
+{
+	int nValue;
+	std::string sValue;
+};
+
+enum _eDBWriteMode
+{
+	DBWRITE_IMMEDIATE=0,	//every sensor update is its own transaction
+	DBWRITE_BATCHED,		//sensor updates are queued and committed by the writer thread
+};
+
+struct _tSQLWriteItem
+{
+	std::string szQuery;
+	CSQLParams Params;
+	unsigned long long DeviceRowID;	//0 if this item is not for one device
+	bool bCoalesce;					//a newer item with the same query replaces it (values), or not (log rows)
+	boost::posix_time::ptime QueueTime;
+};
+
+struct _tSQLWriteStats
+{
+	int QueueSize;
+	int MaxQueueSize;
+	unsigned long long TotalItems;
+	unsigned long long TotalCoalesced;
+	unsigned long long TotalBatches;
+	unsigned long long TotalFullWaits;	//callers that waited for the writer because the queue was full
+	unsigned long long TotalInline;	//written by a caller that holds the query mutex because the queue was full
+	long AvgLatency;	//ms from queueing to commit
+	long MaxLatency;
+};
+
+struct _tAggregationStats
+{
+	time_t LastRun;
+	bool bLastResult;	//false when the transaction of a job was rolled back
+	long TotalTime;		//ms
+	std::vector<std::pair<std::string, long> > JobTimes;
+};
+
+//Log table retention, summed over the passes of the last cleanup of a table
+struct _tCleanupStats
+{
+	time_t LastRun;		//queued
+	bool bDone;			//false while passes are still to come
+	int Passes;
+	int Rows;			//pruned
+	long TotalTime;		//ms
+};
+
+struct _tBackupStatus
+{
+	bool bActive;
+	std::string File;
+	int PageCount;
+	int PagesRemaining;
+	time_t StartTime;
+	time_t EndTime;		//of the last finished backup
+	bool bLastResult;
+};
+
+//Number of device/scene changes kept for incremental device list requests
+#define CHANGE_JOURNAL_SIZE 1024
+
+enum _eChangeJournalType
+{
+	CJTYPE_DEVICE=0,
+	CJTYPE_SCENE,
+	CJTYPE_USERVARIABLE,
+	CJTYPE_RESYNC,		//hardware/sharing/plan change, clients need a full list
+};
+
+struct _tChangeJournalItem
+{
+	unsigned long long seq;
+	_eChangeJournalType type;
+	int op;
+	unsigned long long rowid;
+};
+
+//Called after a preferences variable has been changed (Key, nValue, sValue)
+typedef boost::function<void(const std::string &, const int, const std::string &)> PreferencesVarCallback;
+
 class CSQLHelper
 {
 public:
@@ -168,7 +359,12 @@ public:
 	bool OpenDatabase();
 	void SetDatabaseName(const std::string &DBName);
 
-	bool BackupDatabase(const std::string &OutputFile);
+	//Copies the database in small page batches, other threads can use the database in between.
+	//With bCompress the output is written gzip compressed, StepDelayMS<0 uses the BackupStepDelay preference
+	bool BackupDatabase(const std::string &OutputFile, const bool bCompress=false, int StepDelayMS=-1);
+	void GetBackupStatus(_tBackupStatus &status);
+	//Aborts the running backup and the ones waiting to start
+	void AbortBackup();
 
 	bool RestoreDatabase(const std::string &dbase);
 
@@ -200,6 +396,7 @@ public:
 	bool GetPreferencesVar(const char *Key, int &nValue, std::string &sValue);
 	bool GetPreferencesVar(const char *Key, int &nValue);
 	bool GetPreferencesVar(const char *Key, std::string &sValue);
+	void SubscribePreferencesVar(const std::string &Key, const PreferencesVarCallback &callback);
 	int GetLastBackupNo(const char *Key, int &nValue);
 	void SetLastBackupNo(const char *Key, const int nValue);
 
@@ -323,15 +520,46 @@ public:
 	bool HandleOnOffAction(const bool bIsOn, const std::string &OnAction, const std::string &OffAction);
 
 	std::vector<std::vector<std::string> > query(const std::string &szQuery);
+	//Prepared statements are cached on the query text, so keep the text constant and pass values as parameters
+	std::vector<std::vector<std::string> > query(const std::string &szQuery, const CSQLParams &params);
+	//Commits queued sensor updates, call this before reading values that have to be up to date
+	void FlushWriteQueue();
+	//Commits the queued updates of one device only, call this before writing that device directly
+	//so the (older) queued values can not overwrite it later
+	void FlushWriteQueue(const unsigned long long DeviceRowID);
+	//Current nValue/sValue of a device from the device registry, includes updates that are not committed yet
+	bool GetDeviceValue(const int HardwareID, const std::string &DeviceID, const unsigned char unit, const unsigned char devType, const unsigned char subType, int &nValue, std::string &sValue);
+	void GetWriteQueueStats(_tSQLWriteStats &stats);
+	//Timing of the last 5 minute and calendar aggregation run
+	void GetAggregationStats(std::map<std::string, _tAggregationStats> &stats);
+	//Rows pruned and time spent by the last cleanup of each log table
+	void GetCleanupStats(std::map<std::string, _tCleanupStats> &stats);
+	//Changes every time the log/calendar tables (graph data) are aggregated or modified
+	unsigned long GetLogDataVersion();
+	void SetLogDataChanged();
+	//Rows of a 5 minute log table in Date order (szColumns as in a SELECT), read from the time series store when it is enabled.
+	//Empty dates mean no limit, szDateEnd includes the whole day when no time is given
+	std::vector<std::vector<std::string> > GetShortLog(const std::string &Table, const unsigned long long DeviceRowID, const std::string &szColumns, const std::string &szDateStart="", const std::string &szDateEnd="");
+	//Copies the 5 minute log tables into a new time series store and enables it (-tsdbmigrate)
+	bool MigrateTimeSeriesStore();
+	//Compares size and scan time of the 5 minute log tables with the time series store (-tsdbbenchmark)
+	void BenchmarkTimeSeriesStore();
+	unsigned long long GetChangeSequence();
+	//Returns false when the journal does not cover 'since' and the client needs a full list
+	bool GetChangesSince(const unsigned long long since, unsigned long long &actseq, std::set<unsigned long long> &devices, std::set<unsigned long long> &scenes, std::set<unsigned long long> *pUserVariables=NULL);
+	//Waits until the change sequence is past 'since', returns false on timeout
+	bool WaitForChanges(const unsigned long long since, const int timeoutms);
 	std::string DeleteUserVariable(const std::string &idx);
 	std::string SaveUserVariable(const std::string &varname, const std::string &vartype, const std::string &varvalue);
 	std::string UpdateUserVariable(const std::string &idx, const std::string &varname, const std::string &vartype, const std::string &varvalue, const bool eventtrigger);
 	std::vector<std::vector<std::string> > GetUserVariables();
 
 	void AllowNewHardwareTimer(const int iTotMinutes);
+
+	//Last received switch, for the learning command (hardware is decoded in parallel)
+	void ClearLastSwitch();
+	bool GetLastSwitch(std::string &ID, unsigned long long &RowID);
 public:
-	std::string m_LastSwitchID;	//for learning command
-	unsigned long long m_LastSwitchRowID;
 	_eWindUnit	m_windunit;
 	std::string	m_windsign;
 	float		m_windscale;
@@ -343,7 +571,64 @@ public:
 	int			m_ActiveTimerPlan;
 	bool		m_bDisableEventSystem;
 private:
-	boost::mutex	m_sqlQueryMutex;
+	//recursive, RunAggregationJobs holds it for the transaction of each job
+	boost::recursive_mutex	m_sqlQueryMutex;
+	std::map<std::string,sqlite3_stmt*> m_statement_cache;
+	bool			m_bDeviceValueUpdate;
+
+	//Device registry, kept in sync with the DeviceStatus table by the sqlite update hook
+	boost::mutex	m_device_registry_mutex;
+	std::map<_tDeviceStatusKey,unsigned long long> m_device_ids;
+	std::map<unsigned long long,_tDeviceStatusInfo> m_device_registry;
+	unsigned long	m_device_registry_generation;
+
+	boost::mutex	m_last_switch_mutex;
+	std::string		m_LastSwitchID;
+	unsigned long long m_LastSwitchRowID;
+
+	boost::mutex	m_logdata_mutex;
+	unsigned long	m_logdata_version;
+
+	boost::mutex	m_backup_mutex;		//one backup/restore at a time
+	boost::mutex	m_backup_status_mutex;
+	_tBackupStatus	m_backup_status;
+	volatile bool	m_bAbortBackup;	//reset when the last running/waiting backup is done
+	int				m_backup_users;	//backups running or waiting for m_backup_mutex
+	bool DoBackupDatabase(const std::string &OutputFile, const bool bCompress, int StepDelayMS);
+
+	//Compact store for the 5 minute log tables, filled from the tables after each 5 minute run
+	CTimeSeriesStore m_tsdb;
+	//read by the web threads
+	boost::atomic<bool>	m_bTSDBEnabled;	//new rows are copied into the store
+	boost::atomic<bool>	m_bTSDBReady;	//store is up to date and used for reading
+
+	//Change journal (ring buffer) of DeviceStatus/Scenes updates, filled by the sqlite update hook
+	boost::mutex	m_change_journal_mutex;
+	boost::condition_variable m_change_journal_cond;
+	std::vector<_tChangeJournalItem> m_change_journal;
+	unsigned long long m_change_journal_base;
+	unsigned long long m_change_journal_seq;
+
+	//Preferences cache, loaded at startup and kept in sync by UpdatePreferencesVar
+	boost::mutex	m_preferences_mutex;
+	std::map<std::string,_tPreferencesVar> m_preferences;
+	std::map<std::string,std::vector<PreferencesVarCallback> > m_preferences_callbacks;
+	//Serializes the Preferences table writes, taken before m_sqlQueryMutex
+	boost::mutex	m_preferences_write_mutex;
+
+	//Write-behind queue for DeviceStatus value updates and log inserts
+	boost::mutex	m_write_queue_mutex;
+	boost::condition_variable m_write_queue_cond;
+	boost::condition_variable m_write_queue_space_cond;	//signalled when the queue drops below the low-water mark
+	std::vector<_tSQLWriteItem> m_write_queue;
+	std::map<std::pair<unsigned long long,std::string>,size_t> m_write_queue_index;
+	_eDBWriteMode	m_write_mode;
+	int				m_write_interval;
+	_tSQLWriteStats	m_write_stats;
+	unsigned long long m_write_latency_total;
+	time_t			m_write_full_logged;
+	boost::shared_ptr<boost::thread> m_write_thread;
+
 	CURLEncode		m_urlencoder;
 	sqlite3			*m_dbase;
 	std::string		m_dbase_name;
@@ -352,16 +637,49 @@ private:
 	bool			m_bAcceptHardwareTimerActive;
 	int				m_iAcceptHardwareTimerCounter;
 
-	std::vector<_tTaskItem> m_background_task_queue;
+	//Delayed tasks ordered by due time, off-delay tasks are also indexed by device/command.
+	//Due times are on the steady clock, a wall clock step (NTP on a system without RTC) does not move them
+	typedef std::multimap<boost::chrono::steady_clock::time_point,_tTaskItem> TaskQueue;
+	TaskQueue m_background_task_queue;
+	std::map<_tTaskItemKey,TaskQueue::iterator> m_background_task_index;
 	boost::shared_ptr<boost::thread> m_background_task_thread;
 	boost::mutex m_background_task_mutex;
+	boost::condition_variable m_background_task_cond;
+	//Due tasks are executed by workers, device commands in order on one thread,
+	//slow tasks (scripts, email, camera snapshots) on a small pool
+	boost::mutex m_task_worker_mutex;
+	boost::condition_variable m_task_worker_cond;
+	std::deque<_tTaskItem> m_device_tasks;
+	std::deque<_tTaskItem> m_slow_tasks;
+	std::vector<boost::shared_ptr<boost::thread> > m_task_workers;
 	bool m_stoprequested;
+	bool m_bIncrementalVacuum;
 	bool StartThread();
 	void Do_Work();
+	void Do_TaskWorker(std::deque<_tTaskItem> *pQueue);
+	void ExecuteTaskItem(const _tTaskItem &tItem);
+	void Do_Write_Work();
 
 	bool SwitchLightFromTasker(const std::string &idx, const std::string &switchcmd, const std::string &level, const std::string &hue);
 	bool SwitchLightFromTasker(unsigned long long idx, const std::string &switchcmd, int level, int hue);
 
+	sqlite3_stmt *GetCachedStatement(const std::string &szQuery);
+	void ClearStatementCache();
+	void ExecuteCachedQuery(const std::string &szQuery, const CSQLParams &params, std::vector<std::vector<std::string> > &results);
+	void QueueWrite(const std::string &szQuery, const CSQLParams &params, const unsigned long long DeviceRowID, const bool bCoalesce=true);
+	void ApplyWriteQueue(const unsigned long long DeviceRowID=0);
+
+	void CreateIndexes();
+	void CheckQueryPlans();
+
+	void LoadPreferences();
+	void OnPreferencesVarChanged(const std::string &Key, const int nValue, const std::string &sValue);
+	void LoadDeviceRegistry();
+	bool LookupDevice(const _tDeviceStatusKey &key, _tDeviceStatusInfo &info);
+	void AddDeviceToRegistry(const _tDeviceStatusInfo &info, const unsigned long generation);
+	void RemoveDeviceFromRegistry(const _tDeviceStatusKey &key);
+	static void DeviceStatusHook(void *pArg, int op, char const *dbname, char const *table, long long rowid);
+
 	void FixDaylightSavingTableSimple(const std::string &TableName);
 	void FixDaylightSaving();
 
@@ -373,6 +691,15 @@ private:
 
 	void CleanupLightLog();
 
+	struct _tAggregationJob
+	{
+		const char *szName;
+		void (CSQLHelper::*pJob)();
+	};
+	void RunAggregationJobs(const char *szSchedule, const _tAggregationJob *pJobs, const size_t nJobs);
+	boost::mutex m_aggregation_stats_mutex;
+	std::map<std::string, _tAggregationStats> m_aggregation_stats;
+
 	void UpdateTemperatureLog();
 	void UpdateRainLog();
 	void UpdateWindLog();
@@ -390,6 +717,16 @@ private:
 	void AddCalendarUpdatePercentage();
 	void AddCalendarUpdateFan();
 	void CleanupShortLog();
+	void QueueCleanupLog(const std::string &szTable, const std::string &szDateCutoff);
+	void CleanupLog(const std::string &szTable, const std::string &szDateCutoff);
+	//Tables with a cleanup task queued or running
+	boost::mutex m_cleanup_mutex;
+	std::set<std::string> m_cleanup_pending;
+	std::map<std::string, _tCleanupStats> m_cleanup_stats;
+	std::string GetTimeSeriesStorePath();
+	bool HasStoreOnlyHistory();
+	bool OpenTimeSeriesStore();
+	void SyncTimeSeriesStore();
 	std::string CheckUserVariable(const int vartype, const std::string &varvalue);
 	std::string CheckUserVariableName(const std::string &varname);
 	bool CheckDate(const std::string &sDate, int &d, int &m, int &y);
@@ -0,0 +1,1050 @@
+#include "stdafx.h"
+#include "TimeSeriesStore.h"
+#include "Logger.h"
+#include "Helper.h"
+#include <algorithm>
+#include <sstream>
+#include <fstream>
+#include <string.h>
+#include <limits.h>
+
+#ifndef WIN32
+	#include <dirent.h>
+#else
+	#include "dirent_windows.h"
+#endif
+
+#define TSDB_BLOCK_HEADER_SIZE 28
+#define TSDB_HEAD_HEADER_SIZE 8
+//When DST ends the Date column repeats an hour, these points may be older than the sealed part
+#define TSDB_DST_WINDOW 3600
+
+//Bits are written from the most significant bit of each byte
+class CTSBitWriter
+{
+public:
+	CTSBitWriter(std::vector<unsigned char> &buffer) : m_buffer(buffer), m_used(0) {}
+	void Write(const unsigned long long value, int nbits)
+	{
+		while (nbits>0)
+		{
+			if (m_used==0)
+				m_buffer.push_back(0);
+			int nfree=8-m_used;
+			int ntake=(nbits<nfree)?nbits:nfree;
+			unsigned char bits=(unsigned char)((value>>(nbits-ntake))&((1<<ntake)-1));
+			m_buffer.back()|=(unsigned char)(bits<<(nfree-ntake));
+			m_used=(m_used+ntake)&7;
+			nbits-=ntake;
+		}
+	}
+private:
+	std::vector<unsigned char> &m_buffer;
+	int m_used;	//bits used in the last byte
+};
+
+class CTSBitReader
+{
+public:
+	CTSBitReader(const unsigned char *pData, const size_t nSize) : m_pData(pData), m_nBits(nSize*8), m_pos(0), m_bError(false) {}
+	unsigned long long Read(int nbits)
+	{
+		unsigned long long value=0;
+		while (nbits>0)
+		{
+			if (m_pos>=m_nBits)
+			{
+				m_bError=true;
+				return 0;
+			}
+			int used=(int)(m_pos&7);
+			int avail=8-used;
+			int ntake=(nbits<avail)?nbits:avail;
+			unsigned char bits=(unsigned char)((m_pData[m_pos>>3]>>(avail-ntake))&((1<<ntake)-1));
+			value=(value<<ntake)|bits;
+			m_pos+=ntake;
+			nbits-=ntake;
+		}
+		return value;
+	}
+	bool HasError() { return m_bError; }
+private:
+	const unsigned char *m_pData;
+	size_t m_nBits;
+	size_t m_pos;
+	bool m_bError;
+};
+
+static void PutUInt(std::vector<unsigned char> &buffer, const unsigned long long value, const int nbytes)
+{
+	for (int ii=0; ii<nbytes; ii++)
+		buffer.push_back((unsigned char)((value>>(ii*8))&0xFF));
+}
+
+static unsigned long long GetUInt(const unsigned char *pData, const int nbytes)
+{
+	unsigned long long value=0;
+	for (int ii=nbytes-1; ii>=0; ii--)
+		value=(value<<8)|pData[ii];
+	return value;
+}
+
+static unsigned long long DoubleToBits(const double value)
+{
+	unsigned long long bits;
+	memcpy(&bits,&value,sizeof(bits));
+	return bits;
+}
+
+static double BitsToDouble(const unsigned long long bits)
+{
+	double value;
+	memcpy(&value,&bits,sizeof(value));
+	return value;
+}
+
+static int CountLeadingZeros(const unsigned long long value)
+{
+	int n=0;
+	for (unsigned long long mask=1ULL<<63; (mask!=0)&&((value&mask)==0); mask>>=1)
+		n++;
+	return n;
+}
+
+static int CountTrailingZeros(const unsigned long long value)
+{
+	int n=0;
+	for (unsigned long long mask=1; (mask!=0)&&((value&mask)==0); mask<<=1)
+		n++;
+	return n;
+}
+
+static long long DaysFromCivil(int y, const int m, const int d)
+{
+	y-=(m<=2)?1:0;
+	const long long era=((y>=0)?y:y-399)/400;
+	const int yoe=(int)(y-era*400);
+	const int doy=(153*(m+((m>2)?-3:9))+2)/5+d-1;
+	const int doe=yoe*365+yoe/4-yoe/100+doy;
+	return era*146097+doe-719468;
+}
+
+static void CivilFromDays(long long z, int &y, int &m, int &d)
+{
+	z+=719468;
+	const long long era=((z>=0)?z:z-146096)/146097;
+	const int doe=(int)(z-era*146097);
+	const int yoe=(doe-doe/1460+doe/36524-doe/146096)/365;
+	const int doy=doe-(365*yoe+yoe/4-yoe/100);
+	const int mp=(5*doy+2)/153;
+	d=doy-(153*mp+2)/5+1;
+	m=(mp<10)?mp+3:mp-9;
+	y=(int)(yoe+era*400)+((m<=2)?1:0);
+}
+
+CTimeSeriesStore::CTimeSeriesStore(void)
+{
+	m_bIsOpen=false;
+}
+
+CTimeSeriesStore::~CTimeSeriesStore(void)
+{
+	Close();
+}
+
+//The Date columns hold the local time as text, the store keeps the same wall clock time
+//(as if it was UTC) so the text can be reproduced exactly, also around daylight saving changes
+long long CTimeSeriesStore::LocalTimeFromString(const std::string &szDate)
+{
+	int year=0,month=0,day=0,hour=0,minute=0,second=0;
+	if (sscanf(szDate.c_str(),"%d-%d-%d %d:%d:%d",&year,&month,&day,&hour,&minute,&second)<3)
+		return -1;
+	return DaysFromCivil(year,month,day)*86400+hour*3600+minute*60+second;
+}
+
+std::string CTimeSeriesStore::LocalTimeToString(const long long ltime)
+{
+	long long days=ltime/86400;
+	long long secs=ltime%86400;
+	if (secs<0)
+	{
+		secs+=86400;
+		days--;
+	}
+	int year,month,day;
+	CivilFromDays(days,year,month,day);
+	char szTmp[40];
+	sprintf(szTmp,"%04d-%02d-%02d %02d:%02d:%02d",year,month,day,(int)(secs/3600),(int)((secs/60)%60),(int)(secs%60));
+	return szTmp;
+}
+
+bool CTimeSeriesStore::Open(const std::string &Path)
+{
+	boost::lock_guard<boost::mutex> l(m_mutex);
+	if (m_bIsOpen)
+		return true;
+	m_path=Path;
+	if ((m_path.empty())||((m_path[m_path.size()-1]!='/')&&(m_path[m_path.size()-1]!='\\')))
+		m_path+="/";
+	mkdir_deep(m_path.c_str(),0755);
+
+	DIR *lDir=opendir(m_path.c_str());
+	if (lDir==NULL)
+	{
+		_log.Log(LOG_ERROR,"TSDB: Could not open %s",m_path.c_str());
+		return false;
+	}
+	//Register the series, the files are read when a series is used
+	struct dirent *ent;
+	while ((ent=readdir(lDir))!=NULL)
+	{
+		std::string filename=ent->d_name;
+		size_t pext=filename.rfind('.');
+		size_t pid=filename.rfind('_');
+		if ((pext==std::string::npos)||(pid==std::string::npos)||(pid>pext))
+			continue;
+		std::string ext=filename.substr(pext);
+		if ((ext!=".seg")&&(ext!=".head"))
+			continue;
+		std::string szID=filename.substr(pid+1,pext-pid-1);
+		if ((szID.empty())||(!isInt(szID)))
+			continue;
+		unsigned long long DeviceRowID;
+		std::stringstream s_str(szID);
+		s_str >> DeviceRowID;
+		m_series[SeriesKey(filename.substr(0,pid),DeviceRowID)];
+	}
+	closedir(lDir);
+
+	m_syncpoints.clear();
+	std::ifstream infile((m_path+"syncpoints.txt").c_str());
+	std::string szLine;
+	while (std::getline(infile,szLine))
+	{
+		//"table rowid time", older versions wrote no time
+		std::stringstream s_str(szLine);
+		std::string szTable;
+		_tTSSyncPoint syncpoint;
+		syncpoint.Time=0;
+		if (!(s_str >> szTable >> syncpoint.RowID))
+			continue;
+		s_str >> syncpoint.Time;
+		m_syncpoints[szTable]=syncpoint;
+	}
+
+	m_bIsOpen=true;
+	return true;
+}
+
+void CTimeSeriesStore::Close()
+{
+	boost::lock_guard<boost::mutex> l(m_mutex);
+	m_series.clear();
+	m_syncpoints.clear();
+	m_bIsOpen=false;
+}
+
+bool CTimeSeriesStore::IsOpen()
+{
+	boost::lock_guard<boost::mutex> l(m_mutex);
+	return m_bIsOpen;
+}
+
+std::string CTimeSeriesStore::GetFileName(const SeriesKey &key, const char *szExtension)
+{
+	std::stringstream sstr;
+	sstr << m_path << key.first << "_" << key.second << szExtension;
+	return sstr.str();
+}
+
+CTimeSeriesStore::_tSeries &CTimeSeriesStore::GetSeries(const SeriesKey &key)
+{
+	_tSeries &series=m_series[key];
+	if (!series.bLoaded)
+		LoadSeries(key,series);
+	return series;
+}
+
+//Reads the block headers of the segment and the points of the head file.
+//A block or point that was only partly written (power loss) is dropped.
+void CTimeSeriesStore::LoadSeries(const SeriesKey &key, _tSeries &series)
+{
+	series.bLoaded=true;
+	series.nColumns=0;
+	series.SegmentSize=0;
+	series.Blocks.clear();
+	series.Head.clear();
+
+	std::string szSegment=GetFileName(key,".seg");
+	FILE *fIn=fopen(szSegment.c_str(),"rb");
+	if (fIn!=NULL)
+	{
+		fseek(fIn,0,SEEK_END);
+		long long filesize=ftell(fIn);
+		long long offset=0;
+		unsigned char header[TSDB_BLOCK_HEADER_SIZE];
+		while (offset+TSDB_BLOCK_HEADER_SIZE<=filesize)
+		{
+			fseek(fIn,(long)offset,SEEK_SET);
+			if (fread(header,1,TSDB_BLOCK_HEADER_SIZE,fIn)!=TSDB_BLOCK_HEADER_SIZE)
+				break;
+			if (memcmp(header,"TSB1",4)!=0)
+				break;
+			_tBlockInfo block;
+			block.Offset=offset;
+			block.nPoints=(int)GetUInt(header+4,2);
+			int nColumns=header[6];
+			block.TimeFirst=(long long)GetUInt(header+8,8);
+			block.TimeLast=(long long)GetUInt(header+16,8);
+			block.PayloadSize=(int)GetUInt(header+24,4);
+			if ((nColumns<1)||(nColumns>TSDB_MAX_COLUMNS)||((series.nColumns!=0)&&(nColumns!=series.nColumns)))
+				break;
+			if (offset+TSDB_BLOCK_HEADER_SIZE+block.PayloadSize>filesize)
+				break;
+			series.nColumns=nColumns;
+			series.Blocks.push_back(block);
+			offset+=TSDB_BLOCK_HEADER_SIZE+block.PayloadSize;
+		}
+		series.SegmentSize=offset;
+		if (offset<filesize)
+		{
+			_log.Log(LOG_ERROR,"TSDB: %s is damaged, %lld bytes dropped",szSegment.c_str(),filesize-offset);
+			std::vector<unsigned char> buffer((size_t)offset);
+			fseek(fIn,0,SEEK_SET);
+			size_t nRead=(offset>0)?fread(&buffer[0],1,buffer.size(),fIn):0;
+			fclose(fIn);
+			fIn=NULL;
+			if (nRead==buffer.size())
+			{
+				FILE *fOut=fopen(szSegment.c_str(),"wb");
+				if (fOut!=NULL)
+				{
+					if (!buffer.empty())
+						fwrite(&buffer[0],1,buffer.size(),fOut);
+					fclose(fOut);
+				}
+			}
+		}
+		if (fIn!=NULL)
+			fclose(fIn);
+	}
+
+	fIn=fopen(GetFileName(key,".head").c_str(),"rb");
+	if (fIn==NULL)
+		return;
+	unsigned char header[TSDB_HEAD_HEADER_SIZE];
+	bool bDamaged=false;
+	if (
+		(fread(header,1,TSDB_HEAD_HEADER_SIZE,fIn)==TSDB_HEAD_HEADER_SIZE)&&
+		(memcmp(header,"TSH1",4)==0)&&
+		(header[4]>=1)&&(header[4]<=TSDB_MAX_COLUMNS)&&
+		((series.nColumns==0)||(series.nColumns==header[4]))
+		)
+	{
+		series.nColumns=header[4];
+		const size_t recsize=8+8*series.nColumns;
+		unsigned char record[8+8*TSDB_MAX_COLUMNS];
+		size_t nRead;
+		while ((nRead=fread(record,1,recsize,fIn))==recsize)
+		{
+			_tTSPoint point;
+			memset(&point,0,sizeof(point));
+			point.Time=(long long)GetUInt(record,8);
+			for (int ii=0; ii<series.nColumns; ii++)
+				point.Values[ii]=BitsToDouble(GetUInt(record+8+ii*8,8));
+			series.Head.push_back(point);
+		}
+		bDamaged=(nRead!=0);
+	}
+	else
+		bDamaged=true;
+	fclose(fIn);
+	if (bDamaged)
+	{
+		_log.Log(LOG_ERROR,"TSDB: head of %s/%llu is damaged, kept %d points",key.first.c_str(),key.second,(int)series.Head.size());
+		WriteHead(key,series);
+	}
+}
+
+void CTimeSeriesStore::WriteHead(const SeriesKey &key, const _tSeries &series)
+{
+	std::string szHead=GetFileName(key,".head");
+	if (series.Head.empty())
+	{
+		remove(szHead.c_str());
+		return;
+	}
+	std::vector<unsigned char> buffer;
+	buffer.push_back('T');
+	buffer.push_back('S');
+	buffer.push_back('H');
+	buffer.push_back('1');
+	PutUInt(buffer,series.nColumns,4);
+	std::vector<_tTSPoint>::const_iterator itt;
+	for (itt=series.Head.begin(); itt!=series.Head.end(); ++itt)
+	{
+		PutUInt(buffer,(unsigned long long)itt->Time,8);
+		for (int ii=0; ii<series.nColumns; ii++)
+			PutUInt(buffer,DoubleToBits(itt->Values[ii]),8);
+	}
+	FILE *fOut=fopen(szHead.c_str(),"wb");
+	if (fOut==NULL)
+	{
+		_log.Log(LOG_ERROR,"TSDB: Could not write %s",szHead.c_str());
+		return;
+	}
+	fwrite(&buffer[0],1,buffer.size(),fOut);
+	fclose(fOut);
+}
+
+void CTimeSeriesStore::AppendHead(const SeriesKey &key, const _tSeries &series, const _tTSPoint &point)
+{
+	if (series.Head.size()==1)
+	{
+		//new head file
+		WriteHead(key,series);
+		return;
+	}
+	std::vector<unsigned char> buffer;
+	PutUInt(buffer,(unsigned long long)point.Time,8);
+	for (int ii=0; ii<series.nColumns; ii++)
+		PutUInt(buffer,DoubleToBits(point.Values[ii]),8);
+	FILE *fOut=fopen(GetFileName(key,".head").c_str(),"ab");
+	if (fOut==NULL)
+		return;
+	fwrite(&buffer[0],1,buffer.size(),fOut);
+	fclose(fOut);
+}
+
+void CTimeSeriesStore::SealHead(const SeriesKey &key, _tSeries &series)
+{
+	std::vector<unsigned char> buffer;
+	EncodeBlock(series.Head,0,series.Head.size(),series.nColumns,buffer);
+	std::string szSegment=GetFileName(key,".seg");
+	FILE *fOut=fopen(szSegment.c_str(),"ab");
+	if (fOut==NULL)
+	{
+		_log.Log(LOG_ERROR,"TSDB: Could not write %s",szSegment.c_str());
+		return;
+	}
+	bool bOK=(fwrite(&buffer[0],1,buffer.size(),fOut)==buffer.size());
+	fclose(fOut);
+	if (!bOK)
+	{
+		//keep the points in the head, the partial block is dropped when the series is loaded again
+		_log.Log(LOG_ERROR,"TSDB: Could not write %s",szSegment.c_str());
+		series.bLoaded=false;
+		return;
+	}
+
+	_tBlockInfo block;
+	block.Offset=series.SegmentSize;
+	block.nPoints=(int)series.Head.size();
+	block.TimeFirst=series.Head.front().Time;
+	block.TimeLast=series.Head.back().Time;
+	block.PayloadSize=(int)buffer.size()-TSDB_BLOCK_HEADER_SIZE;
+	series.Blocks.push_back(block);
+	series.SegmentSize+=buffer.size();
+	series.Head.clear();
+	WriteHead(key,series);
+}
+
+bool CTimeSeriesStore::Append(const std::string &Table, const unsigned long long DeviceRowID, const int nColumns, const _tTSPoint &point)
+{
+	if ((nColumns<1)||(nColumns>TSDB_MAX_COLUMNS))
+		return false;
+	boost::lock_guard<boost::mutex> l(m_mutex);
+	if (!m_bIsOpen)
+		return false;
+	SeriesKey key(Table,DeviceRowID);
+	_tSeries &series=GetSeries(key);
+	if ((series.Blocks.empty())&&(series.Head.empty()))
+		series.nColumns=nColumns;
+	else if (series.nColumns!=nColumns)
+		return false;
+	if ((!series.Blocks.empty())&&(point.Time<=series.Blocks.back().TimeLast))
+	{
+		//only the repeated hour when DST ends goes into the head behind the sealed part
+		if (point.Time<=series.Blocks.back().TimeLast-TSDB_DST_WINDOW)
+			return false;
+		if (IsInLastBlock(key,series,point))
+			return false;
+	}
+
+	if ((series.Head.empty())||(point.Time>series.Head.back().Time))
+	{
+		series.Head.push_back(point);
+		AppendHead(key,series,point);
+	}
+	else
+	{
+		//late point (for example the midnight counter value) or the repeated hour when DST ends,
+		//keep the head in time order
+		std::vector<_tTSPoint>::iterator itt;
+		for (itt=series.Head.begin(); itt!=series.Head.end(); ++itt)
+		{
+			if ((itt->Time==point.Time)&&(IsSamePoint(*itt,point,series.nColumns)))
+				return false;
+			if (itt->Time>point.Time)
+				break;
+		}
+		series.Head.insert(itt,point);
+		WriteHead(key,series);
+	}
+	if (series.Head.size()>=TSDB_BLOCK_POINTS)
+		SealHead(key,series);
+	return true;
+}
+
+bool CTimeSeriesStore::IsSamePoint(const _tTSPoint &point1, const _tTSPoint &point2, const int nColumns)
+{
+	if (point1.Time!=point2.Time)
+		return false;
+	for (int ii=0; ii<nColumns; ii++)
+	{
+		if (point1.Values[ii]!=point2.Values[ii])
+			return false;
+	}
+	return true;
+}
+
+bool CTimeSeriesStore::IsInLastBlock(const SeriesKey &key, const _tSeries &series, const _tTSPoint &point)
+{
+	FILE *fIn=fopen(GetFileName(key,".seg").c_str(),"rb");
+	if (fIn==NULL)
+		return false;
+	std::vector<_tTSPoint> bpoints;
+	bool bRead=ReadBlock(fIn,series,series.Blocks.back(),bpoints);
+	fclose(fIn);
+	if (!bRead)
+		return false;
+	std::vector<_tTSPoint>::const_iterator itt;
+	for (itt=bpoints.begin(); itt!=bpoints.end(); ++itt)
+	{
+		if (IsSamePoint(*itt,point,series.nColumns))
+			return true;
+	}
+	return false;
+}
+
+static bool TSPointTimeLess(const _tTSPoint &point1, const _tTSPoint &point2)
+{
+	return (point1.Time<point2.Time);
+}
+
+static bool TSPointTimeGreater(const _tTSPoint &point1, const _tTSPoint &point2)
+{
+	return (point1.Time>point2.Time);
+}
+
+bool CTimeSeriesStore::ReadBlock(FILE *fIn, const _tSeries &series, const _tBlockInfo &block, std::vector<_tTSPoint> &points)
+{
+	std::vector<unsigned char> buffer(block.PayloadSize);
+	fseek(fIn,(long)(block.Offset+TSDB_BLOCK_HEADER_SIZE),SEEK_SET);
+	if ((block.PayloadSize>0)&&(fread(&buffer[0],1,buffer.size(),fIn)!=buffer.size()))
+		return false;
+	return DecodeBlock((buffer.empty())?NULL:&buffer[0],buffer.size(),block.nPoints,series.nColumns,block.TimeFirst,points);
+}
+
+void CTimeSeriesStore::ReadSeries(const SeriesKey &key, _tSeries &series, const long long TimeStart, const long long TimeEnd, std::vector<_tTSPoint> &points)
+{
+	FILE *fIn=NULL;
+	std::vector<_tBlockInfo>::const_iterator itt;
+	for (itt=series.Blocks.begin(); itt!=series.Blocks.end(); ++itt)
+	{
+		if ((itt->TimeLast<TimeStart)||(itt->TimeFirst>TimeEnd))
+			continue;
+		if (fIn==NULL)
+		{
+			fIn=fopen(GetFileName(key,".seg").c_str(),"rb");
+			if (fIn==NULL)
+				break;
+		}
+		std::vector<_tTSPoint> bpoints;
+		if (!ReadBlock(fIn,series,*itt,bpoints))
+		{
+			_log.Log(LOG_ERROR,"TSDB: Could not decode a block of %s/%llu",key.first.c_str(),key.second);
+			continue;
+		}
+		std::vector<_tTSPoint>::const_iterator itt2;
+		for (itt2=bpoints.begin(); itt2!=bpoints.end(); ++itt2)
+		{
+			if ((itt2->Time>=TimeStart)&&(itt2->Time<=TimeEnd))
+				points.push_back(*itt2);
+		}
+	}
+	if (fIn!=NULL)
+		fclose(fIn);
+	std::vector<_tTSPoint>::const_iterator itt2;
+	for (itt2=series.Head.begin(); itt2!=series.Head.end(); ++itt2)
+	{
+		if ((itt2->Time>=TimeStart)&&(itt2->Time<=TimeEnd))
+			points.push_back(*itt2);
+	}
+	//the head can start before the end of the last block (DST), keep equal times in the order they were added
+	if (std::adjacent_find(points.begin(),points.end(),TSPointTimeGreater)!=points.end())
+		std::stable_sort(points.begin(),points.end(),TSPointTimeLess);
+}
+
+void CTimeSeriesStore::Query(const std::string &Table, const unsigned long long DeviceRowID, const long long TimeStart, const long long TimeEnd, std::vector<_tTSPoint> &points)
+{
+	boost::lock_guard<boost::mutex> l(m_mutex);
+	if (!m_bIsOpen)
+		return;
+	SeriesKey key(Table,DeviceRowID);
+	if (m_series.find(key)==m_series.end())
+		return;
+	ReadSeries(key,GetSeries(key),TimeStart,TimeEnd,points);
+}
+
+//Writes the points as full blocks, the rest goes into the head
+void CTimeSeriesStore::RewriteSeries(const SeriesKey &key, _tSeries &series, const std::vector<_tTSPoint> &points)
+{
+	std::string szSegment=GetFileName(key,".seg");
+	std::string szTemp=szSegment+".tmp";
+	series.Blocks.clear();
+	series.Head.clear();
+	series.SegmentSize=0;
+
+	size_t nSealed=(points.size()/TSDB_BLOCK_POINTS)*TSDB_BLOCK_POINTS;
+	if (nSealed>0)
+	{
+		FILE *fOut=fopen(szTemp.c_str(),"wb");
+		if (fOut==NULL)
+		{
+			_log.Log(LOG_ERROR,"TSDB: Could not write %s",szTemp.c_str());
+			series.bLoaded=false;
+			return;
+		}
+		for (size_t ii=0; ii<nSealed; ii+=TSDB_BLOCK_POINTS)
+		{
+			std::vector<unsigned char> buffer;
+			EncodeBlock(points,ii,TSDB_BLOCK_POINTS,series.nColumns,buffer);
+			fwrite(&buffer[0],1,buffer.size(),fOut);
+			_tBlockInfo block;
+			block.Offset=series.SegmentSize;
+			block.nPoints=TSDB_BLOCK_POINTS;
+			block.TimeFirst=points[ii].Time;
+			block.TimeLast=points[ii+TSDB_BLOCK_POINTS-1].Time;
+			block.PayloadSize=(int)buffer.size()-TSDB_BLOCK_HEADER_SIZE;
+			series.Blocks.push_back(block);
+			series.SegmentSize+=buffer.size();
+		}
+		fclose(fOut);
+		remove(szSegment.c_str());
+		rename(szTemp.c_str(),szSegment.c_str());
+	}
+	else
+		remove(szSegment.c_str());
+	series.Head.assign(points.begin()+nSealed,points.end());
+	WriteHead(key,series);
+}
+
+void CTimeSeriesStore::RemovePoints(const std::string &Table, const unsigned long long DeviceRowID, const long long TimeStart, const long long TimeEnd)
+{
+	boost::lock_guard<boost::mutex> l(m_mutex);
+	if (!m_bIsOpen)
+		return;
+	SeriesKey key(Table,DeviceRowID);
+	if (m_series.find(key)==m_series.end())
+		return;
+	_tSeries &series=GetSeries(key);
+	std::vector<_tTSPoint> points;
+	ReadSeries(key,series,LLONG_MIN,LLONG_MAX,points);
+	std::vector<_tTSPoint> kept;
+	std::vector<_tTSPoint>::const_iterator itt;
+	for (itt=points.begin(); itt!=points.end(); ++itt)
+	{
+		if ((itt->Time<TimeStart)||(itt->Time>TimeEnd))
+			kept.push_back(*itt);
+	}
+	if (kept.size()!=points.size())
+		RewriteSeries(key,series,kept);
+}
+
+void CTimeSeriesStore::RemoveSeries(const unsigned long long DeviceRowID)
+{
+	boost::lock_guard<boost::mutex> l(m_mutex);
+	std::map<SeriesKey,_tSeries>::iterator itt=m_series.begin();
+	while (itt!=m_series.end())
+	{
+		if (itt->first.second!=DeviceRowID)
+		{
+			++itt;
+			continue;
+		}
+		remove(GetFileName(itt->first,".seg").c_str());
+		remove(GetFileName(itt->first,".head").c_str());
+		m_series.erase(itt++);
+	}
+}
+
+int CTimeSeriesStore::MoveSeries(const std::string &Table, const unsigned long long FromRowID, const unsigned long long ToRowID, const long long TimeEnd)
+{
+	boost::lock_guard<boost::mutex> l(m_mutex);
+	if ((!m_bIsOpen)||(FromRowID==ToRowID))
+		return 0;
+	SeriesKey fromkey(Table,FromRowID);
+	if (m_series.find(fromkey)==m_series.end())
+		return 0;
+	_tSeries &from=GetSeries(fromkey);
+	std::vector<_tTSPoint> points;
+	ReadSeries(fromkey,from,LLONG_MIN,LLONG_MAX,points);
+	std::vector<_tTSPoint> moved;
+	std::vector<_tTSPoint> kept;
+	std::vector<_tTSPoint>::const_iterator itt;
+	for (itt=points.begin(); itt!=points.end(); ++itt)
+	{
+		if (itt->Time<TimeEnd)
+			moved.push_back(*itt);
+		else
+			kept.push_back(*itt);
+	}
+	if (moved.empty())
+		return 0;
+
+	SeriesKey tokey(Table,ToRowID);
+	_tSeries &to=GetSeries(tokey);
+	std::vector<_tTSPoint> merged;
+	ReadSeries(tokey,to,LLONG_MIN,LLONG_MAX,merged);
+	if (merged.empty())
+		to.nColumns=from.nColumns;
+	else if (to.nColumns!=from.nColumns)
+	{
+		_log.Log(LOG_ERROR,"TSDB: Can not move %s/%llu to %llu, the series have a different number of columns",Table.c_str(),FromRowID,ToRowID);
+		return 0;
+	}
+	//the moved points go before the points of the target with the same time
+	merged.insert(merged.begin(),moved.begin(),moved.end());
+	std::stable_sort(merged.begin(),merged.end(),TSPointTimeLess);
+	RewriteSeries(tokey,to,merged);
+
+	if (kept.empty())
+	{
+		remove(GetFileName(fromkey,".seg").c_str());
+		remove(GetFileName(fromkey,".head").c_str());
+		m_series.erase(fromkey);
+	}
+	else
+		RewriteSeries(fromkey,from,kept);
+	return (int)moved.size();
+}
+
+void CTimeSeriesStore::RemoveAll()
+{
+	boost::lock_guard<boost::mutex> l(m_mutex);
+	std::map<SeriesKey,_tSeries>::const_iterator itt;
+	for (itt=m_series.begin(); itt!=m_series.end(); ++itt)
+	{
+		remove(GetFileName(itt->first,".seg").c_str());
+		remove(GetFileName(itt->first,".head").c_str());
+	}
+	m_series.clear();
+	m_syncpoints.clear();
+	SaveSyncPoints();
+}
+
+int CTimeSeriesStore::Prune(const long long TimeCutoff)
+{
+	boost::lock_guard<boost::mutex> l(m_mutex);
+	if (!m_bIsOpen)
+		return 0;
+	int totPoints=0;
+	std::map<SeriesKey,_tSeries>::iterator itt;
+	for (itt=m_series.begin(); itt!=m_series.end(); ++itt)
+	{
+		_tSeries &series=GetSeries(itt->first);
+		size_t nDrop=0;
+		int nPoints=0;
+		while ((nDrop<series.Blocks.size())&&(series.Blocks[nDrop].TimeLast<TimeCutoff))
+		{
+			nPoints+=series.Blocks[nDrop].nPoints;
+			nDrop++;
+		}
+		if (nDrop==0)
+			continue;
+
+		std::string szSegment=GetFileName(itt->first,".seg");
+		if (nDrop==series.Blocks.size())
+		{
+			remove(szSegment.c_str());
+			series.Blocks.clear();
+			series.SegmentSize=0;
+			totPoints+=nPoints;
+			continue;
+		}
+		//copy the remaining blocks
+		long long offset=series.Blocks[nDrop].Offset;
+		std::vector<unsigned char> buffer((size_t)(series.SegmentSize-offset));
+		FILE *fIn=fopen(szSegment.c_str(),"rb");
+		if (fIn==NULL)
+			continue;
+		fseek(fIn,(long)offset,SEEK_SET);
+		bool bOK=(fread(&buffer[0],1,buffer.size(),fIn)==buffer.size());
+		fclose(fIn);
+		if (!bOK)
+			continue;
+		std::string szTemp=szSegment+".tmp";
+		FILE *fOut=fopen(szTemp.c_str(),"wb");
+		if (fOut==NULL)
+			continue;
+		bOK=(fwrite(&buffer[0],1,buffer.size(),fOut)==buffer.size());
+		fclose(fOut);
+		if (!bOK)
+		{
+			remove(szTemp.c_str());
+			continue;
+		}
+		remove(szSegment.c_str());
+		rename(szTemp.c_str(),szSegment.c_str());
+
+		series.Blocks.erase(series.Blocks.begin(),series.Blocks.begin()+nDrop);
+		std::vector<_tBlockInfo>::iterator itt2;
+		for (itt2=series.Blocks.begin(); itt2!=series.Blocks.end(); ++itt2)
+			itt2->Offset-=offset;
+		series.SegmentSize-=offset;
+		totPoints+=nPoints;
+	}
+	return totPoints;
+}
+
+void CTimeSeriesStore::GetStats(const std::string &Table, _tTSStoreStats &stats)
+{
+	memset(&stats,0,sizeof(stats));
+	boost::lock_guard<boost::mutex> l(m_mutex);
+	std::map<SeriesKey,_tSeries>::iterator itt;
+	for (itt=m_series.begin(); itt!=m_series.end(); ++itt)
+	{
+		if (itt->first.first!=Table)
+			continue;
+		_tSeries &series=GetSeries(itt->first);
+		stats.Series++;
+		stats.Bytes+=series.SegmentSize;
+		std::vector<_tBlockInfo>::const_iterator itt2;
+		for (itt2=series.Blocks.begin(); itt2!=series.Blocks.end(); ++itt2)
+			stats.Points+=itt2->nPoints;
+		if (!series.Head.empty())
+		{
+			stats.Points+=series.Head.size();
+			stats.Bytes+=TSDB_HEAD_HEADER_SIZE+series.Head.size()*(8+8*series.nColumns);
+		}
+	}
+}
+
+long long CTimeSeriesStore::GetOldestTime()
+{
+	boost::lock_guard<boost::mutex> l(m_mutex);
+	if (!m_bIsOpen)
+		return -1;
+	long long oldest=-1;
+	std::map<SeriesKey,_tSeries>::iterator itt;
+	for (itt=m_series.begin(); itt!=m_series.end(); ++itt)
+	{
+		_tSeries &series=GetSeries(itt->first);
+		long long ltime;
+		if (!series.Blocks.empty())
+			ltime=series.Blocks.front().TimeFirst;
+		else if (!series.Head.empty())
+			ltime=series.Head.front().Time;
+		else
+			continue;
+		if ((oldest<0)||(ltime<oldest))
+			oldest=ltime;
+	}
+	return oldest;
+}
+
+void CTimeSeriesStore::GetSyncPoint(const std::string &Table, _tTSSyncPoint &syncpoint)
+{
+	boost::lock_guard<boost::mutex> l(m_mutex);
+	syncpoint.RowID=0;
+	syncpoint.Time=0;
+	std::map<std::string,_tTSSyncPoint>::const_iterator itt=m_syncpoints.find(Table);
+	if (itt!=m_syncpoints.end())
+		syncpoint=itt->second;
+}
+
+void CTimeSeriesStore::SetSyncPoint(const std::string &Table, const _tTSSyncPoint &syncpoint)
+{
+	boost::lock_guard<boost::mutex> l(m_mutex);
+	if (!m_bIsOpen)
+		return;
+	m_syncpoints[Table]=syncpoint;
+	SaveSyncPoints();
+}
+
+void CTimeSeriesStore::SaveSyncPoints()
+{
+	std::string szFile=m_path+"syncpoints.txt";
+	std::string szTemp=szFile+".tmp";
+	{
+		std::ofstream outfile(szTemp.c_str());
+		if (!outfile.is_open())
+			return;
+		std::map<std::string,_tTSSyncPoint>::const_iterator itt;
+		for (itt=m_syncpoints.begin(); itt!=m_syncpoints.end(); ++itt)
+			outfile << itt->first << " " << itt->second.RowID << " " << itt->second.Time << "\n";
+	}
+	remove(szFile.c_str());
+	rename(szTemp.c_str(),szFile.c_str());
+}
+
+//Block layout: "TSB1", points (2), columns (1), 0 (1), first time (8), last time (8), payload size (4), payload.
+//The payload is a bit stream, per point the time as delta-of-delta followed by the XOR encoded columns.
+void CTimeSeriesStore::EncodeBlock(const std::vector<_tTSPoint> &points, const size_t nStart, const size_t nCount, const int nColumns, std::vector<unsigned char> &output)
+{
+	std::vector<unsigned char> payload;
+	CTSBitWriter writer(payload);
+
+	unsigned long long prevBits[TSDB_MAX_COLUMNS];
+	int prevLead[TSDB_MAX_COLUMNS];
+	int prevTrail[TSDB_MAX_COLUMNS];
+	const _tTSPoint &first=points[nStart];
+	for (int ii=0; ii<nColumns; ii++)
+	{
+		prevBits[ii]=DoubleToBits(first.Values[ii]);
+		writer.Write(prevBits[ii],64);
+		prevLead[ii]=-1;
+		prevTrail[ii]=0;
+	}
+	long long prevTime=first.Time;
+	long long prevDelta=0;
+	for (size_t jj=nStart+1; jj<nStart+nCount; jj++)
+	{
+		const _tTSPoint &point=points[jj];
+		long long delta=point.Time-prevTime;
+		long long dod=delta-prevDelta;
+		if (dod==0)
+			writer.Write(0,1);
+		else if ((dod>=-63)&&(dod<=64))
+		{
+			writer.Write(2,2);
+			writer.Write((unsigned long long)(dod+63),7);
+		}
+		else if ((dod>=-255)&&(dod<=256))
+		{
+			writer.Write(6,3);
+			writer.Write((unsigned long long)(dod+255),9);
+		}
+		else if ((dod>=-2047)&&(dod<=2048))
+		{
+			writer.Write(14,4);
+			writer.Write((unsigned long long)(dod+2047),12);
+		}
+		else
+		{
+			writer.Write(15,4);
+			writer.Write((unsigned long long)(unsigned int)(int)dod,32);
+		}
+		prevDelta=delta;
+		prevTime=point.Time;
+
+		for (int ii=0; ii<nColumns; ii++)
+		{
+			unsigned long long bits=DoubleToBits(point.Values[ii]);
+			unsigned long long xorbits=bits^prevBits[ii];
+			prevBits[ii]=bits;
+			if (xorbits==0)
+			{
+				writer.Write(0,1);
+				continue;
+			}
+			int lead=CountLeadingZeros(xorbits);
+			if (lead>31)
+				lead=31;
+			int trail=CountTrailingZeros(xorbits);
+			if ((prevLead[ii]!=-1)&&(lead>=prevLead[ii])&&(trail>=prevTrail[ii]))
+			{
+				//fits in the meaningful bits of the previous value
+				writer.Write(2,2);
+				writer.Write(xorbits>>prevTrail[ii],64-prevLead[ii]-prevTrail[ii]);
+			}
+			else
+			{
+				int meaningful=64-lead-trail;
+				writer.Write(3,2);
+				writer.Write((unsigned long long)lead,5);
+				writer.Write((unsigned long long)(meaningful-1),6);
+				writer.Write(xorbits>>trail,meaningful);
+				prevLead[ii]=lead;
+				prevTrail[ii]=trail;
+			}
+		}
+	}
+
+	output.push_back('T');
+	output.push_back('S');
+	output.push_back('B');
+	output.push_back('1');
+	PutUInt(output,nCount,2);
+	PutUInt(output,nColumns,1);
+	PutUInt(output,0,1);
+	PutUInt(output,(unsigned long long)first.Time,8);
+	PutUInt(output,(unsigned long long)points[nStart+nCount-1].Time,8);
+	PutUInt(output,payload.size(),4);
+	output.insert(output.end(),payload.begin(),payload.end());
+}
+
+bool CTimeSeriesStore::DecodeBlock(const unsigned char *pData, const size_t nSize, const int nPoints, const int nColumns, const long long TimeFirst, std::vector<_tTSPoint> &points)
+{
+	if ((nPoints<1)||(nColumns<1)||(nColumns>TSDB_MAX_COLUMNS))
+		return false;
+	CTSBitReader reader(pData,nSize);
+	points.reserve(points.size()+nPoints);
+
+	_tTSPoint point;
+	memset(&point,0,sizeof(point));
+	unsigned long long prevBits[TSDB_MAX_COLUMNS];
+	int prevLead[TSDB_MAX_COLUMNS];
+	int prevTrail[TSDB_MAX_COLUMNS];
+	point.Time=TimeFirst;
+	for (int ii=0; ii<nColumns; ii++)
+	{
+		prevBits[ii]=reader.Read(64);
+		point.Values[ii]=BitsToDouble(prevBits[ii]);
+		prevLead[ii]=0;
+		prevTrail[ii]=0;
+	}
+	points.push_back(point);
+
+	long long prevDelta=0;
+	for (int jj=1; jj<nPoints; jj++)
+	{
+		long long dod=0;
+		if (reader.Read(1)!=0)
+		{
+			if (reader.Read(1)==0)
+				dod=(long long)reader.Read(7)-63;
+			else if (reader.Read(1)==0)
+				dod=(long long)reader.Read(9)-255;
+			else if (reader.Read(1)==0)
+				dod=(long long)reader.Read(12)-2047;
+			else
+				dod=(int)(unsigned int)reader.Read(32);
+		}
+		prevDelta+=dod;
+		point.Time+=prevDelta;
+
+		for (int ii=0; ii<nColumns; ii++)
+		{
+			if (reader.Read(1)!=0)
+			{
+				if (reader.Read(1)!=0)
+				{
+					prevLead[ii]=(int)reader.Read(5);
+					int meaningful=(int)reader.Read(6)+1;
+					prevTrail[ii]=64-prevLead[ii]-meaningful;
+					if (prevTrail[ii]<0)
+						return false;
+				}
+				unsigned long long xorbits=reader.Read(64-prevLead[ii]-prevTrail[ii])<<prevTrail[ii];
+				prevBits[ii]^=xorbits;
+			}
+			point.Values[ii]=BitsToDouble(prevBits[ii]);
+		}
+		if (reader.HasError())
+			return false;
+		points.push_back(point);
+	}
+	return !reader.HasError();
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <boost/thread/mutex.hpp>
+
+//Points per compressed block, one day of 5 minute samples
+#define TSDB_BLOCK_POINTS 288
+#define TSDB_MAX_COLUMNS 8
+
+struct _tTSPoint
+{
+	long long Time;		//local time as written in the Date column, in seconds since 1970-01-01 00:00:00
+	double Values[TSDB_MAX_COLUMNS];
+};
+
+//Where the copy of a short log table into the store stopped
+struct _tTSSyncPoint
+{
+	unsigned long long RowID;
+	long long Time;		//Date of that row, tells if the ROWID was used again for a newer row
+};
+
+struct _tTSStoreStats
+{
+	unsigned long long Series;
+	unsigned long long Points;
+	unsigned long long Bytes;
+};
+
+//Append-only time series store for the 5 minute short log tables.
+//Each device has a segment file per table with sealed blocks of TSDB_BLOCK_POINTS points,
+//timestamps are stored as delta-of-delta and values XOR compressed (as described in the Gorilla paper).
+//Points of the block that is not full yet are appended uncompressed to a head file.
+class CTimeSeriesStore
+{
+public:
+	CTimeSeriesStore(void);
+	~CTimeSeriesStore(void);
+
+	bool Open(const std::string &Path);
+	void Close();
+	bool IsOpen();
+
+	//Returns false when the point is older than the sealed part of the series, or already stored.
+	//Points with the same time but other values are kept (the repeated hour when DST ends)
+	bool Append(const std::string &Table, const unsigned long long DeviceRowID, const int nColumns, const _tTSPoint &point);
+	//Points with TimeStart<=Time<=TimeEnd, in time order
+	void Query(const std::string &Table, const unsigned long long DeviceRowID, const long long TimeStart, const long long TimeEnd, std::vector<_tTSPoint> &points);
+	void RemovePoints(const std::string &Table, const unsigned long long DeviceRowID, const long long TimeStart, const long long TimeEnd);
+	void RemoveSeries(const unsigned long long DeviceRowID);
+	//Moves the points with Time<TimeEnd of a series to the series of another device (device replaced),
+	//returns the number of points moved
+	int MoveSeries(const std::string &Table, const unsigned long long FromRowID, const unsigned long long ToRowID, const long long TimeEnd);
+	void RemoveAll();
+	//Drops the sealed blocks that only have points older than TimeCutoff, returns the number of points removed
+	int Prune(const long long TimeCutoff);
+	void GetStats(const std::string &Table, _tTSStoreStats &stats);
+	//Time of the oldest point in the store, -1 when it is empty
+	long long GetOldestTime();
+
+	//Last row of a short log table that has been copied into the store
+	void GetSyncPoint(const std::string &Table, _tTSSyncPoint &syncpoint);
+	void SetSyncPoint(const std::string &Table, const _tTSSyncPoint &syncpoint);
+
+	static long long LocalTimeFromString(const std::string &szDate);
+	static std::string LocalTimeToString(const long long ltime);
+private:
+	struct _tBlockInfo
+	{
+		long long Offset;
+		long long TimeFirst;
+		long long TimeLast;
+		int nPoints;
+		int PayloadSize;
+	};
+	struct _tSeries
+	{
+		_tSeries() : bLoaded(false), nColumns(0), SegmentSize(0) {}
+		bool bLoaded;
+		int nColumns;
+		long long SegmentSize;
+		std::vector<_tBlockInfo> Blocks;
+		std::vector<_tTSPoint> Head;
+	};
+	typedef std::pair<std::string,unsigned long long> SeriesKey;
+
+	boost::mutex m_mutex;
+	std::string m_path;
+	bool m_bIsOpen;
+	std::map<SeriesKey,_tSeries> m_series;
+	std::map<std::string,_tTSSyncPoint> m_syncpoints;
+
+	std::string GetFileName(const SeriesKey &key, const char *szExtension);
+	_tSeries &GetSeries(const SeriesKey &key);
+	void LoadSeries(const SeriesKey &key, _tSeries &series);
+	bool ReadBlock(FILE *fIn, const _tSeries &series, const _tBlockInfo &block, std::vector<_tTSPoint> &points);
+	bool IsInLastBlock(const SeriesKey &key, const _tSeries &series, const _tTSPoint &point);
+	void ReadSeries(const SeriesKey &key, _tSeries &series, const long long TimeStart, const long long TimeEnd, std::vector<_tTSPoint> &points);
+	void WriteHead(const SeriesKey &key, const _tSeries &series);
+	void AppendHead(const SeriesKey &key, const _tSeries &series, const _tTSPoint &point);
+	void SealHead(const SeriesKey &key, _tSeries &series);
+	void RewriteSeries(const SeriesKey &key, _tSeries &series, const std::vector<_tTSPoint> &points);
+	void SaveSyncPoints();
+
+	static bool IsSamePoint(const _tTSPoint &point1, const _tTSPoint &point2, const int nColumns);
+	static void EncodeBlock(const std::vector<_tTSPoint> &points, const size_t nStart, const size_t nCount, const int nColumns, std::vector<unsigned char> &output);
+	static bool DecodeBlock(const unsigned char *pData, const size_t nSize, const int nPoints, const int nColumns, const long long TimeFirst, std::vector<_tTSPoint> &points);
+};
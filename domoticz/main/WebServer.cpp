@@ -25,6 +25,7 @@
 	#include "../hardware/GpioPin.h"
 #endif // WITH_GPIO
 #include "../hardware/WOL.h"
+#include "../hardware/evohome.h"
 #include "../webserver/Base64.h"
 #include "../smtpclient/SMTPClient.h"
 #include "../json/config.h"
@@ -44,6 +45,10 @@
 
 #define round(a) ( int ) ( a + .5 )
 
+#define GRAPH_CACHE_MAX_ENTRIES 50
+//seconds between WebSocket pings to the push clients
+#define PUSH_PING_INTERVAL 60
+
 //#define DEBUG_DOWNLOAD
 
 extern std::string szStartupFolder;
@@ -83,6 +88,8 @@ CWebServer::CWebServer(void)
 {
 	m_pWebEm=NULL;
 	m_LastUpdateCheck=0;
+	m_bReloadUsers=false;
+	m_bPushStopRequested=false;
 }
 
 
@@ -253,6 +260,11 @@ bool CWebServer::StartServer(const std::string &listenaddress, const std::string
 	RegisterCommandCode("logincheck", boost::bind(&CWebServer::Cmd_LoginCheck, this, _1), true);
 	RegisterCommandCode("getversion", boost::bind(&CWebServer::Cmd_GetVersion, this, _1),true);
 	RegisterCommandCode("getlog", boost::bind(&CWebServer::Cmd_GetLog, this, _1));
+	RegisterCommandCode("getdbwriterstats", boost::bind(&CWebServer::Cmd_GetDBWriterStats, this, _1));
+	RegisterCommandCode("getdecodestats", boost::bind(&CWebServer::Cmd_GetDecodeStats, this, _1));
+	RegisterCommandCode("getbackupstatus", boost::bind(&CWebServer::Cmd_GetBackupStatus, this, _1));
+	RegisterCommandCode("getevohomesendstats", boost::bind(&CWebServer::Cmd_GetEvohomeSendStats, this, _1));
+	RegisterCommandCode("geteventstats", boost::bind(&CWebServer::Cmd_GetEventStats, this, _1));
 	RegisterCommandCode("getauth", boost::bind(&CWebServer::Cmd_GetAuth, this, _1),true);
 
 	RegisterCommandCode("addhardware",boost::bind(&CWebServer::Cmd_AddHardware,this, _1));
@@ -324,7 +336,7 @@ bool CWebServer::StartServer(const std::string &listenaddress, const std::string
 	RegisterCommandCode("devices_list", boost::bind(&CWebServer::Cmd_GetDevicesList, this, _1));
 	RegisterCommandCode("devices_list_onoff", boost::bind(&CWebServer::Cmd_GetDevicesListOnOff, this, _1));
 
-	RegisterRType("graph", boost::bind(&CWebServer::RType_HandleGraph, this, _1));
+	//graph is handled by GetJSonPage, its result array is streamed as text (see CGraphRows)
 	RegisterRType("lightlog", boost::bind(&CWebServer::RType_LightLog, this, _1));
 	RegisterRType("settings", boost::bind(&CWebServer::RType_Settings, this, _1));
 	RegisterRType("events", boost::bind(&CWebServer::RType_Events, this, _1));
@@ -387,16 +399,149 @@ bool CWebServer::StartServer(const std::string &listenaddress, const std::string
 	//Start worker thread
 	m_thread = boost::shared_ptr<boost::thread>(new boost::thread(boost::bind(&CWebServer::Do_Work, this)));
 
+	m_bPushStopRequested=false;
+	m_pushthread = boost::shared_ptr<boost::thread>(new boost::thread(boost::bind(&CWebServer::Do_PushWork, this)));
+
 	return (m_thread!=NULL);
 }
 
 void CWebServer::StopServer()
 {
+	if (m_pushthread!=NULL)
+	{
+		m_bPushStopRequested=true;
+		m_pushthread->join();
+		m_pushthread.reset();
+	}
 	if (m_pWebEm==NULL)
 		return;
 	m_pWebEm->Stop();
 }
 
+//Incremental device list: changed devices/scenes that are not in the reply became unused,
+//hidden, filtered out or were deleted, list them so the client drops its stale entries
+static void AddRemovedDevices(Json::Value &root, const std::set<unsigned long long> &devices, const std::set<unsigned long long> &scenes)
+{
+	std::set<unsigned long long> _SentDevices;
+	std::set<unsigned long long> _SentScenes;
+	if (root.isMember("result"))
+	{
+		const Json::Value &result = root["result"];
+		for (Json::Value::ArrayIndex ii = 0; ii < result.size(); ii++)
+		{
+			unsigned long long idx = strtoull(result[ii]["idx"].asString().c_str(), NULL, 10);
+			std::string stype = result[ii]["Type"].asString();
+			if ((stype == "Scene") || (stype == "Group"))
+				_SentScenes.insert(idx);
+			else
+				_SentDevices.insert(idx);
+		}
+	}
+	int ii = 0;
+	std::set<unsigned long long>::const_iterator itt;
+	for (itt = devices.begin(); itt != devices.end(); ++itt)
+	{
+		if (_SentDevices.find(*itt) == _SentDevices.end())
+			root["RemovedDevices"][ii++] = boost::lexical_cast<std::string>(*itt);
+	}
+	ii = 0;
+	for (itt = scenes.begin(); itt != scenes.end(); ++itt)
+	{
+		if (_SentScenes.find(*itt) == _SentScenes.end())
+			root["RemovedScenes"][ii++] = boost::lexical_cast<std::string>(*itt);
+	}
+}
+
+void CWebServer::Do_PushWork()
+{
+	unsigned long long lastseq=m_sql.GetChangeSequence();
+	time_t lastping=mytime(NULL);
+	while (!m_bPushStopRequested)
+	{
+		bool bChanged=m_sql.WaitForChanges(lastseq, 1000);
+
+		time_t atime=mytime(NULL);
+		if (atime-lastping>=PUSH_PING_INTERVAL)
+		{
+			lastping=atime;
+			m_pWebEm->PushPing();
+		}
+		if (!bChanged)
+			continue;
+		if (!m_pWebEm->HasPushClients())
+		{
+			lastseq=m_sql.GetChangeSequence();
+			continue;
+		}
+
+		//Send the changes of a burst (for example a batch from the writer thread) in one message
+		sleep_milliseconds(100);
+
+		std::set<unsigned long long> _ChangedDevices;
+		std::set<unsigned long long> _ChangedScenes;
+		std::set<unsigned long long> _ChangedUserVariables;
+		unsigned long long actseq=0;
+		bool bHaveChanges=m_sql.GetChangesSince(lastseq, actseq, _ChangedDevices, _ChangedScenes, &_ChangedUserVariables);
+		lastseq=actseq;
+
+		Json::FastWriter writer;
+		if (!bHaveChanges)
+		{
+			//Deleted devices or hardware/plan changes, clients should reload everything
+			Json::Value root;
+			root["title"]="Devices";
+			root["resync"]=true;
+			root["ActSeq"]=(Json::UInt64)actseq;
+			m_pWebEm->PushMessage(writer.write(root));
+			continue;
+		}
+		if ((!_ChangedDevices.empty())||(!_ChangedScenes.empty()))
+		{
+			Json::Value root;
+			GetJSonDevices(root, "", "all", "", "", "", "", true, 0, &_ChangedDevices, &_ChangedScenes);
+			AddRemovedDevices(root, _ChangedDevices, _ChangedScenes);
+			if ((!root["result"].empty())||(root.isMember("RemovedDevices"))||(root.isMember("RemovedScenes")))
+			{
+				root["title"]="Devices";
+				root["ActSeq"]=(Json::UInt64)actseq;
+				m_pWebEm->PushMessage(writer.write(root));
+			}
+		}
+		if (!_ChangedUserVariables.empty())
+		{
+			std::stringstream szQuery;
+			szQuery << "SELECT ID,Name,ValueType,Value,LastUpdate FROM UserVariables WHERE (ID IN (";
+			std::set<unsigned long long>::const_iterator itt;
+			for (itt=_ChangedUserVariables.begin(); itt!=_ChangedUserVariables.end(); ++itt)
+			{
+				if (itt!=_ChangedUserVariables.begin())
+					szQuery << ",";
+				szQuery << *itt;
+			}
+			szQuery << "))";
+			std::vector<std::vector<std::string> > result=m_sql.query(szQuery.str());
+			if (result.size()>0)
+			{
+				Json::Value root;
+				int ii=0;
+				std::vector<std::vector<std::string> >::const_iterator itt2;
+				for (itt2=result.begin(); itt2!=result.end(); ++itt2)
+				{
+					std::vector<std::string> sd=*itt2;
+					root["result"][ii]["idx"]=sd[0];
+					root["result"][ii]["Name"]=sd[1];
+					root["result"][ii]["Type"]=sd[2];
+					root["result"][ii]["Value"]=sd[3];
+					root["result"][ii]["LastUpdate"]=sd[4];
+					ii++;
+				}
+				root["title"]="GetUserVariables";
+				m_pWebEm->PushMessage(writer.write(root));
+			}
+		}
+	}
+}
+
 void CWebServer::SetAuthenticationMethod(int amethod)
 {
 	if (m_pWebEm == NULL)
@@ -427,12 +572,224 @@ void CWebServer::HandleRType(const std::string &rtype, Json::Value &root)
 	}
 }
 
+#define JSON_STREAM_CHUNK_SIZE 16384
+
+//Writes a Json::Value in pieces of about JSON_STREAM_CHUNK_SIZE bytes, the
+//output is the same as Json::FastWriter. Feeds a chunked reply so large replies
+//are never serialized into one string. Arrays and objects of the tree are released
+//as soon as they are written. A member that is already JSON text (the rows of a
+//graph, see CGraphRows) is written as is at its place in the root object.
+class CJsonStreamWriter
+{
+public:
+	CJsonStreamWriter(const boost::shared_ptr<Json::Value> &root, const std::string &prefix, const std::string &suffix,
+		const std::string &textname = "", const boost::shared_ptr<const std::string> &text = boost::shared_ptr<const std::string>()) :
+		m_root(root),
+		m_prefix(prefix),
+		m_suffix(suffix),
+		m_textname(textname),
+		m_text(text),
+		m_textpos(std::string::npos),
+		m_bStarted(false)
+	{
+	}
+	bool Write(std::string &output)
+	{
+		if (!m_bStarted)
+		{
+			m_bStarted = true;
+			output += m_prefix;
+			WriteValue(*m_root, output);
+		}
+		while (output.size() < JSON_STREAM_CHUNK_SIZE)
+		{
+			if (m_textpos != std::string::npos)
+			{
+				size_t len = std::min(m_text->size() - m_textpos, (size_t)JSON_STREAM_CHUNK_SIZE - output.size());
+				output.append(*m_text, m_textpos, len);
+				m_textpos += len;
+				if (m_textpos >= m_text->size())
+					m_textpos = std::string::npos;
+				continue;
+			}
+			if (m_stack.empty())
+				break;
+			_tLevel &level = m_stack.back();
+			Json::Value *pChild;
+			if (level.pValue->isArray())
+			{
+				if (level.pos >= level.pValue->size())
+				{
+					output += "]";
+					level.pValue->clear();
+					m_stack.pop_back();
+					continue;
+				}
+				if (level.pos > 0)
+					output += ",";
+				pChild = &(*level.pValue)[(Json::Value::ArrayIndex)level.pos];
+			}
+			else
+			{
+				if (level.pos >= level.members.size())
+				{
+					output += "}";
+					level.pValue->clear();
+					m_stack.pop_back();
+					continue;
+				}
+				if (level.pos > 0)
+					output += ",";
+				const std::string &name = level.members[level.pos];
+				output += Json::valueToQuotedString(name.c_str());
+				output += ":";
+				if ((m_text) && (level.pValue == m_root.get()) && (name == m_textname))
+				{
+					level.pos++;
+					m_textpos = 0;
+					continue;
+				}
+				pChild = &(*level.pValue)[name];
+			}
+			level.pos++;
+			//may add a level, do not use level after this
+			WriteValue(*pChild, output);
+		}
+		if ((!m_stack.empty()) || (m_textpos != std::string::npos))
+			return true;
+		output += "\n";
+		output += m_suffix;
+		return false;
+	}
+private:
+	struct _tLevel
+	{
+		Json::Value *pValue;
+		Json::Value::Members members;
+		size_t pos;
+	};
+	//Scalars are written at once, arrays and objects are opened and continued by Write
+	void WriteValue(Json::Value &value, std::string &output)
+	{
+		switch (value.type())
+		{
+		case Json::nullValue:
+			output += "null";
+			break;
+		case Json::intValue:
+			output += Json::valueToString(value.asLargestInt());
+			break;
+		case Json::uintValue:
+			output += Json::valueToString(value.asLargestUInt());
+			break;
+		case Json::realValue:
+			output += Json::valueToString(value.asDouble());
+			break;
+		case Json::stringValue:
+			output += Json::valueToQuotedString(value.asCString());
+			break;
+		case Json::booleanValue:
+			output += Json::valueToString(value.asBool());
+			break;
+		case Json::arrayValue:
+		case Json::objectValue:
+			{
+				_tLevel level;
+				level.pValue = &value;
+				level.pos = 0;
+				if (value.isArray())
+					output += "[";
+				else
+				{
+					level.members = value.getMemberNames();
+					if ((m_text) && (&value == m_root.get()))
+					{
+						//keep the members sorted like Json::FastWriter does
+						Json::Value::Members::iterator itt = std::lower_bound(level.members.begin(), level.members.end(), m_textname);
+						if ((itt == level.members.end()) || (*itt != m_textname))
+							level.members.insert(itt, m_textname);
+					}
+					output += "{";
+				}
+				m_stack.push_back(level);
+			}
+			break;
+		}
+	}
+	boost::shared_ptr<Json::Value> m_root;
+	std::string m_prefix;
+	std::string m_suffix;
+	std::string m_textname;
+	boost::shared_ptr<const std::string> m_text;
+	size_t m_textpos; //npos while the text member is not being written
+	bool m_bStarted;
+	std::vector<_tLevel> m_stack;
+};
+
+//The result array of a graph. GetGraph adds each row as soon as it is read from
+//the database, the row is written out as compact JSON text and cleared for the next
+//one, so a reply holds the text of its rows instead of a Json::Value per row.
+//Graphs that are downsampled afterwards need the values, their rows are appended
+//to root["result"] instead.
+class CGraphRows
+{
+public:
+	CGraphRows() :
+		m_pRoot(NULL),
+		m_text(new std::string()),
+		m_count(0)
+	{
+	}
+	explicit CGraphRows(Json::Value &root) :
+		m_pRoot(&root),
+		m_count(0)
+	{
+	}
+	void Add(Json::Value &row)
+	{
+		m_count++;
+		if (m_pRoot != NULL)
+		{
+			(*m_pRoot)["result"].append(Json::Value()).swap(row);
+			return;
+		}
+		std::string text = m_writer.write(row);
+		text.resize(text.size() - 1); //Json::FastWriter ends with a newline
+		*m_text += (m_count == 1) ? "[" : ",";
+		*m_text += text;
+		row.clear();
+	}
+	//Closes the array, returns an empty pointer when there are no rows (the reply has no result then)
+	boost::shared_ptr<const std::string> GetText()
+	{
+		if ((m_pRoot != NULL) || (m_count == 0))
+			return boost::shared_ptr<const std::string>();
+		*m_text += "]";
+		return m_text;
+	}
+private:
+	Json::Value *m_pRoot;
+	boost::shared_ptr<std::string> m_text;
+	size_t m_count;
+	Json::FastWriter m_writer;
+};
+
 std::string CWebServer::GetJSonPage()
 {
+	std::string retstr;
 	Json::Value root;
+	boost::shared_ptr<const std::string> resulttext;
 	root["status"] = "ERR";
 
 	std::string rtype = m_pWebEm->FindValue("type");
+
+	//Queued sensor updates are committed by the writer within the write interval, only a request
+	//for a single device or graph commits the updates queued for that device first
+	std::string flushidx = m_pWebEm->FindValue("rid");
+	if ((flushidx == "") && (rtype == "graph"))
+		flushidx = m_pWebEm->FindValue("idx");
+	if (flushidx != "")
+		m_sql.FlushWriteQueue(strtoull(flushidx.c_str(), NULL, 10));
 	if (rtype == "command")
 	{
 		std::string cparam = m_pWebEm->FindValue("param");
@@ -448,23 +805,54 @@ std::string CWebServer::GetJSonPage()
 		{
 			root["status"] = "OK";
 			root["title"] = "Logout";
-			m_retstr = "authorize";
-			return m_retstr;
+			retstr = "authorize";
+			return retstr;
 
 		}
-		HandleCommand(cparam, root);
+		{
+			//commands run concurrently, the user list may only change while none is running
+			boost::shared_lock<boost::shared_mutex> l(m_usersmutex);
+			HandleCommand(cparam, root);
+		}
+		if (TestAndClearReloadUsers())
+			LoadUsers();
 	} //(rtype=="command")
+	else if (rtype == "graph")
+	{
+		boost::shared_lock<boost::shared_mutex> l(m_usersmutex);
+		RType_HandleGraph(root, resulttext);
+	}
 	else
+	{
+		boost::shared_lock<boost::shared_mutex> l(m_usersmutex);
 		HandleRType(rtype, root);
+	}
 exitjson:
 	std::string jcallback = m_pWebEm->FindValue("jsoncallback");
+	if ((rtype == "graph") || (rtype == "devices"))
+	{
+		//Graph and device list replies can be several MB, write them out chunk by chunk while they are sent
+		boost::shared_ptr<Json::Value> pRoot(new Json::Value());
+		pRoot->swap(root);
+		boost::shared_ptr<CJsonStreamWriter> pWriter;
+		if (jcallback.size() == 0)
+			pWriter.reset(new CJsonStreamWriter(pRoot, "", "", "result", resulttext));
+		else
+			pWriter.reset(new CJsonStreamWriter(pRoot, "var data=", jcallback + "(data);", "result", resulttext));
+		m_pWebEm->Context().m_contentSource = boost::bind(&CJsonStreamWriter::Write, pWriter, _1);
+		return retstr;
+	}
+	//Compact output, the styled indentation doubles the size of large replies
+	Json::FastWriter writer;
 	if (jcallback.size() == 0)
-		m_retstr = root.toStyledString();
+		retstr = writer.write(root);
 	else
 	{
-		m_retstr = "var data=" + root.toStyledString() + "\n" + jcallback + "(data);";
+		retstr = "var data=";
+		retstr += writer.write(root);
+		retstr += jcallback + "(data);";
 	}
-	return m_retstr;
+	return retstr;
 }
 
 void CWebServer::Cmd_GetLanguage(Json::Value &root)
@@ -506,19 +894,19 @@ void CWebServer::Cmd_LoginCheck(Json::Value &root)
 				return;
 			root["status"]="OK";
 			root["title"]="logincheck";
-			m_pWebEm->m_actualuser = m_users[iUser].Username;
-			m_pWebEm->m_actualuser_rights = m_users[iUser].userrights;
-			m_pWebEm->m_bAddNewSession = true;
-			m_pWebEm->m_bRemembermeUser = (rememberme == "true");
-			root["user"] = m_pWebEm->m_actualuser;
-			root["rights"] = m_pWebEm->m_actualuser_rights;
+			m_pWebEm->Context().m_actualuser = m_users[iUser].Username;
+			m_pWebEm->Context().m_actualuser_rights = m_users[iUser].userrights;
+			m_pWebEm->Context().m_bAddNewSession = true;
+			m_pWebEm->Context().m_bRemembermeUser = (rememberme == "true");
+			root["user"] = m_pWebEm->Context().m_actualuser;
+			root["rights"] = m_pWebEm->Context().m_actualuser_rights;
 		}
 	}
 }
 
 void CWebServer::Cmd_AddHardware(Json::Value &root)
 {
-	if (m_pWebEm->m_actualuser_rights != 2)
+	if (m_pWebEm->Context().m_actualuser_rights != 2)
 	{
 		//No admin user, and not allowed to be here
 		return;
@@ -646,7 +1034,7 @@ void CWebServer::Cmd_AddHardware(Json::Value &root)
 
 void CWebServer::Cmd_UpdateHardware(Json::Value &root)
 {
-	if (m_pWebEm->m_actualuser_rights != 2)
+	if (m_pWebEm->Context().m_actualuser_rights != 2)
 	{
 		//No admin user, and not allowed to be here
 		return;
@@ -818,7 +1206,7 @@ void CWebServer::Cmd_WOLGetNodes(Json::Value &root)
 
 void CWebServer::Cmd_WOLAddNode(Json::Value &root)
 {
-	if (m_pWebEm->m_actualuser_rights != 2)
+	if (m_pWebEm->Context().m_actualuser_rights != 2)
 	{
 		//No admin user, and not allowed to be here
 		return;
@@ -848,7 +1236,7 @@ void CWebServer::Cmd_WOLAddNode(Json::Value &root)
 
 void CWebServer::Cmd_WOLUpdateNode(Json::Value &root)
 {
-	if (m_pWebEm->m_actualuser_rights != 2)
+	if (m_pWebEm->Context().m_actualuser_rights != 2)
 	{
 		//No admin user, and not allowed to be here
 		return;
@@ -881,7 +1269,7 @@ void CWebServer::Cmd_WOLUpdateNode(Json::Value &root)
 
 void CWebServer::Cmd_WOLRemoveNode(Json::Value &root)
 {
-	if (m_pWebEm->m_actualuser_rights != 2)
+	if (m_pWebEm->Context().m_actualuser_rights != 2)
 	{
 		//No admin user, and not allowed to be here
 		return;
@@ -910,7 +1298,7 @@ void CWebServer::Cmd_WOLRemoveNode(Json::Value &root)
 
 void CWebServer::Cmd_WOLClearNodes(Json::Value &root)
 {
-	if (m_pWebEm->m_actualuser_rights != 2)
+	if (m_pWebEm->Context().m_actualuser_rights != 2)
 	{
 		//No admin user, and not allowed to be here
 		return;
@@ -934,7 +1322,7 @@ void CWebServer::Cmd_WOLClearNodes(Json::Value &root)
 
 void CWebServer::Cmd_SaveFibaroLinkConfig(Json::Value &root)
 {
-	if (m_pWebEm->m_actualuser_rights != 2)
+	if (m_pWebEm->Context().m_actualuser_rights != 2)
 	{
 		//No admin user, and not allowed to be here
 		return;
@@ -1081,7 +1469,7 @@ void CWebServer::Cmd_SaveFibaroLink(Json::Value &root)
 
 void CWebServer::Cmd_DeleteFibaroLink(Json::Value &root)
 {
-	if (m_pWebEm->m_actualuser_rights != 2)
+	if (m_pWebEm->Context().m_actualuser_rights != 2)
 	{
 		//No admin user, and not allowed to be here
 		return;
@@ -1247,7 +1635,7 @@ void CWebServer::Cmd_AllowNewHardware(Json::Value &root)
 
 void CWebServer::Cmd_DeleteHardware(Json::Value &root)
 {
-	if (m_pWebEm->m_actualuser_rights != 2)
+	if (m_pWebEm->Context().m_actualuser_rights != 2)
 	{
 		//No admin user, and not allowed to be here
 		return;
@@ -1329,7 +1717,7 @@ void CWebServer::RType_OpenZWaveNodes(Json::Value &root)
 
 void CWebServer::Cmd_ZWaveUpdateNode(Json::Value &root)
 {
-	if (m_pWebEm->m_actualuser_rights != 2)
+	if (m_pWebEm->Context().m_actualuser_rights != 2)
 	{
 		//No admin user, and not allowed to be here
 		return;
@@ -1374,7 +1762,7 @@ void CWebServer::Cmd_ZWaveUpdateNode(Json::Value &root)
 
 void CWebServer::Cmd_ZWaveDeleteNode(Json::Value &root)
 {
-	if (m_pWebEm->m_actualuser_rights != 2)
+	if (m_pWebEm->Context().m_actualuser_rights != 2)
 	{
 		//No admin user, and not allowed to be here
 		return;
@@ -1408,7 +1796,7 @@ void CWebServer::Cmd_ZWaveDeleteNode(Json::Value &root)
 
 void CWebServer::Cmd_ZWaveInclude(Json::Value &root)
 {
-	if (m_pWebEm->m_actualuser_rights != 2)
+	if (m_pWebEm->Context().m_actualuser_rights != 2)
 	{
 		//No admin user, and not allowed to be here
 		return;
@@ -1429,7 +1817,7 @@ void CWebServer::Cmd_ZWaveInclude(Json::Value &root)
 
 void CWebServer::Cmd_ZWaveExclude(Json::Value &root)
 {
-	if (m_pWebEm->m_actualuser_rights != 2)
+	if (m_pWebEm->Context().m_actualuser_rights != 2)
 	{
 		//No admin user, and not allowed to be here
 		return;
@@ -1450,7 +1838,7 @@ void CWebServer::Cmd_ZWaveExclude(Json::Value &root)
 
 void CWebServer::Cmd_ZWaveSoftReset(Json::Value &root)
 {
-	if (m_pWebEm->m_actualuser_rights != 2)
+	if (m_pWebEm->Context().m_actualuser_rights != 2)
 	{
 		//No admin user, and not allowed to be here
 		return;
@@ -1471,7 +1859,7 @@ void CWebServer::Cmd_ZWaveSoftReset(Json::Value &root)
 
 void CWebServer::Cmd_ZWaveHardReset(Json::Value &root)
 {
-	if (m_pWebEm->m_actualuser_rights != 2)
+	if (m_pWebEm->Context().m_actualuser_rights != 2)
 	{
 		//No admin user, and not allowed to be here
 		return;
@@ -1509,7 +1897,7 @@ void CWebServer::Cmd_ZWaveStateCheck(Json::Value &root)
 
 void CWebServer::Cmd_ZWaveNetworkHeal(Json::Value &root)
 {
-	if (m_pWebEm->m_actualuser_rights != 2)
+	if (m_pWebEm->Context().m_actualuser_rights != 2)
 	{
 		//No admin user, and not allowed to be here
 		return;
@@ -1530,7 +1918,7 @@ void CWebServer::Cmd_ZWaveNetworkHeal(Json::Value &root)
 
 void CWebServer::Cmd_ZWaveNodeHeal(Json::Value &root)
 {
-	if (m_pWebEm->m_actualuser_rights != 2)
+	if (m_pWebEm->Context().m_actualuser_rights != 2)
 	{
 		//No admin user, and not allowed to be here
 		return;
@@ -1554,7 +1942,7 @@ void CWebServer::Cmd_ZWaveNodeHeal(Json::Value &root)
 
 void CWebServer::Cmd_ZWaveNetworkInfo(Json::Value &root)
 {
-	if (m_pWebEm->m_actualuser_rights != 2)
+	if (m_pWebEm->Context().m_actualuser_rights != 2)
 	{
 		//No admin user, and not allowed to be here
 		return;
@@ -1615,7 +2003,7 @@ void CWebServer::Cmd_ZWaveNetworkInfo(Json::Value &root)
 
 void CWebServer::Cmd_ZWaveRemoveGroupNode(Json::Value &root)
 {
-	if (m_pWebEm->m_actualuser_rights != 2)
+	if (m_pWebEm->Context().m_actualuser_rights != 2)
 	{
 		//No admin user, and not allowed to be here
 		return;
@@ -1645,7 +2033,7 @@ void CWebServer::Cmd_ZWaveRemoveGroupNode(Json::Value &root)
 
 void CWebServer::Cmd_ZWaveAddGroupNode(Json::Value &root)
 {
-	if (m_pWebEm->m_actualuser_rights != 2)
+	if (m_pWebEm->Context().m_actualuser_rights != 2)
 	{
 		//No admin user, and not allowed to be here
 		return;
@@ -1759,7 +2147,7 @@ void CWebServer::Cmd_ZWaveCancel(Json::Value &root)
 
 void CWebServer::Cmd_ApplyZWaveNodeConfig(Json::Value &root)
 {
-	if (m_pWebEm->m_actualuser_rights != 2)
+	if (m_pWebEm->Context().m_actualuser_rights != 2)
 	{
 		//No admin user, and not allowed to be here
 		return;
@@ -1820,7 +2208,7 @@ void CWebServer::Cmd_ZWaveRequestNodeConfig(Json::Value &root)
 
 void CWebServer::Cmd_ZWaveReceiveConfigurationFromOtherController(Json::Value &root)
 {
-	if (m_pWebEm->m_actualuser_rights != 2)
+	if (m_pWebEm->Context().m_actualuser_rights != 2)
 	{
 		//No admin user, and not allowed to be here
 		return;
@@ -1841,7 +2229,7 @@ void CWebServer::Cmd_ZWaveReceiveConfigurationFromOtherController(Json::Value &r
 
 void CWebServer::Cmd_ZWaveSendConfigurationToSecondaryController(Json::Value &root)
 {
-	if (m_pWebEm->m_actualuser_rights != 2)
+	if (m_pWebEm->Context().m_actualuser_rights != 2)
 	{
 		//No admin user, and not allowed to be here
 		return;
@@ -1862,7 +2250,7 @@ void CWebServer::Cmd_ZWaveSendConfigurationToSecondaryController(Json::Value &ro
 
 void CWebServer::Cmd_ZWaveTransferPrimaryRole(Json::Value &root)
 {
-	if (m_pWebEm->m_actualuser_rights != 2)
+	if (m_pWebEm->Context().m_actualuser_rights != 2)
 	{
 		//No admin user, and not allowed to be here
 		return;
@@ -1882,10 +2270,11 @@ void CWebServer::Cmd_ZWaveTransferPrimaryRole(Json::Value &root)
 }
 std::string CWebServer::ZWaveGetConfigFile()
 {
+	std::string retstr;
 	std::string idx=m_pWebEm->FindValue("idx");
 	if (idx=="")
 		return "";
-	m_retstr="";
+	retstr="";
 	CDomoticzHardwareBase *pHardware=m_mainworker.GetHardware(atoi(idx.c_str()));
 	if (pHardware!=NULL)
 	{
@@ -1893,19 +2282,19 @@ std::string CWebServer::ZWaveGetConfigFile()
 		{
 			COpenZWave *pOZWHardware=(COpenZWave*)pHardware;
 			std::string szConfigFile="";
-			m_retstr=pOZWHardware->GetConfigFile(szConfigFile);
-			if (m_retstr!="")
+			retstr=pOZWHardware->GetConfigFile(szConfigFile);
+			if (retstr!="")
 			{
-				m_pWebEm->m_outputfilename=szConfigFile;
+				m_pWebEm->Context().m_outputfilename=szConfigFile;
 			}
 		}
 	}
-	return m_retstr;
+	return retstr;
 }
 
 void CWebServer::Cmd_ZWaveSetUserCodeEnrollmentMode(Json::Value &root)
 {
-	if (m_pWebEm->m_actualuser_rights != 2)
+	if (m_pWebEm->Context().m_actualuser_rights != 2)
 	{
 		//No admin user, and not allowed to be here
 		return;
@@ -1926,7 +2315,7 @@ void CWebServer::Cmd_ZWaveSetUserCodeEnrollmentMode(Json::Value &root)
 
 void CWebServer::Cmd_ZWaveRemoveUserCode(Json::Value &root)
 {
-	if (m_pWebEm->m_actualuser_rights != 2)
+	if (m_pWebEm->Context().m_actualuser_rights != 2)
 	{
 		//No admin user, and not allowed to be here
 		return;
@@ -2021,10 +2410,153 @@ void CWebServer::Cmd_GetLog(Json::Value &root)
 	}
 }
 
+void CWebServer::Cmd_GetDBWriterStats(Json::Value &root)
+{
+	_tSQLWriteStats wstats;
+	m_sql.GetWriteQueueStats(wstats);
+
+	int nValue = 0;
+	root["status"] = "OK";
+	root["title"] = "GetDBWriterStats";
+	m_sql.GetPreferencesVar("DBWriteMode", nValue);
+	root["WriteMode"] = nValue;
+	m_sql.GetPreferencesVar("DBWriteInterval", nValue);
+	root["WriteInterval"] = nValue;
+	root["QueueSize"] = wstats.QueueSize;
+	root["MaxQueueSize"] = wstats.MaxQueueSize;
+	root["Items"] = (Json::UInt64)wstats.TotalItems;
+	root["Coalesced"] = (Json::UInt64)wstats.TotalCoalesced;
+	root["Batches"] = (Json::UInt64)wstats.TotalBatches;
+	root["FullWaits"] = (Json::UInt64)wstats.TotalFullWaits;
+	root["Inline"] = (Json::UInt64)wstats.TotalInline;
+	root["AvgLatency"] = (int)wstats.AvgLatency;
+	root["MaxLatency"] = (int)wstats.MaxLatency;
+
+	std::map<std::string, _tAggregationStats> astats;
+	m_sql.GetAggregationStats(astats);
+	std::map<std::string, _tAggregationStats>::const_iterator itt;
+	for (itt = astats.begin(); itt != astats.end(); ++itt)
+	{
+		Json::Value &aroot = root["Aggregation"][itt->first];
+		aroot["LastRun"] = (Json::UInt64)itt->second.LastRun;
+		aroot["LastResult"] = itt->second.bLastResult;
+		aroot["TotalTime"] = (int)itt->second.TotalTime;
+		std::vector<std::pair<std::string, long> >::const_iterator itt2;
+		for (itt2 = itt->second.JobTimes.begin(); itt2 != itt->second.JobTimes.end(); ++itt2)
+			aroot["Jobs"][itt2->first] = (int)itt2->second;
+	}
+
+	std::map<std::string, _tCleanupStats> cstats;
+	m_sql.GetCleanupStats(cstats);
+	std::map<std::string, _tCleanupStats>::const_iterator ittC;
+	for (ittC = cstats.begin(); ittC != cstats.end(); ++ittC)
+	{
+		Json::Value &croot = root["Cleanup"][ittC->first];
+		croot["LastRun"] = (Json::UInt64)ittC->second.LastRun;
+		croot["Done"] = ittC->second.bDone;
+		croot["Passes"] = ittC->second.Passes;
+		croot["Rows"] = ittC->second.Rows;
+		croot["TotalTime"] = (int)ittC->second.TotalTime;
+	}
+}
+
+void CWebServer::Cmd_GetBackupStatus(Json::Value &root)
+{
+	_tBackupStatus bstatus;
+	m_sql.GetBackupStatus(bstatus);
+
+	root["status"] = "OK";
+	root["title"] = "GetBackupStatus";
+	root["Active"] = bstatus.bActive;
+	root["File"] = bstatus.File;
+	root["PageCount"] = bstatus.PageCount;
+	root["PagesRemaining"] = bstatus.PagesRemaining;
+	root["Progress"] = (bstatus.PageCount>0) ? ((bstatus.PageCount - bstatus.PagesRemaining) * 100) / bstatus.PageCount : 0;
+	root["StartTime"] = (Json::UInt64)bstatus.StartTime;
+	root["EndTime"] = (Json::UInt64)bstatus.EndTime;
+	root["LastResult"] = bstatus.bLastResult;
+}
+
+void CWebServer::Cmd_GetEvohomeSendStats(Json::Value &root)
+{
+	std::string hwid = m_pWebEm->FindValue("idx");
+	if (hwid == "")
+		return;
+	CDomoticzHardwareBase *pBaseHardware = m_mainworker.GetHardware(atoi(hwid.c_str()));
+	if (pBaseHardware == NULL)
+		return;
+	if (pBaseHardware->HwdType != HTYPE_EVOHOME_SERIAL)
+		return;
+	CEvohome *pHardware = (CEvohome*)pBaseHardware;
+
+	_tEvohomeSendStats sstats;
+	pHardware->GetSendStats(sstats);
+
+	root["status"] = "OK";
+	root["title"] = "GetEvohomeSendStats";
+	root["QueueSize"] = sstats.QueueSize;
+	root["QueueSizeUser"] = sstats.QueueSizeUser;
+	root["MaxQueueSize"] = sstats.MaxQueueSize;
+	root["Sent"] = (Json::UInt64)sstats.Sent;
+	root["Acked"] = (Json::UInt64)sstats.Acked;
+	root["Retries"] = (Json::UInt64)sstats.Retries;
+	root["Dropped"] = (Json::UInt64)sstats.Dropped;
+	root["Deduplicated"] = (Json::UInt64)sstats.Deduplicated;
+	root["AvgAckTime"] = (int)sstats.AvgAckTime;
+	root["MaxAckTime"] = (int)sstats.MaxAckTime;
+}
+
+void CWebServer::Cmd_GetDecodeStats(Json::Value &root)
+{
+	_tDecodeStats dstats;
+	m_mainworker.GetDecodeStats(dstats);
+
+	root["status"] = "OK";
+	root["title"] = "GetDecodeStats";
+	root["Packets"] = (Json::UInt64)dstats.TotalPackets;
+	root["PacketsPerSecond"] = dstats.PacketsPerSecond;
+	root["AvgLatency"] = (int)dstats.AvgLatency;
+	root["P99Latency"] = (int)dstats.P99Latency;
+	root["MaxLatency"] = (int)dstats.MaxLatency;
+}
+
+void CWebServer::Cmd_GetEventStats(Json::Value &root)
+{
+	std::vector<CEventSystem::_tEventStats> estats;
+	m_mainworker.m_eventsystem.GetEventStats(estats);
+
+	CEventSystem::_tEventQueueStats qstats;
+	m_mainworker.m_eventsystem.GetEventQueueStats(qstats);
+
+	root["status"] = "OK";
+	root["title"] = "GetEventStats";
+	root["QueueSize"] = qstats.QueueSize;
+	root["MaxQueueSize"] = qstats.MaxQueueSize;
+	root["Queued"] = (Json::UInt64)qstats.TotalQueued;
+	root["Coalesced"] = (Json::UInt64)qstats.TotalCoalesced;
+	root["Dropped"] = (Json::UInt64)qstats.TotalDropped;
+	root["OldestAge"] = (int)qstats.OldestAge;
+	root["AvgQueueAge"] = (int)qstats.AvgQueueAge;
+	root["MaxQueueAge"] = (int)qstats.MaxQueueAge;
+	int ii = 0;
+	std::vector<CEventSystem::_tEventStats>::const_iterator itt;
+	for (itt = estats.begin(); itt != estats.end(); ++itt)
+	{
+		root["result"][ii]["Name"] = itt->Name;
+		root["result"][ii]["Type"] = itt->Type;
+		root["result"][ii]["Count"] = (Json::UInt64)itt->Count;
+		root["result"][ii]["Skipped"] = (Json::UInt64)itt->Skipped;
+		root["result"][ii]["AvgTime"] = (itt->Count > 0) ? (int)(itt->TotalTime / itt->Count) : 0;
+		root["result"][ii]["MaxTime"] = (int)itt->MaxTime;
+		root["result"][ii]["TotalTime"] = (Json::Int64)itt->TotalTime;
+		ii++;
+	}
+}
+
 //Plan Functions
 void CWebServer::Cmd_AddPlan(Json::Value &root)
 {
-	if (m_pWebEm->m_actualuser_rights != 2)
+	if (m_pWebEm->Context().m_actualuser_rights != 2)
 	{
 		//No admin user, and not allowed to be here
 		return;
@@ -2043,7 +2575,7 @@ void CWebServer::Cmd_AddPlan(Json::Value &root)
 
 void CWebServer::Cmd_UpdatePlan(Json::Value &root)
 {
-	if (m_pWebEm->m_actualuser_rights != 2)
+	if (m_pWebEm->Context().m_actualuser_rights != 2)
 	{
 		//No admin user, and not allowed to be here
 		return;
@@ -2072,7 +2604,7 @@ void CWebServer::Cmd_UpdatePlan(Json::Value &root)
 
 void CWebServer::Cmd_DeletePlan(Json::Value &root)
 {
-	if (m_pWebEm->m_actualuser_rights != 2)
+	if (m_pWebEm->Context().m_actualuser_rights != 2)
 	{
 		//No admin user, and not allowed to be here
 		return;
@@ -2172,7 +2704,7 @@ void CWebServer::Cmd_GetUnusedPlanDevices(Json::Value &root)
 
 void CWebServer::Cmd_AddPlanActiveDevice(Json::Value &root)
 {
-	if (m_pWebEm->m_actualuser_rights != 2)
+	if (m_pWebEm->Context().m_actualuser_rights != 2)
 	{
 		//No admin user, and not allowed to be here
 		return;
@@ -2273,7 +2805,7 @@ void CWebServer::Cmd_GetPlanDevices(Json::Value &root)
 
 void CWebServer::Cmd_DeletePlanDevice(Json::Value &root)
 {
-	if (m_pWebEm->m_actualuser_rights != 2)
+	if (m_pWebEm->Context().m_actualuser_rights != 2)
 	{
 		//No admin user, and not allowed to be here
 		return;
@@ -2309,7 +2841,7 @@ void CWebServer::Cmd_SetPlanDeviceCoords(Json::Value &root)
 
 void CWebServer::Cmd_DeleteAllPlanDevices(Json::Value &root)
 {
-	if (m_pWebEm->m_actualuser_rights != 2)
+	if (m_pWebEm->Context().m_actualuser_rights != 2)
 	{
 		//No admin user, and not allowed to be here
 		return;
@@ -2453,8 +2985,8 @@ void CWebServer::Cmd_GetAuth(Json::Value &root)
 {
 	root["status"] = "OK";
 	root["title"] = "GetAuth";
-	root["user"] = m_pWebEm->m_actualuser;
-	root["rights"] = m_pWebEm->m_actualuser_rights;
+	root["user"] = m_pWebEm->Context().m_actualuser;
+	root["rights"] = m_pWebEm->Context().m_actualuser_rights;
 
 	int nValue = 0;
 	m_sql.GetPreferencesVar("DashboardType", nValue);
@@ -2541,13 +3073,13 @@ void CWebServer::Cmd_GetActiveTabs(Json::Value &root)
 	root["status"] = "OK";
 	root["title"] = "GetActiveTabs";
 
-	bool bHaveUser = (m_pWebEm->m_actualuser != "");
+	bool bHaveUser = (m_pWebEm->Context().m_actualuser != "");
 	int urights = 3;
 	unsigned long UserID = 0;
 	if (bHaveUser)
 	{
 		int iUser = -1;
-		iUser = FindUser(m_pWebEm->m_actualuser.c_str());
+		iUser = FindUser(m_pWebEm->Context().m_actualuser.c_str());
 		if (iUser != -1)
 		{
 			urights = (int)m_users[iUser].userrights;
@@ -2784,11 +3316,11 @@ void CWebServer::Cmd_UpdateDevice(Json::Value &root)
 	if ((idtype == pTypeThermostat) && (idsubtype == sTypeThermSetpoint))
 	{
 		int urights = 3;
-		bool bHaveUser = (m_pWebEm->m_actualuser != "");
+		bool bHaveUser = (m_pWebEm->Context().m_actualuser != "");
 		if (bHaveUser)
 		{
 			int iUser = -1;
-			iUser = FindUser(m_pWebEm->m_actualuser.c_str());
+			iUser = FindUser(m_pWebEm->Context().m_actualuser.c_str());
 			if (iUser != -1)
 			{
 				urights = (int)m_users[iUser].userrights;
@@ -2814,11 +3346,11 @@ void CWebServer::Cmd_SetThermostatState(Json::Value &root)
 	int iState = atoi(sstate.c_str());
 
 	int urights = 3;
-	bool bHaveUser = (m_pWebEm->m_actualuser != "");
+	bool bHaveUser = (m_pWebEm->Context().m_actualuser != "");
 	if (bHaveUser)
 	{
 		int iUser = -1;
-		iUser = FindUser(m_pWebEm->m_actualuser.c_str());
+		iUser = FindUser(m_pWebEm->Context().m_actualuser.c_str());
 		if (iUser != -1)
 		{
 			urights = (int)m_users[iUser].userrights;
@@ -2996,12 +3528,12 @@ void CWebServer::Cmd_GetCosts(Json::Value &root)
 
 void CWebServer::Cmd_CheckForUpdate(Json::Value &root)
 {
-	bool bHaveUser = (m_pWebEm->m_actualuser != "");
+	bool bHaveUser = (m_pWebEm->Context().m_actualuser != "");
 	int urights = 3;
 	if (bHaveUser)
 	{
 		int iUser = -1;
-		iUser = FindUser(m_pWebEm->m_actualuser.c_str());
+		iUser = FindUser(m_pWebEm->Context().m_actualuser.c_str());
 		if (iUser != -1)
 			urights = (int)m_users[iUser].userrights;
 	}
@@ -3185,11 +3717,11 @@ void CWebServer::HandleCommand(const std::string &cparam, Json::Value &root)
 	std::vector<std::vector<std::string> > result2;
 	char szTmp[300];
 
-	bool bHaveUser=(m_pWebEm->m_actualuser!="");
+	bool bHaveUser=(m_pWebEm->Context().m_actualuser!="");
 	int iUser=-1;
 	if (bHaveUser)
 	{
-		iUser=FindUser(m_pWebEm->m_actualuser.c_str());
+		iUser=FindUser(m_pWebEm->Context().m_actualuser.c_str());
 	}
 
 	if (cparam=="deleteallsubdevices")
@@ -5242,12 +5774,12 @@ void CWebServer::HandleCommand(const std::string &cparam, Json::Value &root)
 	}
 	else if (cparam=="adduser")
 	{
-		bool bHaveUser=(m_pWebEm->m_actualuser!="");
+		bool bHaveUser=(m_pWebEm->Context().m_actualuser!="");
 		int urights=3;
 		if (bHaveUser)
 		{
 			int iUser=-1;
-			iUser=FindUser(m_pWebEm->m_actualuser.c_str());
+			iUser=FindUser(m_pWebEm->Context().m_actualuser.c_str());
 			if (iUser!=-1)
 				urights=(int)m_users[iUser].userrights;
 		}
@@ -5290,16 +5822,16 @@ void CWebServer::HandleCommand(const std::string &cparam, Json::Value &root)
 			atoi(sTabsEnabled.c_str())
 			);
 		result=m_sql.query(szTmp);
-		LoadUsers();
+		SetReloadUsers();
 	}
 	else if (cparam=="updateuser")
 	{
-		bool bHaveUser=(m_pWebEm->m_actualuser!="");
+		bool bHaveUser=(m_pWebEm->Context().m_actualuser!="");
 		int urights=3;
 		if (bHaveUser)
 		{
 			int iUser=-1;
-			iUser=FindUser(m_pWebEm->m_actualuser.c_str());
+			iUser=FindUser(m_pWebEm->Context().m_actualuser.c_str());
 			if (iUser!=-1)
 				urights=(int)m_users[iUser].userrights;
 		}
@@ -5348,16 +5880,16 @@ void CWebServer::HandleCommand(const std::string &cparam, Json::Value &root)
 			idx.c_str()
 			);
 		result=m_sql.query(szTmp);
-		LoadUsers();
+		SetReloadUsers();
 	}
 	else if (cparam=="deleteuser")
 	{
-		bool bHaveUser=(m_pWebEm->m_actualuser!="");
+		bool bHaveUser=(m_pWebEm->Context().m_actualuser!="");
 		int urights=3;
 		if (bHaveUser)
 		{
 			int iUser=-1;
-			iUser=FindUser(m_pWebEm->m_actualuser.c_str());
+			iUser=FindUser(m_pWebEm->Context().m_actualuser.c_str());
 			if (iUser!=-1)
 				urights=(int)m_users[iUser].userrights;
 		}
@@ -5378,7 +5910,7 @@ void CWebServer::HandleCommand(const std::string &cparam, Json::Value &root)
 		szQuery << "DELETE FROM SharedDevices WHERE (SharedUserID == " << idx << ")";
 		result=m_sql.query(szQuery.str()); //-V519
 
-		LoadUsers();
+		SetReloadUsers();
 	}
 	else if (cparam=="clearlightlog")
 	{
@@ -5425,12 +5957,14 @@ void CWebServer::HandleCommand(const std::string &cparam, Json::Value &root)
 	}
 	else if (cparam=="learnsw")
 	{
-		m_sql.m_LastSwitchID="";
+		m_sql.ClearLastSwitch();
+		std::string LastSwitchID;
+		unsigned long long LastSwitchRowID=0;
 		bool bReceivedSwitch=false;
 		unsigned char cntr=0;
 		while ((!bReceivedSwitch)&&(cntr<50))	//wait for max. 5 seconds
 		{
-			if (m_sql.m_LastSwitchID!="")
+			if (m_sql.GetLastSwitch(LastSwitchID,LastSwitchRowID))
 			{
 				bReceivedSwitch=true;
 				break;
@@ -5447,14 +5981,15 @@ void CWebServer::HandleCommand(const std::string &cparam, Json::Value &root)
 			//check if used
 			szQuery.clear();
 			szQuery.str("");
-			szQuery << "SELECT Name, Used, nValue FROM DeviceStatus WHERE (ID==" << m_sql.m_LastSwitchRowID << ")";
+			m_sql.FlushWriteQueue(LastSwitchRowID);
+			szQuery << "SELECT Name, Used, nValue FROM DeviceStatus WHERE (ID==" << LastSwitchRowID << ")";
 			result=m_sql.query(szQuery.str());
 			if (result.size()>0)
 			{
 				root["status"]="OK";
 				root["title"]="LearnSW";
-				root["ID"]=m_sql.m_LastSwitchID;
-				root["idx"]=m_sql.m_LastSwitchRowID;
+				root["ID"]=LastSwitchID;
+				root["idx"]=LastSwitchRowID;
 				root["Name"]=result[0][0];
 				root["Used"]=atoi(result[0][1].c_str());
 				root["Cmd"]=atoi(result[0][2].c_str());
@@ -5501,7 +6036,7 @@ void CWebServer::HandleCommand(const std::string &cparam, Json::Value &root)
 		if (bHaveUser)
 		{
 			int iUser=-1;
-			iUser=FindUser(m_pWebEm->m_actualuser.c_str());
+			iUser=FindUser(m_pWebEm->Context().m_actualuser.c_str());
 			if (iUser != -1)
 			{
 				urights = (int)m_users[iUser].userrights;
@@ -5536,6 +6071,7 @@ void CWebServer::HandleCommand(const std::string &cparam, Json::Value &root)
 
 			szQuery.clear();
 			szQuery.str("");
+			m_sql.FlushWriteQueue(strtoull(idx.c_str(),NULL,10));
 			szQuery << "UPDATE DeviceStatus SET nValue=" << nValue << " WHERE (ID == " << idx << ")";
 			result=m_sql.query(szQuery.str());
 			if (result.size()>0) {
@@ -5574,7 +6110,7 @@ void CWebServer::HandleCommand(const std::string &cparam, Json::Value &root)
 		if (bHaveUser)
 		{
 			int iUser=-1;
-			iUser=FindUser(m_pWebEm->m_actualuser.c_str());
+			iUser=FindUser(m_pWebEm->Context().m_actualuser.c_str());
 			if (iUser != -1)
 			{
 				urights = (int)m_users[iUser].userrights;
@@ -5624,7 +6160,7 @@ void CWebServer::HandleCommand(const std::string &cparam, Json::Value &root)
 		if (bHaveUser)
 		{
 			int iUser=-1;
-			iUser=FindUser(m_pWebEm->m_actualuser.c_str());
+			iUser=FindUser(m_pWebEm->Context().m_actualuser.c_str());
 			if (iUser != -1)
 			{
 				urights = (int)m_users[iUser].userrights;
@@ -5670,7 +6206,7 @@ void CWebServer::HandleCommand(const std::string &cparam, Json::Value &root)
 		if (bHaveUser)
 		{
 			int iUser=-1;
-			iUser=FindUser(m_pWebEm->m_actualuser.c_str());
+			iUser=FindUser(m_pWebEm->Context().m_actualuser.c_str());
 			if (iUser!=-1)
 				urights=(int)m_users[iUser].userrights;
 		}
@@ -6014,12 +6550,12 @@ void CWebServer::HandleCommand(const std::string &cparam, Json::Value &root)
 	}
 	else if (cparam == "addfloorplan")
 	{
-		bool bHaveUser=(m_pWebEm->m_actualuser!="");
+		bool bHaveUser=(m_pWebEm->Context().m_actualuser!="");
 		int urights=3;
 		if (bHaveUser)
 		{
 			int iUser=-1;
-			iUser=FindUser(m_pWebEm->m_actualuser.c_str());
+			iUser=FindUser(m_pWebEm->Context().m_actualuser.c_str());
 			if (iUser!=-1)
 				urights=(int)m_users[iUser].userrights;
 		}
@@ -6046,12 +6582,12 @@ void CWebServer::HandleCommand(const std::string &cparam, Json::Value &root)
 	}
 	else if (cparam=="updatefloorplan")
 	{
-		bool bHaveUser=(m_pWebEm->m_actualuser!="");
+		bool bHaveUser=(m_pWebEm->Context().m_actualuser!="");
 		int urights=3;
 		if (bHaveUser)
 		{
 			int iUser=-1;
-			iUser=FindUser(m_pWebEm->m_actualuser.c_str());
+			iUser=FindUser(m_pWebEm->Context().m_actualuser.c_str());
 			if (iUser!=-1)
 				urights=(int)m_users[iUser].userrights;
 		}
@@ -6083,12 +6619,12 @@ void CWebServer::HandleCommand(const std::string &cparam, Json::Value &root)
 	}
 	else if (cparam=="deletefloorplan")
 	{
-		bool bHaveUser=(m_pWebEm->m_actualuser!="");
+		bool bHaveUser=(m_pWebEm->Context().m_actualuser!="");
 		int urights=3;
 		if (bHaveUser)
 		{
 			int iUser=-1;
-			iUser=FindUser(m_pWebEm->m_actualuser.c_str());
+			iUser=FindUser(m_pWebEm->Context().m_actualuser.c_str());
 			if (iUser!=-1)
 				urights=(int)m_users[iUser].userrights;
 		}
@@ -6230,12 +6766,12 @@ void CWebServer::HandleCommand(const std::string &cparam, Json::Value &root)
 	}
 	else if (cparam=="addfloorplanplan")
 	{
-		bool bHaveUser=(m_pWebEm->m_actualuser!="");
+		bool bHaveUser=(m_pWebEm->Context().m_actualuser!="");
 		int urights=3;
 		if (bHaveUser)
 		{
 			int iUser=-1;
-			iUser=FindUser(m_pWebEm->m_actualuser.c_str());
+			iUser=FindUser(m_pWebEm->Context().m_actualuser.c_str());
 			if (iUser!=-1)
 				urights=(int)m_users[iUser].userrights;
 		}
@@ -6262,12 +6798,12 @@ void CWebServer::HandleCommand(const std::string &cparam, Json::Value &root)
 	}
 	else if (cparam=="updatefloorplanplan")
 	{
-		bool bHaveUser=(m_pWebEm->m_actualuser!="");
+		bool bHaveUser=(m_pWebEm->Context().m_actualuser!="");
 		int urights=3;
 		if (bHaveUser)
 		{
 			int iUser=-1;
-			iUser=FindUser(m_pWebEm->m_actualuser.c_str());
+			iUser=FindUser(m_pWebEm->Context().m_actualuser.c_str());
 			if (iUser!=-1)
 				urights=(int)m_users[iUser].userrights;
 		}
@@ -6291,12 +6827,12 @@ void CWebServer::HandleCommand(const std::string &cparam, Json::Value &root)
 	}
 	else if (cparam=="deletefloorplanplan")
 	{
-		bool bHaveUser=(m_pWebEm->m_actualuser!="");
+		bool bHaveUser=(m_pWebEm->Context().m_actualuser!="");
 		int urights=3;
 		if (bHaveUser)
 		{
 			int iUser=-1;
-			iUser=FindUser(m_pWebEm->m_actualuser.c_str());
+			iUser=FindUser(m_pWebEm->Context().m_actualuser.c_str());
 			if (iUser!=-1)
 				urights=(int)m_users[iUser].userrights;
 		}
@@ -6323,9 +6859,17 @@ void CWebServer::HandleCommand(const std::string &cparam, Json::Value &root)
 	}
 }
 
+std::string &CWebServer::GetRetStr()
+{
+	if (m_pRetStr.get()==NULL)
+		m_pRetStr.reset(new std::string());
+	return *m_pRetStr;
+}
+
 char * CWebServer::DisplaySwitchTypesCombo()
 {
-	m_retstr="";
+	std::string &retstr=GetRetStr();
+	retstr="";
 	char szTmp[200];
 
 	std::map<std::string,int> _switchtypes;
@@ -6339,27 +6883,29 @@ char * CWebServer::DisplaySwitchTypesCombo()
 	for (itt=_switchtypes.begin(); itt!=_switchtypes.end(); ++itt)
 	{
 		sprintf(szTmp,"<option value=\"%d\">%s</option>\n",itt->second,itt->first.c_str());
-		m_retstr+=szTmp;
+		retstr+=szTmp;
 
 	}
-	return (char*)m_retstr.c_str();
+	return (char*)retstr.c_str();
 }
 
 char * CWebServer::DisplayMeterTypesCombo()
 {
-	m_retstr="";
+	std::string &retstr=GetRetStr();
+	retstr="";
 	char szTmp[200];
 	for (int ii=0; ii<MTYPE_END; ii++)
 	{
 		sprintf(szTmp,"<option value=\"%d\">%s</option>\n",ii,Meter_Type_Desc((_eMeterType)ii));
-		m_retstr+=szTmp;
+		retstr+=szTmp;
 	}
-	return (char*)m_retstr.c_str();
+	return (char*)retstr.c_str();
 }
 
 char * CWebServer::DisplayLanguageCombo()
 {
-	m_retstr="";
+	std::string &retstr=GetRetStr();
+	retstr="";
 	//return a sorted list
 	std::map<std::string,std::string> _ltypes;
 	std::map<std::string,std::string>::const_iterator itt;
@@ -6373,16 +6919,17 @@ char * CWebServer::DisplayLanguageCombo()
 	for (itt=_ltypes.begin(); itt!=_ltypes.end(); ++itt)
 	{
 		sprintf(szTmp, "<option value=\"%s\">%s</option>\n", itt->second.c_str(), itt->first.c_str());
-		m_retstr+=szTmp;
+		retstr+=szTmp;
 
 	}
 
-	return (char*)m_retstr.c_str();
+	return (char*)retstr.c_str();
 }
 
 char * CWebServer::DisplayHardwareTypesCombo()
 {
-	m_retstr="";
+	std::string &retstr=GetRetStr();
+	retstr="";
 	std::map<std::string,int> _htypes;
 	char szTmp[200];
 	for (int ii=0; ii<HTYPE_END; ii++)
@@ -6434,26 +6981,101 @@ char * CWebServer::DisplayHardwareTypesCombo()
 	for (itt=_htypes.begin(); itt!=_htypes.end(); ++itt)
 	{
 		sprintf(szTmp,"<option value=\"%d\">%s</option>\n",itt->second,itt->first.c_str());
-		m_retstr+=szTmp;
+		retstr+=szTmp;
 
 	}
-	return (char*)m_retstr.c_str();
+	return (char*)retstr.c_str();
 }
 
 char * CWebServer::DisplayTimerTypesCombo()
 {
-	m_retstr="";
+	std::string &retstr=GetRetStr();
+	retstr="";
 	char szTmp[200];
 	for (int ii=0; ii<TTYPE_END; ii++)
 	{
 		sprintf(szTmp, "<option data-i18n=\"%s\" value=\"%d\">%s</option>\n", Timer_Type_Desc(ii),ii,Timer_Type_Desc(ii));
-		m_retstr+=szTmp;
+		retstr+=szTmp;
+	}
+	return (char*)retstr.c_str();
+}
+
+static void LoadTestClient(void *session, const std::string url, const int nRequests, std::vector<long> *pLatencies, int *pErrors)
+{
+	std::vector<unsigned char> response;
+	for (int ii=0; ii<nRequests; ii++)
+	{
+		boost::posix_time::ptime tstart=boost::posix_time::microsec_clock::universal_time();
+		response.clear();
+		if ((!HTTPClient::GETSession(session,url,response))||(response.empty()))
+			(*pErrors)++;
+		pLatencies->push_back((long)(boost::posix_time::microsec_clock::universal_time()-tstart).total_milliseconds());
+	}
+}
+
+void CWebServer::LoadTest(const std::string &url, const int nClients, const int nRequests)
+{
+	std::vector<void*> sessions;
+	std::vector<std::vector<long> > latencies(nClients);
+	std::vector<int> errors(nClients,0);
+	//every client keeps its connection open, like a browser
+	for (int ii=0; ii<nClients; ii++)
+	{
+		void *session=HTTPClient::CreateSession();
+		if (session==NULL)
+		{
+			_log.Log(LOG_ERROR,"Load test: could not create a http session");
+			break;
+		}
+		sessions.push_back(session);
+	}
+	boost::posix_time::ptime tstart=boost::posix_time::microsec_clock::universal_time();
+	std::vector<boost::shared_ptr<boost::thread> > threads;
+	for (size_t ii=0; ii<sessions.size(); ii++)
+		threads.push_back(boost::shared_ptr<boost::thread>(new boost::thread(boost::bind(&LoadTestClient, sessions[ii], url, nRequests, &latencies[ii], &errors[ii]))));
+	for (size_t ii=0; ii<threads.size(); ii++)
+		threads[ii]->join();
+	long elapsed=(long)(boost::posix_time::microsec_clock::universal_time()-tstart).total_milliseconds();
+	for (size_t ii=0; ii<sessions.size(); ii++)
+		HTTPClient::DestroySession(sessions[ii]);
+
+	std::vector<long> all;
+	int totalerrors=0;
+	for (size_t ii=0; ii<sessions.size(); ii++)
+	{
+		all.insert(all.end(),latencies[ii].begin(),latencies[ii].end());
+		totalerrors+=errors[ii];
 	}
-	return (char*)m_retstr.c_str();
+	if (all.empty())
+		return;
+	std::sort(all.begin(),all.end());
+	long long total=0;
+	std::vector<long>::const_iterator itt;
+	for (itt=all.begin(); itt!=all.end(); ++itt)
+		total+=*itt;
+	_log.Log(LOG_STATUS,"Load test: %d clients, %d requests (%d failed) in %ld ms, %.1f requests/sec",
+		(int)sessions.size(),(int)all.size(),totalerrors,elapsed,(elapsed>0)?(all.size()*1000.0/elapsed):0.0);
+	_log.Log(LOG_STATUS,"Load test: latency avg %ld ms, p99 %ld ms, max %ld ms",
+		(long)(total/all.size()),all[(all.size()*99)/100],all[all.size()-1]);
+}
+
+void CWebServer::SetReloadUsers()
+{
+	boost::lock_guard<boost::mutex> l(m_reloadusersmutex);
+	m_bReloadUsers=true;
+}
+
+bool CWebServer::TestAndClearReloadUsers()
+{
+	boost::lock_guard<boost::mutex> l(m_reloadusersmutex);
+	bool bReload=m_bReloadUsers;
+	m_bReloadUsers=false;
+	return bReload;
 }
 
 void CWebServer::LoadUsers()
 {
+	boost::unique_lock<boost::shared_mutex> l(m_usersmutex);
 	ClearUserPasswords();
 	std::string WebUserName,WebPassword;
 	int nValue=0;
@@ -6541,12 +7163,13 @@ bool CWebServer::FindAdminUser()
 
 char * CWebServer::PostSettings()
 {
-	m_retstr="/index.html";
+	std::string &retstr=GetRetStr();
+	retstr="/index.html";
 
-	if (m_pWebEm->m_actualuser_rights != 2)
+	if (m_pWebEm->Context().m_actualuser_rights != 2)
 	{
 		//No admin user, and not allowed to be here
-		return (char*)m_retstr.c_str();
+		return (char*)retstr.c_str();
 	}
 
 	std::string Latitude=m_pWebEm->FindValue("Latitude");
@@ -6572,13 +7195,9 @@ char * CWebServer::PostSettings()
 
 	int nUnit=atoi(m_pWebEm->FindValue("WindUnit").c_str());
 	m_sql.UpdatePreferencesVar("WindUnit",nUnit);
-	m_sql.m_windunit=(_eWindUnit)nUnit;
 
 	nUnit=atoi(m_pWebEm->FindValue("TempUnit").c_str());
 	m_sql.UpdatePreferencesVar("TempUnit",nUnit);
-	m_sql.m_tempunit=(_eTempUnit)nUnit;
-
-	m_sql.SetUnitsAndScale();
 
 	std::string AuthenticationMethod=m_pWebEm->FindValue("AuthenticationMethod");
 	_eAuthenticationMethod amethod=(_eAuthenticationMethod)atoi(AuthenticationMethod.c_str());
@@ -6631,10 +7250,10 @@ char * CWebServer::PostSettings()
 	//add local hostname
 	m_pWebEm->AddLocalNetworks("");
 
-	if (m_pWebEm->m_actualuser == "")
+	if (m_pWebEm->Context().m_actualuser == "")
 	{
 		//Local network could be changed so lets for a check here
-		m_pWebEm->m_actualuser_rights = -1;
+		m_pWebEm->Context().m_actualuser_rights = -1;
 	}
 
 	std::string SecPassword=m_pWebEm->FindValue("SecPassword");
@@ -6692,7 +7311,6 @@ char * CWebServer::PostSettings()
 	if (rnOldvalue!=rnvalue)
 	{
 		m_sql.UpdatePreferencesVar("ActiveTimerPlan",rnvalue);
-		m_sql.m_ActiveTimerPlan=rnvalue;
 		m_mainworker.m_scheduler.ReloadSchedules();
 	}
 	m_sql.UpdatePreferencesVar("DoorbellCommand",atoi(m_pWebEm->FindValue("DoorbellCommand").c_str()));
@@ -6740,7 +7358,6 @@ char * CWebServer::PostSettings()
 	std::string DisableEventScriptSystem = m_pWebEm->FindValue("DisableEventScriptSystem");
 	int iDisableEventScriptSystem = (DisableEventScriptSystem == "on" ? 1 : 0);
 	m_sql.UpdatePreferencesVar("DisableEventScriptSystem", iDisableEventScriptSystem);
-	m_sql.m_bDisableEventSystem = (iDisableEventScriptSystem == 1);
 	if (iDisableEventScriptSystem != rnOldvalue)
 	{
 		m_mainworker.m_eventsystem.SetEnabled(!m_sql.m_bDisableEventSystem);
@@ -6750,7 +7367,6 @@ char * CWebServer::PostSettings()
 	std::string EnableWidgetOrdering=m_pWebEm->FindValue("AllowWidgetOrdering");
 	int iEnableAllowWidgetOrdering=(EnableWidgetOrdering=="on"?1:0);
 	m_sql.UpdatePreferencesVar("AllowWidgetOrdering",iEnableAllowWidgetOrdering);
-	m_sql.m_bAllowWidgetOrdering=(iEnableAllowWidgetOrdering==1);
 
 	rnOldvalue=0;
 	m_sql.GetPreferencesVar("RemoteSharedPort", rnOldvalue);
@@ -6800,21 +7416,22 @@ char * CWebServer::PostSettings()
 	m_sql.UpdatePreferencesVar("FloorplanInactiveOpacity",atoi(m_pWebEm->FindValue("FloorplanInactiveOpacity").c_str()));
 	
 	
-	return (char*)m_retstr.c_str();
+	return (char*)retstr.c_str();
 }
 
 char * CWebServer::SMASpotImportOldData()
 {
-	m_retstr = "/index.html";
-	if (m_pWebEm->m_actualuser_rights != 2)
+	std::string &retstr=GetRetStr();
+	retstr = "/index.html";
+	if (m_pWebEm->Context().m_actualuser_rights != 2)
 	{
 		//No admin user, and not allowed to be here
-		return (char*)m_retstr.c_str();
+		return (char*)retstr.c_str();
 	}
 
 	std::string idx = m_pWebEm->FindValue("idx");
 	if (idx == "") {
-		return (char*)m_retstr.c_str();
+		return (char*)retstr.c_str();
 	}
 	int hardwareID = atoi(idx.c_str());
 	CDomoticzHardwareBase *pHardware = m_mainworker.GetHardware(hardwareID);
@@ -6826,21 +7443,22 @@ char * CWebServer::SMASpotImportOldData()
 			pSMASpot->ImportOldMonthData();
 		}
 	}
-	return (char*)m_retstr.c_str();
+	return (char*)retstr.c_str();
 }
 
 char * CWebServer::SetOpenThermSettings()
 {
-	m_retstr = "/index.html";
-	if (m_pWebEm->m_actualuser_rights != 2)
+	std::string &retstr=GetRetStr();
+	retstr = "/index.html";
+	if (m_pWebEm->Context().m_actualuser_rights != 2)
 	{
 		//No admin user, and not allowed to be here
-		return (char*)m_retstr.c_str();
+		return (char*)retstr.c_str();
 	}
 
 	std::string idx=m_pWebEm->FindValue("idx");
 	if (idx=="") {
-		return (char*)m_retstr.c_str();
+		return (char*)retstr.c_str();
 	}
 	std::vector<std::vector<std::string> > result;
 	std::stringstream szQuery;
@@ -6850,7 +7468,7 @@ char * CWebServer::SetOpenThermSettings()
 	szQuery << "SELECT Mode1, Mode2, Mode3, Mode4, Mode5 FROM Hardware WHERE (ID=" << idx << ")";
 	result=m_sql.query(szQuery.str());
 	if (result.size()<1)
-		return (char*)m_retstr.c_str();
+		return (char*)retstr.c_str();
 
 
 	int currentMode1=atoi(result[0][0].c_str());
@@ -6864,22 +7482,23 @@ char * CWebServer::SetOpenThermSettings()
 		m_mainworker.RestartHardware(idx);
 	}
 
-	return (char*)m_retstr.c_str();
+	return (char*)retstr.c_str();
 }
 
 char * CWebServer::SetRFXCOMMode()
 {
-	m_retstr = "/index.html";
+	std::string &retstr=GetRetStr();
+	retstr = "/index.html";
 
-	if (m_pWebEm->m_actualuser_rights != 2)
+	if (m_pWebEm->Context().m_actualuser_rights != 2)
 	{
 		//No admin user, and not allowed to be here
-		return (char*)m_retstr.c_str();
+		return (char*)retstr.c_str();
 	}
 
 	std::string idx=m_pWebEm->FindValue("idx");
 	if (idx=="") {
-		return (char*)m_retstr.c_str();
+		return (char*)retstr.c_str();
 	}
 	std::vector<std::vector<std::string> > result;
 	std::stringstream szQuery;
@@ -6889,7 +7508,7 @@ char * CWebServer::SetRFXCOMMode()
 	szQuery << "SELECT Mode1, Mode2, Mode3, Mode4, Mode5 FROM Hardware WHERE (ID=" << idx << ")";
 	result=m_sql.query(szQuery.str());
 	if (result.size()<1)
-		return (char*)m_retstr.c_str();
+		return (char*)retstr.c_str();
 
 	unsigned char Mode1=atoi(result[0][0].c_str());
 	unsigned char Mode2=atoi(result[0][1].c_str());
@@ -6931,22 +7550,23 @@ char * CWebServer::SetRFXCOMMode()
 
 	m_mainworker.SetRFXCOMHardwaremodes(atoi(idx.c_str()),Response.ICMND.msg1,Response.ICMND.msg2,Response.ICMND.msg3,Response.ICMND.msg4,Response.ICMND.msg5);
 
-	return (char*)m_retstr.c_str();
+	return (char*)retstr.c_str();
 }
 
 
 char * CWebServer::SetRego6XXType()
 {
-	m_retstr = "/index.html";
-	if (m_pWebEm->m_actualuser_rights != 2)
+	std::string &retstr=GetRetStr();
+	retstr = "/index.html";
+	if (m_pWebEm->Context().m_actualuser_rights != 2)
 	{
 		//No admin user, and not allowed to be here
-		return (char*)m_retstr.c_str();
+		return (char*)retstr.c_str();
 	}
 
 	std::string idx=m_pWebEm->FindValue("idx");
 	if (idx=="") {
-		return (char*)m_retstr.c_str();
+		return (char*)retstr.c_str();
 	}
 	std::vector<std::vector<std::string> > result;
 	std::stringstream szQuery;
@@ -6956,7 +7576,7 @@ char * CWebServer::SetRego6XXType()
 	szQuery << "SELECT Mode1, Mode2, Mode3, Mode4, Mode5 FROM Hardware WHERE (ID=" << idx << ")";
 	result=m_sql.query(szQuery.str());
 	if (result.size()<1)
-		return (char*)m_retstr.c_str();
+		return (char*)retstr.c_str();
 
     unsigned char currentMode1=atoi(result[0][0].c_str());
 
@@ -6968,39 +7588,41 @@ char * CWebServer::SetRego6XXType()
         m_sql.UpdateRFXCOMHardwareDetails(atoi(idx.c_str()), newMode1, 0, 0, 0, 0);
     }
 	
-	return (char*)m_retstr.c_str();
+	return (char*)retstr.c_str();
 }
 
 char * CWebServer::RestoreDatabase()
 {
-	m_retstr = "/index.html";
-	if (m_pWebEm->m_actualuser_rights != 2)
+	std::string &retstr=GetRetStr();
+	retstr = "/index.html";
+	if (m_pWebEm->Context().m_actualuser_rights != 2)
 	{
 		//No admin user, and not allowed to be here
-		return (char*)m_retstr.c_str();
+		return (char*)retstr.c_str();
 	}
 
 	std::string dbasefile=m_pWebEm->FindValue("dbasefile");
 	if (dbasefile=="") {
-		return (char*)m_retstr.c_str();
+		return (char*)retstr.c_str();
 	}
 	if (!m_sql.RestoreDatabase(dbasefile))
-		return (char*)m_retstr.c_str();
-	return (char*)m_retstr.c_str();
+		return (char*)retstr.c_str();
+	return (char*)retstr.c_str();
 }
 
 char * CWebServer::SetP1USBType()
 {
-	m_retstr = "/index.html";
-	if (m_pWebEm->m_actualuser_rights != 2)
+	std::string &retstr=GetRetStr();
+	retstr = "/index.html";
+	if (m_pWebEm->Context().m_actualuser_rights != 2)
 	{
 		//No admin user, and not allowed to be here
-		return (char*)m_retstr.c_str();
+		return (char*)retstr.c_str();
 	}
 
 	std::string idx=m_pWebEm->FindValue("idx");
 	if (idx=="") {
-		return (char*)m_retstr.c_str();
+		return (char*)retstr.c_str();
 	}
 
 	std::vector<std::vector<std::string> > result;
@@ -7011,7 +7633,7 @@ char * CWebServer::SetP1USBType()
 	szQuery << "SELECT Mode1, Mode2, Mode3, Mode4, Mode5 FROM Hardware WHERE (ID=" << idx << ")";
 	result=m_sql.query(szQuery.str());
 	if (result.size()<1)
-		return (char*)m_retstr.c_str();
+		return (char*)retstr.c_str();
 
 	int Mode1=atoi(m_pWebEm->FindValue("P1Baudrate").c_str());
 	int Mode2=0;
@@ -7022,21 +7644,22 @@ char * CWebServer::SetP1USBType()
 
 	m_mainworker.RestartHardware(idx);
 
-	return (char*)m_retstr.c_str();
+	return (char*)retstr.c_str();
 }
 
 char * CWebServer::SetS0MeterType()
 {
-	m_retstr = "/index.html";
-	if (m_pWebEm->m_actualuser_rights != 2)
+	std::string &retstr=GetRetStr();
+	retstr = "/index.html";
+	if (m_pWebEm->Context().m_actualuser_rights != 2)
 	{
 		//No admin user, and not allowed to be here
-		return (char*)m_retstr.c_str();
+		return (char*)retstr.c_str();
 	}
 
 	std::string idx=m_pWebEm->FindValue("idx");
 	if (idx=="") {
-		return (char*)m_retstr.c_str();
+		return (char*)retstr.c_str();
 	}
 
 	std::vector<std::vector<std::string> > result;
@@ -7047,7 +7670,7 @@ char * CWebServer::SetS0MeterType()
 	szQuery << "SELECT Mode1, Mode2, Mode3, Mode4, Mode5 FROM Hardware WHERE (ID=" << idx << ")";
 	result=m_sql.query(szQuery.str());
 	if (result.size()<1)
-		return (char*)m_retstr.c_str();
+		return (char*)retstr.c_str();
 
 	int Mode1=atoi(m_pWebEm->FindValue("S0M1Type").c_str());
 	int Mode2=atoi(m_pWebEm->FindValue("M1PulsesPerHour").c_str());
@@ -7058,20 +7681,21 @@ char * CWebServer::SetS0MeterType()
 
 	m_mainworker.RestartHardware(idx);
 
-	return (char*)m_retstr.c_str();
+	return (char*)retstr.c_str();
 }
 
 char * CWebServer::SetLimitlessType()
 {
-	m_retstr = "/index.html";
-	if (m_pWebEm->m_actualuser_rights != 2)
+	std::string &retstr=GetRetStr();
+	retstr = "/index.html";
+	if (m_pWebEm->Context().m_actualuser_rights != 2)
 	{
 		//No admin user, and not allowed to be here
-		return (char*)m_retstr.c_str();
+		return (char*)retstr.c_str();
 	}
 	std::string idx = m_pWebEm->FindValue("idx");
 	if (idx=="") {
-		return (char*)m_retstr.c_str();
+		return (char*)retstr.c_str();
 	}
 
 	std::vector<std::vector<std::string> > result;
@@ -7082,7 +7706,7 @@ char * CWebServer::SetLimitlessType()
 	szQuery << "SELECT Mode1, Mode2, Mode3, Mode4, Mode5 FROM Hardware WHERE (ID=" << idx << ")";
 	result=m_sql.query(szQuery.str());
 	if (result.size()<1)
-		return (char*)m_retstr.c_str();
+		return (char*)retstr.c_str();
 
 	int Mode1=atoi(m_pWebEm->FindValue("LimitlessType").c_str());
 	int Mode2=atoi(result[0][1].c_str());
@@ -7092,7 +7716,7 @@ char * CWebServer::SetLimitlessType()
 
 	m_mainworker.RestartHardware(idx);
 
-	return (char*)m_retstr.c_str();
+	return (char*)retstr.c_str();
 }
 
 struct _tHardwareListInt{
@@ -7100,11 +7724,35 @@ struct _tHardwareListInt{
 	bool Enabled;
 } tHardwareList;
 
-void CWebServer::GetJSonDevices(Json::Value &root, const std::string &rused, const std::string &rfilter, const std::string &order, const std::string &rowid, const std::string &planID, const std::string &floorID, const bool bDisplayHidden, const time_t LastUpdate)
+void CWebServer::GetJSonDevices(Json::Value &root, const std::string &rused, const std::string &rfilter, const std::string &order, const std::string &rowid, const std::string &planID, const std::string &floorID, const bool bDisplayHidden, const time_t LastUpdate, const std::set<unsigned long long> *pChangedDevices, const std::set<unsigned long long> *pChangedScenes)
 {
 	std::vector<std::vector<std::string> > result;
 	std::stringstream szQuery;
 
+	//When a change list is given, only these devices/scenes are returned (incremental update)
+	std::string szChangedDevices;
+	std::string szChangedScenes;
+	if (pChangedDevices!=NULL)
+	{
+		std::set<unsigned long long>::const_iterator itt;
+		for (itt=pChangedDevices->begin(); itt!=pChangedDevices->end(); ++itt)
+		{
+			if (!szChangedDevices.empty())
+				szChangedDevices+=",";
+			szChangedDevices+=boost::lexical_cast<std::string>(*itt);
+		}
+	}
+	if (pChangedScenes!=NULL)
+	{
+		std::set<unsigned long long>::const_iterator itt;
+		for (itt=pChangedScenes->begin(); itt!=pChangedScenes->end(); ++itt)
+		{
+			if (!szChangedScenes.empty())
+				szChangedScenes+=",";
+			szChangedScenes+=boost::lexical_cast<std::string>(*itt);
+		}
+	}
+
 	time_t now = mytime(NULL);
 	struct tm tm1;
 	localtime_r(&now,&tm1);
@@ -7166,12 +7814,12 @@ void CWebServer::GetJSonDevices(Json::Value &root, const std::string &rused, con
 
 	unsigned char tempsign=m_sql.m_tempsign[0];
 
-	bool bHaveUser=(m_pWebEm->m_actualuser!="");
+	bool bHaveUser=(m_pWebEm->Context().m_actualuser!="");
 	int iUser=-1;
 	unsigned int totUserDevices=0;
 	if (bHaveUser)
 	{
-		iUser=FindUser(m_pWebEm->m_actualuser.c_str());
+		iUser=FindUser(m_pWebEm->Context().m_actualuser.c_str());
 		if (iUser!=-1)
 		{
 			_eUserRights urights=m_users[iUser].userrights;
@@ -7198,6 +7846,8 @@ void CWebServer::GetJSonDevices(Json::Value &root, const std::string &rused, con
 
 		if (rowid!="")
 			szQuery << "SELECT ID, Name, nValue, LastUpdate, Favorite, SceneType, Protected, 0 as XOffset, 0 as YOffset, 0 as PlanID FROM Scenes WHERE (ID==" << rowid << ")";
+		else if (pChangedScenes!=NULL)
+			szQuery << "SELECT ID, Name, nValue, LastUpdate, Favorite, SceneType, Protected, 0 as XOffset, 0 as YOffset, 0 as PlanID FROM Scenes WHERE (ID IN (" << szChangedScenes << ")) ORDER BY " << szOrderBy;
 		else if ((planID!="")&&(planID!="0"))
 			szQuery << "SELECT A.ID, A.Name, A.nValue, A.LastUpdate, A.Favorite, A.SceneType, A.Protected, B.XOffset, B.YOffset, B.PlanID FROM Scenes as A, DeviceToPlansMap as B WHERE (B.PlanID==" << planID << ") AND (B.DeviceRowID==a.ID) AND (B.DevSceneType==1) ORDER BY B.[Order]";
 		else if ((floorID!="")&&(floorID!="0"))
@@ -7306,7 +7956,10 @@ void CWebServer::GetJSonDevices(Json::Value &root, const std::string &rused, con
 				szQuery.clear();
 				szQuery.str("");
 			}
-			szQuery << "SELECT ID, DeviceID, Unit, Name, Used, Type, SubType, SignalLevel, BatteryLevel, nValue, sValue, LastUpdate, Favorite, SwitchType, HardwareID, AddjValue, AddjMulti, AddjValue2, AddjMulti2, LastLevel, CustomImage, StrParam1, StrParam2, Protected, 0 as XOffset, 0 as YOffset, 0 as PlanID FROM DeviceStatus ORDER BY " << szOrderBy;
+			szQuery << "SELECT ID, DeviceID, Unit, Name, Used, Type, SubType, SignalLevel, BatteryLevel, nValue, sValue, LastUpdate, Favorite, SwitchType, HardwareID, AddjValue, AddjMulti, AddjValue2, AddjMulti2, LastLevel, CustomImage, StrParam1, StrParam2, Protected, 0 as XOffset, 0 as YOffset, 0 as PlanID FROM DeviceStatus ";
+			if (pChangedDevices!=NULL)
+				szQuery << "WHERE (ID IN (" << szChangedDevices << ")) ";
+			szQuery << "ORDER BY " << szOrderBy;
 		}
 	}
 	else
@@ -7346,7 +7999,10 @@ void CWebServer::GetJSonDevices(Json::Value &root, const std::string &rused, con
 			}
 			szQuery.clear();
 			szQuery.str("");
-			szQuery << "SELECT A.ID, A.DeviceID, A.Unit, A.Name, A.Used, A.Type, A.SubType, A.SignalLevel, A.BatteryLevel, A.nValue, A.sValue, A.LastUpdate, A.Favorite, A.SwitchType, A.HardwareID, A.AddjValue, A.AddjMulti, A.AddjValue2, A.AddjMulti2, A.LastLevel, A.CustomImage, A.StrParam1, A.StrParam2, A.Protected, 0 as XOffset, 0 as YOffset, 0 as PlanID FROM DeviceStatus as A, SharedDevices as B WHERE (B.DeviceRowID==a.ID) AND (B.SharedUserID==" << m_users[iUser].ID << ") ORDER BY " << szOrderBy;
+			szQuery << "SELECT A.ID, A.DeviceID, A.Unit, A.Name, A.Used, A.Type, A.SubType, A.SignalLevel, A.BatteryLevel, A.nValue, A.sValue, A.LastUpdate, A.Favorite, A.SwitchType, A.HardwareID, A.AddjValue, A.AddjMulti, A.AddjValue2, A.AddjMulti2, A.LastLevel, A.CustomImage, A.StrParam1, A.StrParam2, A.Protected, 0 as XOffset, 0 as YOffset, 0 as PlanID FROM DeviceStatus as A, SharedDevices as B WHERE (B.DeviceRowID==a.ID) AND (B.SharedUserID==" << m_users[iUser].ID << ") ";
+			if (pChangedDevices!=NULL)
+				szQuery << "AND (A.ID IN (" << szChangedDevices << ")) ";
+			szQuery << "ORDER BY " << szOrderBy;
 		}
 	}
 
@@ -9085,9 +9741,10 @@ void CWebServer::GetJSonDevices(Json::Value &root, const std::string &rused, con
 
 std::string CWebServer::GetInternalCameraSnapshot()
 {
-	m_retstr="";
+	std::string retstr;
+	retstr="";
 	std::vector<unsigned char> camimage;
-	if (m_pWebEm->m_lastRequestPath.find("raspberry")!=std::string::npos)
+	if (m_pWebEm->Context().m_lastRequestPath.find("raspberry")!=std::string::npos)
 	{
 		if (!m_mainworker.m_cameras.TakeRaspberrySnapshot(camimage))
 			goto exitproc;
@@ -9097,15 +9754,16 @@ std::string CWebServer::GetInternalCameraSnapshot()
 		if (!m_mainworker.m_cameras.TakeUVCSnapshot(camimage))
 			goto exitproc;
 	}
-	m_retstr.insert( m_retstr.begin(), camimage.begin(), camimage.end() );
-	m_pWebEm->m_outputfilename="snapshot.jpg";
+	retstr.insert( retstr.begin(), camimage.begin(), camimage.end() );
+	m_pWebEm->Context().m_outputfilename="snapshot.jpg";
 exitproc:
-	return m_retstr;
+	return retstr;
 }
 
 std::string CWebServer::GetCameraSnapshot()
 {
-	m_retstr="";
+	std::string retstr;
+	retstr="";
 	std::vector<unsigned char> camimage;
 	std::string idx=m_pWebEm->FindValue("idx");
 	if (idx=="")
@@ -9113,15 +9771,16 @@ std::string CWebServer::GetCameraSnapshot()
 
 	if (!m_mainworker.m_cameras.TakeSnapshot(idx, camimage))
 		goto exitproc;
-	m_retstr.insert( m_retstr.begin(), camimage.begin(), camimage.end() );
-	m_pWebEm->m_outputfilename="snapshot.jpg";
+	retstr.insert( retstr.begin(), camimage.begin(), camimage.end() );
+	m_pWebEm->Context().m_outputfilename="snapshot.jpg";
 exitproc:
-	return m_retstr;
+	return retstr;
 }
 
 std::string CWebServer::GetDatabaseBackup()
 {
-	m_retstr="";
+	std::string retstr;
+	retstr="";
 	std::string OutputFileName=szStartupFolder + "backup.db";
 	if (m_sql.BackupDatabase(OutputFileName))
 	{
@@ -9130,16 +9789,16 @@ std::string CWebServer::GetDatabaseBackup()
 			std::istreambuf_iterator<char>());
 		if (fileContents.size()>0)
 		{
-			m_retstr.insert( m_retstr.begin(), fileContents.begin(), fileContents.end() );
-			m_pWebEm->m_outputfilename="domoticz.db";
+			retstr.insert( retstr.begin(), fileContents.begin(), fileContents.end() );
+			m_pWebEm->Context().m_outputfilename="domoticz.db";
 		}
 	}
-	return m_retstr;
+	return retstr;
 }
 
 void CWebServer::RType_DeleteDevice(Json::Value &root)
 {
-	if (m_pWebEm->m_actualuser_rights != 2)
+	if (m_pWebEm->Context().m_actualuser_rights != 2)
 	{
 		//No admin user, and not allowed to be here
 		return;
@@ -9157,7 +9816,7 @@ void CWebServer::RType_DeleteDevice(Json::Value &root)
 
 void CWebServer::RType_AddScene(Json::Value &root)
 {
-	if (m_pWebEm->m_actualuser_rights != 2)
+	if (m_pWebEm->Context().m_actualuser_rights != 2)
 	{
 		//No admin user, and not allowed to be here
 		return;
@@ -9196,7 +9855,7 @@ void CWebServer::RType_AddScene(Json::Value &root)
 
 void CWebServer::RType_DeleteScene(Json::Value &root)
 {
-	if (m_pWebEm->m_actualuser_rights != 2)
+	if (m_pWebEm->Context().m_actualuser_rights != 2)
 	{
 		//No admin user, and not allowed to be here
 		return;
@@ -9218,7 +9877,7 @@ void CWebServer::RType_DeleteScene(Json::Value &root)
 
 void CWebServer::RType_UpdateScene(Json::Value &root)
 {
-	if (m_pWebEm->m_actualuser_rights != 2)
+	if (m_pWebEm->Context().m_actualuser_rights != 2)
 	{
 		//No admin user, and not allowed to be here
 		return;
@@ -9258,7 +9917,7 @@ void CWebServer::RType_UpdateScene(Json::Value &root)
 
 void CWebServer::RType_CreateEvohomeSensor(Json::Value &root)
 {
-	if (m_pWebEm->m_actualuser_rights != 2)
+	if (m_pWebEm->Context().m_actualuser_rights != 2)
 	{
 		//No admin user, and not allowed to be here
 		return;
@@ -9316,7 +9975,7 @@ void CWebServer::RType_CreateEvohomeSensor(Json::Value &root)
 
 void CWebServer::RType_CreateVirtualSensor(Json::Value &root)
 {
-	if (m_pWebEm->m_actualuser_rights != 2)
+	if (m_pWebEm->Context().m_actualuser_rights != 2)
 	{
 		//No admin user, and not allowed to be here
 		return;
@@ -9747,6 +10406,7 @@ void CWebServer::RType_Devices(Json::Value &root)
 	std::string sDisplayHidden = m_pWebEm->FindValue("displayhidden");
 	bool bDisplayHidden = (sDisplayHidden == "1");
 	std::string sLastUpdate = m_pWebEm->FindValue("lastupdate");
+	std::string sSince = m_pWebEm->FindValue("since");
 
 	time_t LastUpdate = 0;
 	if (sLastUpdate != "")
@@ -9759,7 +10419,32 @@ void CWebServer::RType_Devices(Json::Value &root)
 	root["status"] = "OK";
 	root["title"] = "Devices";
 
-	GetJSonDevices(root, rused, rfilter, order, rid, planid, floorid, bDisplayHidden, LastUpdate);
+	//since=<ActSeq of a previous reply> only returns the devices/scenes that changed after it,
+	//changed ones that are left out now are listed in RemovedDevices/RemovedScenes.
+	//When the change journal does not cover it anymore the full list is returned with FullSync=true
+	bool bHaveChanges = false;
+	unsigned long long ActSeq = 0;
+	if ((sSince != "") && (rid == "") && ((planid == "") || (planid == "0")) && ((floorid == "") || (floorid == "0")))
+	{
+		std::set<unsigned long long> _ChangedDevices;
+		std::set<unsigned long long> _ChangedScenes;
+		unsigned long long since = strtoull(sSince.c_str(), NULL, 10);
+		if (m_sql.GetChangesSince(since, ActSeq, _ChangedDevices, _ChangedScenes))
+		{
+			//the change list replaces lastupdate, a device left out by it would be reported as removed
+			GetJSonDevices(root, rused, rfilter, order, rid, planid, floorid, bDisplayHidden, 0, &_ChangedDevices, &_ChangedScenes);
+			AddRemovedDevices(root, _ChangedDevices, _ChangedScenes);
+			bHaveChanges = true;
+		}
+	}
+	if (!bHaveChanges)
+	{
+		ActSeq = m_sql.GetChangeSequence();
+		GetJSonDevices(root, rused, rfilter, order, rid, planid, floorid, bDisplayHidden, LastUpdate);
+		if (sSince != "")
+			root["FullSync"] = true;
+	}
+	root["ActSeq"] = (Json::UInt64)ActSeq;
 
 	root["WindScale"] = m_sql.m_windscale*10.0f;
 	root["WindSign"] = m_sql.m_windsign;
@@ -9825,12 +10510,12 @@ void CWebServer::RType_Cameras(Json::Value &root)
 
 void CWebServer::RType_Users(Json::Value &root)
 {
-	bool bHaveUser = (m_pWebEm->m_actualuser != "");
+	bool bHaveUser = (m_pWebEm->Context().m_actualuser != "");
 	int urights = 3;
 	if (bHaveUser)
 	{
 		int iUser = -1;
-		iUser = FindUser(m_pWebEm->m_actualuser.c_str());
+		iUser = FindUser(m_pWebEm->Context().m_actualuser.c_str());
 		if (iUser != -1)
 			urights = (int)m_users[iUser].userrights;
 	}
@@ -9924,7 +10609,7 @@ void CWebServer::RType_Timers(Json::Value &root)
 
 void CWebServer::Cmd_AddTimer(Json::Value &root)
 {
-	if (m_pWebEm->m_actualuser_rights != 2)
+	if (m_pWebEm->Context().m_actualuser_rights != 2)
 	{
 		//No admin user, and not allowed to be here
 		return;
@@ -10000,7 +10685,7 @@ void CWebServer::Cmd_AddTimer(Json::Value &root)
 
 void CWebServer::Cmd_UpdateTimer(Json::Value &root)
 {
-	if (m_pWebEm->m_actualuser_rights != 2)
+	if (m_pWebEm->Context().m_actualuser_rights != 2)
 	{
 		//No admin user, and not allowed to be here
 		return;
@@ -10075,7 +10760,7 @@ void CWebServer::Cmd_UpdateTimer(Json::Value &root)
 
 void CWebServer::Cmd_DeleteTimer(Json::Value &root)
 {
-	if (m_pWebEm->m_actualuser_rights != 2)
+	if (m_pWebEm->Context().m_actualuser_rights != 2)
 	{
 		//No admin user, and not allowed to be here
 		return;
@@ -10097,7 +10782,7 @@ void CWebServer::Cmd_DeleteTimer(Json::Value &root)
 
 void CWebServer::Cmd_ClearTimers(Json::Value &root)
 {
-	if (m_pWebEm->m_actualuser_rights != 2)
+	if (m_pWebEm->Context().m_actualuser_rights != 2)
 	{
 		//No admin user, and not allowed to be here
 		return;
@@ -10178,7 +10863,7 @@ void CWebServer::RType_SceneTimers(Json::Value &root)
 
 void CWebServer::Cmd_AddSceneTimer(Json::Value &root)
 {
-	if (m_pWebEm->m_actualuser_rights != 2)
+	if (m_pWebEm->Context().m_actualuser_rights != 2)
 	{
 		//No admin user, and not allowed to be here
 		return;
@@ -10251,7 +10936,7 @@ void CWebServer::Cmd_AddSceneTimer(Json::Value &root)
 
 void CWebServer::Cmd_UpdateSceneTimer(Json::Value &root)
 {
-	if (m_pWebEm->m_actualuser_rights != 2)
+	if (m_pWebEm->Context().m_actualuser_rights != 2)
 	{
 		//No admin user, and not allowed to be here
 		return;
@@ -10324,7 +11009,7 @@ void CWebServer::Cmd_UpdateSceneTimer(Json::Value &root)
 
 void CWebServer::Cmd_DeleteSceneTimer(Json::Value &root)
 {
-	if (m_pWebEm->m_actualuser_rights != 2)
+	if (m_pWebEm->Context().m_actualuser_rights != 2)
 	{
 		//No admin user, and not allowed to be here
 		return;
@@ -10346,7 +11031,7 @@ void CWebServer::Cmd_DeleteSceneTimer(Json::Value &root)
 
 void CWebServer::Cmd_ClearSceneTimers(Json::Value &root)
 {
-	if (m_pWebEm->m_actualuser_rights != 2)
+	if (m_pWebEm->Context().m_actualuser_rights != 2)
 	{
 		//No admin user, and not allowed to be here
 		return;
@@ -10368,7 +11053,7 @@ void CWebServer::Cmd_ClearSceneTimers(Json::Value &root)
 
 void CWebServer::Cmd_SetSceneCode(Json::Value &root)
 {
-	if (m_pWebEm->m_actualuser_rights != 2)
+	if (m_pWebEm->Context().m_actualuser_rights != 2)
 	{
 		//No admin user, and not allowed to be here
 		return;
@@ -10416,7 +11101,7 @@ void CWebServer::Cmd_SetSceneCode(Json::Value &root)
 
 void CWebServer::Cmd_RemoveSceneCode(Json::Value &root)
 {
-	if (m_pWebEm->m_actualuser_rights != 2)
+	if (m_pWebEm->Context().m_actualuser_rights != 2)
 	{
 		//No admin user, and not allowed to be here
 		return;
@@ -10584,6 +11269,9 @@ void CWebServer::RType_TransferDevice(Json::Value &root)
 
 	std::stringstream szQuery;
 	std::vector<std::vector<std::string> > result;
+	//we copy the current values of the new device
+	m_sql.FlushWriteQueue(strtoull(newidx.c_str(),NULL,10));
+	m_sql.FlushWriteQueue(strtoull(sidx.c_str(),NULL,10));
 	szQuery << "SELECT HardwareID, DeviceID, Unit, Name, Type, SubType, SignalLevel, BatteryLevel, nValue, sValue FROM DeviceStatus WHERE (ID == " << newidx << ")";
 	result = m_sql.query(szQuery.str());
 	if (result.size() < 1)
@@ -10724,7 +11412,7 @@ void CWebServer::RType_SetSharedUserDevices(Json::Value &root)
 
 void CWebServer::RType_SetUsed(Json::Value &root)
 {
-	if (m_pWebEm->m_actualuser_rights != 2)
+	if (m_pWebEm->Context().m_actualuser_rights != 2)
 	{
 		//No admin user, and not allowed to be here
 		return;
@@ -10753,11 +11441,11 @@ void CWebServer::RType_SetUsed(Json::Value &root)
 
 	char szTmp[200];
 
-	bool bHaveUser = (m_pWebEm->m_actualuser != "");
+	bool bHaveUser = (m_pWebEm->Context().m_actualuser != "");
 	int iUser = -1;
 	if (bHaveUser)
 	{
-		iUser = FindUser(m_pWebEm->m_actualuser.c_str());
+		iUser = FindUser(m_pWebEm->Context().m_actualuser.c_str());
 	}
 
 	int switchtype = -1;
@@ -10785,6 +11473,8 @@ void CWebServer::RType_SetUsed(Json::Value &root)
 	std::stringstream szQuery;
 	std::vector<std::vector<std::string> > result;
 	
+	//the sValue is updated below
+	m_sql.FlushWriteQueue(ullidx);
 	szQuery << "SELECT HardwareID, DeviceID,Unit,Type,SubType,SwitchType,sValue,StrParam1,StrParam2,Protected FROM DeviceStatus WHERE (ID == " << idx << ")";
 	result=m_sql.query(szQuery.str());
 	if (result.size()<1)
@@ -10890,7 +11580,7 @@ void CWebServer::RType_SetUsed(Json::Value &root)
 		if (bHaveUser)
 		{
 			int iUser = -1;
-			iUser = FindUser(m_pWebEm->m_actualuser.c_str());
+			iUser = FindUser(m_pWebEm->Context().m_actualuser.c_str());
 			if (iUser != -1)
 			{
 				urights = (int)m_users[iUser].userrights;
@@ -11614,7 +12304,247 @@ void CWebServer::RType_LightLog(Json::Value &root)
 	}
 }
 
-void CWebServer::RType_HandleGraph(Json::Value &root)
+//Graph preferences that change the produced values
+static const char *szGraphPreferences[] =
+{
+	"TempUnit",
+	"WindUnit",
+	"MeterDividerEnergy",
+	"MeterDividerGas",
+	"MeterDividerWater",
+	"ElectricVoltage",
+	"CM113DisplayType",
+	"SmartMeterType",
+	NULL
+};
+
+static double GetGraphValue(const Json::Value &value)
+{
+	if (value.isString())
+		return atof(value.asCString());
+	return value.asDouble();
+}
+
+//Largest-Triangle-Three-Buckets downsampling of a graph result array to maxpoints.
+//The first and last point are kept, of every bucket in between the point that forms
+//the largest triangle with the previous selected point and the average of the next
+//bucket is kept, so peaks and dips stay visible. The date of a point is its x, so
+//gaps and irregular sampling are taken into account.
+static void DownsampleGraph(Json::Value &values, const size_t maxpoints)
+{
+	if (!values.isArray())
+		return;
+	size_t total = values.size();
+	if ((maxpoints < 3) || (total <= maxpoints))
+		return;
+
+	//the value is the main series of the graph, or else the first numeric member that is not the date
+	static const char *szMainFields[] = { "te", "v", "mm", "sp", "uvi", "hu", "ba", "v1", "r1", NULL };
+	std::string field = "";
+	const Json::Value &first = values[(Json::Value::ArrayIndex)0];
+	if (!first.isObject())
+		return;
+	for (int ii = 0; szMainFields[ii] != NULL; ii++)
+	{
+		if (first.isMember(szMainFields[ii]))
+		{
+			field = szMainFields[ii];
+			break;
+		}
+	}
+	if (field == "")
+	{
+		Json::Value::Members members = first.getMemberNames();
+		Json::Value::Members::const_iterator itt;
+		for (itt = members.begin(); itt != members.end(); ++itt)
+		{
+			if (*itt == "d")
+				continue;
+			const Json::Value &value = first[*itt];
+			if ((value.isNumeric()) || ((value.isString()) && (isdigit(value.asString()[0]) || (value.asString()[0] == '-'))))
+			{
+				field = *itt;
+				break;
+			}
+		}
+	}
+	if (field == "")
+		return;
+
+	std::vector<double> x(total);
+	std::vector<double> y(total);
+	bool bHaveDates = true;
+	for (size_t ii = 0; ii < total; ii++)
+	{
+		const Json::Value &point = values[(Json::Value::ArrayIndex)ii];
+		y[ii] = GetGraphValue(point[field]);
+		long long ltime = (point["d"].isString()) ? CTimeSeriesStore::LocalTimeFromString(point["d"].asString()) : -1;
+		if (ltime < 0)
+			bHaveDates = false;
+		x[ii] = (double)ltime;
+	}
+	if (!bHaveDates)
+	{
+		//no (usable) dates, the points are taken as evenly spaced
+		for (size_t ii = 0; ii < total; ii++)
+			x[ii] = (double)ii;
+	}
+
+	Json::Value sampled(Json::arrayValue);
+	sampled.append(values[(Json::Value::ArrayIndex)0]);
+
+	double every = (double)(total - 2) / (double)(maxpoints - 2);
+	size_t a = 0;
+	for (size_t ii = 0; ii < maxpoints - 2; ii++)
+	{
+		size_t avgstart = (size_t)floor((ii + 1)*every) + 1;
+		size_t avgend = (size_t)floor((ii + 2)*every) + 1;
+		if (avgend > total)
+			avgend = total;
+		double avgx = 0;
+		double avgy = 0;
+		for (size_t jj = avgstart; jj < avgend; jj++)
+		{
+			avgx += x[jj];
+			avgy += y[jj];
+		}
+		if (avgend > avgstart)
+		{
+			avgx /= (double)(avgend - avgstart);
+			avgy /= (double)(avgend - avgstart);
+		}
+		else
+		{
+			avgx = x[total - 1];
+			avgy = y[total - 1];
+		}
+
+		size_t rangestart = (size_t)floor(ii*every) + 1;
+		size_t rangeend = (size_t)floor((ii + 1)*every) + 1;
+		double maxarea = -1;
+		size_t next = rangestart;
+		for (size_t jj = rangestart; jj < rangeend; jj++)
+		{
+			double area = fabs((x[a] - avgx)*(y[jj] - y[a]) - (x[a] - x[jj])*(avgy - y[a]));
+			if (area > maxarea)
+			{
+				maxarea = area;
+				next = jj;
+			}
+		}
+		sampled.append(values[(Json::Value::ArrayIndex)next]);
+		a = next;
+	}
+	sampled.append(values[(Json::Value::ArrayIndex)(total - 1)]);
+	values.swap(sampled);
+}
+
+void CWebServer::RType_HandleGraph(Json::Value &root, boost::shared_ptr<const std::string> &resulttext)
+{
+	std::string idx = m_pWebEm->FindValue("idx");
+	if ((idx == "") || (m_pWebEm->FindValue("sensor") == "") || (m_pWebEm->FindValue("range") == ""))
+	{
+		CGraphRows rows;
+		GetGraph(root, rows);
+		resulttext = rows.GetText();
+		return;
+	}
+	std::vector<std::vector<std::string> > result;
+	result = m_sql.query("SELECT Type, SubType, SwitchType, AddjValue, AddjMulti, LastUpdate FROM DeviceStatus WHERE (ID == ?)", CSQLParams().Add(idx));
+	if (result.size() < 1)
+		return;
+
+	//The key is made of the request parameters, the device settings and the graph preferences
+	std::stringstream szKey;
+	const std::multimap<std::string, std::string> &params = m_pWebEm->Context().myNameValues;
+	std::multimap<std::string, std::string>::const_iterator itt;
+	for (itt = params.begin(); itt != params.end(); ++itt)
+	{
+		if ((itt->first == "_") || (itt->first == "jsoncallback"))
+			continue;
+		szKey << itt->first << "=" << itt->second << "&";
+	}
+	std::vector<std::string> sd = result[0];
+	szKey << "|" << sd[0] << "|" << sd[1] << "|" << sd[2] << "|" << sd[3] << "|" << sd[4];
+	if (m_pWebEm->FindValue("sensor") == "counter")
+		szKey << "|" << sd[5]; //counter graphs include the actual counter value
+	for (int ii = 0; szGraphPreferences[ii] != NULL; ii++)
+	{
+		int nValue = 0;
+		std::string sValue;
+		m_sql.GetPreferencesVar(szGraphPreferences[ii], nValue, sValue);
+		szKey << "|" << nValue << "," << sValue;
+	}
+	std::string key = szKey.str();
+
+	unsigned long logversion = m_sql.GetLogDataVersion();
+	time_t atime = mytime(NULL);
+	{
+		boost::lock_guard<boost::mutex> l(m_graphcache_mutex);
+		std::map<std::string, _tGraphCacheEntry>::iterator ittCache = m_graphcache.find(key);
+		if (ittCache != m_graphcache.end())
+		{
+			if (ittCache->second.logversion == logversion)
+			{
+				ittCache->second.lastused = atime;
+				root = *ittCache->second.root;
+				resulttext = ittCache->second.resulttext;
+				return;
+			}
+			m_graphcache.erase(ittCache);
+		}
+	}
+
+	int maxpoints = atoi(m_pWebEm->FindValue("points").c_str());
+	if (maxpoints > 0)
+	{
+		//downsampling needs all values, the rows are written out as text afterwards
+		CGraphRows rows(root);
+		GetGraph(root, rows);
+		CGraphRows sampledrows;
+		if (root.isMember("result"))
+		{
+			Json::Value &values = root["result"];
+			DownsampleGraph(values, (size_t)maxpoints);
+			for (Json::Value::ArrayIndex ii = 0; ii < values.size(); ii++)
+				sampledrows.Add(values[ii]);
+			root.removeMember("result");
+		}
+		if (root.isMember("resultprev"))
+			DownsampleGraph(root["resultprev"], (size_t)maxpoints);
+		resulttext = sampledrows.GetText();
+	}
+	else
+	{
+		CGraphRows rows;
+		GetGraph(root, rows);
+		resulttext = rows.GetText();
+	}
+	if (root["status"] != "OK")
+		return;
+
+	boost::lock_guard<boost::mutex> l(m_graphcache_mutex);
+	if (m_graphcache.size() >= GRAPH_CACHE_MAX_ENTRIES)
+	{
+		//remove the least recently used entry
+		std::map<std::string, _tGraphCacheEntry>::iterator ittOldest = m_graphcache.begin();
+		std::map<std::string, _tGraphCacheEntry>::iterator ittCache;
+		for (ittCache = m_graphcache.begin(); ittCache != m_graphcache.end(); ++ittCache)
+		{
+			if (ittCache->second.lastused < ittOldest->second.lastused)
+				ittOldest = ittCache;
+		}
+		m_graphcache.erase(ittOldest);
+	}
+	_tGraphCacheEntry gentry;
+	gentry.logversion = logversion;
+	gentry.lastused = atime;
+	gentry.root = boost::shared_ptr<Json::Value>(new Json::Value(root));
+	gentry.resulttext = resulttext;
+	m_graphcache[key] = gentry;
+}
+
+void CWebServer::GetGraph(Json::Value &root, CGraphRows &rows)
 {
 	unsigned long long idx = 0;
 	if (m_pWebEm->FindValue("idx") != "")
@@ -11731,19 +12661,16 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 			root["status"] = "OK";
 			root["title"] = "Graph " + sensor + " " + srange;
 
-			szQuery.clear();
-			szQuery.str("");
-			szQuery << "SELECT Temperature, Chill, Humidity, Barometer, Date, SetPoint FROM " << dbasetable << " WHERE (DeviceRowID==" << idx << ") ORDER BY Date ASC";
-			result = m_sql.query(szQuery.str());
+			result = m_sql.GetShortLog(dbasetable, idx, "Temperature, Chill, Humidity, Barometer, Date, SetPoint");
 			if (result.size()>0)
 			{
 				std::vector<std::vector<std::string> >::const_iterator itt;
-				int ii = 0;
+				Json::Value row;
 				for (itt = result.begin(); itt != result.end(); ++itt)
 				{
 					std::vector<std::string> sd = *itt;
 
-					root["result"][ii]["d"] = sd[4].substr(0, 16);
+					row["d"] = sd[4].substr(0, 16);
 					if (
 						(dType == pTypeRego6XXTemp) ||
 						(dType == pTypeTEMP) ||
@@ -11762,7 +12689,7 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 						)
 					{
 						double tvalue = ConvertTemperature(atof(sd[0].c_str()), tempsign);
-						root["result"][ii]["te"] = tvalue;
+						row["te"] = tvalue;
 					}
 					if (
 						((dType == pTypeWIND) && (dSubType == sTypeWIND4)) ||
@@ -11770,11 +12697,11 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 						)
 					{
 						double tvalue = ConvertTemperature(atof(sd[1].c_str()), tempsign);
-						root["result"][ii]["ch"] = tvalue;
+						row["ch"] = tvalue;
 					}
 					if ((dType == pTypeHUM) || (dType == pTypeTEMP_HUM) || (dType == pTypeTEMP_HUM_BARO))
 					{
-						root["result"][ii]["hu"] = sd[2];
+						row["hu"] = sd[2];
 					}
 					if (
 						(dType == pTypeTEMP_HUM_BARO) ||
@@ -11786,24 +12713,24 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 							if (dSubType == sTypeTHBFloat)
 							{
 								sprintf(szTmp, "%.1f", atof(sd[3].c_str()) / 10.0f);
-								root["result"][ii]["ba"] = szTmp;
+								row["ba"] = szTmp;
 							}
 							else
-								root["result"][ii]["ba"] = sd[3];
+								row["ba"] = sd[3];
 						}
 						else if (dType == pTypeTEMP_BARO)
 						{
 							sprintf(szTmp, "%.1f", atof(sd[3].c_str()) / 10.0f);
-							root["result"][ii]["ba"] = szTmp;
+							row["ba"] = szTmp;
 						}
 					}
 					if((dType == pTypeEvohomeZone) || (dType == pTypeEvohomeWater))
 					{
 						double se = ConvertTemperature(atof(sd[5].c_str()), tempsign);
-						root["result"][ii]["se"] = se;
+						row["se"] = se;
 					}
 
-					ii++;
+					rows.Add(row);
 				}
 			}
 		}
@@ -11811,21 +12738,18 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 			root["status"] = "OK";
 			root["title"] = "Graph " + sensor + " " + srange;
 
-			szQuery.clear();
-			szQuery.str("");
-			szQuery << "SELECT Percentage, Date FROM " << dbasetable << " WHERE (DeviceRowID==" << idx << ") ORDER BY Date ASC";
-			result = m_sql.query(szQuery.str());
+			result = m_sql.GetShortLog(dbasetable, idx, "Percentage, Date");
 			if (result.size()>0)
 			{
 				std::vector<std::vector<std::string> >::const_iterator itt;
-				int ii = 0;
+				Json::Value row;
 				for (itt = result.begin(); itt != result.end(); ++itt)
 				{
 					std::vector<std::string> sd = *itt;
 
-					root["result"][ii]["d"] = sd[1].substr(0, 16);
-					root["result"][ii]["v"] = sd[0];
-					ii++;
+					row["d"] = sd[1].substr(0, 16);
+					row["v"] = sd[0];
+					rows.Add(row);
 				}
 			}
 		}
@@ -11833,21 +12757,18 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 			root["status"] = "OK";
 			root["title"] = "Graph " + sensor + " " + srange;
 
-			szQuery.clear();
-			szQuery.str("");
-			szQuery << "SELECT Speed, Date FROM " << dbasetable << " WHERE (DeviceRowID==" << idx << ") ORDER BY Date ASC";
-			result = m_sql.query(szQuery.str());
+			result = m_sql.GetShortLog(dbasetable, idx, "Speed, Date");
 			if (result.size()>0)
 			{
 				std::vector<std::vector<std::string> >::const_iterator itt;
-				int ii = 0;
+				Json::Value row;
 				for (itt = result.begin(); itt != result.end(); ++itt)
 				{
 					std::vector<std::string> sd = *itt;
 
-					root["result"][ii]["d"] = sd[1].substr(0, 16);
-					root["result"][ii]["v"] = sd[0];
-					ii++;
+					row["d"] = sd[1].substr(0, 16);
+					row["v"] = sd[0];
+					rows.Add(row);
 				}
 			}
 		}
@@ -11859,14 +12780,11 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 				root["status"] = "OK";
 				root["title"] = "Graph " + sensor + " " + srange;
 
-				szQuery.clear();
-				szQuery.str("");
-				szQuery << "SELECT Value1, Value2, Value3, Value4, Value5, Value6, Date FROM " << dbasetable << " WHERE (DeviceRowID==" << idx << ") ORDER BY Date ASC";
-				result = m_sql.query(szQuery.str());
+				result = m_sql.GetShortLog(dbasetable, idx, "Value1, Value2, Value3, Value4, Value5, Value6, Date");
 				if (result.size()>0)
 				{
 					std::vector<std::vector<std::string> >::const_iterator itt;
-					int ii = 0;
+					Json::Value row;
 					bool bHaveDeliverd = false;
 					bool bHaveFirstValue = false;
 					long long lastUsage1, lastUsage2, lastDeliv1, lastDeliv2;
@@ -11928,20 +12846,20 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 								curDeliv1 *= int(tlaps);
 								curDeliv2 *= int(tlaps);
 
-								root["result"][ii]["d"] = sd[6].substr(0, 16);
+								row["d"] = sd[6].substr(0, 16);
 
 								if ((curDeliv1 != 0) || (curDeliv2 != 0))
 									bHaveDeliverd = true;
 
 								sprintf(szTmp, "%ld", curUsage1);
-								root["result"][ii]["v"] = szTmp;
+								row["v"] = szTmp;
 								sprintf(szTmp, "%ld", curUsage2);
-								root["result"][ii]["v2"] = szTmp;
+								row["v2"] = szTmp;
 								sprintf(szTmp, "%ld", curDeliv1);
-								root["result"][ii]["r1"] = szTmp;
+								row["r1"] = szTmp;
 								sprintf(szTmp, "%ld", curDeliv2);
-								root["result"][ii]["r2"] = szTmp;
-								ii++;
+								row["r2"] = szTmp;
+								rows.Add(row);
 							}
 							else
 							{
@@ -11956,13 +12874,13 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 						else
 						{
 							//this meter has no decimals, so return the use peaks
-							root["result"][ii]["d"] = sd[6].substr(0, 16);
+							row["d"] = sd[6].substr(0, 16);
 
 							if (sd[3] != "0")
 								bHaveDeliverd = true;
-							root["result"][ii]["v"] = sd[2];
-							root["result"][ii]["r1"] = sd[3];
-							ii++;
+							row["v"] = sd[2];
+							row["r1"] = sd[3];
+							rows.Add(row);
 
 						}
 					}
@@ -11977,21 +12895,18 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 				root["status"] = "OK";
 				root["title"] = "Graph " + sensor + " " + srange;
 
-				szQuery.clear();
-				szQuery.str("");
-				szQuery << "SELECT Value, Date FROM " << dbasetable << " WHERE (DeviceRowID==" << idx << ") ORDER BY Date ASC";
-				result = m_sql.query(szQuery.str());
+				result = m_sql.GetShortLog(dbasetable, idx, "Value, Date");
 				if (result.size()>0)
 				{
 					std::vector<std::vector<std::string> >::const_iterator itt;
-					int ii = 0;
+					Json::Value row;
 					for (itt = result.begin(); itt != result.end(); ++itt)
 					{
 						std::vector<std::string> sd = *itt;
 
-						root["result"][ii]["d"] = sd[1].substr(0, 16);
-						root["result"][ii]["co2"] = sd[0];
-						ii++;
+						row["d"] = sd[1].substr(0, 16);
+						row["co2"] = sd[0];
+						rows.Add(row);
 					}
 				}
 			}
@@ -12000,21 +12915,18 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 				root["status"] = "OK";
 				root["title"] = "Graph " + sensor + " " + srange;
 
-				szQuery.clear();
-				szQuery.str("");
-				szQuery << "SELECT Value, Date FROM " << dbasetable << " WHERE (DeviceRowID==" << idx << ") ORDER BY Date ASC";
-				result = m_sql.query(szQuery.str());
+				result = m_sql.GetShortLog(dbasetable, idx, "Value, Date");
 				if (result.size()>0)
 				{
 					std::vector<std::vector<std::string> >::const_iterator itt;
-					int ii = 0;
+					Json::Value row;
 					for (itt = result.begin(); itt != result.end(); ++itt)
 					{
 						std::vector<std::string> sd = *itt;
 
-						root["result"][ii]["d"] = sd[1].substr(0, 16);
-						root["result"][ii]["v"] = sd[0];
-						ii++;
+						row["d"] = sd[1].substr(0, 16);
+						row["v"] = sd[0];
+						rows.Add(row);
 					}
 				}
 			}
@@ -12031,19 +12943,16 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 				if ((dType == pTypeGeneral) && (dSubType == sTypeVoltage))
 					vdiv = 1000.0f;
 
-				szQuery.clear();
-				szQuery.str("");
-				szQuery << "SELECT Value, Date FROM " << dbasetable << " WHERE (DeviceRowID==" << idx << ") ORDER BY Date ASC";
-				result = m_sql.query(szQuery.str());
+				result = m_sql.GetShortLog(dbasetable, idx, "Value, Date");
 				if (result.size()>0)
 				{
 					std::vector<std::vector<std::string> >::const_iterator itt;
-					int ii = 0;
+					Json::Value row;
 					for (itt = result.begin(); itt != result.end(); ++itt)
 					{
 						std::vector<std::string> sd = *itt;
 
-						root["result"][ii]["d"] = sd[1].substr(0, 16);
+						row["d"] = sd[1].substr(0, 16);
 						float fValue = float(atof(sd[0].c_str())) / vdiv;
 						if (metertype == 1)
 							fValue *= 0.6214f;
@@ -12051,8 +12960,8 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 							sprintf(szTmp, "%.3f", fValue);
 						else
 							sprintf(szTmp, "%.1f", fValue);
-						root["result"][ii]["v"] = szTmp;
-						ii++;
+						row["v"] = szTmp;
+						rows.Add(row);
 					}
 				}
 			}
@@ -12061,21 +12970,18 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 				root["status"] = "OK";
 				root["title"] = "Graph " + sensor + " " + srange;
 
-				szQuery.clear();
-				szQuery.str("");
-				szQuery << "SELECT Value, Date FROM " << dbasetable << " WHERE (DeviceRowID==" << idx << ") ORDER BY Date ASC";
-				result = m_sql.query(szQuery.str());
+				result = m_sql.GetShortLog(dbasetable, idx, "Value, Date");
 				if (result.size()>0)
 				{
 					std::vector<std::vector<std::string> >::const_iterator itt;
-					int ii = 0;
+					Json::Value row;
 					for (itt = result.begin(); itt != result.end(); ++itt)
 					{
 						std::vector<std::string> sd = *itt;
 
-						root["result"][ii]["d"] = sd[1].substr(0, 16);
-						root["result"][ii]["v"] = sd[0];
-						ii++;
+						row["d"] = sd[1].substr(0, 16);
+						row["v"] = sd[0];
+						rows.Add(row);
 					}
 				}
 			}
@@ -12084,21 +12990,18 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 				root["status"] = "OK";
 				root["title"] = "Graph " + sensor + " " + srange;
 
-				szQuery.clear();
-				szQuery.str("");
-				szQuery << "SELECT Value, Date FROM " << dbasetable << " WHERE (DeviceRowID==" << idx << ") ORDER BY Date ASC";
-				result = m_sql.query(szQuery.str());
+				result = m_sql.GetShortLog(dbasetable, idx, "Value, Date");
 				if (result.size()>0)
 				{
 					std::vector<std::vector<std::string> >::const_iterator itt;
-					int ii = 0;
+					Json::Value row;
 					for (itt = result.begin(); itt != result.end(); ++itt)
 					{
 						std::vector<std::string> sd = *itt;
 
-						root["result"][ii]["d"] = sd[1].substr(0, 16);
-						root["result"][ii]["lux"] = sd[0];
-						ii++;
+						row["d"] = sd[1].substr(0, 16);
+						row["lux"] = sd[0];
+						rows.Add(row);
 					}
 				}
 			}
@@ -12107,22 +13010,19 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 				root["status"] = "OK";
 				root["title"] = "Graph " + sensor + " " + srange;
 
-				szQuery.clear();
-				szQuery.str("");
-				szQuery << "SELECT Value, Date FROM " << dbasetable << " WHERE (DeviceRowID==" << idx << ") ORDER BY Date ASC";
-				result = m_sql.query(szQuery.str());
+				result = m_sql.GetShortLog(dbasetable, idx, "Value, Date");
 				if (result.size()>0)
 				{
 					std::vector<std::vector<std::string> >::const_iterator itt;
-					int ii = 0;
+					Json::Value row;
 					for (itt = result.begin(); itt != result.end(); ++itt)
 					{
 						std::vector<std::string> sd = *itt;
 
-						root["result"][ii]["d"] = sd[1].substr(0, 16);
+						row["d"] = sd[1].substr(0, 16);
 						sprintf(szTmp, "%.1f", atof(sd[0].c_str()) / 10.0f);
-						root["result"][ii]["v"] = szTmp;
-						ii++;
+						row["v"] = szTmp;
+						rows.Add(row);
 					}
 				}
 			}
@@ -12131,21 +13031,18 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 				root["status"] = "OK";
 				root["title"] = "Graph " + sensor + " " + srange;
 
-				szQuery.clear();
-				szQuery.str("");
-				szQuery << "SELECT Value, Date FROM " << dbasetable << " WHERE (DeviceRowID==" << idx << ") ORDER BY Date ASC";
-				result = m_sql.query(szQuery.str());
+				result = m_sql.GetShortLog(dbasetable, idx, "Value, Date");
 				if (result.size()>0)
 				{
 					std::vector<std::vector<std::string> >::const_iterator itt;
-					int ii = 0;
+					Json::Value row;
 					for (itt = result.begin(); itt != result.end(); ++itt)
 					{
 						std::vector<std::string> sd = *itt;
 
-						root["result"][ii]["d"] = sd[1].substr(0, 16);
-						root["result"][ii]["u"] = atof(sd[0].c_str())/10.0f;
-						ii++;
+						row["d"] = sd[1].substr(0, 16);
+						row["u"] = atof(sd[0].c_str())/10.0f;
+						rows.Add(row);
 					}
 				}
 			}
@@ -12162,14 +13059,11 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 
 				root["displaytype"] = displaytype;
 
-				szQuery.clear();
-				szQuery.str("");
-				szQuery << "SELECT Value1, Value2, Value3, Date FROM " << dbasetable << " WHERE (DeviceRowID==" << idx << ") ORDER BY Date ASC";
-				result = m_sql.query(szQuery.str());
+				result = m_sql.GetShortLog(dbasetable, idx, "Value1, Value2, Value3, Date");
 				if (result.size()>0)
 				{
 					std::vector<std::vector<std::string> >::const_iterator itt;
-					int ii = 0;
+					Json::Value row;
 					bool bHaveL1 = false;
 					bool bHaveL2 = false;
 					bool bHaveL3 = false;
@@ -12177,7 +13071,7 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 					{
 						std::vector<std::string> sd = *itt;
 
-						root["result"][ii]["d"] = sd[3].substr(0, 16);
+						row["d"] = sd[3].substr(0, 16);
 
 						float fval1 = (float)atof(sd[0].c_str()) / 10.0f;
 						float fval2 = (float)atof(sd[1].c_str()) / 10.0f;
@@ -12193,22 +13087,22 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 						if (displaytype == 0)
 						{
 							sprintf(szTmp, "%.1f", fval1);
-							root["result"][ii]["v1"] = szTmp;
+							row["v1"] = szTmp;
 							sprintf(szTmp, "%.1f", fval2);
-							root["result"][ii]["v2"] = szTmp;
+							row["v2"] = szTmp;
 							sprintf(szTmp, "%.1f", fval3);
-							root["result"][ii]["v3"] = szTmp;
+							row["v3"] = szTmp;
 						}
 						else
 						{
 							sprintf(szTmp, "%d", int(fval1*voltage));
-							root["result"][ii]["v1"] = szTmp;
+							row["v1"] = szTmp;
 							sprintf(szTmp, "%d", int(fval2*voltage));
-							root["result"][ii]["v2"] = szTmp;
+							row["v2"] = szTmp;
 							sprintf(szTmp, "%d", int(fval3*voltage));
-							root["result"][ii]["v3"] = szTmp;
+							row["v3"] = szTmp;
 						}
-						ii++;
+						rows.Add(row);
 					}
 					if (
 						(!bHaveL1) &&
@@ -12240,14 +13134,11 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 
 				root["displaytype"] = displaytype;
 
-				szQuery.clear();
-				szQuery.str("");
-				szQuery << "SELECT Value1, Value2, Value3, Date FROM " << dbasetable << " WHERE (DeviceRowID==" << idx << ") ORDER BY Date ASC";
-				result = m_sql.query(szQuery.str());
+				result = m_sql.GetShortLog(dbasetable, idx, "Value1, Value2, Value3, Date");
 				if (result.size()>0)
 				{
 					std::vector<std::vector<std::string> >::const_iterator itt;
-					int ii = 0;
+					Json::Value row;
 					bool bHaveL1 = false;
 					bool bHaveL2 = false;
 					bool bHaveL3 = false;
@@ -12255,7 +13146,7 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 					{
 						std::vector<std::string> sd = *itt;
 
-						root["result"][ii]["d"] = sd[3].substr(0, 16);
+						row["d"] = sd[3].substr(0, 16);
 
 						float fval1 = (float)atof(sd[0].c_str()) / 10.0f;
 						float fval2 = (float)atof(sd[1].c_str()) / 10.0f;
@@ -12271,22 +13162,22 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 						if (displaytype == 0)
 						{
 							sprintf(szTmp, "%.1f", fval1);
-							root["result"][ii]["v1"] = szTmp;
+							row["v1"] = szTmp;
 							sprintf(szTmp, "%.1f", fval2);
-							root["result"][ii]["v2"] = szTmp;
+							row["v2"] = szTmp;
 							sprintf(szTmp, "%.1f", fval3);
-							root["result"][ii]["v3"] = szTmp;
+							row["v3"] = szTmp;
 						}
 						else
 						{
 							sprintf(szTmp, "%d", int(fval1*voltage));
-							root["result"][ii]["v1"] = szTmp;
+							row["v1"] = szTmp;
 							sprintf(szTmp, "%d", int(fval2*voltage));
-							root["result"][ii]["v2"] = szTmp;
+							row["v2"] = szTmp;
 							sprintf(szTmp, "%d", int(fval3*voltage));
-							root["result"][ii]["v3"] = szTmp;
+							row["v3"] = szTmp;
 						}
-						ii++;
+						rows.Add(row);
 					}
 					if (
 						(!bHaveL1) &&
@@ -12331,11 +13222,8 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 				else if ((dType == pTypeENERGY) || (dType == pTypePOWER))
 					EnergyDivider *= 100.0f;
 
-				szQuery.clear();
-				szQuery.str("");
-				int ii = 0;
-				szQuery << "SELECT Value,[Usage], Date FROM " << dbasetable << " WHERE (DeviceRowID==" << idx << ") ORDER BY Date ASC";
-				result = m_sql.query(szQuery.str());
+				Json::Value row;
+				result = m_sql.GetShortLog(dbasetable, idx, "Value,[Usage], Date");
 
 				int method = 0;
 				std::string sMethod = m_pWebEm->FindValue("method");
@@ -12371,7 +13259,7 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 							{
 								if (bHaveFirstValue)
 								{
-									root["result"][ii]["d"] = LastDateTime + ":00";
+									row["d"] = LastDateTime + ":00";
 
 									unsigned long long ulTotalValue = ulLastValue - ulFirstValue;
 									if (ulTotalValue == 0)
@@ -12398,8 +13286,8 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 											sprintf(szTmp, "%.1f", TotalValue);
 											break;
 										}
-										root["result"][ii]["v"] = szTmp;
-										ii++;
+										row["v"] = szTmp;
+										rows.Add(row);
 									}
 								}
 								LastDateTime = actDateTimeHour;
@@ -12429,7 +13317,7 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 							unsigned long long actValue;
 							s_str1 >> actValue;
 
-							root["result"][ii]["d"] = sd[2].substr(0, 16);
+							row["d"] = sd[2].substr(0, 16);
 
 							float TotalValue = float(actValue);
 							switch (metertype)
@@ -12447,8 +13335,8 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 								sprintf(szTmp, "%.1f", TotalValue);
 								break;
 							}
-							root["result"][ii]["v"] = szTmp;
-							ii++;
+							row["v"] = szTmp;
+							rows.Add(row);
 						}
 					}
 				}
@@ -12479,11 +13367,8 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 				else if ((dType == pTypeENERGY) || (dType == pTypePOWER))
 					EnergyDivider *= 100.0f;
 
-				szQuery.clear();
-				szQuery.str("");
-				int ii = 0;
-				szQuery << "SELECT Value, Date FROM " << dbasetable << " WHERE (DeviceRowID==" << idx << ") ORDER BY Date ASC";
-				result = m_sql.query(szQuery.str());
+				Json::Value row;
+				result = m_sql.GetShortLog(dbasetable, idx, "Value, Date");
 
 				int method = 0;
 				std::string sMethod = m_pWebEm->FindValue("method");
@@ -12534,7 +13419,7 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 									localtime_r(&atime, &ntime);
 									char szTime[50];
 									sprintf(szTime, "%04d-%02d-%02d %02d:00", ntime.tm_year + 1900, ntime.tm_mon + 1, ntime.tm_mday, ntime.tm_hour);
-									root["result"][ii]["d"] = szTime;
+									row["d"] = szTime;
 
 									float TotalValue = float(actValue - ulFirstValue);
 
@@ -12555,8 +13440,8 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 											sprintf(szTmp, "%.1f", TotalValue);
 											break;
 										}
-										root["result"][ii]["v"] = szTmp;
-										ii++;
+										row["v"] = szTmp;
+										rows.Add(row);
 									}
 								}
 								ulFirstValue = actValue;
@@ -12599,7 +13484,7 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 								float tlaps = 3600.0f / tdiff;
 								curValue *= int(tlaps);
 
-								root["result"][ii]["d"] = sd[1].substr(0, 16);
+								row["d"] = sd[1].substr(0, 16);
 
 								float TotalValue = float(curValue);
 								if (TotalValue != 0)
@@ -12619,8 +13504,8 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 										sprintf(szTmp, "%.1f", TotalValue);
 										break;
 									}
-									root["result"][ii]["v"] = szTmp;
-									ii++;
+									row["v"] = szTmp;
+									rows.Add(row);
 								}
 
 							}
@@ -12634,7 +13519,7 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 				if ((bHaveFirstValue) && (method == 0))
 				{
 					//add last value
-					root["result"][ii]["d"] = LastDateTime + ":00";
+					row["d"] = LastDateTime + ":00";
 
 					unsigned long long ulTotalValue = ulLastValue - ulFirstValue;
 
@@ -12657,8 +13542,8 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 							sprintf(szTmp, "%.1f", TotalValue);
 							break;
 						}
-						root["result"][ii]["v"] = szTmp;
-						ii++;
+						row["v"] = szTmp;
+						rows.Add(row);
 					}
 				}
 			}
@@ -12667,21 +13552,18 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 			root["status"] = "OK";
 			root["title"] = "Graph " + sensor + " " + srange;
 
-			szQuery.clear();
-			szQuery.str("");
-			szQuery << "SELECT Level, Date FROM " << dbasetable << " WHERE (DeviceRowID==" << idx << ") ORDER BY Date ASC";
-			result = m_sql.query(szQuery.str());
+			result = m_sql.GetShortLog(dbasetable, idx, "Level, Date");
 			if (result.size()>0)
 			{
 				std::vector<std::vector<std::string> >::const_iterator itt;
-				int ii = 0;
+				Json::Value row;
 				for (itt = result.begin(); itt != result.end(); ++itt)
 				{
 					std::vector<std::string> sd = *itt;
 
-					root["result"][ii]["d"] = sd[1].substr(0, 16);
-					root["result"][ii]["uvi"] = sd[0];
-					ii++;
+					row["d"] = sd[1].substr(0, 16);
+					row["uvi"] = sd[0];
+					rows.Add(row);
 				}
 			}
 		}
@@ -12695,14 +13577,11 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 			float LastValue = -1;
 			std::string LastDate = "";
 
-			szQuery.clear();
-			szQuery.str("");
-			szQuery << "SELECT Total, Date FROM " << dbasetable << " WHERE (DeviceRowID==" << idx << ") ORDER BY Date ASC";
-			result = m_sql.query(szQuery.str());
+			result = m_sql.GetShortLog(dbasetable, idx, "Total, Date");
 			if (result.size()>0)
 			{
 				std::vector<std::vector<std::string> >::const_iterator itt;
-				int ii = 0;
+				Json::Value row;
 				for (itt = result.begin(); itt != result.end(); ++itt)
 				{
 					std::vector<std::string> sd = *itt;
@@ -12716,21 +13595,21 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 							if (Hour != NextCalculatedHour)
 							{
 								//Looks like we have a GAP somewhere, finish the last hour
-								root["result"][ii]["d"] = LastDate;
+								row["d"] = LastDate;
 								double mmval = ActTotal - LastValue;
 								mmval *= AddjMulti;
 								sprintf(szTmp, "%.1f", mmval);
-								root["result"][ii]["mm"] = szTmp;
-								ii++;
+								row["mm"] = szTmp;
+								rows.Add(row);
 							}
 							else
 							{
-								root["result"][ii]["d"] = sd[1].substr(0, 16);
+								row["d"] = sd[1].substr(0, 16);
 								double mmval = ActTotal - LastTotalPreviousHour;
 								mmval *= AddjMulti;
 								sprintf(szTmp, "%.1f", mmval);
-								root["result"][ii]["mm"] = szTmp;
-								ii++;
+								row["mm"] = szTmp;
+								rows.Add(row);
 							}
 						}
 						LastHour = Hour;
@@ -12745,28 +13624,25 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 			root["status"] = "OK";
 			root["title"] = "Graph " + sensor + " " + srange;
 
-			szQuery.clear();
-			szQuery.str("");
-			szQuery << "SELECT Direction, Speed, Gust, Date FROM " << dbasetable << " WHERE (DeviceRowID==" << idx << ") ORDER BY Date ASC";
-			result = m_sql.query(szQuery.str());
+			result = m_sql.GetShortLog(dbasetable, idx, "Direction, Speed, Gust, Date");
 			if (result.size()>0)
 			{
 				std::vector<std::vector<std::string> >::const_iterator itt;
-				int ii = 0;
+				Json::Value row;
 				for (itt = result.begin(); itt != result.end(); ++itt)
 				{
 					std::vector<std::string> sd = *itt;
 
-					root["result"][ii]["d"] = sd[3].substr(0, 16);
-					root["result"][ii]["di"] = sd[0];
+					row["d"] = sd[3].substr(0, 16);
+					row["di"] = sd[0];
 
 					int intSpeed = atoi(sd[1].c_str());
 					sprintf(szTmp, "%.1f", float(intSpeed) * m_sql.m_windscale);
-					root["result"][ii]["sp"] = szTmp;
+					row["sp"] = szTmp;
 					int intGust = atoi(sd[2].c_str());
 					sprintf(szTmp, "%.1f", float(intGust) * m_sql.m_windscale);
-					root["result"][ii]["gu"] = szTmp;
-					ii++;
+					row["gu"] = szTmp;
+					rows.Add(row);
 				}
 			}
 		}
@@ -12774,10 +13650,7 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 			root["status"] = "OK";
 			root["title"] = "Graph " + sensor + " " + srange;
 
-			szQuery.clear();
-			szQuery.str("");
-			szQuery << "SELECT Direction, Speed FROM " << dbasetable << " WHERE (DeviceRowID==" << idx << ") ORDER BY Date ASC";
-			result = m_sql.query(szQuery.str());
+			result = m_sql.GetShortLog(dbasetable, idx, "Direction, Speed");
 			if (result.size()>0)
 			{
 				std::vector<std::vector<std::string> >::const_iterator itt;
@@ -12785,6 +13658,7 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 				float wdirtable[17][8];
 				int wdirtabletemp[17][8];
 				int ii = 0;
+				Json::Value row;
 
 				int totalvalues = 0;
 				//init dir list
@@ -12839,16 +13713,15 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 					}
 					wdirtable[ii][7] = total;
 				}
-				ii = 0;
 				for (idir = 0; idir<360 + 1; idir++)
 				{
 					if (_directions[idir] != 0)
 					{
-						root["result"][ii]["dig"] = idir;
+						row["dig"] = idir;
 						float percentage = (float(100.0 / float(totalvalues))*float(_directions[idir]));
 						sprintf(szTmp, "%.2f", percentage);
-						root["result"][ii]["div"] = szTmp;
-						ii++;
+						row["div"] = szTmp;
+						rows.Add(row);
 					}
 				}
 			}
@@ -12888,7 +13761,7 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 			szQuery.str("");
 			szQuery << "SELECT Total, Rate, Date FROM " << dbasetable << " WHERE (DeviceRowID==" << idx << " AND Date>='" << szDateStart << "' AND Date<='" << szDateEnd << "') ORDER BY Date ASC";
 			result = m_sql.query(szQuery.str());
-			int ii = 0;
+			Json::Value row;
 			if (result.size()>0)
 			{
 				std::vector<std::vector<std::string> >::const_iterator itt;
@@ -12896,12 +13769,12 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 				{
 					std::vector<std::string> sd = *itt;
 
-					root["result"][ii]["d"] = sd[2].substr(0, 16);
+					row["d"] = sd[2].substr(0, 16);
 					double mmval = atof(sd[0].c_str());
 					mmval *= AddjMulti;
 					sprintf(szTmp, "%.1f", mmval);
-					root["result"][ii]["mm"] = szTmp;
-					ii++;
+					row["mm"] = szTmp;
+					rows.Add(row);
 				}
 			}
 			//add today (have to calculate it)
@@ -12935,9 +13808,9 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 				}
 				total_real *= AddjMulti;
 				sprintf(szTmp, "%.1f", total_real);
-				root["result"][ii]["d"] = szDateEnd;
-				root["result"][ii]["mm"] = szTmp;
-				ii++;
+				row["d"] = szDateEnd;
+				row["mm"] = szTmp;
+				rows.Add(row);
 			}
 		}
 		else if (sensor == "counter")
@@ -12992,7 +13865,7 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 
 			szQuery.clear();
 			szQuery.str("");
-			int ii = 0;
+			Json::Value row;
 			if (dType == pTypeP1Power)
 			{
 				szQuery << "SELECT Value1,Value2,Value5,Value6,Date FROM " << dbasetable << " WHERE (DeviceRowID==" << idx << " AND Date>='" << szDateStart << "' AND Date<='" << szDateEnd << "') ORDER BY Date ASC";
@@ -13004,7 +13877,7 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 					for (itt = result.begin(); itt != result.end(); ++itt)
 					{
 						std::vector<std::string> sd = *itt;
-						root["result"][ii]["d"] = sd[4].substr(0, 16);
+						row["d"] = sd[4].substr(0, 16);
 						std::string szValueUsage1 = sd[0];
 						std::string szValueDeliv1 = sd[1];
 						std::string szValueUsage2 = sd[2];
@@ -13018,14 +13891,14 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 						if ((fDeliv1 != 0) || (fDeliv2 != 0))
 							bHaveDeliverd = true;
 						sprintf(szTmp, "%.3f", fUsage1 / EnergyDivider);
-						root["result"][ii]["v"] = szTmp;
+						row["v"] = szTmp;
 						sprintf(szTmp, "%.3f", fUsage2 / EnergyDivider);
-						root["result"][ii]["v2"] = szTmp;
+						row["v2"] = szTmp;
 						sprintf(szTmp, "%.3f", fDeliv1 / EnergyDivider);
-						root["result"][ii]["r1"] = szTmp;
+						row["r1"] = szTmp;
 						sprintf(szTmp, "%.3f", fDeliv2 / EnergyDivider);
-						root["result"][ii]["r2"] = szTmp;
-						ii++;
+						row["r2"] = szTmp;
+						rows.Add(row);
 					}
 					if (bHaveDeliverd)
 					{
@@ -13044,7 +13917,7 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 					{
 						std::vector<std::string> sd = *itt;
 
-						root["result"][ii]["d"] = sd[1].substr(0, 16);
+						row["d"] = sd[1].substr(0, 16);
 						std::string szValue = sd[0];
 						switch (metertype)
 						{
@@ -13061,8 +13934,8 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 							szValue = szTmp;
 							break;
 						}
-						root["result"][ii]["v"] = szValue;
-						ii++;
+						row["v"] = szValue;
+						rows.Add(row);
 					}
 				}
 			}
@@ -13108,27 +13981,27 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 					if ((total_real_deliv_1 != 0) || (total_real_deliv_2 != 0))
 						bHaveDeliverd = true;
 
-					root["result"][ii]["d"] = szDateEnd;
+					row["d"] = szDateEnd;
 
 					sprintf(szTmp, "%llu", total_real_usage_1);
 					std::string szValue = szTmp;
 					sprintf(szTmp, "%.3f", atof(szValue.c_str()) / EnergyDivider);
-					root["result"][ii]["v"] = szTmp;
+					row["v"] = szTmp;
 					sprintf(szTmp, "%llu", total_real_usage_2);
 					szValue = szTmp;
 					sprintf(szTmp, "%.3f", atof(szValue.c_str()) / EnergyDivider);
-					root["result"][ii]["v2"] = szTmp;
+					row["v2"] = szTmp;
 
 					sprintf(szTmp, "%llu", total_real_deliv_1);
 					szValue = szTmp;
 					sprintf(szTmp, "%.3f", atof(szValue.c_str()) / EnergyDivider);
-					root["result"][ii]["r1"] = szTmp;
+					row["r1"] = szTmp;
 					sprintf(szTmp, "%llu", total_real_deliv_2);
 					szValue = szTmp;
 					sprintf(szTmp, "%.3f", atof(szValue.c_str()) / EnergyDivider);
-					root["result"][ii]["r2"] = szTmp;
+					row["r2"] = szTmp;
 
-					ii++;
+					rows.Add(row);
 					if (bHaveDeliverd)
 					{
 						root["delivered"] = true;
@@ -13168,9 +14041,9 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 						break;
 					}
 
-					root["result"][ii]["d"] = szDateEnd;
-					root["result"][ii]["v"] = szValue;
-					ii++;
+					row["d"] = szDateEnd;
+					row["v"] = szValue;
+					rows.Add(row);
 				}
 			}
 		}
@@ -13251,7 +14124,7 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 			szQuery.str("");
 			szQuery << "SELECT Temp_Min, Temp_Max, Chill_Min, Chill_Max, Humidity, Barometer, Temp_Avg, Date, SetPoint_Min, SetPoint_Max, SetPoint_Avg FROM " << dbasetable << " WHERE (DeviceRowID==" << idx << " AND Date>='" << szDateStart << "' AND Date<='" << szDateEnd << "') ORDER BY Date ASC";
 			result = m_sql.query(szQuery.str());
-			int ii = 0;
+			Json::Value row;
 			if (result.size()>0)
 			{
 				std::vector<std::vector<std::string> >::const_iterator itt;
@@ -13259,7 +14132,7 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 				{
 					std::vector<std::string> sd = *itt;
 
-					root["result"][ii]["d"] = sd[7].substr(0, 16);
+					row["d"] = sd[7].substr(0, 16);
 
 					if (
 						(dType == pTypeRego6XXTemp) || (dType == pTypeTEMP) || (dType == pTypeTEMP_HUM) || (dType == pTypeTEMP_HUM_BARO) || (dType == pTypeTEMP_BARO) || (dType == pTypeWIND) || (dType == pTypeThermostat1) ||
@@ -13280,9 +14153,9 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 							double te = ConvertTemperature(atof(sd[1].c_str()), tempsign);
 							double tm = ConvertTemperature(atof(sd[0].c_str()), tempsign);
 							double ta = ConvertTemperature(atof(sd[6].c_str()), tempsign);
-							root["result"][ii]["te"] = te;
-							root["result"][ii]["tm"] = tm;
-							root["result"][ii]["ta"] = ta;
+							row["te"] = te;
+							row["tm"] = tm;
+							row["ta"] = ta;
 						}
 					}
 					if (
@@ -13292,12 +14165,12 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 					{
 						double ch = ConvertTemperature(atof(sd[3].c_str()), tempsign);
 						double cm = ConvertTemperature(atof(sd[2].c_str()), tempsign);
-						root["result"][ii]["ch"] = ch;
-						root["result"][ii]["cm"] = cm;
+						row["ch"] = ch;
+						row["cm"] = cm;
 					}
 					if ((dType == pTypeHUM) || (dType == pTypeTEMP_HUM) || (dType == pTypeTEMP_HUM_BARO))
 					{
-						root["result"][ii]["hu"] = sd[4];
+						row["hu"] = sd[4];
 					}
 					if (
 						(dType == pTypeTEMP_HUM_BARO) ||
@@ -13309,15 +14182,15 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 							if (dSubType == sTypeTHBFloat)
 							{
 								sprintf(szTmp, "%.1f", atof(sd[5].c_str()) / 10.0f);
-								root["result"][ii]["ba"] = szTmp;
+								row["ba"] = szTmp;
 							}
 							else
-								root["result"][ii]["ba"] = sd[5];
+								row["ba"] = sd[5];
 						}
 						else if (dType == pTypeTEMP_BARO)
 						{
 							sprintf(szTmp, "%.1f", atof(sd[5].c_str()) / 10.0f);
-							root["result"][ii]["ba"] = szTmp;
+							row["ba"] = szTmp;
 						}
 					}
 					if((dType == pTypeEvohomeZone) || (dType == pTypeEvohomeWater))
@@ -13325,11 +14198,11 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 						double sm = ConvertTemperature(atof(sd[8].c_str()), tempsign);
 						double sx = ConvertTemperature(atof(sd[9].c_str()), tempsign);
 						double se = ConvertTemperature(atof(sd[10].c_str()), tempsign);
-						root["result"][ii]["sm"] = sm;
-						root["result"][ii]["se"] = se;
-						root["result"][ii]["sx"] = sx;
+						row["sm"] = sm;
+						row["se"] = se;
+						row["sx"] = sx;
 					}
-					ii++;
+					rows.Add(row);
 				}
 			}
 			//add today (have to calculate it)
@@ -13341,7 +14214,7 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 			{
 				std::vector<std::string> sd = result[0];
 
-				root["result"][ii]["d"] = szDateEnd;
+				row["d"] = szDateEnd;
 				if (
 					((dType == pTypeRego6XXTemp) || (dType == pTypeTEMP) || (dType == pTypeTEMP_HUM) || (dType == pTypeTEMP_HUM_BARO) || (dType == pTypeTEMP_BARO) || (dType == pTypeWIND) || (dType == pTypeThermostat1)) ||
 					((dType == pTypeUV) && (dSubType == sTypeUV3)) ||
@@ -13354,9 +14227,9 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 					double tm = ConvertTemperature(atof(sd[0].c_str()), tempsign);
 					double ta = ConvertTemperature(atof(sd[6].c_str()), tempsign);
 
-					root["result"][ii]["te"] = te;
-					root["result"][ii]["tm"] = tm;
-					root["result"][ii]["ta"] = ta;
+					row["te"] = te;
+					row["tm"] = tm;
+					row["ta"] = ta;
 				}
 				if (
 					((dType == pTypeWIND) && (dSubType == sTypeWIND4)) ||
@@ -13365,12 +14238,12 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 				{
 					double ch = ConvertTemperature(atof(sd[3].c_str()), tempsign);
 					double cm = ConvertTemperature(atof(sd[2].c_str()), tempsign);
-					root["result"][ii]["ch"] = ch;
-					root["result"][ii]["cm"] = cm;
+					row["ch"] = ch;
+					row["cm"] = cm;
 				}
 				if ((dType == pTypeHUM) || (dType == pTypeTEMP_HUM) || (dType == pTypeTEMP_HUM_BARO))
 				{
-					root["result"][ii]["hu"] = sd[4];
+					row["hu"] = sd[4];
 				}
 				if (
 					(dType == pTypeTEMP_HUM_BARO) ||
@@ -13382,15 +14255,15 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 						if (dSubType == sTypeTHBFloat)
 						{
 							sprintf(szTmp, "%.1f", atof(sd[5].c_str()) / 10.0f);
-							root["result"][ii]["ba"] = szTmp;
+							row["ba"] = szTmp;
 						}
 						else
-							root["result"][ii]["ba"] = sd[5];
+							row["ba"] = sd[5];
 					}
 					else if (dType == pTypeTEMP_BARO)
 					{
 						sprintf(szTmp, "%.1f", atof(sd[5].c_str()) / 10.0f);
-						root["result"][ii]["ba"] = szTmp;
+						row["ba"] = szTmp;
 					}
 				}
 				if((dType == pTypeEvohomeZone) || (dType == pTypeEvohomeWater))
@@ -13398,11 +14271,11 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 					double sx = ConvertTemperature(atof(sd[8].c_str()), tempsign);
 					double sm = ConvertTemperature(atof(sd[7].c_str()), tempsign);
 					double se = ConvertTemperature(atof(sd[9].c_str()), tempsign);
-					root["result"][ii]["se"] = se;
-					root["result"][ii]["sm"] = sm;
-					root["result"][ii]["sx"] = sx;
+					row["se"] = se;
+					row["sm"] = sm;
+					row["sx"] = sx;
 				}
-				ii++;
+				rows.Add(row);
 			}
 			//Previous Year
 			szQuery.clear();
@@ -13493,7 +14366,7 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 			szQuery.str("");
 			szQuery << "SELECT Percentage_Min, Percentage_Max, Percentage_Avg, Date FROM " << dbasetable << " WHERE (DeviceRowID==" << idx << " AND Date>='" << szDateStart << "' AND Date<='" << szDateEnd << "') ORDER BY Date ASC";
 			result = m_sql.query(szQuery.str());
-			int ii = 0;
+			Json::Value row;
 			if (result.size()>0)
 			{
 				std::vector<std::vector<std::string> >::const_iterator itt;
@@ -13501,11 +14374,11 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 				{
 					std::vector<std::string> sd = *itt;
 
-					root["result"][ii]["d"] = sd[3].substr(0, 16);
-					root["result"][ii]["v_min"] = sd[0];
-					root["result"][ii]["v_max"] = sd[1];
-					root["result"][ii]["v_avg"] = sd[2];
-					ii++;
+					row["d"] = sd[3].substr(0, 16);
+					row["v_min"] = sd[0];
+					row["v_max"] = sd[1];
+					row["v_avg"] = sd[2];
+					rows.Add(row);
 				}
 			}
 			//add today (have to calculate it)
@@ -13516,11 +14389,11 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 			if (result.size()>0)
 			{
 				std::vector<std::string> sd = result[0];
-				root["result"][ii]["d"] = szDateEnd;
-				root["result"][ii]["v_min"] = sd[0];
-				root["result"][ii]["v_max"] = sd[1];
-				root["result"][ii]["v_avg"] = sd[2];
-				ii++;
+				row["d"] = szDateEnd;
+				row["v_min"] = sd[0];
+				row["v_max"] = sd[1];
+				row["v_avg"] = sd[2];
+				rows.Add(row);
 			}
 
 		}
@@ -13532,7 +14405,7 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 			szQuery.str("");
 			szQuery << "SELECT Speed_Min, Speed_Max, Date FROM " << dbasetable << " WHERE (DeviceRowID==" << idx << " AND Date>='" << szDateStart << "' AND Date<='" << szDateEnd << "') ORDER BY Date ASC";
 			result = m_sql.query(szQuery.str());
-			int ii = 0;
+			Json::Value row;
 			if (result.size()>0)
 			{
 				std::vector<std::vector<std::string> >::const_iterator itt;
@@ -13540,10 +14413,10 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 				{
 					std::vector<std::string> sd = *itt;
 
-					root["result"][ii]["d"] = sd[2].substr(0, 16);
-					root["result"][ii]["v_max"] = sd[1];
-					root["result"][ii]["v_min"] = sd[0];
-					ii++;
+					row["d"] = sd[2].substr(0, 16);
+					row["v_max"] = sd[1];
+					row["v_min"] = sd[0];
+					rows.Add(row);
 				}
 			}
 			//add today (have to calculate it)
@@ -13554,10 +14427,10 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 			if (result.size()>0)
 			{
 				std::vector<std::string> sd = result[0];
-				root["result"][ii]["d"] = szDateEnd;
-				root["result"][ii]["v_max"] = sd[1];
-				root["result"][ii]["v_min"] = sd[0];
-				ii++;
+				row["d"] = szDateEnd;
+				row["v_max"] = sd[1];
+				row["v_min"] = sd[0];
+				rows.Add(row);
 			}
 
 		}
@@ -13569,7 +14442,7 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 			szQuery.str("");
 			szQuery << "SELECT Level, Date FROM " << dbasetable << " WHERE (DeviceRowID==" << idx << " AND Date>='" << szDateStart << "' AND Date<='" << szDateEnd << "') ORDER BY Date ASC";
 			result = m_sql.query(szQuery.str());
-			int ii = 0;
+			Json::Value row;
 			if (result.size()>0)
 			{
 				std::vector<std::vector<std::string> >::const_iterator itt;
@@ -13577,9 +14450,9 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 				{
 					std::vector<std::string> sd = *itt;
 
-					root["result"][ii]["d"] = sd[1].substr(0, 16);
-					root["result"][ii]["uvi"] = sd[0];
-					ii++;
+					row["d"] = sd[1].substr(0, 16);
+					row["uvi"] = sd[0];
+					rows.Add(row);
 				}
 			}
 			//add today (have to calculate it)
@@ -13591,9 +14464,9 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 			{
 				std::vector<std::string> sd = result[0];
 
-				root["result"][ii]["d"] = szDateEnd;
-				root["result"][ii]["uvi"] = sd[0];
-				ii++;
+				row["d"] = szDateEnd;
+				row["uvi"] = sd[0];
+				rows.Add(row);
 			}
 			//Previous Year
 			szQuery.clear();
@@ -13622,7 +14495,7 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 			szQuery.str("");
 			szQuery << "SELECT Total, Rate, Date FROM " << dbasetable << " WHERE (DeviceRowID==" << idx << " AND Date>='" << szDateStart << "' AND Date<='" << szDateEnd << "') ORDER BY Date ASC";
 			result = m_sql.query(szQuery.str());
-			int ii = 0;
+			Json::Value row;
 			if (result.size()>0)
 			{
 				std::vector<std::vector<std::string> >::const_iterator itt;
@@ -13630,12 +14503,12 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 				{
 					std::vector<std::string> sd = *itt;
 
-					root["result"][ii]["d"] = sd[2].substr(0, 16);
+					row["d"] = sd[2].substr(0, 16);
 					double mmval = atof(sd[0].c_str());
 					mmval *= AddjMulti;
 					sprintf(szTmp, "%.1f", mmval);
-					root["result"][ii]["mm"] = szTmp;
-					ii++;
+					row["mm"] = szTmp;
+					rows.Add(row);
 				}
 			}
 			//add today (have to calculate it)
@@ -13669,9 +14542,9 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 				}
 				total_real *= AddjMulti;
 				sprintf(szTmp, "%.1f", total_real);
-				root["result"][ii]["d"] = szDateEnd;
-				root["result"][ii]["mm"] = szTmp;
-				ii++;
+				row["d"] = szDateEnd;
+				row["mm"] = szTmp;
+				rows.Add(row);
 			}
 			//Previous Year
 			szQuery.clear();
@@ -13738,7 +14611,7 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 
 			szQuery.clear();
 			szQuery.str("");
-			int ii = 0;
+			Json::Value row;
 			int iPrev = 0;
 			if (dType == pTypeP1Power)
 			{
@@ -13753,7 +14626,7 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 					{
 						std::vector<std::string> sd = *itt;
 
-						root["result"][ii]["d"] = sd[4].substr(0, 16);
+						row["d"] = sd[4].substr(0, 16);
 
 						std::string szUsage1 = sd[0];
 						std::string szDeliv1 = sd[1];
@@ -13768,14 +14641,14 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 						if ((fDeliv_1 != 0) || (fDeliv_2 != 0))
 							bHaveDeliverd = true;
 						sprintf(szTmp, "%.3f", fUsage_1 / EnergyDivider);
-						root["result"][ii]["v"] = szTmp;
+						row["v"] = szTmp;
 						sprintf(szTmp, "%.3f", fUsage_2 / EnergyDivider);
-						root["result"][ii]["v2"] = szTmp;
+						row["v2"] = szTmp;
 						sprintf(szTmp, "%.3f", fDeliv_1 / EnergyDivider);
-						root["result"][ii]["r1"] = szTmp;
+						row["r1"] = szTmp;
 						sprintf(szTmp, "%.3f", fDeliv_2 / EnergyDivider);
-						root["result"][ii]["r2"] = szTmp;
-						ii++;
+						row["r2"] = szTmp;
+						rows.Add(row);
 					}
 					if (bHaveDeliverd)
 					{
@@ -13839,10 +14712,10 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 					{
 						std::vector<std::string> sd = *itt;
 
-						root["result"][ii]["d"] = sd[2].substr(0, 16);
-						root["result"][ii]["co2_min"] = sd[0];
-						root["result"][ii]["co2_max"] = sd[1];
-						ii++;
+						row["d"] = sd[2].substr(0, 16);
+						row["co2_min"] = sd[0];
+						row["co2_max"] = sd[1];
+						rows.Add(row);
 					}
 				}
 			}
@@ -13863,10 +14736,10 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 					{
 						std::vector<std::string> sd = *itt;
 
-						root["result"][ii]["d"] = sd[2].substr(0, 16);
-						root["result"][ii]["v_min"] = sd[0];
-						root["result"][ii]["v_max"] = sd[1];
-						ii++;
+						row["d"] = sd[2].substr(0, 16);
+						row["v_min"] = sd[0];
+						row["v_max"] = sd[1];
+						rows.Add(row);
 					}
 				}
 			}
@@ -13893,7 +14766,7 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 					{
 						std::vector<std::string> sd = *itt;
 
-						root["result"][ii]["d"] = sd[2].substr(0, 16);
+						row["d"] = sd[2].substr(0, 16);
 
 						float fValue1 = float(atof(sd[0].c_str())) / vdiv;
 						float fValue2 = float(atof(sd[1].c_str())) / vdiv;
@@ -13906,13 +14779,13 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 							sprintf(szTmp, "%.3f", fValue1);
 						else
 							sprintf(szTmp, "%.1f", fValue1);
-						root["result"][ii]["v_min"] = szTmp;
+						row["v_min"] = szTmp;
 						if ((dType == pTypeGeneral) && (dSubType == sTypeVoltage))
 							sprintf(szTmp, "%.3f", fValue2);
 						else
 							sprintf(szTmp, "%.1f", fValue2);
-						root["result"][ii]["v_max"] = szTmp;
-						ii++;
+						row["v_max"] = szTmp;
+						rows.Add(row);
 					}
 				}
 			}
@@ -13930,10 +14803,10 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 					{
 						std::vector<std::string> sd = *itt;
 
-						root["result"][ii]["d"] = sd[2].substr(0, 16);
-						root["result"][ii]["lux_min"] = sd[0];
-						root["result"][ii]["lux_max"] = sd[1];
-						ii++;
+						row["d"] = sd[2].substr(0, 16);
+						row["lux_min"] = sd[0];
+						row["lux_max"] = sd[1];
+						rows.Add(row);
 					}
 				}
 			}
@@ -13951,12 +14824,12 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 					{
 						std::vector<std::string> sd = *itt;
 
-						root["result"][ii]["d"] = sd[2].substr(0, 16);
+						row["d"] = sd[2].substr(0, 16);
 						sprintf(szTmp, "%.1f", atof(sd[0].c_str()) / 10.0f);
-						root["result"][ii]["v_min"] = szTmp;
+						row["v_min"] = szTmp;
 						sprintf(szTmp, "%.1f", atof(sd[1].c_str()) / 10.0f);
-						root["result"][ii]["v_max"] = szTmp;
-						ii++;
+						row["v_max"] = szTmp;
+						rows.Add(row);
 					}
 				}
 			}
@@ -13974,10 +14847,10 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 					{
 						std::vector<std::string> sd = *itt;
 
-						root["result"][ii]["d"] = sd[2].substr(0, 16);
-						root["result"][ii]["u_min"] = atof(sd[0].c_str())/10.0f;
-						root["result"][ii]["u_max"] = atof(sd[1].c_str())/10.0f;
-						ii++;
+						row["d"] = sd[2].substr(0, 16);
+						row["u_min"] = atof(sd[0].c_str())/10.0f;
+						row["u_max"] = atof(sd[1].c_str())/10.0f;
+						rows.Add(row);
 					}
 				}
 			}
@@ -14003,7 +14876,7 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 					{
 						std::vector<std::string> sd = *itt;
 
-						root["result"][ii]["d"] = sd[6].substr(0, 16);
+						row["d"] = sd[6].substr(0, 16);
 
 						float fval1 = (float)atof(sd[0].c_str()) / 10.0f;
 						float fval2 = (float)atof(sd[1].c_str()) / 10.0f;
@@ -14022,35 +14895,35 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 						if (displaytype == 0)
 						{
 							sprintf(szTmp, "%.1f", fval1);
-							root["result"][ii]["v1"] = szTmp;
+							row["v1"] = szTmp;
 							sprintf(szTmp, "%.1f", fval2);
-							root["result"][ii]["v2"] = szTmp;
+							row["v2"] = szTmp;
 							sprintf(szTmp, "%.1f", fval3);
-							root["result"][ii]["v3"] = szTmp;
+							row["v3"] = szTmp;
 							sprintf(szTmp, "%.1f", fval4);
-							root["result"][ii]["v4"] = szTmp;
+							row["v4"] = szTmp;
 							sprintf(szTmp, "%.1f", fval5);
-							root["result"][ii]["v5"] = szTmp;
+							row["v5"] = szTmp;
 							sprintf(szTmp, "%.1f", fval6);
-							root["result"][ii]["v6"] = szTmp;
+							row["v6"] = szTmp;
 						}
 						else
 						{
 							sprintf(szTmp, "%d", int(fval1*voltage));
-							root["result"][ii]["v1"] = szTmp;
+							row["v1"] = szTmp;
 							sprintf(szTmp, "%d", int(fval2*voltage));
-							root["result"][ii]["v2"] = szTmp;
+							row["v2"] = szTmp;
 							sprintf(szTmp, "%d", int(fval3*voltage));
-							root["result"][ii]["v3"] = szTmp;
+							row["v3"] = szTmp;
 							sprintf(szTmp, "%d", int(fval4*voltage));
-							root["result"][ii]["v4"] = szTmp;
+							row["v4"] = szTmp;
 							sprintf(szTmp, "%d", int(fval5*voltage));
-							root["result"][ii]["v5"] = szTmp;
+							row["v5"] = szTmp;
 							sprintf(szTmp, "%d", int(fval6*voltage));
-							root["result"][ii]["v6"] = szTmp;
+							row["v6"] = szTmp;
 						}
 
-						ii++;
+						rows.Add(row);
 					}
 					if (
 						(!bHaveL1) &&
@@ -14091,7 +14964,7 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 					{
 						std::vector<std::string> sd = *itt;
 
-						root["result"][ii]["d"] = sd[6].substr(0, 16);
+						row["d"] = sd[6].substr(0, 16);
 
 						float fval1 = (float)atof(sd[0].c_str()) / 10.0f;
 						float fval2 = (float)atof(sd[1].c_str()) / 10.0f;
@@ -14110,35 +14983,35 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 						if (displaytype == 0)
 						{
 							sprintf(szTmp, "%.1f", fval1);
-							root["result"][ii]["v1"] = szTmp;
+							row["v1"] = szTmp;
 							sprintf(szTmp, "%.1f", fval2);
-							root["result"][ii]["v2"] = szTmp;
+							row["v2"] = szTmp;
 							sprintf(szTmp, "%.1f", fval3);
-							root["result"][ii]["v3"] = szTmp;
+							row["v3"] = szTmp;
 							sprintf(szTmp, "%.1f", fval4);
-							root["result"][ii]["v4"] = szTmp;
+							row["v4"] = szTmp;
 							sprintf(szTmp, "%.1f", fval5);
-							root["result"][ii]["v5"] = szTmp;
+							row["v5"] = szTmp;
 							sprintf(szTmp, "%.1f", fval6);
-							root["result"][ii]["v6"] = szTmp;
+							row["v6"] = szTmp;
 						}
 						else
 						{
 							sprintf(szTmp, "%d", int(fval1*voltage));
-							root["result"][ii]["v1"] = szTmp;
+							row["v1"] = szTmp;
 							sprintf(szTmp, "%d", int(fval2*voltage));
-							root["result"][ii]["v2"] = szTmp;
+							row["v2"] = szTmp;
 							sprintf(szTmp, "%d", int(fval3*voltage));
-							root["result"][ii]["v3"] = szTmp;
+							row["v3"] = szTmp;
 							sprintf(szTmp, "%d", int(fval4*voltage));
-							root["result"][ii]["v4"] = szTmp;
+							row["v4"] = szTmp;
 							sprintf(szTmp, "%d", int(fval5*voltage));
-							root["result"][ii]["v5"] = szTmp;
+							row["v5"] = szTmp;
 							sprintf(szTmp, "%d", int(fval6*voltage));
-							root["result"][ii]["v6"] = szTmp;
+							row["v6"] = szTmp;
 						}
 
-						ii++;
+						rows.Add(row);
 					}
 					if (
 						(!bHaveL1) &&
@@ -14218,9 +15091,9 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 							szValue = szTmp;
 							break;
 						}
-						root["result"][ii]["d"] = sd[1].substr(0, 16);
-						root["result"][ii]["v"] = szValue;
-						ii++;
+						row["d"] = sd[1].substr(0, 16);
+						row["v"] = szValue;
+						rows.Add(row);
 					}
 				}
 				//Past Year
@@ -14323,29 +15196,29 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 					if ((total_real_deliv_1 != 0) || (total_real_deliv_2 != 0))
 						bHaveDeliverd = true;
 
-					root["result"][ii]["d"] = szDateEnd;
+					row["d"] = szDateEnd;
 
 					std::string szValue;
 
 					sprintf(szTmp, "%llu", total_real_usage_1);
 					szValue = szTmp;
 					sprintf(szTmp, "%.3f", atof(szValue.c_str()) / EnergyDivider);
-					root["result"][ii]["v"] = szTmp;
+					row["v"] = szTmp;
 					sprintf(szTmp, "%llu", total_real_usage_2);
 					szValue = szTmp;
 					sprintf(szTmp, "%.3f", atof(szValue.c_str()) / EnergyDivider);
-					root["result"][ii]["v2"] = szTmp;
+					row["v2"] = szTmp;
 
 					sprintf(szTmp, "%llu", total_real_deliv_1);
 					szValue = szTmp;
 					sprintf(szTmp, "%.3f", atof(szValue.c_str()) / EnergyDivider);
-					root["result"][ii]["r1"] = szTmp;
+					row["r1"] = szTmp;
 					sprintf(szTmp, "%llu", total_real_deliv_2);
 					szValue = szTmp;
 					sprintf(szTmp, "%.3f", atof(szValue.c_str()) / EnergyDivider);
-					root["result"][ii]["r2"] = szTmp;
+					row["r2"] = szTmp;
 
-					ii++;
+					rows.Add(row);
 				}
 				if (bHaveDeliverd)
 				{
@@ -14358,10 +15231,10 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 				result = m_sql.query(szQuery.str());
 				if (result.size()>0)
 				{
-					root["result"][ii]["d"] = szDateEnd;
-					root["result"][ii]["co2_min"] = result[0][0];
-					root["result"][ii]["co2_max"] = result[0][1];
-					ii++;
+					row["d"] = szDateEnd;
+					row["co2_min"] = result[0][0];
+					row["co2_max"] = result[0][1];
+					rows.Add(row);
 				}
 			}
 			else if (
@@ -14373,10 +15246,10 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 				result = m_sql.query(szQuery.str());
 				if (result.size()>0)
 				{
-					root["result"][ii]["d"] = szDateEnd;
-					root["result"][ii]["v_min"] = result[0][0];
-					root["result"][ii]["v_max"] = result[0][1];
-					ii++;
+					row["d"] = szDateEnd;
+					row["v_min"] = result[0][0];
+					row["v_max"] = result[0][1];
+					rows.Add(row);
 				}
 			}
 			else if (
@@ -14394,7 +15267,7 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 				result = m_sql.query(szQuery.str());
 				if (result.size()>0)
 				{
-					root["result"][ii]["d"] = szDateEnd;
+					row["d"] = szDateEnd;
 					float fValue1 = float(atof(result[0][0].c_str())) / vdiv;
 					float fValue2 = float(atof(result[0][1].c_str())) / vdiv;
 					if (metertype == 1)
@@ -14407,13 +15280,13 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 						sprintf(szTmp, "%.3f", fValue1);
 					else
 						sprintf(szTmp, "%.1f", fValue1);
-					root["result"][ii]["v_min"] = szTmp;
+					row["v_min"] = szTmp;
 					if ((dType == pTypeGeneral) && (dSubType == sTypeVoltage))
 						sprintf(szTmp, "%.3f", fValue2);
 					else
 						sprintf(szTmp, "%.1f", fValue2);
-					root["result"][ii]["v_max"] = szTmp;
-					ii++;
+					row["v_max"] = szTmp;
+					rows.Add(row);
 				}
 			}
 			else if (dType == pTypeLux)
@@ -14422,10 +15295,10 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 				result = m_sql.query(szQuery.str());
 				if (result.size()>0)
 				{
-					root["result"][ii]["d"] = szDateEnd;
-					root["result"][ii]["lux_min"] = result[0][0];
-					root["result"][ii]["lux_max"] = result[0][1];
-					ii++;
+					row["d"] = szDateEnd;
+					row["lux_min"] = result[0][0];
+					row["lux_max"] = result[0][1];
+					rows.Add(row);
 				}
 			}
 			else if (dType == pTypeWEIGHT)
@@ -14434,12 +15307,12 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 				result = m_sql.query(szQuery.str());
 				if (result.size()>0)
 				{
-					root["result"][ii]["d"] = szDateEnd;
+					row["d"] = szDateEnd;
 					sprintf(szTmp, "%.1f", atof(result[0][0].c_str()) / 10.0f);
-					root["result"][ii]["v_min"] = szTmp;
+					row["v_min"] = szTmp;
 					sprintf(szTmp, "%.1f", atof(result[0][1].c_str()) / 10.0f);
-					root["result"][ii]["v_max"] = szTmp;
-					ii++;
+					row["v_max"] = szTmp;
+					rows.Add(row);
 				}
 			}
 			else if (dType == pTypeUsage)
@@ -14448,10 +15321,10 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 				result = m_sql.query(szQuery.str());
 				if (result.size()>0)
 				{
-					root["result"][ii]["d"] = szDateEnd;
-					root["result"][ii]["u_min"] = atof(result[0][0].c_str())/10.0f;
-					root["result"][ii]["u_max"] = atof(result[0][1].c_str())/10.0f;
-					ii++;
+					row["d"] = szDateEnd;
+					row["u_min"] = atof(result[0][0].c_str())/10.0f;
+					row["u_max"] = atof(result[0][1].c_str())/10.0f;
+					rows.Add(row);
 				}
 			}
 			else
@@ -14487,9 +15360,9 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 						break;
 					}
 
-					root["result"][ii]["d"] = szDateEnd;
-					root["result"][ii]["v"] = szValue;
-					ii++;
+					row["d"] = szDateEnd;
+					row["v"] = szValue;
+					rows.Add(row);
 				}
 			}
 		}
@@ -14497,7 +15370,7 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 			root["status"] = "OK";
 			root["title"] = "Graph " + sensor + " " + srange;
 
-			int ii = 0;
+			Json::Value row;
 
 			szQuery.clear();
 			szQuery.str("");
@@ -14510,16 +15383,16 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 				{
 					std::vector<std::string> sd = *itt;
 
-					root["result"][ii]["d"] = sd[5].substr(0, 16);
-					root["result"][ii]["di"] = sd[0];
+					row["d"] = sd[5].substr(0, 16);
+					row["di"] = sd[0];
 
 					int intSpeed = atoi(sd[2].c_str());
 					sprintf(szTmp, "%.1f", float(intSpeed) * m_sql.m_windscale);
-					root["result"][ii]["sp"] = szTmp;
+					row["sp"] = szTmp;
 					int intGust = atoi(sd[4].c_str());
 					sprintf(szTmp, "%.1f", float(intGust) * m_sql.m_windscale);
-					root["result"][ii]["gu"] = szTmp;
-					ii++;
+					row["gu"] = szTmp;
+					rows.Add(row);
 				}
 			}
 			//add today (have to calculate it)
@@ -14531,16 +15404,16 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 			{
 				std::vector<std::string> sd = result[0];
 
-				root["result"][ii]["d"] = szDateEnd;
-				root["result"][ii]["di"] = sd[0];
+				row["d"] = szDateEnd;
+				row["di"] = sd[0];
 
 				int intSpeed = atoi(sd[2].c_str());
 				sprintf(szTmp, "%.1f", float(intSpeed) * m_sql.m_windscale);
-				root["result"][ii]["sp"] = szTmp;
+				row["sp"] = szTmp;
 				int intGust = atoi(sd[4].c_str());
 				sprintf(szTmp, "%.1f", float(intGust) * m_sql.m_windscale);
-				root["result"][ii]["gu"] = szTmp;
-				ii++;
+				row["gu"] = szTmp;
+				rows.Add(row);
 			}
 		}
 	}//month or year
@@ -14612,9 +15485,8 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 			if (sgraphtype == "1")
 			{
 				// Need to get all values of the end date so 23:59:59 is appended to the date string
-				szQuery << "SELECT Temperature, Chill, Humidity, Barometer, Date, DewPoint, SetPoint FROM Temperature WHERE (DeviceRowID==" << idx << " AND Date>='" << szDateStart << "' AND Date<='" << szDateEnd << " 23:59:59') ORDER BY Date ASC";
-				result = m_sql.query(szQuery.str());
-				int ii = 0;
+				result = m_sql.GetShortLog("Temperature", idx, "Temperature, Chill, Humidity, Barometer, Date, DewPoint, SetPoint", szDateStart, szDateEnd);
+				Json::Value row;
 				if (result.size()>0)
 				{
 					std::vector<std::vector<std::string> >::const_iterator itt;
@@ -14622,24 +15494,24 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 					{
 						std::vector<std::string> sd = *itt;
 
-						root["result"][ii]["d"] = sd[4];//.substr(0,16);
+						row["d"] = sd[4];//.substr(0,16);
 						if (sendTemp)
 						{
 							double te = ConvertTemperature(atof(sd[0].c_str()), tempsign);
 							double tm = ConvertTemperature(atof(sd[0].c_str()), tempsign);
-							root["result"][ii]["te"] = te;
-							root["result"][ii]["tm"] = tm;
+							row["te"] = te;
+							row["tm"] = tm;
 						}
 						if (sendChill)
 						{
 							double ch = ConvertTemperature(atof(sd[1].c_str()), tempsign);
 							double cm = ConvertTemperature(atof(sd[1].c_str()), tempsign);
-							root["result"][ii]["ch"] = ch;
-							root["result"][ii]["cm"] = cm;
+							row["ch"] = ch;
+							row["cm"] = cm;
 						}
 						if (sendHum)
 						{
-							root["result"][ii]["hu"] = sd[2];
+							row["hu"] = sd[2];
 						}
 						if (sendBaro)
 						{
@@ -14648,28 +15520,28 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 								if (dSubType == sTypeTHBFloat)
 								{
 									sprintf(szTmp, "%.1f", atof(sd[3].c_str()) / 10.0f);
-									root["result"][ii]["ba"] = szTmp;
+									row["ba"] = szTmp;
 								}
 								else
-									root["result"][ii]["ba"] = sd[3];
+									row["ba"] = sd[3];
 							}
 							else if (dType == pTypeTEMP_BARO)
 							{
 								sprintf(szTmp, "%.1f", atof(sd[3].c_str()) / 10.0f);
-								root["result"][ii]["ba"] = szTmp;
+								row["ba"] = szTmp;
 							}
 						}
 						if (sendDew)
 						{
 							double dp = ConvertTemperature(atof(sd[5].c_str()), tempsign);
-							root["result"][ii]["dp"] = dp;
+							row["dp"] = dp;
 						}
 						if (sendSet)
 						{
 							double se = ConvertTemperature(atof(sd[6].c_str()), tempsign);
-							root["result"][ii]["se"] = se;
+							row["se"] = se;
 						}
-						ii++;
+						rows.Add(row);
 					}
 				}
 			}
@@ -14677,7 +15549,7 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 			{
 				szQuery << "SELECT Temp_Min, Temp_Max, Chill_Min, Chill_Max, Humidity, Barometer, Date, DewPoint, Temp_Avg, SetPoint_Min, SetPoint_Max, SetPoint_Avg FROM Temperature_Calendar WHERE (DeviceRowID==" << idx << " AND Date>='" << szDateStart << "' AND Date<='" << szDateEnd << "') ORDER BY Date ASC";
 				result = m_sql.query(szQuery.str());
-				int ii = 0;
+				Json::Value row;
 				if (result.size()>0)
 				{
 					std::vector<std::vector<std::string> >::const_iterator itt;
@@ -14685,28 +15557,28 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 					{
 						std::vector<std::string> sd = *itt;
 
-						root["result"][ii]["d"] = sd[6].substr(0, 16);
+						row["d"] = sd[6].substr(0, 16);
 						if (sendTemp)
 						{
 							double te = ConvertTemperature(atof(sd[1].c_str()), tempsign);
 							double tm = ConvertTemperature(atof(sd[0].c_str()), tempsign);
 							double ta = ConvertTemperature(atof(sd[8].c_str()), tempsign);
 
-							root["result"][ii]["te"] = te;
-							root["result"][ii]["tm"] = tm;
-							root["result"][ii]["ta"] = ta;
+							row["te"] = te;
+							row["tm"] = tm;
+							row["ta"] = ta;
 						}
 						if (sendChill)
 						{
 							double ch = ConvertTemperature(atof(sd[3].c_str()), tempsign);
 							double cm = ConvertTemperature(atof(sd[2].c_str()), tempsign);
 
-							root["result"][ii]["ch"] = ch;
-							root["result"][ii]["cm"] = cm;
+							row["ch"] = ch;
+							row["cm"] = cm;
 						}
 						if (sendHum)
 						{
-							root["result"][ii]["hu"] = sd[4];
+							row["hu"] = sd[4];
 						}
 						if (sendBaro)
 						{
@@ -14715,36 +15587,36 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 								if (dSubType == sTypeTHBFloat)
 								{
 									sprintf(szTmp, "%.1f", atof(sd[5].c_str()) / 10.0f);
-									root["result"][ii]["ba"] = szTmp;
+									row["ba"] = szTmp;
 								}
 								else
-									root["result"][ii]["ba"] = sd[5];
+									row["ba"] = sd[5];
 							}
 							else if (dType == pTypeTEMP_BARO)
 							{
 								sprintf(szTmp, "%.1f", atof(sd[5].c_str()) / 10.0f);
-								root["result"][ii]["ba"] = szTmp;
+								row["ba"] = szTmp;
 							}
 						}
 						if (sendDew)
 						{
 							double dp = ConvertTemperature(atof(sd[7].c_str()), tempsign);
-							root["result"][ii]["dp"] = dp;
+							row["dp"] = dp;
 						}
 						if (sendSet)
 						{
 							double sm = ConvertTemperature(atof(sd[9].c_str()), tempsign);
 							double sx = ConvertTemperature(atof(sd[10].c_str()), tempsign);
 							double se = ConvertTemperature(atof(sd[11].c_str()), tempsign);
-							root["result"][ii]["sm"] = sm;
-							root["result"][ii]["se"] = se;
-							root["result"][ii]["sx"] = sx;
+							row["sm"] = sm;
+							row["se"] = se;
+							row["sx"] = sx;
 							char szTmp[1024];
 							sprintf(szTmp,"%.1f %.1f %.1f",sm,se,sx);
 							_log.Log(LOG_STATUS,szTmp);
 							
 						}
-						ii++;
+						rows.Add(row);
 					}
 				}
 
@@ -14757,27 +15629,27 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 				{
 					std::vector<std::string> sd = result[0];
 
-					root["result"][ii]["d"] = szDateEnd;
+					row["d"] = szDateEnd;
 					if (sendTemp)
 					{
 						double te = ConvertTemperature(atof(sd[1].c_str()), tempsign);
 						double tm = ConvertTemperature(atof(sd[0].c_str()), tempsign);
 						double ta = ConvertTemperature(atof(sd[7].c_str()), tempsign);
 
-						root["result"][ii]["te"] = te;
-						root["result"][ii]["tm"] = tm;
-						root["result"][ii]["ta"] = ta;
+						row["te"] = te;
+						row["tm"] = tm;
+						row["ta"] = ta;
 					}
 					if (sendChill)
 					{
 						double ch = ConvertTemperature(atof(sd[3].c_str()), tempsign);
 						double cm = ConvertTemperature(atof(sd[2].c_str()), tempsign);
-						root["result"][ii]["ch"] = ch;
-						root["result"][ii]["cm"] = cm;
+						row["ch"] = ch;
+						row["cm"] = cm;
 					}
 					if (sendHum)
 					{
-						root["result"][ii]["hu"] = sd[4];
+						row["hu"] = sd[4];
 					}
 					if (sendBaro)
 					{
@@ -14786,21 +15658,21 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 							if (dSubType == sTypeTHBFloat)
 							{
 								sprintf(szTmp, "%.1f", atof(sd[5].c_str()) / 10.0f);
-								root["result"][ii]["ba"] = szTmp;
+								row["ba"] = szTmp;
 							}
 							else
-								root["result"][ii]["ba"] = sd[5];
+								row["ba"] = sd[5];
 						}
 						else if (dType == pTypeTEMP_BARO)
 						{
 							sprintf(szTmp, "%.1f", atof(sd[5].c_str()) / 10.0f);
-							root["result"][ii]["ba"] = szTmp;
+							row["ba"] = szTmp;
 						}
 					}
 					if (sendDew)
 					{
 						double dp = ConvertTemperature(atof(sd[6].c_str()), tempsign);
-						root["result"][ii]["dp"] = dp;
+						row["dp"] = dp;
 					}
 					if (sendSet)
 					{
@@ -14808,11 +15680,11 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 						double sx = ConvertTemperature(atof(sd[9].c_str()), tempsign);
 						double se = ConvertTemperature(atof(sd[10].c_str()), tempsign);
 						
-						root["result"][ii]["sm"] = sm;
-						root["result"][ii]["se"] = se;
-						root["result"][ii]["sx"] = sx;
+						row["sm"] = sm;
+						row["se"] = se;
+						row["sx"] = sx;
 					}
-					ii++;
+					rows.Add(row);
 				}
 			}
 		}
@@ -14824,7 +15696,7 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 			szQuery.str("");
 			szQuery << "SELECT Level, Date FROM " << dbasetable << " WHERE (DeviceRowID==" << idx << " AND Date>='" << szDateStart << "' AND Date<='" << szDateEnd << "') ORDER BY Date ASC";
 			result = m_sql.query(szQuery.str());
-			int ii = 0;
+			Json::Value row;
 			if (result.size()>0)
 			{
 				std::vector<std::vector<std::string> >::const_iterator itt;
@@ -14832,9 +15704,9 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 				{
 					std::vector<std::string> sd = *itt;
 
-					root["result"][ii]["d"] = sd[1].substr(0, 16);
-					root["result"][ii]["uvi"] = sd[0];
-					ii++;
+					row["d"] = sd[1].substr(0, 16);
+					row["uvi"] = sd[0];
+					rows.Add(row);
 				}
 			}
 			//add today (have to calculate it)
@@ -14846,9 +15718,9 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 			{
 				std::vector<std::string> sd = result[0];
 
-				root["result"][ii]["d"] = szDateEnd;
-				root["result"][ii]["uvi"] = sd[0];
-				ii++;
+				row["d"] = szDateEnd;
+				row["uvi"] = sd[0];
+				rows.Add(row);
 			}
 		}
 		else if (sensor == "rain") {
@@ -14859,7 +15731,7 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 			szQuery.str("");
 			szQuery << "SELECT Total, Rate, Date FROM " << dbasetable << " WHERE (DeviceRowID==" << idx << " AND Date>='" << szDateStart << "' AND Date<='" << szDateEnd << "') ORDER BY Date ASC";
 			result = m_sql.query(szQuery.str());
-			int ii = 0;
+			Json::Value row;
 			if (result.size()>0)
 			{
 				std::vector<std::vector<std::string> >::const_iterator itt;
@@ -14867,9 +15739,9 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 				{
 					std::vector<std::string> sd = *itt;
 
-					root["result"][ii]["d"] = sd[2].substr(0, 16);
-					root["result"][ii]["mm"] = sd[0];
-					ii++;
+					row["d"] = sd[2].substr(0, 16);
+					row["mm"] = sd[0];
+					rows.Add(row);
 				}
 			}
 			//add today (have to calculate it)
@@ -14902,9 +15774,9 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 					total_real = total_max;
 				}
 				sprintf(szTmp, "%.1f", total_real);
-				root["result"][ii]["d"] = szDateEnd;
-				root["result"][ii]["mm"] = szTmp;
-				ii++;
+				row["d"] = szDateEnd;
+				row["mm"] = szTmp;
+				rows.Add(row);
 			}
 		}
 		else if (sensor == "counter") {
@@ -14934,7 +15806,7 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 
 			szQuery.clear();
 			szQuery.str("");
-			int ii = 0;
+			Json::Value row;
 			if (dType == pTypeP1Power)
 			{
 				szQuery << "SELECT Value1,Value2,Value5,Value6, Date FROM " << dbasetable << " WHERE (DeviceRowID==" << idx << " AND Date>='" << szDateStart << "' AND Date<='" << szDateEnd << "') ORDER BY Date ASC";
@@ -14947,7 +15819,7 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 					{
 						std::vector<std::string> sd = *itt;
 
-						root["result"][ii]["d"] = sd[4].substr(0, 16);
+						row["d"] = sd[4].substr(0, 16);
 
 						std::string szUsage1 = sd[0];
 						std::string szDeliv1 = sd[1];
@@ -14960,10 +15832,10 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 						if (fDeliv != 0)
 							bHaveDeliverd = true;
 						sprintf(szTmp, "%.3f", fUsage / EnergyDivider);
-						root["result"][ii]["v"] = szTmp;
+						row["v"] = szTmp;
 						sprintf(szTmp, "%.3f", fDeliv / EnergyDivider);
-						root["result"][ii]["v2"] = szTmp;
-						ii++;
+						row["v2"] = szTmp;
+						rows.Add(row);
 					}
 					if (bHaveDeliverd)
 					{
@@ -14998,9 +15870,9 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 							szValue = szTmp;
 							break;
 						}
-						root["result"][ii]["d"] = sd[1].substr(0, 16);
-						root["result"][ii]["v"] = szValue;
-						ii++;
+						row["d"] = sd[1].substr(0, 16);
+						row["v"] = szValue;
+						rows.Add(row);
 					}
 				}
 			}
@@ -15043,17 +15915,17 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 					if (total_real_deliv != 0)
 						bHaveDeliverd = true;
 
-					root["result"][ii]["d"] = szDateEnd;
+					row["d"] = szDateEnd;
 
 					sprintf(szTmp, "%llu", total_real_usage);
 					std::string szValue = szTmp;
 					sprintf(szTmp, "%.3f", atof(szValue.c_str()) / EnergyDivider);
-					root["result"][ii]["v"] = szTmp;
+					row["v"] = szTmp;
 					sprintf(szTmp, "%llu", total_real_deliv);
 					szValue = szTmp;
 					sprintf(szTmp, "%.3f", atof(szValue.c_str()) / EnergyDivider);
-					root["result"][ii]["v2"] = szTmp;
-					ii++;
+					row["v2"] = szTmp;
+					rows.Add(row);
 					if (bHaveDeliverd)
 					{
 						root["delivered"] = true;
@@ -15093,9 +15965,9 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 						break;
 					}
 
-					root["result"][ii]["d"] = szDateEnd;
-					root["result"][ii]["v"] = szValue;
-					ii++;
+					row["d"] = szDateEnd;
+					row["v"] = szValue;
+					rows.Add(row);
 				}
 			}
 		}
@@ -15103,7 +15975,7 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 			root["status"] = "OK";
 			root["title"] = "Graph " + sensor + " " + srange;
 
-			int ii = 0;
+			Json::Value row;
 
 			szQuery.clear();
 			szQuery.str("");
@@ -15116,16 +15988,16 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 				{
 					std::vector<std::string> sd = *itt;
 
-					root["result"][ii]["d"] = sd[5].substr(0, 16);
-					root["result"][ii]["di"] = sd[0];
+					row["d"] = sd[5].substr(0, 16);
+					row["di"] = sd[0];
 
 					int intSpeed = atoi(sd[2].c_str());
 					sprintf(szTmp, "%.1f", float(intSpeed) * m_sql.m_windscale);
-					root["result"][ii]["sp"] = szTmp;
+					row["sp"] = szTmp;
 					int intGust = atoi(sd[4].c_str());
 					sprintf(szTmp, "%.1f", float(intGust) * m_sql.m_windscale);
-					root["result"][ii]["gu"] = szTmp;
-					ii++;
+					row["gu"] = szTmp;
+					rows.Add(row);
 				}
 			}
 			//add today (have to calculate it)
@@ -15137,16 +16009,16 @@ void CWebServer::RType_HandleGraph(Json::Value &root)
 			{
 				std::vector<std::string> sd = result[0];
 
-				root["result"][ii]["d"] = szDateEnd;
-				root["result"][ii]["di"] = sd[0];
+				row["d"] = szDateEnd;
+				row["di"] = sd[0];
 
 				int intSpeed = atoi(sd[2].c_str());
 				sprintf(szTmp, "%.1f", float(intSpeed) * m_sql.m_windscale);
-				root["result"][ii]["sp"] = szTmp;
+				row["sp"] = szTmp;
 				int intGust = atoi(sd[4].c_str());
 				sprintf(szTmp, "%.1f", float(intGust) * m_sql.m_windscale);
-				root["result"][ii]["gu"] = szTmp;
-				ii++;
+				row["gu"] = szTmp;
+				rows.Add(row);
 			}
 		}
 	}//custom range
@@ -2,6 +2,7 @@
 
 #include <string>
 #include <vector>
+#include <set>
 
 namespace Json
 {
@@ -12,6 +13,7 @@ namespace http {
 	namespace server {
 		class cWebem;
 		struct _tWebUserPassword;
+		class CGraphRows;
 class CWebServer
 {
 	struct _tCustomIcon
@@ -26,6 +28,8 @@ public:
 	~CWebServer(void);
 	bool StartServer(const std::string &listenaddress, const std::string &listenport, const std::string &serverpath, const bool bIgnoreUsernamePassword);
 	void StopServer();
+	//Sends requests to a running instance from several clients at the same time and shows requests/sec and latency (-webloadtest)
+	static void LoadTest(const std::string &url, const int nClients, const int nRequests);
 	void RegisterCommandCode(const char* idname, webserver_response_function ResponseFunction, bool bypassAuthentication=false);
 	void RegisterRType(const char* idname, webserver_response_function ResponseFunction);
 
@@ -57,9 +61,15 @@ public:
 	int FindUser(const char* szUserName);
 	void SetAuthenticationMethod(int amethod);
 	std::vector<_tWebUserPassword> m_users;
+	boost::shared_mutex m_usersmutex;
+	//set by the user commands, the list is reloaded once the command is done (requests run on a thread pool)
+	boost::mutex m_reloadusersmutex;
+	bool m_bReloadUsers;
+	void SetReloadUsers();
+	bool TestAndClearReloadUsers();
 
 	//JSon
-	void GetJSonDevices(Json::Value &root, const std::string &rused, const std::string &rfilter, const std::string &order, const std::string &rowid, const std::string &planID, const std::string &floorID, const bool bDisplayHidden, const time_t LastUpdate);
+	void GetJSonDevices(Json::Value &root, const std::string &rused, const std::string &rfilter, const std::string &order, const std::string &rowid, const std::string &planID, const std::string &floorID, const bool bDisplayHidden, const time_t LastUpdate, const std::set<unsigned long long> *pChangedDevices=NULL, const std::set<unsigned long long> *pChangedScenes=NULL);
 private:
 	void HandleCommand(const std::string &cparam, Json::Value &root);
 	void HandleRType(const std::string &rtype, Json::Value &root);
@@ -90,6 +100,11 @@ private:
 	void Cmd_GetUserVariable(Json::Value &root);
 	void Cmd_AllowNewHardware(Json::Value &root);
 	void Cmd_GetLog(Json::Value &root);
+	void Cmd_GetDBWriterStats(Json::Value &root);
+	void Cmd_GetBackupStatus(Json::Value &root);
+	void Cmd_GetEvohomeSendStats(Json::Value &root);
+	void Cmd_GetDecodeStats(Json::Value &root);
+	void Cmd_GetEventStats(Json::Value &root);
 	void Cmd_AddPlan(Json::Value &root);
 	void Cmd_UpdatePlan(Json::Value &root);
 	void Cmd_DeletePlan(Json::Value &root);
@@ -133,7 +148,8 @@ private:
 	void Cmd_GetDevicesListOnOff(Json::Value &root);
 
 	//RTypes
-	void RType_HandleGraph(Json::Value &root);
+	void RType_HandleGraph(Json::Value &root, boost::shared_ptr<const std::string> &resulttext);
+	void GetGraph(Json::Value &root, CGraphRows &rows);
 	void RType_LightLog(Json::Value &root);
 	void RType_Settings(Json::Value &root);
 	void RType_Events(Json::Value &root);
@@ -193,10 +209,27 @@ private:
 	std::map < std::string, webserver_response_function > m_webcommands;
 	std::map < std::string, webserver_response_function > m_webrtypes;
 	void Do_Work();
-	std::string m_retstr;
+	//Publishes device/scene/uservariable changes to the push (WebSocket/long-poll) clients
+	boost::shared_ptr<boost::thread> m_pushthread;
+	volatile bool m_bPushStopRequested;
+	void Do_PushWork();
+	//return buffer of the include and action functions, one per request thread
+	boost::thread_specific_ptr<std::string> m_pRetStr;
+	std::string &GetRetStr();
 	std::wstring m_wretstr;
 	time_t m_LastUpdateCheck;
 	std::vector<_tCustomIcon> m_custom_light_icons;
+
+	//Graph results, invalidated when the log tables change (see CSQLHelper::GetLogDataVersion)
+	struct _tGraphCacheEntry
+	{
+		unsigned long logversion;
+		time_t lastused;
+		boost::shared_ptr<Json::Value> root; //without the result array
+		boost::shared_ptr<const std::string> resulttext; //result array as JSON text, shared with the replies being sent
+	};
+	boost::mutex m_graphcache_mutex;
+	std::map<std::string, _tGraphCacheEntry> m_graphcache;
 };
 
 } //server
@@ -28,6 +28,8 @@
 #include "Helper.h"
 #include "WebServer.h"
 #include "SQLHelper.h"
+#include "../hardware/evohome.h"
+#include "../hardware/ZWaveBase.h"
 
 #if defined WIN32
 	#include "WindowsHelper.h"
@@ -64,6 +66,12 @@ const char *szHelp=
 #endif
 	"\t-loglevel (0=All, 1=Status+Error, 2=Error)\n"
 	"\t-nocache (do not cache HTML pages (for editing)\n"
+	"\t-tsdbmigrate (copy the 5 minute logs into the time series store, enable it and exit)\n"
+	"\t-tsdbbenchmark (compare size and scan speed of the 5 minute logs and the time series store, and exit)\n"
+	"\t-evoreplay file (decode a captured evohome log, check it against the reference decoder, show the decode rate and exit)\n"
+	"\t-zwavebenchmark (measure the Z-Wave device lookup cost of a value notification and exit)\n"
+	"\t-webloadtest url clients requests (send requests per client to a running instance, show requests/sec and latency and exit)\n"
+	"\t-decodebenchmark (decode packets of several simulated hardware in parallel into decodebenchmark.db, show packets/sec and latency and exit)\n"
 #ifndef WIN32
 	"\t-daemon (run as background daemon)\n"
 	"\t-syslog (use syslog as log output)\n"
@@ -513,6 +521,55 @@ int main(int argc, char**argv)
 	}
 	m_sql.SetDatabaseName(dbasefile);
 
+	if ((cmdLine.HasSwitch("-tsdbmigrate"))||(cmdLine.HasSwitch("-tsdbbenchmark")))
+	{
+		if (!m_sql.OpenDatabase())
+			return 1;
+		if ((cmdLine.HasSwitch("-tsdbmigrate"))&&(!m_sql.MigrateTimeSeriesStore()))
+			return 1;
+		if (cmdLine.HasSwitch("-tsdbbenchmark"))
+			m_sql.BenchmarkTimeSeriesStore();
+		return 0;
+	}
+
+	if (cmdLine.HasSwitch("-evoreplay"))
+	{
+		if (cmdLine.GetArgumentCount("-evoreplay")!=1)
+		{
+			_log.Log(LOG_ERROR,"Please specify an evohome log file");
+			return 1;
+		}
+		return (CEvohome::ReplayLog(cmdLine.GetSafeArgument("-evoreplay",0,"")))?0:1;
+	}
+	if (cmdLine.HasSwitch("-zwavebenchmark"))
+	{
+		ZWaveBase::BenchmarkDeviceIndex();
+		return 0;
+	}
+	if (cmdLine.HasSwitch("-webloadtest"))
+	{
+		if (cmdLine.GetArgumentCount("-webloadtest")<1)
+		{
+			_log.Log(LOG_ERROR,"Please specify an url, for example http://127.0.0.1:8080/json.htm?type=devices&used=true");
+			return 1;
+		}
+		int nClients=atoi(cmdLine.GetSafeArgument("-webloadtest",1,"50").c_str());
+		int nRequests=atoi(cmdLine.GetSafeArgument("-webloadtest",2,"40").c_str());
+		http::server::CWebServer::LoadTest(cmdLine.GetSafeArgument("-webloadtest",0,""),(nClients>0)?nClients:1,(nRequests>0)?nRequests:1);
+		return 0;
+	}
+	if (cmdLine.HasSwitch("-decodebenchmark"))
+	{
+		//the benchmark creates devices, keep them out of the real database
+		std::string benchfile=szStartupFolder+"decodebenchmark.db";
+		std::remove(benchfile.c_str());
+		m_sql.SetDatabaseName(benchfile);
+		if (!m_sql.OpenDatabase())
+			return 1;
+		m_mainworker.BenchmarkDecode();
+		return 0;
+	}
+
 	if (cmdLine.HasSwitch("-wwwroot"))
 	{
 		if (cmdLine.GetArgumentCount("-wwwroot")!=1)
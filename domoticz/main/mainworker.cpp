@@ -11,6 +11,7 @@
 #include "../webserver/Base64.h"
 
 #include <boost/algorithm/string/join.hpp>
+#include <algorithm>
 
 //Hardware Devices
 #include "../hardware/hardwaretypes.h"
@@ -80,6 +81,9 @@
 
 #define round(a) ( int ) ( a + .5 )
 
+//number of decoded packets used for the rate/latency statistics
+#define DECODE_STATS_SAMPLES 1000
+
 extern std::string szStartupFolder;
 extern std::string szWWWFolder;
 extern bool bHasInternalTemperature;
@@ -98,6 +102,7 @@ MainWorker::MainWorker()
 {
 	m_SecCountdown=-1;
 	m_stoprequested=false;
+	m_bBackupRunning=false;
 	m_verboselevel=EVBL_None;
 	m_bStartHardware=false;
 	m_hardwareStartCounter=0;
@@ -112,6 +117,11 @@ MainWorker::MainWorker()
 	m_bHaveDownloadedDomoticzUpdate=false;
 	m_bHaveDownloadedDomoticzUpdateSuccessFull=false;
 	m_bDoDownloadDomoticzUpdate=false;
+
+	m_decodestats_packets=0;
+	m_decodestats_latency_total=0;
+	m_decodestats_latency_max=0;
+	m_decodestats_sample_pos=0;
 }
 
 MainWorker::~MainWorker()
@@ -182,13 +192,13 @@ void MainWorker::AddDomoticzHardware(CDomoticzHardwareBase *pHardware)
 	}
 	boost::lock_guard<boost::mutex> l(m_devicemutex);
 	pHardware->sDecodeRXMessage.connect( boost::bind( &MainWorker::DecodeRXMessage, this, _1, _2 ) );
+	pHardware->sUpdateDevice.connect( boost::bind( &MainWorker::DecodeDeviceUpdate, this, _1, _2 ) );
 	pHardware->sOnConnected.connect( boost::bind( &MainWorker::OnHardwareConnected, this, _1 ) );
 	m_hardwaredevices.push_back(pHardware);
 }
 
 void MainWorker::RemoveDomoticzHardware(CDomoticzHardwareBase *pHardware)
 {
-//	boost::lock_guard<boost::mutex> l1(decodeRXMessageMutex);
 	boost::lock_guard<boost::mutex> l2(m_devicemutex);
 	std::vector<CDomoticzHardwareBase*>::iterator itt;
 	for (itt=m_hardwaredevices.begin(); itt!=m_hardwaredevices.end(); ++itt)
@@ -586,6 +596,11 @@ bool MainWorker::Start()
 	{
 		return false;
 	}
+	//Outgoing http requests (data push, notifications, OpenURL) are handled in the background
+	if (!m_httpclient.StartThread())
+	{
+		_log.Log(LOG_ERROR, "Failed to start the HTTP client thread");
+	}
 	//Add Hardware devices
 	std::vector<std::vector<std::string> > result;
 	std::stringstream szQuery;
@@ -644,6 +659,13 @@ bool MainWorker::Stop()
 
 		m_stoprequested = true;
 		m_thread->join();
+		if (m_backup_thread)
+		{
+			m_sql.AbortBackup();
+			m_backup_thread->join();
+			m_backup_thread.reset();
+		}
+		m_httpclient.StopThread();
 	}
 	return true;
 }
@@ -744,6 +766,28 @@ void MainWorker::GetInternalTemperature()
 	}
 }
 
+void MainWorker::StartAutomaticBackups()
+{
+	if (m_bBackupRunning)
+	{
+		_log.Log(LOG_NORM,"Previous automatic backup still running, skipping this hour");
+		return;
+	}
+	int nValue=0;
+	if ((!m_sql.GetPreferencesVar("UseAutoBackup",nValue))||(nValue!=1))
+		return;
+	if (m_backup_thread)
+		m_backup_thread->join();
+	m_bBackupRunning=true;
+	m_backup_thread = boost::shared_ptr<boost::thread>(new boost::thread(boost::bind(&MainWorker::Do_Backup_Work, this)));
+}
+
+void MainWorker::Do_Backup_Work()
+{
+	HandleAutomaticBackups();
+	m_bBackupRunning=false;
+}
+
 void MainWorker::HandleAutomaticBackups()
 {
 	int nValue=0;
@@ -751,6 +795,11 @@ void MainWorker::HandleAutomaticBackups()
 		return;
 	if (nValue==1)
 	{
+		int nCompress=0;
+		m_sql.GetPreferencesVar("BackupCompress",nCompress);
+		bool bCompress=(nCompress==1);
+		std::string szExtension=(bCompress)?".db.gz":".db";
+
 		std::stringstream backup_DirH;
 		std::stringstream backup_DirD;
 		std::stringstream backup_DirM;
@@ -796,10 +845,10 @@ void MainWorker::HandleAutomaticBackups()
 			if ((lDir = opendir(sbackup_DirH.c_str())) != NULL)
 			{
 				std::stringstream sTmp;
-				sTmp << "backup-hour-" << hour << ".db";
+				sTmp << "backup-hour-" << hour << szExtension;
 
 				std::string OutputFileName=sbackup_DirH + sTmp.str();
-				if (m_sql.BackupDatabase(OutputFileName)) {
+				if (m_sql.BackupDatabase(OutputFileName,bCompress)) {
 					m_sql.SetLastBackupNo("Hour", hour);
 				}
 				else {
@@ -816,10 +865,10 @@ void MainWorker::HandleAutomaticBackups()
 			if ((lDir = opendir(sbackup_DirD.c_str())) != NULL)
 			{
 				std::stringstream sTmp;
-				sTmp << "backup-day-" << day << ".db";
+				sTmp << "backup-day-" << day << szExtension;
 
 				std::string OutputFileName=sbackup_DirD + sTmp.str();
-				if (m_sql.BackupDatabase(OutputFileName)) {
+				if (m_sql.BackupDatabase(OutputFileName,bCompress)) {
 					m_sql.SetLastBackupNo("Day", day);
 				}
 				else {
@@ -835,10 +884,10 @@ void MainWorker::HandleAutomaticBackups()
 			if ((lDir = opendir(sbackup_DirM.c_str())) != NULL)
 			{
 				std::stringstream sTmp;
-				sTmp << "backup-month-" << month+1 << ".db";
+				sTmp << "backup-month-" << month+1 << szExtension;
 
 				std::string OutputFileName=sbackup_DirM + sTmp.str();
-				if (m_sql.BackupDatabase(OutputFileName)) {
+				if (m_sql.BackupDatabase(OutputFileName,bCompress)) {
 					m_sql.SetLastBackupNo("Month", month);
 				}
 				else {
@@ -1017,7 +1066,7 @@ void MainWorker::Do_Work()
 			{
 				m_sql.ScheduleDay();
 			}
-			HandleAutomaticBackups();
+			StartAutomaticBackups();
 		}
 		if ((bHasInternalTemperature)&&(ltime.tm_sec%30==0))
 		{
@@ -1209,10 +1258,414 @@ unsigned long long MainWorker::PerformRealActionFromDomoticzClient(const unsigne
 	return -1;
 }
 
+std::string &MainWorker::LastDeviceName()
+{
+	if (m_pLastDeviceName.get()==NULL)
+		m_pLastDeviceName.reset(new std::string());
+	return *m_pLastDeviceName;
+}
+
+boost::shared_ptr<boost::mutex> MainWorker::GetDecodeMutex(const int HwdID)
+{
+	boost::lock_guard<boost::mutex> l(m_decodemutexes_mutex);
+	boost::shared_ptr<boost::mutex> &pMutex=m_decodemutexes[HwdID];
+	if (!pMutex)
+		pMutex=boost::shared_ptr<boost::mutex>(new boost::mutex);
+	return pMutex;
+}
+
 void MainWorker::DecodeRXMessage(const CDomoticzHardwareBase *pHardware, const unsigned char *pRXCommand)
 {
-	boost::lock_guard<boost::mutex> l(decodeRXMessageMutex);
+	boost::posix_time::ptime tstart=boost::posix_time::microsec_clock::universal_time();
+	{
+		boost::shared_ptr<boost::mutex> pMutex=GetDecodeMutex(pHardware->m_HwdID);
+		boost::lock_guard<boost::mutex> l(*pMutex);
+		DecodeRXMessageInt(pHardware, pRXCommand);
+	}
+	AddDecodeStats(tstart);
+}
+
+void MainWorker::DecodeDeviceUpdate(const CDomoticzHardwareBase *pHardware, const _tDeviceUpdate &update)
+{
+	boost::posix_time::ptime tstart=boost::posix_time::microsec_clock::universal_time();
+	{
+		boost::shared_ptr<boost::mutex> pMutex=GetDecodeMutex(pHardware->m_HwdID);
+		boost::lock_guard<boost::mutex> l(*pMutex);
+		DecodeDeviceUpdateInt(pHardware, update);
+	}
+	AddDecodeStats(tstart);
+}
+
+void MainWorker::AddDecodeStats(const boost::posix_time::ptime &tstart)
+{
+	boost::posix_time::ptime tend=boost::posix_time::microsec_clock::universal_time();
+	long latency=(long)(tend-tstart).total_microseconds();
+
+	boost::lock_guard<boost::mutex> l(m_decodestats_mutex);
+	m_decodestats_packets++;
+	m_decodestats_latency_total+=latency;
+	if (latency>m_decodestats_latency_max)
+		m_decodestats_latency_max=latency;
+	if (m_decodestats_samples.size()<DECODE_STATS_SAMPLES)
+		m_decodestats_samples.push_back(std::pair<boost::posix_time::ptime,long>(tend,latency));
+	else
+		m_decodestats_samples[m_decodestats_sample_pos]=std::pair<boost::posix_time::ptime,long>(tend,latency);
+	m_decodestats_sample_pos=(m_decodestats_sample_pos+1)%DECODE_STATS_SAMPLES;
+}
+
+void MainWorker::GetDecodeStats(_tDecodeStats &stats)
+{
+	boost::lock_guard<boost::mutex> l(m_decodestats_mutex);
+	stats.TotalPackets=m_decodestats_packets;
+	stats.PacketsPerSecond=0;
+	stats.AvgLatency=0;
+	stats.P99Latency=0;
+	stats.MaxLatency=m_decodestats_latency_max;
+	if (m_decodestats_samples.empty())
+		return;
+	stats.AvgLatency=(long)(m_decodestats_latency_total/m_decodestats_packets);
+
+	std::vector<long> latencies;
+	boost::posix_time::ptime tfirst=m_decodestats_samples[0].first;
+	std::vector<std::pair<boost::posix_time::ptime,long> >::const_iterator itt;
+	for (itt=m_decodestats_samples.begin(); itt!=m_decodestats_samples.end(); ++itt)
+	{
+		latencies.push_back(itt->second);
+		if (itt->first<tfirst)
+			tfirst=itt->first;
+	}
+	size_t p99=(latencies.size()*99)/100;
+	std::nth_element(latencies.begin(),latencies.begin()+p99,latencies.end());
+	stats.P99Latency=latencies[p99];
+
+	long elapsed=(long)(boost::posix_time::microsec_clock::universal_time()-tfirst).total_milliseconds();
+	if (elapsed>0)
+		stats.PacketsPerSecond=(float)(latencies.size()*1000.0/elapsed);
+}
+
+void MainWorker::BenchmarkDecodeHardware(const CDomoticzHardwareBase *pHardware, const int nPackets, std::vector<long> *pLatencies)
+{
+	//20 devices per hardware: temperature, temperature/humidity, energy meter and switch packets in turn
+	tRBUF tsen;
+	for (int ii=0; ii<nPackets; ii++)
+	{
+		int devnr=ii%20;
+		memset(&tsen,0,sizeof(RBUF));
+		switch (devnr%4)
+		{
+		case 0:
+			tsen.TEMP.packetlength=sizeof(tsen.TEMP)-1;
+			tsen.TEMP.packettype=pTypeTEMP;
+			tsen.TEMP.subtype=sTypeTEMP1;
+			tsen.TEMP.id1=0;
+			tsen.TEMP.id2=devnr+1;
+			tsen.TEMP.temperatureh=0;
+			tsen.TEMP.temperaturel=(BYTE)(150+(ii%50));
+			tsen.TEMP.battery_level=9;
+			tsen.TEMP.rssi=12;
+			break;
+		case 1:
+			tsen.TEMP_HUM.packetlength=sizeof(tsen.TEMP_HUM)-1;
+			tsen.TEMP_HUM.packettype=pTypeTEMP_HUM;
+			tsen.TEMP_HUM.subtype=sTypeTH1;
+			tsen.TEMP_HUM.id1=0;
+			tsen.TEMP_HUM.id2=devnr+1;
+			tsen.TEMP_HUM.temperatureh=0;
+			tsen.TEMP_HUM.temperaturel=(BYTE)(180+(ii%50));
+			tsen.TEMP_HUM.humidity=(BYTE)(40+(ii%20));
+			tsen.TEMP_HUM.humidity_status=humstat_comfort;
+			tsen.TEMP_HUM.battery_level=9;
+			tsen.TEMP_HUM.rssi=12;
+			break;
+		case 2:
+			tsen.ENERGY.packetlength=sizeof(tsen.ENERGY)-1;
+			tsen.ENERGY.packettype=pTypeENERGY;
+			tsen.ENERGY.subtype=sTypeELEC2;
+			tsen.ENERGY.id1=0;
+			tsen.ENERGY.id2=devnr+1;
+			tsen.ENERGY.count=1;
+			tsen.ENERGY.instant3=(BYTE)(ii%200);
+			tsen.ENERGY.total4=(BYTE)(ii/256);
+			tsen.ENERGY.total5=(BYTE)(ii%256);
+			tsen.ENERGY.battery_level=9;
+			tsen.ENERGY.rssi=12;
+			break;
+		default:
+			tsen.LIGHTING2.packetlength=sizeof(tsen.LIGHTING2)-1;
+			tsen.LIGHTING2.packettype=pTypeLighting2;
+			tsen.LIGHTING2.subtype=sTypeAC;
+			tsen.LIGHTING2.id4=devnr+1;
+			tsen.LIGHTING2.unitcode=1;
+			tsen.LIGHTING2.cmnd=((ii/20)%2)?light2_sOn:light2_sOff;
+			tsen.LIGHTING2.level=((ii/20)%2)?15:0;
+			tsen.LIGHTING2.rssi=12;
+			break;
+		}
+		boost::posix_time::ptime tstart=boost::posix_time::microsec_clock::universal_time();
+		DecodeRXMessage(pHardware,(const unsigned char *)&tsen);
+		pLatencies->push_back((long)(boost::posix_time::microsec_clock::universal_time()-tstart).total_microseconds());
+	}
+}
+
+void MainWorker::BenchmarkDecode()
+{
+	const int nHardware=8;
+	const int nPackets=2000;
+	std::vector<boost::shared_ptr<CDummy> > hardware;
+	std::vector<std::vector<long> > latencies(nHardware);
+	for (int ii=0; ii<nHardware; ii++)
+	{
+		boost::shared_ptr<CDummy> pHardware(new CDummy(1000+ii));
+		pHardware->HwdType=HTYPE_Dummy;
+		pHardware->Name="Benchmark";
+		hardware.push_back(pHardware);
+	}
+	//first pass creates the devices, only the second one is measured
+	for (int ii=0; ii<nHardware; ii++)
+	{
+		std::vector<long> tmp;
+		BenchmarkDecodeHardware(hardware[ii].get(),20,&tmp);
+	}
+
+	eVerboseLevel verboselevel=m_verboselevel;
+	m_verboselevel=EVBL_None;
+	boost::posix_time::ptime tstart=boost::posix_time::microsec_clock::universal_time();
+	std::vector<boost::shared_ptr<boost::thread> > threads;
+	for (int ii=0; ii<nHardware; ii++)
+		threads.push_back(boost::shared_ptr<boost::thread>(new boost::thread(boost::bind(&MainWorker::BenchmarkDecodeHardware, this, hardware[ii].get(), nPackets, &latencies[ii]))));
+	for (int ii=0; ii<nHardware; ii++)
+		threads[ii]->join();
+	long elapsed=(long)(boost::posix_time::microsec_clock::universal_time()-tstart).total_milliseconds();
+	m_verboselevel=verboselevel;
+	m_sql.FlushWriteQueue();
+
+	std::vector<long> all;
+	for (int ii=0; ii<nHardware; ii++)
+		all.insert(all.end(),latencies[ii].begin(),latencies[ii].end());
+	if (all.empty())
+		return;
+	std::sort(all.begin(),all.end());
+	long long total=0;
+	std::vector<long>::const_iterator itt;
+	for (itt=all.begin(); itt!=all.end(); ++itt)
+		total+=*itt;
+	_log.Log(LOG_STATUS,"Decode benchmark: %d hardware, %d packets in %ld ms, %.0f packets/sec",
+		nHardware,(int)all.size(),elapsed,(elapsed>0)?(all.size()*1000.0/elapsed):0.0);
+	_log.Log(LOG_STATUS,"Decode benchmark: latency avg %ld us, p99 %ld us, max %ld us",
+		(long)(total/all.size()),all[(all.size()*99)/100],all[all.size()-1]);
+}
+
+void MainWorker::DecodeDeviceUpdateInt(const CDomoticzHardwareBase *pHardware, const _tDeviceUpdate &update)
+{
+	int HwdID = pHardware->m_HwdID;
+	((CDomoticzHardwareBase *)pHardware)->SetHeartbeatReceived();
+
+	unsigned long long DeviceRowIdx=-1;
+	std::string sdevicetype = RFX_Type_Desc(update.devType, 1);
+	switch (update.devType)
+	{
+	case pTypeGeneral:
+		DeviceRowIdx=update_General(HwdID, update);
+		sdevicetype += "/" + std::string(RFX_Type_SubType_Desc(update.devType, update.subType));
+		break;
+	case pTypeUsage:
+		DeviceRowIdx=update_Usage(HwdID, update);
+		break;
+	case pTypeTEMP:
+		DeviceRowIdx=update_Temp(HwdID, update);
+		break;
+	case pTypeHUM:
+		DeviceRowIdx=update_Hum(HwdID, update);
+		break;
+	case pTypeTEMP_HUM:
+		DeviceRowIdx=update_TempHum(HwdID, update);
+		break;
+	case pTypeP1Power:
+		DeviceRowIdx=update_P1MeterPower(HwdID, update);
+		break;
+	case pTypeP1Gas:
+		DeviceRowIdx=update_P1MeterGas(HwdID, update);
+		break;
+	case pTypeEvohome:
+		DeviceRowIdx=update_evohome1(pHardware, HwdID, update);
+		break;
+	case pTypeEvohomeZone:
+	case pTypeEvohomeWater:
+		DeviceRowIdx=update_evohome2(pHardware, HwdID, update);
+		break;
+	default:
+		_log.Log(LOG_ERROR,"UNHANDLED DEVICE UPDATE TYPE: %02X", update.devType);
+		return;
+	}
+	if (DeviceRowIdx == -1)
+		return;
+
+	time_t now = time(0);
+	struct tm ltime;
+	localtime_r(&now,&ltime);
+	char szDate[40];
+	strftime(szDate,sizeof(szDate),"%a %b %d %H:%M:%S %Y",&ltime);
+
+	std::stringstream sTmp;
+	sTmp << szDate << " (" << pHardware->Name << ") " << sdevicetype << " (" << LastDeviceName() << ")";
+	WriteMessageStart();
+	WriteMessage(sTmp.str().c_str());
+	WriteMessageEnd();
+
+	//Send to connected Sharing Users, they still receive the packet format
+	SendDeviceUpdateToShared(DeviceRowIdx, update);
+
+	//send via data push
+	m_datapush.DoWork(DeviceRowIdx);
+}
+
+void MainWorker::SendDeviceUpdateToShared(const unsigned long long DeviceRowIdx, const _tDeviceUpdate &update)
+{
+	switch (update.devType)
+	{
+	case pTypeGeneral:
+		{
+			_tGeneralDevice gDevice;
+			gDevice.subtype=update.subType;
+			gDevice.id=(unsigned char)update.ID;
+			gDevice.floatval1=update.floatval;
+			gDevice.floatval2=0;
+			gDevice.intval1=update.intval;
+			gDevice.intval2=0;
+			if ((update.subType==sTypeVoltage)||(update.subType==sTypePercentage)||(update.subType==sTypePressure))
+				gDevice.intval1=(int)update.ID;
+			m_sharedserver.SendToAll(DeviceRowIdx,(const char*)&gDevice,sizeof(gDevice),NULL);
+		}
+		break;
+	case pTypeUsage:
+		{
+			_tUsageMeter umeter;
+			umeter.subtype=update.subType;
+			umeter.id1=(BYTE)((update.ID>>24)&0xFF);
+			umeter.id2=(BYTE)((update.ID>>16)&0xFF);
+			umeter.id3=(BYTE)((update.ID>>8)&0xFF);
+			umeter.id4=(BYTE)(update.ID&0xFF);
+			umeter.dunit=update.Unit;
+			umeter.fusage=update.floatval;
+			m_sharedserver.SendToAll(DeviceRowIdx,(const char*)&umeter,sizeof(umeter),NULL);
+		}
+		break;
+	case pTypeTEMP:
+	case pTypeHUM:
+	case pTypeTEMP_HUM:
+		{
+			RBUF tsen;
+			memset(&tsen,0,sizeof(RBUF));
+			//the layout up to the battery/rssi byte is the same for the three packets
+			tsen.TEMP_HUM.packettype=update.devType;
+			tsen.TEMP_HUM.subtype=update.subType;
+			tsen.TEMP_HUM.id1=(BYTE)((update.ID>>8)&0xFF);
+			tsen.TEMP_HUM.id2=(BYTE)(update.ID&0xFF);
+			int at10=round(abs(update.floatval*10.0f));
+			if (update.devType==pTypeTEMP)
+		{
+				tsen.TEMP.packetlength=sizeof(tsen.TEMP)-1;
+				tsen.TEMP.tempsign=(update.floatval>=0)?0:1;
+				tsen.TEMP.temperatureh=(BYTE)(at10/256);
+				tsen.TEMP.temperaturel=(BYTE)(at10%256);
+				tsen.TEMP.battery_level=(update.BatteryLevel==0)?0:9;
+				tsen.TEMP.rssi=update.SignalLevel&0x0F;
+		}
+		else if (update.devType==pTypeHUM)
+		{
+				tsen.HUM.packetlength=sizeof(tsen.HUM)-1;
+				tsen.HUM.humidity=(BYTE)update.intval;
+				tsen.HUM.humidity_status=(BYTE)update.intval2;
+				tsen.HUM.battery_level=(update.BatteryLevel==0)?0:9;
+				tsen.HUM.rssi=update.SignalLevel&0x0F;
+		}
+		else
+		{
+				tsen.TEMP_HUM.packetlength=sizeof(tsen.TEMP_HUM)-1;
+				tsen.TEMP_HUM.tempsign=(update.floatval>=0)?0:1;
+				tsen.TEMP_HUM.temperatureh=(BYTE)(at10/256);
+				tsen.TEMP_HUM.temperaturel=(BYTE)(at10%256);
+				tsen.TEMP_HUM.humidity=(BYTE)update.intval;
+				tsen.TEMP_HUM.humidity_status=(BYTE)update.intval2;
+				tsen.TEMP_HUM.battery_level=(update.BatteryLevel==0)?0:9;
+				tsen.TEMP_HUM.rssi=update.SignalLevel&0x0F;
+		}
+		m_sharedserver.SendToAll(DeviceRowIdx,(const char*)&tsen,tsen.TEMP.packetlength+1,NULL);
+		}
+		break;
+	case pTypeP1Power:
+		{
+			P1Power p1power;
+			memset(&p1power,0,sizeof(p1power));
+			p1power.len=sizeof(P1Power)-1;
+			p1power.type=update.devType;
+			p1power.subtype=update.subType;
+			p1power.powerusage1=update.P1.powerusage1;
+			p1power.powerusage2=update.P1.powerusage2;
+			p1power.powerdeliv1=update.P1.powerdeliv1;
+			p1power.powerdeliv2=update.P1.powerdeliv2;
+			p1power.usagecurrent=update.P1.usagecurrent;
+			p1power.delivcurrent=update.P1.delivcurrent;
+			m_sharedserver.SendToAll(DeviceRowIdx,(const char*)&p1power,sizeof(p1power),NULL);
+		}
+		break;
+	case pTypeP1Gas:
+		{
+			P1Gas p1gas;
+			memset(&p1gas,0,sizeof(p1gas));
+			p1gas.len=sizeof(P1Gas)-1;
+			p1gas.type=update.devType;
+			p1gas.subtype=update.subType;
+			p1gas.gasusage=update.P1.gasusage;
+			m_sharedserver.SendToAll(DeviceRowIdx,(const char*)&p1gas,sizeof(p1gas),NULL);
+		}
+		break;
+	case pTypeEvohome:
+		{
+			REVOBUF tsen;
+			memset(&tsen,0,sizeof(REVOBUF));
+			tsen.EVOHOME1.len=sizeof(tsen.EVOHOME1)-1;
+			tsen.EVOHOME1.type=update.devType;
+			tsen.EVOHOME1.subtype=update.subType;
+			RFX_SETID3(update.ID,tsen.EVOHOME1.id1,tsen.EVOHOME1.id2,tsen.EVOHOME1.id3);
+			tsen.EVOHOME1.status=update.EVOHOME.status;
+			tsen.EVOHOME1.mode=update.EVOHOME.mode;
+			tsen.EVOHOME1.year=update.EVOHOME.year;
+			tsen.EVOHOME1.month=update.EVOHOME.month;
+			tsen.EVOHOME1.day=update.EVOHOME.day;
+			tsen.EVOHOME1.hrs=update.EVOHOME.hrs;
+			tsen.EVOHOME1.mins=update.EVOHOME.mins;
+			tsen.EVOHOME1.action=update.EVOHOME.action;
+			m_sharedserver.SendToAll(DeviceRowIdx,(const char*)&tsen,tsen.EVOHOME1.len+1,NULL);
+		}
+		break;
+	case pTypeEvohomeZone:
+	case pTypeEvohomeWater:
+		{
+			REVOBUF tsen;
+			memset(&tsen,0,sizeof(REVOBUF));
+			tsen.EVOHOME2.len=sizeof(tsen.EVOHOME2)-1;
+			tsen.EVOHOME2.type=update.devType;
+			tsen.EVOHOME2.subtype=update.subType;
+			RFX_SETID3(update.ID,tsen.EVOHOME2.id1,tsen.EVOHOME2.id2,tsen.EVOHOME2.id3);
+			tsen.EVOHOME2.zone=update.Unit;
+			tsen.EVOHOME2.updatetype=update.EVOHOME.updatetype;
+			tsen.EVOHOME2.temperature=update.EVOHOME.temperature;
+			tsen.EVOHOME2.mode=update.EVOHOME.mode;
+			tsen.EVOHOME2.controllermode=update.EVOHOME.controllermode;
+			tsen.EVOHOME2.year=update.EVOHOME.year;
+			tsen.EVOHOME2.month=update.EVOHOME.month;
+			tsen.EVOHOME2.day=update.EVOHOME.day;
+			tsen.EVOHOME2.hrs=update.EVOHOME.hrs;
+			tsen.EVOHOME2.mins=update.EVOHOME.mins;
+			m_sharedserver.SendToAll(DeviceRowIdx,(const char*)&tsen,tsen.EVOHOME2.len+1,NULL);
+		}
+		break;
+	}
+}
 
+void MainWorker::DecodeRXMessageInt(const CDomoticzHardwareBase *pHardware, const unsigned char *pRXCommand)
+{
 	// current date/time based on current system
 	time_t now = time(0);
 
@@ -1234,11 +1687,15 @@ void MainWorker::DecodeRXMessage(const CDomoticzHardwareBase *pHardware, const u
 	_log.Log(LOG_NORM,"%s",sstream.str().c_str());
 #endif
 	// convert now to string form
-	char *szDate = asctime(localtime(&now));
-	szDate[strlen(szDate) - 1] = 0;
+	struct tm ltime;
+	localtime_r(&now,&ltime);
+	char szDate[40];
+	strftime(szDate,sizeof(szDate),"%a %b %d %H:%M:%S %Y",&ltime);
 
 	unsigned long long DeviceRowIdx=-1;
 	tcp::server::CTCPClient *pClient2Ignore=NULL;
+	boost::shared_ptr<boost::mutex> pOrgMutex;
+	boost::unique_lock<boost::mutex> lOrg;
 
 	if (pHardware->HwdType == HTYPE_Domoticz)
 	{
@@ -1269,6 +1726,10 @@ void MainWorker::DecodeRXMessage(const CDomoticzHardwareBase *pHardware, const u
 					{
 						DeviceRowIdx=-1;
 						pClient2Ignore=(tcp::server::CTCPClient*)pHardware->m_pUserData;
+						//keep the order with packets received by the original hardware
+						pOrgMutex=GetDecodeMutex(pOrgHardware->m_HwdID);
+						boost::unique_lock<boost::mutex> lTmp(*pOrgMutex);
+						lOrg.swap(lTmp);
 						pHardware=pOrgHardware;
 						HwdID=pOrgHardware->m_HwdID;
 					}
@@ -1466,7 +1927,7 @@ void MainWorker::DecodeRXMessage(const CDomoticzHardwareBase *pHardware, const u
 		const _tGeneralDevice *pMeter = (const _tGeneralDevice*)pRXCommand;
 		sdevicetype += "/" + std::string(RFX_Type_SubType_Desc(pMeter->type, pMeter->subtype));
 	}
-	sTmp << szDate << " (" << pHardware->Name << ") " << sdevicetype << " (" << m_LastDeviceName << ")";
+	sTmp << szDate << " (" << pHardware->Name << ") " << sdevicetype << " (" << LastDeviceName() << ")";
 	WriteMessageStart();
 	WriteMessage(sTmp.str().c_str());
 	WriteMessageEnd();
@@ -1885,7 +2346,7 @@ unsigned long long MainWorker::decode_Rain(const CDomoticzHardwareBase *pHardwar
 	int Rainrate=(pResponse->RAIN.rainrateh * 256) + pResponse->RAIN.rainratel;
 	float TotalRain=float((pResponse->RAIN.raintotal1 * 65535) + (pResponse->RAIN.raintotal2 * 256) + pResponse->RAIN.raintotal3) / 10.0f;
 	sprintf(szTmp,"%d;%.1f",Rainrate,TotalRain);
-	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,cmnd,szTmp,m_LastDeviceName);
+	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,cmnd,szTmp,LastDeviceName());
 	if (DevRowIdx == -1)
 		return -1;
 
@@ -1969,7 +2430,10 @@ unsigned long long MainWorker::decode_Wind(const CDomoticzHardwareBase *pHardwar
 
 	double dDirection;
 	dDirection = (double)(pResponse->WIND.directionh * 256) + pResponse->WIND.directionl;
-	dDirection=m_wind_calculator[windID].AddValueAndReturnAvarage(dDirection);
+	{
+		boost::lock_guard<boost::mutex> l(m_wind_calculator_mutex);
+		dDirection=m_wind_calculator[windID].AddValueAndReturnAvarage(dDirection);
+	}
 
 	std::string strDirection;
 	if (dDirection > 348.75 || dDirection < 11.26)
@@ -2091,7 +2555,7 @@ unsigned long long MainWorker::decode_Wind(const CDomoticzHardwareBase *pHardwar
 	}
 
 	sprintf(szTmp,"%.2f;%s;%d;%d;%.1f;%.1f",dDirection,strDirection.c_str(),intSpeed,intGust,temp,chill);
-	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,cmnd,szTmp,m_LastDeviceName);
+	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,cmnd,szTmp,LastDeviceName());
 	if (DevRowIdx == -1)
 		return -1;
 
@@ -2177,19 +2641,17 @@ unsigned long long MainWorker::decode_Wind(const CDomoticzHardwareBase *pHardwar
 unsigned long long MainWorker::decode_Temp(const CDomoticzHardwareBase *pHardware, const int HwdID, const tRBUF *pResponse)
 {
 	char szTmp[100];
-	unsigned char devType=pTypeTEMP;
-	unsigned char subType=pResponse->TEMP.subtype;
-	sprintf(szTmp,"%d",(pResponse->TEMP.id1 * 256) + pResponse->TEMP.id2);
-	std::string ID=szTmp;
-	unsigned char Unit=pResponse->TEMP.id2;
+	_tDeviceUpdate update;
+	update.devType=pTypeTEMP;
+	update.subType=pResponse->TEMP.subtype;
+	update.ID=(pResponse->TEMP.id1 * 256) + pResponse->TEMP.id2;
+	update.Unit=pResponse->TEMP.id2;
 
-	unsigned char cmnd=0;
-	unsigned char SignalLevel=pResponse->TEMP.rssi;
-	unsigned char BatteryLevel = 0;
+	update.SignalLevel=pResponse->TEMP.rssi;
 	if ((pResponse->TEMP.battery_level &0x0F) == 0)
-		BatteryLevel=0;
+		update.BatteryLevel=0;
 	else
-		BatteryLevel=100;
+		update.BatteryLevel=100;
 
 	//Override battery level if hardware supports it
 	if (pHardware!=NULL)
@@ -2199,13 +2661,13 @@ unsigned long long MainWorker::decode_Temp(const CDomoticzHardwareBase *pHardwar
 			(pHardware->HwdType == HTYPE_OpenZWave)
 			)
 		{
-			BatteryLevel=pResponse->TEMP.battery_level*10;
+			update.BatteryLevel=pResponse->TEMP.battery_level*10;
 		}
 		else if ((pHardware->HwdType == HTYPE_EnOceanESP2)||(pHardware->HwdType == HTYPE_EnOceanESP3))
 		{
-			BatteryLevel=255;
-			SignalLevel=12;
-			Unit=(pResponse->TEMP.rssi<<4)|pResponse->TEMP.battery_level;
+			update.BatteryLevel=255;
+			update.SignalLevel=12;
+			update.Unit=(pResponse->TEMP.rssi<<4)|pResponse->TEMP.battery_level;
 		}
 	}
 
@@ -2218,47 +2680,12 @@ unsigned long long MainWorker::decode_Temp(const CDomoticzHardwareBase *pHardwar
 	{
 		temp=-(float(((pResponse->TEMP.temperatureh & 0x7F) * 256) + pResponse->TEMP.temperaturel) / 10.0f);
 	}
-	if ((temp<-60)||(temp>380))
-	{
-		WriteMessage(" Invalid Temperature");
-		return -1;
-	}
-
-	float AddjValue=0.0f;
-	float AddjMulti=1.0f;
-	m_sql.GetAddjustment(HwdID, ID.c_str(),Unit,devType,subType,AddjValue,AddjMulti);
-	temp+=AddjValue;
+	update.floatval=temp;
 
-	sprintf(szTmp,"%.1f",temp);
-	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,cmnd,szTmp,m_LastDeviceName);
+	unsigned long long DevRowIdx=update_Temp(HwdID, update);
 	if (DevRowIdx == -1)
 		return -1;
 
-	unsigned char humidity=0;
-	if (pResponse->TEMP.subtype==sTypeTEMP5)
-	{
-		//check if we already had a humidity for this device, if so, keep it!
-		char szTmp[300];
-		std::vector<std::vector<std::string> > result;
-
-		sprintf(szTmp,"SELECT nValue,sValue FROM DeviceStatus WHERE (HardwareID=%d AND DeviceID='%s' AND Unit=%d AND Type=%d AND SubType=%d)",HwdID, ID.c_str(),1,pTypeHUM,sTypeHUM1);
-		result=m_sql.query(szTmp);
-		if (result.size()==1)
-		{
-			m_sql.GetAddjustment(HwdID, ID.c_str(),2,pTypeTEMP_HUM,sTypeTH_LC_TC,AddjValue,AddjMulti);
-			temp+=AddjValue;
-			humidity=atoi(result[0][0].c_str());
-			unsigned char humidity_status=atoi(result[0][1].c_str());
-			sprintf(szTmp,"%.1f;%d;%d",temp,humidity,humidity_status);
-			DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),2,pTypeTEMP_HUM,sTypeTH_LC_TC,SignalLevel,BatteryLevel,0,szTmp,m_LastDeviceName);
-			m_sql.CheckAndHandleTempHumidityNotification(HwdID, ID, 2, pTypeTEMP_HUM, sTypeTH_LC_TC, temp, humidity, true, true);
-			float dewpoint=(float)CalculateDewPoint(temp,humidity);
-			m_sql.CheckAndHandleDewPointNotification(HwdID, ID, 2, pTypeTEMP_HUM, sTypeTH_LC_TC,temp,dewpoint);
-		}
-	}
-
-	m_sql.CheckAndHandleTempHumidityNotification(HwdID, ID, Unit, devType, subType, temp, humidity, true, false);
-
 	if (m_verboselevel == EVBL_ALL)
 	{
 		WriteMessageStart();
@@ -2335,70 +2762,93 @@ unsigned long long MainWorker::decode_Temp(const CDomoticzHardwareBase *pHardwar
 	return DevRowIdx;
 }
 
-unsigned long long MainWorker::decode_Hum(const CDomoticzHardwareBase *pHardware, const int HwdID, const tRBUF *pResponse)
+unsigned long long MainWorker::update_Temp(const int HwdID, const _tDeviceUpdate &update)
 {
 	char szTmp[100];
-	unsigned char devType=pTypeHUM;
-	unsigned char subType=pResponse->HUM.subtype;
-	sprintf(szTmp,"%d",(pResponse->HUM.id1 * 256) + pResponse->HUM.id2);
+	unsigned char devType=update.devType;
+	unsigned char subType=update.subType;
+	sprintf(szTmp,"%lu",update.ID);
 	std::string ID=szTmp;
-	unsigned char Unit=1;
+	unsigned char Unit=update.Unit;
 
-	unsigned char SignalLevel=pResponse->HUM.rssi;
-	unsigned char BatteryLevel = 0;
-	if ((pResponse->HUM.battery_level &0x0F) == 0)
-		BatteryLevel=0;
-	else
-		BatteryLevel=100;
-	//Override battery level if hardware supports it
-	if (pHardware!=NULL)
-	{
-		if (
-			(pHardware->HwdType == HTYPE_RazberryZWave)||
-			(pHardware->HwdType == HTYPE_OpenZWave)
-			)
-		{
-			BatteryLevel=pResponse->TEMP.battery_level;
-		}
-	}
+	unsigned char cmnd=0;
+	unsigned char SignalLevel=update.SignalLevel;
+	unsigned char BatteryLevel=update.BatteryLevel;
 
-	unsigned char humidity=pResponse->HUM.humidity;
-	if (humidity>100)
+	float temp=update.floatval;
+	if ((temp<-60)||(temp>380))
 	{
-		WriteMessage(" Invalid Humidity");
+		WriteMessage(" Invalid Temperature");
 		return -1;
 	}
 
-	sprintf(szTmp,"%d",pResponse->HUM.humidity_status);
-	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,humidity,szTmp,m_LastDeviceName);
+	float AddjValue=0.0f;
+	float AddjMulti=1.0f;
+	m_sql.GetAddjustment(HwdID, ID.c_str(),Unit,devType,subType,AddjValue,AddjMulti);
+	temp+=AddjValue;
+
+	sprintf(szTmp,"%.1f",temp);
+	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,cmnd,szTmp,LastDeviceName());
 	if (DevRowIdx == -1)
 		return -1;
 
-	float temp=0;
-	if (pResponse->HUM.subtype==sTypeHUM1)
+	unsigned char humidity=0;
+	if (subType==sTypeTEMP5)
 	{
 		//check if we already had a humidity for this device, if so, keep it!
 		char szTmp[300];
-		std::vector<std::vector<std::string> > result;
-
-		sprintf(szTmp,"SELECT sValue FROM DeviceStatus WHERE (HardwareID=%d AND DeviceID='%s' AND Unit=%d AND Type=%d AND SubType=%d)",HwdID, ID.c_str(),0,pTypeTEMP,sTypeTEMP5);
-		result=m_sql.query(szTmp);
-		if (result.size()==1)
+		int hum_nValue;
+		std::string hum_sValue;
+		if (m_sql.GetDeviceValue(HwdID, ID, 1, pTypeHUM, sTypeHUM1, hum_nValue, hum_sValue))
 		{
-			temp=(float)atof(result[0][0].c_str());
-			float AddjValue=0.0f;
-			float AddjMulti=1.0f;
 			m_sql.GetAddjustment(HwdID, ID.c_str(),2,pTypeTEMP_HUM,sTypeTH_LC_TC,AddjValue,AddjMulti);
 			temp+=AddjValue;
-			sprintf(szTmp,"%.1f;%d;%d",temp,humidity,pResponse->HUM.humidity_status);
-			DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),2,pTypeTEMP_HUM,sTypeTH_LC_TC,SignalLevel,BatteryLevel,0,szTmp,m_LastDeviceName);
+			humidity=hum_nValue;
+			unsigned char humidity_status=atoi(hum_sValue.c_str());
+			sprintf(szTmp,"%.1f;%d;%d",temp,humidity,humidity_status);
+			DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),2,pTypeTEMP_HUM,sTypeTH_LC_TC,SignalLevel,BatteryLevel,0,szTmp,LastDeviceName());
 			m_sql.CheckAndHandleTempHumidityNotification(HwdID, ID, 2, pTypeTEMP_HUM, sTypeTH_LC_TC, temp, humidity, true, true);
 			float dewpoint=(float)CalculateDewPoint(temp,humidity);
 			m_sql.CheckAndHandleDewPointNotification(HwdID, ID, 2, pTypeTEMP_HUM, sTypeTH_LC_TC,temp,dewpoint);
 		}
 	}
 
-	m_sql.CheckAndHandleTempHumidityNotification(HwdID, ID, Unit, devType, subType, temp, humidity, false, true);
+	m_sql.CheckAndHandleTempHumidityNotification(HwdID, ID, Unit, devType, subType, temp, humidity, true, false);
+
+	return DevRowIdx;
+}
+
+unsigned long long MainWorker::decode_Hum(const CDomoticzHardwareBase *pHardware, const int HwdID, const tRBUF *pResponse)
+{
+	char szTmp[100];
+	_tDeviceUpdate update;
+	update.devType=pTypeHUM;
+	update.subType=pResponse->HUM.subtype;
+	update.ID=(pResponse->HUM.id1 * 256) + pResponse->HUM.id2;
+	update.Unit=1;
+
+	update.SignalLevel=pResponse->HUM.rssi;
+	if ((pResponse->HUM.battery_level &0x0F) == 0)
+		update.BatteryLevel=0;
+	else
+		update.BatteryLevel=100;
+	//Override battery level if hardware supports it
+	if (pHardware!=NULL)
+	{
+		if (
+			(pHardware->HwdType == HTYPE_RazberryZWave)||
+			(pHardware->HwdType == HTYPE_OpenZWave)
+			)
+		{
+			update.BatteryLevel=pResponse->TEMP.battery_level;
+		}
+	}
+	update.intval=pResponse->HUM.humidity;
+	update.intval2=pResponse->HUM.humidity_status;
+
+	unsigned long long DevRowIdx=update_Hum(HwdID, update);
+	if (DevRowIdx == -1)
+		return -1;
 
 	if (m_verboselevel == EVBL_ALL)
 	{
@@ -2453,19 +2903,68 @@ unsigned long long MainWorker::decode_Hum(const CDomoticzHardwareBase *pHardware
 	return DevRowIdx;
 }
 
+unsigned long long MainWorker::update_Hum(const int HwdID, const _tDeviceUpdate &update)
+{
+	char szTmp[100];
+	unsigned char devType=update.devType;
+	unsigned char subType=update.subType;
+	sprintf(szTmp,"%lu",update.ID);
+	std::string ID=szTmp;
+	unsigned char Unit=update.Unit;
+
+	unsigned char SignalLevel=update.SignalLevel;
+	unsigned char BatteryLevel=update.BatteryLevel;
+
+	if ((update.intval<0)||(update.intval>100))
+	{
+		WriteMessage(" Invalid Humidity");
+		return -1;
+	}
+	unsigned char humidity=(unsigned char)update.intval;
+
+	sprintf(szTmp,"%d",update.intval2);
+	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,humidity,szTmp,LastDeviceName());
+	if (DevRowIdx == -1)
+		return -1;
+
+	float temp=0;
+	if (subType==sTypeHUM1)
+	{
+		//check if we already had a humidity for this device, if so, keep it!
+		char szTmp[300];
+		int temp_nValue;
+		std::string temp_sValue;
+		if (m_sql.GetDeviceValue(HwdID, ID, 0, pTypeTEMP, sTypeTEMP5, temp_nValue, temp_sValue))
+		{
+			temp=(float)atof(temp_sValue.c_str());
+			float AddjValue=0.0f;
+			float AddjMulti=1.0f;
+			m_sql.GetAddjustment(HwdID, ID.c_str(),2,pTypeTEMP_HUM,sTypeTH_LC_TC,AddjValue,AddjMulti);
+			temp+=AddjValue;
+			sprintf(szTmp,"%.1f;%d;%d",temp,humidity,update.intval2);
+			DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),2,pTypeTEMP_HUM,sTypeTH_LC_TC,SignalLevel,BatteryLevel,0,szTmp,LastDeviceName());
+			m_sql.CheckAndHandleTempHumidityNotification(HwdID, ID, 2, pTypeTEMP_HUM, sTypeTH_LC_TC, temp, humidity, true, true);
+			float dewpoint=(float)CalculateDewPoint(temp,humidity);
+			m_sql.CheckAndHandleDewPointNotification(HwdID, ID, 2, pTypeTEMP_HUM, sTypeTH_LC_TC,temp,dewpoint);
+		}
+	}
+
+	m_sql.CheckAndHandleTempHumidityNotification(HwdID, ID, Unit, devType, subType, temp, humidity, false, true);
+
+	return DevRowIdx;
+}
+
 unsigned long long MainWorker::decode_TempHum(const CDomoticzHardwareBase *pHardware, const int HwdID, const tRBUF *pResponse)
 {
 	char szTmp[100];
-	unsigned char devType=pTypeTEMP_HUM;
-	unsigned char subType=pResponse->TEMP_HUM.subtype;
-	std::string ID;
-	sprintf(szTmp,"%d",(pResponse->TEMP_HUM.id1 * 256) + pResponse->TEMP_HUM.id2);
-	ID=szTmp;
-	unsigned char Unit=0;
+	_tDeviceUpdate update;
+	update.devType=pTypeTEMP_HUM;
+	update.subType=pResponse->TEMP_HUM.subtype;
+	update.ID=(pResponse->TEMP_HUM.id1 * 256) + pResponse->TEMP_HUM.id2;
+	update.Unit=0;
 
-	unsigned char cmnd=0;
-	unsigned char SignalLevel=pResponse->TEMP_HUM.rssi;
-	unsigned char BatteryLevel = get_BateryLevel(pHardware,pResponse->TEMP_HUM.subtype == sTypeTH8,pResponse->TEMP_HUM.battery_level);
+	update.SignalLevel=pResponse->TEMP_HUM.rssi;
+	update.BatteryLevel=get_BateryLevel(pHardware,pResponse->TEMP_HUM.subtype == sTypeTH8,pResponse->TEMP_HUM.battery_level);
 
 	//Get Channel(Unit)
 	switch (pResponse->TEMP_HUM.subtype)
@@ -2479,7 +2978,7 @@ unsigned long long MainWorker::decode_TempHum(const CDomoticzHardwareBase *pHard
 	case sTypeTH10:
 	case sTypeTH11:
 	case sTypeTH12:
-		Unit = pResponse->TEMP_HUM.id2;
+		update.Unit = pResponse->TEMP_HUM.id2;
 		break;
 	case sTypeTH5:
 	case sTypeTH9:
@@ -2487,15 +2986,15 @@ unsigned long long MainWorker::decode_TempHum(const CDomoticzHardwareBase *pHard
 		break;
 	case sTypeTH7:
 		if (pResponse->TEMP_HUM.id1 < 0x40)
-			Unit = 1;
+			update.Unit = 1;
 		else if (pResponse->TEMP_HUM.id1 < 0x60)
-			Unit = 2;
+			update.Unit = 2;
 		else if (pResponse->TEMP_HUM.id1 < 0x80)
-			Unit = 3;
+			update.Unit = 3;
 		else if ((pResponse->TEMP_HUM.id1 > 0x9F) && (pResponse->TEMP_HUM.id1 < 0xC0))
-			Unit = 4;
+			update.Unit = 4;
 		else if (pResponse->TEMP_HUM.id1 < 0xE0)
-			Unit = 5;
+			update.Unit = 5;
 		break;
 	}
 
@@ -2509,45 +3008,16 @@ unsigned long long MainWorker::decode_TempHum(const CDomoticzHardwareBase *pHard
 	{
 		temp=-(float(((pResponse->TEMP_HUM.temperatureh & 0x7F) * 256) + pResponse->TEMP_HUM.temperaturel) / 10.0f);
 	}
-	if ((temp<-60)||(temp>380))
-	{
-		WriteMessage(" Invalid Temperature");
-		return -1;
-	}
-
-	float AddjValue=0.0f;
-	float AddjMulti=1.0f;
-	m_sql.GetAddjustment(HwdID, ID.c_str(),Unit,devType,subType,AddjValue,AddjMulti);
-	temp+=AddjValue;
+	update.floatval=temp;
 
 	int Humidity = (int)pResponse->TEMP_HUM.humidity;
-	unsigned char HumidityStatus = pResponse->TEMP_HUM.humidity_status;
+	update.intval=Humidity;
+	update.intval2=pResponse->TEMP_HUM.humidity_status;
 
-	if (Humidity>100)
-	{
-		WriteMessage(" Invalid Humidity");
-		return -1;
-	}
-/*
-	AddjValue=0.0f;
-	AddjMulti=1.0f;
-	m_sql.GetAddjustment2(HwdID, ID.c_str(),Unit,devType,subType,AddjValue,AddjMulti);
-	Humidity+=int(AddjValue);
-	if (Humidity>100)
-		Humidity=100;
-	if (Humidity<0)
-		Humidity=0;
-*/
-	sprintf(szTmp,"%.1f;%d;%d",temp,Humidity,HumidityStatus);
-	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,cmnd,szTmp,m_LastDeviceName);
+	unsigned long long DevRowIdx=update_TempHum(HwdID, update);
 	if (DevRowIdx == -1)
 		return -1;
 
-	m_sql.CheckAndHandleTempHumidityNotification(HwdID, ID, Unit, devType, subType, temp, Humidity, true, true);
-
-	float dewpoint=(float)CalculateDewPoint(temp,Humidity);
-	m_sql.CheckAndHandleDewPointNotification(HwdID, ID, Unit, devType, subType,temp,dewpoint);
-
 	if (m_verboselevel == EVBL_ALL)
 	{
 		WriteMessageStart();
@@ -2627,7 +3097,7 @@ unsigned long long MainWorker::decode_TempHum(const CDomoticzHardwareBase *pHard
 
 		sprintf(szTmp,"Sequence nbr  = %d", pResponse->TEMP_HUM.seqnbr);
 		WriteMessage(szTmp);
-		sprintf(szTmp,"ID            = %s", ID.c_str());
+		sprintf(szTmp,"ID            = %lu", update.ID);
 		WriteMessage(szTmp);
 
 		double tvalue=ConvertTemperature(temp,m_sql.m_tempsign[0]);
@@ -2661,6 +3131,62 @@ unsigned long long MainWorker::decode_TempHum(const CDomoticzHardwareBase *pHard
 	return DevRowIdx;
 }
 
+unsigned long long MainWorker::update_TempHum(const int HwdID, const _tDeviceUpdate &update)
+{
+	char szTmp[100];
+	unsigned char devType=update.devType;
+	unsigned char subType=update.subType;
+	sprintf(szTmp,"%lu",update.ID);
+	std::string ID=szTmp;
+	unsigned char Unit=update.Unit;
+
+	unsigned char cmnd=0;
+	unsigned char SignalLevel=update.SignalLevel;
+	unsigned char BatteryLevel=update.BatteryLevel;
+
+	float temp=update.floatval;
+	if ((temp<-60)||(temp>380))
+	{
+		WriteMessage(" Invalid Temperature");
+		return -1;
+	}
+
+	float AddjValue=0.0f;
+	float AddjMulti=1.0f;
+	m_sql.GetAddjustment(HwdID, ID.c_str(),Unit,devType,subType,AddjValue,AddjMulti);
+	temp+=AddjValue;
+
+	int Humidity = update.intval;
+	unsigned char HumidityStatus = (unsigned char)update.intval2;
+
+	if ((Humidity<0)||(Humidity>100))
+	{
+		WriteMessage(" Invalid Humidity");
+		return -1;
+	}
+/*
+	AddjValue=0.0f;
+	AddjMulti=1.0f;
+	m_sql.GetAddjustment2(HwdID, ID.c_str(),Unit,devType,subType,AddjValue,AddjMulti);
+	Humidity+=int(AddjValue);
+	if (Humidity>100)
+		Humidity=100;
+	if (Humidity<0)
+		Humidity=0;
+*/
+	sprintf(szTmp,"%.1f;%d;%d",temp,Humidity,HumidityStatus);
+	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,cmnd,szTmp,LastDeviceName());
+	if (DevRowIdx == -1)
+		return -1;
+
+	m_sql.CheckAndHandleTempHumidityNotification(HwdID, ID, Unit, devType, subType, temp, Humidity, true, true);
+
+	float dewpoint=(float)CalculateDewPoint(temp,Humidity);
+	m_sql.CheckAndHandleDewPointNotification(HwdID, ID, Unit, devType, subType,temp,dewpoint);
+
+	return DevRowIdx;
+}
+
 unsigned long long MainWorker::decode_TempHumBaro(const CDomoticzHardwareBase *pHardware, const int HwdID, const tRBUF *pResponse)
 {
 	char szTmp[100];
@@ -2745,7 +3271,7 @@ unsigned long long MainWorker::decode_TempHumBaro(const CDomoticzHardwareBase *p
 		}
 		sprintf(szTmp,"%.1f;%d;%d;%d;%d",temp,Humidity,HumidityStatus, barometer,forcast);
 	}
-	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,cmnd,szTmp,m_LastDeviceName);
+	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,cmnd,szTmp,LastDeviceName());
 	if (DevRowIdx == -1)
 		return -1;
 
@@ -2883,7 +3409,7 @@ unsigned long long MainWorker::decode_TempBaro(const CDomoticzHardwareBase *pHar
 	fbarometer+=AddjValue;
 
 	sprintf(szTmp,"%.1f;%.1f;%d;%.2f",temp,fbarometer,forcast,pTempBaro->altitude);
-	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,cmnd,szTmp,m_LastDeviceName);
+	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,cmnd,szTmp,LastDeviceName());
 	if (DevRowIdx == -1)
 		return -1;
 
@@ -2985,16 +3511,16 @@ unsigned long long MainWorker::decode_TempRain(const CDomoticzHardwareBase *pHar
 	float TotalRain=float((pResponse->TEMP_RAIN.raintotal1 * 256) + pResponse->TEMP_RAIN.raintotal2) / 10.0f;
 
 	sprintf(szTmp,"%.1f;%.1f",temp,TotalRain);
-	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,cmnd,szTmp,m_LastDeviceName);
+	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,cmnd,szTmp,LastDeviceName());
 	if (DevRowIdx == -1)
 		return -1;
 
 	sprintf(szTmp,"%.1f",temp);
-	unsigned long long DevRowIdxTemp=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,pTypeTEMP,sTypeTEMP3,SignalLevel,BatteryLevel,cmnd,szTmp,m_LastDeviceName);
+	unsigned long long DevRowIdxTemp=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,pTypeTEMP,sTypeTEMP3,SignalLevel,BatteryLevel,cmnd,szTmp,LastDeviceName());
 	m_sql.CheckAndHandleTempHumidityNotification(HwdID, ID, Unit, pTypeTEMP, sTypeTEMP3, temp, 0, true, false);
 
 	sprintf(szTmp,"%d;%.1f",0,TotalRain);
-	unsigned long long DevRowIdxRain=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,pTypeRAIN,sTypeRAIN3,SignalLevel,BatteryLevel,cmnd,szTmp,m_LastDeviceName);
+	unsigned long long DevRowIdxRain=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,pTypeRAIN,sTypeRAIN3,SignalLevel,BatteryLevel,cmnd,szTmp,LastDeviceName());
 	m_sql.CheckAndHandleRainNotification(HwdID, ID, Unit, pTypeRAIN, sTypeRAIN3, NTYPE_RAIN, TotalRain);
 
 	if (m_verboselevel == EVBL_ALL)
@@ -3075,7 +3601,7 @@ unsigned long long MainWorker::decode_UV(const CDomoticzHardwareBase *pHardware,
 	}
 
 	sprintf(szTmp,"%.1f;%.1f",Level,temp);
-	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,cmnd,szTmp,m_LastDeviceName);
+	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,cmnd,szTmp,LastDeviceName());
 	if (DevRowIdx == -1)
 		return -1;
 
@@ -3152,7 +3678,7 @@ unsigned long long MainWorker::decode_Lighting1(const CDomoticzHardwareBase *pHa
 	unsigned char SignalLevel=pResponse->LIGHTING1.rssi;
 	CheckSceneCode(HwdID, ID.c_str(),Unit,devType,subType,cmnd,"");
 
-	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,-1,cmnd,m_LastDeviceName);
+	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,-1,cmnd,LastDeviceName());
 	if (DevRowIdx == -1)
 		return -1;
 
@@ -3340,7 +3866,7 @@ unsigned long long MainWorker::decode_Lighting2(const CDomoticzHardwareBase *pHa
 	unsigned char SignalLevel=pResponse->LIGHTING2.rssi;
 
 	sprintf(szTmp,"%d",level);
-	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,-1,cmnd,szTmp,m_LastDeviceName);
+	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,-1,cmnd,szTmp,LastDeviceName());
 	if (DevRowIdx == -1)
 		return -1;
 	unsigned char check_cmnd=cmnd;
@@ -3479,7 +4005,7 @@ unsigned long long MainWorker::decode_Lighting4(const CDomoticzHardwareBase *pHa
 	unsigned char cmnd=1; //only an on supported
 	unsigned char SignalLevel=pResponse->LIGHTING4.rssi;
 	sprintf(szTmp,"%d",(pResponse->LIGHTING4.pulseHigh*256)+pResponse->LIGHTING4.pulseLow);
-	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,-1,cmnd,szTmp,m_LastDeviceName);
+	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,-1,cmnd,szTmp,LastDeviceName());
 	if (DevRowIdx == -1)
 		return -1;
 	CheckSceneCode(HwdID, ID.c_str(),Unit,devType,subType,cmnd,szTmp);
@@ -3673,7 +4199,7 @@ unsigned long long MainWorker::decode_Lighting5(const CDomoticzHardwareBase *pHa
 	if (bDoUpdate)
 	{
 		sprintf(szTmp,"%d",pResponse->LIGHTING5.level);
-		DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,-1,cmnd,szTmp,m_LastDeviceName);
+		DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,-1,cmnd,szTmp,LastDeviceName());
 		if (DevRowIdx == -1)
 			return -1;
 		CheckSceneCode(HwdID, ID.c_str(),Unit,devType,subType,cmnd,szTmp);
@@ -3987,7 +4513,7 @@ unsigned long long MainWorker::decode_Lighting6(const CDomoticzHardwareBase *pHa
 	unsigned char SignalLevel=pResponse->LIGHTING6.rssi;
 
 	sprintf(szTmp,"%d",rfu);
-	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,-1,cmnd,szTmp,m_LastDeviceName);
+	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,-1,cmnd,szTmp,LastDeviceName());
 	if (DevRowIdx == -1)
 		return -1;
 	CheckSceneCode(HwdID, ID.c_str(),Unit,devType,subType,cmnd,szTmp);
@@ -4059,7 +4585,7 @@ unsigned long long MainWorker::decode_LimitlessLights(const CDomoticzHardwareBas
 	unsigned char cmnd=pLed->command;
 	unsigned char value=pLed->value;
 
-	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,12,-1,cmnd,m_LastDeviceName);
+	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,12,-1,cmnd,LastDeviceName());
 	if (DevRowIdx == -1)
 		return -1;
 	CheckSceneCode(HwdID, ID.c_str(),Unit,devType,subType,cmnd,szTmp);
@@ -4076,6 +4602,7 @@ unsigned long long MainWorker::decode_LimitlessLights(const CDomoticzHardwareBas
 			s_str >> ulID;
 
 			//store light level
+			m_sql.FlushWriteQueue(ulID);
 			sprintf(szTmp,
 				"UPDATE DeviceStatus SET LastLevel='%d' WHERE (ID = %llu)",
 				value,
@@ -4099,7 +4626,7 @@ unsigned long long MainWorker::decode_Chime(const CDomoticzHardwareBase *pHardwa
 	unsigned char cmnd=pResponse->CHIME.sound;
 	unsigned char SignalLevel=pResponse->CHIME.rssi;
 
-	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,-1,cmnd,m_LastDeviceName);
+	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,-1,cmnd,LastDeviceName());
 	if (DevRowIdx == -1)
 		return -1;
 	CheckSceneCode(HwdID, ID.c_str(),Unit,devType,subType,cmnd,"");
@@ -4332,7 +4859,7 @@ unsigned long long MainWorker::decode_Curtain(const CDomoticzHardwareBase *pHard
 	unsigned char cmnd=pResponse->CURTAIN1.cmnd;
 	unsigned char SignalLevel=9;
 
-	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,-1,cmnd,m_LastDeviceName);
+	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,-1,cmnd,LastDeviceName());
 	if (DevRowIdx == -1)
 		return -1;
 
@@ -4401,7 +4928,7 @@ unsigned long long MainWorker::decode_BLINDS1(const CDomoticzHardwareBase *pHard
 	unsigned char cmnd = pResponse->BLINDS1.cmnd;
 	unsigned char SignalLevel=pResponse->BLINDS1.rssi;
 
-	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,-1,cmnd,m_LastDeviceName);
+	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,-1,cmnd,LastDeviceName());
 	if (DevRowIdx == -1)
 		return -1;
 	CheckSceneCode(HwdID, ID.c_str(),Unit,devType,subType,cmnd,szTmp);
@@ -4522,7 +5049,7 @@ unsigned long long MainWorker::decode_RFY(const CDomoticzHardwareBase *pHardware
 	unsigned char cmnd=pResponse->RFY.cmnd;
 	unsigned char SignalLevel=pResponse->RFY.rssi;
 
-	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,-1,cmnd,m_LastDeviceName);
+	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,-1,cmnd,LastDeviceName());
 	if (DevRowIdx == -1)
 		return -1;
 	CheckSceneCode(HwdID, ID.c_str(),Unit,devType,subType,cmnd,szTmp);
@@ -4641,8 +5168,27 @@ unsigned long long MainWorker::decode_RFY(const CDomoticzHardwareBase *pHardware
 
 unsigned long long MainWorker::decode_evohome2(const CDomoticzHardwareBase *pHardware, const int HwdID, const tRBUF *pResponse)
 {
-	char szTmp[100];
 	const REVOBUF *pEvo=reinterpret_cast<const REVOBUF*>(pResponse);
+	_tDeviceUpdate update;
+	update.devType=pEvo->EVOHOME2.type;
+	update.subType=pEvo->EVOHOME2.subtype;
+	update.ID=RFX_GETID3(pEvo->EVOHOME2.id1,pEvo->EVOHOME2.id2,pEvo->EVOHOME2.id3);
+	update.Unit=pEvo->EVOHOME2.zone;
+	update.EVOHOME.updatetype=pEvo->EVOHOME2.updatetype;
+	update.EVOHOME.temperature=pEvo->EVOHOME2.temperature;
+	update.EVOHOME.mode=pEvo->EVOHOME2.mode;
+	update.EVOHOME.controllermode=pEvo->EVOHOME2.controllermode;
+	update.EVOHOME.year=pEvo->EVOHOME2.year;
+	update.EVOHOME.month=pEvo->EVOHOME2.month;
+	update.EVOHOME.day=pEvo->EVOHOME2.day;
+	update.EVOHOME.hrs=pEvo->EVOHOME2.hrs;
+	update.EVOHOME.mins=pEvo->EVOHOME2.mins;
+	return update_evohome2(pHardware, HwdID, update);
+}
+
+unsigned long long MainWorker::update_evohome2(const CDomoticzHardwareBase *pHardware, const int HwdID, const _tDeviceUpdate &update)
+{
+	char szTmp[100];
 	unsigned char cmnd=0;
 	unsigned char SignalLevel=255;//Unknown
 	unsigned char BatteryLevel = 255;//Unknown
@@ -4651,16 +5197,16 @@ unsigned long long MainWorker::decode_evohome2(const CDomoticzHardwareBase *pHar
 	std::vector<std::vector<std::string> > result;
 	std::stringstream szQuery;
 	szQuery << "SELECT HardwareID, DeviceID,Unit,Type,SubType,sValue FROM DeviceStatus WHERE (HardwareID==" << HwdID << ") AND (";
-	if(pEvo->EVOHOME2.zone)//if unit number is available the id3 will be the controller device id
+	if(update.Unit)//if unit number is available the id3 will be the controller device id
 	{
-		szQuery << "Unit == " << (int)pEvo->EVOHOME2.zone << ") AND (Type==" << (int)pEvo->EVOHOME2.type << ")";
+		szQuery << "Unit == " << (int)update.Unit << ") AND (Type==" << (int)update.devType << ")";
 	}
 	else//unit number not available then id3 should be the zone device id
 	{
-		szQuery << "DeviceID == '" << std::hex << (int)RFX_GETID3(pEvo->EVOHOME2.id1,pEvo->EVOHOME2.id2,pEvo->EVOHOME2.id3) << std::dec << "')";
+		szQuery << "DeviceID == '" << std::hex << update.ID << std::dec << "')";
 	}
 	result=m_sql.query(szQuery.str());
-	if (result.size()<1 && !pEvo->EVOHOME2.zone)
+	if (result.size()<1 && !update.Unit)
 		return -1;
 
 	bool bNewDev=false;
@@ -4681,9 +5227,9 @@ unsigned long long MainWorker::decode_evohome2(const CDomoticzHardwareBase *pHar
 	else
 	{
 		bNewDev=true;
-		Unit=pEvo->EVOHOME2.zone;//should always be non zero
-		dType=pEvo->EVOHOME2.type;
-		dSubType=pEvo->EVOHOME2.subtype;		
+		Unit=update.Unit;//should always be non zero
+		dType=update.devType;
+		dSubType=update.subType;		
 		if(!pHardware)
 			return -1;
 		CEvohome *pEvoHW=(CEvohome*)pHardware;//do we have rtti
@@ -4696,30 +5242,30 @@ unsigned long long MainWorker::decode_evohome2(const CDomoticzHardwareBase *pHar
 		szUpdateStat="0.0;0.0;Auto";
 	}
 	
-	if(dType==pTypeEvohomeWater && pEvo->EVOHOME2.updatetype==CEvohome::updSetPoint)
-		sprintf(szTmp,"%s",pEvo->EVOHOME2.temperature?"On":"Off");
+	if(dType==pTypeEvohomeWater && update.EVOHOME.updatetype==CEvohome::updSetPoint)
+		sprintf(szTmp,"%s",update.EVOHOME.temperature?"On":"Off");
 	else
-		sprintf(szTmp,"%.1f",pEvo->EVOHOME2.temperature/100.0f);
+		sprintf(szTmp,"%.1f",update.EVOHOME.temperature/100.0f);
 	
 	std::vector<std::string> strarray;
 	StringSplit(szUpdateStat, ";", strarray);
 	if (strarray.size() >= 3)
 	{
-		if(pEvo->EVOHOME2.updatetype==CEvohome::updSetPoint)//SetPoint
+		if(update.EVOHOME.updatetype==CEvohome::updSetPoint)//SetPoint
 		{
 			strarray[1]=szTmp;
-			if(pEvo->EVOHOME2.mode<=CEvohome::zmTmp)//for the moment only update this if we get a valid setpoint mode as we can now send setpoint on its own
+			if(update.EVOHOME.mode<=CEvohome::zmTmp)//for the moment only update this if we get a valid setpoint mode as we can now send setpoint on its own
 			{
-				int nControllerMode=pEvo->EVOHOME2.controllermode;
+				int nControllerMode=update.EVOHOME.controllermode;
 				if(dType==pTypeEvohomeWater && (nControllerMode==CEvohome::cmEvoHeatingOff || nControllerMode==CEvohome::cmEvoAutoWithEco || nControllerMode==CEvohome::cmEvoCustom))//dhw has no economy mode and does not turn off for heating off also appears custom does not support the dhw zone
 					nControllerMode=CEvohome::cmEvoAuto;
-				if(pEvo->EVOHOME2.mode==CEvohome::zmAuto || nControllerMode==CEvohome::cmEvoHeatingOff)//if zonemode is auto (followschedule) or controllermode is heatingoff
+				if(update.EVOHOME.mode==CEvohome::zmAuto || nControllerMode==CEvohome::cmEvoHeatingOff)//if zonemode is auto (followschedule) or controllermode is heatingoff
 					strarray[2]=CEvohome::GetWebAPIModeName(nControllerMode);//the web front end ultimately uses these names for images etc.
 				else
-					strarray[2]=CEvohome::GetZoneModeName(pEvo->EVOHOME2.mode);
-				if(pEvo->EVOHOME2.mode==CEvohome::zmTmp)
+					strarray[2]=CEvohome::GetZoneModeName(update.EVOHOME.mode);
+				if(update.EVOHOME.mode==CEvohome::zmTmp)
 				{
-					std::string szISODate(CEvohomeDateTime::GetISODate(pEvo->EVOHOME2));
+					std::string szISODate(CEvohomeDateTime::GetISODate(update.EVOHOME));
 					if(strarray.size()<4) //add or set until
 						strarray.push_back(szISODate);
 					else
@@ -4730,9 +5276,9 @@ unsigned long long MainWorker::decode_evohome2(const CDomoticzHardwareBase *pHar
 						strarray.resize(3);
 			}
 		}
-		else if(pEvo->EVOHOME2.updatetype==CEvohome::updOverride)
+		else if(update.EVOHOME.updatetype==CEvohome::updOverride)
 		{
-			strarray[2]=CEvohome::GetZoneModeName(pEvo->EVOHOME2.mode);
+			strarray[2]=CEvohome::GetZoneModeName(update.EVOHOME.mode);
 			if(strarray.size()>=4) //remove until
 				strarray.resize(3);
 		}
@@ -4740,7 +5286,7 @@ unsigned long long MainWorker::decode_evohome2(const CDomoticzHardwareBase *pHar
 			strarray[0]=szTmp;
 		szUpdateStat=boost::algorithm::join(strarray, ";");
 	}
-	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, szDevID.c_str(),Unit,dType,dSubType,SignalLevel,BatteryLevel,cmnd,szUpdateStat.c_str(),m_LastDeviceName);
+	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, szDevID.c_str(),Unit,dType,dSubType,SignalLevel,BatteryLevel,cmnd,szUpdateStat.c_str(),LastDeviceName());
 	if (DevRowIdx == -1)
 		return -1;
 	if(bNewDev)
@@ -4755,21 +5301,39 @@ unsigned long long MainWorker::decode_evohome2(const CDomoticzHardwareBase *pHar
 
 unsigned long long MainWorker::decode_evohome1(const CDomoticzHardwareBase *pHardware, const int HwdID, const tRBUF *pResponse)
 {
-	char szTmp[100];
 	const REVOBUF *pEvo=reinterpret_cast<const REVOBUF*>(pResponse);
+	_tDeviceUpdate update;
+	update.devType=pTypeEvohome;
+	update.subType=pEvo->EVOHOME1.subtype;
+	update.ID=RFX_GETID3(pEvo->EVOHOME1.id1,pEvo->EVOHOME1.id2,pEvo->EVOHOME1.id3);
+	update.Unit=0;
+	update.EVOHOME.status=pEvo->EVOHOME1.status;
+	update.EVOHOME.mode=pEvo->EVOHOME1.mode;
+	update.EVOHOME.year=pEvo->EVOHOME1.year;
+	update.EVOHOME.month=pEvo->EVOHOME1.month;
+	update.EVOHOME.day=pEvo->EVOHOME1.day;
+	update.EVOHOME.hrs=pEvo->EVOHOME1.hrs;
+	update.EVOHOME.mins=pEvo->EVOHOME1.mins;
+	update.EVOHOME.action=pEvo->EVOHOME1.action;
+	return update_evohome1(pHardware, HwdID, update);
+}
+
+unsigned long long MainWorker::update_evohome1(const CDomoticzHardwareBase *pHardware, const int HwdID, const _tDeviceUpdate &update)
+{
+	char szTmp[100];
 	unsigned char devType=pTypeEvohome;
-	unsigned char subType=pEvo->EVOHOME1.subtype;
+	unsigned char subType=update.subType;
 	std::stringstream szID;
-	szID << std::hex << (int)RFX_GETID3(pEvo->EVOHOME1.id1,pEvo->EVOHOME1.id2,pEvo->EVOHOME1.id3);
+	szID << std::hex << update.ID;
 	std::string ID(szID.str());
 	unsigned char Unit=0;
-	unsigned char cmnd=pEvo->EVOHOME1.status;
+	unsigned char cmnd=update.EVOHOME.status;
 	unsigned char SignalLevel=255;//Unknown
 	unsigned char BatteryLevel = 255;//Unknown
 
 	std::string szUntilDate;
-	if(pEvo->EVOHOME1.mode==CEvohome::cmTmp)//temporary
-		szUntilDate=CEvohomeDateTime::GetISODate(pEvo->EVOHOME1);
+	if(update.EVOHOME.mode==CEvohome::cmTmp)//temporary
+		szUntilDate=CEvohomeDateTime::GetISODate(update.EVOHOME);
 
 	//FIXME A similar check is also done in switchmodal do we want to forward the ooc flag and rely on this check entirely?
 	std::vector<std::vector<std::string> > result;
@@ -4795,7 +5359,7 @@ unsigned long long MainWorker::decode_evohome1(const CDomoticzHardwareBase *pHar
 			return -1;
 	}
 
-	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,cmnd,szUntilDate.c_str(),m_LastDeviceName,pEvo->EVOHOME1.action);
+	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,cmnd,szUntilDate.c_str(),LastDeviceName(),update.EVOHOME.action);
 	if (DevRowIdx == -1)
 		return -1;
 	if(bNewDev)
@@ -4810,20 +5374,20 @@ unsigned long long MainWorker::decode_evohome1(const CDomoticzHardwareBase *pHar
 	if (m_verboselevel == EVBL_ALL)
 	{
 		WriteMessageStart();
-		switch (pEvo->EVOHOME1.subtype)
+		switch (update.subType)
 		{
 		case sTypeEvohome:
 			WriteMessage("subtype       = Evohome");
 			break;
 		default:
-			sprintf(szTmp,"ERROR: Unknown Sub type for Packet type= %02X:%02X", pEvo->EVOHOME1.type, pEvo->EVOHOME1.subtype);
+			sprintf(szTmp,"ERROR: Unknown Sub type for Packet type= %02X:%02X", update.devType, update.subType);
 			WriteMessage(szTmp);
 			break;
 		}
 
-		sprintf(szTmp, "id         = %02X:%02X:%02X", pEvo->EVOHOME1.id1, pEvo->EVOHOME1.id2, pEvo->EVOHOME1.id3);
+		sprintf(szTmp, "id         = %02X:%02X:%02X", (unsigned int)((update.ID>>16)&0xFF), (unsigned int)((update.ID>>8)&0xFF), (unsigned int)(update.ID&0xFF));
 		WriteMessage(szTmp);
-		WriteMessage("status        = %s", CEvohome::GetControllerModeName(pEvo->EVOHOME1.status));
+		WriteMessage("status        = %s", CEvohome::GetControllerModeName(update.EVOHOME.status));
 
 		WriteMessageEnd();
 	}
@@ -4851,7 +5415,7 @@ unsigned long long MainWorker::decode_Security1(const CDomoticzHardwareBase *pHa
 		BatteryLevel=255;
 	}
 
-	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,cmnd,m_LastDeviceName);
+	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,cmnd,LastDeviceName());
 	if (DevRowIdx == -1)
 		return -1;
 	CheckSceneCode(HwdID, ID.c_str(),Unit,devType,subType,cmnd,"");
@@ -5112,7 +5676,7 @@ unsigned long long MainWorker::decode_Remote(const CDomoticzHardwareBase *pHardw
 	unsigned char cmnd=light2_sOn;
 	unsigned char SignalLevel=pResponse->REMOTE.rssi;
 
-	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,-1,cmnd,m_LastDeviceName);
+	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,-1,cmnd,LastDeviceName());
 	if (DevRowIdx == -1)
 		return -1;
 	CheckSceneCode(HwdID, ID.c_str(),Unit,devType,subType,cmnd,"");
@@ -6204,7 +6768,7 @@ unsigned long long MainWorker::decode_Thermostat1(const CDomoticzHardwareBase *p
 	unsigned char status=(pResponse->THERMOSTAT1.status & 0x03);
 
 	sprintf(szTmp,"%d;%d;%d;%d",temp,set_point,mode,status);
-	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,cmnd,szTmp,m_LastDeviceName);
+	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,cmnd,szTmp,LastDeviceName());
 	if (DevRowIdx == -1)
 		return -1;
 
@@ -6347,7 +6911,7 @@ unsigned long long MainWorker::decode_Thermostat3(const CDomoticzHardwareBase *p
 	unsigned char BatteryLevel = 255;
 	CheckSceneCode(HwdID, ID.c_str(),Unit,devType,subType,cmnd,"");
 
-	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,cmnd,m_LastDeviceName);
+	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,cmnd,LastDeviceName());
 	if (DevRowIdx == -1)
 		return -1;
 
@@ -6510,7 +7074,7 @@ unsigned long long MainWorker::decode_Current(const CDomoticzHardwareBase *pHard
 	float CurrentChannel2= float((pResponse->CURRENT.ch2h * 256) + pResponse->CURRENT.ch2l) / 10.0f;
 	float CurrentChannel3= float((pResponse->CURRENT.ch3h * 256) + pResponse->CURRENT.ch3l) / 10.0f;
 	sprintf(szTmp,"%.1f;%.1f;%.1f",CurrentChannel1,CurrentChannel2,CurrentChannel3);
-	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,cmnd,szTmp,m_LastDeviceName);
+	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,cmnd,szTmp,LastDeviceName());
 	if (DevRowIdx == -1)
 		return -1;
 
@@ -6583,7 +7147,7 @@ unsigned long long MainWorker::decode_Energy(const CDomoticzHardwareBase *pHardw
 			) / 223.666;
 
 	sprintf(szTmp,"%ld;%.2f",instant,usage);
-	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,cmnd,szTmp,m_LastDeviceName);
+	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,cmnd,szTmp,LastDeviceName());
 	if (DevRowIdx == -1)
 		return -1;
 
@@ -6650,7 +7214,7 @@ unsigned long long MainWorker::decode_Power(const CDomoticzHardwareBase *pHardwa
 	int frequency = pResponse->POWER.freq; //Hz
 
 	sprintf(szTmp,"%ld;%.2f",long(round(instant)),usage*1000.0);
-	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,cmnd,szTmp,m_LastDeviceName);
+	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,cmnd,szTmp,LastDeviceName());
 	if (DevRowIdx == -1)
 		return -1;
 
@@ -6715,14 +7279,12 @@ unsigned long long MainWorker::decode_Current_Energy(const CDomoticzHardwareBase
 	if (pResponse->CURRENT_ENERGY.count!=0)
 	{
 		//no usage provided, get the last usage
-		std::vector<std::vector<std::string> > result2;
-		std::stringstream szQuery2;
-		szQuery2 << "SELECT nValue,sValue FROM DeviceStatus WHERE (HardwareID=" << HwdID << " AND DeviceID='" << ID << "' AND Unit=" << int(Unit) << " AND Type=" << int(devType) << " AND SubType=" << int(subType) << ")";
-		result2=m_sql.query(szQuery2.str());
-		if (result2.size()>0)
+		int last_nValue;
+		std::string last_sValue;
+		if (m_sql.GetDeviceValue(HwdID, ID, Unit, devType, subType, last_nValue, last_sValue))
 		{
 			std::vector<std::string> strarray;
-			StringSplit(result2[0][1], ";", strarray);
+			StringSplit(last_sValue, ";", strarray);
 			if (strarray.size()==4)
 			{
 				usage = atof(strarray[3].c_str());
@@ -6744,14 +7306,12 @@ unsigned long long MainWorker::decode_Current_Energy(const CDomoticzHardwareBase
 		{
 			//That should not be, let's get the previous value
 			//no usage provided, get the last usage
-			std::vector<std::vector<std::string> > result2;
-			std::stringstream szQuery2;
-			szQuery2 << "SELECT nValue,sValue FROM DeviceStatus WHERE (HardwareID=" << HwdID << " AND DeviceID='" << ID << "' AND Unit=" << int(Unit) << " AND Type=" << int(devType) << " AND SubType=" << int(subType) << ")";
-			result2=m_sql.query(szQuery2.str());
-			if (result2.size()>0)
+			int last_nValue;
+			std::string last_sValue;
+			if (m_sql.GetDeviceValue(HwdID, ID, Unit, devType, subType, last_nValue, last_sValue))
 			{
 				std::vector<std::string> strarray;
-				StringSplit(result2[0][1], ";", strarray);
+				StringSplit(last_sValue, ";", strarray);
 				if (strarray.size()==4)
 				{
 					usage = atof(strarray[3].c_str());
@@ -6763,10 +7323,10 @@ unsigned long long MainWorker::decode_Current_Energy(const CDomoticzHardwareBase
 		m_sql.GetPreferencesVar("ElectricVoltage", voltage);
 
 		sprintf(szTmp,"%ld;%.2f",(long)round((CurrentChannel1+CurrentChannel2+CurrentChannel3)*voltage),usage);
-		m_sql.UpdateValue(HwdID, ID.c_str(),Unit,pTypeENERGY,sTypeELEC3,SignalLevel,BatteryLevel,cmnd,szTmp,m_LastDeviceName);
+		m_sql.UpdateValue(HwdID, ID.c_str(),Unit,pTypeENERGY,sTypeELEC3,SignalLevel,BatteryLevel,cmnd,szTmp,LastDeviceName());
 	}
 	sprintf(szTmp,"%.1f;%.1f;%.1f;%.3f",CurrentChannel1,CurrentChannel2,CurrentChannel3,usage);
-	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,cmnd,szTmp,m_LastDeviceName);
+	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,cmnd,szTmp,LastDeviceName());
 	if (DevRowIdx == -1)
 		return -1;
 
@@ -6866,7 +7426,7 @@ unsigned long long MainWorker::decode_Weight(const CDomoticzHardwareBase *pHardw
 	weight+=AddjValue;
 
 	sprintf(szTmp,"%.1f",weight);
-	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,cmnd,szTmp,m_LastDeviceName);
+	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,cmnd,szTmp,LastDeviceName());
 	if (DevRowIdx == -1)
 		return -1;
 
@@ -6950,7 +7510,7 @@ unsigned long long MainWorker::decode_RFXSensor(const CDomoticzHardwareBase *pHa
 		}
 		break;
 	}
-	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,cmnd,szTmp,m_LastDeviceName);
+	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,cmnd,szTmp,LastDeviceName());
 	if (DevRowIdx == -1)
 		return -1;
 
@@ -7063,7 +7623,7 @@ unsigned long long MainWorker::decode_RFXMeter(const CDomoticzHardwareBase *pHar
 		//float RFXPwr = float(counter) / 1000.0f;
 
 		sprintf(szTmp,"%lu",counter);
-		DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,cmnd,szTmp,m_LastDeviceName);
+		DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,cmnd,szTmp,LastDeviceName());
 		if (DevRowIdx == -1)
 			return -1;
 	}
@@ -7275,55 +7835,72 @@ unsigned long long MainWorker::decode_RFXMeter(const CDomoticzHardwareBase *pHar
 
 unsigned long long MainWorker::decode_P1MeterPower(const CDomoticzHardwareBase *pHardware, const int HwdID, const tRBUF *pResponse)
 {
-	char szTmp[200];
 	const _tP1Power *p1Power=(const _tP1Power*)pResponse;
-	unsigned char devType=p1Power->type;
-	unsigned char subType=p1Power->subtype;
-	std::string ID="1";
-	unsigned char Unit=subType;
+	_tDeviceUpdate update;
+	update.devType=p1Power->type;
+	update.subType=p1Power->subtype;
+	update.ID=1;
+	update.Unit=p1Power->subtype;
+	update.P1.powerusage1=p1Power->powerusage1;
+	update.P1.powerusage2=p1Power->powerusage2;
+	update.P1.powerdeliv1=p1Power->powerdeliv1;
+	update.P1.powerdeliv2=p1Power->powerdeliv2;
+	update.P1.usagecurrent=p1Power->usagecurrent;
+	update.P1.delivcurrent=p1Power->delivcurrent;
+	return update_P1MeterPower(HwdID, update);
+}
+
+unsigned long long MainWorker::update_P1MeterPower(const int HwdID, const _tDeviceUpdate &update)
+{
+	char szTmp[200];
+	unsigned char devType=update.devType;
+	unsigned char subType=update.subType;
+	sprintf(szTmp,"%lu",update.ID);
+	std::string ID=szTmp;
+	unsigned char Unit=update.Unit;
 	unsigned char cmnd=0;
 	unsigned char SignalLevel=12;
 	unsigned char BatteryLevel = 255;
 
 	sprintf(szTmp,"%lu;%lu;%lu;%lu;%lu;%lu",
-		p1Power->powerusage1,
-		p1Power->powerusage2,
-		p1Power->powerdeliv1,
-		p1Power->powerdeliv2,
-		p1Power->usagecurrent,
-		p1Power->delivcurrent
+		update.P1.powerusage1,
+		update.P1.powerusage2,
+		update.P1.powerdeliv1,
+		update.P1.powerdeliv2,
+		update.P1.usagecurrent,
+		update.P1.delivcurrent
 		);
-	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,cmnd,szTmp,m_LastDeviceName);
+	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,cmnd,szTmp,LastDeviceName());
 	if (DevRowIdx == -1)
 		return -1;
 
-	m_sql.CheckAndHandleNotification(HwdID, ID, Unit, devType, subType, NTYPE_USAGE, (const float)p1Power->usagecurrent);
+	m_sql.CheckAndHandleNotification(HwdID, ID, Unit, devType, subType, NTYPE_USAGE, (const float)update.P1.usagecurrent);
 
 	if (m_verboselevel == EVBL_ALL)
 	{
 		WriteMessageStart();
-		switch (p1Power->subtype)
+		switch (update.subType)
 		{
 		case sTypeP1Power:
 			WriteMessage("subtype       = P1 Smart Meter Power");
 
-			sprintf(szTmp,"powerusage1 = %.3f kWh", float(p1Power->powerusage1) / 1000.0f);
+			sprintf(szTmp,"powerusage1 = %.3f kWh", float(update.P1.powerusage1) / 1000.0f);
 			WriteMessage(szTmp);
-			sprintf(szTmp,"powerusage2 = %.3f kWh", float(p1Power->powerusage2) / 1000.0f);
+			sprintf(szTmp,"powerusage2 = %.3f kWh", float(update.P1.powerusage2) / 1000.0f);
 			WriteMessage(szTmp);
 
-			sprintf(szTmp,"powerdeliv1 = %.3f kWh", float(p1Power->powerdeliv1) / 1000.0f);
+			sprintf(szTmp,"powerdeliv1 = %.3f kWh", float(update.P1.powerdeliv1) / 1000.0f);
 			WriteMessage(szTmp);
-			sprintf(szTmp,"powerdeliv2 = %.3f kWh", float(p1Power->powerdeliv2) / 1000.0f);
+			sprintf(szTmp,"powerdeliv2 = %.3f kWh", float(update.P1.powerdeliv2) / 1000.0f);
 			WriteMessage(szTmp);
 
-			sprintf(szTmp,"current usage = %03lu Watt", p1Power->usagecurrent);
+			sprintf(szTmp,"current usage = %03lu Watt", update.P1.usagecurrent);
 			WriteMessage(szTmp);
-			sprintf(szTmp,"current deliv = %03lu Watt", p1Power->delivcurrent);
+			sprintf(szTmp,"current deliv = %03lu Watt", update.P1.delivcurrent);
 			WriteMessage(szTmp);
 			break;
 		default:
-			sprintf(szTmp,"ERROR: Unknown Sub type for Packet type= %02X:%02X", p1Power->type, p1Power->subtype);
+			sprintf(szTmp,"ERROR: Unknown Sub type for Packet type= %02X:%02X", update.devType, update.subType);
 			WriteMessage(szTmp);
 			break;
 		}
@@ -7334,34 +7911,46 @@ unsigned long long MainWorker::decode_P1MeterPower(const CDomoticzHardwareBase *
 
 unsigned long long MainWorker::decode_P1MeterGas(const CDomoticzHardwareBase *pHardware, const int HwdID, const tRBUF *pResponse)
 {
-	char szTmp[200];
 	const _tP1Gas *p1Gas=(const _tP1Gas*)pResponse;
-	unsigned char devType=p1Gas->type;
-	unsigned char subType=p1Gas->subtype;
-	std::string ID="1";
-	unsigned char Unit=subType;
+	_tDeviceUpdate update;
+	update.devType=p1Gas->type;
+	update.subType=p1Gas->subtype;
+	update.ID=1;
+	update.Unit=p1Gas->subtype;
+	update.P1.gasusage=p1Gas->gasusage;
+	return update_P1MeterGas(HwdID, update);
+}
+
+unsigned long long MainWorker::update_P1MeterGas(const int HwdID, const _tDeviceUpdate &update)
+{
+	char szTmp[200];
+	unsigned char devType=update.devType;
+	unsigned char subType=update.subType;
+	sprintf(szTmp,"%lu",update.ID);
+	std::string ID=szTmp;
+	unsigned char Unit=update.Unit;
 	unsigned char cmnd=0;
 	unsigned char SignalLevel=12;
 	unsigned char BatteryLevel = 255;
 
-	sprintf(szTmp,"%lu",p1Gas->gasusage);
-	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,cmnd,szTmp,m_LastDeviceName);
+	sprintf(szTmp,"%lu",update.P1.gasusage);
+	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,cmnd,szTmp,LastDeviceName());
 	if (DevRowIdx == -1)
 		return -1;
 
 	if (m_verboselevel == EVBL_ALL)
 	{
 		WriteMessageStart();
-		switch (p1Gas->subtype)
+		switch (update.subType)
 		{
 		case sTypeP1Gas:
 			WriteMessage("subtype       = P1 Smart Meter Gas");
 
-			sprintf(szTmp,"gasusage = %.3f m3", float(p1Gas->gasusage) / 1000.0f);
+			sprintf(szTmp,"gasusage = %.3f m3", float(update.P1.gasusage) / 1000.0f);
 			WriteMessage(szTmp);
 			break;
 		default:
-			sprintf(szTmp,"ERROR: Unknown Sub type for Packet type= %02X:%02X", p1Gas->type, p1Gas->subtype);
+			sprintf(szTmp,"ERROR: Unknown Sub type for Packet type= %02X:%02X", update.devType, update.subType);
 			WriteMessage(szTmp);
 			break;
 		}
@@ -7387,7 +7976,7 @@ unsigned long long MainWorker::decode_YouLessMeter(const CDomoticzHardwareBase *
 		pMeter->powerusage,
 		pMeter->usagecurrent
 		);
-	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,cmnd,szTmp,m_LastDeviceName);
+	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,cmnd,szTmp,LastDeviceName());
 	if (DevRowIdx == -1)
 		return -1;
 
@@ -7431,7 +8020,7 @@ unsigned long long MainWorker::decode_Rego6XXTemp(const CDomoticzHardwareBase *p
     sprintf(szTmp,"%.1f",
 		pRego->temperature
 	);
-	unsigned long long DevRowIdx = m_sql.UpdateValue(HwdID, ID.c_str(), Unit, devType, subType, SignalLevel, BatteryLevel, cmnd, szTmp, m_LastDeviceName);
+	unsigned long long DevRowIdx = m_sql.UpdateValue(HwdID, ID.c_str(), Unit, devType, subType, SignalLevel, BatteryLevel, cmnd, szTmp, LastDeviceName());
 	if (DevRowIdx == -1)
 		return -1;
     m_sql.CheckAndHandleNotification(HwdID, ID, Unit, devType, subType, NTYPE_TEMPERATURE, pRego->temperature);
@@ -7464,7 +8053,7 @@ unsigned long long MainWorker::decode_Rego6XXValue(const CDomoticzHardwareBase *
 		pRego->value
 	);
 
-    unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,numValue,szTmp,m_LastDeviceName);
+    unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,numValue,szTmp,LastDeviceName());
 	if (DevRowIdx == -1)
 		return -1;
 
@@ -7502,7 +8091,7 @@ unsigned long long MainWorker::decode_AirQuality(const CDomoticzHardwareBase *pH
 	unsigned char SignalLevel=12;
 	unsigned char BatteryLevel = 255;
 
-	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,pMeter->airquality,m_LastDeviceName);
+	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,pMeter->airquality,LastDeviceName());
 	if (DevRowIdx == -1)
 		return -1;
 
@@ -7542,38 +8131,50 @@ unsigned long long MainWorker::decode_AirQuality(const CDomoticzHardwareBase *pH
 
 unsigned long long MainWorker::decode_Usage(const CDomoticzHardwareBase *pHardware, const int HwdID, const tRBUF *pResponse)
 {
-	char szTmp[200];
 	const _tUsageMeter *pMeter=(const _tUsageMeter*)pResponse;
-	unsigned char devType=pMeter->type;
-	unsigned char subType=pMeter->subtype;
-	sprintf(szTmp,"%X%02X%02X%02X", pMeter->id1, pMeter->id2, pMeter->id3, pMeter->id4);
+	_tDeviceUpdate update;
+	update.devType=pMeter->type;
+	update.subType=pMeter->subtype;
+	update.ID=(pMeter->id1<<24)|(pMeter->id2<<16)|(pMeter->id3<<8)|pMeter->id4;
+	update.Unit=pMeter->dunit;
+	update.floatval=pMeter->fusage;
+	update.intval=0;
+	return update_Usage(HwdID, update);
+}
+
+unsigned long long MainWorker::update_Usage(const int HwdID, const _tDeviceUpdate &update)
+{
+	char szTmp[200];
+	unsigned char devType=update.devType;
+	unsigned char subType=update.subType;
+	sprintf(szTmp,"%X%02X%02X%02X", (unsigned int)((update.ID>>24)&0xFF), (unsigned int)((update.ID>>16)&0xFF), (unsigned int)((update.ID>>8)&0xFF), (unsigned int)(update.ID&0xFF));
 	std::string ID=szTmp;
-	unsigned char Unit=pMeter->dunit;
+	unsigned char Unit=update.Unit;
 	unsigned char cmnd=0;
 	unsigned char SignalLevel=12;
 	unsigned char BatteryLevel = 255;
 
-	sprintf(szTmp,"%.1f",pMeter->fusage);
+	sprintf(szTmp,"%.1f",update.floatval);
 
-	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,cmnd,szTmp,m_LastDeviceName);
+	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,cmnd,szTmp,LastDeviceName());
 	if (DevRowIdx == -1)
 		return -1;
 
-	m_sql.CheckAndHandleNotification(HwdID, ID, Unit, devType, subType, NTYPE_USAGE, pMeter->fusage);
+	m_sql.CheckAndHandleNotification(HwdID, ID, Unit, devType, subType, NTYPE_USAGE, update.floatval);
 
 	if (m_verboselevel == EVBL_ALL)
 	{
 		WriteMessageStart();
-		switch (pMeter->subtype)
+		switch (update.subType)
 		{
 		case sTypeElectric:
 			WriteMessage("subtype       = Electric");
 
-			sprintf(szTmp,"Usage = %.1f W", pMeter->fusage);
+			sprintf(szTmp,"Usage = %.1f W", update.floatval);
 			WriteMessage(szTmp);
 			break;
 		default:
-			sprintf(szTmp,"ERROR: Unknown Sub type for Packet type= %02X:%02X", pMeter->type, pMeter->subtype);
+			sprintf(szTmp,"ERROR: Unknown Sub type for Packet type= %02X:%02X", update.devType, update.subType);
 			WriteMessage(szTmp);
 			break;
 		}
@@ -7597,7 +8198,7 @@ unsigned long long MainWorker::decode_Lux(const CDomoticzHardwareBase *pHardware
 
 	sprintf(szTmp,"%.0f",pMeter->fLux);
 
-	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,cmnd,szTmp,m_LastDeviceName);
+	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,cmnd,szTmp,LastDeviceName());
 	if (DevRowIdx == -1)
 		return -1;
 
@@ -7648,7 +8249,7 @@ unsigned long long MainWorker::decode_Thermostat(const CDomoticzHardwareBase *pH
 		return -1;
 	}
 
-	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,cmnd,szTmp,m_LastDeviceName);
+	unsigned long long DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,cmnd,szTmp,LastDeviceName());
 	if (DevRowIdx == -1)
 		return -1;
 
@@ -7682,18 +8283,34 @@ unsigned long long MainWorker::decode_Thermostat(const CDomoticzHardwareBase *pH
 
 unsigned long long MainWorker::decode_General(const CDomoticzHardwareBase *pHardware, const int HwdID, const tRBUF *pResponse)
 {
-	char szTmp[200];
 	const _tGeneralDevice *pMeter=(const _tGeneralDevice*)pResponse;
-	unsigned char devType=pMeter->type;
-	unsigned char subType=pMeter->subtype;
+	_tDeviceUpdate update;
+	update.devType=pMeter->type;
+	update.subType=pMeter->subtype;
+	if ((update.subType==sTypeVoltage)||(update.subType==sTypePercentage)||(update.subType==sTypePressure))
+		update.ID=(unsigned int)pMeter->intval1;
+	else
+		update.ID=pMeter->id;
+	update.Unit=1;
+	update.floatval=pMeter->floatval1;
+	update.intval=pMeter->intval1;
+	return update_General(HwdID, update);
+}
+
+unsigned long long MainWorker::update_General(const int HwdID, const _tDeviceUpdate &update)
+{
+	char szTmp[200];
+	unsigned char devType=update.devType;
+	unsigned char subType=update.subType;
 
 	if ((subType==sTypeVoltage)||(subType==sTypePercentage)||(subType==sTypePressure))
 	{
-		sprintf(szTmp,"%08X", (unsigned int)pMeter->intval1);
+		sprintf(szTmp,"%08X", (unsigned int)update.ID);
 	}
 	else
 	{
-		sprintf(szTmp,"%d", pMeter->id);
+		//8 bit id, as in the packet format
+		sprintf(szTmp,"%d", (int)(update.ID&0xFF));
 	}
 	std::string ID=szTmp;
 	unsigned char Unit=1;
@@ -7705,13 +8322,13 @@ unsigned long long MainWorker::decode_General(const CDomoticzHardwareBase *pHard
 
 	if (subType==sTypeVisibility)
 	{
-		sprintf(szTmp,"%.1f",pMeter->floatval1);
-		DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,cmnd,szTmp,m_LastDeviceName);
+		sprintf(szTmp,"%.1f",update.floatval);
+		DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,cmnd,szTmp,LastDeviceName());
 		if (DevRowIdx == -1)
 			return -1;
 		int meterType=0;
 		m_sql.GetMeterType(HwdID, ID.c_str(),Unit,devType,subType,meterType);
-		float fValue=pMeter->floatval1;
+		float fValue=update.floatval;
 		if (meterType==1)
 		{
 			//miles
@@ -7721,88 +8338,88 @@ unsigned long long MainWorker::decode_General(const CDomoticzHardwareBase *pHard
 	}
 	else if (subType==sTypeSolarRadiation)
 	{
-		sprintf(szTmp,"%.1f",pMeter->floatval1);
-		DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,cmnd,szTmp,m_LastDeviceName);
+		sprintf(szTmp,"%.1f",update.floatval);
+		DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,cmnd,szTmp,LastDeviceName());
 		if (DevRowIdx == -1)
 			return -1;
-		m_sql.CheckAndHandleNotification(HwdID, ID, Unit, devType, subType, NTYPE_USAGE, pMeter->floatval1);
+		m_sql.CheckAndHandleNotification(HwdID, ID, Unit, devType, subType, NTYPE_USAGE, update.floatval);
 	}
 	else if (subType==sTypeSoilMoisture)
 	{
-		DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,pMeter->intval1,m_LastDeviceName);
+		DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,update.intval,LastDeviceName());
 		if (DevRowIdx == -1)
 			return -1;
-		m_sql.CheckAndHandleNotification(HwdID, ID, Unit, devType, subType, NTYPE_USAGE, (float)pMeter->intval1);
+		m_sql.CheckAndHandleNotification(HwdID, ID, Unit, devType, subType, NTYPE_USAGE, (float)update.intval);
 	}
 	else if (subType==sTypeLeafWetness)
 	{
-		DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,pMeter->intval1,m_LastDeviceName);
+		DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,update.intval,LastDeviceName());
 		if (DevRowIdx == -1)
 			return -1;
-		m_sql.CheckAndHandleNotification(HwdID, ID, Unit, devType, subType, NTYPE_USAGE, (float)pMeter->intval1);
+		m_sql.CheckAndHandleNotification(HwdID, ID, Unit, devType, subType, NTYPE_USAGE, (float)update.intval);
 	}
 	else if (subType==sTypeVoltage)
 	{
-		sprintf(szTmp,"%.3f",pMeter->floatval1);
-		DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,cmnd,szTmp,m_LastDeviceName);
+		sprintf(szTmp,"%.3f",update.floatval);
+		DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,cmnd,szTmp,LastDeviceName());
 		if (DevRowIdx == -1)
 			return -1;
-		m_sql.CheckAndHandleNotification(HwdID, ID, Unit, devType, subType, NTYPE_USAGE, pMeter->floatval1);
+		m_sql.CheckAndHandleNotification(HwdID, ID, Unit, devType, subType, NTYPE_USAGE, update.floatval);
 	}
 	else if (subType==sTypePressure)
 	{
-		sprintf(szTmp,"%.1f",pMeter->floatval1);
-		DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,cmnd,szTmp,m_LastDeviceName);
+		sprintf(szTmp,"%.1f",update.floatval);
+		DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,cmnd,szTmp,LastDeviceName());
 		if (DevRowIdx == -1)
 			return -1;
-		m_sql.CheckAndHandleNotification(HwdID, ID, Unit, devType, subType, NTYPE_USAGE, pMeter->floatval1);
+		m_sql.CheckAndHandleNotification(HwdID, ID, Unit, devType, subType, NTYPE_USAGE, update.floatval);
 	}
 	else if (subType==sTypePercentage)
 	{
-		sprintf(szTmp,"%.2f",pMeter->floatval1);
-		DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,cmnd,szTmp,m_LastDeviceName);
+		sprintf(szTmp,"%.2f",update.floatval);
+		DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,cmnd,szTmp,LastDeviceName());
 		if (DevRowIdx == -1)
 			return -1;
-		m_sql.CheckAndHandleNotification(HwdID, ID, Unit, devType, subType, NTYPE_PERCENTAGE, pMeter->floatval1);
+		m_sql.CheckAndHandleNotification(HwdID, ID, Unit, devType, subType, NTYPE_PERCENTAGE, update.floatval);
 	}
 
 	if (m_verboselevel == EVBL_ALL)
 	{
 		WriteMessageStart();
-		switch (pMeter->subtype)
+		switch (update.subType)
 		{
 		case sTypeVisibility:
 			WriteMessage("subtype       = Visibility");
-			sprintf(szTmp,"Visibility = %.1f km", pMeter->floatval1);
+			sprintf(szTmp,"Visibility = %.1f km", update.floatval);
 			WriteMessage(szTmp);
 			break;
 		case sTypeSolarRadiation:
 			WriteMessage("subtype       = Solar Radiation");
-			sprintf(szTmp,"Radiation = %.1f Watt/m2", pMeter->floatval1);
+			sprintf(szTmp,"Radiation = %.1f Watt/m2", update.floatval);
 			WriteMessage(szTmp);
 			break;
 		case sTypeSoilMoisture:
 			WriteMessage("subtype       = Soil Moisture");
-			sprintf(szTmp,"Moisture = %d cb", pMeter->intval1);
+			sprintf(szTmp,"Moisture = %d cb", update.intval);
 			WriteMessage(szTmp);
 			break;
 		case sTypeLeafWetness:
 			WriteMessage("subtype       = Leaf Wetness");
-			sprintf(szTmp,"Wetness = %d", pMeter->intval1);
+			sprintf(szTmp,"Wetness = %d", update.intval);
 			WriteMessage(szTmp);
 			break;
 		case sTypeVoltage:
 			WriteMessage("subtype       = Voltage");
-			sprintf(szTmp,"Voltage = %.3f V", pMeter->floatval1);
+			sprintf(szTmp,"Voltage = %.3f V", update.floatval);
 			WriteMessage(szTmp);
 			break;
 		case sTypePressure:
 			WriteMessage("subtype       = Pressure");
-			sprintf(szTmp,"Voltage = %.1f bar", pMeter->floatval1);
+			sprintf(szTmp,"Voltage = %.1f bar", update.floatval);
 			WriteMessage(szTmp);
 			break;
 		default:
-			sprintf(szTmp,"ERROR: Unknown Sub type for Packet type= %02X:%02X", pMeter->type, pMeter->subtype);
+			sprintf(szTmp,"ERROR: Unknown Sub type for Packet type= %02X:%02X", update.devType, update.subType);
 			WriteMessage(szTmp);
 			break;
 		}
@@ -7838,7 +8455,7 @@ unsigned long long MainWorker::decode_BBQ(const CDomoticzHardwareBase *pHardware
 	temp2=float((pResponse->BBQ.sensor2h * 256) + pResponse->BBQ.sensor2l);// / 10.0f;
 
 	sprintf(szTmp,"%.0f;%.0f",temp1,temp2);
-	DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,cmnd,szTmp,m_LastDeviceName);
+	DevRowIdx=m_sql.UpdateValue(HwdID, ID.c_str(),Unit,devType,subType,SignalLevel,BatteryLevel,cmnd,szTmp,LastDeviceName());
 	if (DevRowIdx == -1)
 		return -1;
 	if (m_verboselevel == EVBL_ALL)
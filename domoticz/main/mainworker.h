@@ -11,6 +11,7 @@
 #include "WindCalculation.h"
 #include "../tcpserver/TCPServer.h"
 #include "DataPush.h"
+#include "../httpclient/AsyncHTTPClient.h"
 
 
 enum eVerboseLevel
@@ -19,6 +20,15 @@ enum eVerboseLevel
 	EVBL_ALL,
 };
 
+struct _tDecodeStats
+{
+	unsigned long long TotalPackets;
+	float PacketsPerSecond;	//over the last sampled packets
+	long AvgLatency;		//us from receive until the packet is decoded and stored
+	long P99Latency;
+	long MaxLatency;
+};
+
 class MainWorker
 {
 public:
@@ -87,6 +97,7 @@ public:
 	CScheduler m_scheduler;
 	CEventSystem m_eventsystem;
 	CDataPush m_datapush;
+	CAsyncHTTPClient m_httpclient;
 	CHardwareMonitor m_hardwaremonitor;
 	CCameraHandler m_cameras;
 
@@ -97,8 +108,17 @@ public:
 	bool m_bHaveDownloadedDomoticzUpdateSuccessFull;
 
 	tcp::server::CTCPServer m_sharedserver;
+
+	void GetDecodeStats(_tDecodeStats &stats);
+	//Replays sensor and switch packets from several simulated hardware instances in parallel
+	//and reports packets/sec and latency (-decodebenchmark, needs an open scratch database)
+	void BenchmarkDecode();
 private:
+	void BenchmarkDecodeHardware(const CDomoticzHardwareBase *pHardware, const int nPackets, std::vector<long> *pLatencies);
 	void GetInternalTemperature();
+	//Automatic backups run on their own thread, a large database takes a while to copy
+	void StartAutomaticBackups();
+	void Do_Backup_Work();
 	void HandleAutomaticBackups();
 	unsigned long long PerformRealActionFromDomoticzClient(const unsigned char *pRXCommand, CDomoticzHardwareBase **pOriginalHardware);
 	struct _tStartScene
@@ -106,7 +126,9 @@ private:
 		unsigned long long SceneRowID;
 		std::string switchcmd;
 	};
-	std::string m_LastDeviceName;
+	//Name of the device that was last decoded by the calling thread
+	boost::thread_specific_ptr<std::string> m_pLastDeviceName;
+	std::string &LastDeviceName();
 
 	std::map<std::string, time_t > m_componentheartbeats;
 	boost::mutex m_heartbeatmutex;
@@ -120,7 +142,17 @@ private:
 	int m_ScheduleLastHour;
 
 	boost::mutex m_devicemutex;
-	boost::mutex decodeRXMessageMutex;
+	//Packets are decoded in order per hardware, different hardware are decoded in parallel
+	boost::mutex m_decodemutexes_mutex;
+	std::map<int,boost::shared_ptr<boost::mutex> > m_decodemutexes;
+	boost::shared_ptr<boost::mutex> GetDecodeMutex(const int HwdID);
+
+	boost::mutex m_decodestats_mutex;
+	unsigned long long m_decodestats_packets;
+	unsigned long long m_decodestats_latency_total;
+	long m_decodestats_latency_max;
+	std::vector<std::pair<boost::posix_time::ptime,long> > m_decodestats_samples;
+	size_t m_decodestats_sample_pos;
 
 	std::string m_szDomoticzUpdateURL;
 	bool m_bDoDownloadDomoticzUpdate;
@@ -133,8 +165,11 @@ private:
 
 	volatile bool m_stoprequested;
 	boost::shared_ptr<boost::thread> m_thread;
+	boost::shared_ptr<boost::thread> m_backup_thread;
+	volatile bool m_bBackupRunning;
 	boost::mutex m_mutex;
 
+	boost::mutex m_wind_calculator_mutex;
 	std::map<unsigned short,_tWindCalculationStruct> m_wind_calculator;
 
 	bool StartThread();
@@ -145,6 +180,12 @@ private:
 	void SendCommand(const int HwdID, unsigned char Cmd, const char *szMessage=NULL);
 	void WriteToHardware(const int HwdID, const char *pdata, const unsigned char length);
 	void DecodeRXMessage(const CDomoticzHardwareBase *pHardware, const unsigned char *pRXCommand);
+	void DecodeRXMessageInt(const CDomoticzHardwareBase *pHardware, const unsigned char *pRXCommand);
+	//Typed updates from the hardware, without a RFXtrx packet
+	void DecodeDeviceUpdate(const CDomoticzHardwareBase *pHardware, const _tDeviceUpdate &update);
+	void DecodeDeviceUpdateInt(const CDomoticzHardwareBase *pHardware, const _tDeviceUpdate &update);
+	void SendDeviceUpdateToShared(const unsigned long long DeviceRowIdx, const _tDeviceUpdate &update);
+	void AddDecodeStats(const boost::posix_time::ptime &tstart);
 	
 	void OnHardwareConnected(CDomoticzHardwareBase *pHardware);
 
@@ -164,8 +205,11 @@ private:
 	unsigned long long decode_Rain(const CDomoticzHardwareBase *pHardware, const int HwdID, const tRBUF *pResponse);
 	unsigned long long decode_Wind(const CDomoticzHardwareBase *pHardware, const int HwdID, const tRBUF *pResponse);
 	unsigned long long decode_Temp(const CDomoticzHardwareBase *pHardware, const int HwdID, const tRBUF *pResponse);
+	unsigned long long update_Temp(const int HwdID, const _tDeviceUpdate &update);
 	unsigned long long decode_Hum(const CDomoticzHardwareBase *pHardware, const int HwdID, const tRBUF *pResponse);
+	unsigned long long update_Hum(const int HwdID, const _tDeviceUpdate &update);
 	unsigned long long decode_TempHum(const CDomoticzHardwareBase *pHardware, const int HwdID, const tRBUF *pResponse);
+	unsigned long long update_TempHum(const int HwdID, const _tDeviceUpdate &update);
 	unsigned long long decode_TempRain(const CDomoticzHardwareBase *pHardware, const int HwdID, const tRBUF *pResponse);
 	unsigned long long decode_UV(const CDomoticzHardwareBase *pHardware, const int HwdID, const tRBUF *pResponse);
 	unsigned long long decode_Lighting1(const CDomoticzHardwareBase *pHardware, const int HwdID, const tRBUF *pResponse);
@@ -196,7 +240,9 @@ private:
 	unsigned long long decode_RFXSensor(const CDomoticzHardwareBase *pHardware, const int HwdID, const tRBUF *pResponse);
 	unsigned long long decode_RFXMeter(const CDomoticzHardwareBase *pHardware, const int HwdID, const tRBUF *pResponse);
 	unsigned long long decode_P1MeterPower(const CDomoticzHardwareBase *pHardware, const int HwdID, const tRBUF *pResponse);
+	unsigned long long update_P1MeterPower(const int HwdID, const _tDeviceUpdate &update);
 	unsigned long long decode_P1MeterGas(const CDomoticzHardwareBase *pHardware, const int HwdID, const tRBUF *pResponse);
+	unsigned long long update_P1MeterGas(const int HwdID, const _tDeviceUpdate &update);
 	unsigned long long decode_YouLessMeter(const CDomoticzHardwareBase *pHardware, const int HwdID, const tRBUF *pResponse);
 	unsigned long long decode_AirQuality(const CDomoticzHardwareBase *pHardware, const int HwdID, const tRBUF *pResponse);
 	unsigned long long decode_FS20(const CDomoticzHardwareBase *pHardware, const int HwdID, const tRBUF *pResponse);
@@ -205,13 +251,17 @@ private:
 	unsigned long long decode_Usage(const CDomoticzHardwareBase *pHardware, const int HwdID, const tRBUF *pResponse);
 	unsigned long long decode_Lux(const CDomoticzHardwareBase *pHardware, const int HwdID, const tRBUF *pResponse);
 	unsigned long long decode_General(const CDomoticzHardwareBase *pHardware, const int HwdID, const tRBUF *pResponse);
+	unsigned long long update_Usage(const int HwdID, const _tDeviceUpdate &update);
+	unsigned long long update_General(const int HwdID, const _tDeviceUpdate &update);
 	unsigned long long decode_Thermostat(const CDomoticzHardwareBase *pHardware, const int HwdID, const tRBUF *pResponse);
 	unsigned long long decode_Chime(const CDomoticzHardwareBase *pHardware, const int HwdID, const tRBUF *pResponse);
 	unsigned long long decode_BBQ(const CDomoticzHardwareBase *pHardware, const int HwdID, const tRBUF *pResponse);
 	unsigned long long decode_Power(const CDomoticzHardwareBase *pHardware, const int HwdID, const tRBUF *pResponse);
 	unsigned long long decode_LimitlessLights(const CDomoticzHardwareBase *pHardware, const int HwdID, const tRBUF *pResponse);
 	unsigned long long decode_evohome1(const CDomoticzHardwareBase *pHardware, const int HwdID, const tRBUF *pResponse);
+	unsigned long long update_evohome1(const CDomoticzHardwareBase *pHardware, const int HwdID, const _tDeviceUpdate &update);
 	unsigned long long decode_evohome2(const CDomoticzHardwareBase *pHardware, const int HwdID, const tRBUF *pResponse);
+	unsigned long long update_evohome2(const CDomoticzHardwareBase *pHardware, const int HwdID, const _tDeviceUpdate &update);
 };
 
 extern MainWorker m_mainworker;
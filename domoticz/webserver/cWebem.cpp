@@ -7,6 +7,7 @@
 #include "cWebem.h"
 #include <boost/bind.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
 
 #include "reply.hpp"
 #include "request.hpp"
@@ -27,6 +28,9 @@
 //10 minutes
 #define SESSION_TIMEOUT 600
 
+//number of threads handling web requests
+#define WEBEM_THREAD_POOL_SIZE 4
+
 int m_failcounter=0;
 
 namespace http {
@@ -49,13 +53,10 @@ cWebem::cWebem(
 	   const std::string& port,
 	   const std::string& doc_root ) :
 myRequestHandler( doc_root,this ), myPort( port ),
-myServer( address, port, myRequestHandler )
+myServer( address, port, myRequestHandler, WEBEM_THREAD_POOL_SIZE )
 {
 	m_DigistRealm = "Domoticz.com";
 	m_zippassword = "";
-	m_actsessionid="";
-	m_actualuser = "";
-	m_actualuser_rights = -1;
 	m_authmethod=AUTH_LOGIN;
 	m_bForceRelogin=false;
 }
@@ -74,12 +75,39 @@ void cWebem::Run() { myServer.run(); }
 
 void cWebem::Stop() { myServer.stop(); }
 
+void cWebem::PushMessage(const std::string &message)
+{
+	myServer.get_push_manager().publish(message);
+}
+
+void cWebem::PushPing()
+{
+	myServer.get_push_manager().ping();
+}
+
+bool cWebem::HasPushClients()
+{
+	return myServer.get_push_manager().is_active();
+}
+
 
 void cWebem::SetAuthenticationMethod(const _eAuthenticationMethod amethod)
 {
 	m_authmethod=amethod;
 }
 
+WebEmRequestContext &cWebem::Context()
+{
+	if (m_pContext.get()==NULL)
+		m_pContext.reset(new WebEmRequestContext());
+	return *m_pContext;
+}
+
+void cWebem::ResetContext()
+{
+	m_pContext.reset(new WebEmRequestContext());
+}
+
 /**
 
 Create a link between a string ID and a function to calculate the dynamic content of the string
@@ -355,7 +383,7 @@ bool cWebem::CheckForAction( request& req )
 								std::string szContent;
 								size_t bpos=size_t(ss.tellg());
 								szContent=req.content.substr(bpos,ss.rdbuf()->str().size()-bpos-szBoundary.size()-6);
-								myNameValues.insert( std::pair< std::string,std::string > ( vName, szContent) );
+								Context().myNameValues.insert( std::pair< std::string,std::string > ( vName, szContent) );
 								// call the function
 								req.uri = pfun->second( this );
 								return true;
@@ -375,7 +403,7 @@ bool cWebem::CheckForAction( request& req )
 	}
 
 
-	myNameValues.clear();
+	Context().myNameValues.clear();
 	std::string name;
 	std::string value;
 
@@ -402,7 +430,7 @@ bool cWebem::CheckForAction( request& req )
 			value.replace( p, 1, " " );
 		}
 
-		myNameValues.insert( std::pair< std::string,std::string > ( name, value ) );
+		Context().myNameValues.insert( std::pair< std::string,std::string > ( name, value ) );
 		p = q+1;
 	}
 
@@ -435,8 +463,8 @@ bool cWebem::CheckForPageOverride(const request& req, reply& rep)
 		request_path += "index.html";
 	}
 
-	myNameValues.clear();
-	m_lastRequestPath=request_path;
+	Context().myNameValues.clear();
+	Context().m_lastRequestPath=request_path;
 
 	int paramPos=request_path.find_first_of('?');
 	if (paramPos!=std::string::npos)
@@ -472,7 +500,7 @@ bool cWebem::CheckForPageOverride(const request& req, reply& rep)
 				value.replace( p, 1, " " );
 			}
 
-			myNameValues.insert( std::pair< std::string,std::string > ( name, value ) );
+			Context().myNameValues.insert( std::pair< std::string,std::string > ( name, value ) );
 			p = q+1;
 		}
 
@@ -493,28 +521,59 @@ bool cWebem::CheckForPageOverride(const request& req, reply& rep)
 
 	if (pfun!=myPages.end())
 	{
-		m_outputfilename="";
+		std::string &outputfilename=Context().m_outputfilename;
+		outputfilename="";
+		Context().m_contentSource.clear();
 		rep.status = reply::ok;
 		std::string retstr=pfun->second( );
 
-		rep.content.append(retstr.c_str(), retstr.size());
+		//take over the generated page instead of copying it
+		if (rep.content.empty())
+			rep.content.swap(retstr);
+		else
+			rep.content.append(retstr.c_str(), retstr.size());
+
+		bool bChunked=false;
+		webem_content_source source;
+		source.swap(Context().m_contentSource);
+		if (source)
+		{
+			if ((req.http_version_major>1)||((req.http_version_major==1)&&(req.http_version_minor>=1)))
+			{
+				rep.content_source.swap(source);
+				bChunked=true;
+			}
+			else
+			{
+				//HTTP/1.0 clients can't take a chunked reply, collect the whole body
+				while (source(rep.content));
+			}
+		}
 
 		std::string strMimeType=mime_types::extension_to_type(extension);
 		int extraheaders=0;
-		if (m_outputfilename!="")
+		if (outputfilename!="")
 		{
-			std::size_t last_dot_pos = m_outputfilename.find_last_of(".");
+			std::size_t last_dot_pos = outputfilename.find_last_of(".");
 			if (last_dot_pos != std::string::npos)
 			{
-				extension = m_outputfilename.substr(last_dot_pos + 1);
+				extension = outputfilename.substr(last_dot_pos + 1);
 				strMimeType=mime_types::extension_to_type(extension);
 			}
 			extraheaders=1;
 		}
 
 		rep.headers.resize(4+extraheaders);
-		rep.headers[0].name = "Content-Length";
-		rep.headers[0].value = boost::lexical_cast<std::string>(rep.content.size());
+		if (bChunked)
+		{
+			rep.headers[0].name = "Transfer-Encoding";
+			rep.headers[0].value = "chunked";
+		}
+		else
+		{
+			rep.headers[0].name = "Content-Length";
+			rep.headers[0].value = boost::lexical_cast<std::string>(rep.content.size());
+		}
 		rep.headers[1].name = "Content-Type";
 		rep.headers[1].value = strMimeType;
 		rep.headers[1].value += ";charset=UTF-8"; //ISO-8859-1
@@ -523,10 +582,18 @@ bool cWebem::CheckForPageOverride(const request& req, reply& rep)
 		rep.headers[3].name = "Pragma";
 		rep.headers[3].value = "no-cache";
 
-		if (m_outputfilename!="")
+		if (outputfilename!="")
 		{
 			rep.headers[4].name = "Content-Disposition";
-			rep.headers[4].value = "attachment; filename=" + m_outputfilename;
+			rep.headers[4].value = "attachment; filename=" + outputfilename;
+		}
+		if (bChunked)
+		{
+			//HTTP/1.1 defaults to keep-alive, we close after every reply
+			header hclose;
+			hclose.name = "Connection";
+			hclose.value = "close";
+			rep.headers.push_back(hclose);
 		}
 		return true;
 	}
@@ -560,11 +627,13 @@ void cWebem::AddUserPassword(const unsigned long ID, const std::string username,
 	wtmp.Username=username;
 	wtmp.Password=password;
 	wtmp.userrights=userrights;
+	boost::lock_guard<boost::mutex> l(m_sessionsmutex);
 	m_userpasswords.push_back(wtmp);
 }
 
 void cWebem::ClearUserPasswords()
 {
+	boost::lock_guard<boost::mutex> l(m_sessionsmutex);
 	m_userpasswords.clear();
 	m_sessionids.clear();
 }
@@ -573,6 +642,7 @@ void cWebem::AddLocalNetworks(std::string network)
 {
 	_tIPNetwork ipnetwork;
 
+	boost::lock_guard<boost::mutex> l(m_sessionsmutex);
 	if (network=="")
 	{
 		//add local host
@@ -654,6 +724,7 @@ void cWebem::AddLocalNetworks(std::string network)
 
 void cWebem::ClearLocalNetworks()
 {
+	boost::lock_guard<boost::mutex> l(m_sessionsmutex);
 	m_localnetworks.clear();
 }
 
@@ -672,12 +743,11 @@ void cWebem::SetZipPassword(std::string password)
   Find the value of a name set by a form submit action
 
 */
-std::string& cWebem::FindValue( const char* name )
+std::string cWebem::FindValue( const char* name )
 {
-	static std::string ret;
-	ret = "";
-	webem_iter_name_value iter = myNameValues.find( name );
-	if( iter != myNameValues.end() )
+	std::string ret;
+	webem_iter_name_value iter = Context().myNameValues.find( name );
+	if( iter != Context().myNameValues.end() )
 		ret = iter->second;
 
 	return ret;
@@ -1074,6 +1144,7 @@ int cWebemRequestHandler::parse_auth_header(const request& req, struct ah *ah)
 // Authorize against the opened passwords file. Return 1 if authorized.
 int cWebemRequestHandler::authorize(const request& req, reply& rep)
 {
+	WebEmRequestContext &context=myWebem->Context();
 	struct ah _ah;
 
 	std::string uname="";
@@ -1090,7 +1161,7 @@ int cWebemRequestHandler::authorize(const request& req, reply& rep)
 		{
 			if (myWebem->m_guestuser!="")
 			{
-				myWebem->m_actualuser=myWebem->m_guestuser;
+				context.m_actualuser=myWebem->m_guestuser;
 				return 1;
 			}
 			return 0;
@@ -1115,11 +1186,11 @@ int cWebemRequestHandler::authorize(const request& req, reply& rep)
 							m_failcounter++;
 							return 0;
 						}
-						myWebem->m_actualuser = itt->Username;
-						myWebem->m_actualuser_rights = itt->userrights;
+						context.m_actualuser = itt->Username;
+						context.m_actualuser_rights = itt->userrights;
 						m_failcounter=0;
-						myWebem->m_bRemembermeUser = false;
-						myWebem->m_bAddNewSession = true;
+						context.m_bRemembermeUser = false;
+						context.m_bAddNewSession = true;
 						return 1;
 					}
 				}
@@ -1144,11 +1215,11 @@ int cWebemRequestHandler::authorize(const request& req, reply& rep)
 				m_failcounter++;
 				return 0;
 			}
-			myWebem->m_actualuser = itt->Username;
-			myWebem->m_actualuser_rights = itt->userrights;
+			context.m_actualuser = itt->Username;
+			context.m_actualuser_rights = itt->userrights;
 			m_failcounter=0;
-			myWebem->m_bRemembermeUser = false;
-			myWebem->m_bAddNewSession = true;
+			context.m_bRemembermeUser = false;
+			context.m_bAddNewSession = true;
 			return 1;
 		}
 	}
@@ -1232,18 +1303,19 @@ const char * wkdays[7] = {
 	"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"
 };
 
-char *make_web_time(const time_t rawtime)
+std::string make_web_time(const time_t rawtime)
 {
-	static char buffer[256];
-	struct tm *gmt=gmtime(&rawtime);
+	char buffer[256];
+	//gmtime is not reentrant
+	struct tm gmt=boost::posix_time::to_tm(boost::posix_time::from_time_t(rawtime));
 	sprintf(buffer, "%s, %02d %s %04d %02d:%02d:%02d GMT",
-		wkdays[gmt->tm_wday],
-		gmt->tm_mday,
-		months[gmt->tm_mon],
-		gmt->tm_year + 1900,
-		gmt->tm_hour,
-		gmt->tm_min,
-		gmt->tm_sec);
+		wkdays[gmt.tm_wday],
+		gmt.tm_mday,
+		months[gmt.tm_mon],
+		gmt.tm_year + 1900,
+		gmt.tm_hour,
+		gmt.tm_min,
+		gmt.tm_sec);
 	return buffer;
 }
 
@@ -1292,6 +1364,74 @@ void cWebemRequestHandler::send_authorization_request(reply& rep)
 	rep.headers[ahsize+1].value = szAuthHeader;
 }
 
+//Compress to gzip format in one pass, the output grows in blocks instead of
+//being reallocated for every compressed block
+static bool GZipCompress(const std::string &input, std::string &output)
+{
+	z_stream zs;
+	memset(&zs, 0, sizeof(zs));
+	//MAX_WBITS+16 lets zlib write the gzip header and trailer
+	if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, MAX_WBITS + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		return false;
+
+	output.clear();
+	output.reserve(input.size() / 4);
+
+	char outbuf[32768];
+	zs.next_in = (Bytef*)input.data();
+	zs.avail_in = (uInt)input.size();
+	int ret;
+	do
+	{
+		zs.next_out = (Bytef*)outbuf;
+		zs.avail_out = sizeof(outbuf);
+		ret = deflate(&zs, Z_FINISH);
+		output.append(outbuf, sizeof(outbuf) - zs.avail_out);
+	} while (ret == Z_OK);
+	deflateEnd(&zs);
+	return (ret == Z_STREAM_END);
+}
+
+//Deflate state of a streamed reply, shared by the copies of the content source
+struct _tGZipStreamState
+{
+	z_stream zs;
+	bool bInit;
+	_tGZipStreamState()
+	{
+		memset(&zs, 0, sizeof(zs));
+		bInit = (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, MAX_WBITS + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK);
+	}
+	~_tGZipStreamState()
+	{
+		if (bInit)
+			deflateEnd(&zs);
+	}
+};
+
+//Pull the next piece of the inner source and append its compressed form,
+//the gzip trailer is written after the last piece
+static bool GZipStreamSource(const webem_content_source &source, boost::shared_ptr<_tGZipStreamState> state, std::string &output)
+{
+	std::string input;
+	bool bMore = source(input);
+
+	z_stream &zs = state->zs;
+	zs.next_in = (Bytef*)input.data();
+	zs.avail_in = (uInt)input.size();
+	int flush = (bMore) ? Z_NO_FLUSH : Z_FINISH;
+	char outbuf[32768];
+	do
+	{
+		zs.next_out = (Bytef*)outbuf;
+		zs.avail_out = sizeof(outbuf);
+		if (deflate(&zs, flush) == Z_STREAM_ERROR)
+			throw std::runtime_error("deflate failed");
+		output.append(outbuf, sizeof(outbuf) - zs.avail_out);
+	} while (zs.avail_out == 0);
+	return bMore;
+}
+
 bool cWebemRequestHandler::CompressWebOutput(const request& req, reply& rep)
 {
 	std::string request_path;
@@ -1312,13 +1452,26 @@ bool cWebemRequestHandler::CompressWebOutput(const request& req, reply& rep)
 	{
 		//see if we support gzip
 		bool bHaveGZipSupport=(strstr(encoding_header,"gzip")!=NULL);
+		if ((bHaveGZipSupport)&&(rep.content_source))
+		{
+			//compress while the reply is written
+			boost::shared_ptr<_tGZipStreamState> state(new _tGZipStreamState());
+			if (!state->bInit)
+				return false;
+			webem_content_source source = rep.content_source;
+			rep.content_source = boost::bind(&GZipStreamSource, source, state, _1);
+			int ohsize=rep.headers.size();
+			rep.headers.resize(ohsize+1);
+			rep.headers[ohsize].name = "Content-Encoding";
+			rep.headers[ohsize].value = "gzip";
+			return true;
+		}
 		if (bHaveGZipSupport)
 		{
-			CA2GZIP gzip((char*)rep.content.c_str(), rep.content.size());
-			if ((gzip.Length>0)&&(gzip.Length<(int)rep.content.size()))
+			std::string gzcontent;
+			if ((GZipCompress(rep.content, gzcontent))&&(gzcontent.size()<rep.content.size()))
 			{
-				rep.content.clear();
-				rep.content.append((char*)gzip.pgzip, gzip.Length);
+				rep.content.swap(gzcontent);
 				//Set new content length
 				std::string szSize=boost::lexical_cast<std::string>(rep.content.size());
 
@@ -1336,9 +1489,11 @@ bool cWebemRequestHandler::CompressWebOutput(const request& req, reply& rep)
 
 bool cWebemRequestHandler::CheckAuthentication(const std::string &sHost, const request& req, reply& rep)
 {
-	myWebem->m_actsessionid = "";
-	myWebem->m_actualuser = "";
-	myWebem->m_actualuser_rights = -1;
+	WebEmRequestContext &context=myWebem->Context();
+	boost::lock_guard<boost::mutex> l(myWebem->m_sessionsmutex);
+	context.m_actsessionid = "";
+	context.m_actualuser = "";
+	context.m_actualuser_rights = -1;
 	if (myWebem->m_bForceRelogin)
 	{
 		myWebem->m_bForceRelogin = false;
@@ -1351,13 +1506,13 @@ bool cWebemRequestHandler::CheckAuthentication(const std::string &sHost, const r
 
 	if (myWebem->m_userpasswords.size() == 0)
 	{
-		myWebem->m_actualuser_rights = 2;
+		context.m_actualuser_rights = 2;
 		return true;//no username/password we are admin
 	}
 
 	if (AreWeInLocalNetwork(sHost, req))
 	{
-		myWebem->m_actualuser_rights = 2;
+		context.m_actualuser_rights = 2;
 		return true;//we are in the local network, no authentication needed, we are admin
 	}
 
@@ -1404,9 +1559,9 @@ bool cWebemRequestHandler::CheckAuthentication(const std::string &sHost, const r
 				{
 					if (itt != myWebem->m_sessionids.end())
 					{
-						myWebem->m_actsessionid = sSID;
-						myWebem->m_actualuser = myWebem->m_sessionids[sSID].username;
-						myWebem->m_actualuser_rights = myWebem->m_sessionids[sSID].rights;
+						context.m_actsessionid = sSID;
+						context.m_actualuser = myWebem->m_sessionids[sSID].username;
+						context.m_actualuser_rights = myWebem->m_sessionids[sSID].rights;
 						return true;
 					}
 					else
@@ -1419,25 +1574,25 @@ bool cWebemRequestHandler::CheckAuthentication(const std::string &sHost, const r
 							if (tempSID == sSID)
 							{
 								_tWebEmSession usession;
-								myWebem->m_actualuser = itt->Username;
-								myWebem->m_actualuser_rights = itt->userrights;
-								usession.username = myWebem->m_actualuser;
-								usession.rights = myWebem->m_actualuser_rights;
+								context.m_actualuser = itt->Username;
+								context.m_actualuser_rights = itt->userrights;
+								usession.username = context.m_actualuser;
+								usession.rights = context.m_actualuser_rights;
 								usession.lasttouch = stime;
 								myWebem->m_sessionids[sSID] = usession;
-								myWebem->m_actsessionid = sSID;
+								context.m_actsessionid = sSID;
 								return true;
 							}
 						}
 
-						myWebem->m_bRemoveCookie = true;
+						context.m_bRemoveCookie = true;
 					}
 				}
 			}
 			else
 			{
 				//invalid cookie
-				myWebem->m_bRemoveCookie = true;
+				context.m_bRemoveCookie = true;
 			}
 		}
 	}
@@ -1467,16 +1622,30 @@ bool cWebemRequestHandler::CheckAuthentication(const std::string &sHost, const r
 	}
 
 	rep = reply::stock_reply(reply::unauthorized);
-	if (myWebem->m_bRemoveCookie)
+	if (context.m_bRemoveCookie)
 	{
 		send_remove_cookie(rep);
 	}
 	return false;
 }
 
-char *cWebemRequestHandler::strftime_t(const char *format, const time_t rawtime)
+bool cWebemRequestHandler::check_push_request(const std::string &sHost, const request& req, reply& rep)
+{
+	myWebem->ResetContext();
+	if (!CheckAuthentication(sHost, req, rep))
+		return false;
+	//pushed device lists are not filtered on shared devices
+	if (myWebem->Context().m_actualuser_rights != 2)
+	{
+		rep = reply::stock_reply(reply::forbidden);
+		return false;
+	}
+	return true;
+}
+
+std::string cWebemRequestHandler::strftime_t(const char *format, const time_t rawtime)
 {
-	static char buffer[1024];
+	char buffer[1024];
 	struct tm ltime;
 	localtime_r(&rawtime,&ltime);
 	strftime(buffer, sizeof(buffer), format, &ltime);
@@ -1487,14 +1656,14 @@ void cWebemRequestHandler::handle_request( const std::string &sHost, const reque
 {
 	//_log.Log(LOG_NORM, "www-request: %s", req.uri.c_str());
 	rep.bIsGZIP = false;
-	myWebem->m_bAddNewSession=false;
-	myWebem->m_bRemoveCookie=false;
-	myWebem->m_actsessionid = "";
+	myWebem->ResetContext();
+	WebEmRequestContext &context=myWebem->Context();
 
 	if (req.uri.find("json.htm") != std::string::npos)
 	{
 		if (req.uri.find("dologout") != std::string::npos)
 		{
+			boost::lock_guard<boost::mutex> l(myWebem->m_sessionsmutex);
 			//Remove session id based on cookie
 			const char *cookie;
 			cookie = request::get_req_header(&req, "Cookie");
@@ -1512,11 +1681,11 @@ void cWebemRequestHandler::handle_request( const std::string &sHost, const reque
 					}
 				}
 			}
-			myWebem->m_actsessionid = "";
-			myWebem->m_actualuser = "";
-			myWebem->m_actualuser_rights = -1;
+			context.m_actsessionid = "";
+			context.m_actualuser = "";
+			context.m_actualuser_rights = -1;
 			myWebem->m_bForceRelogin = true;
-			myWebem->m_bRemoveCookie = true;
+			context.m_bRemoveCookie = true;
 		}
 		else
 		{
@@ -1542,7 +1711,7 @@ void cWebemRequestHandler::handle_request( const std::string &sHost, const reque
 		//post actions only allowed when authenticated and user has admin rights
 		if (!CheckAuthentication(sHost, req, rep))
 			return;
-		if (myWebem->m_actualuser_rights != 2)
+		if (context.m_actualuser_rights != 2)
 		{
 			rep = reply::stock_reply(reply::forbidden);
 			return;
@@ -1595,14 +1764,15 @@ void cWebemRequestHandler::handle_request( const std::string &sHost, const reque
 			CompressWebOutput(req,rep);
 	}
 
-	if (myWebem->m_bAddNewSession == true)
+	boost::lock_guard<boost::mutex> l(myWebem->m_sessionsmutex);
+	if (context.m_bAddNewSession == true)
 	{
 		//Add new session ID
 		_tWebEmSession usession;
-		usession.username = myWebem->m_actualuser;
-		usession.rights = myWebem->m_actualuser_rights;
+		usession.username = context.m_actualuser;
+		usession.rights = context.m_actualuser_rights;
 		usession.lasttouch = mytime(NULL) + SESSION_TIMEOUT;
-		if (myWebem->m_bRemembermeUser)
+		if (context.m_bRemembermeUser)
 		{
 			//Extend session by a year
 			usession.lasttouch += (86400 * 365);
@@ -1613,28 +1783,28 @@ void cWebemRequestHandler::handle_request( const std::string &sHost, const reque
 		{
 			if (itt->Username == usession.username)
 			{
-				std::string sSID = generateSessionID(sHost, myWebem->m_actualuser, itt->Password);
+				std::string sSID = generateSessionID(sHost, context.m_actualuser, itt->Password);
 				myWebem->m_sessionids[sSID] = usession;
-				myWebem->m_actsessionid = sSID;
+				context.m_actsessionid = sSID;
 				send_cookie(rep, sSID, usession.lasttouch);
 				break;
 			}
 		}
 	}
-	else if (myWebem->m_bRemoveCookie == true)
+	else if (context.m_bRemoveCookie == true)
 	{
 		send_remove_cookie(rep);
 	}
-	else if (myWebem->m_actsessionid.size()>0)
+	else if (context.m_actsessionid.size()>0)
 	{
-		std::map<std::string, WebEmSession>::iterator itt = myWebem->m_sessionids.find(myWebem->m_actsessionid);
+		std::map<std::string, WebEmSession>::iterator itt = myWebem->m_sessionids.find(context.m_actsessionid);
 		if (itt != myWebem->m_sessionids.end())
 		{
 			time_t atime = mytime(NULL);
-			if (myWebem->m_sessionids[myWebem->m_actsessionid].lasttouch - 60 < atime)
+			if (myWebem->m_sessionids[context.m_actsessionid].lasttouch - 60 < atime)
 			{
-				myWebem->m_sessionids[myWebem->m_actsessionid].lasttouch = atime + SESSION_TIMEOUT;
-				send_cookie(rep, myWebem->m_actsessionid, myWebem->m_sessionids[myWebem->m_actsessionid].lasttouch);
+				myWebem->m_sessionids[context.m_actsessionid].lasttouch = atime + SESSION_TIMEOUT;
+				send_cookie(rep, context.m_actsessionid, myWebem->m_sessionids[context.m_actsessionid].lasttouch);
 			}
 		}
 	}
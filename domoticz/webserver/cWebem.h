@@ -2,6 +2,8 @@
 
 #include <map>
 #include <boost/function.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
 #include "server.hpp"
 
 namespace http {
@@ -33,6 +35,33 @@ namespace http {
 			int rights;
 		} WebEmSession;
 
+		//Produces a reply body piece by piece, returns false after the last piece
+		typedef boost::function< bool( std::string& ) > webem_content_source;
+
+		//State of the request that is handled by the calling thread
+		typedef struct _tWebEmRequestContext
+		{
+			std::string m_actualuser;
+			int m_actualuser_rights;
+			std::string m_actsessionid;
+			std::string m_lastRequestPath;
+			std::string m_outputfilename;
+			bool m_bAddNewSession;
+			bool m_bRemoveCookie;
+			bool m_bRemembermeUser;
+			std::multimap<std::string, std::string> myNameValues;
+			//set by a page function that streams its reply instead of returning it
+			webem_content_source m_contentSource;
+
+			_tWebEmRequestContext()
+			{
+				m_actualuser_rights = -1;
+				m_bAddNewSession = false;
+				m_bRemoveCookie = false;
+				m_bRemembermeUser = false;
+			}
+		} WebEmRequestContext;
+
 		typedef struct _tIPNetwork
 		{
 			uint32_t network;
@@ -110,8 +139,10 @@ namespace http {
 
 			  /// Handle a request and produce a reply.
 			  virtual void handle_request( const std::string &sHost, const request& req, reply& rep);
+			  /// Only admins may open the push channel
+			  virtual bool check_push_request(const std::string &sHost, const request& req, reply& rep);
 		private:
-			char *strftime_t(const char *format, const time_t rawtime);
+			std::string strftime_t(const char *format, const time_t rawtime);
 			bool CompressWebOutput(const request& req, reply& rep);
 			bool CheckAuthentication(const std::string &sHost, const request& req, reply& rep);
 			void send_authorization_request(reply& rep);
@@ -143,6 +174,11 @@ namespace http {
 			void Run();
 			void Stop();
 
+			//Server push to WebSocket/long-poll clients
+			void PushMessage(const std::string &message);
+			void PushPing();
+			bool HasPushClients();
+
 			void RegisterIncludeCode(
 				const char* idname,
 				webem_include_function fun );
@@ -167,8 +203,12 @@ namespace http {
 			void RegisterWhitelistURLString(const char* idname);
 
 			bool CheckForAction( request& req );
-			std::string& FindValue( const char* name );
-			bool HasParams() { return (myNameValues.size()>0); };
+			std::string FindValue( const char* name );
+			bool HasParams() { return (Context().myNameValues.size()>0); };
+
+			//Requests are handled by a pool of threads, each thread has its own request context
+			WebEmRequestContext &Context();
+			void ResetContext();
 
 			bool CheckForPageOverride(const request& req, reply& rep);
 			
@@ -184,18 +224,12 @@ namespace http {
 			std::string m_DigistRealm;
 			void SetZipPassword(std::string password);
 			std::string m_zippassword;
-			std::string m_actualuser;
-			int m_actualuser_rights;
 			std::string m_guestuser;
-			std::string m_lastRequestPath;
-			std::string m_outputfilename;
 			std::map<std::string,WebEmSession> m_sessionids;
-			std::string m_actsessionid;
 			_eAuthenticationMethod m_authmethod;
 			bool m_bForceRelogin;
-			bool m_bAddNewSession;
-			bool m_bRemoveCookie;
-			bool m_bRemembermeUser;
+			//protects the users, sessions and local networks
+			boost::mutex m_sessionsmutex;
 			//Whitelist url strings that bypass authentication checks (not used by basic-auth authentication)
 			std::vector < std::string > myWhitelistURLs;
 		private:
@@ -209,8 +243,8 @@ namespace http {
 			std::map < std::string, webem_page_function > myPages;
 			/// store map between pages and application functions
 			std::map < std::string, webem_page_function_w > myPages_w;
-			/// store map between pages and application functions (wide char)
-			std::multimap  < std::string, std::string> myNameValues;
+			/// per thread request state (user, session and form values)
+			boost::thread_specific_ptr<WebEmRequestContext> m_pContext;
 			/// request handler specialized to handle webem requests
 			cWebemRequestHandler myRequestHandler;
 			/// boost::asio web server
@@ -10,21 +10,72 @@
 #include "stdafx.h"
 #include "connection.hpp"
 #include <vector>
+#include <sstream>
 #include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/uuid/detail/sha1.hpp>
 #include "connection_manager.hpp"
+#include "push_manager.hpp"
 #include "request_handler.hpp"
+#include "Base64.h"
 #include "../main/localtime_r.h"
 
+//maximum number of queued push messages per client, a slower client gets a resync
+#define PUSH_MAX_QUEUE 64
+//maximum size of a frame received from a WebSocket client
+#define PUSH_MAX_FRAME_SIZE 65536
+//seconds a long-poll request waits for a message
+#define PUSH_LONGPOLL_TIMEOUT 30
+//seconds without any data from a WebSocket client before it is closed
+#define PUSH_PING_TIMEOUT 3*60
+
 namespace http {
 namespace server {
 
+static unsigned long long get_uri_number(const std::string &uri, const char *name)
+{
+	std::string sname=std::string(name)+"=";
+	size_t pos=uri.find("?"+sname);
+	if (pos==std::string::npos)
+		pos=uri.find("&"+sname);
+	if (pos==std::string::npos)
+		return 0;
+	return strtoull(uri.c_str()+pos+1+sname.size(), NULL, 10);
+}
+
+static std::string websocket_accept_key(const std::string &key)
+{
+	std::string src=key+"258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+	boost::uuids::detail::sha1 sha;
+	sha.process_bytes(src.data(), src.size());
+	unsigned int digest[5];
+	sha.get_digest(digest);
+	unsigned char hash[20];
+	for (int ii=0; ii<5; ii++)
+	{
+		hash[ii*4]=(unsigned char)((digest[ii]>>24)&0xFF);
+		hash[ii*4+1]=(unsigned char)((digest[ii]>>16)&0xFF);
+		hash[ii*4+2]=(unsigned char)((digest[ii]>>8)&0xFF);
+		hash[ii*4+3]=(unsigned char)(digest[ii]&0xFF);
+	}
+	return base64_encode(hash, 20);
+}
+
 connection::connection(boost::asio::io_service& io_service,
-    connection_manager& manager, request_handler& handler)
-  : socket_(io_service),
+    connection_manager& manager, push_manager& pmanager, request_handler& handler)
+  : strand_(io_service),
+    socket_(io_service),
     connection_manager_(manager),
-    request_handler_(handler)
+    push_manager_(pmanager),
+    request_handler_(handler),
+    longpoll_timer_(io_service)
 {
 	m_lastresponse=mytime(NULL);
+	mode_=mode_http;
+	push_writing_=false;
+	push_closing_=false;
+	push_since_=0;
+	push_seq_=0;
 }
 
 boost::asio::ip::tcp::socket& connection::socket()
@@ -37,13 +88,20 @@ void connection::start()
 	host_endpoint_ = socket_.remote_endpoint().address().to_string();
 
 	socket_.async_read_some(boost::asio::buffer(buffer_),
+		strand_.wrap(
 		boost::bind(&connection::handle_read, shared_from_this(),
         boost::asio::placeholders::error,
-        boost::asio::placeholders::bytes_transferred));
+        boost::asio::placeholders::bytes_transferred)));
 }
 
 void connection::stop()
 {
+  if (mode_!=mode_http)
+  {
+    push_manager_.unsubscribe(shared_from_this());
+    boost::system::error_code ignored_ec;
+    longpoll_timer_.cancel(ignored_ec);
+  }
   socket_.close();
 }
 
@@ -65,24 +123,47 @@ void connection::handle_read(const boost::system::error_code& e,
 
     if (result)
     {
-      request_handler_.handle_request(host_endpoint_, request_, reply_);
+      if (request_handler::is_push_request(request_))
+      {
+        if (request_handler_.check_push_request(host_endpoint_, request_, reply_))
+        {
+          start_push();
+          return;
+        }
+      }
+      else
+      {
+        request_handler_.handle_request(host_endpoint_, request_, reply_);
+        if (reply_.content_source)
+        {
+          //send the headers, the body follows chunk by chunk
+          boost::asio::async_write(socket_, reply_.to_buffers(),
+              strand_.wrap(
+              boost::bind(&connection::handle_write_chunk, shared_from_this(),
+                boost::asio::placeholders::error)));
+          return;
+        }
+      }
       boost::asio::async_write(socket_, reply_.to_buffers(),
+          strand_.wrap(
           boost::bind(&connection::handle_write, shared_from_this(),
-            boost::asio::placeholders::error));
+            boost::asio::placeholders::error)));
     }
     else if (!result)
     {
       reply_ = reply::stock_reply(reply::bad_request);
       boost::asio::async_write(socket_, reply_.to_buffers(),
+          strand_.wrap(
           boost::bind(&connection::handle_write, shared_from_this(),
-            boost::asio::placeholders::error));
+            boost::asio::placeholders::error)));
     }
     else
     {
       socket_.async_read_some(boost::asio::buffer(buffer_),
+          strand_.wrap(
           boost::bind(&connection::handle_read, shared_from_this(),
             boost::asio::placeholders::error,
-            boost::asio::placeholders::bytes_transferred));
+            boost::asio::placeholders::bytes_transferred)));
     }
   }
   else if (e != boost::asio::error::operation_aborted)
@@ -107,5 +188,358 @@ void connection::handle_write(const boost::system::error_code& e)
   m_lastresponse=mytime(NULL);
 }
 
+void connection::handle_write_chunk(const boost::system::error_code& e)
+{
+  if (e)
+  {
+    reply_.content_source.clear();
+    handle_write(e);
+    return;
+  }
+  std::string data;
+  bool bMore;
+  try
+  {
+    bMore=reply_.content_source(data);
+  }
+  catch (...)
+  {
+    //drop the connection without the last chunk, the client sees an incomplete reply
+    reply_.content_source.clear();
+    connection_manager_.stop(shared_from_this());
+    return;
+  }
+  chunk_buffer_.clear();
+  if (!data.empty())
+  {
+    char szSize[20];
+    sprintf(szSize, "%X\r\n", (unsigned int)data.size());
+    chunk_buffer_=szSize;
+    chunk_buffer_.append(data);
+    chunk_buffer_.append("\r\n");
+  }
+  m_lastresponse=mytime(NULL);
+  if (!bMore)
+  {
+    reply_.content_source.clear();
+    chunk_buffer_.append("0\r\n\r\n");
+    boost::asio::async_write(socket_, boost::asio::buffer(chunk_buffer_),
+        strand_.wrap(
+        boost::bind(&connection::handle_write, shared_from_this(),
+          boost::asio::placeholders::error)));
+    return;
+  }
+  boost::asio::async_write(socket_, boost::asio::buffer(chunk_buffer_),
+      strand_.wrap(
+      boost::bind(&connection::handle_write_chunk, shared_from_this(),
+        boost::asio::placeholders::error)));
+}
+
+void connection::start_push()
+{
+	push_since_=get_uri_number(request_.uri, "since");
+
+	const char *upgrade=request::get_req_header(&request_, "Upgrade");
+	const char *key=request::get_req_header(&request_, "Sec-WebSocket-Key");
+	if ((upgrade!=NULL)&&(key!=NULL)&&(request::mg_strcasecmp(upgrade, "websocket")==0))
+	{
+		mode_=mode_websocket;
+		reply_.status=reply::switching_protocols;
+		reply_.content.clear();
+		reply_.headers.resize(3);
+		reply_.headers[0].name="Upgrade";
+		reply_.headers[0].value="websocket";
+		reply_.headers[1].name="Connection";
+		reply_.headers[1].value="Upgrade";
+		reply_.headers[2].name="Sec-WebSocket-Accept";
+		reply_.headers[2].value=websocket_accept_key(key);
+		boost::asio::async_write(socket_, reply_.to_buffers(),
+			strand_.wrap(
+			boost::bind(&connection::handle_websocket_handshake, shared_from_this(),
+			boost::asio::placeholders::error)));
+		return;
+	}
+
+	//Long-poll, reply as soon as there is a message or when the request expires
+	mode_=mode_longpoll;
+	int timeout=(int)get_uri_number(request_.uri, "timeout");
+	if ((timeout<1)||(timeout>PUSH_LONGPOLL_TIMEOUT))
+		timeout=PUSH_LONGPOLL_TIMEOUT;
+	{
+		boost::lock_guard<boost::mutex> l(push_mutex_);
+		push_seq_=push_since_;
+	}
+	unsigned long long seq=push_manager_.subscribe(shared_from_this(), push_since_);
+	{
+		boost::lock_guard<boost::mutex> l(push_mutex_);
+		if (push_seq_==0)
+			push_seq_=seq;
+	}
+	longpoll_timer_.expires_from_now(boost::posix_time::seconds(timeout));
+	longpoll_timer_.async_wait(
+		strand_.wrap(
+		boost::bind(&connection::handle_longpoll_timeout, shared_from_this(),
+		boost::asio::placeholders::error)));
+}
+
+void connection::handle_websocket_handshake(const boost::system::error_code& e)
+{
+	if (e)
+	{
+		if (e != boost::asio::error::operation_aborted)
+			connection_manager_.stop(shared_from_this());
+		return;
+	}
+	push_manager_.subscribe(shared_from_this(), push_since_);
+	socket_.async_read_some(boost::asio::buffer(buffer_),
+		strand_.wrap(
+		boost::bind(&connection::handle_websocket_read, shared_from_this(),
+		boost::asio::placeholders::error,
+		boost::asio::placeholders::bytes_transferred)));
+}
+
+void connection::handle_websocket_read(const boost::system::error_code& e,
+    std::size_t bytes_transferred)
+{
+	if (e)
+	{
+		if (e != boost::asio::error::operation_aborted)
+			connection_manager_.stop(shared_from_this());
+		return;
+	}
+	m_lastresponse=mytime(NULL);
+	websocket_buffer_.append(buffer_.data(), bytes_transferred);
+
+	//Handle all complete frames, frames from a client are always masked
+	while (websocket_buffer_.size()>=2)
+	{
+		const unsigned char *pData=(const unsigned char*)websocket_buffer_.data();
+		unsigned char opcode=pData[0]&0x0F;
+		bool bMasked=((pData[1]&0x80)!=0);
+		unsigned long long len=pData[1]&0x7F;
+		size_t hlen=2;
+		if (len==126)
+		{
+			if (websocket_buffer_.size()<4)
+				break;
+			len=(pData[2]<<8)|pData[3];
+			hlen=4;
+		}
+		else if (len==127)
+		{
+			if (websocket_buffer_.size()<10)
+				break;
+			len=0;
+			for (int ii=0; ii<8; ii++)
+				len=(len<<8)|pData[2+ii];
+			hlen=10;
+		}
+		if ((!bMasked)||(len>PUSH_MAX_FRAME_SIZE))
+		{
+			connection_manager_.stop(shared_from_this());
+			return;
+		}
+		if (websocket_buffer_.size()<hlen+4+len)
+			break;
+		std::string payload=websocket_buffer_.substr(hlen+4, (size_t)len);
+		for (size_t ii=0; ii<payload.size(); ii++)
+			payload[ii]^=pData[hlen+(ii%4)];
+		websocket_buffer_.erase(0, hlen+4+(size_t)len);
+
+		boost::lock_guard<boost::mutex> l(push_mutex_);
+		if (push_closing_)
+			return;
+		if (opcode==0x8)
+		{
+			//Close, echo it and close the connection when the queue is sent
+			queue_frame(0x8, payload.substr(0, 2));
+			push_closing_=true;
+			start_push_write();
+			return;
+		}
+		else if (opcode==0x9)
+		{
+			queue_frame(0xA, payload);
+			start_push_write();
+		}
+		//the push channel is one way, text/binary/pong frames are ignored
+	}
+
+	socket_.async_read_some(boost::asio::buffer(buffer_),
+		strand_.wrap(
+		boost::bind(&connection::handle_websocket_read, shared_from_this(),
+		boost::asio::placeholders::error,
+		boost::asio::placeholders::bytes_transferred)));
+}
+
+void connection::push(const unsigned long long seq, const std::string& message)
+{
+	boost::lock_guard<boost::mutex> l(push_mutex_);
+	if (push_closing_)
+		return;
+	if (push_queue_.size()>=PUSH_MAX_QUEUE)
+	{
+		//Slow client, drop its backlog, it has to reload its state
+		push_queue_.clear();
+		if (mode_==mode_websocket)
+			queue_frame(0x1, push_manager::resync_message(seq));
+		else
+			push_queue_.push_back(push_manager::resync_message(seq));
+	}
+	else if (mode_==mode_websocket)
+		queue_frame(0x1, message);
+	else
+		push_queue_.push_back(message);
+	push_seq_=seq;
+	start_push_write();
+}
+
+void connection::push_ping()
+{
+	//m_lastresponse and mode_ are written by the handlers on the strand
+	strand_.post(boost::bind(&connection::do_push_ping, shared_from_this()));
+}
+
+void connection::do_push_ping()
+{
+	if (mode_!=mode_websocket)
+		return;
+	if (mytime(NULL)-m_lastresponse>PUSH_PING_TIMEOUT)
+	{
+		connection_manager_.stop(shared_from_this());
+		return;
+	}
+	boost::lock_guard<boost::mutex> l(push_mutex_);
+	if (push_closing_)
+		return;
+	queue_frame(0x9, "");
+	start_push_write();
+}
+
+void connection::queue_frame(const unsigned char opcode, const std::string& payload)
+{
+	std::string frame;
+	frame.reserve(payload.size()+10);
+	frame+=(char)(0x80|opcode);
+	size_t len=payload.size();
+	if (len<126)
+		frame+=(char)len;
+	else if (len<65536)
+	{
+		frame+=(char)126;
+		frame+=(char)((len>>8)&0xFF);
+		frame+=(char)(len&0xFF);
+	}
+	else
+	{
+		frame+=(char)127;
+		for (int ii=7; ii>=0; ii--)
+			frame+=(char)(((unsigned long long)len>>(ii*8))&0xFF);
+	}
+	frame+=payload;
+	push_queue_.push_back(frame);
+}
+
+void connection::start_push_write()
+{
+	if (push_writing_)
+		return;
+	push_writing_=true;
+	strand_.post(boost::bind(&connection::do_push_write, shared_from_this()));
+}
+
+void connection::do_push_write()
+{
+	if (mode_==mode_longpoll)
+	{
+		std::stringstream sstr;
+		{
+			boost::lock_guard<boost::mutex> l(push_mutex_);
+			if (push_closing_)
+				return;
+			push_closing_=true;
+			//PushSeq is the push channel sequence (since= of the next request), ActSeq in the messages is the change journal one
+			sstr << "{\"status\":\"OK\",\"title\":\"Push\",\"PushSeq\":" << push_seq_ << ",\"result\":[";
+			for (size_t ii=0; ii<push_queue_.size(); ii++)
+			{
+				if (ii!=0)
+					sstr << ",";
+				sstr << push_queue_[ii];
+			}
+			sstr << "]}";
+			push_queue_.clear();
+		}
+		boost::system::error_code ignored_ec;
+		longpoll_timer_.cancel(ignored_ec);
+		push_manager_.unsubscribe(shared_from_this());
+
+		reply_.status=reply::ok;
+		reply_.content=sstr.str();
+		reply_.headers.resize(3);
+		reply_.headers[0].name="Content-Length";
+		reply_.headers[0].value=boost::lexical_cast<std::string>(reply_.content.size());
+		reply_.headers[1].name="Content-Type";
+		reply_.headers[1].value="application/json;charset=UTF-8";
+		reply_.headers[2].name="Cache-Control";
+		reply_.headers[2].value="no-cache";
+		boost::asio::async_write(socket_, reply_.to_buffers(),
+			strand_.wrap(
+			boost::bind(&connection::handle_write, shared_from_this(),
+			boost::asio::placeholders::error)));
+		return;
+	}
+
+	{
+		boost::lock_guard<boost::mutex> l(push_mutex_);
+		if (push_queue_.empty())
+		{
+			push_writing_=false;
+			return;
+		}
+		push_write_buffer_.swap(push_queue_.front());
+		push_queue_.pop_front();
+	}
+	boost::asio::async_write(socket_, boost::asio::buffer(push_write_buffer_),
+		strand_.wrap(
+		boost::bind(&connection::handle_push_write, shared_from_this(),
+		boost::asio::placeholders::error)));
+}
+
+void connection::handle_push_write(const boost::system::error_code& e)
+{
+	if (e)
+	{
+		if (e != boost::asio::error::operation_aborted)
+			connection_manager_.stop(shared_from_this());
+		return;
+	}
+	bool bClosed=false;
+	{
+		boost::lock_guard<boost::mutex> l(push_mutex_);
+		bClosed=(push_closing_&&push_queue_.empty());
+	}
+	if (bClosed)
+	{
+		boost::system::error_code ignored_ec;
+		socket_.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ignored_ec);
+		connection_manager_.stop(shared_from_this());
+		return;
+	}
+	do_push_write();
+}
+
+void connection::handle_longpoll_timeout(const boost::system::error_code& e)
+{
+	if (e == boost::asio::error::operation_aborted)
+		return;
+	{
+		boost::lock_guard<boost::mutex> l(push_mutex_);
+		if (push_writing_)
+			return;
+		push_writing_=true;
+	}
+	do_push_write();
+}
+
 } // namespace server
 } // namespace http
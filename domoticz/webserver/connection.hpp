@@ -11,8 +11,10 @@
 #ifndef HTTP_CONNECTION_HPP
 #define HTTP_CONNECTION_HPP
 
+#include <deque>
 #include <boost/asio.hpp>
 #include <boost/array.hpp>
+#include <boost/thread/mutex.hpp>
 #include <boost/noncopyable.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/enable_shared_from_this.hpp>
@@ -25,6 +27,7 @@ namespace http {
 namespace server {
 
 class connection_manager;
+class push_manager;
 
 /// Represents a single connection from a client.
 class connection
@@ -34,7 +37,7 @@ class connection
 public:
   /// Construct a connection with the given io_service.
   explicit connection(boost::asio::io_service& io_service,
-      connection_manager& manager, request_handler& handler);
+      connection_manager& manager, push_manager& pmanager, request_handler& handler);
 
   /// Get the socket associated with the connection.
   boost::asio::ip::tcp::socket& socket();
@@ -45,10 +48,52 @@ public:
   /// Stop all asynchronous operations associated with the connection.
   void stop();
 
+  /// Queue a push message for this client (WebSocket frame or long-poll
+  /// reply). Never blocks, when the queue is full it is replaced by a resync.
+  void push(const unsigned long long seq, const std::string& message);
+
+  /// Send a WebSocket ping, closes the connection when the client stopped answering.
+  void push_ping();
+
   /// Last user interaction
   time_t m_lastresponse;
 
 private:
+  enum _eConnectionMode
+  {
+    mode_http=0,
+    mode_websocket,
+    mode_longpoll
+  };
+
+  /// Switch the connection to push mode (WebSocket upgrade or long-poll).
+  void start_push();
+
+  /// Handle completion of the WebSocket handshake reply.
+  void handle_websocket_handshake(const boost::system::error_code& e);
+
+  /// Handle incoming WebSocket frames.
+  void handle_websocket_read(const boost::system::error_code& e,
+      std::size_t bytes_transferred);
+
+  /// Ping check, runs on the strand.
+  void do_push_ping();
+
+  /// Queue a WebSocket frame (called with push_mutex_ locked).
+  void queue_frame(const unsigned char opcode, const std::string& payload);
+
+  /// Start writing the queue if no write is in progress (called with push_mutex_ locked).
+  void start_push_write();
+
+  /// Write the next queued push message.
+  void do_push_write();
+
+  /// Handle completion of a push write.
+  void handle_push_write(const boost::system::error_code& e);
+
+  /// Long-poll request without messages expired.
+  void handle_longpoll_timeout(const boost::system::error_code& e);
+
   /// Handle completion of a read operation.
   void handle_read(const boost::system::error_code& e,
       std::size_t bytes_transferred);
@@ -56,6 +101,12 @@ private:
   /// Handle completion of a write operation.
   void handle_write(const boost::system::error_code& e);
 
+  /// Write the next chunk of a streamed reply.
+  void handle_write_chunk(const boost::system::error_code& e);
+
+  /// Strand to ensure the connection's handlers are not called concurrently.
+  boost::asio::io_service::strand strand_;
+
   /// Socket for the connection.
   boost::asio::ip::tcp::socket socket_;
   //Host EndPoint
@@ -64,6 +115,9 @@ private:
   /// The manager for this connection.
   connection_manager& connection_manager_;
 
+  /// The push message fan-out.
+  push_manager& push_manager_;
+
   /// The handler used to process the incoming request.
   request_handler& request_handler_;
 
@@ -78,6 +132,25 @@ private:
 
   /// The reply to be sent back to the client.
   reply reply_;
+
+  /// Chunk of a streamed reply that is being written.
+  std::string chunk_buffer_;
+
+  /// Push state, push() is called from the publishing thread.
+  _eConnectionMode mode_;
+  boost::mutex push_mutex_;
+  std::deque<std::string> push_queue_;
+  std::string push_write_buffer_;
+  bool push_writing_;
+  bool push_closing_;
+  unsigned long long push_since_;
+  unsigned long long push_seq_;
+
+  /// Incoming WebSocket data that did not form a complete frame yet.
+  std::string websocket_buffer_;
+
+  /// Long-poll expiry.
+  boost::asio::deadline_timer longpoll_timer_;
 };
 
 typedef boost::shared_ptr<connection> connection_ptr;
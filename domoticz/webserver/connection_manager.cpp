@@ -10,6 +10,7 @@
 #include "stdafx.h"
 #include "connection_manager.hpp"
 #include <algorithm>
+#include <vector>
 #include <boost/bind.hpp>
 #include <iostream>
 #include "../main/Logger.h"
@@ -20,14 +21,17 @@ namespace server {
 
 void connection_manager::start(connection_ptr c)
 {
-  connections_.insert(c);
-  std::string s = c->socket().remote_endpoint().address().to_string();
-
-  if (connectedips_.find(s)==connectedips_.end())
   {
-	  //ok, this could get a very long list when running for years
-	  connectedips_.insert(s);
-	  _log.Log(LOG_STATUS,"Incoming connection from: %s", s.c_str());
+	  boost::lock_guard<boost::mutex> l(mutex_);
+	  connections_.insert(c);
+	  std::string s = c->socket().remote_endpoint().address().to_string();
+
+	  if (connectedips_.find(s)==connectedips_.end())
+	  {
+		  //ok, this could get a very long list when running for years
+		  connectedips_.insert(s);
+		  _log.Log(LOG_STATUS,"Incoming connection from: %s", s.c_str());
+	  }
   }
 
   c->start();
@@ -35,29 +39,40 @@ void connection_manager::start(connection_ptr c)
 
 void connection_manager::stop(connection_ptr c)
 {
-	connections_.erase(c);
+	{
+		boost::lock_guard<boost::mutex> l(mutex_);
+		connections_.erase(c);
+	}
 	c->stop();
 }
 
 void connection_manager::stop_all()
 {
-  std::for_each(connections_.begin(), connections_.end(),
+  std::set<connection_ptr> connections;
+  {
+	  boost::lock_guard<boost::mutex> l(mutex_);
+	  connections.swap(connections_);
+  }
+  std::for_each(connections.begin(), connections.end(),
       boost::bind(&connection::stop, _1));
-  connections_.clear();
 }
 
 void connection_manager::check_timeouts()
 {
 	time_t atime=mytime(NULL);
-	std::set<connection_ptr>::const_iterator itt;
-	for (itt=connections_.begin(); itt!=connections_.end(); ++itt)
+	std::vector<connection_ptr> expired;
 	{
-		if (atime-(*itt)->m_lastresponse>20*60)
+		boost::lock_guard<boost::mutex> l(mutex_);
+		std::set<connection_ptr>::const_iterator itt;
+		for (itt=connections_.begin(); itt!=connections_.end(); ++itt)
 		{
-			stop(*itt);
-			itt=connections_.begin();
+			if (atime-(*itt)->m_lastresponse>20*60)
+				expired.push_back(*itt);
 		}
 	}
+	std::vector<connection_ptr>::const_iterator itt;
+	for (itt=expired.begin(); itt!=expired.end(); ++itt)
+		stop(*itt);
 }
 
 } // namespace server
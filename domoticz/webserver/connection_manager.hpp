@@ -13,6 +13,7 @@
 
 #include <set>
 #include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
 #include "connection.hpp"
 
 namespace http {
@@ -40,6 +41,8 @@ private:
   /// The managed connections.
   std::set<connection_ptr> connections_;
   std::set<std::string> connectedips_;
+  /// Connections are started and stopped from several threads.
+  boost::mutex mutex_;
 };
 
 } // namespace server
@@ -0,0 +1,109 @@
+//
+// push_manager.cpp
+// ~~~~~~~~~~~~~~~~
+//
+// Fan-out of server push messages to WebSocket and long-poll clients.
+//
+#include "stdafx.h"
+#include "push_manager.hpp"
+#include <sstream>
+#include "../main/localtime_r.h"
+
+//number of published messages kept for reconnecting long-poll clients
+#define PUSH_HISTORY_SIZE 256
+//keep publishing this long after the last subscriber left (long-poll clients reconnect)
+#define PUSH_ACTIVE_TIMEOUT 5*60
+
+namespace http {
+namespace server {
+
+push_manager::push_manager()
+{
+	//Start the sequence at the startup time, so sequence numbers of a previous run are detected as stale
+	base_seq_=(unsigned long long)mytime(NULL)*1000;
+	seq_=base_seq_;
+	last_active_=0;
+}
+
+unsigned long long push_manager::publish(const std::string& data)
+{
+	boost::lock_guard<boost::mutex> l(mutex_);
+	seq_++;
+	std::stringstream sstr;
+	sstr << "{\"seq\":" << seq_ << ",\"data\":" << data << "}";
+	std::string message=sstr.str();
+
+	history_.push_back(std::pair<unsigned long long, std::string>(seq_, message));
+	while (history_.size()>PUSH_HISTORY_SIZE)
+		history_.pop_front();
+
+	//connection::push only queues the message, it never blocks on the socket
+	std::set<connection_ptr>::const_iterator itt;
+	for (itt=subscribers_.begin(); itt!=subscribers_.end(); ++itt)
+		(*itt)->push(seq_, message);
+	if (!subscribers_.empty())
+		last_active_=mytime(NULL);
+	return seq_;
+}
+
+unsigned long long push_manager::subscribe(connection_ptr c, const unsigned long long since)
+{
+	boost::lock_guard<boost::mutex> l(mutex_);
+	if ((since!=0)&&(since!=seq_))
+	{
+		if (
+			(since<base_seq_)||
+			(since>seq_)||
+			(history_.empty())||
+			(since<history_.front().first-1)
+			)
+		{
+			c->push(seq_, resync_message(seq_));
+		}
+		else
+		{
+			std::deque<std::pair<unsigned long long, std::string> >::const_iterator itt;
+			for (itt=history_.begin(); itt!=history_.end(); ++itt)
+			{
+				if (itt->first>since)
+					c->push(itt->first, itt->second);
+			}
+		}
+	}
+	subscribers_.insert(c);
+	last_active_=mytime(NULL);
+	return seq_;
+}
+
+void push_manager::unsubscribe(connection_ptr c)
+{
+	boost::lock_guard<boost::mutex> l(mutex_);
+	if (subscribers_.erase(c)!=0)
+		last_active_=mytime(NULL);
+}
+
+void push_manager::ping()
+{
+	boost::lock_guard<boost::mutex> l(mutex_);
+	std::set<connection_ptr>::const_iterator itt;
+	for (itt=subscribers_.begin(); itt!=subscribers_.end(); ++itt)
+		(*itt)->push_ping();
+}
+
+bool push_manager::is_active()
+{
+	boost::lock_guard<boost::mutex> l(mutex_);
+	if (!subscribers_.empty())
+		return true;
+	return (mytime(NULL)-last_active_<PUSH_ACTIVE_TIMEOUT);
+}
+
+std::string push_manager::resync_message(const unsigned long long seq)
+{
+	std::stringstream sstr;
+	sstr << "{\"seq\":" << seq << ",\"resync\":true}";
+	return sstr.str();
+}
+
+} // namespace server
+} // namespace http
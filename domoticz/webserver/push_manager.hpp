@@ -0,0 +1,73 @@
+//
+// push_manager.hpp
+// ~~~~~~~~~~~~~~~~
+//
+// Fan-out of server push messages to WebSocket and long-poll clients.
+//
+
+#ifndef HTTP_PUSH_MANAGER_HPP
+#define HTTP_PUSH_MANAGER_HPP
+
+#include <set>
+#include <deque>
+#include <string>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+#include "connection.hpp"
+
+namespace http {
+namespace server {
+
+/// Distributes published messages to all subscribed connections. Every
+/// connection has its own bounded queue, so a slow client never stalls
+/// the publisher.
+class push_manager
+  : private boost::noncopyable
+{
+public:
+  push_manager();
+
+  /// Publish a message (json text) to all subscribers, returns its sequence number.
+  unsigned long long publish(const std::string& data);
+
+  /// Add a subscriber. Messages after 'since' that are still in the history
+  /// are delivered first, if 'since' is too old the client gets a resync
+  /// message. since=0 only delivers new messages. Returns the current sequence number.
+  unsigned long long subscribe(connection_ptr c, const unsigned long long since);
+
+  /// Remove a subscriber.
+  void unsubscribe(connection_ptr c);
+
+  /// Ping all WebSocket subscribers, clients that stopped answering are closed.
+  void ping();
+
+  /// True when there are (or recently were) subscribers.
+  bool is_active();
+
+  /// Build the message that tells a client to reload its full state.
+  static std::string resync_message(const unsigned long long seq);
+
+private:
+  /// Protects the subscribers and history.
+  boost::mutex mutex_;
+
+  /// The subscribed connections.
+  std::set<connection_ptr> subscribers_;
+
+  /// The last published messages, for long-poll clients that reconnect.
+  std::deque<std::pair<unsigned long long, std::string> > history_;
+
+  /// Sequence number of the last published message.
+  unsigned long long seq_;
+
+  /// First sequence number of this run.
+  unsigned long long base_seq_;
+
+  /// Last time there was a subscriber.
+  time_t last_active_;
+};
+
+} // namespace server
+} // namespace http
+
+#endif // HTTP_PUSH_MANAGER_HPP
@@ -17,8 +17,12 @@ namespace server {
 
 namespace status_strings {
 
+const std::string switching_protocols =
+  "HTTP/1.1 101 Switching Protocols\r\n";
 const std::string ok =
   "HTTP/1.0 200 OK\r\n";
+const std::string ok_chunked =
+  "HTTP/1.1 200 OK\r\n";
 const std::string created =
   "HTTP/1.0 201 Created\r\n";
 const std::string accepted =
@@ -54,6 +58,8 @@ boost::asio::const_buffer to_buffer(reply::status_type status)
 {
   switch (status)
   {
+  case reply::switching_protocols:
+    return boost::asio::buffer(switching_protocols);
   case reply::ok:
     return boost::asio::buffer(ok);
   case reply::created:
@@ -103,7 +109,11 @@ const char crlf[] = { '\r', '\n' };
 std::vector<boost::asio::const_buffer> reply::to_buffers()
 {
   std::vector<boost::asio::const_buffer> buffers;
-  buffers.push_back(status_strings::to_buffer(status));
+  //chunked transfer encoding needs a HTTP/1.1 status line
+  if ((content_source)&&(status == reply::ok))
+    buffers.push_back(boost::asio::buffer(status_strings::ok_chunked));
+  else
+    buffers.push_back(status_strings::to_buffer(status));
   for (std::size_t i = 0; i < headers.size(); ++i)
   {
     header& h = headers[i];
@@ -113,7 +123,8 @@ std::vector<boost::asio::const_buffer> reply::to_buffers()
     buffers.push_back(boost::asio::buffer(misc_strings::crlf));
   }
   buffers.push_back(boost::asio::buffer(misc_strings::crlf));
-  buffers.push_back(boost::asio::buffer(content));
+  if (!content_source)
+    buffers.push_back(boost::asio::buffer(content));
   return buffers;
 }
 
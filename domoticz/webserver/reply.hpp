@@ -14,6 +14,7 @@
 #include <string>
 #include <vector>
 #include <boost/asio.hpp>
+#include <boost/function.hpp>
 #include "header.hpp"
 
 namespace http {
@@ -25,6 +26,7 @@ struct reply
   /// The status of the reply.
   enum status_type
   {
+    switching_protocols = 101,
     ok = 200,
     created = 201,
     accepted = 202,
@@ -50,6 +52,11 @@ struct reply
   std::string content;
   bool bIsGZIP;
 
+  /// When set the body is produced while it is written: every call appends
+  /// the next piece and returns false after the last one. Such a reply is
+  /// sent with chunked transfer encoding, content is not used.
+  boost::function<bool (std::string&)> content_source;
+
   /// Convert the reply into a vector of buffers. The buffers do not own the
   /// underlying memory blocks, therefore the reply object must remain valid and
   /// not be changed until the write operation has completed.
@@ -190,6 +190,7 @@ void request_handler::handle_request(const std::string &sHost, const request& re
 #ifndef WEBSERVER_DONT_USE_ZIP
   else
   {
+	  boost::lock_guard<boost::mutex> l(m_zipmutex);
 	  if (m_uf==NULL)
 	  {
 		  rep = reply::stock_reply(reply::not_found);
@@ -243,6 +244,18 @@ void request_handler::handle_request(const std::string &sHost, const request& re
   }
 }
 
+bool request_handler::is_push_request(const request& req)
+{
+  std::string path = req.uri.substr(0, req.uri.find('?'));
+  return (path == "/push");
+}
+
+bool request_handler::check_push_request(const std::string &sHost, const request& req, reply& rep)
+{
+  rep = reply::stock_reply(reply::not_found);
+  return false;
+}
+
 bool request_handler::url_decode(const std::string& in, std::string& out)
 {
   out.clear();
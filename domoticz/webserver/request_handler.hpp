@@ -14,6 +14,7 @@
 #include <string>
 #include <vector>
 #include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
 #ifndef WEBSERVER_DONT_USE_ZIP
 	#include "zip/unzip.h"
 	#define USEWIN32IOAPI
@@ -39,6 +40,12 @@ public:
   /// Handle a request and produce a reply.
   virtual void handle_request(const std::string &sHost, const request& req, reply& rep);
 
+  /// Is this a request for the push channel (/push, WebSocket or long-poll).
+  static bool is_push_request(const request& req);
+
+  /// Check if the client may open the push channel, fills rep when not.
+  virtual bool check_push_request(const std::string &sHost, const request& req, reply& rep);
+
   /// Perform URL-decoding on a string. Returns false if the encoding was
   /// invalid.
   static bool url_decode(const std::string& in, std::string& out);
@@ -54,6 +61,8 @@ private:
 	  unzFile m_uf;
 	  bool m_bIsZIP;
 	  void *m_pUnzipBuffer;
+	  //the zip file and buffer are shared by the request threads
+	  boost::mutex m_zipmutex;
 	  int do_extract_currentfile(unzFile uf, const char* password, std::string &outputstr);
 #endif
 };
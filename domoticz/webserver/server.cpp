@@ -10,17 +10,20 @@
 #include "stdafx.h"
 #include "server.hpp"
 #include <boost/bind.hpp>
+#include "../main/Logger.h"
 
 namespace http {
 namespace server {
 
 server::server(const std::string& address, const std::string& port,
-    request_handler& user_request_handler )
-  : io_service_(),
+    request_handler& user_request_handler, std::size_t thread_pool_size )
+  : thread_pool_size_(thread_pool_size),
+    io_service_(),
     acceptor_(io_service_),
     connection_manager_(),
+    push_manager_(),
     new_connection_(new connection(io_service_,
-          connection_manager_, request_handler_)),
+          connection_manager_, push_manager_, request_handler_)),
     request_handler_( user_request_handler)
 {
   // Open the acceptor with the option to reuse the address (i.e. SO_REUSEADDR).
@@ -42,7 +45,35 @@ void server::run()
   // have finished. While the server is running, there is always at least one
   // asynchronous operation outstanding: the asynchronous accept call waiting
   // for new incoming connections.
-  io_service_.run();
+  std::vector<boost::shared_ptr<boost::thread> > threads;
+  for (std::size_t i = 1; i < thread_pool_size_; ++i)
+  {
+    boost::shared_ptr<boost::thread> thread(new boost::thread(
+          boost::bind(&server::run_thread, this)));
+    threads.push_back(thread);
+  }
+  run_thread();
+
+  // Wait for all threads in the pool to exit.
+  for (std::size_t i = 0; i < threads.size(); ++i)
+    threads[i]->join();
+}
+
+void server::run_thread()
+{
+  while (true)
+  {
+    try
+    {
+      io_service_.run();
+      break;
+    }
+    catch (...)
+    {
+      // A failing request handler should not take a thread out of the pool
+      _log.Log(LOG_ERROR, "WebServer: exception in request handler, continuing...");
+    }
+  }
 }
 
 void server::stop()
@@ -58,7 +89,7 @@ void server::handle_accept(const boost::system::error_code& e)
   {
     connection_manager_.start(new_connection_);
     new_connection_.reset(new connection(io_service_,
-          connection_manager_, request_handler_));
+          connection_manager_, push_manager_, request_handler_));
     acceptor_.async_accept(new_connection_->socket(),
         boost::bind(&server::handle_accept, this,
           boost::asio::placeholders::error));
@@ -13,9 +13,13 @@
 
 #include <boost/asio.hpp>
 #include <string>
+#include <vector>
 #include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
 #include "connection.hpp"
 #include "connection_manager.hpp"
+#include "push_manager.hpp"
 #include "request_handler.hpp"
 
 namespace http {
@@ -27,16 +31,21 @@ class server
 {
 public:
   /// Construct the server to listen on the specified TCP address and port, and
-  /// serve up files from the given directory.
+  /// serve up files from the given directory. Requests are handled by
+  /// thread_pool_size threads.
   explicit server(const std::string& address, const std::string& port,
-      request_handler& user_request_handler );
+      request_handler& user_request_handler, std::size_t thread_pool_size = 1 );
 
-  /// Run the server's io_service loop.
+  /// Run the server's io_service loop on the thread pool, the calling thread
+  /// is part of the pool. Returns when the server is stopped.
   void run();
 
   /// Stop the server.
   void stop();
 
+  /// The fan-out for push (WebSocket/long-poll) clients.
+  push_manager& get_push_manager() { return push_manager_; }
+
 private:
   /// Handle completion of an asynchronous accept operation.
   void handle_accept(const boost::system::error_code& e);
@@ -44,6 +53,12 @@ private:
   /// Handle a request to stop the server.
   void handle_stop();
 
+  /// Run the io_service loop for one thread of the pool.
+  void run_thread();
+
+  /// The number of threads that will call io_service::run().
+  std::size_t thread_pool_size_;
+
   /// The io_service used to perform asynchronous operations.
   boost::asio::io_service io_service_;
 
@@ -53,6 +68,9 @@ private:
   /// The connection manager which owns all live connections.
   connection_manager connection_manager_;
 
+  /// The push message fan-out.
+  push_manager push_manager_;
+
   /// The handler for all incoming requests.
   request_handler& request_handler_;
 